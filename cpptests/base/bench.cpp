@@ -0,0 +1,387 @@
+// Microbenchmarks of libs/base, built for the host: strings, number formatting and parsing,
+// maps, arrays, buffers, allocation and GC pauses. The results go to stdout as JSON, one entry
+// per benchmark, so that runs of different releases can be compared; the numbers are the best
+// of a few runs, in ns per operation.
+//
+//   make bench                 # all of them
+//   make bench ARGS=string     # only those whose name starts with "string"
+
+#include "pxt.h"
+#include <string.h>
+#include <time.h>
+
+namespace String_ {
+String concat(String s, String other);
+TNumber charCodeAt(String s, int pos);
+int indexOf(String s, String searchString, int start);
+TNumber toNumber(String s);
+} // namespace String_
+
+namespace BufferMethods {
+void setNumber(Buffer buf, NumberFormat format, int offset, TNumber value);
+TNumber getNumber(Buffer buf, NumberFormat format, int offset);
+} // namespace BufferMethods
+
+#define RUNS 5
+
+static volatile uintptr_t sink;
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// the number of operations done; the time is taken around the whole call
+typedef int (*BenchFn)();
+
+static String rooted(String s) {
+    registerGCObj(s);
+    return s;
+}
+
+static String mkNumbered(const char *prefix, int i) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+    return mkString(buf);
+}
+
+static String longString(int len, char last) {
+    auto tmp = (char *)xmalloc(len + 1);
+    memset(tmp, 'a', len);
+    tmp[len - 1] = last;
+    tmp[len] = 0;
+    auto r = mkString(tmp, len);
+    xfree(tmp);
+    return r;
+}
+
+static int stringConcat() {
+    static String piece;
+    if (!piece)
+        piece = rooted(mkString("abcdefgh"));
+    for (int i = 0; i < 100; ++i) {
+        auto s = mkString("");
+        for (int j = 0; j < 100; ++j)
+            s = String_::concat(s, piece);
+        sink += (uintptr_t)s;
+    }
+    return 100 * 100;
+}
+
+static int stringIndexOf() {
+    static String hay, needle;
+    if (!hay) {
+        hay = rooted(longString(1000, 'b'));
+        needle = rooted(mkString("aab"));
+    }
+    for (int i = 0; i < 10000; ++i)
+        sink += String_::indexOf(hay, needle, 0);
+    return 10000;
+}
+
+static int stringCharCodeAt() {
+    static String s;
+    if (!s)
+        s = rooted(longString(1000, 'b'));
+    for (int i = 0; i < 100; ++i)
+        for (int j = 0; j < 1000; ++j)
+            sink += (uintptr_t)String_::charCodeAt(s, j);
+    return 100 * 1000;
+}
+
+static int numberToStringInt() {
+    for (int i = 0; i < 100000; ++i)
+        sink += (uintptr_t)numops::toString(fromInt(i * 7919));
+    return 100000;
+}
+
+static int numberToStringDouble() {
+    for (int i = 0; i < 100000; ++i)
+        sink += (uintptr_t)numops::toString(fromDouble(i * 1.37e-3));
+    return 100000;
+}
+
+static int numberParse() {
+    static RefCollection *strs;
+    if (!strs) {
+        strs = Array_::mk();
+        registerGCObj(strs);
+        for (int i = 0; i < 1000; ++i) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), i & 1 ? "%d" : "%.6g", i & 1 ? i * 7919 : i * 1.37e-3);
+            Array_::push(strs, (TValue)mkString(buf));
+        }
+    }
+    for (int i = 0; i < 100; ++i)
+        for (int j = 0; j < 1000; ++j)
+            sink += (uintptr_t)String_::toNumber((String)Array_::getAt(strs, j));
+    return 100 * 1000;
+}
+
+#define MAP_KEYS 32
+
+static RefCollection *mapKeys() {
+    static RefCollection *keys;
+    if (!keys) {
+        keys = Array_::mk();
+        registerGCObj(keys);
+        for (int i = 0; i < MAP_KEYS; ++i)
+            Array_::push(keys, (TValue)mkNumbered("key", i));
+    }
+    return keys;
+}
+
+static int mapSet() {
+    auto keys = mapKeys();
+    for (int i = 0; i < 1000; ++i) {
+        auto map = pxtrt::mkMap();
+        for (int j = 0; j < MAP_KEYS; ++j)
+            pxtrt::mapSetByString(map, (String)Array_::getAt(keys, j), fromInt(j));
+        sink += (uintptr_t)map;
+    }
+    return 1000 * MAP_KEYS;
+}
+
+static int mapGet() {
+    static RefMap *map;
+    auto keys = mapKeys();
+    if (!map) {
+        map = pxtrt::mkMap();
+        registerGCObj(map);
+        for (int j = 0; j < MAP_KEYS; ++j)
+            pxtrt::mapSetByString(map, (String)Array_::getAt(keys, j), fromInt(j));
+    }
+    for (int i = 0; i < 3000; ++i)
+        for (int j = 0; j < MAP_KEYS; ++j)
+            sink += (uintptr_t)pxtrt::mapGetByString(map, (String)Array_::getAt(keys, j));
+    return 3000 * MAP_KEYS;
+}
+
+static int arrayPushPop() {
+    auto c = Array_::mk();
+    for (int i = 0; i < 100; ++i) {
+        for (int j = 0; j < 1000; ++j)
+            Array_::push(c, fromInt(j));
+        for (int j = 0; j < 1000; ++j)
+            sink += (uintptr_t)Array_::pop(c);
+    }
+    return 100 * 1000 * 2;
+}
+
+static int arrayIndexOfNumber() {
+    static RefCollection *c;
+    if (!c) {
+        c = Array_::mk();
+        registerGCObj(c);
+        for (int i = 0; i < 1000; ++i)
+            Array_::push(c, fromInt(i));
+    }
+    for (int i = 0; i < 1000; ++i)
+        sink += Array_::indexOf(c, fromInt(999), 0);
+    return 1000 * 1000;
+}
+
+static int arrayIndexOfString() {
+    static RefCollection *c;
+    static String last;
+    if (!c) {
+        c = Array_::mk();
+        registerGCObj(c);
+        for (int i = 0; i < 1000; ++i)
+            Array_::push(c, (TValue)mkNumbered("item", i));
+        // equal to the last one, but not the same object
+        last = rooted(mkNumbered("item", 999));
+    }
+    for (int i = 0; i < 100; ++i)
+        sink += Array_::indexOf(c, (TValue)last, 0);
+    return 100 * 1000;
+}
+
+static Buffer benchBuffer() {
+    static Buffer buf;
+    if (!buf) {
+        buf = mkBuffer(NULL, 4096);
+        registerGCObj(buf);
+    }
+    return buf;
+}
+
+static int bufferSetNumber() {
+    auto buf = benchBuffer();
+    for (int i = 0; i < 100; ++i)
+        for (int j = 0; j < 1024; ++j)
+            BufferMethods::setNumber(buf, NumberFormat::Int32LE, j * 4, fromInt(i + j));
+    return 100 * 1024;
+}
+
+static int bufferGetNumber() {
+    auto buf = benchBuffer();
+    for (int i = 0; i < 100; ++i)
+        for (int j = 0; j < 1024; ++j)
+            sink += (uintptr_t)BufferMethods::getNumber(buf, NumberFormat::Int32LE, j * 4);
+    return 100 * 1024;
+}
+
+// small objects that die right away; the time includes the collections they cause
+static int allocSmall() {
+    for (int i = 0; i < 200000; ++i)
+        sink += (uintptr_t)mkBuffer(NULL, 16);
+    return 200000;
+}
+
+// buffers too big for a GC block, as for screens and sound
+static int allocLarge() {
+    for (int i = 0; i < 2000; ++i)
+        sink += (uintptr_t)mkBuffer(NULL, 96 * 1024);
+    return 2000;
+}
+
+// instances of a class with four fields, as new does them
+static const VTable benchClassVT = {sizeof(RefRecord) + 4 * sizeof(TValue),
+                                    ValType::Object,
+                                    VTABLE_MAGIC,
+                                    0,
+                                    BuiltInType::User0,
+                                    0,
+                                    0,
+                                    {(PVoid)&RefRecord_destroy, (PVoid)&RefRecord_print,
+                                     (PVoid)&RefRecord_scan, (PVoid)&RefRecord_gcsize}};
+
+static int allocObjects() {
+    for (int i = 0; i < 200000; ++i)
+        sink += (uintptr_t)mkClassInstance((VTable *)&benchClassVT);
+    return 200000;
+}
+
+static int allocArrays() {
+    for (int i = 0; i < 50000; ++i) {
+        auto c = Array_::mk();
+        Array_::push(c, fromInt(i));
+        sink += (uintptr_t)c;
+    }
+    return 50000;
+}
+
+// a full collection, with about that many KB of 64 byte strings kept alive, in arrays of
+// GC_ARRAY_LEN, since one array can only be as big as a GC block
+#define GC_ARRAY_LEN 1024
+static int gcPause(int kb) {
+    static RefCollection *live;
+    if (!live) {
+        live = Array_::mk();
+        registerGCObj(live);
+    }
+    int n = kb * 1024 / 64 / GC_ARRAY_LEN;
+    while (Array_::length(live) > n)
+        Array_::pop(live);
+    while (Array_::length(live) < n) {
+        auto strs = Array_::mk();
+        Array_::push(live, (TValue)strs);
+        for (int i = 0; i < GC_ARRAY_LEN; ++i)
+            Array_::push(strs, (TValue)longString(64 - 8, 'c'));
+    }
+    gc(0);
+    for (int i = 0; i < 10; ++i)
+        gc(0);
+    return 10;
+}
+
+#define GC_PAUSE(kb)                                                                               \
+    static int gcPause##kb() { return gcPause(kb); }
+GC_PAUSE(64)
+GC_PAUSE(256)
+GC_PAUSE(1024)
+GC_PAUSE(4096)
+
+// allocations which only fit once the heap is compacted: every other one of a heap full of 1KB
+// buffers is dropped, which leaves holes too small for 16KB ones; the buffers kept are checked to
+// still hold what was written into them
+#define COMPACT_BUFFERS 2048
+#define COMPACT_BIG 32
+static int gcCompact() {
+    static RefCollection *live;
+    if (!live) {
+        live = Array_::mk();
+        registerGCObj(live);
+    }
+    Array_::setLength(live, 0);
+    gc(0);
+    for (int i = 0; i < COMPACT_BUFFERS; ++i) {
+        auto buf = mkBuffer(NULL, 1024);
+        memset(buf->data, i & 0xff, buf->length);
+        Array_::push(live, (TValue)buf);
+    }
+    for (int i = 1; i < COMPACT_BUFFERS; i += 2)
+        Array_::setAt(live, i, NULL);
+    for (int i = 0; i < COMPACT_BIG; ++i)
+        Array_::push(live, (TValue)mkBuffer(NULL, 16 * 1024));
+    for (int i = 0; i < COMPACT_BUFFERS; i += 2) {
+        auto buf = (Buffer)Array_::getAt(live, i);
+        for (int j = 0; j < (int)buf->length; ++j)
+            if (buf->data[j] != (i & 0xff)) {
+                fprintf(stderr, "gc.compact: buffer %d changed\n", i);
+                exit(1);
+            }
+    }
+    return 1;
+}
+
+struct Bench {
+    const char *name;
+    BenchFn fn;
+};
+
+static const Bench benches[] = {
+    {"string.concat", stringConcat},
+    {"string.indexOf", stringIndexOf},
+    {"string.charCodeAt", stringCharCodeAt},
+    {"number.toString.int", numberToStringInt},
+    {"number.toString.double", numberToStringDouble},
+    {"number.parse", numberParse},
+    {"map.set", mapSet},
+    {"map.get", mapGet},
+    {"array.pushPop", arrayPushPop},
+    {"array.indexOf.number", arrayIndexOfNumber},
+    {"array.indexOf.string", arrayIndexOfString},
+    {"buffer.setNumber", bufferSetNumber},
+    {"buffer.getNumber", bufferGetNumber},
+    {"alloc.small", allocSmall},
+    {"alloc.object", allocObjects},
+    {"alloc.array", allocArrays},
+    {"alloc.large", allocLarge},
+    {"gc.pause.64k", gcPause64},
+    {"gc.pause.256k", gcPause256},
+    {"gc.pause.1m", gcPause1024},
+    {"gc.pause.4m", gcPause4096},
+    {"gc.compact", gcCompact},
+};
+
+int main(int argc, char **argv) {
+    pxt::hostStart(__builtin_frame_address(0));
+
+    const char *prefix = argc > 1 ? argv[1] : "";
+    bool first = true;
+    printf("{\n  \"pointerBits\": %d,\n  \"results\": [", (int)(sizeof(void *) * 8));
+    for (auto &b : benches) {
+        if (strncmp(b.name, prefix, strlen(prefix)))
+            continue;
+        // the first run also does the setup
+        b.fn();
+        double best = 0;
+        int ops = 0;
+        for (int i = 0; i < RUNS; ++i) {
+            auto t0 = nowNs();
+            ops = b.fn();
+            double ns = (double)(nowNs() - t0) / ops;
+            if (!i || ns < best)
+                best = ns;
+        }
+        printf("%s\n    {\"name\": \"%s\", \"ops\": %d, \"nsPerOp\": %.2f}", first ? "" : ",",
+               b.name, ops, best);
+        fflush(stdout);
+        first = false;
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
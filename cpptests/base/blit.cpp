@@ -0,0 +1,98 @@
+// Transparent 4bpp sprite blits by drawTransparentImage() in libs/screen/image.cpp, which merges
+// a column of 8 pixels per word under a mask of the non-transparent ones. The screen is checked
+// against drawing the same sprites pixel by pixel, clipped at every edge, and the time per blit
+// of both is printed.
+//
+//   make test
+
+#include "test.h"
+
+namespace pxt {
+Image_ mkImage(int width, int height, int bpp);
+} // namespace pxt
+
+namespace ImageMethods {
+void setPixel(Image_ img, int x, int y, int c);
+int getPixel(Image_ img, int x, int y);
+void fill(Image_ img, int c);
+void drawTransparentImage(Image_ img, Image_ from, int x, int y);
+} // namespace ImageMethods
+
+#define SCREEN_W 160
+#define SCREEN_H 120
+#define NUM_BLITS 200000
+
+static void drawPixels(Image_ img, Image_ from, int x, int y) {
+    for (int i = 0; i < from->width(); ++i)
+        for (int j = 0; j < from->height(); ++j) {
+            auto c = ImageMethods::getPixel(from, i, j);
+            if (c)
+                ImageMethods::setPixel(img, x + i, y + j, c);
+        }
+}
+
+// a round blob with a transparent border, like most sprites
+static Image_ makeSprite(int w, int h) {
+    auto s = mkImage(w, h, 4);
+    ImageMethods::fill(s, 0);
+    for (int x = 0; x < w; ++x)
+        for (int y = 0; y < h; ++y) {
+            int dx = 2 * x - w + 1, dy = 2 * y - h + 1;
+            if (dx * dx + dy * dy < w * h)
+                ImageMethods::setPixel(s, x, y, 1 + (x + y) % 15);
+        }
+    return s;
+}
+
+static void checkSame(Image_ a, Image_ b, int w, int h) {
+    for (int x = 0; x < SCREEN_W; ++x)
+        for (int y = 0; y < SCREEN_H; ++y)
+            if (ImageMethods::getPixel(a, x, y) != ImageMethods::getPixel(b, x, y)) {
+                fprintf(stderr, "blit: %dx%d sprite differs at %d,%d\n", w, h, x, y);
+                exit(1);
+            }
+}
+
+static void run(int w, int h) {
+    auto s = makeSprite(w, h);
+    registerGCObj(s);
+    auto golden = mkImage(SCREEN_W, SCREEN_H, 4);
+    registerGCObj(golden);
+    auto screen = mkImage(SCREEN_W, SCREEN_H, 4);
+    registerGCObj(screen);
+
+    ImageMethods::fill(golden, 3);
+    ImageMethods::fill(screen, 3);
+    for (int i = 0; i < 2000; ++i) {
+        int x = getrand(SCREEN_W + 2 * w) - w, y = getrand(SCREEN_H + 2 * h) - h;
+        drawPixels(golden, s, x, y);
+        ImageMethods::drawTransparentImage(screen, s, x, y);
+    }
+    checkSame(golden, screen, w, h);
+
+    auto t0 = nowNs();
+    for (int i = 0; i < NUM_BLITS; ++i)
+        ImageMethods::drawTransparentImage(screen, s, (i * 7) % (SCREEN_W - w),
+                                           (i * 13) % (SCREEN_H - h));
+    auto words = (double)(nowNs() - t0) / NUM_BLITS;
+    t0 = nowNs();
+    for (int i = 0; i < NUM_BLITS / 10; ++i)
+        drawPixels(golden, s, (i * 7) % (SCREEN_W - w), (i * 13) % (SCREEN_H - h));
+    auto pixels = (double)(nowNs() - t0) / (NUM_BLITS / 10);
+
+    unregisterGCObj(screen);
+    unregisterGCObj(golden);
+    unregisterGCObj(s);
+    printf("blit: %dx%d sprite: %.0f ns/blit, pixel by pixel %.0f ns/blit\n", w, h, words,
+           pixels);
+}
+
+int main() {
+    pxt::hostStart(__builtin_frame_address(0));
+
+    run(16, 16);
+    run(8, 8);
+    run(32, 24);
+    run(7, 13);
+    return 0;
+}
@@ -0,0 +1,70 @@
+// Allocation by gcAllocate() in libs/base/gc.cpp, with the usual mix of small objects (served
+// from the size class lists) and occasional bigger ones, about half of which survive each round
+// of collections. The survivors are checked to still hold what was written into them, and the
+// latency of small and big allocations is printed.
+//
+//   make test
+
+#include "test.h"
+
+#define NUM_ROUNDS 200
+#define ALLOCS_PER_ROUND 10000
+#define NUM_LIVE 4096
+// GC_MAX_SIZE_CLASS_WORDS in gc.cpp, in bytes of buffer data
+#define SMALL_BYTES (16 * 8 - 16)
+
+static uint32_t randomSize() {
+    if (getrand(10) == 0)
+        return SMALL_BYTES + 1 + getrand(1600);
+    return 1 + getrand(SMALL_BYTES);
+}
+
+static void fill(Buffer buf, int tag) {
+    memset(buf->data, tag & 0xff, buf->length);
+}
+
+static void checkFilled(Buffer buf, int tag) {
+    for (int i = 0; i < buf->length; ++i)
+        CHECK(buf->data[i] == (tag & 0xff));
+}
+
+int main() {
+    pxt::hostStart(__builtin_frame_address(0));
+
+    auto live = Array_::mk();
+    registerGCObj(live);
+    for (int i = 0; i < NUM_LIVE; ++i)
+        Array_::push(live, NULL);
+
+    // [0] is small allocations, [1] is big ones
+    uint64_t total[2] = {0, 0};
+    uint32_t count[2] = {0, 0};
+    for (int r = 0; r < NUM_ROUNDS; ++r) {
+        for (int i = 0; i < ALLOCS_PER_ROUND; ++i) {
+            auto sz = randomSize();
+            auto k = sz > SMALL_BYTES;
+            auto t0 = nowNs();
+            auto buf = mkBuffer(NULL, sz);
+            total[k] += nowNs() - t0;
+            count[k]++;
+            // the slot says what it was filled with
+            int slot = getrand(NUM_LIVE);
+            fill(buf, slot);
+            if (getrand(2))
+                Array_::setAt(live, slot, (TValue)buf);
+        }
+        gc(0);
+        for (int i = 0; i < NUM_LIVE; ++i) {
+            auto buf = (Buffer)Array_::getAt(live, i);
+            if (!buf)
+                continue;
+            checkFilled(buf, i);
+            // about half of them die in the next round
+            if (getrand(2))
+                Array_::setAt(live, i, NULL);
+        }
+    }
+    printf("gcalloc: small %.1f ns/alloc, big %.1f ns/alloc\n", (double)total[0] / count[0],
+           (double)total[1] / count[1]);
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Hashes of buffers by BufferMethods::crc32()/hash32()/sha256()/hash() in libs/base/buffer.cpp:
+// published test vectors, CRC32 continued after a CRC unit of the chip did part of the data, and
+// speed.
+//
+//   make test
+
+#include "test.h"
+
+namespace BufferMethods {
+uint32_t hash(Buffer buf, int bits);
+uint32_t crc32(Buffer buf);
+uint32_t hash32(Buffer buf, int seed);
+Buffer sha256(Buffer buf);
+} // namespace BufferMethods
+
+// a CRC unit that does the first [hardwareLen] bytes, when set; bit by bit, to be independent
+// of the table in buffer.cpp
+static int hardwareLen = -1;
+
+namespace pxt {
+unsigned crc32Hardware(const uint8_t *data, unsigned len, uint32_t *state) {
+    if (hardwareLen < 0)
+        return 0;
+    unsigned n = min(len, (unsigned)hardwareLen);
+    uint32_t crc = *state;
+    for (unsigned i = 0; i < n; ++i) {
+        crc ^= data[i];
+        for (int k = 0; k < 8; ++k)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    *state = crc;
+    return n;
+}
+} // namespace pxt
+
+static Buffer mkStr(const char *s) {
+    return mkBuffer(s, strlen(s));
+}
+
+static void checkSha(const char *msg, const char *hex) {
+    auto d = BufferMethods::sha256(mkStr(msg));
+    char tmp[65];
+    CHECK(d->length == 32);
+    for (int i = 0; i < 32; ++i)
+        sprintf(tmp + i * 2, "%02x", d->data[i]);
+    if (strcmp(tmp, hex)) {
+        fprintf(stderr, "hash: sha256 of \"%s\" is %s\n", msg, tmp);
+        exit(1);
+    }
+}
+
+static void testVectors() {
+    CHECK(BufferMethods::crc32(mkStr("123456789")) == 0xcbf43926);
+    CHECK(BufferMethods::crc32(mkStr("")) == 0);
+    CHECK(BufferMethods::hash32(mkStr(""), 0) == 0x02cc5d05);
+    CHECK(BufferMethods::hash32(mkStr("abc"), 0) == 0x32d153ff);
+    CHECK(BufferMethods::hash32(mkStr("Nobody inspects the spammish repetition"), 0) ==
+          0xe2293b2f);
+    // FNV-1 of "a"
+    CHECK(BufferMethods::hash(mkStr("a"), 32) == 0x050c5d7e);
+    CHECK(BufferMethods::hash(mkStr("a"), 0) == 0);
+    CHECK(BufferMethods::hash(mkStr("a"), 8) < 256);
+
+    checkSha("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    checkSha("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    checkSha("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+             "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    checkSha("abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopq"
+             "klmnopqrlmnopqrsmnopqrstnopqrstu",
+             "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1");
+}
+
+static void testHardwareCrc() {
+    auto buf = mkBuffer(NULL, 100);
+    registerGCObj(buf);
+    for (int i = 0; i < 100; ++i)
+        buf->data[i] = getrand(256);
+    for (int n = 0; n <= 100; ++n) {
+        auto part = mkBuffer(buf->data, n);
+        hardwareLen = -1;
+        auto expected = BufferMethods::crc32(part);
+        for (hardwareLen = 0; hardwareLen <= n; hardwareLen += 1 + n / 7)
+            CHECK(BufferMethods::crc32(part) == expected);
+    }
+    hardwareLen = -1;
+    unregisterGCObj(buf);
+}
+
+static volatile uint32_t sink;
+
+static void testSpeed() {
+    int n = 64 * 1024;
+    auto buf = mkBuffer(NULL, n);
+    registerGCObj(buf);
+    for (int i = 0; i < n; ++i)
+        buf->data[i] = getrand(256);
+    const char *names[] = {"fnv1", "xxh32", "crc32", "sha256"};
+    for (int kind = 0; kind < 4; ++kind) {
+        uint32_t sum = 0;
+        auto t0 = nowNs();
+        for (int k = 0; k < 100; ++k) {
+            if (kind == 0)
+                sum += BufferMethods::hash(buf, 32);
+            else if (kind == 1)
+                sum += BufferMethods::hash32(buf, k);
+            else if (kind == 2)
+                sum += BufferMethods::crc32(buf);
+            else
+                sum += BufferMethods::sha256(buf)->data[0];
+        }
+        sink = sum;
+        printf("hash: %-7s %5.0f MB/s\n", names[kind], 100.0 * n * 1e3 / (nowNs() - t0));
+    }
+    unregisterGCObj(buf);
+}
+
+int main() {
+    pxt::hostStart(__builtin_frame_address(0));
+
+    testVectors();
+    testHardwareCrc();
+    testSpeed();
+    return 0;
+}
@@ -0,0 +1,143 @@
+// What libs/base needs from a platform, for running it in a host process: malloc(), the clock,
+// and GC blocks. There are no fibers; the one stack is scanned the way core/codal.cpp scans a
+// fiber stack, except that only words pointing at an object in a GC block are looked at, since
+// reading anything else may fault here.
+
+#include "pxt.h"
+#include <setjmp.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+extern "C" void *xmalloc(size_t sz) {
+    auto r = malloc(sz);
+    if (!r)
+        target_panic(PANIC_GC_OOM);
+    return r;
+}
+
+extern "C" void xfree(void *p) {
+    free(p);
+}
+
+extern "C" void target_panic(int error_code) {
+    fprintf(stderr, "PANIC %d\n", error_code);
+    exit(1);
+}
+
+// this isn't a program, so there are no globals and no bytecode
+PXT_SHIMS_BEGIN
+PXT_SHIMS_END
+
+namespace pxt {
+
+#define MAX_BLOCKS 1024
+static uint8_t *blockStart[MAX_BLOCKS], *blockEnd[MAX_BLOCKS];
+static int numBlocks;
+uint8_t *gcAreaStart, *gcAreaEnd;
+static void *stackEnd;
+static ThreadContext *threadCtx;
+
+// the part of the program header the runtime reads: no interface member names (see
+// lookupMapKey() in core.cpp), and no globals
+static uint16_t header[32];
+static const uintptr_t memberNames[] = {1, 0};
+
+// as mkInternalString() does for the VM; malloc() memory counts as read-only, see the Makefile
+String hostString(const char *str) {
+    int len = (int)strlen(str);
+    String r = new (xmalloc(sizeof(void *) + 2 + len + 1)) BoxedString(&string_inline_ascii_vt);
+    r->ascii.length = len;
+    memcpy(r->ascii.data, str, len + 1);
+    return r;
+}
+
+void hostStart(void *end) {
+    stackEnd = end;
+    auto names = memberNames;
+    memcpy(&header[22], &names, sizeof(names));
+    bytecode = header;
+}
+
+void *gcAllocBlock(size_t sz) {
+    if (numBlocks == MAX_BLOCKS)
+        target_panic(PANIC_GC_OOM);
+    // mmap() places its blocks high, away from the executable and the malloc() heap
+    auto r = (uint8_t *)mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (r == MAP_FAILED)
+        target_panic(PANIC_GC_OOM);
+    if (isReadOnly((TValue)r)) {
+        DMESG("mmap returned read-only address: %p", r);
+        target_panic(PANIC_INTERNAL_ERROR);
+    }
+    if (!gcAreaStart || r < gcAreaStart)
+        gcAreaStart = r;
+    if (r + sz > gcAreaEnd)
+        gcAreaEnd = r + sz;
+    blockStart[numBlocks] = r;
+    blockEnd[numBlocks++] = r + sz;
+    return r;
+}
+
+// unlike GC_IN_AREA(), not in the gaps between the blocks
+static bool inBlock(uintptr_t p) {
+    for (int i = 0; i < numBlocks; ++i)
+        if ((uintptr_t)blockStart[i] <= p && p < (uintptr_t)blockEnd[i])
+            return true;
+    return false;
+}
+
+// the executable, where the vtables are
+extern "C" char __executable_start[], _end[];
+
+// A word can point into the middle of an object, eg. into the characters of a string, and then
+// what gcProcess() takes for the vtable is just data; this only lets through the words that point
+// at something starting with a vtable. Marked objects fail too, but they need no more work.
+static bool isObjectStart(TValue v) {
+    auto vt = *(uintptr_t *)v;
+    return (uintptr_t)__executable_start <= vt && vt < (uintptr_t)_end &&
+           ((VTable *)vt)->magic == VTABLE_MAGIC;
+}
+
+__attribute__((noinline, no_sanitize_address)) static void scanStack(int flags) {
+    auto p = (TValue *)__builtin_frame_address(0);
+    auto end = (TValue *)stackEnd;
+    if (flags & 2)
+        DMESG("RS:%p/%d", p, (int)(end - p));
+    for (; p < end; ++p)
+        if (isPointer(*p) && inBlock((uintptr_t)*p)) {
+#ifdef PXT_GC_COMPACT
+            // C++ frames may point into objects
+            gcPin(*p);
+#endif
+            if (isObjectStart(*p))
+                gcProcess(*p);
+        }
+}
+
+void gcProcessStacks(int flags) {
+    // spill the registers onto the stack, so the values only kept in them are seen as well
+    jmp_buf regs;
+    setjmp(regs);
+    scanStack(flags);
+}
+
+ThreadContext *getThreadContext() {
+    return threadCtx;
+}
+
+void setThreadContext(ThreadContext *ctx) {
+    threadCtx = ctx;
+}
+
+void initRuntime() {}
+
+void releaseFiber() {}
+
+uint64_t current_time_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+} // namespace pxt
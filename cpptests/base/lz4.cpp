@@ -0,0 +1,144 @@
+// LZ4 compression by BufferMethods::compress()/decompress() in libs/base/buffer.cpp: round
+// trips, the format rules the reference decoder relies on, corrupt input, and speed.
+//
+//   make test
+
+#include "test.h"
+
+namespace BufferMethods {
+Buffer compress(Buffer buf, int level);
+Buffer decompress(Buffer buf);
+} // namespace BufferMethods
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5 // the last bytes are always literals
+#define LZ4_MF_LIMIT 12     // and no match starts in the bytes at the end
+#define LZ4_MAX_LEVEL 5
+
+// what the LZ4 reference implementation requires of the sequences, beyond them decoding
+static void checkFormat(Buffer c, int n) {
+    const uint8_t *ip = c->data + 4, *end = c->data + c->length;
+    CHECK((int)(c->data[0] | c->data[1] << 8 | c->data[2] << 16 | c->data[3] << 24) == n);
+    int pos = 0;
+    while (ip < end) {
+        int token = *ip++;
+        int lit = token >> 4;
+        if (lit == 15)
+            while (*ip == 255)
+                lit += *ip++;
+        if ((token >> 4) == 15)
+            lit += *ip++;
+        ip += lit;
+        pos += lit;
+        if (ip == end)
+            break;
+        ip += 2;
+        if (pos > n - LZ4_MF_LIMIT) {
+            fprintf(stderr, "lz4: match at %d of %d\n", pos, n);
+            exit(1);
+        }
+        int ml = token & 15;
+        if (ml == 15)
+            while (*ip == 255)
+                ml += *ip++;
+        if ((token & 15) == 15)
+            ml += *ip++;
+        pos += ml + LZ4_MIN_MATCH;
+    }
+    if (n >= LZ4_LAST_LITERALS && pos != n) {
+        fprintf(stderr, "lz4: ends at %d of %d\n", pos, n);
+        exit(1);
+    }
+}
+
+static void fillData(uint8_t *p, int n, int kind) {
+    for (int i = 0; i < n; ++i) {
+        if (kind == 0)
+            p[i] = getrand(256); // noise
+        else if (kind == 1)
+            p[i] = i > 8 && getrand(8) ? p[i - 1 - getrand(8)] : getrand(256); // short repeats
+        else if (kind == 2)
+            p[i] = getrand(50) ? 'a' : 'b'; // long runs
+        else
+            p[i] = "temperature=21.5 humidity=40 "[i % 29] + (getrand(20) == 0); // telemetry
+    }
+}
+
+// what the reference compressor makes of 16 times 'a': a literal and a match of 10 one byte
+// back, then the last 5 bytes as literals
+static void testReference() {
+    static const uint8_t ref[] = {16, 0, 0, 0, 0x16, 'a', 1, 0, 0x50, 'a', 'a', 'a', 'a', 'a'};
+    auto d = BufferMethods::decompress(mkBuffer(ref, sizeof(ref)));
+    CHECK(d && d->length == 16);
+    for (int i = 0; i < 16; ++i)
+        CHECK(d->data[i] == 'a');
+}
+
+static void testRoundTrip() {
+    int maxN = 200000;
+    for (int i = 0; i < 4000; ++i) {
+        int n = i < 100 ? i : getrand(i < 3900 ? 3000 : maxN);
+        int kind = getrand(4);
+        int level = getrand(LZ4_MAX_LEVEL) + 1;
+        auto src = mkBuffer(NULL, n);
+        registerGCObj(src);
+        fillData(src->data, n, kind);
+        auto c = BufferMethods::compress(src, level);
+        registerGCObj(c);
+        if (c->length - 4 > n + n / 255 + 16) {
+            fprintf(stderr, "lz4: too long %d for %d\n", c->length - 4, n);
+            exit(1);
+        }
+        checkFormat(c, n);
+        auto d = BufferMethods::decompress(c);
+        if (!d || d->length != n || memcmp(src->data, d->data, n)) {
+            fprintf(stderr, "lz4: round trip of %d bytes, kind %d, level %d\n", n, kind, level);
+            exit(1);
+        }
+        // a cut off stream is always noticed, and damaged data decodes to something or
+        // nothing, without reading or writing out of bounds
+        if (n > 0) {
+            CHECK(!BufferMethods::decompress(mkBuffer(c->data, 4 + getrand(c->length - 4))));
+            c->data[4 + getrand(c->length - 4)] ^= 1 << getrand(8);
+            BufferMethods::decompress(c);
+        }
+        unregisterGCObj(c);
+        unregisterGCObj(src);
+    }
+    CHECK(!BufferMethods::decompress(mkBuffer(NULL, 3)));
+}
+
+static void testSpeed() {
+    int n = 64 * 1024;
+    auto src = mkBuffer(NULL, n);
+    registerGCObj(src);
+    const char *kinds[] = {"noise", "repeats", "runs", "telemetry"};
+    for (int kind = 0; kind < 4; ++kind) {
+        fillData(src->data, n, kind);
+        for (int level = 1; level <= LZ4_MAX_LEVEL; level += 2) {
+            Buffer c = NULL;
+            auto t0 = nowNs();
+            for (int k = 0; k < 20; ++k)
+                c = BufferMethods::compress(src, level);
+            auto t1 = nowNs();
+            registerGCObj(c);
+            for (int k = 0; k < 20; ++k)
+                BufferMethods::decompress(c);
+            auto t2 = nowNs();
+            unregisterGCObj(c);
+            printf("lz4: %-10s level %d: %5.1f%%, %4.0f MB/s, decompress %4.0f MB/s\n",
+                   kinds[kind], level, (c->length - 4) * 100.0 / n, 20.0 * n * 1e3 / (t1 - t0),
+                   20.0 * n * 1e3 / (t2 - t1));
+        }
+    }
+    unregisterGCObj(src);
+}
+
+int main() {
+    pxt::hostStart(__builtin_frame_address(0));
+
+    testReference();
+    testRoundTrip();
+    testSpeed();
+    return 0;
+}
@@ -0,0 +1,82 @@
+// Number to string conversion by numops::toString() in libs/base/core.cpp. Values with a known
+// JavaScript form are checked against it, sensor readings, money amounts and occasional tiny or
+// huge values are checked to read back as the same double, and the time per number is printed.
+//
+//   make test
+
+#include "test.h"
+#include <math.h>
+
+#define NUM_VALUES 100000
+#define NUM_ROUNDS 20
+
+static const char *format(double v) {
+    return PXT_STRING_DATA(numops::toString(fromDouble(v)));
+}
+
+static void checkFormat(double v, const char *expected) {
+    auto s = format(v);
+    if (strcmp(s, expected)) {
+        fprintf(stderr, "numfmt: %.17g formats as %s, not %s\n", v, s, expected);
+        exit(1);
+    }
+}
+
+static double values[NUM_VALUES];
+static volatile int sink;
+
+int main() {
+    pxt::hostStart(__builtin_frame_address(0));
+
+    checkFormat(0, "0");
+    checkFormat(-1, "-1");
+    checkFormat(2147483648.0, "2147483648");
+    checkFormat(9007199254740992.0, "9007199254740992");
+    checkFormat(0.1, "0.1");
+    checkFormat(-0.5, "-0.5");
+    checkFormat(0.1 + 0.2, "0.30000000000000004");
+    checkFormat(1 / 3.0, "0.3333333333333333");
+    checkFormat(123.456, "123.456");
+    checkFormat(1e21, "1e+21");
+    checkFormat(1.5e300, "1.5e+300");
+    checkFormat(0.000001, "0.000001");
+    checkFormat(1e-7, "1e-7");
+    checkFormat(5e-324, "5e-324");
+    checkFormat(1.7976931348623157e308, "1.7976931348623157e+308");
+    checkFormat(NAN, "NaN");
+    checkFormat(INFINITY, "Infinity");
+    checkFormat(-INFINITY, "-Infinity");
+
+    for (int i = 0; i < NUM_VALUES; ++i) {
+        switch (i % 4) {
+        case 0:
+            values[i] = getrand(100000) / 100.0;
+            break;
+        case 1:
+            values[i] = getrand(0x7fffffff) / (double)0x7fffffff;
+            break;
+        case 2:
+            values[i] = ((int)getrand(0x7fffffff) - 0x3fffffff) * 1e-3;
+            break;
+        default:
+            values[i] = getrand(0x7fffffff) * pow(10, (int)getrand(60) - 30);
+            break;
+        }
+    }
+    for (int i = 0; i < NUM_VALUES; ++i) {
+        auto s = format(values[i]);
+        if (strtod(s, NULL) != values[i]) {
+            fprintf(stderr, "numfmt: %.17g formats as %s\n", values[i], s);
+            exit(1);
+        }
+    }
+
+    int sum = 0;
+    auto t0 = nowNs();
+    for (int r = 0; r < NUM_ROUNDS; ++r)
+        for (int i = 0; i < NUM_VALUES; ++i)
+            sum += format(values[i])[0];
+    sink = sum;
+    printf("numfmt: %.1f ns/number\n", (double)(nowNs() - t0) / (NUM_ROUNDS * NUM_VALUES));
+    return 0;
+}
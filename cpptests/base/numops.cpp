@@ -0,0 +1,148 @@
+// Arithmetic and comparisons on NaN-boxed values by numops::adds()/muls()/lt()/... in
+// libs/base/core.cpp. Every pair of a set of ints, doubles and NaNs is checked against plain
+// double math, and a physics-like loop checks and times the int-or-double fast path.
+//
+//   make test
+
+#include "test.h"
+#include <math.h>
+
+namespace numops {
+TNumber adds(TNumber a, TNumber b);
+TNumber subs(TNumber a, TNumber b);
+TNumber muls(TNumber a, TNumber b);
+TNumber div(TNumber a, TNumber b);
+TNumber lt(TNumber a, TNumber b);
+TNumber le(TNumber a, TNumber b);
+TNumber gt(TNumber a, TNumber b);
+TNumber ge(TNumber a, TNumber b);
+bool lt_bool(TNumber a, TNumber b);
+} // namespace numops
+
+#define NUM_BODIES 1000
+#define NUM_STEPS 2000
+
+static const double operands[] = {
+    0, 1, -1, 7, 0.5, -2.25, 3.75, 1e300, -1e-300, 2147483647.0, -2147483648.0, 65536, NAN,
+};
+#define NUM_OPERANDS (int)(sizeof(operands) / sizeof(operands[0]))
+
+static bool same(double a, double b) {
+    return a == b || (isnan(a) && isnan(b));
+}
+
+static void checkOp(const char *name, TNumber r, double expected, double x, double y) {
+    auto v = toDouble(r);
+    if (!same(v, expected)) {
+        fprintf(stderr, "numops: %s(%.17g, %.17g) is %.17g, not %.17g\n", name, x, y, v,
+                expected);
+        exit(1);
+    }
+}
+
+static void checkCmp(const char *name, TNumber r, bool expected, double x, double y) {
+    if (r != (expected ? TAG_TRUE : TAG_FALSE)) {
+        fprintf(stderr, "numops: %s(%.17g, %.17g) is not %s\n", name, x, y,
+                expected ? "true" : "false");
+        exit(1);
+    }
+}
+
+static void checkPairs() {
+    for (int i = 0; i < NUM_OPERANDS; ++i)
+        for (int j = 0; j < NUM_OPERANDS; ++j) {
+            auto x = operands[i], y = operands[j];
+            auto a = fromDouble(x), b = fromDouble(y);
+            checkOp("adds", numops::adds(a, b), x + y, x, y);
+            checkOp("subs", numops::subs(a, b), x - y, x, y);
+            checkOp("muls", numops::muls(a, b), x * y, x, y);
+            checkOp("div", numops::div(a, b), x / y, x, y);
+            checkCmp("lt", numops::lt(a, b), x < y, x, y);
+            checkCmp("le", numops::le(a, b), x <= y, x, y);
+            checkCmp("gt", numops::gt(a, b), x > y, x, y);
+            checkCmp("ge", numops::ge(a, b), x >= y, x, y);
+            CHECK(numops::lt_bool(a, b) == (x < y));
+        }
+    // undefined reads as NaN
+    checkOp("adds", numops::adds(TAG_UNDEFINED, fromInt(1)), NAN, NAN, 1);
+    checkCmp("lt", numops::lt(TAG_UNDEFINED, fromInt(1)), false, NAN, 1);
+}
+
+struct Body {
+    TNumber x, y, vx, vy;
+};
+static Body bodies[NUM_BODIES];
+
+struct PlainBody {
+    double x, y, vx, vy;
+};
+static PlainBody plain[NUM_BODIES];
+
+// a step like the ones in libs/game/physics.ts: integrate, bounce, apply friction
+static void step(TNumber dt, TNumber friction, TNumber limit) {
+    auto minusOne = fromInt(-1);
+    for (int i = 0; i < NUM_BODIES; ++i) {
+        auto b = &bodies[i];
+        b->x = numops::adds(b->x, numops::muls(b->vx, dt));
+        b->y = numops::adds(b->y, numops::muls(b->vy, dt));
+        if (numops::lt_bool(limit, b->x))
+            b->vx = numops::muls(b->vx, minusOne);
+        if (numops::lt_bool(limit, b->y))
+            b->vy = numops::muls(b->vy, minusOne);
+        b->vx = numops::muls(b->vx, friction);
+        b->vy = numops::muls(b->vy, friction);
+    }
+}
+
+static void plainStep(double dt, double friction, double limit) {
+    for (int i = 0; i < NUM_BODIES; ++i) {
+        auto b = &plain[i];
+        b->x = b->x + b->vx * dt;
+        b->y = b->y + b->vy * dt;
+        if (limit < b->x)
+            b->vx = b->vx * -1;
+        if (limit < b->y)
+            b->vy = b->vy * -1;
+        b->vx = b->vx * friction;
+        b->vy = b->vy * friction;
+    }
+}
+
+static void checkPhysics() {
+    for (int i = 0; i < NUM_BODIES; ++i) {
+        plain[i].x = i % 160;
+        plain[i].y = i % 120;
+        plain[i].vx = 1.5 + i % 7;
+        plain[i].vy = -(i % 5);
+        bodies[i].x = fromDouble(plain[i].x);
+        bodies[i].y = fromDouble(plain[i].y);
+        bodies[i].vx = fromDouble(plain[i].vx);
+        bodies[i].vy = fromDouble(plain[i].vy);
+    }
+
+    auto t0 = nowNs();
+    for (int s = 0; s < NUM_STEPS; ++s)
+        step(fromDouble(0.016), fromDouble(0.999), fromInt(1000));
+    auto ns = (double)(nowNs() - t0) / (NUM_STEPS * NUM_BODIES);
+    t0 = nowNs();
+    for (int s = 0; s < NUM_STEPS; ++s)
+        plainStep(0.016, 0.999, 1000);
+    auto plainNs = (double)(nowNs() - t0) / (NUM_STEPS * NUM_BODIES);
+
+    for (int i = 0; i < NUM_BODIES; ++i) {
+        CHECK(toDouble(bodies[i].x) == plain[i].x);
+        CHECK(toDouble(bodies[i].y) == plain[i].y);
+        CHECK(toDouble(bodies[i].vx) == plain[i].vx);
+        CHECK(toDouble(bodies[i].vy) == plain[i].vy);
+    }
+    printf("numops: NaN-boxed %.1f ns/body-step, plain doubles %.1f ns/body-step\n", ns,
+           plainNs);
+}
+
+int main() {
+    pxt::hostStart(__builtin_frame_address(0));
+
+    checkPairs();
+    checkPhysics();
+    return 0;
+}
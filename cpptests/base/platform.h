@@ -0,0 +1,12 @@
+#ifndef __PXT_PLATFORM_H
+#define __PXT_PLATFORM_H
+
+#define PXT_IN_ISR() false
+
+// as in the VM
+#define GC_BLOCK_SIZE (1024 * 64)
+
+// for gc.compact in bench.cpp
+#define PXT_GC_COMPACT 1
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __PXT_H
+#define __PXT_H
+
+#include "pxtbase.h"
+
+#endif
@@ -0,0 +1,4 @@
+// like the targets that ship libs/base, so that strings get the skip lists of core.cpp
+#define PXT_UTF8 1
+// 4 bit color images, as in arcade
+#define IMAGE_BITS 4
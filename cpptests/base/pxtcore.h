@@ -0,0 +1,41 @@
+#ifndef __PXTCORE_H
+#define __PXTCORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define DMESG(...)                                                                                 \
+    do {                                                                                           \
+        fprintf(stderr, __VA_ARGS__);                                                              \
+        fprintf(stderr, "\n");                                                                     \
+    } while (0)
+
+static inline void itoa(int v, char *dst) {
+    snprintf(dst, 30, "%d", v);
+}
+
+extern "C" void *xmalloc(size_t sz);
+extern "C" void xfree(void *p);
+
+namespace pxt {
+void *gcAllocBlock(size_t sz);
+// from the first GC block to the end of the last one, see gcAllocBlock()
+extern uint8_t *gcAreaStart, *gcAreaEnd;
+// main() calls this first, so that gcProcessStacks() knows where the stack ends
+void hostStart(void *stackEnd);
+} // namespace pxt
+
+// nothing patches the string literals of the runtime here, so they are made at startup
+namespace pxt {
+class BoxedString;
+BoxedString *hostString(const char *str);
+} // namespace pxt
+#define PXT_DEF_STRING(name, val) String name = pxt::hostString(val);
+
+#define GC_ALLOC_BLOCK gcAllocBlock
+#define GC_IN_AREA(p) (pxt::gcAreaStart <= (uint8_t *)(p) && (uint8_t *)(p) < pxt::gcAreaEnd)
+
+#define PXT_HARD_FLOAT 1
+
+#endif
@@ -0,0 +1,110 @@
+// Growth and shrinking of the Segment behind arrays, by Segment::growByMin()/shrinkFor() in
+// libs/base/pxt.cpp, driven through Array_. The elements are checked after every push, pop,
+// insert and remove, the number of reallocations (seen as the data moving) is bounded, and
+// the time per operation is printed.
+//
+//   make test
+
+#include "test.h"
+
+// the elements are their index, or what it was when they were pushed
+static TValue elt(int i) {
+    return fromInt(i);
+}
+
+static void checkContents(RefCollection *c, int length, int first = 0) {
+    CHECK(Array_::length(c) == length);
+    for (int i = 0; i < length; ++i)
+        CHECK(Array_::getAt(c, i) == elt(first + i));
+    CHECK(Array_::getAt(c, length) == TAG_UNDEFINED);
+}
+
+static int moves;
+static TValue *lastData;
+
+static void noteMove(RefCollection *c) {
+    if (c->getData() != lastData) {
+        moves++;
+        lastData = c->getData();
+    }
+}
+
+// [rounds] times push up to [peak] elements and pop down to [low], moving the data at most
+// [maxMoves] times a round
+static void run(const char *name, int rounds, int peak, int low, int maxMoves) {
+    auto c = Array_::mk();
+    registerGCObj(c);
+    moves = 0;
+    lastData = c->getData();
+    uint64_t ops = 0, t = 0;
+    for (int r = 0; r < rounds; ++r) {
+        auto t0 = nowNs();
+        while (Array_::length(c) < peak) {
+            Array_::push(c, elt(Array_::length(c)));
+            noteMove(c);
+        }
+        auto growMoves = moves;
+        while (Array_::length(c) > low) {
+            auto len = Array_::length(c);
+            CHECK(Array_::pop(c) == elt(len - 1));
+            noteMove(c);
+        }
+        t += nowNs() - t0;
+        ops += 2 * (peak - low);
+        checkContents(c, low);
+        // popping most of a big array gives back the memory
+        if (peak >= 4 * low + 64)
+            CHECK(moves > growMoves);
+    }
+    CHECK(moves <= maxMoves * rounds);
+    unregisterGCObj(c);
+    printf("segment: %s: %.1f ns/op, %d reallocations\n", name, (double)t / ops, moves);
+}
+
+// shift()/push() through a queue of [length] elements
+static void runQueue(int length, int rounds) {
+    auto c = Array_::mk();
+    registerGCObj(c);
+    for (int i = 0; i < length; ++i)
+        Array_::push(c, elt(i));
+    auto t0 = nowNs();
+    for (int i = 0; i < rounds; ++i) {
+        CHECK(Array_::removeAt(c, 0) == elt(i));
+        Array_::push(c, elt(length + i));
+    }
+    auto t = nowNs() - t0;
+    checkContents(c, length, rounds);
+    unregisterGCObj(c);
+    printf("segment: queue of %d: %.1f ns/op\n", length, (double)t / (2 * rounds));
+}
+
+static void checkInsertRemove() {
+    auto c = Array_::mk();
+    registerGCObj(c);
+    for (int i = 0; i < 1000; i += 2)
+        Array_::push(c, elt(i));
+    for (int i = 1; i < 1000; i += 2)
+        Array_::insertAt(c, i, elt(i));
+    checkContents(c, 1000);
+    for (int i = 0; i < 900; ++i)
+        CHECK(Array_::removeAt(c, 0) == elt(i));
+    checkContents(c, 100, 900);
+    Array_::setLength(c, 10);
+    checkContents(c, 10, 900);
+    Array_::setLength(c, 20);
+    CHECK(Array_::length(c) == 20);
+    CHECK(Array_::getAt(c, 15) == TAG_UNDEFINED);
+    unregisterGCObj(c);
+}
+
+int main() {
+    pxt::hostStart(__builtin_frame_address(0));
+
+    checkInsertRemove();
+    run("0..100", 10000, 100, 0, 8);
+    run("10..5000", 200, 5000, 10, 30);
+    // 1.5x growth; adding a constant would take hundreds
+    run("0..60000", 1, 60000, 0, 40);
+    runQueue(100, 100000);
+    return 0;
+}
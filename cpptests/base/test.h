@@ -0,0 +1,34 @@
+#ifndef __PXT_TEST_H
+#define __PXT_TEST_H
+
+// What the tests of libs/base share: checking, timing and random numbers. A test exits with an
+// error the first time a check fails; the timings it prints are only there for comparing runs.
+
+#include "pxt.h"
+#include <string.h>
+#include <time.h>
+
+#define CHECK(cond)                                                                                \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);               \
+            exit(1);                                                                               \
+        }                                                                                          \
+    } while (0)
+
+static inline uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// see https://en.wikipedia.org/wiki/Xorshift; the same numbers on every run
+static inline uint32_t getrand(uint32_t max) {
+    static uint32_t x = 0xf01ba80;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x % max;
+}
+
+#endif
@@ -0,0 +1,94 @@
+// charCodeAt() on UTF-8 strings, which goes through the skip list and the sequential access
+// cursor of skipLookup() in libs/base/core.cpp. Every character read, in order, in reverse and
+// in a scattered order, is checked against decoding the C string directly, and the time per
+// character is printed.
+//
+//   make test
+
+#include "test.h"
+
+namespace String_ {
+TNumber charCodeAt(String s, int pos);
+int length(String s);
+} // namespace String_
+
+#define NUM_ROUNDS 50
+#define MAX_LENGTH 5000
+
+static char data[3 * MAX_LENGTH + 1];
+static int codes[MAX_LENGTH];
+
+static void putCode(char *&dst, int code) {
+    if (code < 0x80) {
+        *dst++ = code;
+    } else if (code < 0x800) {
+        *dst++ = 0xc0 | (code >> 6);
+        *dst++ = 0x80 | (code & 0x3f);
+    } else {
+        *dst++ = 0xe0 | (code >> 12);
+        *dst++ = 0x80 | ((code >> 6) & 0x3f);
+        *dst++ = 0x80 | (code & 0x3f);
+    }
+}
+
+// [charBytes] is 2 for Cyrillic and 3 for CJK; every 8th character is an ASCII space, and
+// with [mixed] the width of each character is random
+static String setup(int length, int charBytes, bool mixed) {
+    char *dst = data;
+    for (int i = 0; i < length; ++i) {
+        int bytes = mixed ? 1 + getrand(3) : charBytes;
+        if (i % 8 == 7 || bytes == 1)
+            codes[i] = i % 8 == 7 ? ' ' : 'a' + i % 26;
+        else if (bytes == 2)
+            codes[i] = 0x410 + i % 16;
+        else
+            codes[i] = 0x4e00 + i % 128;
+        putCode(dst, codes[i]);
+    }
+    *dst = 0;
+    return mkString(data, dst - data);
+}
+
+static volatile int sink;
+
+static double readAll(String s, int length, int step) {
+    auto t0 = nowNs();
+    for (int r = 0; r < NUM_ROUNDS; ++r)
+        for (int i = 0; i < length; ++i) {
+            // with a [step] prime to [length] this visits every character once
+            int idx = (int)(((int64_t)i * step + (step < 0 ? length - 1 : 0)) % length);
+            if (idx < 0)
+                idx += length;
+            auto v = String_::charCodeAt(s, idx);
+            CHECK(isInt(v) && numValue(v) == codes[idx]);
+            sink += numValue(v);
+        }
+    return (double)(nowNs() - t0) / (NUM_ROUNDS * length);
+}
+
+static void run(const char *name, int length, int charBytes, bool mixed = false) {
+    auto s = setup(length, charBytes, mixed);
+    registerGCObj(s);
+    CHECK(String_::length(s) == length);
+    CHECK(String_::charCodeAt(s, length) == TAG_NAN);
+    auto seq = readAll(s, length, 1);
+    auto rev = readAll(s, length, -1);
+    auto rnd = readAll(s, length, 7919);
+    unregisterGCObj(s);
+    printf("utf8skip: %s %d chars: sequential %.1f ns/char, reverse %.1f ns/char, random %.1f "
+           "ns/char\n",
+           name, length, seq, rev, rnd);
+}
+
+int main() {
+    pxt::hostStart(__builtin_frame_address(0));
+
+    run("cyrillic", 10, 2);
+    run("cyrillic", 200, 2);
+    run("cyrillic", MAX_LENGTH, 2);
+    run("cjk", 200, 3);
+    run("cjk", MAX_LENGTH, 3);
+    run("mixed", 201, 0, true);
+    run("mixed", 4999, 0, true);
+    return 0;
+}
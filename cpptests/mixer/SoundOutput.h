@@ -0,0 +1,20 @@
+#define SAMPLE_RATE 44100
+
+namespace music {
+class WSynthesizer;
+
+class BenchDAC {
+  public:
+    int getSampleRate() { return SAMPLE_RATE; }
+};
+
+class SoundOutput {
+  public:
+    BenchDAC dac;
+
+    SoundOutput(WSynthesizer &) {}
+
+    void setOutput(int) {}
+};
+
+} // namespace music
@@ -0,0 +1,136 @@
+// Cost of mixing in libs/mixer/melody.cpp: renders a few seconds of notes, with glides and
+// envelopes, through WSynthesizer::fillSamples() for 1 to MAX_SOUNDS voices of each waveform, and
+// of PCM resampled from 8 and 16-bit samples. Reports ns per output sample and per voice sample.
+//
+//   make bench
+//
+// BENCH_SECONDS=<n> sets the seconds rendered for each case.
+
+#include "pxt.h"
+#include "SoundOutput.h"
+#include "melody.h"
+#include <math.h>
+#include <time.h>
+
+namespace music {
+WSynthesizer *getWSynthesizer();
+void queuePlayInstructions(int when, Buffer buf);
+int queuePlayPcm(int when, Buffer buf, int sampleRate, int flags);
+void stopPlaying();
+} // namespace music
+
+using namespace music;
+
+Buffer mkBuffer(const void *data, int len) {
+    auto r = new BoxedBuffer;
+    r->length = len;
+    r->data = (uint8_t *)calloc(len ? len : 1, 1);
+    if (data)
+        memcpy(r->data, data, len);
+    return r;
+}
+
+static void freeBuffer(Buffer b) {
+    free(b->data);
+    delete b;
+}
+
+uint64_t current_time_us() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+void sleep_ms(unsigned) {}
+
+#define NOTE_MS 100
+#define PCM_RATE 22050
+#define WAVE_PCM8 100
+#define WAVE_PCM16 101
+
+static const struct {
+    int wave;
+    const char *name;
+} waves[] = {
+    {SW_TRIANGLE, "triangle"},   {SW_SAWTOOTH, "sawtooth"}, {SW_SINE, "sine"},
+    {SW_TUNEDNOISE, "tunednoise"}, {SW_NOISE, "noise"},     {SW_SQUARE_10, "square10"},
+    {SW_SQUARE_50, "square50"},  {SW_SQUARE_CYCLE_16, "cycle16"}, {WAVE_PCM8, "pcm8"},
+    {WAVE_PCM16, "pcm16"},
+};
+
+// notes of a voice: a tune over two octaves, every fourth one gliding, all with a decay
+static Buffer notes(int wave, int voice, int seconds) {
+    int n = seconds * 1000 / NOTE_MS;
+    auto buf = mkBuffer(NULL, n * sizeof(SoundInstruction));
+    auto instr = (SoundInstruction *)buf->data;
+    for (int i = 0; i < n; ++i) {
+        int step = (i * 7 + voice * 3) % 24;
+        instr[i].soundWave = wave;
+        instr[i].flags = 0;
+        instr[i].frequency = (uint16_t)(220 * pow(2, step / 12.0));
+        instr[i].endFrequency = i % 4 == 3 ? instr[i].frequency * 2 : instr[i].frequency;
+        instr[i].duration = NOTE_MS;
+        instr[i].startVolume = 800;
+        instr[i].endVolume = 200;
+    }
+    return buf;
+}
+
+static Buffer pcm(bool wide, int voice, int seconds) {
+    int n = seconds * PCM_RATE;
+    auto buf = mkBuffer(NULL, n << wide);
+    for (int i = 0; i < n; ++i) {
+        double v = sin(2 * M_PI * (440 + 50 * voice) * i / PCM_RATE);
+        if (wide)
+            ((int16_t *)buf->data)[i] = (int16_t)(v * 30000);
+        else
+            buf->data[i] = (uint8_t)(128 + v * 120);
+    }
+    return buf;
+}
+
+int main() {
+    int seconds = getenv("BENCH_SECONDS") ? atoi(getenv("BENCH_SECONDS")) : 2;
+    auto snd = getWSynthesizer();
+    static int16_t out[256];
+    const int numSamples = seconds * SAMPLE_RATE;
+
+    printf("%-12s %6s %12s %14s %10s\n", "wave", "voices", "ns/sample", "ns/voice-smpl",
+           "max fill");
+    for (auto &w : waves) {
+        for (int voices = 1; voices <= MAX_SOUNDS; ++voices) {
+            stopPlaying();
+            Buffer bufs[MAX_SOUNDS];
+            for (int v = 0; v < voices; ++v) {
+                if (w.wave >= WAVE_PCM8) {
+                    bool wide = w.wave == WAVE_PCM16;
+                    bufs[v] = pcm(wide, v, seconds + 1);
+                    queuePlayPcm(0, bufs[v], PCM_RATE, (wide ? PCM_16BIT : 0) | 800 << PCM_VOLUME_SHIFT);
+                } else {
+                    bufs[v] = notes(w.wave, v, seconds + 1);
+                    queuePlayInstructions(0, bufs[v]);
+                }
+            }
+
+            uint64_t maxFill = 0;
+            uint64_t start = current_time_us();
+            for (int done = 0; done < numSamples; done += 256) {
+                uint64_t t0 = current_time_us();
+                snd->fillSamples(out, 256);
+                uint64_t t = current_time_us() - t0;
+                if (t > maxFill)
+                    maxFill = t;
+            }
+            double ns = (current_time_us() - start) * 1000.0 / numSamples;
+
+            printf("%-12s %6d %12.1f %14.1f %8dus\n", w.name, voices, ns, ns / voices,
+                   (int)maxFill);
+
+            stopPlaying();
+            for (int v = 0; v < voices; ++v)
+                freeBuffer(bufs[v]);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef __PXT_H
+#define __PXT_H
+
+// Just enough of the runtime for libs/mixer/melody.cpp on the host.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DMESG(...) do { printf(__VA_ARGS__); printf("\n"); } while(0)
+#define NOLOG(...) do {} while (0)
+#define STATIC_ASSERT(e) static_assert(e, #e);
+#define PXT_REGISTER_RESET(fn) ((void)0)
+// no tracing here, as without PXT_TRACE in pxtbase.h
+#define PXT_TRACE_EVENT(ev, a, b) ((void)0)
+#define PXT_TRACE_SPAN(ev, a, b) ((void)0)
+
+#define SINGLETON(ClassName)                                                                       \
+    static ClassName *inst##ClassName;                                                             \
+    ClassName *get##ClassName() {                                                                  \
+        if (!inst##ClassName)                                                                      \
+            inst##ClassName = new ClassName();                                                     \
+        return inst##ClassName;                                                                    \
+    }
+
+struct BoxedBuffer {
+    uint32_t length;
+    uint8_t *data;
+};
+typedef BoxedBuffer *Buffer;
+
+Buffer mkBuffer(const void *data, int len);
+static inline void registerGCObj(Buffer) {}
+static inline void unregisterGCObj(Buffer) {}
+static inline void target_disable_irq() {}
+static inline void target_enable_irq() {}
+void sleep_ms(unsigned ms);
+uint64_t current_time_us();
+
+#endif
@@ -1,99 +1,26 @@
+// The LogQueue of libs/core---vm, which the VM writes DMESG and serial output to and the host
+// reads from.
+//
+//   g++ -O2 -pthread -o queue queue.cpp && ./queue
+
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
 
-#define LOG_QUEUE_SIZE 256
-
-class LogQueue {
-    void writeCore(const char *buf, int len);
-  public:
-    int ptr;
-    char buffer[LOG_QUEUE_SIZE];
-    int rdPtr;
-    int numWrap;
-    LogQueue();
-    int write(const char *buf, int len);
-    int read(char *buf, int len);
-};
-
-LogQueue::LogQueue() {
-    ptr = 0;
-    rdPtr = 0;
-    numWrap = 0;
-    memset(buffer, 0, sizeof(buffer));
-}
-
-void LogQueue::writeCore(const char *buf, int len) {
-    memcpy(buffer + ptr, buf, len);
-    // did we pass it?
-    if (ptr < rdPtr && rdPtr <= ptr + len)
-        rdPtr = -1;
-    ptr += len;
-}
-
-int LogQueue::read(char *buf, int len) {
-    if (rdPtr < 0) {
-        if (numWrap == 0) {
-            rdPtr = 0;
-        } else {
-            rdPtr = ptr + 1;
-        }
-    }
-
-    if (rdPtr <= ptr) {
-        int av = ptr - rdPtr;
-        if (len > av)
-            len = av;
-        memcpy(buf, buffer + rdPtr, len);
-        rdPtr += len;
-    } else {
-        int latter = sizeof(buffer) - rdPtr;
-
-        if (latter >= len) {
-            memcpy(buf, buffer + rdPtr, len);
-            rdPtr += len;
-        } else {
-            memcpy(buf, buffer + rdPtr, latter);
-            buf += latter;
-            int len2 = len - latter;
-            if (len2 > ptr)
-                len2 = ptr;
-            memcpy(buf, buffer, len2);
-            rdPtr = len2;
-            len = latter + len2;
-        }
-    }
-
-    if (rdPtr >= (int)sizeof(buffer))
-        rdPtr = 0;
-
-    return len;
+namespace pxt {
+template <typename T> T min(T a, T b) {
+    return a < b ? a : b;
 }
+} // namespace pxt
 
-int LogQueue::write(const char *buf, int len) {
-    if (len > (int)sizeof(buffer) / 2)
-        return -1;
-
-    int left = sizeof(buffer) - ptr;
-
-    if (left < len + 1) {
-        writeCore(buf, left);
-        buf += left;
-        len -= left;
-        ptr = 0;
-        numWrap++;
-        if (rdPtr == 0)
-            rdPtr = -1;
-    }
-
-    writeCore(buf, len);
-    buffer[ptr] = 0;
-
-    // printf("write %d -> ptr=%d rd=%d\n", len, ptr, rdPtr);
+// small, so that the tests go round it a lot
+#define LOG_QUEUE_SIZE 256
+#include "../libs/core---vm/logqueue.h"
 
-    return 0;
-}
+using namespace pxt;
 
 static uint32_t getrand(int max) {
     // see https://en.wikipedia.org/wiki/Xorshift
@@ -123,7 +50,7 @@ void testQ() {
             wrSize += sz;
         }
 
-        int off = wrSize - (LOG_QUEUE_SIZE - 1);
+        int off = wrSize - LOG_QUEUE_SIZE;
         if (off < 0) {
             off = 0;
         } else {
@@ -156,8 +83,56 @@ void testQ() {
     }
 }
 
+// byte i of the stream
+static char streamByte(uint32_t i) {
+    return (char)(i * 7 + (i >> 8));
+}
+
+static LogQueue *sharedQ;
+static volatile bool writerDone;
+
+static void *writer(void *) {
+    char buf[LOG_QUEUE_SIZE];
+    uint32_t pos = 0;
+    for (int i = 0; i < 50000; ++i) {
+        int sz = getrand(40) + 1;
+        for (int k = 0; k < sz; ++k)
+            buf[k] = streamByte(pos + k);
+        sharedQ->write(buf, sz);
+        pos += sz;
+        if (i % 16 == 0)
+            sched_yield(); // so that the reader keeps up sometimes, and gets lapped other times
+    }
+    writerDone = true;
+    return NULL;
+}
+
+// the host thread reads while the VM writes; whatever it gets has to be what was written there
+void testConcurrent() {
+    sharedQ = new LogQueue();
+    pthread_t th;
+    pthread_create(&th, NULL, writer, NULL);
+    char buf[LOG_QUEUE_SIZE];
+    uint32_t pos = 0;
+    uint64_t numRead = 0, numLost = 0;
+    while (!writerDone) {
+        uint32_t prev = pos;
+        int n = sharedQ->readFrom(pos, buf, getrand(LOG_QUEUE_SIZE) + 1);
+        numLost += pos - prev - n;
+        for (int j = 0; j < n; ++j)
+            if (buf[j] != streamByte(pos - n + j)) {
+                printf("at %u %d != %d\n", pos - n + j, buf[j], streamByte(pos - n + j));
+                exit(1);
+            }
+        numRead += n;
+    }
+    pthread_join(th, NULL);
+    printf("concurrent: %llu bytes read, %llu lost\n", (unsigned long long)numRead,
+           (unsigned long long)numLost);
+}
 
 int main() {
     testQ();
+    testConcurrent();
     printf("OK\n");
 }
\ No newline at end of file
@@ -0,0 +1,195 @@
+// Timing of the image primitives in libs/screen/image.cpp on 160x120 4bpp frames, as drawn by a
+// typical game: sprites (opaque and transparent, word-aligned or not, clipped at the edges), fills,
+// textured rows, scrolling, circles, lines and color replacement. Reports ns per call and per
+// pixel touched.
+//
+//   make bench
+//
+// For a run on a device, build bench.cpp and libs/screen/image.cpp with the target toolchain,
+// -DBENCH_DEVICE and -DBENCH_NOW_NS=<function returning uint64_t nanoseconds>, possibly with
+// -DBENCH_SCALE=0.1, and call benchMain() from the firmware; results go through DMESG().
+
+#include "pxt.h"
+#include <stdlib.h>
+#include <time.h>
+
+namespace ImageMethods {
+void fill(Image_ img, int c);
+void fillRect(Image_ img, int x, int y, int w, int h, int c);
+void setPixel(Image_ img, int x, int y, int c);
+void scroll(Image_ img, int dx, int dy);
+void replace(Image_ img, int from, int to);
+void drawLine(Image_ img, int x0, int y0, int x1, int y1, int c);
+void fillCircle(Image_ img, int cx, int cy, int r, int c);
+void blitRow(Image_ img, int x, int y, Image_ from, int fromX, int fromH);
+bool drawImageCore(Image_ img, Image_ from, int x, int y, int color);
+} // namespace ImageMethods
+
+#define SCREEN_W 160
+#define SCREEN_H 120
+
+#ifdef BENCH_DEVICE
+extern uint64_t BENCH_NOW_NS();
+#else
+static uint64_t nowNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+#define BENCH_NOW_NS nowNs
+#endif
+
+#ifndef BENCH_SCALE
+#define BENCH_SCALE 1
+#endif
+
+static Image_ screen;
+
+// a round blob with a transparent border, like most sprites
+static Image_ makeSprite(int w, int h) {
+    auto img = mkImage(w, h, 4);
+    ImageMethods::fill(img, 0);
+    for (int x = 0; x < w; ++x)
+        for (int y = 0; y < h; ++y) {
+            int dx = 2 * x - w + 1, dy = 2 * y - h + 1;
+            if (dx * dx + dy * dy < w * h)
+                ImageMethods::setPixel(img, x, y, 1 + (x + y) % 15);
+        }
+    return img;
+}
+
+static void report(const char *name, uint64_t t0, int calls, int pixelsPerCall) {
+    auto ns = (double)(BENCH_NOW_NS() - t0);
+    DMESG("%-28s %8.0f ns/call %7.2f ns/pixel", name, ns / calls,
+          ns / ((double)calls * pixelsPerCall));
+}
+
+static void benchSprites(const char *name, Image_ sprite, bool transparent, int yStep, bool clip) {
+    int n = 20000 * BENCH_SCALE;
+    int w = sprite->width(), h = sprite->height();
+    auto t0 = BENCH_NOW_NS();
+    for (int i = 0; i < n; ++i) {
+        int x, y;
+        if (clip) {
+            // half off one of the edges
+            x = i & 1 ? -w / 2 : SCREEN_W - w / 2;
+            y = (i * yStep) % (SCREEN_H - h);
+        } else {
+            x = (i * 7) % (SCREEN_W - w);
+            y = (i * yStep) % (SCREEN_H - h);
+        }
+        ImageMethods::drawImageCore(screen, sprite, x, y, transparent ? 0 : -2);
+    }
+    report(name, t0, n, clip ? w * h / 2 : w * h);
+}
+
+static void benchFillRect() {
+    int n = 20000 * BENCH_SCALE;
+    auto t0 = BENCH_NOW_NS();
+    for (int i = 0; i < n; ++i)
+        ImageMethods::fillRect(screen, (i * 7) % 130, (i * 13) % 90, 30, 30, i & 15);
+    report("fillRect 30x30", t0, n, 30 * 30);
+
+    n = 2000 * BENCH_SCALE;
+    t0 = BENCH_NOW_NS();
+    for (int i = 0; i < n; ++i)
+        ImageMethods::fillRect(screen, 0, 0, SCREEN_W, SCREEN_H, i & 15);
+    report("fillRect full screen", t0, n, SCREEN_W * SCREEN_H);
+}
+
+static void benchBlitRow() {
+    // a raycaster wall: one textured column per screen column
+    auto texture = makeSprite(16, 16);
+    int n = 200 * BENCH_SCALE;
+    auto t0 = BENCH_NOW_NS();
+    for (int i = 0; i < n; ++i)
+        for (int x = 0; x < SCREEN_W; ++x) {
+            int h = 20 + (x + i) % 100;
+            ImageMethods::blitRow(screen, x, (SCREEN_H - h) / 2, texture, x & 15, h);
+        }
+    report("blitRow wall", t0, n * SCREEN_W, 70);
+}
+
+static void benchScroll() {
+    int n = 2000 * BENCH_SCALE;
+    auto t0 = BENCH_NOW_NS();
+    for (int i = 0; i < n; ++i)
+        ImageMethods::scroll(screen, i & 1 ? 1 : -1, 0);
+    report("scroll x", t0, n, SCREEN_W * SCREEN_H);
+
+    t0 = BENCH_NOW_NS();
+    for (int i = 0; i < n; ++i)
+        ImageMethods::scroll(screen, 0, i & 1 ? 1 : -1);
+    report("scroll y", t0, n, SCREEN_W * SCREEN_H);
+}
+
+static void benchShapes() {
+    int n = 20000 * BENCH_SCALE;
+    auto t0 = BENCH_NOW_NS();
+    for (int i = 0; i < n; ++i)
+        ImageMethods::fillCircle(screen, 20 + (i * 7) % 120, 20 + (i * 13) % 80, 15, i & 15);
+    report("fillCircle r=15", t0, n, 709); // pixels in a circle of radius 15
+
+    t0 = BENCH_NOW_NS();
+    for (int i = 0; i < n; ++i)
+        ImageMethods::drawLine(screen, 0, (i * 13) % SCREEN_H, SCREEN_W - 1,
+                               SCREEN_H - 1 - (i * 13) % SCREEN_H, i & 15);
+    report("drawLine shallow", t0, n, SCREEN_W);
+
+    t0 = BENCH_NOW_NS();
+    for (int i = 0; i < n; ++i)
+        ImageMethods::drawLine(screen, (i * 7) % SCREEN_W, 0, SCREEN_W - 1 - (i * 7) % SCREEN_W,
+                               SCREEN_H - 1, i & 15);
+    report("drawLine steep", t0, n, SCREEN_H);
+
+    n = 2000 * BENCH_SCALE;
+    t0 = BENCH_NOW_NS();
+    for (int i = 0; i < n; ++i)
+        ImageMethods::replace(screen, i & 15, (i + 1) & 15);
+    report("replace", t0, n, SCREEN_W * SCREEN_H);
+}
+
+extern "C" int benchMain() {
+    screen = mkImage(SCREEN_W, SCREEN_H, 4);
+    ImageMethods::fill(screen, 3);
+
+    auto s16 = makeSprite(16, 16);
+    auto s8 = makeSprite(8, 8);
+    auto s32 = makeSprite(32, 24);
+
+    // y steps of 8 keep 4bpp sprites word-aligned, odd ones don't
+    benchSprites("drawImage 16x16 aligned", s16, false, 8, false);
+    benchSprites("drawImage 16x16 unaligned", s16, false, 13, false);
+    benchSprites("drawImage 16x16 clipped", s16, false, 13, true);
+    benchSprites("transparent 16x16 aligned", s16, true, 8, false);
+    benchSprites("transparent 16x16 unaligned", s16, true, 13, false);
+    benchSprites("transparent 16x16 clipped", s16, true, 13, true);
+    benchSprites("transparent 8x8", s8, true, 13, false);
+    benchSprites("transparent 32x24", s32, true, 13, false);
+    benchFillRect();
+    benchBlitRow();
+    benchScroll();
+    benchShapes();
+    return 0;
+}
+
+#ifndef BENCH_DEVICE
+extern "C" int main() {
+    return benchMain();
+}
+
+void *operator new(size_t sz) {
+    return malloc(sz);
+}
+void *operator new[](size_t sz) {
+    return malloc(sz);
+}
+void operator delete(void *p) {
+    free(p);
+}
+
+extern "C" void target_panic(int code) {
+    DMESG("PANIC %d", code);
+    exit(1);
+}
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+// the parts of CODAL's DataStream used by the spectrum analyzer
+
+#define DATASTREAM_FORMAT_8BIT_UNSIGNED 1
+#define DATASTREAM_FORMAT_8BIT_SIGNED 2
+#define DATASTREAM_FORMAT_16BIT_SIGNED 4
+
+class ManagedBuffer {
+  public:
+    uint8_t *data;
+    int len;
+    ManagedBuffer() : data(NULL), len(0) {}
+    ManagedBuffer(uint8_t *data, int len) : data(data), len(len) {}
+    uint8_t *getBytes() { return data; }
+    int length() { return len; }
+};
+
+namespace codal {
+class DataSink {
+  public:
+    virtual int pullRequest() { return 0; }
+};
+class DataSource {
+  public:
+    virtual ManagedBuffer pull() { return ManagedBuffer(); }
+    virtual void connect(DataSink &) {}
+    virtual void disconnect() {}
+    virtual int getFormat() { return DATASTREAM_FORMAT_16BIT_SIGNED; }
+    virtual int setFormat(int) { return 0; }
+};
+} // namespace codal
@@ -0,0 +1,83 @@
+// The bands of libs/microphone/spectrum.cpp for tones swept across the spectrum, which should
+// peak in the band holding their frequency, and the cost of a window of each size.
+//
+//   make bench
+
+#include "pxt.h"
+#include "spectrum.h"
+#include <math.h>
+#include <time.h>
+
+#define SAMPLE_RATE 16000
+#define BANDS 8
+
+using namespace pxt;
+
+namespace pxt {
+SpectrumAnalyzer *getMicrophoneSpectrum() {
+    return NULL;
+}
+} // namespace pxt
+
+static void tone(int16_t *dst, int n, float freq, float amplitude) {
+    static float phase;
+    for (int i = 0; i < n; ++i) {
+        dst[i] = (int16_t)(amplitude * sinf(phase));
+        phase += 2 * (float)M_PI * freq / SAMPLE_RATE;
+        if (phase > 2 * (float)M_PI)
+            phase -= 2 * (float)M_PI;
+    }
+}
+
+static int loudestBand(SpectrumAnalyzer &s) {
+    int best = 0;
+    for (int b = 1; b < BANDS; ++b)
+        if (s.bandLevel(b) > s.bandLevel(best))
+            best = b;
+    return best;
+}
+
+int main() {
+    codal::DataSource mic;
+    SpectrumAnalyzer s(mic);
+    int16_t buf[SPECTRUM_MAX_WINDOW];
+    int fails = 0;
+
+    s.configure(256, BANDS);
+    printf("tone (Hz)  band  levels\n");
+    int prev = 0;
+    for (float f = 100; f < SAMPLE_RATE / 2; f *= 1.5f) {
+        tone(buf, 256, f, 16000);
+        s.analyze(buf, 256);
+        int b = loudestBand(s);
+        printf("%9d  %4d ", (int)f, b);
+        for (int i = 0; i < BANDS; ++i)
+            printf(" %3d", s.bandLevel(i));
+        printf("\n");
+        // higher tones never go to a lower band
+        if (b < prev)
+            fails++;
+        prev = b;
+    }
+
+    tone(buf, 256, 1000, 0);
+    s.analyze(buf, 256);
+    for (int i = 0; i < BANDS; ++i)
+        if (s.bandLevel(i))
+            fails++;
+
+    printf("\nwindow  us per window  us per sample\n");
+    for (int size = SPECTRUM_MIN_WINDOW; size <= SPECTRUM_MAX_WINDOW; size *= 2) {
+        s.configure(size, BANDS);
+        tone(buf, size, 440, 8000);
+        int n = 2000000 / size;
+        clock_t t0 = clock();
+        for (int i = 0; i < n; ++i)
+            s.analyze(buf, size);
+        double us = (clock() - t0) * 1e6 / CLOCKS_PER_SEC / n;
+        printf("%6d  %13.2f  %13.3f\n", size, us, us / size);
+    }
+
+    printf("\n%s\n", fails ? "FAILED" : "OK");
+    return fails != 0;
+}
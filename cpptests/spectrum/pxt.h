@@ -0,0 +1,24 @@
+#ifndef __PXT_H
+#define __PXT_H
+
+// Just enough of the runtime for libs/microphone/spectrum.cpp on the host.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEVICE_OK 0
+#define xmalloc malloc
+#define xfree free
+#define target_disable_irq() ((void)0)
+#define target_enable_irq() ((void)0)
+
+template <typename T> inline const T &min(const T &a, const T &b) {
+    return a < b ? a : b;
+}
+template <typename T> inline const T &max(const T &a, const T &b) {
+    return a > b ? a : b;
+}
+
+#endif
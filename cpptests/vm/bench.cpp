@@ -0,0 +1,243 @@
+// Cost of running bytecode in exec_loop() of libs/core---vm/vm.cpp. A loop like the ones
+// pxt compiles from
+//
+//   let s = 0, i = 0, more = true
+//   while (more) { s = s + i; i = i + 1; more = i < N }
+//
+// is put in an image and run to the end, and the ns per iteration and per instruction are
+// reported. The Makefile builds this once decoding the opcodes and once with PXT_VM_THREADED,
+// so the two can be compared; both must come up with the same sum.
+//
+//   make bench
+//
+// BENCH_ITERATIONS=<n> sets the number of times around the loop.
+
+#include "pxt.h"
+#include <malloc.h>
+#include <time.h>
+
+namespace numops {
+TNumber adds(TNumber a, TNumber b);
+TNumber lt(TNumber a, TNumber b);
+} // namespace numops
+
+namespace pxt {
+void op_stloc(FiberContext *ctx, unsigned arg);
+void op_ldloc(FiberContext *ctx, unsigned arg);
+void op_ldnumber(FiberContext *ctx, unsigned arg);
+void op_jmp(FiberContext *ctx, unsigned arg);
+void op_jmpz(FiberContext *ctx, unsigned arg);
+void op_ret(FiberContext *ctx, unsigned arg);
+void op_pushmany(FiberContext *ctx, unsigned arg);
+void op_ldspecial(FiberContext *ctx, unsigned arg);
+void op_ldint(FiberContext *ctx, unsigned arg);
+FiberContext *setupThread(Action a, TValue arg = 0);
+void *gcPreallocDone();
+
+// rtcalls take the last argument in r0 and pop the others
+static void rt_adds(FiberContext *ctx) {
+    ctx->r0 = numops::adds(ctx->sp[0], ctx->r0);
+    ctx->sp++;
+}
+
+static void rt_lt(FiberContext *ctx) {
+    ctx->r0 = numops::lt(ctx->sp[0], ctx->r0);
+    ctx->sp++;
+}
+
+// there is no screen package to draw on
+void updateScreen(Image_ img) {}
+} // namespace pxt
+
+using namespace pxt;
+
+// the order of the names in the OpCodeMap section
+enum {
+    OP_STLOC,
+    OP_LDLOC,
+    OP_LDNUMBER,
+    OP_JMP,
+    OP_JMPZ,
+    OP_RET,
+    OP_PUSHMANY,
+    OP_LDSPECIAL,
+    OP_LDINT,
+    RT_ADDS = VM_FIRST_RTCALL,
+    RT_LT,
+    NUM_OPS,
+};
+
+PXT_SHIMS_BEGIN
+{"pxt::op_stloc", op_stloc, 0},
+{"pxt::op_ldloc", op_ldloc, 0},
+{"pxt::op_ldnumber", op_ldnumber, 0},
+{"pxt::op_jmp", op_jmp, 0},
+{"pxt::op_jmpz", op_jmpz, 0},
+{"pxt::op_ret", op_ret, 0},
+{"pxt::op_pushmany", op_pushmany, 0},
+{"pxt::op_ldspecial", op_ldspecial, 0},
+{"pxt::op_ldint", op_ldint, 0},
+// the name prepareFuse() looks for, to fuse ldint with it
+{"numops::adds", (OpFun)rt_adds, 2},
+{"numops::lt", (OpFun)rt_lt, 2},
+PXT_SHIMS_END
+
+// indexed like the enum above; the rest are unused
+static const char *opNames[NUM_OPS] = {
+    "pxt::op_stloc", "pxt::op_ldloc",    "pxt::op_ldnumber",  "pxt::op_jmp",   "pxt::op_jmpz",
+    "pxt::op_ret",   "pxt::op_pushmany", "pxt::op_ldspecial", "pxt::op_ldint",
+};
+
+#define MAX_IMAGE_WORDS 4096
+static uint64_t image[MAX_IMAGE_WORDS];
+static unsigned imageWords;
+
+static void addSection(SectionType type, const void *data, unsigned len) {
+    auto size = (8 + len + 7) & ~7;
+    auto sect = (VMImageSection *)&image[imageWords];
+    if (imageWords + size / 8 > MAX_IMAGE_WORDS) {
+        fprintf(stderr, "image too big\n");
+        exit(1);
+    }
+    sect->type = type;
+    sect->size = size;
+    memcpy(sect->data, data, len);
+    imageWords += size / 8;
+}
+
+// the function, as it's laid out in its section after the header
+static struct {
+    uint16_t len, numArgs, initialLen, flags;
+    uint64_t func;
+    uint16_t code[128];
+} fn;
+static unsigned pc;
+
+static void emit(int opIdx, unsigned arg = 0, bool push = false) {
+    fn.code[pc++] = opIdx | (push ? VM_OPCODE_PUSH_MASK : 0) | arg << VM_OPCODE_ARG_POS;
+}
+
+static void emitRtCall(int opIdx) {
+    fn.code[pc++] = 0x8000 | opIdx;
+}
+
+// always with the extended-arg prefix, so that the offset can be filled in later
+static unsigned emitJump() {
+    pc += 2;
+    return pc;
+}
+
+static void patchJump(unsigned after, int opIdx, unsigned target) {
+    int arg = (int)target - (int)after;
+    fn.code[after - 2] = 0xc000 | ((arg >> 9) & 0x3fff);
+    fn.code[after - 1] = opIdx | (arg & 0x1ff) << VM_OPCODE_ARG_POS;
+}
+
+// the locals, below the return address
+#define LOC_I 0
+#define LOC_S 1
+#define LOC_MORE 2
+
+static unsigned buildImage(unsigned iterations) {
+    VMImageHeader hd;
+    memset(&hd, 0, sizeof(hd));
+    hd.magic0 = VM_MAGIC0;
+    hd.magic1 = VM_MAGIC1;
+    addSection(SectionType::InfoHeader, &hd, sizeof(hd));
+
+    char names[NUM_OPS * 20], *p = names;
+    opNames[RT_ADDS] = "numops::adds";
+    opNames[RT_LT] = "numops::lt";
+    for (int i = 0; i < NUM_OPS; ++i) {
+        auto name = opNames[i] ? opNames[i] : "";
+        strcpy(p, name);
+        p += strlen(name) + 1;
+    }
+    addSection(SectionType::OpCodeMap, names, p - names);
+
+    uint64_t numbers[] = {(uint64_t)TAG_NUMBER(iterations)};
+    addSection(SectionType::NumberLiterals, numbers, sizeof(numbers));
+    int32_t config[] = {0, 0};
+    addSection(SectionType::ConfigData, config, sizeof(config));
+
+    pc = 0;
+    emit(OP_PUSHMANY, 3);
+    emit(OP_LDINT, 0);
+    emit(OP_STLOC, LOC_I);
+    emit(OP_LDINT, 0);
+    emit(OP_STLOC, LOC_S);
+    emit(OP_LDSPECIAL, (uintptr_t)TAG_TRUE);
+    emit(OP_STLOC, LOC_MORE);
+    auto loop = pc;
+    emit(OP_LDLOC, LOC_MORE);
+    auto exitJump = emitJump();
+    // s = s + i
+    emit(OP_LDLOC, LOC_S, true);
+    emit(OP_LDLOC, LOC_I + 1);
+    emitRtCall(RT_ADDS);
+    emit(OP_STLOC, LOC_S);
+    // i = i + 1
+    emit(OP_LDLOC, LOC_I, true);
+    emit(OP_LDINT, 1);
+    emitRtCall(RT_ADDS);
+    emit(OP_STLOC, LOC_I);
+    // more = i < N
+    emit(OP_LDLOC, LOC_I, true);
+    emit(OP_LDNUMBER, 0);
+    emitRtCall(RT_LT);
+    emit(OP_STLOC, LOC_MORE);
+    patchJump(emitJump(), OP_JMP, loop);
+    patchJump(exitJump, OP_JMPZ, pc);
+    emit(OP_LDLOC, LOC_S);
+    emit(OP_RET, 0 | 3 << 6);
+
+    addSection(SectionType::Function, &fn, VM_FUNCTION_CODE_OFFSET - 8 + pc * 2);
+    // ldloc, jmpz, 12 in the body, jmp
+    return 15;
+}
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main() {
+    auto env = getenv("BENCH_ITERATIONS");
+    unsigned iterations = env ? atoi(env) : 20000000;
+    auto perIteration = buildImage(iterations);
+
+    // the image block has to be where isReadOnly() takes it for flash, that is at a low
+    // address, so malloc() mustn't mmap() it
+    mallopt(M_MMAP_THRESHOLD, 64 << 20);
+    gcPreStartup();
+    auto img = loadVMImage(image, imageWords * 8);
+    img->preallocBlock = gcPreallocDone();
+    if (img->errorCode) {
+        fprintf(stderr, "validation error %d at 0x%x\n", img->errorCode, img->errorOffset);
+        return 1;
+    }
+    vmImg = img;
+    gcStartup();
+
+    auto f = setupThread((Action)img->entryPoint);
+    currentFiber = f;
+    f->pc = f->resumePC;
+    auto t0 = nowNs();
+    exec_loop(f);
+    auto ns = (double)(nowNs() - t0);
+
+    auto expected = (double)iterations * (iterations - 1) / 2;
+    if (toDouble(f->r0) != expected) {
+        fprintf(stderr, "sum is %.0f, not %.0f\n", toDouble(f->r0), expected);
+        return 1;
+    }
+#ifdef PXT_VM_THREADED
+    auto mode = "threaded";
+#else
+    auto mode = "decoding";
+#endif
+    printf("exec_loop(), %s: %.2f ns/iteration, %.2f ns/instruction\n", mode, ns / iterations,
+           ns / iterations / perIteration);
+    return 0;
+}
@@ -0,0 +1,2 @@
+// what a program compiled for the VM has
+#define PXT_VM 1
@@ -21,6 +21,21 @@
 #include "LIS3DH.h"
 #endif
 
+// Read the LIS3DH samples in batches from its FIFO, instead of one per interrupt. The sensor's own
+// axes are used as they are, so boards that turn this on set ACCELEROMETER_SPACE to match how it
+// is mounted.
+#ifndef PXT_ACCELEROMETER_FIFO
+#define PXT_ACCELEROMETER_FIFO 0
+#endif
+// samples in the FIFO (of 32) that raise the interrupt
+#ifndef ACCELEROMETER_FIFO_WATERMARK
+#define ACCELEROMETER_FIFO_WATERMARK 16
+#endif
+// the FIFO is also read when the last batch is older than this, for readers in between
+#ifndef ACCELEROMETER_FIFO_MAX_AGE_MS
+#define ACCELEROMETER_FIFO_MAX_AGE_MS 20
+#endif
+
 #ifndef PXT_SUPPORT_MMA8653
 #define PXT_SUPPORT_MMA8653 0
 #endif
@@ -62,6 +77,68 @@
 
 namespace pxt {
 
+#if PXT_SUPPORT_LIS3DH && PXT_ACCELEROMETER_FIFO
+#define LIS3DH_FIFO_CTRL3 0x22
+#define LIS3DH_FIFO_CTRL5 0x24
+#define LIS3DH_FIFO_OUT_X_L 0x28
+#define LIS3DH_FIFO_CTRL 0x2E
+#define LIS3DH_FIFO_SRC 0x2F
+
+class LIS3DHFifo : public LIS3DH {
+    codal::I2C &bus;
+    Pin &irq;
+    uint16_t addr;
+    uint32_t lastRead;
+
+  public:
+    LIS3DHFifo(codal::I2C &i2c, Pin &int1, CoordinateSpace &space, uint16_t address)
+        : LIS3DH(i2c, int1, space, address), bus(i2c), irq(int1), addr(address), lastRead(0) {}
+
+    virtual int configure() override {
+        int r = LIS3DH::configure();
+        if (r != DEVICE_OK)
+            return r;
+        // stream mode, which drops the oldest samples when full, and INT1 on the watermark
+        // instead of on every sample
+        if (bus.writeRegister(addr, LIS3DH_FIFO_CTRL5, 0x40) ||
+            bus.writeRegister(addr, LIS3DH_FIFO_CTRL, 0x80 | ACCELEROMETER_FIFO_WATERMARK) ||
+            bus.writeRegister(addr, LIS3DH_FIFO_CTRL3, 0x04))
+            return DEVICE_I2C_ERROR;
+        return DEVICE_OK;
+    }
+
+    virtual int requestUpdate() override {
+        status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
+
+        uint32_t now = current_time_ms();
+        if (!irq.getDigitalValue() && now - lastRead < ACCELEROMETER_FIFO_MAX_AGE_MS)
+            return DEVICE_OK;
+        lastRead = now;
+
+        uint8_t src;
+        if (bus.readRegister(addr, LIS3DH_FIFO_SRC, &src, 1))
+            return DEVICE_I2C_ERROR;
+        int n = src & 0x40 ? 32 : src & 0x1f; // overrun means full
+        if (!n)
+            return DEVICE_OK;
+
+        // the address goes back from Z_H to X_L, so this is all of them, oldest first
+        int16_t data[32 * 3];
+        if (bus.readRegister(addr, 0x80 | LIS3DH_FIFO_OUT_X_L, (uint8_t *)data, n * 6))
+            return DEVICE_I2C_ERROR;
+
+        // left-justified, full scale is sampleRange g; gestures are tracked on every sample
+        for (int i = 0; i < n; ++i) {
+            sampleENU.x = (data[i * 3] * sampleRange * 1000) >> 15;
+            sampleENU.y = (data[i * 3 + 1] * sampleRange * 1000) >> 15;
+            sampleENU.z = (data[i * 3 + 2] * sampleRange * 1000) >> 15;
+            update();
+        }
+        return DEVICE_OK;
+    }
+};
+#endif
+
     /*
 RAW,                            0x000000
 SIMPLE_CARTESIAN,               0x000001
@@ -194,8 +271,12 @@ private:
 #if PXT_SUPPORT_LIS3DH
         case ACCELEROMETER_TYPE_LIS3DH:
         case ACCELEROMETER_TYPE_LIS3DH_ALT:
+#if PXT_ACCELEROMETER_FIFO
+            return new LIS3DHFifo(*i2c, *LOOKUP_PIN(ACCELEROMETER_INT), space, accType);
+#else
             return new LIS3DH(*i2c, *LOOKUP_PIN(ACCELEROMETER_INT), space, accType);
 #endif
+#endif
 #if PXT_SUPPORT_MSA300
         case ACCELEROMETER_TYPE_MSA300:
             return new MSA300(*i2c, *LOOKUP_PIN(ACCELEROMETER_INT), space);
@@ -0,0 +1,159 @@
+#include "pxt.h"
+
+namespace animation {
+
+// the fields of an animation track for _stepTracks(), each an Int32LE value; a path track is
+// followed by NUM_NODE_FIELDS values for each of its nodes. Must match animation.ts
+enum TrackField {
+    FLAGS,
+    START,  // ms, when the track was first stepped
+    PERIOD, // ms * 256 it takes to go through STEPS frames or nodes
+    STEPS,
+    COUNT, // frames or nodes
+    LAST,  // the index of the frame or node the track was at
+    OUT_X, // the frame, for image tracks
+    OUT_Y,
+    NUM_TRACK_FIELDS
+};
+enum NodeField { NODE_TYPE, P0X, P0Y, P1X, P1Y, P2X, P2Y, P3X, P3Y, NUM_NODE_FIELDS };
+enum NodeType { MOVE_TO, LINE_TO, QUADRATIC_CURVE_TO, CUBIC_CURVE_TO };
+
+#define TRACK_PATH 0x01
+#define TRACK_LOOP 0x02
+#define TRACK_STARTED 0x04
+#define TRACK_DONE 0x08
+#define TRACK_MOVED 0x10 // OUT_X and OUT_Y were set by the last step
+
+static bool isBuffer(TValue v) {
+    auto vt = getAnyVTable(v);
+    return vt && vt->classNo == BuiltInType::BoxedBuffer;
+}
+
+// Math.round()
+static inline int jsRound(double v) {
+    return (int)floor(v + 0.5);
+}
+
+// the index of the frame or node of t at now, and how far into it (0 to 1)
+static int trackIndex(const int32_t *t, int now, double *progress) {
+    int period = max(1, (int)t[PERIOD]);
+    int64_t k = (int64_t)max(0, now - (int)t[START]) * 256 * max(1, (int)t[STEPS]);
+    int64_t idx = k / period;
+    if (progress)
+        *progress = (double)(k - idx * period) / period;
+    return idx > 0x7fffffff ? 0x7fffffff : (int)idx;
+}
+
+// set the position of a sprite at progress p of node; like PathNode.apply(), moves only move at
+// the end
+static bool nodePosition(const int32_t *node, double p, int32_t *out) {
+    double d = 1 - p;
+    switch (node[NODE_TYPE]) {
+    case MOVE_TO:
+        if (p < 1)
+            return false;
+        out[0] = node[P1X];
+        out[1] = node[P1Y];
+        return true;
+    case LINE_TO:
+        out[0] = jsRound((node[P1X] - node[P0X]) * p) + node[P0X];
+        out[1] = jsRound((node[P1Y] - node[P0Y]) * p) + node[P0Y];
+        return true;
+    case QUADRATIC_CURVE_TO: {
+        double a = d * d, b = 2 * d * p, c = p * p;
+        out[0] = jsRound(a * node[P0X] + b * node[P1X] + c * node[P2X]);
+        out[1] = jsRound(a * node[P0Y] + b * node[P1Y] + c * node[P2Y]);
+        return true;
+    }
+    case CUBIC_CURVE_TO: {
+        double a = d * d * d, b = 3 * d * d * p, c = 3 * d * p * p, e = p * p * p;
+        out[0] = jsRound(a * node[P0X] + b * node[P1X] + c * node[P2X] + e * node[P3X]);
+        out[1] = jsRound(a * node[P0Y] + b * node[P1Y] + c * node[P2Y] + e * node[P3Y]);
+        return true;
+    }
+    }
+    return false;
+}
+
+// see ImageAnimation.update()
+static void stepImage(int32_t *t, int now) {
+    int idx = trackIndex(t, now, NULL);
+    int count = t[COUNT];
+    if (t[LAST] != idx && count > 0) {
+        if (!(t[FLAGS] & TRACK_LOOP) && idx >= count) {
+            t[FLAGS] |= TRACK_DONE;
+            return;
+        }
+        t[OUT_X] = idx % count;
+        t[FLAGS] |= TRACK_MOVED;
+    }
+    t[LAST] = idx;
+}
+
+// see Path.run() and MovementAnimation.update()
+static void stepPath(int32_t *t, int len, int now) {
+    int count = t[COUNT];
+    if (count < 0 || len < NUM_TRACK_FIELDS + count * NUM_NODE_FIELDS) {
+        t[FLAGS] |= TRACK_DONE;
+        return;
+    }
+    auto nodes = t + NUM_TRACK_FIELDS;
+    double progress;
+    int idx = trackIndex(t, now, &progress);
+    int last = t[LAST];
+    // the end of the last node, in case it was missed; this makes sure all moves happen
+    if (last > -1 && last < idx && nodePosition(nodes + last * NUM_NODE_FIELDS, 1, t + OUT_X))
+        t[FLAGS] |= TRACK_MOVED;
+    if (idx >= count) {
+        if (t[FLAGS] & TRACK_LOOP)
+            t[START] = now;
+        else
+            t[FLAGS] |= TRACK_DONE;
+        return;
+    }
+    t[LAST] = idx;
+    if (nodePosition(nodes + idx * NUM_NODE_FIELDS, progress, t + OUT_X))
+        t[FLAGS] |= TRACK_MOVED;
+}
+
+/**
+ * Step the animation tracks in one go to now (ms): the frames of image tracks and the positions
+ * along path tracks. Writes the indices of the tracks which changed or are done into events, as
+ * UInt16LE values, along with those which are not buffers (animations stepped one at a time);
+ * returns how many there are.
+ */
+//%
+int _stepTracks(RefCollection *tracks, int now, Buffer events) {
+    int n = tracks->length();
+    int maxEvents = events->length / 2;
+    auto ev = (uint16_t *)events->data;
+    int numEvents = 0;
+    for (int i = 0; i < n && numEvents < maxEvents; ++i) {
+        auto v = tracks->getAt(i);
+        if (!isBuffer(v)) {
+            ev[numEvents++] = i;
+            continue;
+        }
+        auto buf = (Buffer)v;
+        int len = buf->length / sizeof(int32_t);
+        if (len < NUM_TRACK_FIELDS)
+            continue;
+        auto t = (int32_t *)buf->data;
+        if (!(t[FLAGS] & TRACK_DONE)) {
+            t[FLAGS] &= ~TRACK_MOVED;
+            if (!(t[FLAGS] & TRACK_STARTED)) {
+                t[FLAGS] |= TRACK_STARTED;
+                t[START] = now;
+            }
+            if (t[FLAGS] & TRACK_PATH)
+                stepPath(t, len, now);
+            else
+                stepImage(t, now);
+        }
+        if (t[FLAGS] & (TRACK_MOVED | TRACK_DONE))
+            ev[numEvents++] = i;
+    }
+    return numEvents;
+}
+
+} // namespace animation
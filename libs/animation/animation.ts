@@ -6,8 +6,76 @@
 namespace animation {
     const stateNamespace = "__animation";
 
+    //% shim=animation::_stepTracks
+    declare function _stepTracks(tracks: Buffer[], now: number, events: Buffer): number;
+
+    // the fields of a track stepped by _stepTracks(), each an Int32LE value, followed by the
+    // nodes of a path; must match animation.cpp
+    const enum TrackField {
+        Flags,
+        Start,
+        Period, // ms * 256 to go through Steps frames or nodes
+        Steps,
+        Count,
+        Last,
+        OutX, // the frame, for image tracks
+        OutY,
+        NumFields
+    }
+
+    const enum NodeField {
+        Type,
+        Points, // up to 4 (x, y) pairs
+        NumFields = 9
+    }
+
+    const enum NodeType {
+        MoveTo,
+        LineTo,
+        QuadraticCurveTo,
+        CubicCurveTo
+    }
+
+    const enum TrackFlag {
+        Path = 0x01,
+        Loop = 0x02,
+        Done = 0x08,
+        Moved = 0x10
+    }
+
     interface AnimationState {
         animations: SpriteAnimation[];
+        // the _track of each of the animations, for _stepTracks(); undefined when they change
+        tracks: Buffer[];
+        // indices into animations, from _stepTracks()
+        events: Buffer;
+    }
+
+    // a track lasting period ms, with nodes after it; undefined if the native ms * 256 can't hold it
+    function createTrack(flags: number, period: number, steps: number, count: number, numNodes: number) {
+        const p = Math.round(period * 256);
+        if (!(p > 0 && p <= 0x7fffffff))
+            return undefined;
+        const track = control.createBuffer((TrackField.NumFields + numNodes * NodeField.NumFields) * 4);
+        track.setNumber(NumberFormat.Int32LE, TrackField.Flags * 4, flags);
+        track.setNumber(NumberFormat.Int32LE, TrackField.Period * 4, p);
+        track.setNumber(NumberFormat.Int32LE, TrackField.Steps * 4, steps);
+        track.setNumber(NumberFormat.Int32LE, TrackField.Count * 4, count);
+        track.setNumber(NumberFormat.Int32LE, TrackField.Last * 4, -1);
+        return track;
+    }
+
+    function trackField(track: Buffer, field: TrackField) {
+        return track.getNumber(NumberFormat.Int32LE, field * 4);
+    }
+
+    function writeNode(track: Buffer, offset: number, type: NodeType, points: Point[]) {
+        track.setNumber(NumberFormat.Int32LE, offset + NodeField.Type * 4, type);
+        for (let i = 0; i < points.length; ++i) {
+            track.setNumber(NumberFormat.Int32LE, offset + (NodeField.Points + 2 * i) * 4, points[i].x);
+            track.setNumber(NumberFormat.Int32LE, offset + (NodeField.Points + 2 * i + 1) * 4, points[i].y);
+        }
+        return true;
     }
 
     export class Point {
@@ -285,6 +353,23 @@ namespace animation {
             return this.nodes.length;
         }
 
+        /**
+         * A track for _stepTracks() going through the nodes, interval ms each; undefined if
+         * some of them can only be applied by script
+         */
+        public _track(interval: number, loop: boolean): Buffer {
+            const n = this.nodes.length;
+            const track = createTrack(TrackFlag.Path | (loop ? TrackFlag.Loop : 0), interval * n, n, n, n);
+            if (!track)
+                return undefined;
+            for (let i = 0; i < n; ++i) {
+                const offset = (TrackField.NumFields + i * NodeField.NumFields) * 4;
+                if (!this.nodes[i]._encode(track, offset))
+                    return undefined;
+            }
+            return track;
+        }
+
         public run(interval: number, target: Sprite, startedAt: number): boolean {
             const runningTime = control.millis() - startedAt; // The time since the start of the path
             const nodeIndex = Math.floor(runningTime / interval); // The current node
@@ -310,6 +395,13 @@ namespace animation {
 
         apply(target: Sprite, nodeTime: number, interval: number) {};
 
+        /**
+         * Write the node into a path track at offset, for _stepTracks(); false if it can't be
+         */
+        _encode(track: Buffer, offset: number): boolean {
+            return false;
+        }
+
         getLastControlPoint(): Point {
             return null;
         };
@@ -330,6 +422,10 @@ namespace animation {
             nodeTime >= interval && target.setPosition(this.p1.x, this.p1.y);
         }
 
+        _encode(track: Buffer, offset: number) {
+            return writeNode(track, offset, NodeType.MoveTo, [new Point(0, 0), this.p1]);
+        }
+
         getEndPoint(): Point {
             return this.p1;
         }
@@ -347,6 +443,10 @@ namespace animation {
             target.setPosition(x, y);
         }
 
+        _encode(track: Buffer, offset: number) {
+            return writeNode(track, offset, NodeType.LineTo, [this.p0, this.p1]);
+        }
+
         getEndPoint(): Point {
             return this.p1;
         }
@@ -370,6 +470,10 @@ namespace animation {
             target.setPosition(x, y);
         }
 
+        _encode(track: Buffer, offset: number) {
+            return writeNode(track, offset, NodeType.QuadraticCurveTo, [this.p0, this.p1, this.p2]);
+        }
+
         getLastControlPoint(): Point {
             return this.p1;
         }
@@ -398,6 +502,10 @@ namespace animation {
             target.setPosition(x, y);
         }
 
+        _encode(track: Buffer, offset: number) {
+            return writeNode(track, offset, NodeType.CubicCurveTo, [this.p0, this.p1, this.p2, this.p3]);
+        }
+
         getLastControlPoint(): Point {
             return this.p2;
         }
@@ -409,6 +517,8 @@ namespace animation {
 
     export abstract class SpriteAnimation {
         protected startedAt: number;
+        // stepped natively with the other animations of the scene when set; see _step()
+        _track: Buffer;
 
         constructor(public sprite: Sprite, protected loop: boolean) {
         }
@@ -419,15 +529,33 @@ namespace animation {
             // Register animation updates to fire when frames are rendered
             if (!state) {
                 state = game.currentScene().data[stateNamespace] = {
-                    animations: []
+                    animations: [],
+                    tracks: undefined,
+                    events: undefined
                 } as AnimationState;
 
                 game.eventContext().registerFrameHandler(scene.ANIMATION_UPDATE_PRIORITY, () => {
-                    state.animations = state.animations.filter((anim: SpriteAnimation) => {
-                        if (anim.sprite.flags & sprites.Flag.Destroyed)
-                            return false;
-                        return !anim.update(); // If update returns true, the animation is done and will be removed
-                    });
+                    // all the tracks are stepped in one call, and only the animations with something
+                    // to do for their sprite come back
+                    const animations = state.animations;
+                    if (!state.tracks)
+                        state.tracks = animations.map(anim => anim._track);
+                    if (!state.events || state.events.length < 2 * animations.length)
+                        state.events = control.createBuffer(2 * animations.length + 16);
+                    const n = _stepTracks(state.tracks, control.millis(), state.events);
+                    let done: SpriteAnimation[];
+                    for (let i = 0; i < n; ++i) {
+                        const anim = animations[state.events.getNumber(NumberFormat.UInt16LE, 2 * i)];
+                        // If _step returns true, the animation is done and will be removed
+                        if ((anim.sprite.flags & sprites.Flag.Destroyed) || anim._step()) {
+                            if (!done) done = [];
+                            done.push(anim);
+                        }
+                    }
+                    if (done) {
+                        state.animations = state.animations.filter(anim => done.indexOf(anim) < 0);
+                        state.tracks = undefined;
+                    }
                 });
             }
 
@@ -439,12 +567,20 @@ namespace animation {
             });
 
             state.animations.push(this);
+            state.tracks = undefined;
         }
 
         public update(): boolean {
             // This should be implemented by subclasses
             return false;
         }
+
+        /**
+         * Apply the last step of _track to the sprite, or update() without one; true when done
+         */
+        _step(): boolean {
+            return this.update();
+        }
     }
 
     export class ImageAnimation extends SpriteAnimation {
@@ -453,6 +589,18 @@ namespace animation {
         constructor(sprite: Sprite, private frames: Image[], private frameInterval: number, loop?: boolean) {
             super(sprite, loop);
             this.lastFrame = -1;
+            this._track = createTrack(loop ? TrackFlag.Loop : 0, frameInterval, 1, frames.length, 0);
+        }
+
+        _step(): boolean {
+            if (!this._track)
+                return this.update();
+            if (trackField(this._track, TrackField.Flags) & TrackFlag.Done)
+                return true;
+            const newImage = this.frames[trackField(this._track, TrackField.OutX) % this.frames.length];
+            if (newImage && this.sprite.image !== newImage)
+                this.sprite.setImage(newImage);
+            return false;
         }
 
         public update(): boolean {
@@ -480,6 +628,16 @@ namespace animation {
             super(sprite, loop);
 
             this.loop = loop;
+            this._track = path._track(nodeInterval, !!loop);
+        }
+
+        _step(): boolean {
+            if (!this._track)
+                return this.update();
+            const flags = trackField(this._track, TrackField.Flags);
+            if (flags & TrackFlag.Moved)
+                this.sprite.setPosition(trackField(this._track, TrackField.OutX), trackField(this._track, TrackField.OutY));
+            return !!(flags & TrackFlag.Done);
         }
 
         public update(): boolean {
@@ -562,6 +720,7 @@ namespace animation {
                 }
                 return true;
             });
+            state.tracks = undefined;
         }
     }
 
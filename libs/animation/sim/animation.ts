@@ -0,0 +1,119 @@
+namespace pxsim.animation {
+    // must match TrackField and NodeField in animation.cpp
+    const FLAGS = 0, START = 1, PERIOD = 2, STEPS = 3, COUNT = 4, LAST = 5, OUT_X = 6, OUT_Y = 7
+    const NUM_TRACK_FIELDS = 8
+    const NUM_NODE_FIELDS = 9
+    const MOVE_TO = 0, LINE_TO = 1, QUADRATIC_CURVE_TO = 2, CUBIC_CURVE_TO = 3
+    const TRACK_PATH = 0x01, TRACK_LOOP = 0x02, TRACK_STARTED = 0x04, TRACK_DONE = 0x08, TRACK_MOVED = 0x10
+
+    function trackIndex(v: DataView, now: number) {
+        const get = (f: number) => v.getInt32(f * 4, true)
+        const period = Math.max(1, get(PERIOD))
+        const k = Math.max(0, now - get(START)) * 256 * Math.max(1, get(STEPS))
+        const idx = Math.min(Math.floor(k / period), 0x7fffffff)
+        return { idx, progress: (k - idx * period) / period }
+    }
+
+    function nodePosition(v: DataView, node: number, p: number) {
+        const get = (f: number) => v.getInt32((node + f) * 4, true)
+        const d = 1 - p
+        let x: number, y: number
+        switch (get(0)) {
+            case MOVE_TO:
+                if (p < 1)
+                    return false
+                x = get(3)
+                y = get(4)
+                break
+            case LINE_TO:
+                x = Math.round((get(3) - get(1)) * p) + get(1)
+                y = Math.round((get(4) - get(2)) * p) + get(2)
+                break
+            case QUADRATIC_CURVE_TO: {
+                const a = d * d, b = 2 * d * p, c = p * p
+                x = Math.round(a * get(1) + b * get(3) + c * get(5))
+                y = Math.round(a * get(2) + b * get(4) + c * get(6))
+                break
+            }
+            case CUBIC_CURVE_TO: {
+                const a = d * d * d, b = 3 * d * d * p, c = 3 * d * p * p, e = p * p * p
+                x = Math.round(a * get(1) + b * get(3) + c * get(5) + e * get(7))
+                y = Math.round(a * get(2) + b * get(4) + c * get(6) + e * get(8))
+                break
+            }
+            default:
+                return false
+        }
+        v.setInt32(OUT_X * 4, x, true)
+        v.setInt32(OUT_Y * 4, y, true)
+        return true
+    }
+
+    function step(v: DataView, len: number, now: number) {
+        const get = (f: number) => v.getInt32(f * 4, true)
+        const set = (f: number, val: number) => v.setInt32(f * 4, val | 0, true)
+        const flag = (f: number) => set(FLAGS, get(FLAGS) | f)
+        const count = get(COUNT)
+        const { idx, progress } = trackIndex(v, now)
+        if (!(get(FLAGS) & TRACK_PATH)) {
+            if (get(LAST) != idx && count > 0) {
+                if (!(get(FLAGS) & TRACK_LOOP) && idx >= count) {
+                    flag(TRACK_DONE)
+                    return
+                }
+                set(OUT_X, idx % count)
+                flag(TRACK_MOVED)
+            }
+            set(LAST, idx)
+            return
+        }
+
+        if (count < 0 || len < NUM_TRACK_FIELDS + count * NUM_NODE_FIELDS) {
+            flag(TRACK_DONE)
+            return
+        }
+        const last = get(LAST)
+        if (last > -1 && last < idx && nodePosition(v, NUM_TRACK_FIELDS + last * NUM_NODE_FIELDS, 1))
+            flag(TRACK_MOVED)
+        if (idx >= count) {
+            if (get(FLAGS) & TRACK_LOOP)
+                set(START, now)
+            else
+                flag(TRACK_DONE)
+            return
+        }
+        set(LAST, idx)
+        if (nodePosition(v, NUM_TRACK_FIELDS + idx * NUM_NODE_FIELDS, progress))
+            flag(TRACK_MOVED)
+    }
+
+    export function _stepTracks(tracks: RefCollection, now: number, events: RefBuffer) {
+        const maxEvents = events.data.length >> 1
+        const ev = new DataView(events.data.buffer, events.data.byteOffset, events.data.length)
+        let numEvents = 0
+        for (let i = 0; i < tracks.getLength() && numEvents < maxEvents; ++i) {
+            const buf = tracks.getAt(i)
+            if (!(buf instanceof RefBuffer)) {
+                ev.setUint16(2 * numEvents++, i, true)
+                continue
+            }
+            const len = buf.data.length >> 2
+            if (len < NUM_TRACK_FIELDS)
+                continue
+            const v = new DataView(buf.data.buffer, buf.data.byteOffset, buf.data.length)
+            let flags = v.getInt32(FLAGS * 4, true)
+            if (!(flags & TRACK_DONE)) {
+                flags &= ~TRACK_MOVED
+                if (!(flags & TRACK_STARTED)) {
+                    flags |= TRACK_STARTED
+                    v.setInt32(START * 4, now, true)
+                }
+                v.setInt32(FLAGS * 4, flags, true)
+                step(v, len, now)
+            }
+            if (v.getInt32(FLAGS * 4, true) & (TRACK_MOVED | TRACK_DONE))
+                ev.setUint16(2 * numEvents++, i, true)
+        }
+        return numEvents
+    }
+}
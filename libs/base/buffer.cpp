@@ -116,6 +116,9 @@ Buffer slice(Buffer buf, int offset = 0, int length = -1) {
     if (length < 0)
         length = buf->length;
     length = min(length, buf->length - offset);
+    // buffers in flash can't change, so all of one is as good as a copy
+    if (length == buf->length && buf->isReadOnly())
+        return buf;
     return mkBuffer(buf->data + offset, length);
 }
 
@@ -158,16 +161,52 @@ String toString(Buffer buf) {
     return mkString((char *)buf->data, buf->length);
 }
 
+/**
+ * Convert a fragment of a buffer to string assuming UTF8 encoding, without copying the fragment
+ * to a new buffer first.
+ * @param offset where the fragment starts, eg: 0
+ * @param length the number of bytes in it; if negative, the rest of the buffer, eg: -1
+ */
+//%
+String sliceToString(Buffer buf, int offset = 0, int length = -1) {
+    offset = max(0, min((int)buf->length, offset));
+    if (length < 0)
+        length = buf->length;
+    length = min(length, buf->length - offset);
+    return mkString((char *)buf->data + offset, length);
+}
+
+/**
+ * Return the offset of the first byte equal to `value` in a fragment of the buffer, or -1.
+ * @param start where the fragment starts, eg: 0
+ * @param length the number of bytes in it; if negative, the rest of the buffer, eg: -1
+ */
+//%
+int indexOfByte(Buffer buf, int value, int start = 0, int length = -1) {
+    start = max(0, min((int)buf->length, start));
+    if (length < 0)
+        length = buf->length;
+    length = min(length, buf->length - start);
+    auto p = (const uint8_t *)memchr(buf->data + start, value & 0xff, length);
+    return p ? p - buf->data : -1;
+}
+
 /**
  * Convert a buffer to its hexadecimal representation.
  */
 //%
 String toHex(Buffer buf) {
     const char *hex = "0123456789abcdef";
-    auto res = mkStringCore(NULL, buf->length * 2);
-    for (int i = 0; i < buf->length; ++i) {
-        res->ascii.data[i << 1] = hex[buf->data[i] >> 4];
-        res->ascii.data[(i << 1) + 1] = hex[buf->data[i] & 0xf];
+    int len = buf->length;
+    auto res = mkStringCore(NULL, len * 2);
+    // in locals, as the stores through char* would otherwise make them be loaded again every time
+    auto src = buf->data;
+    auto dst = res->ascii.data;
+    for (int i = 0; i < len; ++i) {
+        uint8_t b = src[i];
+        dst[0] = hex[b >> 4];
+        dst[1] = hex[b & 0xf];
+        dst += 2;
     }
     return res;
 }
@@ -235,8 +274,846 @@ uint32_t hash(Buffer buf, int bits) {
         return ((h ^ (h >> bits)) & ((1 << bits) - 1));
 }
 
+// The CRC32 of zlib and Ethernet. When the chip has a CRC unit, targets provide
+// pxt::crc32Hardware(), which does as much as it can from the start of the data.
+static const uint32_t crc32Table[256] = {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+};
+
+/**
+ * Compute the CRC32 checksum of the buffer (the one of zlib, PNG and Ethernet).
+ */
+//%
+uint32_t crc32(Buffer buf) {
+    uint32_t crc = 0xffffffff;
+    unsigned n = buf->length;
+    unsigned i = crc32Hardware(buf->data, n, &crc);
+    const uint8_t *p = buf->data;
+    for (; i < n; ++i)
+        crc = crc32Table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+#define XXH_PRIME1 2654435761U
+#define XXH_PRIME2 2246822519U
+#define XXH_PRIME3 3266489917U
+#define XXH_PRIME4 668265263U
+#define XXH_PRIME5 374761393U
+
+static inline uint32_t rotl32(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t read32LE(const uint8_t *p) {
+    uint32_t r;
+    memcpy(&r, p, 4);
+    return r;
+}
+
+static inline uint32_t xxhRound(uint32_t v, uint32_t input) {
+    return rotl32(v + input * XXH_PRIME2, 13) * XXH_PRIME1;
+}
+
+/**
+ * Compute the 32-bit xxHash of the buffer; much faster than hash(), and also non-cryptographic.
+ * @param seed changes the hash, eg: 0
+ */
+//%
+uint32_t hash32(Buffer buf, int seed) {
+    const uint8_t *p = buf->data;
+    const uint8_t *end = p + buf->length;
+    uint32_t s = seed;
+    uint32_t h;
+
+    if (buf->length >= 16) {
+        uint32_t v1 = s + XXH_PRIME1 + XXH_PRIME2;
+        uint32_t v2 = s + XXH_PRIME2;
+        uint32_t v3 = s;
+        uint32_t v4 = s - XXH_PRIME1;
+        const uint8_t *limit = end - 16;
+        do {
+            v1 = xxhRound(v1, read32LE(p));
+            v2 = xxhRound(v2, read32LE(p + 4));
+            v3 = xxhRound(v3, read32LE(p + 8));
+            v4 = xxhRound(v4, read32LE(p + 12));
+            p += 16;
+        } while (p <= limit);
+        h = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+    } else {
+        h = s + XXH_PRIME5;
+    }
+
+    h += buf->length;
+    for (; p + 4 <= end; p += 4)
+        h = rotl32(h + read32LE(p) * XXH_PRIME3, 17) * XXH_PRIME4;
+    for (; p < end; p++)
+        h = rotl32(h + *p * XXH_PRIME5, 11) * XXH_PRIME1;
+
+    h ^= h >> 15;
+    h *= XXH_PRIME2;
+    h ^= h >> 13;
+    h *= XXH_PRIME3;
+    h ^= h >> 16;
+    return h;
+}
+
+static const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr32(uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+static void sha256Block(uint32_t *state, const uint8_t *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+        w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) |
+               block[i * 4 + 3];
+    for (int i = 16; i < 64; ++i) {
+        uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) +
+                      sha256K[i] + w[i];
+        uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+/**
+ * Compute the SHA-256 digest of the buffer, as a new 32-byte buffer.
+ */
+//%
+Buffer sha256(Buffer buf) {
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    unsigned n = buf->length;
+    unsigned i = 0;
+    for (; i + 64 <= n; i += 64)
+        sha256Block(state, buf->data + i);
+
+    // the rest, 0x80, zeros and the length in bits; one or two blocks
+    uint8_t tail[128];
+    unsigned rest = n - i;
+    memcpy(tail, buf->data + i, rest);
+    memset(tail + rest, 0, sizeof(tail) - rest);
+    tail[rest] = 0x80;
+    unsigned tailLen = rest < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)n * 8;
+    for (int k = 0; k < 8; ++k)
+        tail[tailLen - 1 - k] = (uint8_t)(bits >> (k * 8));
+    sha256Block(state, tail);
+    if (tailLen == 128)
+        sha256Block(state, tail + 64);
+
+    auto res = mkBuffer(NULL, 32);
+    for (int k = 0; k < 32; ++k)
+        res->data[k] = state[k >> 2] >> (24 - (k & 3) * 8);
+    return res;
+}
+
+// Bulk operations on buffers holding numbers in a given format (typed arrays). Little endian
+// formats are processed directly on the elements; big endian ones fall back to
+// getNumberCore()/setNumberCore() for every element, except in packNumbers()/unpackNumbers(),
+// which swap the bytes.
+
+static int numberFormatSize(NumberFormat format) {
+    switch (format) {
+    case NumberFormat::Int8LE:
+    case NumberFormat::UInt8LE:
+    case NumberFormat::Int8BE:
+    case NumberFormat::UInt8BE:
+        return 1;
+    case NumberFormat::Int16LE:
+    case NumberFormat::UInt16LE:
+    case NumberFormat::Int16BE:
+    case NumberFormat::UInt16BE:
+        return 2;
+    case NumberFormat::Float64LE:
+    case NumberFormat::Float64BE:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+// clamp element range [start, start+count) to the buffer; returns pointer to the first element
+static uint8_t *numberRange(Buffer buf, NumberFormat format, int start, int &count) {
+    int total = (int)buf->length / numberFormatSize(format);
+    if (start < 0 || start > total)
+        start = total;
+    if (count < 0 || count > total - start)
+        count = total - start;
+    return buf->data + start * numberFormatSize(format);
+}
+
+// elements may be unaligned, so they are always accessed with memcpy()
+template <typename T> struct NumElt {
+    static T load(const uint8_t *p) {
+        T v;
+        memcpy(&v, p, sizeof(T));
+        return v;
+    }
+    static void store(uint8_t *p, T v) { memcpy(p, &v, sizeof(T)); }
+    static T conv(TNumber v) { return (T)toInt(v); }
+    static T fromNum(NUMBER v) { return (T)(int)v; }
+    static TNumber box(T v) { return fromInt(v); }
+};
+template <> uint32_t NumElt<uint32_t>::conv(TNumber v) {
+    return toUInt(v);
+}
+template <> uint32_t NumElt<uint32_t>::fromNum(NUMBER v) {
+    return (uint32_t)(int64_t)v;
+}
+template <> float NumElt<float>::conv(TNumber v) {
+    return toFloat(v);
+}
+template <> float NumElt<float>::fromNum(NUMBER v) {
+    return (float)v;
+}
+template <> double NumElt<double>::conv(TNumber v) {
+    return toDouble(v);
+}
+template <> double NumElt<double>::fromNum(NUMBER v) {
+    return v;
+}
+template <> TNumber NumElt<uint32_t>::box(uint32_t v) {
+    return fromUInt(v);
+}
+template <> TNumber NumElt<float>::box(float v) {
+    return fromFloat(v);
+}
+template <> TNumber NumElt<double>::box(double v) {
+    return fromDouble(v);
+}
+
+template <typename T> static T swapBytes(T v) {
+    uint8_t b[sizeof(T)];
+    memcpy(b, &v, sizeof(T));
+    for (unsigned i = 0; i < sizeof(T) / 2; ++i) {
+        auto t = b[i];
+        b[i] = b[sizeof(T) - 1 - i];
+        b[sizeof(T) - 1 - i] = t;
+    }
+    memcpy(&v, b, sizeof(T));
+    return v;
+}
+
+// integers are summed exactly
+template <typename T> struct NumAcc { typedef int64_t type; };
+template <> struct NumAcc<float> { typedef NUMBER type; };
+template <> struct NumAcc<double> { typedef NUMBER type; };
+
+// generic, boxing element access for big endian formats
+static NUMBER getElt(uint8_t *p, int idx, NumberFormat format) {
+    auto sz = numberFormatSize(format);
+    return toDouble(getNumberCore(p + idx * sz, sz, format));
+}
+
+static void setElt(uint8_t *p, int idx, NumberFormat format, TNumber v) {
+    auto sz = numberFormatSize(format);
+    setNumberCore(p + idx * sz, sz, format, v);
+}
+
+// invokes CASE(type) for little endian formats, DEFAULT otherwise
+#define NUMBER_FORMAT_SWITCH(format, CASE, DEFAULT)                                                \
+    switch (format) {                                                                              \
+    case NumberFormat::Int8LE:                                                                     \
+        CASE(int8_t);                                                                              \
+        break;                                                                                     \
+    case NumberFormat::UInt8LE:                                                                    \
+        CASE(uint8_t);                                                                             \
+        break;                                                                                     \
+    case NumberFormat::Int16LE:                                                                    \
+        CASE(int16_t);                                                                             \
+        break;                                                                                     \
+    case NumberFormat::UInt16LE:                                                                   \
+        CASE(uint16_t);                                                                            \
+        break;                                                                                     \
+    case NumberFormat::Int32LE:                                                                    \
+        CASE(int32_t);                                                                             \
+        break;                                                                                     \
+    case NumberFormat::UInt32LE:                                                                   \
+        CASE(uint32_t);                                                                            \
+        break;                                                                                     \
+    case NumberFormat::Float32LE:                                                                  \
+        CASE(float);                                                                               \
+        break;                                                                                     \
+    case NumberFormat::Float64LE:                                                                  \
+        CASE(double);                                                                              \
+        break;                                                                                     \
+    default:                                                                                       \
+        DEFAULT;                                                                                   \
+        break;                                                                                     \
+    }
+
+// invokes CASE(type) for big endian formats, DEFAULT otherwise
+#define NUMBER_FORMAT_SWITCH_BE(format, CASE, DEFAULT)                                             \
+    switch (format) {                                                                              \
+    case NumberFormat::Int8BE:                                                                     \
+        CASE(int8_t);                                                                              \
+        break;                                                                                     \
+    case NumberFormat::UInt8BE:                                                                    \
+        CASE(uint8_t);                                                                             \
+        break;                                                                                     \
+    case NumberFormat::Int16BE:                                                                    \
+        CASE(int16_t);                                                                             \
+        break;                                                                                     \
+    case NumberFormat::UInt16BE:                                                                   \
+        CASE(uint16_t);                                                                            \
+        break;                                                                                     \
+    case NumberFormat::Int32BE:                                                                    \
+        CASE(int32_t);                                                                             \
+        break;                                                                                     \
+    case NumberFormat::UInt32BE:                                                                   \
+        CASE(uint32_t);                                                                            \
+        break;                                                                                     \
+    case NumberFormat::Float32BE:                                                                  \
+        CASE(float);                                                                               \
+        break;                                                                                     \
+    case NumberFormat::Float64BE:                                                                  \
+        CASE(double);                                                                              \
+        break;                                                                                     \
+    default:                                                                                       \
+        DEFAULT;                                                                                   \
+        break;                                                                                     \
+    }
+
+template <typename T> static void fillElts(uint8_t *p, int count, TNumber value) {
+    auto v = NumElt<T>::conv(value);
+    for (int i = 0; i < count; ++i)
+        NumElt<T>::store(p + i * sizeof(T), v);
+}
+
+static void fillGeneric(uint8_t *p, int count, NumberFormat format, TNumber value) {
+    for (int i = 0; i < count; ++i)
+        setElt(p, i, format, value);
+}
+
+/**
+ * Set `count` numbers in specified format, starting at element `start`, to `value`.
+ * The format is in the low byte of formatStart and start in the rest, to fit in 4 arguments.
+ */
+//%
+void _fillNumbers(Buffer buf, int formatStart, TNumber value, int count) {
+    auto format = (NumberFormat)(formatStart & 0xff);
+    auto p = numberRange(buf, format, formatStart >> 8, count);
+#define FILL_CASE(T) fillElts<T>(p, count, value)
+    NUMBER_FORMAT_SWITCH(format, FILL_CASE, fillGeneric(p, count, format, value))
+#undef FILL_CASE
+}
+
+template <typename T> static NUMBER sumElts(const uint8_t *p, int count) {
+    typename NumAcc<T>::type r = 0;
+    for (int i = 0; i < count; ++i)
+        r += NumElt<T>::load(p + i * sizeof(T));
+    return (NUMBER)r;
+}
+
+static NUMBER sumGeneric(uint8_t *p, int count, NumberFormat format) {
+    NUMBER r = 0;
+    for (int i = 0; i < count; ++i)
+        r += getElt(p, i, format);
+    return r;
+}
+
+/**
+ * Sum `count` numbers in specified format, starting at element `start`.
+ */
+//% start.defl=0 count.defl=-1
+TNumber sumNumbers(Buffer buf, NumberFormat format, int start = 0, int count = -1) {
+    auto p = numberRange(buf, format, start, count);
+    NUMBER r = 0;
+#define SUM_CASE(T) r = sumElts<T>(p, count)
+    NUMBER_FORMAT_SWITCH(format, SUM_CASE, r = sumGeneric(p, count, format))
+#undef SUM_CASE
+    return fromDouble(r);
+}
+
+template <typename T> static NUMBER minMaxElts(const uint8_t *p, int count, bool isMax) {
+    T r = NumElt<T>::load(p);
+    for (int i = 1; i < count; ++i) {
+        auto v = NumElt<T>::load(p + i * sizeof(T));
+        if (isMax ? v > r : v < r)
+            r = v;
+    }
+    return (NUMBER)r;
+}
+
+static NUMBER minMaxGeneric(uint8_t *p, int count, NumberFormat format, bool isMax) {
+    NUMBER r = getElt(p, 0, format);
+    for (int i = 1; i < count; ++i) {
+        auto v = getElt(p, i, format);
+        if (isMax ? v > r : v < r)
+            r = v;
+    }
+    return r;
+}
+
+static TNumber minMaxNumbers(Buffer buf, NumberFormat format, int start, int count, bool isMax) {
+    auto p = numberRange(buf, format, start, count);
+    // like Math.min() and Math.max() without arguments
+    if (count == 0)
+        return fromDouble(isMax ? -INFINITY : INFINITY);
+    NUMBER r = 0;
+#define MINMAX_CASE(T) r = minMaxElts<T>(p, count, isMax)
+    NUMBER_FORMAT_SWITCH(format, MINMAX_CASE, r = minMaxGeneric(p, count, format, isMax))
+#undef MINMAX_CASE
+    return fromDouble(r);
+}
+
+/**
+ * Find the smallest of `count` numbers in specified format, starting at element `start`.
+ */
+//% start.defl=0 count.defl=-1
+TNumber minNumbers(Buffer buf, NumberFormat format, int start = 0, int count = -1) {
+    return minMaxNumbers(buf, format, start, count, false);
+}
+
+/**
+ * Find the largest of `count` numbers in specified format, starting at element `start`.
+ */
+//% start.defl=0 count.defl=-1
+TNumber maxNumbers(Buffer buf, NumberFormat format, int start = 0, int count = -1) {
+    return minMaxNumbers(buf, format, start, count, true);
+}
+
+template <typename T> static void scaleElts(uint8_t *p, int count, NUMBER mul, NUMBER add) {
+    for (int i = 0; i < count; ++i) {
+        auto q = p + i * sizeof(T);
+        NumElt<T>::store(q, NumElt<T>::fromNum(NumElt<T>::load(q) * mul + add));
+    }
+}
+
+static void scaleGeneric(uint8_t *p, int count, NumberFormat format, NUMBER mul, NUMBER add) {
+    for (int i = 0; i < count; ++i)
+        setElt(p, i, format, fromDouble(getElt(p, i, format) * mul + add));
+}
+
+/**
+ * Replace every number `x` in specified format with `x * mul + add`.
+ */
+//%
+void scaleNumbers(Buffer buf, NumberFormat format, TNumber mul, TNumber add) {
+    int count = -1;
+    auto p = numberRange(buf, format, 0, count);
+    auto m = toDouble(mul), a = toDouble(add);
+#define SCALE_CASE(T) scaleElts<T>(p, count, m, a)
+    NUMBER_FORMAT_SWITCH(format, SCALE_CASE, scaleGeneric(p, count, format, m, a))
+#undef SCALE_CASE
+}
+
+template <typename S, typename D> static void convertElts(uint8_t *dst, const uint8_t *src, int count) {
+    for (int i = 0; i < count; ++i)
+        NumElt<D>::store(dst + i * sizeof(D),
+                         NumElt<D>::fromNum((NUMBER)NumElt<S>::load(src + i * sizeof(S))));
+}
+
+static void convertGeneric(uint8_t *dst, NumberFormat format, uint8_t *src, NumberFormat srcFormat,
+                           int count) {
+    for (int i = 0; i < count; ++i)
+        setElt(dst, i, format, fromDouble(getElt(src, i, srcFormat)));
+}
+
+// convert from little endian source type S to any format
+template <typename S>
+static void convertFrom(uint8_t *dst, NumberFormat format, uint8_t *src, NumberFormat srcFormat,
+                        int count) {
+#define CONVERT_CASE(D) convertElts<S, D>(dst, src, count)
+    NUMBER_FORMAT_SWITCH(format, CONVERT_CASE, convertGeneric(dst, format, src, srcFormat, count))
+#undef CONVERT_CASE
+}
+
+/**
+ * Copy numbers from `src` in `srcFormat` to current buffer in `format`, converting them;
+ * copies as many as fit in both buffers.
+ */
+//%
+void copyNumbers(Buffer buf, NumberFormat format, Buffer src, NumberFormat srcFormat) {
+    auto sz = numberFormatSize(format);
+    int count = min((int)buf->length / sz, (int)src->length / numberFormatSize(srcFormat));
+    if (format == srcFormat) {
+        memmove(buf->data, src->data, count * sz);
+        return;
+    }
+    auto dst = buf->data, s = src->data;
+#define SRC_CASE(S) convertFrom<S>(dst, format, s, srcFormat, count)
+    NUMBER_FORMAT_SWITCH(srcFormat, SRC_CASE, convertGeneric(dst, format, s, srcFormat, count))
+#undef SRC_CASE
+}
+
+// clamp count to the elements that fit from byte offset on; returns pointer to the first one
+static uint8_t *numberBytes(Buffer buf, NumberFormat format, int offset, int &count) {
+    int fits = 0;
+    if (offset >= 0 && offset <= (int)buf->length)
+        fits = (buf->length - offset) / numberFormatSize(format);
+    if (count < 0 || count > fits)
+        count = fits;
+    return buf->data + (count ? offset : 0);
+}
+
+template <typename T, bool swap>
+static void packElts(uint8_t *p, RefCollection *values, int count) {
+    for (int i = 0; i < count; ++i) {
+        auto v = NumElt<T>::conv(values->getAt(i));
+        NumElt<T>::store(p + i * sizeof(T), swap ? swapBytes(v) : v);
+    }
+}
+
+/**
+ * Write numbers from `values` in specified format, starting at byte `offset`; writes as many as
+ * fit in the buffer, and returns how many that is.
+ */
+//%
+int packNumbers(Buffer buf, NumberFormat format, int offset, RefCollection *values) {
+    int count = values->length();
+    auto p = numberBytes(buf, format, offset, count);
+#define PACK_CASE(T) packElts<T, false>(p, values, count)
+#define PACK_CASE_BE(T) packElts<T, true>(p, values, count)
+    NUMBER_FORMAT_SWITCH(format, PACK_CASE, NUMBER_FORMAT_SWITCH_BE(format, PACK_CASE_BE, ))
+#undef PACK_CASE
+#undef PACK_CASE_BE
+    return count;
+}
+
+template <typename T, bool swap>
+static void unpackElts(const uint8_t *p, RefCollection *res, int count) {
+    for (int i = 0; i < count; ++i) {
+        auto v = NumElt<T>::load(p + i * sizeof(T));
+        res->head.set(i, NumElt<T>::box(swap ? swapBytes(v) : v));
+    }
+}
+
+/**
+ * Read `count` numbers in specified format, starting at byte `offset`, into an array; by default
+ * all that fit in the buffer.
+ */
+//% count.defl=-1
+RefCollection *unpackNumbers(Buffer buf, NumberFormat format, int offset, int count = -1) {
+    auto p = numberBytes(buf, format, offset, count);
+    auto res = Array_::mk();
+    registerGCObj(res);
+    res->setLength(count);
+#define UNPACK_CASE(T) unpackElts<T, false>(p, res, count)
+#define UNPACK_CASE_BE(T) unpackElts<T, true>(p, res, count)
+    NUMBER_FORMAT_SWITCH(format, UNPACK_CASE, NUMBER_FORMAT_SWITCH_BE(format, UNPACK_CASE_BE, ))
+#undef UNPACK_CASE
+#undef UNPACK_CASE_BE
+    unregisterGCObj(res);
+    return res;
+}
+
+// LZ4 block format (github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), as produced by the
+// reference compressor with a 4-byte little endian length of the uncompressed data in front, like
+// lz4.block.compress() in Python does by default. The match finder keeps the low 16 bits of
+// the positions only, which is enough as matches can't be more than 64k back.
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5 // the last bytes are always literals
+#define LZ4_MF_LIMIT 12     // and no match starts in the bytes at the end
+#define LZ4_MAX_LEVEL 5
+
+static uint32_t lz4Read32(const uint8_t *p) {
+    uint32_t r;
+    memcpy(&r, p, 4);
+    return r;
+}
+
+static uint8_t *lz4WriteLength(uint8_t *op, int len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+// matchLen (less LZ4_MIN_MATCH) is negative for the last sequence, which has no match
+static uint8_t *lz4WriteSequence(uint8_t *op, const uint8_t *lit, int litLen, int dist,
+                                 int matchLen) {
+    uint8_t *token = op++;
+    *token = min(litLen, 15) << 4;
+    if (litLen >= 15)
+        op = lz4WriteLength(op, litLen - 15);
+    memcpy(op, lit, litLen);
+    op += litLen;
+    if (matchLen >= 0) {
+        *token |= min(matchLen, 15);
+        *op++ = dist;
+        *op++ = dist >> 8;
+        if (matchLen >= 15)
+            op = lz4WriteLength(op, matchLen - 15);
+    }
+    return op;
+}
+
+// dst needs n + n / 255 + 16 bytes; table has 1 << hashLog zeroed entries
+static int lz4Compress(const uint8_t *src, int n, uint8_t *dst, uint16_t *table, int hashLog) {
+    const uint8_t *anchor = src, *end = src + n;
+    uint8_t *op = dst;
+
+    if (n > LZ4_MF_LIMIT) {
+        const uint8_t *mfLimit = end - LZ4_MF_LIMIT;
+        const uint8_t *matchLimit = end - LZ4_LAST_LITERALS;
+        const uint8_t *ip = src;
+        int misses = 0;
+        while (ip < mfLimit) {
+            uint32_t seq = lz4Read32(ip);
+            uint32_t h = (seq * 2654435761U) >> (32 - hashLog);
+            uint32_t pos = ip - src;
+            uint32_t dist = (pos - table[h]) & 0xffff;
+            table[h] = pos;
+            if (dist == 0 || dist > pos || lz4Read32(ip - dist) != seq) {
+                // step faster over data that doesn't compress
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            const uint8_t *match = ip - dist;
+            while (ip > anchor && match > src && ip[-1] == match[-1]) {
+                ip--;
+                match--;
+            }
+            const uint8_t *p = ip + LZ4_MIN_MATCH;
+            const uint8_t *m = match + LZ4_MIN_MATCH;
+            while (p < matchLimit && *p == *m) {
+                p++;
+                m++;
+            }
+
+            op = lz4WriteSequence(op, anchor, ip - anchor, dist, p - ip - LZ4_MIN_MATCH);
+            ip = anchor = p;
+        }
+    }
+
+    return lz4WriteSequence(op, anchor, end - anchor, 0, -1) - dst;
+}
+
+// returns the number of bytes written to dst, or -1 if src is not valid
+static int lz4Decompress(const uint8_t *src, int n, uint8_t *dst, int size) {
+    const uint8_t *ip = src, *end = src + n;
+    uint8_t *op = dst, *oend = dst + size;
+
+    while (ip < end) {
+        int token = *ip++;
+        int litLen = token >> 4;
+        if (litLen == 15) {
+            int b;
+            do {
+                if (ip >= end)
+                    return -1;
+                b = *ip++;
+                litLen += b;
+            } while (b == 255);
+        }
+        if (litLen > end - ip || litLen > oend - op)
+            return -1;
+        memcpy(op, ip, litLen);
+        ip += litLen;
+        op += litLen;
+        if (ip == end)
+            break; // the last sequence has no match
+
+        if (end - ip < 2)
+            return -1;
+        int dist = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (dist == 0 || dist > op - dst)
+            return -1;
+        int matchLen = token & 15;
+        if (matchLen == 15) {
+            int b;
+            do {
+                if (ip >= end)
+                    return -1;
+                b = *ip++;
+                matchLen += b;
+            } while (b == 255);
+        }
+        matchLen += LZ4_MIN_MATCH;
+        if (matchLen > oend - op)
+            return -1;
+        // may overlap what is being written, for runs
+        const uint8_t *m = op - dist;
+        while (matchLen--)
+            *op++ = *m++;
+    }
+
+    return op - dst;
+}
+
+/**
+ * Compress the buffer (LZ4 format, with the size in front), for storing or sending it.
+ * @param level from 1 (least memory, 1kB) to 5 (best, 16kB), eg: 3
+ */
+//%
+Buffer compress(Buffer buf, int level = 3) {
+    int hashLog = 8 + max(1, min(LZ4_MAX_LEVEL, level));
+    int n = buf->length;
+    auto table = (uint16_t *)xmalloc(sizeof(uint16_t) << hashLog);
+    memset(table, 0, sizeof(uint16_t) << hashLog);
+    auto tmp = (uint8_t *)xmalloc(4 + n + n / 255 + 16);
+    tmp[0] = n;
+    tmp[1] = n >> 8;
+    tmp[2] = n >> 16;
+    tmp[3] = n >> 24;
+    int len = lz4Compress(buf->data, n, tmp + 4, table, hashLog);
+    xfree(table);
+    auto res = mkBuffer(tmp, len + 4);
+    xfree(tmp);
+    return res;
+}
+
+/**
+ * Return the data of a buffer made with compress(), or undefined if it is not valid.
+ */
+//%
+Buffer decompress(Buffer buf) {
+    if (buf->length < 4)
+        return NULL;
+    uint32_t size = lz4Read32(buf->data); // the buffer might be unaligned
+    // a byte can't stand for more than 255 bytes of the data
+    if (size > (uint32_t)(buf->length - 4) * 255 + 16)
+        return NULL;
+    auto res = mkBuffer(NULL, size);
+    if (lz4Decompress(buf->data + 4, buf->length - 4, res->data, size) != (int)size)
+        return NULL;
+    return res;
+}
+
+/**
+ * Convert a buffer to its base64 representation (standard alphabet, with padding).
+ */
+//%
+String toBase64(Buffer buf) {
+    const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    int len = buf->length;
+    auto res = mkStringCore(NULL, (len + 2) / 3 * 4);
+    auto src = buf->data;
+    auto dst = res->ascii.data;
+    int i = 0;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t v = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+        dst[0] = alphabet[v >> 18];
+        dst[1] = alphabet[(v >> 12) & 63];
+        dst[2] = alphabet[(v >> 6) & 63];
+        dst[3] = alphabet[v & 63];
+        dst += 4;
+    }
+    if (i < len) {
+        uint32_t v = (src[i] << 16) | (i + 1 < len ? src[i + 1] << 8 : 0);
+        dst[0] = alphabet[v >> 18];
+        dst[1] = alphabet[(v >> 12) & 63];
+        dst[2] = i + 1 < len ? alphabet[(v >> 6) & 63] : '=';
+        dst[3] = '=';
+    }
+    return res;
+}
+
+/**
+ * Fill the buffer with random bytes.
+ */
+//%
+void fillRandom(Buffer buf) {
+    pxt::fillRandom(buf->data, buf->length);
+}
+
 } // namespace BufferMethods
 
+static int hexDigit(uint8_t c) {
+    if ((uint8_t)(c - '0') < 10)
+        return c - '0';
+    c |= 0x20; // lower case
+    if ((uint8_t)(c - 'a') < 6)
+        return c - 'a' + 10;
+    return -1;
+}
+
+// the URL-safe alphabet is accepted too
+static int base64Digit(uint8_t c) {
+    if ((uint8_t)(c - 'A') < 26)
+        return c - 'A';
+    if ((uint8_t)(c - 'a') < 26)
+        return c - 'a' + 26;
+    if ((uint8_t)(c - '0') < 10)
+        return c - '0' + 52;
+    if (c == '+' || c == '-')
+        return 62;
+    if (c == '/' || c == '_')
+        return 63;
+    return -1;
+}
+
 // The functions below are deprecated in control namespace, but they are referenced
 // in Buffer namespaces via explicit shim=...
 namespace control {
@@ -265,9 +1142,76 @@ Buffer createBufferFromUTF8(String str) {
     return mkBuffer((const uint8_t *)str->getUTF8Data(), str->getUTF8Size());
 #endif
 }
+
+/**
+ * Create a new buffer, decoding a hex string; undefined if it has anything but hex digits.
+ * @param str the hex digits, two for each byte
+ */
+//% deprecated=1
+Buffer createBufferFromHex(String str) {
+    auto src = (const uint8_t *)str->getUTF8Data();
+    int len = str->getUTF8Size() >> 1;
+    auto res = mkBuffer(NULL, len);
+    auto dst = res->data;
+    for (int i = 0; i < len; ++i) {
+        int hi = hexDigit(src[i * 2]), lo = hexDigit(src[i * 2 + 1]);
+        if (hi < 0 || lo < 0)
+            return NULL;
+        dst[i] = (hi << 4) | lo;
+    }
+    return res;
+}
+
+/**
+ * Create a new buffer, decoding a base64 string; undefined if it is not valid base64.
+ * Whitespace and padding are skipped.
+ * @param str the base64 data
+ */
+//% deprecated=1
+Buffer createBufferFromBase64(String str) {
+    auto src = (const uint8_t *)str->getUTF8Data();
+    int len = str->getUTF8Size();
+    int numDigits = 0;
+    for (int i = 0; i < len; ++i)
+        if (base64Digit(src[i]) >= 0)
+            numDigits++;
+    if (numDigits % 4 == 1)
+        return NULL;
+    auto res = mkBuffer(NULL, numDigits * 3 / 4);
+    auto dst = res->data;
+    uint32_t acc = 0;
+    int n = 0;
+    for (int i = 0; i < len; ++i) {
+        int d = base64Digit(src[i]);
+        if (d < 0) {
+            uint8_t c = src[i];
+            if (c == '=' || c == ' ' || c == '\n' || c == '\r' || c == '\t')
+                continue;
+            return NULL;
+        }
+        acc = (acc << 6) | d;
+        if (++n == 4) {
+            dst[0] = acc >> 16;
+            dst[1] = acc >> 8;
+            dst[2] = acc;
+            dst += 3;
+            n = 0;
+        }
+    }
+    if (n >= 2)
+        *dst++ = acc >> (n == 2 ? 4 : 10);
+    if (n == 3)
+        *dst++ = acc >> 2;
+    return res;
+}
 } // namespace control
 
 namespace pxt {
+unsigned crc32Hardware(const uint8_t *data, unsigned len, uint32_t *state) __attribute__((weak));
+unsigned crc32Hardware(const uint8_t *data, unsigned len, uint32_t *state) {
+    return 0;
+}
+
 static int writeBytes(uint8_t *dst, uint8_t *src, int length, bool swapBytes, int szLeft) {
     if (szLeft < length) {
         return -1;
@@ -174,6 +174,10 @@ namespace helpers {
         Buffer.__packUnpackCore(format, nums, buf, true, offset)
     }
 
+    export function bufferFillNumbers(buf: Buffer, format: NumberFormat, value: number, start?: number, count?: number) {
+        buf._fillNumbers(format | ((start || 0) << 8), value, count == null ? -1 : count)
+    }
+
     export function bufferChunked(buf: Buffer, maxBytes: number) {
         if (buf.length <= maxBytes) return [buf]
         else {
@@ -185,12 +189,7 @@ namespace helpers {
     }
 
     export function bufferToArray(buf: Buffer, format: NumberFormat) {
-        const sz = Buffer.sizeOfNumberFormat(format)
-        const len = buf.length - sz
-        const r: number[] = []
-        for (let i = 0; i <= len; i += sz)
-            r.push(buf.getNumber(format, i))
-        return r
+        return buf.unpackNumbers(format, 0)
     }
 }
 
@@ -240,6 +239,13 @@ interface Buffer {
     //% helper=bufferToArray
     toArray(format: NumberFormat): number[];
 
+    /**
+     * Set `count` numbers in specified format, starting at element `start`, to `value`.
+     * By default all of the numbers are set.
+     */
+    //% helper=bufferFillNumbers
+    fillNumbers(format: NumberFormat, value: number, start?: number, count?: number): void;
+
     // rest defined in buffer.cpp
 }
 
@@ -255,16 +261,19 @@ namespace Buffer {
      * Create a new buffer, decoding a hex string
      */
     export function fromHex(hex: string) {
-        const hexStr = "0123456789abcdef"
-        const res = Buffer.create(hex.length >> 1)
-        hex = hex.toLowerCase()
-        for (let i = 0; i < hex.length; i += 2) {
-            const p0 = hexStr.indexOf(hex.charAt(i))
-            const p1 = hexStr.indexOf(hex.charAt(i + 1))
-            if (p0 < 0 || p1 < 0)
-                throw "Invalid hex"
-            res[i >> 1] = (p0 << 4) | p1
-        }
+        const res = control.createBufferFromHex(hex)
+        if (!res)
+            throw "Invalid hex"
+        return res
+    }
+
+    /**
+     * Create a new buffer, decoding a base64 string
+     */
+    export function fromBase64(b64: string) {
+        const res = control.createBufferFromBase64(b64)
+        if (!res)
+            throw "Invalid base64"
         return res
     }
 
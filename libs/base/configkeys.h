@@ -220,6 +220,10 @@
 #define CFG_NUM_ONBOARD_DOTSTARS 221
 #define CFG_PIN_ONBOARD_NEOPIXEL 222
 #define CFG_NUM_ONBOARD_NEOPIXELS 223
+// max. length of incremental GC marking slice in microseconds; 0 to disable
+#define CFG_GC_INCREMENTAL_SLICE_US 224
+// non-zero for the single precision sin(), cos(), atan2() and sqrt() of trig.cpp
+#define CFG_FAST_MATH 225
 
 #define CFG_MATRIX_KEYPAD_MESSAGE_ID 239
 #define CFG_NUM_MATRIX_KEYPAD_ROWS 240
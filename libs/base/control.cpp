@@ -146,4 +146,52 @@ namespace control {
         return false;
 #endif
     }
+
+    /**
+     * Send the binary trace over serial, in hex after a "TRACE:" line, when it is enabled in the
+     * current build; scripts/trace2json.js reads it back.
+     */
+    //%
+    void dumpTrace() {
+#if defined(PXT_TRACE) && !defined(PXT_VM)
+        auto size = PXT_TRACE_SIZE * (int)sizeof(TraceRecord);
+        auto data = (uint8_t *)xmalloc(size);
+        size = traceRead(data, size);
+        pxt::sendSerial("\nTRACE:\n", 8);
+        char line[65];
+        for (int i = 0; i < size; i += 32) {
+            int n = min(32, size - i);
+            for (int j = 0; j < n; ++j) {
+                line[j * 2] = "0123456789abcdef"[data[i + j] >> 4];
+                line[j * 2 + 1] = "0123456789abcdef"[data[i + j] & 0xf];
+            }
+            line[n * 2] = '\n';
+            pxt::sendSerial(line, n * 2 + 1);
+        }
+        pxt::sendSerial("\n", 1);
+        xfree(data);
+#endif
+    }
+
+    /**
+     * Get the one string shared by all the equal strings interned, so that they compare, and are
+     * found in maps, by pointer. Strings equal to a property name become that name.
+     */
+    //%
+    String intern(String s) {
+        return gcInternString(s);
+    }
+
+    /**
+     * Get the CPU use of each fiber, as five Int32LE values per fiber: an id, how long it ran
+     * for in us, how many times it was switched to, the most stack it used in bytes, and where
+     * the function it was started for is, or 0. On hardware the accounting starts with the
+     * first call, and samples the running fiber every millisecond.
+     */
+    //%
+    Buffer fiberStats() {
+        FiberStats stats[PXT_MAX_FIBER_STATS];
+        int n = getFiberStats(stats, PXT_MAX_FIBER_STATS);
+        return mkBuffer((uint8_t *)stats, n * sizeof(FiberStats));
+    }
 }
@@ -2,6 +2,14 @@
 #include <limits.h>
 #include <stdlib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PXT_SEARCH_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PXT_SEARCH_NEON 1
+#endif
+
 using namespace std;
 
 #define p10(v) __builtin_powi(10, v)
@@ -14,21 +22,61 @@ using namespace std;
 // which is similar to amortized allocation time
 #define SKIP_INCR 16 // needs to be power of 2; needs to be kept in sync with compiler
 #define MIN_SKIP 20  // min. size of string to use skip list; static code has its own limit
+// used for strings created at runtime averaging 1.5+ bytes per character (Cyrillic, CJK)
+#define DENSE_SKIP_INCR 8
 
 namespace pxt {
 
 PXT_DEF_STRING(emptyString, "")
 
-static HandlerBinding *handlerBindings;
+static PXT_TLS HandlerBinding *handlerBindings;
 
-HandlerBinding *nextBinding(HandlerBinding *curr, int source, int value) {
-    for (auto p = curr; p; p = p->next) {
-        // DEVICE_ID_ANY == DEVICE_EXT_ANY == 0
-        if ((p->source == source || p->source == 0) && (value == -1 || p->value == value || p->value == 0)) {
+// bindings are also hashed on (source, value), newest first in each bucket,
+// so that dispatching an event doesn't need to go through all of them
+#define BINDING_BUCKETS 64
+static PXT_TLS HandlerBinding **bindingIndex;
+static PXT_TLS uint32_t bindingSeq;
+
+static inline unsigned bindingBucket(int source, int value) {
+    return ((uint32_t)source * 0x9e3779b1 ^ (uint32_t)value) % BINDING_BUCKETS;
+}
+
+// first binding for exactly (source, value) that is not newer than [maxSeq]
+static HandlerBinding *exactBinding(int source, int value, uint32_t maxSeq) {
+    for (auto p = bindingIndex[bindingBucket(source, value)]; p; p = p->hashNext) {
+        if (p->source == source && p->value == value && p->seq <= maxSeq)
             return p;
+    }
+    return NULL;
+}
+
+HandlerBinding *nextBinding(HandlerBinding *curr, int source, int value) {
+    if (!curr)
+        return NULL;
+
+    if (value == -1 || !bindingIndex) {
+        for (auto p = curr; p; p = p->next) {
+            // DEVICE_ID_ANY == DEVICE_EXT_ANY == 0
+            if ((p->source == source || p->source == 0) &&
+                (value == -1 || p->value == value || p->value == 0)) {
+                return p;
+            }
         }
+        return 0;
     }
-    return 0;
+
+    // the first match in list order from [curr] on is the newest one of the four candidates
+    HandlerBinding *best = NULL;
+    for (int i = 0; i < 4; ++i) {
+        int s = i & 1 ? 0 : source;
+        int v = i & 2 ? 0 : value;
+        if ((i & 1 && !source) || (i & 2 && !value))
+            continue; // same as an earlier candidate
+        auto p = exactBinding(s, v, curr->seq);
+        if (p && (!best || p->seq > best->seq))
+            best = p;
+    }
+    return best;
 }
 
 HandlerBinding *findBinding(int source, int value) {
@@ -36,13 +84,11 @@ HandlerBinding *findBinding(int source, int value) {
 }
 
 void setBinding(int source, int value, Action act) {
-    HandlerBinding *curr = NULL;
-    for (auto p = handlerBindings; p; p = p->next) {
-        if ((p->source == source) && (p->value == value)) {
-            curr = p;
-            break;
-        }
+    if (!bindingIndex) {
+        bindingIndex = (HandlerBinding **)app_alloc(BINDING_BUCKETS * sizeof(HandlerBinding *));
+        memset(bindingIndex, 0, BINDING_BUCKETS * sizeof(HandlerBinding *));
     }
+    HandlerBinding *curr = exactBinding(source, value, bindingSeq);
     if (curr) {
         curr->action = act;
         return;
@@ -52,13 +98,37 @@ void setBinding(int source, int value, Action act) {
     curr->source = source;
     curr->value = value;
     curr->action = act;
+    curr->seq = ++bindingSeq;
+    auto bucket = &bindingIndex[bindingBucket(source, value)];
+    curr->hashNext = *bucket;
+    *bucket = curr;
     registerGC(&curr->action);
     handlerBindings = curr;
 }
 
+static PXT_TLS MapShape *emptyMapShape;
+
+// Frames of try blocks that have ended, kept for the next ones, so that entering a try block
+// doesn't take an app_alloc(); at most MAX_SPARE_TRY_FRAMES, since they are rarely nested deep.
+#define MAX_SPARE_TRY_FRAMES 8
+static PXT_TLS TryFrame *spareTryFrames;
+static PXT_TLS int numSpareTryFrames;
+
+#if !defined(PXT64) && PXT_BOX_CACHE
+static void resetBoxCache();
+#endif
+
 void coreReset() {
     // these are allocated on GC heap, so they will go away together with the reset
     handlerBindings = NULL;
+    bindingIndex = NULL;
+    bindingSeq = 0;
+    emptyMapShape = NULL;
+    spareTryFrames = NULL;
+    numSpareTryFrames = 0;
+#if !defined(PXT64) && PXT_BOX_CACHE
+    resetBoxCache();
+#endif
 }
 
 static const char emptyBuffer[] __attribute__((aligned(4))) = "@PXT#:\x00\x00\x00";
@@ -201,8 +271,20 @@ static bool isUTF8(const char *data, int len) {
     return false;
 }
 
-#define NUM_SKIP_ENTRIES(p) ((p)->skip.length / SKIP_INCR)
+static inline uint32_t skipIncrFor(uint32_t size, uint32_t length) {
+    return 2 * size >= 3 * length ? DENSE_SKIP_INCR : SKIP_INCR;
+}
+
+// static strings are laid out by the compiler, always with SKIP_INCR
+static inline uint32_t skipIncr(String p) {
+    return isReadOnly((TValue)p) ? SKIP_INCR : skipIncrFor(p->skip.size, p->skip.length);
+}
+
+#define NUM_SKIP_ENTRIES(p) ((p)->skip.length / skipIncr(p))
 #define SKIP_DATA(p) (const char *)(p->skip.list + NUM_SKIP_ENTRIES(p))
+// runtime strings keep the last looked up character index and its byte offset after the data
+#define SKIP_CURSOR(p, data) ((uint16_t *)(((uintptr_t)(data) + (p)->skip.size + 2) & ~1))
+#define SKIP_ARRAY_BYTES(numSkips, size) ((numSkips)*2 + (((size) + 2) & ~1) + 4)
 
 static void setupSkipList(String r, const char *data) {
     char *dst = (char *)SKIP_DATA(r);
@@ -211,13 +293,17 @@ static void setupSkipList(String r, const char *data) {
         memcpy(dst, data, len);
     dst[len] = 0;
     const char *ptr = dst;
-    auto skipEntries = NUM_SKIP_ENTRIES(r);
+    auto incr = skipIncr(r);
+    int skipEntries = NUM_SKIP_ENTRIES(r);
     for (int i = 0; i < skipEntries; ++i) {
-        ptr = utf8Skip(ptr, (int)(len - (ptr - dst)), SKIP_INCR);
+        ptr = utf8Skip(ptr, (int)(len - (ptr - dst)), incr);
         if (!ptr)
             oops(80);
         r->skip.list[i] = ptr - dst;
     }
+    auto cursor = SKIP_CURSOR(r, dst);
+    cursor[0] = 0;
+    cursor[1] = 0;
 }
 #endif
 
@@ -252,7 +338,8 @@ String mkStringCore(const char *data, int len) {
         r->skip.size = len;
         r->skip.length = utf8Len(data, len);
         r->skip.list = NULL; // in case gc triggers below
-        r->skip.list = (uint16_t *)gcAllocateArray(NUM_SKIP_ENTRIES(r) * 2 + len + 1);
+        r->skip.list = (uint16_t *)gcAllocateArray(SKIP_ARRAY_BYTES(NUM_SKIP_ENTRIES(r), len));
+        gcRememberObject(r);
         setupSkipList(r, data);
         unregisterGCObj(r);
     } else
@@ -338,45 +425,75 @@ Buffer mkBuffer(const void *data, int len) {
     return r;
 }
 
-static unsigned random_value = 0xC0DA1;
+// xorshift128 (Marsaglia, "Xorshift RNGs", 2003): a 32-bit word per step, with shifts and xors
+// only, which even the Cortex-M0 does in a few cycles; the state must not be all zeros.
+static PXT_TLS uint32_t random_state[4] = {0xC0DA1, 0x6C078965, 0x9908B0DF, 0x2545F491};
+
+static inline uint32_t nextRandom() {
+    uint32_t t = random_state[3];
+    uint32_t s = random_state[0];
+    random_state[3] = random_state[2];
+    random_state[2] = random_state[1];
+    random_state[1] = s;
+    t ^= t << 11;
+    t ^= t >> 8;
+    random_state[0] = t ^ s ^ (s >> 19);
+    return random_state[0];
+}
+
+static void mixRandomState() {
+    if (!(random_state[0] | random_state[1] | random_state[2] | random_state[3]))
+        random_state[0] = 0xC0DA1;
+    // spread the seed over the state, so that close seeds don't give close sequences
+    for (int i = 0; i < 8; ++i)
+        nextRandom();
+}
 
 //%
 void seedRandom(unsigned seed) {
-    random_value = seed;
+    // splitmix32 steps to fill the state from one word
+    for (int i = 0; i < 4; ++i) {
+        uint32_t z = (seed += 0x9E3779B9);
+        z = (z ^ (z >> 16)) * 0x85EBCA6B;
+        z = (z ^ (z >> 13)) * 0xC2B2AE35;
+        random_state[i] = z ^ (z >> 16);
+    }
+    mixRandomState();
 }
 
 //% expose
 void seedAddRandom(unsigned seed) {
-    random_value ^= 0xCA2557CB * seed;
+    random_state[0] ^= 0xCA2557CB * seed;
+    mixRandomState();
 }
 
 unsigned getRandom(unsigned max) {
-    unsigned m, result;
-
-    do {
-        m = (unsigned)max;
-        result = 0;
-
-        do {
-            // Cycle the LFSR (Linear Feedback Shift Register).
-            // We use an optimal sequence with a period of 2^32-1, as defined by Bruce Schneier here
-            // (a true legend in the field!),
-            // For those interested, it's documented in his paper:
-            // "Pseudo-Random Sequence Generator for 32-Bit CPUs: A fast, machine-independent
-            // generator for 32-bit Microprocessors"
-            // https://www.schneier.com/paper-pseudorandom-sequence.html
-            unsigned r = random_value;
-
-            r = ((((r >> 31) ^ (r >> 6) ^ (r >> 4) ^ (r >> 2) ^ (r >> 1) ^ r) & 1) << 31) |
-                (r >> 1);
-
-            random_value = r;
-
-            result = ((result << 1) | (r & 0x00000001));
-        } while (m >>= 1);
-    } while (result > (unsigned)max);
+    uint32_t r = nextRandom();
+    if (max == UINT_MAX)
+        return r;
+    // Lemire's multiply-shift: the high word of r * range is uniform in [0, range) once the low
+    // word isn't below 2^32 % range
+    uint32_t range = max + 1;
+    uint64_t m = (uint64_t)r * range;
+    if ((uint32_t)m < range) {
+        uint32_t threshold = -range % range;
+        while ((uint32_t)m < threshold)
+            m = (uint64_t)nextRandom() * range;
+    }
+    return (uint32_t)(m >> 32);
+}
 
-    return result;
+void fillRandom(uint8_t *dst, unsigned len) {
+    while (len >= 4) {
+        uint32_t r = nextRandom();
+        memcpy(dst, &r, 4);
+        dst += 4;
+        len -= 4;
+    }
+    if (len) {
+        uint32_t r = nextRandom();
+        memcpy(dst, &r, len);
+    }
 }
 
 TNumber BoxedString::charCodeAt(int pos) {
@@ -465,6 +582,16 @@ String charAt(String s, int pos) {
 #define IS_CONS(s) ((s)->vtable == (uintptr_t)&string_cons_vt)
 #define IS_EMPTY(s) ((s) == (String)emptyString)
 
+#if PXT_UTF8
+// vtable, left, right, size+length
+#define CONS_BYTES (4 * sizeof(void *))
+
+static void setConsSize(String r) {
+    r->cons.size = r->cons.left->getUTF8Size() + r->cons.right->getUTF8Size();
+    r->cons.length = r->cons.left->getLength() + r->cons.right->getLength();
+}
+#endif
+
 //%
 String concat(String s, String other) {
     if (!s)
@@ -493,11 +620,14 @@ String concat(String s, String other) {
         // single characters
 
         // allocate [r] first, and keep it alive
-        String r = new (gcAllocate(3 * sizeof(void *))) BoxedString(&string_cons_vt);
+        String r = new (gcAllocate(CONS_BYTES)) BoxedString(&string_cons_vt);
+        r->cons.left = NULL;
+        r->cons.right = NULL;
         registerGCObj(r);
         r->cons.left = s->cons.left;
         // this concat() might trigger GC
         r->cons.right = concat(s->cons.right, other);
+        setConsSize(r);
         unregisterGCObj(r);
         return r;
     }
@@ -526,9 +656,10 @@ String concat(String s, String other) {
 
 #if PXT_UTF8
 mkCons:
-    r = new (gcAllocate(3 * sizeof(void *))) BoxedString(&string_cons_vt);
+    r = new (gcAllocate(CONS_BYTES)) BoxedString(&string_cons_vt);
     r->cons.left = s;
     r->cons.right = other;
+    setConsSize(r);
     return r;
 #endif
 }
@@ -563,27 +694,197 @@ int length(String s) {
 #define isspace(c) ((c) == ' ')
 #define iswhitespace(c) ((c) == 0x09 || (c) == 0x0B || (c) == 0x0C || (c) == 0x20 || (c) == 0xA0 || (c) == 0x0A || (c) == 0x0D)
 
+// 5^q for q in [EL_MIN_POW, EL_MAX_POW], normalized to 128 bits (high, low); negative powers
+// are rounded up; see Lemire, "Number Parsing at a Gigabyte per Second"
+#define EL_MIN_POW -40
+#define EL_MAX_POW 40
+static const uint64_t pow5x128[][2] = {
+    {0x8b61313bbabce2c6ULL, 0x2323ac4b3b3da015ULL},
+    {0xae397d8aa96c1b77ULL, 0xabec975e0a0d081aULL},
+    {0xd9c7dced53c72255ULL, 0x96e7bd358c904a21ULL},
+    {0x881cea14545c7575ULL, 0x7e50d64177da2e54ULL},
+    {0xaa242499697392d2ULL, 0xdde50bd1d5d0b9e9ULL},
+    {0xd4ad2dbfc3d07787ULL, 0x955e4ec64b44e864ULL},
+    {0x84ec3c97da624ab4ULL, 0xbd5af13bef0b113eULL},
+    {0xa6274bbdd0fadd61ULL, 0xecb1ad8aeacdd58eULL},
+    {0xcfb11ead453994baULL, 0x67de18eda5814af2ULL},
+    {0x81ceb32c4b43fcf4ULL, 0x80eacf948770ced7ULL},
+    {0xa2425ff75e14fc31ULL, 0xa1258379a94d028dULL},
+    {0xcad2f7f5359a3b3eULL, 0x096ee45813a04330ULL},
+    {0xfd87b5f28300ca0dULL, 0x8bca9d6e188853fcULL},
+    {0x9e74d1b791e07e48ULL, 0x775ea264cf55347eULL},
+    {0xc612062576589ddaULL, 0x95364afe032a819eULL},
+    {0xf79687aed3eec551ULL, 0x3a83ddbd83f52205ULL},
+    {0x9abe14cd44753b52ULL, 0xc4926a9672793543ULL},
+    {0xc16d9a0095928a27ULL, 0x75b7053c0f178294ULL},
+    {0xf1c90080baf72cb1ULL, 0x5324c68b12dd6339ULL},
+    {0x971da05074da7beeULL, 0xd3f6fc16ebca5e04ULL},
+    {0xbce5086492111aeaULL, 0x88f4bb1ca6bcf585ULL},
+    {0xec1e4a7db69561a5ULL, 0x2b31e9e3d06c32e6ULL},
+    {0x9392ee8e921d5d07ULL, 0x3aff322e62439fd0ULL},
+    {0xb877aa3236a4b449ULL, 0x09befeb9fad487c3ULL},
+    {0xe69594bec44de15bULL, 0x4c2ebe687989a9b4ULL},
+    {0x901d7cf73ab0acd9ULL, 0x0f9d37014bf60a11ULL},
+    {0xb424dc35095cd80fULL, 0x538484c19ef38c95ULL},
+    {0xe12e13424bb40e13ULL, 0x2865a5f206b06fbaULL},
+    {0x8cbccc096f5088cbULL, 0xf93f87b7442e45d4ULL},
+    {0xafebff0bcb24aafeULL, 0xf78f69a51539d749ULL},
+    {0xdbe6fecebdedd5beULL, 0xb573440e5a884d1cULL},
+    {0x89705f4136b4a597ULL, 0x31680a88f8953031ULL},
+    {0xabcc77118461cefcULL, 0xfdc20d2b36ba7c3eULL},
+    {0xd6bf94d5e57a42bcULL, 0x3d32907604691b4dULL},
+    {0x8637bd05af6c69b5ULL, 0xa63f9a49c2c1b110ULL},
+    {0xa7c5ac471b478423ULL, 0x0fcf80dc33721d54ULL},
+    {0xd1b71758e219652bULL, 0xd3c36113404ea4a9ULL},
+    {0x83126e978d4fdf3bULL, 0x645a1cac083126eaULL},
+    {0xa3d70a3d70a3d70aULL, 0x3d70a3d70a3d70a4ULL},
+    {0xccccccccccccccccULL, 0xcccccccccccccccdULL},
+    {0x8000000000000000ULL, 0x0000000000000000ULL},
+    {0xa000000000000000ULL, 0x0000000000000000ULL},
+    {0xc800000000000000ULL, 0x0000000000000000ULL},
+    {0xfa00000000000000ULL, 0x0000000000000000ULL},
+    {0x9c40000000000000ULL, 0x0000000000000000ULL},
+    {0xc350000000000000ULL, 0x0000000000000000ULL},
+    {0xf424000000000000ULL, 0x0000000000000000ULL},
+    {0x9896800000000000ULL, 0x0000000000000000ULL},
+    {0xbebc200000000000ULL, 0x0000000000000000ULL},
+    {0xee6b280000000000ULL, 0x0000000000000000ULL},
+    {0x9502f90000000000ULL, 0x0000000000000000ULL},
+    {0xba43b74000000000ULL, 0x0000000000000000ULL},
+    {0xe8d4a51000000000ULL, 0x0000000000000000ULL},
+    {0x9184e72a00000000ULL, 0x0000000000000000ULL},
+    {0xb5e620f480000000ULL, 0x0000000000000000ULL},
+    {0xe35fa931a0000000ULL, 0x0000000000000000ULL},
+    {0x8e1bc9bf04000000ULL, 0x0000000000000000ULL},
+    {0xb1a2bc2ec5000000ULL, 0x0000000000000000ULL},
+    {0xde0b6b3a76400000ULL, 0x0000000000000000ULL},
+    {0x8ac7230489e80000ULL, 0x0000000000000000ULL},
+    {0xad78ebc5ac620000ULL, 0x0000000000000000ULL},
+    {0xd8d726b7177a8000ULL, 0x0000000000000000ULL},
+    {0x878678326eac9000ULL, 0x0000000000000000ULL},
+    {0xa968163f0a57b400ULL, 0x0000000000000000ULL},
+    {0xd3c21bcecceda100ULL, 0x0000000000000000ULL},
+    {0x84595161401484a0ULL, 0x0000000000000000ULL},
+    {0xa56fa5b99019a5c8ULL, 0x0000000000000000ULL},
+    {0xcecb8f27f4200f3aULL, 0x0000000000000000ULL},
+    {0x813f3978f8940984ULL, 0x4000000000000000ULL},
+    {0xa18f07d736b90be5ULL, 0x5000000000000000ULL},
+    {0xc9f2c9cd04674edeULL, 0xa400000000000000ULL},
+    {0xfc6f7c4045812296ULL, 0x4d00000000000000ULL},
+    {0x9dc5ada82b70b59dULL, 0xf020000000000000ULL},
+    {0xc5371912364ce305ULL, 0x6c28000000000000ULL},
+    {0xf684df56c3e01bc6ULL, 0xc732000000000000ULL},
+    {0x9a130b963a6c115cULL, 0x3c7f400000000000ULL},
+    {0xc097ce7bc90715b3ULL, 0x4b9f100000000000ULL},
+    {0xf0bdc21abb48db20ULL, 0x1e86d40000000000ULL},
+    {0x96769950b50d88f4ULL, 0x1314448000000000ULL},
+    {0xbc143fa4e250eb31ULL, 0x17d955a000000000ULL},
+    {0xeb194f8e1ae525fdULL, 0x5dcfab0800000000ULL},
+};
+
+// powers of 10 that are exact in a double
+static const double exactPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static inline void mul64x64(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *hi = (uint64_t)(r >> 64);
+    *lo = (uint64_t)r;
+#else
+    uint64_t a0 = a & 0xffffffff, a1 = a >> 32, b0 = b & 0xffffffff, b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+    *lo = (mid << 32) | (p00 & 0xffffffff);
+    *hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+// converts w * 10^q (w != 0, exact) to the nearest double; returns false when the result
+// cannot be decided without more precision
+static bool decimalToDouble(uint64_t w, int q, double *res) {
+    // Clinger's fast path: both w and 10^q are exact doubles
+    if (w <= (1ULL << 53) && -22 <= q && q <= 22) {
+        *res = q < 0 ? (double)w / exactPow10[-q] : (double)w * exactPow10[q];
+        return true;
+    }
+
+    // Eisel-Lemire
+    if (q < EL_MIN_POW || q > EL_MAX_POW)
+        return false;
+    auto pow5 = pow5x128[q - EL_MIN_POW];
+    int64_t exponent = (((152170 + 65536) * q) >> 16) + 1024 + 63;
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+    uint64_t upper, lower;
+    mul64x64(w, pow5[0], &upper, &lower);
+    if ((upper & 0x1ff) == 0x1ff && lower + w < lower) {
+        uint64_t hi2, lo2;
+        mul64x64(w, pow5[1], &hi2, &lo2);
+        uint64_t mid = lower + hi2;
+        if (mid < lower)
+            upper++;
+        if (mid + 1 == 0 && (upper & 0x1ff) == 0x1ff && lo2 + w < lo2)
+            return false;
+        lower = mid;
+    }
+    uint64_t upperbit = upper >> 63;
+    uint64_t mantissa = upper >> (upperbit + 9);
+    lz += (int)(1 ^ upperbit);
+    // half-way between two doubles
+    if (lower == 0 && (upper & 0x1ff) == 0 && (mantissa & 3) == 1)
+        return false;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (1ULL << 53)) {
+        mantissa = 1ULL << 52;
+        lz--;
+    }
+    mantissa &= ~(1ULL << 52);
+    int64_t realExponent = exponent - lz;
+    if (realExponent < 1 || realExponent > 2046)
+        return false;
+    mantissa |= (uint64_t)realExponent << 52;
+    memcpy(res, &mantissa, sizeof(*res));
+    return true;
+}
+
 NUMBER mystrtod(const char *p, char **endp) {
     while (iswhitespace(*p))
         p++;
-    NUMBER m = 1;
-    NUMBER v = 0;
-    int dot = 0;
-    int hasDigit = 0;
+    bool neg = false;
     if (*p == '+')
         p++;
     if (*p == '-') {
-        m = -1;
+        neg = true;
         p++;
     }
 
+    // up to 19 significant digits go into w, the value is w * 10^q
+    const char *start = p;
+    uint64_t w = 0;
+    int q = 0;
+    int numDigits = 0;
+    bool truncated = false;
+    int dot = 0;
+    int hasDigit = 0;
+
     while (*p) {
         int c = *p - '0';
         if (0 <= c && c <= 9) {
-            v *= 10;
-            v += c;
-            if (dot)
-                m /= 10;
+            if (numDigits < 19) {
+                w = w * 10 + c;
+                if (w)
+                    numDigits++;
+                if (dot)
+                    q--;
+            } else {
+                if (c)
+                    truncated = true;
+                if (!dot)
+                    q++;
+            }
             hasDigit = 1;
         } else if (!dot && *p == '.') {
             dot = 1;
@@ -595,17 +896,56 @@ NUMBER mystrtod(const char *p, char **endp) {
         p++;
     }
 
-    v *= m;
-
     if (*p == 'e' || *p == 'E') {
         p++;
-        int pw = (int)strtol(p, endp, 10);
-        v *= p10(pw);
+        long pw = strtol(p, endp, 10);
+        if (pw > 1000)
+            pw = 1000;
+        if (pw < -1000)
+            pw = -1000;
+        q += (int)pw;
     } else {
         *endp = (char *)p;
     }
 
-    return v;
+    double v;
+    if (w == 0) {
+        v = 0;
+    } else if (truncated || !decimalToDouble(w, q, &v)) {
+#if defined(PXT_VM) || defined(__linux__)
+        // correctly rounded, but slow
+        v = strtod(start, NULL);
+#else
+        v = (double)w * p10(q);
+#endif
+    }
+
+    return neg ? -v : v;
+}
+
+// integer-only path for up to 9 digits; avoids software floating point on parts without FPU
+static bool parseSmallInt(const char *p, int *res) {
+    while (iswhitespace(*p))
+        p++;
+    int m = 1;
+    if (*p == '+')
+        p++;
+    if (*p == '-') {
+        m = -1;
+        p++;
+    }
+    int v = 0;
+    int n = 0;
+    while ('0' <= *p && *p <= '9') {
+        if (++n > 9)
+            return false;
+        v = v * 10 + (*p++ - '0');
+    }
+    // leave "-0", "1.5" or "1e3" to mystrtod()
+    if (n == 0 || (v == 0 && m < 0) || *p == '.' || *p == 'e' || *p == 'E')
+        return false;
+    *res = v * m;
+    return true;
 }
 
 //%
@@ -613,6 +953,9 @@ TNumber toNumber(String s) {
     // JSCHECK
     char *endptr;
     auto data = s->getUTF8Data();
+    int iv;
+    if (parseSmallInt(data, &iv))
+        return fromInt(iv);
     NUMBER v = mystrtod(data, &endptr);
     if (v == 0.0 || v == -0.0) {
         // nothing
@@ -633,7 +976,8 @@ String substr(String s, int start, int length) {
         return mkEmpty();
     auto p = s->getUTF8DataAt(start);
 #if PXT_UTF8
-    auto ep = s->getUTF8DataAt(start + length);
+    // walk from [p], rather than doing a second lookup from the start of the string
+    auto ep = utf8Skip(p, (int)(s->getUTF8Size() - (p - s->getUTF8Data())), length);
     if (ep == NULL)
         oops(82);
     return mkStringCore(p, (int)(ep - p));
@@ -642,6 +986,64 @@ String substr(String s, int start, int length) {
 #endif
 }
 
+// find [b] (lenB > 0) in [a]; only positions where both the first and the last byte
+// of [b] match are checked with memcmp()
+static const char *findBytes(const char *a, int lenA, const char *b, int lenB) {
+    const char *end = a + lenA - lenB; // last possible match
+    if (end < a)
+        return NULL;
+    if (lenB == 1)
+        return (const char *)memchr(a, b[0], lenA);
+
+    int last = lenB - 1;
+
+#if defined(PXT_SEARCH_SSE2)
+    auto first16 = _mm_set1_epi8(b[0]);
+    auto last16 = _mm_set1_epi8(b[last]);
+    while (end - a >= 16) {
+        auto ma = _mm_cmpeq_epi8(first16, _mm_loadu_si128((const __m128i *)a));
+        auto mb = _mm_cmpeq_epi8(last16, _mm_loadu_si128((const __m128i *)(a + last)));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(ma, mb));
+        while (mask) {
+            int k = __builtin_ctz(mask);
+            if (!memcmp(a + k + 1, b + 1, lenB - 2))
+                return a + k;
+            mask &= mask - 1;
+        }
+        a += 16;
+    }
+#elif defined(PXT_SEARCH_NEON)
+    auto first16 = vdupq_n_u8(b[0]);
+    auto last16 = vdupq_n_u8(b[last]);
+    while (end - a >= 16) {
+        auto ma = vceqq_u8(first16, vld1q_u8((const uint8_t *)a));
+        auto mb = vceqq_u8(last16, vld1q_u8((const uint8_t *)(a + last)));
+        // narrow to 4 bits per byte
+        auto m = vshrn_n_u16(vreinterpretq_u16_u8(vandq_u8(ma, mb)), 4);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(m), 0);
+        while (mask) {
+            int k = __builtin_ctzll(mask) >> 2;
+            if (!memcmp(a + k + 1, b + 1, lenB - 2))
+                return a + k;
+            mask &= ~(0xfULL << (k << 2));
+        }
+        a += 16;
+    }
+#endif
+
+    // portable version, also used for the tail; memchr() is typically optimized in libc
+    char firstB = b[0], lastB = b[last];
+    while (a <= end) {
+        a = (const char *)memchr(a, firstB, end - a + 1);
+        if (!a)
+            return NULL;
+        if (a[last] == lastB && !memcmp(a + 1, b + 1, lenB - 2))
+            return a;
+        a++;
+    }
+    return NULL;
+}
+
 //%
 int indexOf(String s, String searchString, int start) {
     if (!s || !searchString)
@@ -652,26 +1054,26 @@ int indexOf(String s, String searchString, int start) {
 
     auto dataA0 = s->getUTF8Data();
     auto dataA = s->getUTF8DataAt(start);
+    if (dataA == NULL)
+        return -1;
     auto offset = dataA - dataA0;
-    auto lenA = s->getUTF8Size() - offset;
-    auto lenB = searchString->getUTF8Size();
+    int lenA = (int)(s->getUTF8Size() - offset);
+    int lenB = (int)searchString->getUTF8Size();
 
-    if (dataA == NULL || lenB > lenA)
+    if (lenB == 0)
+        return start;
+    if (lenB > lenA)
         return -1;
 
-    auto dataB = searchString->getUTF8Data();
-    auto firstB = dataB[0];
-    while (lenA >= lenB) {
-        if (*dataA == firstB && !memcmp(dataA, dataB, lenB))
+    auto res = findBytes(dataA, lenA, searchString->getUTF8Data(), lenB);
+    if (!res)
+        return -1;
 #if PXT_UTF8
-            return utf8Len(dataA0, (int)(dataA - dataA0));
+    // convert to character index once, only counting characters past [start]
+    return start + utf8Len(dataA, (int)(res - dataA));
 #else
-            return dataA - dataA0;
+    return res - dataA0;
 #endif
-        dataA++;
-        lenA--;
-    }
-    return -1;
 }
 
 //%
@@ -679,6 +1081,100 @@ int includes(String s, String searchString, int start) {
     return -1 != indexOf(s, searchString, start);
 }
 
+// the bytes of a character starting with c
+static inline int utf8CharSize(uint8_t c) {
+#if PXT_UTF8
+    return c < 0xc0 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Split the string at each separator; into characters when the separator is empty. Unlike
+ * split(), the parts are found and the array allocated before any part is created.
+ */
+//%
+RefCollection *splitOn(String s, String separator) {
+    auto len = (int)s->getUTF8Size();
+    auto sepLen = separator ? (int)separator->getUTF8Size() : 0;
+    auto sepData = sepLen ? separator->getUTF8Data() : NULL;
+    auto data = s->getUTF8Data();
+
+    // count the parts first, so that the array is only allocated once
+    int n = 0;
+    if (!sepLen) {
+        for (int i = 0; i < len; i += utf8CharSize(data[i]))
+            n++;
+    } else {
+        n = 1;
+        for (const char *p = data, *end = data + len;
+             (p = findBytes(p, (int)(end - p), sepData, sepLen)) != NULL; p += sepLen)
+            n++;
+    }
+
+    auto r = Array_::mk();
+    registerGCObj(r);
+    r->setLength(n);
+    // the array holds all the parts as soon as they're made; part allocations may run the GC,
+    // but don't move anything
+    data = s->getUTF8Data();
+    int pos = 0;
+    for (int i = 0; i < n; ++i) {
+        int next;
+        if (!sepLen) {
+            next = min(len, pos + utf8CharSize(data[pos]));
+        } else {
+            auto p = i == n - 1 ? NULL : findBytes(data + pos, len - pos, sepData, sepLen);
+            next = p ? (int)(p - data) : len;
+        }
+        Array_::setAt(r, i, (TValue)mkStringCore(data + pos, next - pos));
+        pos = next + (sepLen && next < len ? sepLen : 0);
+    }
+    unregisterGCObj(r);
+    return r;
+}
+
+/**
+ * Replace every occurrence of search in the string; nothing is replaced when search is empty.
+ * The result is allocated once.
+ */
+//%
+String replaceEvery(String s, String search, String replacement) {
+    auto len = (int)s->getUTF8Size();
+    auto searchLen = search ? (int)search->getUTF8Size() : 0;
+    if (!searchLen || len < searchLen)
+        return s;
+    auto replLen = replacement ? (int)replacement->getUTF8Size() : 0;
+    auto searchData = search->getUTF8Data();
+    auto data = s->getUTF8Data();
+    auto end = data + len;
+
+    int n = 0;
+    for (const char *p = data; (p = findBytes(p, (int)(end - p), searchData, searchLen)) != NULL;
+         p += searchLen)
+        n++;
+    if (!n)
+        return s;
+
+    int resLen = len + n * (replLen - searchLen);
+    auto buf = (char *)xmalloc(resLen + 1);
+    auto replData = replLen ? replacement->getUTF8Data() : NULL;
+    auto dst = buf;
+    const char *src = data;
+    for (const char *p; (p = findBytes(src, (int)(end - src), searchData, searchLen)) != NULL;) {
+        memcpy(dst, src, p - src);
+        dst += p - src;
+        memcpy(dst, replData, replLen);
+        dst += replLen;
+        src = p + searchLen;
+    }
+    memcpy(dst, src, end - src);
+    auto r = mkStringCore(buf, resLen);
+    xfree(buf);
+    return r;
+}
+
 } // namespace String_
 
 namespace Boolean_ {
@@ -819,6 +1315,78 @@ static inline TValue doubleToInt(NUMBER r) {
 }
 #endif
 
+#if !defined(PXT64) && PXT_BOX_CACHE
+// Recently boxed non-integer numbers, indexed by a hash of the bit pattern. Boxes are never
+// modified, so the same one can be handed out for every equal result. The slots are GC roots;
+// they keep at most PXT_BOX_CACHE boxes alive.
+static PXT_TLS BoxedNumber *boxCache[PXT_BOX_CACHE];
+// common constants, allocated on first use and never evicted
+static const NUMBER boxConstValues[] = {0.5, -0.5, 1.5, -1.5, 0.25, 0.1, INFINITY, -INFINITY};
+#define NUM_BOX_CONSTS (int)(sizeof(boxConstValues) / sizeof(boxConstValues[0]))
+static PXT_TLS BoxedNumber *boxConsts[NUM_BOX_CONSTS];
+static PXT_TLS bool boxCacheRegistered;
+PXT_TLS BoxCacheStats boxCacheStats;
+
+static void resetBoxCache() {
+    // the roots and the boxes go away with the GC reset
+    memset(boxCache, 0, sizeof(boxCache));
+    memset(boxConsts, 0, sizeof(boxConsts));
+    boxCacheRegistered = false;
+    memset(&boxCacheStats, 0, sizeof(boxCacheStats));
+}
+
+static unsigned boxCacheSlot(NUMBER x) {
+    uint64_t bits = 0;
+    memcpy(&bits, &x, sizeof(x));
+    uint32_t h = (uint32_t)(bits ^ (bits >> 32));
+    return ((h * 0x9e3779b1) >> 16) % PXT_BOX_CACHE;
+}
+
+static inline bool sameBits(NUMBER a, NUMBER b) {
+    return memcmp(&a, &b, sizeof(NUMBER)) == 0;
+}
+
+static BoxedNumber *newBox(NUMBER r) {
+    BoxedNumber *p = NEW_GC(BoxedNumber);
+    p->num = r;
+    MEMDBG("mkNum: %d/1000 => %p", (int)(r * 1000), p);
+    return p;
+}
+
+static TNumber boxNumber(NUMBER r) {
+    auto slot = boxCacheSlot(r);
+    auto p = boxCache[slot];
+    if (p && sameBits(p->num, r)) {
+        boxCacheStats.hits++;
+        return (TNumber)p;
+    }
+
+    if (!boxCacheRegistered) {
+        boxCacheRegistered = true;
+        registerGC((TValue *)boxCache, PXT_BOX_CACHE);
+        registerGC((TValue *)boxConsts, NUM_BOX_CONSTS);
+    }
+
+    p = NULL;
+    for (int i = 0; i < NUM_BOX_CONSTS; ++i)
+        if (sameBits(boxConstValues[i], r)) {
+            if (!boxConsts[i])
+                boxConsts[i] = newBox(r);
+            p = boxConsts[i];
+            break;
+        }
+
+    if (p)
+        boxCacheStats.hits++;
+    else {
+        boxCacheStats.misses++;
+        p = newBox(r);
+    }
+    boxCache[slot] = p;
+    return (TNumber)p;
+}
+#endif
+
 TNumber fromDouble(NUMBER r) {
 #ifndef PXT_BOX_DEBUG
     auto i = doubleToInt(r);
@@ -829,6 +1397,8 @@ TNumber fromDouble(NUMBER r) {
         return TAG_NAN;
 #ifdef PXT64
     return tvalueFromDouble(r);
+#elif PXT_BOX_CACHE
+    return boxNumber(r);
 #else
     BoxedNumber *p = NEW_GC(BoxedNumber);
     p->num = r;
@@ -892,15 +1462,15 @@ static inline bool eq_core(TValue a, TValue b, ValType ta) {
 }
 
 bool eqq_bool(TValue a, TValue b) {
-    if (a == TAG_NAN || b == TAG_NAN)
-        return false;
-
+    // the same small int or object, or two different small ints, without looking at the types
     if (a == b)
-        return true;
-
+        return a != TAG_NAN;
     if (bothNumbers(a, b))
         return false;
 
+    if (a == TAG_NAN || b == TAG_NAN)
+        return false;
+
     ValType ta = valType(a);
     ValType tb = valType(b);
 
@@ -911,15 +1481,18 @@ bool eqq_bool(TValue a, TValue b) {
 }
 
 bool eq_bool(TValue a, TValue b) {
+    // as in eqq_bool()
+    if (a == b)
+        return a != TAG_NAN;
+    if (bothNumbers(a, b))
+        return false;
+
     if (a == TAG_NAN || b == TAG_NAN)
         return false;
 
     if (eqFixup(a) == eqFixup(b))
         return true;
 
-    if (bothNumbers(a, b))
-        return false;
-
     ValType ta = valType(a);
     ValType tb = valType(b);
 
@@ -992,6 +1565,24 @@ int toBoolDecr(TValue v) {
 
 // The integer, non-overflow case for add/sub/bit opts is handled in assembly
 
+#ifdef PXT64
+// Doubles are NaN-boxed immediates here, so arithmetic on them doesn't allocate; when both
+// operands are ints or doubles, skip the checks in toDouble().
+static inline bool isNumberValue(TValue v) {
+    return isDouble(v) || ((intptr_t)v & 1);
+}
+
+static inline double numberValue(TValue v) {
+    return isDouble(v) ? doubleVal(v) : numValue(v);
+}
+
+#define FLOATOP(op)                                                                                \
+    if (isNumberValue(a) && isNumberValue(b))                                                      \
+        return fromDouble(numberValue(a) op numberValue(b));
+#else
+#define FLOATOP(op)
+#endif
+
 #ifdef PXT_VM
 #define NUMOP2(op)                                                                                 \
     if (bothNumbers(a, b)) {                                                                       \
@@ -999,6 +1590,7 @@ int toBoolDecr(TValue v) {
         if ((int)tmp == tmp)                                                                       \
             return TAG_NUMBER((int)tmp);                                                           \
     }                                                                                              \
+    FLOATOP(op)                                                                                    \
     NUMOP(op)
 #else
 #define NUMOP2(op) NUMOP(op)
@@ -1027,11 +1619,15 @@ TNumber muls(TNumber a, TNumber b) {
         }
 #endif
     }
+    FLOATOP(*)
     NUMOP(*)
 }
 
 //%
-TNumber div(TNumber a, TNumber b){NUMOP(/)}
+TNumber div(TNumber a, TNumber b) {
+    FLOATOP(/)
+    NUMOP(/)
+}
 
 //%
 TNumber mod(TNumber a, TNumber b) {
@@ -1072,9 +1668,12 @@ TNumber ands(TNumber a, TNumber b) {
 }
 
 #ifdef PXT64
+// NaN is TAG_NAN, never a boxed double, so comparing the doubles directly is fine
 #define CMPOP_RAW(op, t, f)                                                                        \
     if (bothNumbers(a, b))                                                                         \
         return numValue(a) op numValue(b) ? t : f;                                                 \
+    if (isNumberValue(a) && isNumberValue(b))                                                      \
+        return numberValue(a) op numberValue(b) ? t : f;                                           \
     int cmp = valCompare(a, b);                                                                    \
     return cmp != -2 && cmp op 0 ? t : f;
 #else
@@ -1092,15 +1691,18 @@ static int valCompare(TValue a, TValue b) {
     if (a == TAG_NAN || b == TAG_NAN)
         return -2;
 
+    // the same value, or small ints; neither needs the types
+    if (a == b)
+        return 0;
+    if (bothNumbers(a, b))
+        return numValue(a) < numValue(b) ? -1 : 1;
+
     ValType ta = valType(a);
     ValType tb = valType(b);
 
     if (ta == ValType::String && tb == ValType::String)
         return String_::compare((String)a, (String)b);
 
-    if (a == b)
-        return 0;
-
     auto da = toDouble(a);
     auto db = toDouble(b);
 
@@ -1150,6 +1752,7 @@ TNumber neqq(TNumber a, TNumber b) {
     return !pxt::eqq_bool(a, b) ? TAG_TRUE : TAG_FALSE;
 }
 
+#ifdef PXT_USE_FLOAT
 // How many significant digits mycvt() should output.
 // This cannot be more than 15, as this is the most that can be accurately represented
 // in 64 bit double. Otherwise this code may crash.
@@ -1246,6 +1849,247 @@ void mycvt(NUMBER d, char *buf) {
         *buf = 0;
     }
 }
+#else
+// Shortest representation that reads back as the same double, using Grisu2
+// (Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers").
+// It is shortest in over 99% of cases and always round-trips.
+
+struct DiyFp {
+    uint64_t f;
+    int e;
+};
+
+static DiyFp diyMul(DiyFp x, DiyFp y) {
+    uint64_t a = x.f >> 32, b = x.f & 0xffffffff;
+    uint64_t c = y.f >> 32, d = y.f & 0xffffffff;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & 0xffffffff) + (bc & 0xffffffff);
+    tmp += 1U << 31; // round
+    return {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+}
+
+static DiyFp diyNormalize(DiyFp x) {
+    int s = __builtin_clzll(x.f);
+    return {x.f << s, x.e - s};
+}
+
+// 10^-348, 10^-340, ..., 10^340 as normalized 64 bit mantissa and binary exponent
+static const uint64_t cachedPowersF[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+static const int16_t cachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+    -927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661,
+    -635, -608, -582, -555, -529, -502, -475, -449, -422, -396, -369,
+    -343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77,
+    -50, -24, 3, 30, 56, 83, 109, 136, 162, 189, 216,
+    242, 269, 295, 322, 348, 375, 402, 428, 455, 481, 508,
+    534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800,
+    827, 853, 880, 907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t pow10u64[] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+    10000000000000000000ULL,
+};
+
+static void grisuRound(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t tenKappa,
+                       uint64_t wpw) {
+    while (rest < wpw && delta - rest >= tenKappa &&
+           (rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw)) {
+        buf[len - 1]--;
+        rest += tenKappa;
+    }
+}
+
+// writes digits of [d] (positive, finite) to [buf]; d == digits * 10^K
+static int grisu2(double d, char *buf, int *K) {
+    uint64_t bits;
+    memcpy(&bits, &d, 8);
+    int be = (int)((bits >> 52) & 0x7ff);
+    uint64_t frac = bits & 0xfffffffffffffULL;
+    DiyFp v = be ? DiyFp{frac | (1ULL << 52), be - 1075} : DiyFp{frac, -1074};
+
+    // boundaries half-way to the neighboring doubles
+    DiyFp wp = diyNormalize({(v.f << 1) + 1, v.e - 1});
+    DiyFp wm = frac == 0 && be > 1 ? DiyFp{(v.f << 2) - 1, v.e - 2} : DiyFp{(v.f << 1) - 1, v.e - 1};
+    wm.f <<= wm.e - wp.e;
+    wm.e = wp.e;
+
+    // pick 10^-K so that the product has binary exponent in [-60, -32]
+    double dk = (-61 - wp.e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if (dk - k > 0.0)
+        k++;
+    unsigned idx = (unsigned)((k >> 3) + 1);
+    *K = 348 - (int)(idx << 3);
+    DiyFp c = {cachedPowersF[idx], cachedPowersE[idx]};
+
+    DiyFp w = diyMul(diyNormalize(v), c);
+    DiyFp mp = diyMul(wp, c);
+    DiyFp mm = diyMul(wm, c);
+    mp.f--;
+    mm.f++;
+    uint64_t delta = mp.f - mm.f;
+
+    // generate digits
+    int shift = -mp.e;
+    uint64_t one = 1ULL << shift;
+    uint64_t wpw = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> shift);
+    uint64_t p2 = mp.f & (one - 1);
+    int kappa = 1;
+    while (kappa < 10 && p1 >= pow10u64[kappa])
+        kappa++;
+    int len = 0;
+    while (kappa > 0) {
+        uint32_t div = (uint32_t)pow10u64[kappa - 1];
+        uint32_t dig = p1 / div;
+        p1 %= div;
+        if (dig || len)
+            buf[len++] = '0' + dig;
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta) {
+            *K += kappa;
+            grisuRound(buf, len, delta, rest, pow10u64[kappa] << shift, wpw);
+            return len;
+        }
+    }
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char dig = (char)(p2 >> shift);
+        if (dig || len)
+            buf[len++] = '0' + dig;
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta) {
+            *K += kappa;
+            grisuRound(buf, len, delta, p2, one, -kappa < 20 ? wpw * pow10u64[-kappa] : 0);
+            return len;
+        }
+    }
+}
+
+static char *writeDecimal(char *buf, uint64_t v) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n)
+        *buf++ = tmp[--n];
+    return buf;
+}
+
+// formats [d] as JavaScript's Number.prototype.toString() would
+void mycvt(NUMBER d, char *buf) {
+    if (d < 0) {
+        *buf++ = '-';
+        d = -d;
+    }
+
+    // integer fast path; beyond 2^53 the decimal expansion may be longer than the shortest form
+    if (d < 9007199254740992.0 && d == (uint64_t)d) {
+        *writeDecimal(buf, (uint64_t)d) = 0;
+        return;
+    }
+
+    char digits[20];
+    int K;
+    int len = grisu2(d, digits, &K);
+    int n = len + K; // position of the decimal point
+
+    if (len <= n && n <= 21) {
+        // 1234e7 -> 12340000000
+        memcpy(buf, digits, len);
+        buf += len;
+        while (len++ < n)
+            *buf++ = '0';
+    } else if (0 < n && n <= 21) {
+        // 1234e-2 -> 12.34
+        memcpy(buf, digits, n);
+        buf += n;
+        *buf++ = '.';
+        memcpy(buf, digits + n, len - n);
+        buf += len - n;
+    } else if (-6 < n && n <= 0) {
+        // 1234e-6 -> 0.001234
+        *buf++ = '0';
+        *buf++ = '.';
+        while (n++ < 0)
+            *buf++ = '0';
+        memcpy(buf, digits, len);
+        buf += len;
+    } else {
+        // 1234e30 -> 1.234e+33
+        *buf++ = digits[0];
+        if (len > 1) {
+            *buf++ = '.';
+            memcpy(buf, digits + 1, len - 1);
+            buf += len - 1;
+        }
+        *buf++ = 'e';
+        int e = n - 1;
+        if (e > 0)
+            *buf++ = '+';
+        else {
+            *buf++ = '-';
+            e = -e;
+        }
+        buf = writeDecimal(buf, e);
+    }
+    *buf = 0;
+}
+#endif
 
 #if 0
 //%
@@ -1284,6 +2128,23 @@ function testFloatAsInt() {
 }
 #endif
 
+#ifndef PXT_NUMBER_STRING_CACHE
+#define PXT_NUMBER_STRING_CACHE 8
+#endif
+
+#if PXT_NUMBER_STRING_CACHE
+// recently formatted non-integer numbers, indexed by a hash of the value
+static PXT_TLS NUMBER numCacheKeys[PXT_NUMBER_STRING_CACHE];
+static PXT_TLS String numCacheValues[PXT_NUMBER_STRING_CACHE];
+
+static unsigned numCacheSlot(NUMBER x) {
+    uint64_t bits = 0;
+    memcpy(&bits, &x, sizeof(x));
+    uint32_t h = (uint32_t)(bits ^ (bits >> 32));
+    return ((h * 0x9e3779b1) >> 16) % PXT_NUMBER_STRING_CACHE;
+}
+#endif
+
 String toString(TValue v) {
     ValType t = valType(v);
 
@@ -1317,9 +2178,28 @@ String toString(TValue v) {
         } else if (isnan(x)) {
             return (String)(void *)sNaN;
         }
+
+#if PXT_NUMBER_STRING_CACHE
+        auto slot = numCacheSlot(x);
+        if (numCacheValues[slot] && numCacheKeys[slot] == x)
+            return numCacheValues[slot];
+        static PXT_TLS bool numCacheRegistered;
+        if (!numCacheRegistered) {
+            numCacheRegistered = true;
+            registerGC((TValue *)numCacheValues, PXT_NUMBER_STRING_CACHE);
+        }
+#endif
+
         mycvt(x, buf);
 
+#if PXT_NUMBER_STRING_CACHE
+        auto r = mkStringCore(buf);
+        numCacheKeys[slot] = x;
+        numCacheValues[slot] = r;
+        return r;
+#else
         return mkStringCore(buf);
+#endif
     } else if (t == ValType::Function) {
         return (String)(void *)sFunction;
     } else {
@@ -1351,8 +2231,9 @@ TNumber pow(TNumber x, TNumber y) {
 }
 
 NUMBER randomDouble() {
-    return getRandom(UINT_MAX) / ((NUMBER)UINT_MAX + 1) +
-           getRandom(0xffffff) / ((NUMBER)UINT_MAX * 0xffffff);
+    // 53 random bits, from two words
+    uint32_t hi = getRandom(UINT_MAX) >> 5, lo = getRandom(UINT_MAX) >> 6;
+    return (hi * 67108864.0 + lo) * (1.0 / 9007199254740992.0);
 }
 
 //%
@@ -1458,11 +2339,36 @@ void insertAt(RefCollection *c, int x, TValue value) {
 }
 int indexOf(RefCollection *c, TValue x, int start) {
     auto data = c->head.getData();
-    auto len = c->head.getLength();
-    for (unsigned i = 0; i < len; i++) {
-        if (pxt::eq_bool(data[i], x)) {
-            return (int)i;
+    int len = c->head.getLength();
+    if (start < 0)
+        start = max(0, len + start);
+
+    // Arrays of numbers or of strings are the common case, so the elements that can only be
+    // equal to x when they are the same value, or the same string, are told apart without
+    // eq_bool(); anything else (eg. "1" and 1) still goes through it.
+    if (isInt(x)) {
+        for (int i = start; i < len; i++) {
+            auto v = data[i];
+            if (v == x || (!isInt(v) && pxt::eq_bool(v, x)))
+                return i;
         }
+    } else if (isPointer(x) && valType(x) == ValType::String) {
+        auto size = ((String)x)->getUTF8Size();
+        for (int i = start; i < len; i++) {
+            auto v = data[i];
+            if (v == x)
+                return i;
+            if (isPointer(v) && valType(v) == ValType::String) {
+                if (((String)v)->getUTF8Size() == size && String_::compare((String)v, (String)x) == 0)
+                    return i;
+            } else if (pxt::eq_bool(v, x)) {
+                return i;
+            }
+        }
+    } else {
+        for (int i = start; i < len; i++)
+            if (pxt::eq_bool(data[i], x))
+                return i;
     }
     return -1;
 }
@@ -1474,10 +2380,286 @@ bool removeElement(RefCollection *c, TValue x) {
     }
     return 0;
 }
+
+// Default sort order: numbers numerically with NaN after them, then strings, then other
+// objects in original order, then undefined. Unlike valCompare() this is a total order.
+static int sortRank(TValue v) {
+    if (v == TAG_UNDEFINED)
+        return 4;
+    if (v == TAG_NAN)
+        return 1;
+    switch (valType(v)) {
+    case ValType::Number:
+        return 0;
+    case ValType::String:
+        return 2;
+    default:
+        return 3;
+    }
+}
+
+struct DefaultLess {
+    bool operator()(TValue a, TValue b) {
+        if (bothNumbers(a, b))
+            return numValue(a) < numValue(b);
+        int ra = sortRank(a), rb = sortRank(b);
+        if (ra != rb)
+            return ra < rb;
+        if (ra == 0)
+            return toDouble(a) < toDouble(b);
+        if (ra == 2)
+            return String_::compare((String)a, (String)b) < 0;
+        return false;
+    }
+};
+
+struct IntLess {
+    bool operator()(TValue a, TValue b) { return numValue(a) < numValue(b); }
+};
+
+struct StringLess {
+    bool operator()(TValue a, TValue b) { return String_::compare((String)a, (String)b) < 0; }
+};
+
+template <typename Less> static void insertionSort(TValue *data, int len, Less less) {
+    for (int i = 1; i < len; ++i) {
+        auto v = data[i];
+        int j = i;
+        while (j > 0 && less(v, data[j - 1])) {
+            data[j] = data[j - 1];
+            j--;
+        }
+        data[j] = v;
+    }
+}
+
+template <typename Less> static void siftDown(TValue *data, int root, int len, Less less) {
+    for (;;) {
+        int child = 2 * root + 1;
+        if (child >= len)
+            break;
+        if (child + 1 < len && less(data[child], data[child + 1]))
+            child++;
+        if (!less(data[root], data[child]))
+            break;
+        auto t = data[root];
+        data[root] = data[child];
+        data[child] = t;
+        root = child;
+    }
+}
+
+template <typename Less> static void heapSort(TValue *data, int len, Less less) {
+    for (int i = len / 2 - 1; i >= 0; --i)
+        siftDown(data, i, len, less);
+    for (int i = len - 1; i > 0; --i) {
+        auto t = data[0];
+        data[0] = data[i];
+        data[i] = t;
+        siftDown(data, 0, i, less);
+    }
+}
+
+// quicksort with median-of-three pivots, falling back to heap sort when recursion gets too deep
+template <typename Less> static void introSort(TValue *data, int len, int depth, Less less) {
+    while (len > 16) {
+        if (depth-- == 0) {
+            heapSort(data, len, less);
+            return;
+        }
+        auto a = data[0], b = data[len >> 1], c = data[len - 1];
+        auto pivot = less(a, b) ? (less(b, c) ? b : less(a, c) ? c : a)
+                                : (less(a, c) ? a : less(b, c) ? c : b);
+        int i = 0, j = len - 1;
+        for (;;) {
+            while (less(data[i], pivot))
+                i++;
+            while (less(pivot, data[j]))
+                j--;
+            if (i >= j)
+                break;
+            auto t = data[i];
+            data[i] = data[j];
+            data[j] = t;
+            i++;
+            j--;
+        }
+        // recurse into the smaller part
+        if (j + 1 < len - j - 1) {
+            introSort(data, j + 1, depth, less);
+            data += j + 1;
+            len -= j + 1;
+        } else {
+            introSort(data + j + 1, len - j - 1, depth, less);
+            len = j + 1;
+        }
+    }
+    insertionSort(data, len, less);
+}
+
+template <typename Less> static void introSort(TValue *data, int len, Less less) {
+    int depth = 0;
+    for (int n = len; n > 1; n >>= 1)
+        depth += 2;
+    introSort(data, len, depth, less);
+}
+
+// stable merge sort of data[0..len) using tmp[0..len/2)
+template <typename Less> static void mergeSort(TValue *data, TValue *tmp, int len, Less &less) {
+    if (len <= 8) {
+        insertionSort(data, len, less);
+        return;
+    }
+    int mid = len >> 1;
+    mergeSort(data, tmp, mid, less);
+    mergeSort(data + mid, tmp, len - mid, less);
+    // already in order
+    if (!less(data[mid], data[mid - 1]))
+        return;
+    memcpy(tmp, data, mid * sizeof(TValue));
+    int i = 0, j = mid, k = 0;
+    while (i < mid && j < len) {
+        if (less(data[j], tmp[i]))
+            data[k++] = data[j++];
+        else
+            data[k++] = tmp[i++];
+    }
+    while (i < mid)
+        data[k++] = tmp[i++];
+}
+
+#ifndef PXT_VM
+struct CompareLess {
+    Action cmp;
+    bool operator()(TValue a, TValue b) { return toDouble(runAction2(cmp, a, b)) < 0; }
+};
+#endif
+
+/**
+ * Sort the collection in place. Returns false if comparator-based sorting isn't supported
+ * natively, in which case the array is left alone.
+ */
+/**
+ * Join the elements of the array into a string, with separator between them; undefined and null
+ * elements are left empty, as by join(). The size of the result is worked out first, so that
+ * it's allocated once.
+ */
+//%
+String joinWith(RefCollection *c, String separator) {
+    int n = c->length();
+    if (n == 0)
+        return (String)emptyString;
+
+    // elements that aren't strings are converted up front, and kept here while converting more
+    RefCollection *conv = NULL;
+    for (int i = 0; i < n; ++i) {
+        auto v = c->getAt(i);
+        if (!v || v == TAG_NULL || valType(v) == ValType::String)
+            continue;
+        if (!conv) {
+            conv = mk();
+            registerGCObj(conv);
+            conv->setLength(n);
+        }
+        setAt(conv, i, (TValue)numops::toString(v));
+    }
+
+    auto sepLen = separator ? (int)separator->getUTF8Size() : 0;
+    auto sepData = sepLen ? separator->getUTF8Data() : NULL;
+    int total = sepLen * (n - 1);
+    for (int i = 0; i < n; ++i) {
+        auto v = conv && conv->getAt(i) ? conv->getAt(i) : c->getAt(i);
+        if (v && v != TAG_NULL)
+            total += ((String)v)->getUTF8Size();
+    }
+
+    auto buf = (char *)xmalloc(total + 1);
+    auto dst = buf;
+    for (int i = 0; i < n; ++i) {
+        if (i && sepLen) {
+            memcpy(dst, sepData, sepLen);
+            dst += sepLen;
+        }
+        auto v = conv && conv->getAt(i) ? conv->getAt(i) : c->getAt(i);
+        if (v && v != TAG_NULL) {
+            auto str = (String)v;
+            auto sz = str->getUTF8Size();
+            memcpy(dst, str->getUTF8Data(), sz);
+            dst += sz;
+        }
+    }
+    auto r = mkStringCore(buf, total);
+    xfree(buf);
+    if (conv)
+        unregisterGCObj(conv);
+    return r;
+}
+
+bool sort(RefCollection *c, Action cmp) {
+    auto len = (int)c->length();
+    if (len < 2)
+        return true;
+
+    if (cmp) {
+#ifdef PXT_VM
+        // the VM can't call back into user code from a native
+        return false;
+#else
+        // the comparator can run arbitrary code, including GC and changes to the array being
+        // sorted, so the elements are sorted in a separate, GC-rooted collection
+        auto work = mk();
+        registerGCObj(work);
+        work->setLength(len + len / 2);
+        for (int i = 0; i < len; ++i)
+            work->head.set(i, c->getAt(i));
+        auto data = work->getData();
+        CompareLess less = {cmp};
+        mergeSort(data, data + len, len, less);
+        // the comparator might have resized the array
+        len = min(len, (int)c->length());
+        for (int i = 0; i < len; ++i)
+            c->head.set(i, data[i]);
+        unregisterGCObj(work);
+        return true;
+#endif
+    }
+
+    auto data = c->getData();
+    bool allInts = true, allStrings = true;
+    for (int i = 0; i < len; ++i) {
+        if (!isInt(data[i]))
+            allInts = false;
+        if (valType(data[i]) != ValType::String)
+            allStrings = false;
+    }
+
+    // no user code runs below, so the elements can be sorted in place
+    if (allInts)
+        introSort(data, len, IntLess());
+    else if (allStrings)
+        introSort(data, len, StringLess());
+    else {
+        // objects of rank 3 compare equal, and keep their order only with a stable sort
+        auto tmp = (TValue *)xmalloc((len / 2) * sizeof(TValue));
+        DefaultLess less;
+        mergeSort(data, tmp, len, less);
+        xfree(tmp);
+    }
+    return true;
+}
 } // namespace Array_
 
 namespace pxt {
-int debugFlags;
+/**
+ * Sort the array in place, using `cmp` if given; returns false if it has to be done in
+ * TypeScript instead.
+ */
+//% expose
+bool sortArray(RefCollection *arr, Action cmp) {
+    return Array_::sort(arr, cmp);
+}
+
+PXT_TLS int debugFlags;
 
 //%
 void *ptrOfLiteral(int offset);
@@ -1497,40 +2679,89 @@ void deepSleep() __attribute__((weak));
 //%
 void deepSleep() {}
 
+void setLowPowerIdle(bool enabled) __attribute__((weak));
+//%
+void setLowPowerIdle(bool enabled) {}
+
+int getFiberStats(FiberStats *dest, int max) __attribute__((weak));
+int getFiberStats(FiberStats *dest, int max) {
+    return 0;
+}
+
 int *getBootloaderConfigData() __attribute__((weak));
 int *getBootloaderConfigData() {
     return NULL;
 }
 
-//%
-int getConfig(int key, int defl) {
-#ifdef PXT_VM
-    int *cfgData = vmImg->configData;
-#else
-    int *cfgData = bytecode ? *(int **)&bytecode[18] : NULL;
-#endif
+// A config table is pairs of keys and values ending with key 0. They are usually sorted by key, and
+// then binary searched; an unsorted one still works, just slower. Whether a table is sorted is
+// found once; the tables don't change, but under the VM a new program brings a new one.
+struct ConfigTable {
+    int *data;
+    int len; // pairs, without the terminating one
+    bool sorted;
+};
+static ConfigTable programConfig, bootloaderConfig;
 
-    if (cfgData) {
-        for (int i = 0;; i += 2) {
-            if (cfgData[i] == key)
-                return cfgData[i + 1];
-            if (cfgData[i] == 0)
-                break;
-        }
+static void setConfigTable(ConfigTable &t, int *data) {
+    if (t.data == data)
+        return;
+    t.data = data;
+    t.len = 0;
+    t.sorted = true;
+    if (!data)
+        return;
+    for (int i = 0; data[2 * i] != 0; ++i) {
+        if (i > 0 && (unsigned)data[2 * i] <= (unsigned)data[2 * i - 2])
+            t.sorted = false;
+        t.len++;
     }
+}
 
-    cfgData = getBootloaderConfigData();
+static int *findConfig(ConfigTable &t, int key) {
+    if (!t.data)
+        return NULL;
+    if (!t.sorted) {
+        for (int i = 0; i < t.len; ++i)
+            if (t.data[2 * i] == key)
+                return &t.data[2 * i + 1];
+        return NULL;
+    }
+    int l = 0, r = t.len - 1;
+    while (l <= r) {
+        int m = (l + r) >> 1;
+        auto k = (unsigned)t.data[2 * m];
+        if (k == (unsigned)key)
+            return &t.data[2 * m + 1];
+        if (k < (unsigned)key)
+            l = m + 1;
+        else
+            r = m - 1;
+    }
+    return NULL;
+}
 
-    if (cfgData) {
-        for (int i = 0;; i += 2) {
-            if (cfgData[i] == key)
-                return cfgData[i + 1];
-            if (cfgData[i] == 0)
-                break;
-        }
+bool lookupConfig(int key, int *value) {
+#ifdef PXT_VM
+    setConfigTable(programConfig, vmImg->configData);
+#else
+    setConfigTable(programConfig, bytecode ? *(int **)&bytecode[18] : NULL);
+#endif
+    auto v = findConfig(programConfig, key);
+    if (!v) {
+        setConfigTable(bootloaderConfig, getBootloaderConfigData());
+        v = findConfig(bootloaderConfig, key);
     }
+    if (!v)
+        return false;
+    *value = *v;
+    return true;
+}
 
-    return defl;
+//%
+int getConfig(int key, int defl) {
+    int v;
+    return lookupConfig(key, &v) ? v : defl;
 }
 
 } // namespace pxt
@@ -1543,6 +2774,7 @@ TValue ldlocRef(RefRefLocal *r) {
 
 //%
 void stlocRef(RefRefLocal *r, TValue v) {
+    gcWriteBarrier(r, v);
     r->v = v;
 }
 
@@ -1584,7 +2816,12 @@ int ptrToBool(TValue p) {
 }
 
 RefMap *mkMap() {
+    if (!emptyMapShape) {
+        emptyMapShape = (MapShape *)app_alloc(sizeof(MapShape));
+        memset(emptyMapShape, 0, sizeof(MapShape));
+    }
     auto r = NEW_GC(RefMap);
+    r->shape = emptyMapShape;
     MEMDBG("mkMap: => %p", r);
     return r;
 }
@@ -1634,6 +2871,32 @@ int lookupMapKey(String key) {
     return 0;
 }
 
+int lookupMapKeyData(const char *data, unsigned len) {
+    auto arr = IFACE_MEMBER_NAMES;
+    int l = 1U;
+    int r = (int)*arr++ - 1;
+    while (l <= r) {
+        int m = (l + r) >> 1;
+        auto key = (String)arr[m];
+        auto keyLen = key->getUTF8Size();
+        // same order as String_::compare()
+        int cmp = memcmp(key->getUTF8Data(), data, min(keyLen, len));
+        if (cmp == 0)
+            cmp = keyLen == len ? 0 : keyLen < len ? -1 : 1;
+        if (cmp == 0)
+            return m;
+        else if (cmp < 0)
+            l = m + 1;
+        else
+            r = m - 1;
+    }
+    return 0;
+}
+
+String mapKeyName(int key) {
+    return ((String *)IFACE_MEMBER_NAMES)[key + 1];
+}
+
 TValue mapGet(RefMap *map, unsigned key) {
     auto arr = (String *)IFACE_MEMBER_NAMES;
     auto r = mapGetByString(map, arr[key + 1]);
@@ -1644,8 +2907,22 @@ TValue mapGet(RefMap *map, unsigned key) {
 void mapSetByString(RefMap *map, String key, TValue val) {
     int i = map->findIdx(key);
     if (i < 0) {
+        // so that lookups with the interned key, or with the literal, compare pointers; a key
+        // equal to a property name becomes the literal, which keeps the map's shape
+        if (!isReadOnly((TValue)key))
+            key = gcInternString(key);
+        if (map->shape) {
+            auto next = map->shape->withKey(key);
+            if (next) {
+                map->values.push(val);
+                map->shape = next;
+                return;
+            }
+            map->toDictionary();
+        }
         map->keys.push((TValue)key);
         map->values.push(val);
+        map->keyAdded();
     } else {
         map->values.set(i, val);
     }
@@ -1794,47 +3071,41 @@ static void dtorDoNothing() {}
                (void *)&name##_gcscan, (void *)&name##_gcsize, (void *)&name##_data,               \
                (void *)&name##_utfsize, (void *)&name##_length, (void *)&name##_dataAt)
 
-void gcMarkArray(void *data);
-void gcScan(TValue v);
+void gcMarkArrayField(void *field);
+void gcScanField(TValue *field);
 
 #if PXT_UTF8
 static const char *skipLookup(BoxedString *p, uint32_t idx) {
     if (idx > p->skip.length)
         return NULL;
-    auto ent = idx / SKIP_INCR;
-    auto data = SKIP_DATA(p);
+    auto incr = skipIncr(p);
+    auto ent = idx / incr;
+    auto data = (const char *)(p->skip.list + p->skip.length / incr);
     auto size = p->skip.size;
+    uint32_t off = 0, skip = idx;
     if (ent) {
-        auto off = p->skip.list[ent - 1];
-        data += off;
-        size -= off;
-        idx &= SKIP_INCR - 1;
+        off = p->skip.list[ent - 1];
+        skip = idx & (incr - 1);
     }
-    return utf8Skip(data, size, idx);
-}
-
-extern LLSegment workQueue;
-
-static uint32_t fixSize(BoxedString *p, uint32_t *len) {
-    uint32_t tlen = 0;
-    uint32_t sz = 0;
-    if (workQueue.getLength())
-        oops(81);
-    workQueue.push((TValue)p);
-    while (workQueue.getLength()) {
-        p = (BoxedString *)workQueue.pop();
-        if (IS_CONS(p)) {
-            workQueue.push((TValue)p->cons.right);
-            workQueue.push((TValue)p->cons.left);
-        } else {
-            tlen += p->getLength();
-            sz += p->getUTF8Size();
-        }
+    if (isReadOnly((TValue)p))
+        return utf8Skip(data + off, size - off, skip);
+
+    // in sequential scans the cursor is usually just behind idx
+    auto cursor = SKIP_CURSOR(p, data);
+    if (cursor[0] <= idx && idx - cursor[0] < skip) {
+        off = cursor[1];
+        skip = idx - cursor[0];
     }
-    *len = tlen;
-    return sz;
+    auto res = utf8Skip(data + off, size - off, skip);
+    if (res) {
+        cursor[0] = idx;
+        cursor[1] = res - data;
+    }
+    return res;
 }
 
+static PXT_TLS LLSegment workQueue;
+
 static void fixCopy(BoxedString *p, char *dst) {
     if (workQueue.getLength())
         oops(81);
@@ -1853,22 +3124,25 @@ static void fixCopy(BoxedString *p, char *dst) {
     }
 }
 
+extern const VTable string_flatcons_vt;
+
 // switches CONS representation into skip list representation
 // does not switch representation of CONS' children
 static void fixCons(BoxedString *r) {
-    uint32_t length = 0;
-    auto sz = fixSize(r, &length);
-    auto numSkips = length / SKIP_INCR;
+    uint32_t length = r->cons.length;
+    uint32_t sz = r->cons.size;
+    auto numSkips = length / skipIncrFor(sz, length);
     // allocate first, while [r] still holds references to its children
     // because allocation might trigger GC
-    auto data = (uint16_t *)gcAllocateArray(numSkips * 2 + sz + 1);
+    auto data = (uint16_t *)gcAllocateArray(SKIP_ARRAY_BYTES(numSkips, sz));
     // copy, while [r] is still cons
     fixCopy(r, (char *)(data + numSkips));
     // now, set [r] up properly
-    r->vtable = PXT_VTABLE_TO_INT(&string_skiplist16_vt);
+    r->vtable = PXT_VTABLE_TO_INT(&string_flatcons_vt);
     r->skip.size = sz;
     r->skip.length = length;
     r->skip.list = data;
+    gcRememberObject(r);
     setupSkipList(r, NULL);
 }
 #endif
@@ -1878,10 +3152,38 @@ STRING_VT(string_inline_ascii, NOOP, NOOP, 2 + p->ascii.length + 1, p->ascii.dat
 #if PXT_UTF8
 STRING_VT(string_inline_utf8, NOOP, NOOP, 2 + p->utf8.length + 1, p->utf8.data, p->utf8.length,
           utf8Len(p->utf8.data, p->utf8.length), utf8Skip(p->utf8.data, p->utf8.length, idx))
-STRING_VT(string_skiplist16, NOOP, if (p->skip.list) gcMarkArray(p->skip.list), 2 * sizeof(void *),
+STRING_VT(string_skiplist16, NOOP, if (p->skip.list) gcMarkArrayField(&p->skip.list), 2 * sizeof(void *),
           SKIP_DATA(p), p->skip.size, p->skip.length, skipLookup(p, idx))
-STRING_VT(string_cons, fixCons(p), (gcScan((TValue)p->cons.left), gcScan((TValue)p->cons.right)),
-          2 * sizeof(void *), SKIP_DATA(p), p->skip.size, p->skip.length, skipLookup(p, idx))
+// once flattened, cons strings look like skip list ones, but they are one word longer
+STRING_VT(string_flatcons, NOOP, if (p->skip.list) gcMarkArrayField(&p->skip.list), 3 * sizeof(void *),
+          SKIP_DATA(p), p->skip.size, p->skip.length, skipLookup(p, idx))
+
+// not using STRING_VT(), as the size and length are known without flattening
+static uint32_t string_cons_gcsize(BoxedString *p) {
+    return TOWORDS(CONS_BYTES);
+}
+static void string_cons_gcscan(BoxedString *p) {
+    gcScanField((TValue *)&p->cons.left);
+    gcScanField((TValue *)&p->cons.right);
+}
+static const char *string_cons_data(BoxedString *p) {
+    fixCons(p);
+    return SKIP_DATA(p);
+}
+static uint32_t string_cons_utfsize(BoxedString *p) {
+    return p->cons.size;
+}
+static uint32_t string_cons_length(BoxedString *p) {
+    return p->cons.length;
+}
+static const char *string_cons_dataAt(BoxedString *p, uint32_t idx) {
+    fixCons(p);
+    return skipLookup(p, idx);
+}
+DEF_VTABLE(string_cons_vt, BoxedString, ValType::String, (void *)&dtorDoNothing, (void *)&anyPrint,
+           (void *)&string_cons_gcscan, (void *)&string_cons_gcsize, (void *)&string_cons_data,
+           (void *)&string_cons_utfsize, (void *)&string_cons_length,
+           (void *)&string_cons_dataAt)
 #endif
 
 PRIM_VTABLE(number, ValType::Number, BoxedNumber, 0)
@@ -1909,7 +3211,7 @@ void missingProperty(TValue v) {
 }
 
 #ifdef PXT_PROFILE
-struct PerfCounter *perfCounters;
+PXT_TLS struct PerfCounter *perfCounters;
 
 struct PerfCounterInfo {
     uint32_t numPerfCounters;
@@ -1954,6 +3256,40 @@ void stopPerfCounter(PerfCounters n) {
 }
 #endif
 
+#ifdef PXT_TRACE
+static TraceRecord traceRing[PXT_TRACE_SIZE];
+static uint32_t traceNext; // free running
+
+void traceEvent(int event, uint32_t arg0, uint32_t arg1) {
+    // events come from interrupts and other threads too; claim a slot without locking
+#ifdef __ARM_ARCH_6M__
+    // no atomic instructions on the M0
+    target_disable_irq();
+    uint32_t idx = traceNext++;
+    target_enable_irq();
+#else
+    uint32_t idx = __atomic_fetch_add(&traceNext, 1, __ATOMIC_RELAXED);
+#endif
+    auto r = &traceRing[idx & (PXT_TRACE_SIZE - 1)];
+    r->time = (uint32_t)current_time_us();
+    r->event = event;
+    r->arg0 = arg0;
+    r->arg1 = arg1;
+}
+
+int traceRead(uint8_t *dst, int maxSize) {
+    uint32_t end = __atomic_load_n(&traceNext, __ATOMIC_RELAXED);
+    uint32_t num = end < PXT_TRACE_SIZE ? end : PXT_TRACE_SIZE;
+    if (num > maxSize / sizeof(TraceRecord))
+        num = maxSize / sizeof(TraceRecord);
+    // the records being written as this runs may come out torn; it's a trace
+    for (uint32_t i = 0; i < num; ++i)
+        memcpy(dst + i * sizeof(TraceRecord), &traceRing[(end - num + i) & (PXT_TRACE_SIZE - 1)],
+               sizeof(TraceRecord));
+    return num * sizeof(TraceRecord);
+}
+#endif
+
 // Exceptions
 
 #ifndef PXT_EXN_CTX
@@ -1965,10 +3301,26 @@ typedef void (*RestoreStateType)(TryFrame *, ThreadContext *);
 #define pxt_restore_exception_state ((RestoreStateType)(((uintptr_t *)bytecode)[14]))
 #endif
 
+static void freeTryFrame(TryFrame *f) {
+    if (numSpareTryFrames < MAX_SPARE_TRY_FRAMES) {
+        f->parent = spareTryFrames;
+        spareTryFrames = f;
+        numSpareTryFrames++;
+    } else {
+        app_free(f);
+    }
+}
+
 //%
 TryFrame *beginTry() {
     auto ctx = PXT_EXN_CTX();
-    auto frame = (TryFrame *)app_alloc(sizeof(TryFrame));
+    auto frame = spareTryFrames;
+    if (frame) {
+        spareTryFrames = frame->parent;
+        numSpareTryFrames--;
+    } else {
+        frame = (TryFrame *)app_alloc(sizeof(TryFrame));
+    }
     frame->parent = ctx->tryFrame;
     ctx->tryFrame = frame;
     return frame;
@@ -1981,7 +3333,7 @@ void endTry() {
     if (!f)
         oops(51);
     ctx->tryFrame = f->parent;
-    app_free(f);
+    freeTryFrame(f);
 }
 
 //% expose
@@ -1995,7 +3347,7 @@ void throwValue(TValue v) {
     }
     ctx->tryFrame = f->parent;
     TryFrame copy = *f;
-    app_free(f);
+    freeTryFrame(f);
     ctx->thrownValue = v;
     pxt_restore_exception_state(&copy, ctx);
 }
@@ -3,6 +3,8 @@ namespace control {
      * Run code when a registered event happens.
      * @param id the event compoent id
      * @param value the event value to match
+     * @param flags how the handler is run; on CODAL devices, adding 256 queues the events for a
+     *      single fiber that runs the handler, instead of a fiber per event
      */
     //% weight=20 blockGap=8 blockId="control_on_event" block="on event|from %src|with value %value"
     //% blockExternalInputs=1
@@ -8,6 +8,33 @@
 #define GC_MAX_ALLOC_SIZE (GC_BLOCK_SIZE - 16)
 #endif
 
+#ifndef GC_GET_HEAP_SIZE
+// hosted targets keep big objects outside of the GC blocks, see LargeObject
+#define GC_LARGE_SPACE 1
+#endif
+
+#ifndef GC_LARGE_OBJECT_SIZE
+#ifdef GC_LARGE_SPACE
+#define GC_LARGE_OBJECT_SIZE (GC_BLOCK_SIZE / 2)
+#else
+#define GC_LARGE_OBJECT_SIZE 2048
+#endif
+#endif
+
+#ifdef GC_LARGE_SPACE
+#ifndef GC_MAX_LARGE_ALLOC_SIZE
+#define GC_MAX_LARGE_ALLOC_SIZE (64 * 1024 * 1024)
+#endif
+#define GC_LARGE_PAGE_SIZE 4096
+// allocate at least that much in the large-object space before collecting to make room there
+#define GC_LARGE_MIN_BYTES_BEFORE_GC (256 * 1024)
+#endif
+
+#ifndef GC_BUMP_REGION_SIZE
+// size of the regions class instances are bump-allocated from
+#define GC_BUMP_REGION_SIZE 512
+#endif
+
 #ifndef GC_ALLOC_BLOCK
 #define GC_ALLOC_BLOCK xmalloc
 #endif
@@ -46,6 +73,9 @@
 #endif
 //#define PXT_GC_STRESS 1
 
+// keep a log of the last few collections; see getGCTelemetry()
+//#define PXT_GC_TELEMETRY 1
+
 //#define PXT_GC_CHECKS 1
 
 #define MARK(v)                                                                                    \
@@ -64,6 +94,75 @@
 #define VVLOG NOLOG
 #endif
 
+#ifdef PXT_GC_NURSERY
+#ifndef PXT_VM
+// native code generators store object fields directly, without write barriers
+#error "PXT_GC_NURSERY is only supported in the VM"
+#endif
+#ifndef PXT_GC_NURSERY_SIZE
+#define PXT_GC_NURSERY_SIZE (256 * 1024)
+#endif
+// objects bigger than this go directly to the main heap
+#define NURSERY_MAX_ALLOC_WORDS BYTES_TO_WORDS(PXT_GC_NURSERY_SIZE / 16)
+// past this many remembered entries, the next collection is a full one
+#define REMEMBERED_SET_MAX 4096
+#define REMEMBERED_ARRAY 1
+#define REMEMBERED_SEGMENT 2
+// internal flag for gc()
+#define GC_MINOR 0x100
+#endif
+
+#ifdef PXT_GC_INCREMENTAL
+#ifndef PXT_VM
+#error "PXT_GC_INCREMENTAL is only supported in the VM"
+#endif
+#ifdef PXT_GC_NURSERY
+#error "PXT_GC_INCREMENTAL and PXT_GC_NURSERY cannot be used together"
+#endif
+// how many objects to scan between checking the time
+#define INCREMENTAL_CHECK_INTERVAL 64
+#endif
+
+#ifdef PXT_GC_COMPACT
+#if defined(PXT_VM) || defined(PXT_GC_PARALLEL)
+#error "PXT_GC_COMPACT is only supported in native builds, without PXT_GC_PARALLEL"
+#endif
+// while compacting, see gcCompact(): objects that stay in place have both mark bits set,
+// and headers with only the second one point at the fields threaded onto the object
+#define PINNED_MASK 0x2
+#define IS_THREADED(vt) (((uintptr_t)(vt)&ANY_MARKED_MASK) == PINNED_MASK)
+#define IS_PINNED(vt) (((uintptr_t)(vt)&ANY_MARKED_MASK) == ANY_MARKED_MASK)
+// set on arrays holding values, which are scanned through their owners otherwise
+#define VALUES_MASK (1ULL << HIGH_SHIFT)
+// what the scan methods do while compacting
+#define COMPACT_MARK 1
+#define COMPACT_PIN 2
+#define COMPACT_THREAD 3
+#endif
+
+#ifdef PXT_GC_PARALLEL
+#if !defined(PXT_VM) && !defined(PXT_GC_THREAD_LIST)
+#error "PXT_GC_PARALLEL is only supported on Linux and in the VM"
+#endif
+#if defined(PXT_GC_NURSERY) || defined(PXT_GC_INCREMENTAL)
+#error "PXT_GC_PARALLEL cannot be used with PXT_GC_NURSERY or PXT_GC_INCREMENTAL"
+#endif
+#ifdef PXT_VM_MULTI
+// the workers would see their own (empty) copies of the thread-local heap state
+#error "PXT_GC_PARALLEL cannot be used with PXT_VM_MULTI"
+#endif
+#ifndef PXT_GC_THREADS
+#define PXT_GC_THREADS 4
+#endif
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(PXT_GC_NURSERY) || defined(PXT_GC_INCREMENTAL)
+// objects may be scanned again after they have been marked
+#define GC_RESCAN 1
+#endif
+
 #ifdef PXT_GC_CHECKS
 #define GC_CHECK(cond, code)                                                                       \
     if (!(cond))                                                                                   \
@@ -82,15 +181,120 @@ struct GCStats {
     uint32_t lastFreeBytes;
     uint32_t lastMaxBlockBytes;
     uint32_t minFreeBytes;
+    uint32_t numMinorGC;
+    uint32_t maxPauseUs;
+    uint32_t meanPauseUs;
+    // fromDouble() results found in / missing from the boxed number cache
+    uint32_t boxCacheHits;
+    uint32_t boxCacheMisses;
+};
+
+static PXT_TLS GCStats gcStats;
+
+#ifdef PXT_GC_TELEMETRY
+#ifndef PXT_GC_TELEMETRY_SIZE
+#define PXT_GC_TELEMETRY_SIZE 16
+#endif
+// arrays, then BuiltInType::BoxedString...MMap, then all user classes
+#define GC_TELEMETRY_TYPES 12
+#define GC_TELEMETRY_MINOR 1
+
+// keep in sync with base/gcstats.ts, function gcTelemetry()
+struct GCRecord {
+    uint32_t timeMs;
+    uint32_t pauseUs;
+    uint32_t flags;
+    uint32_t usedBytesBefore;
+    uint32_t usedBytesAfter;
+    uint32_t freeBytes;
+    uint32_t maxFreeBlockBytes;
+    uint32_t numPendingArrays;
+    uint32_t liveObjects[GC_TELEMETRY_TYPES];
+    uint32_t liveBytes[GC_TELEMETRY_TYPES];
 };
 
-static GCStats gcStats;
+static PXT_TLS GCRecord *gcTelemetry;
+static PXT_TLS uint32_t numGCRecords; // total, the ring only keeps PXT_GC_TELEMETRY_SIZE last ones
+static PXT_TLS GCRecord currRecord;
+static PXT_TLS uint32_t lastUsedBytes;
+static PXT_TLS uint32_t allocatedSinceGC;
+
+static inline unsigned telemetryType(uintptr_t vt) {
+    if (IS_VAR_BLOCK(vt))
+        return 0;
+    auto cls = (unsigned)((VTable *)vt)->classNo;
+    if (cls > (unsigned)BuiltInType::MMap)
+        return GC_TELEMETRY_TYPES - 1;
+    return cls;
+}
+#endif
+static PXT_TLS uint64_t totalPauseUs;
+static PXT_TLS uint32_t numPauses;
+
+static void recordPause(uint64_t startTime) {
+    auto len = (uint32_t)(current_time_us() - startTime);
+    if (len > gcStats.maxPauseUs)
+        gcStats.maxPauseUs = len;
+    totalPauseUs += len;
+    numPauses++;
+    gcStats.meanPauseUs = (uint32_t)(totalPauseUs / numPauses);
+}
+
+uint64_t gcPauseTotalUs() {
+    return totalPauseUs;
+}
 
 //% expose
 Buffer getGCStats() {
+#if !defined(PXT64) && PXT_BOX_CACHE
+    gcStats.boxCacheHits = boxCacheStats.hits;
+    gcStats.boxCacheMisses = boxCacheStats.misses;
+#endif
     return mkBuffer((uint8_t *)&gcStats, sizeof(gcStats));
 }
 
+/**
+ * Get records of recent collections, oldest first, or NULL if not compiled in.
+ */
+//% expose
+Buffer getGCTelemetry() {
+#ifdef PXT_GC_TELEMETRY
+    auto num = min(numGCRecords, (uint32_t)PXT_GC_TELEMETRY_SIZE);
+    auto res = mkBuffer(NULL, num * sizeof(GCRecord));
+    auto dst = (GCRecord *)res->data;
+    for (unsigned i = 0; i < num; ++i)
+        dst[i] = gcTelemetry[(numGCRecords - num + i) % PXT_GC_TELEMETRY_SIZE];
+    return res;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Print records of recent collections to DMESG.
+ */
+//% expose
+void dumpGCTelemetry() {
+#ifdef PXT_GC_TELEMETRY
+    static const char *typeNames[GC_TELEMETRY_TYPES] = {
+        "data", "string", "number", "buffer", "function", "image",
+        "array", "reflocal", "map", "mimage", "mmap", "user"};
+    auto num = min(numGCRecords, (uint32_t)PXT_GC_TELEMETRY_SIZE);
+    for (unsigned i = 0; i < num; ++i) {
+        auto idx = numGCRecords - num + i;
+        auto r = &gcTelemetry[idx % PXT_GC_TELEMETRY_SIZE];
+        DMESG("GC #%d%s @%dms: %dus, used %d -> %d, %d free, %d max block, %d pending arrays",
+              idx, r->flags & GC_TELEMETRY_MINOR ? " (minor)" : "", r->timeMs, r->pauseUs,
+              r->usedBytesBefore, r->usedBytesAfter, r->freeBytes, r->maxFreeBlockBytes,
+              r->numPendingArrays);
+        for (unsigned j = 0; j < GC_TELEMETRY_TYPES; ++j)
+            if (r->liveObjects[j])
+                DMESG("  %s: %d objects, %d bytes", typeNames[j], r->liveObjects[j],
+                      r->liveBytes[j]);
+    }
+#endif
+}
+
 //%
 void popThreadContext(ThreadContext *ctx);
 //%
@@ -108,14 +312,13 @@ ThreadContext *threadContexts;
 #define IN_GC_ALLOC 1
 #define IN_GC_COLLECT 2
 #define IN_GC_FREEZE 4
-#define IN_GC_PREALLOC 8
 
 #ifndef PXT_VM
 static TValue *tempRoot;
 static uint8_t tempRootLen;
 #endif
 
-uint8_t inGC;
+PXT_TLS uint8_t inGC;
 
 void popThreadContext(ThreadContext *ctx) {
 #ifndef PXT_VM
@@ -217,6 +420,21 @@ struct GCBlock {
     RefObject data[0];
 };
 
+#ifdef GC_LARGE_SPACE
+// Objects bigger than GC_LARGE_OBJECT_SIZE, mostly buffers and images, each get a run of pages of
+// their own, so that they don't fragment the blocks, and sweepLarge() goes over them without
+// walking their insides. Runs of dead objects are reused best-fit, and like the blocks, never
+// given back to the system.
+struct LargeObject {
+    LargeObject *next;
+    uintptr_t size; // in bytes, with the header
+    RefObject data[0];
+};
+
+static PXT_TLS LargeObject *largeObjects, *largeFree;
+static PXT_TLS uintptr_t largeLiveBytes, largeBytesSinceGC;
+#endif
+
 struct PendingArray {
     PendingArray *next;
     TValue *data;
@@ -225,19 +443,89 @@ struct PendingArray {
 
 #define PENDING_ARRAY_THR 100
 
-static PendingArray *pendingArrays;
-static LLSegment gcRoots;
-LLSegment workQueue; // (ab)used by consString making
-static GCBlock *firstBlock;
-static RefBlock *firstFree;
-static uint8_t *midPtr;
+static PXT_TLS PendingArray *pendingArrays;
+static PXT_TLS LLSegment gcRoots;
+static PXT_TLS LLSegment workQueue;
+static PXT_TLS GCBlock *firstBlock;
+static PXT_TLS RefBlock *firstFree;
+static PXT_TLS uint8_t *midPtr;
+
+#ifndef PXT_GC_NURSERY
+// Class instances (see gcAllocateFixed()) are bump-allocated from a region taken off a free
+// block. Past bumpPtr the region is not walkable; sealBumpRegion() turns the rest into a free
+// block again, before the heap is walked.
+static PXT_TLS uint8_t *bumpPtr, *bumpLimit;
+#endif
+
+// Small free blocks are kept in segregated lists by size class, so that most allocations
+// are just a pop from a list. The classes are 2, 3, 4, 6, 8, 12 and 16 words; the list
+// for a class holds blocks at least that big, but smaller than the next class.
+// Bigger blocks stay in firstFree.
+#define GC_NUM_SIZE_CLASSES 7
+#define GC_MAX_SIZE_CLASS_WORDS 16
+// smallest class that fits given number of words
+static const uint8_t allocSizeClass[GC_MAX_SIZE_CLASS_WORDS + 1] = {0, 0, 0, 1, 2, 3, 3, 4, 4,
+                                                                    5, 5, 5, 5, 6, 6, 6, 6};
+// class a free block of given number of words goes into
+static const uint8_t freeSizeClass[GC_MAX_SIZE_CLASS_WORDS + 1] = {0, 0, 0, 1, 2, 2, 3, 3, 4,
+                                                                   4, 4, 4, 5, 5, 5, 5, 6};
+static PXT_TLS RefBlock *sizeClassFree[GC_NUM_SIZE_CLASSES];
+
+static inline void addSizeClassFree(RefBlock *p, unsigned words) {
+    auto c = freeSizeClass[words];
+    p->nextFree = sizeClassFree[c];
+    sizeClassFree[c] = p;
+}
+
+#ifdef PXT_GC_NURSERY
+// With the nursery, mark bits are sticky - objects which survived a collection stay marked,
+// and are considered old. Minor collections only trace unmarked (young) objects reachable from
+// roots and from the remembered set (old objects written since the last collection),
+// and only sweep the nursery block. Survivors are promoted in place, and new objects are
+// bump-allocated in the holes between them.
+static PXT_TLS GCBlock *nursery;
+static PXT_TLS RefBlock *nurseryFree;
+static PXT_TLS uint8_t *nurseryPtr, *nurseryLimit;
+static PXT_TLS LLSegment rememberedSet;
+static PXT_TLS bool needFullGC;
+// permanent allocations would pin the nursery
+static PXT_TLS bool inAppAlloc;
+#endif
+
+#ifdef PXT_GC_INCREMENTAL
+// In incremental mode, roots are first only marked grey (pushed onto the work queue),
+// and then the queue is drained in time-bounded slices between fiber switches.
+// Stores into objects go through a write barrier which marks the new value grey.
+// Once the queue is empty, the final collection re-scans the roots (which includes
+// stacks, as they do not have barriers) and sweeps.
+static PXT_TLS bool markInProgress;
+static PXT_TLS bool greyRootsOnly;
+static PXT_TLS uint32_t gcSliceUs;
+static PXT_TLS uint32_t bytesSinceGC;
+#endif
+
+#ifdef PXT_GC_COMPACT
+static PXT_TLS uint8_t compactPhase;
+// words of the roots which point into the heap, see pinObjects()
+static PXT_TLS LLSegment pinCandidates;
+#endif
 
 static bool inGCArea(void *ptr) {
+#ifdef GC_IN_AREA
+    return GC_IN_AREA(ptr);
+#else
     for (auto block = firstBlock; block; block = block->next) {
         if ((void *)block->data <= ptr && ptr < (void *)((uint8_t *)block->data + block->blockSize))
             return true;
     }
+#ifdef GC_LARGE_SPACE
+    for (auto p = largeObjects; p; p = p->next) {
+        if ((void *)p->data <= ptr && ptr < (void *)((uint8_t *)p + p->size))
+            return true;
+    }
+#endif
     return false;
+#endif
 }
 
 #define NO_MAGIC(vt) ((VTable *)vt)->magic != VTABLE_MAGIC
@@ -245,28 +533,153 @@ static bool inGCArea(void *ptr) {
 #define SKIP_PROCESSING(p)                                                                         \
     (isReadOnly(p) || (VT(p) & (ANY_MARKED_MASK | ARRAY_MASK)) || NO_MAGIC(VT(p)))
 
+#ifdef PXT_GC_COMPACT
+static void compactRef(void *field, bool inArray) {
+    auto v = *(TValue *)field;
+    if (!isPointer(v) || isReadOnly(v))
+        return;
+    // arrays are pointed at past their header
+    auto hdr = inArray ? (uintptr_t *)v - 1 : (uintptr_t *)v;
+    if (!inGCArea(hdr))
+        return;
+    auto vt = *hdr;
+    if (IS_PINNED(vt))
+        return;
+    if (compactPhase == COMPACT_PIN) {
+        *hdr = vt | MARKED_MASK | PINNED_MASK;
+    } else {
+        // the field gets the header (or the next field on the list), until unthread()
+        *(uintptr_t *)field = vt;
+        *hdr = (uintptr_t)field | PINNED_MASK;
+    }
+}
+
+void gcPin(TValue v) {
+    if (compactPhase == COMPACT_MARK && isPointer(v) && !isReadOnly(v) && inGCArea(v))
+        pinCandidates.push(v);
+}
+#endif
+
 void gcMarkArray(void *data) {
+#ifdef PXT_GC_COMPACT
+    // can't update the pointer
+    GC_CHECK(compactPhase < COMPACT_PIN, 41);
+#endif
     auto segBl = (uintptr_t *)data - 1;
+#ifdef GC_RESCAN
+    // the owner may be scanned again, after the array is already marked
+    if (IS_MARKED(VT(segBl)))
+        return;
+#else
     GC_CHECK(!IS_MARKED(VT(segBl)), 47);
+#endif
     MARK(segBl);
 }
 
+#ifdef PXT_GC_PARALLEL
+// Marking is split between the thread running gc() and PXT_GC_THREADS - 1 helper threads.
+// Every worker has its own deque of grey objects; it takes work from the back of its own,
+// and steals from the front of the other ones when it runs out.
+struct MarkDeque {
+    pthread_mutex_t lock;
+    TValue *data;
+    unsigned head, tail, size;
+};
+
+struct GCWorker {
+    MarkDeque queue;
+    pthread_t thread;
+    unsigned id;
+};
+
+static GCWorker gcWorkers[PXT_GC_THREADS];
+// set while the current thread is marking
+static __thread GCWorker *currWorker;
+
+static void dequePush(MarkDeque *q, TValue v) {
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->size) {
+        if (q->head >= q->size / 2) {
+            q->tail -= q->head;
+            memmove(q->data, q->data + q->head, q->tail * sizeof(TValue));
+            q->head = 0;
+        } else {
+            auto newSize = q->size ? q->size * 2 : 256;
+            auto tmp = (TValue *)xmalloc(newSize * sizeof(TValue));
+            if (q->data)
+                memcpy(tmp, q->data, q->tail * sizeof(TValue));
+            xfree(q->data);
+            q->data = tmp;
+            q->size = newSize;
+        }
+    }
+    q->data[q->tail++] = v;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static TValue dequeTake(MarkDeque *q, bool steal) {
+    TValue r = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->head == q->tail)
+        q->head = q->tail = 0;
+    else if (steal)
+        r = q->data[q->head++];
+    else
+        r = q->data[--q->tail];
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+static inline void markAndQueue(TValue v) {
+    // several threads may get to the same object at once; only one of them gets to scan it
+    if (__atomic_fetch_or((uintptr_t *)v, MARKED_MASK, __ATOMIC_RELAXED) & MARKED_MASK)
+        return;
+    dequePush(&currWorker->queue, v);
+}
+#endif
+
 void gcScan(TValue v) {
+#ifdef PXT_GC_COMPACT
+    // can't update the pointer; see gcScanField()
+    GC_CHECK(compactPhase < COMPACT_PIN, 41);
+#endif
     if (SKIP_PROCESSING(v))
         return;
+#ifdef PXT_GC_PARALLEL
+    if (currWorker) {
+        markAndQueue(v);
+        return;
+    }
+#endif
     MARK(v);
     workQueue.push(v);
 }
 
 void gcScanMany(TValue *data, unsigned len) {
     // VLOG("scan: %p %d", data, len);
+#ifdef PXT_GC_COMPACT
+    if (compactPhase >= COMPACT_PIN) {
+        for (unsigned i = 0; i < len; ++i)
+            compactRef(&data[i], false);
+        return;
+    }
+#endif
     for (unsigned i = 0; i < len; ++i) {
         auto v = data[i];
         // VLOG("psh: %p %d %d", v, isReadOnly(v), (*(uint32_t *)v & 1));
         if (SKIP_PROCESSING(v))
             continue;
+#ifdef PXT_GC_PARALLEL
+        if (currWorker) {
+            markAndQueue(v);
+            continue;
+        }
+#endif
         MARK(v);
         workQueue.push(v);
+#ifndef PXT_GC_INCREMENTAL
+        // the array may be modified before the rest is scanned in incremental mode, so
+        // it has to be done in one go; the VM doesn't really need to save memory here
         if (workQueue.getLength() > PENDING_ARRAY_THR) {
             i++;
             // store rest of the work for later, when we have cleared the queue
@@ -275,8 +688,12 @@ void gcScanMany(TValue *data, unsigned len) {
             pa->data = data + i;
             pa->len = len - i;
             pendingArrays = pa;
+#ifdef PXT_GC_TELEMETRY
+            currRecord.numPendingArrays++;
+#endif
             break;
         }
+#endif
     }
 }
 
@@ -285,26 +702,50 @@ void gcScanSegment(Segment &seg) {
     if (!data)
         return;
     VVLOG("seg %p %d", data, seg.getLength());
+#ifdef PXT_GC_COMPACT
+    if (compactPhase >= COMPACT_PIN) {
+        // the values are done along with the array itself
+        compactRef(seg.dataField(), true);
+        return;
+    }
+    if (compactPhase == COMPACT_MARK && !IS_PERMA(((uintptr_t *)data)[-1]))
+        ((uintptr_t *)data)[-1] |= (uintptr_t)VALUES_MASK;
+#endif
     gcMarkArray(data);
     gcScanMany(data, seg.getLength());
 }
 
+// gcScan(*field), except that when compacting, the field gets updated
+void gcScanField(TValue *field) {
+#ifdef PXT_GC_COMPACT
+    if (compactPhase >= COMPACT_PIN) {
+        compactRef(field, false);
+        return;
+    }
+#endif
+    gcScan(*field);
+}
+
+// same, for gcMarkArray()
+void gcMarkArrayField(void *field) {
+#ifdef PXT_GC_COMPACT
+    if (compactPhase >= COMPACT_PIN) {
+        compactRef(field, true);
+        return;
+    }
+#endif
+    gcMarkArray(*(void **)field);
+}
+
 #define getScanMethod(vt) ((RefObjectMethod)(((VTable *)(vt))->methods[2]))
 #define getSizeMethod(vt) ((RefObjectSizeMethod)(((VTable *)(vt))->methods[3]))
 
-void gcProcess(TValue v) {
-    if (SKIP_PROCESSING(v))
-        return;
-    VVLOG("gcProcess: %p", v);
-    MARK(v);
-    auto scan = getScanMethod(VT(v) & ~ANY_MARKED_MASK);
-    if (scan)
-        scan((RefObject *)v);
+static void gcDrain() {
     for (;;) {
         while (workQueue.getLength()) {
             auto curr = (RefObject *)workQueue.pop();
             VVLOG(" - %p", curr);
-            scan = getScanMethod(curr->vtable & ~ANY_MARKED_MASK);
+            auto scan = getScanMethod(curr->vtable & ~ANY_MARKED_MASK);
             if (scan)
                 scan(curr);
         }
@@ -321,6 +762,145 @@ void gcProcess(TValue v) {
     }
 }
 
+void gcProcess(TValue v) {
+#ifdef PXT_GC_PARALLEL
+    // roots are only queued; the workers then do the scanning
+    if (currWorker) {
+        gcScan(v);
+        return;
+    }
+#endif
+#ifdef PXT_GC_INCREMENTAL
+    if (greyRootsOnly) {
+        gcScan(v);
+        return;
+    }
+#endif
+#ifdef PXT_GC_COMPACT
+    gcPin(v);
+#endif
+    if (SKIP_PROCESSING(v))
+        return;
+    VVLOG("gcProcess: %p", v);
+    MARK(v);
+    auto scan = getScanMethod(VT(v) & ~ANY_MARKED_MASK);
+    if (scan)
+        scan((RefObject *)v);
+    gcDrain();
+}
+
+void gcProcessMany(TValue *data, unsigned len) {
+#ifdef PXT_GC_COMPACT
+    if (compactPhase == COMPACT_MARK)
+        for (unsigned i = 0; i < len; ++i)
+            gcPin(data[i]);
+#endif
+    // most stack words are numbers or in flash, which SKIP_PROCESSING() rejects before
+    // looking at memory
+    gcScanMany(data, len);
+#ifdef PXT_GC_PARALLEL
+    if (currWorker)
+        return;
+#endif
+#ifdef PXT_GC_INCREMENTAL
+    if (greyRootsOnly)
+        return;
+#endif
+    gcDrain();
+}
+
+#ifdef PXT_GC_NURSERY
+static inline bool isYoung(TValue v) {
+    return isPointer(v) && !isReadOnly(v) && !IS_MARKED(VT(v));
+}
+
+static void gcRemember(void *p, int kind) {
+    auto e = (TValue)((uintptr_t)p | kind);
+    auto len = rememberedSet.getLength();
+    // the same object is often written to many times in a row
+    if (len && rememberedSet.get(len - 1) == e)
+        return;
+    if (len >= REMEMBERED_SET_MAX) {
+        needFullGC = true;
+        return;
+    }
+    rememberedSet.push(e);
+}
+
+void gcWriteBarrier(RefObject *obj, TValue v) {
+    if (IS_MARKED(obj->vtable) && isYoung(v))
+        gcRemember(obj, 0);
+}
+
+void gcWriteBarrierArray(TValue *data, TValue v) {
+    if (IS_MARKED(data[-1]) && isYoung(v))
+        gcRemember(data, REMEMBERED_ARRAY);
+}
+
+void gcRememberObject(RefObject *obj) {
+    if (IS_MARKED(obj->vtable))
+        gcRemember(obj, 0);
+}
+
+void gcRememberSegment(Segment *seg) {
+    // we don't know if the owner of the segment is old, so always remember
+    if (isReadOnly((TValue)seg))
+        return;
+    gcRemember(seg, REMEMBERED_SEGMENT);
+}
+
+static void scanRemembered() {
+    auto len = rememberedSet.getLength();
+    for (unsigned i = 0; i < len; ++i) {
+        auto e = (uintptr_t)rememberedSet.get(i);
+        auto p = (void *)(e & ~3);
+        switch (e & 3) {
+        case REMEMBERED_ARRAY:
+            // the unused part of arrays is zeroed, so we can scan all of it
+            gcScanMany((TValue *)p, VAR_BLOCK_WORDS(((uintptr_t *)p)[-1]) - 1);
+            break;
+        case REMEMBERED_SEGMENT:
+            gcScanSegment(*(Segment *)p);
+            break;
+        default: {
+            auto scan = getScanMethod(VT(p) & ~ANY_MARKED_MASK);
+            if (scan)
+                scan((RefObject *)p);
+            break;
+        }
+        }
+        gcDrain();
+    }
+}
+#endif
+
+#ifdef PXT_GC_INCREMENTAL
+void gcWriteBarrier(RefObject *, TValue v) {
+    if (markInProgress)
+        gcScan(v);
+}
+
+void gcWriteBarrierArray(TValue *, TValue v) {
+    if (markInProgress)
+        gcScan(v);
+}
+
+void gcRememberObject(RefObject *obj) {
+    // if the object is not marked yet, it will be scanned later anyways
+    if (markInProgress && IS_MARKED(obj->vtable)) {
+        auto scan = getScanMethod(obj->vtable & ~ANY_MARKED_MASK);
+        if (scan)
+            scan(obj);
+    }
+}
+
+void gcRememberSegment(Segment *seg) {
+    // the owner may be dead, but then the data is just kept until the next collection
+    if (markInProgress)
+        gcScanSegment(*seg);
+}
+#endif
+
 static void mark(int flags) {
 #ifdef PXT_GC_DEBUG
     flags |= 2;
@@ -346,9 +926,8 @@ static void mark(int flags) {
             auto ptr = (TValue *)threadAddressFor(ctx, seg->top);
             auto end = (TValue *)threadAddressFor(ctx, seg->bottom);
             VLOG("mark: %p - %p", ptr, end);
-            while (ptr < end) {
-                gcProcess(*ptr++);
-            }
+            if (ptr < end)
+                gcProcessMany(ptr, end - ptr);
         }
     }
 #else
@@ -380,6 +959,54 @@ static void mark(int flags) {
 #endif
 }
 
+#ifdef PXT_GC_INCREMENTAL
+static bool drainUntil(uint64_t deadline) {
+    int cnt = 0;
+    while (workQueue.getLength()) {
+        if (++cnt >= INCREMENTAL_CHECK_INTERVAL) {
+            cnt = 0;
+            if (current_time_us() >= deadline)
+                return false;
+        }
+        auto curr = (RefObject *)workQueue.pop();
+        auto scan = getScanMethod(curr->vtable & ~ANY_MARKED_MASK);
+        if (scan)
+            scan(curr);
+    }
+    return true;
+}
+
+void gcIncrementalStep() {
+    if (!gcSliceUs || inGC)
+        return;
+
+    if (!markInProgress) {
+        auto freeBytes = gcStats.lastFreeBytes ? gcStats.lastFreeBytes : gcStats.totalBytes;
+        // the allocator forces a full collection when about half of free memory is used
+        if (bytesSinceGC < freeBytes / 4)
+            return;
+    }
+
+    auto startTime = current_time_us();
+    startPerfCounter(PerfCounters::GC);
+    inGC |= IN_GC_COLLECT;
+    if (!markInProgress) {
+        LOG("GC incremental start");
+        markInProgress = true;
+        greyRootsOnly = true;
+        mark(0);
+        greyRootsOnly = false;
+    }
+    auto done = drainUntil(startTime + gcSliceUs);
+    inGC &= ~IN_GC_COLLECT;
+    stopPerfCounter(PerfCounters::GC);
+    recordPause(startTime);
+
+    if (done)
+        gc(0);
+}
+#endif
+
 static uint32_t getObjectSize(RefObject *o) {
     auto vt = o->vtable & ~ANY_MARKED_MASK;
     uint32_t r;
@@ -484,84 +1111,327 @@ __attribute__((noinline)) static void allocateBlock() {
     linkFreeBlock(curr);
 }
 
-static void sweep(int flags) {
-    RefBlock *prevFreePtr = NULL;
-    uint32_t freeSize = 0;
-    uint32_t totalSize = 0;
-    uint32_t maxFreeBlock = 0;
-    firstFree = NULL;
+#ifdef PXT_GC_NURSERY
+static void sealNursery() {
+    // make sure the heap stays walkable past the bump pointer
+    if (nurseryPtr < nurseryLimit)
+        ((RefObject *)nurseryPtr)->vtable =
+            (BYTES_TO_WORDS(nurseryLimit - nurseryPtr) << 2) | FREE_MASK;
+    nurseryPtr = nurseryLimit = NULL;
+}
 
-    gcStats.numGC++;
+#else
+static void sealBumpRegion() {
+    if (bumpPtr < bumpLimit) {
+        ((RefObject *)bumpPtr)->vtable = (BYTES_TO_WORDS(bumpLimit - bumpPtr) << 2) | FREE_MASK;
+        // the region was counted as allocated as a whole
+#ifdef PXT_GC_INCREMENTAL
+        bytesSinceGC -= bumpLimit - bumpPtr;
+#endif
+#ifdef PXT_GC_TELEMETRY
+        allocatedSinceGC -= bumpLimit - bumpPtr;
+#endif
+    }
+    bumpPtr = bumpLimit = NULL;
+}
+#endif
 
+#ifdef PXT_GC_NURSERY
+static void clearMarks() {
     for (auto h = firstBlock; h; h = h->next) {
         auto d = h->data;
-        auto words = BYTES_TO_WORDS(h->blockSize);
-        auto end = d + words;
-        totalSize += words;
-        VLOG("sweep: %p - %p", d, end);
+        auto end = d + BYTES_TO_WORDS(h->blockSize);
         while (d < end) {
-            if (IS_LIVE(d->vtable)) {
-                VVLOG("Live %p", d);
-                d->vtable &= ~MARKED_MASK;
-                d += getObjectSize(d);
-            } else {
-                auto start = (RefBlock *)d;
-                while (d < end) {
-                    if (IS_FREE(d->vtable)) {
-                        VVLOG("Free %p", d);
-                    } else if (IS_LIVE(d->vtable)) {
-                        break;
-                    } else if (IS_ARRAY(d->vtable)) {
-                        VVLOG("Dead Arr %p", d);
-                    } else {
-                        VVLOG("Dead Obj %p", d);
-                        GC_CHECK(((VTable *)d->vtable)->magic == VTABLE_MAGIC, 41);
-                        d->destroyVT();
-                        VVLOG("destroyed");
-                    }
-                    d += getObjectSize(d);
-                }
-                auto sz = d - (RefObject *)start;
-                freeSize += sz;
-                if (sz > (int)maxFreeBlock)
-                    maxFreeBlock = sz;
-#ifdef PXT_GC_CHECKS
-                memset(start, 0xff, WORDS_TO_BYTES(sz));
-#endif
-                start->vtable = (sz << 2) | FREE_MASK;
-                if (sz > 1) {
-                    start->nextFree = NULL;
-                    if (!prevFreePtr) {
-                        firstFree = start;
-                    } else {
-                        prevFreePtr->nextFree = start;
-                    }
-                    prevFreePtr = start;
-                }
-            }
+            d->vtable &= ~MARKED_MASK;
+            d += getObjectSize(d);
         }
     }
+#ifdef GC_LARGE_SPACE
+    for (auto p = largeObjects; p; p = p->next)
+        p->data[0].vtable &= ~MARKED_MASK;
+#endif
+}
+#endif
 
-    if (midPtr) {
-        uint32_t currFree = 0;
-        auto limit = freeSize * 1 / 2;
-        for (auto p = firstFree; p; p = p->nextFree) {
-            auto len = VAR_BLOCK_WORDS(p->vtable);
-            currFree += len;
-            if (currFree > limit) {
-                midPtr = (uint8_t *)p + ((limit - currFree + len) << 2);
-                break;
-            }
-        }
-    }
+struct SweepState {
+    RefBlock *firstFree, *lastFree;
+    RefBlock *classFree[GC_NUM_SIZE_CLASSES], *classLast[GC_NUM_SIZE_CLASSES];
+#ifdef PXT_GC_NURSERY
+    RefBlock *nurseryFree, *lastNursery;
+#endif
+    uint32_t freeSize, totalSize, maxFreeBlock;
+#ifdef PXT_GC_TELEMETRY
+    uint32_t liveObjects[GC_TELEMETRY_TYPES], liveBytes[GC_TELEMETRY_TYPES];
+#endif
+};
 
-    freeSize = WORDS_TO_BYTES(freeSize);
-    totalSize = WORDS_TO_BYTES(totalSize);
-    maxFreeBlock = WORDS_TO_BYTES(maxFreeBlock);
+static inline void appendFree(RefBlock **first, RefBlock **last, RefBlock *p) {
+    p->nextFree = NULL;
+    if (*last)
+        (*last)->nextFree = p;
+    else
+        *first = p;
+    *last = p;
+}
+
+static inline void appendList(RefBlock **first, RefBlock **last, RefBlock *otherFirst,
+                              RefBlock *otherLast) {
+    if (!otherFirst)
+        return;
+    if (*last)
+        (*last)->nextFree = otherFirst;
+    else
+        *first = otherFirst;
+    *last = otherLast;
+}
+
+static void sweepBlock(GCBlock *h, SweepState &st) {
+    auto d = h->data;
+    auto words = BYTES_TO_WORDS(h->blockSize);
+    auto end = d + words;
+    st.totalSize += words;
+    VLOG("sweep: %p - %p", d, end);
+    while (d < end) {
+        if (IS_LIVE(d->vtable)) {
+            VVLOG("Live %p", d);
+#ifndef PXT_GC_NURSERY
+            // with the nursery, survivors stay marked, which makes them old
+            d->vtable &= ~MARKED_MASK;
+#endif
+#ifdef PXT_GC_TELEMETRY
+            auto t = telemetryType(d->vtable & ~ANY_MARKED_MASK);
+            auto sz = getObjectSize(d);
+            st.liveObjects[t]++;
+            st.liveBytes[t] += WORDS_TO_BYTES(sz);
+            d += sz;
+#else
+            d += getObjectSize(d);
+#endif
+        } else {
+            auto start = (RefBlock *)d;
+            while (d < end) {
+                if (IS_FREE(d->vtable)) {
+                    VVLOG("Free %p", d);
+                } else if (IS_LIVE(d->vtable)) {
+                    break;
+                } else if (IS_ARRAY(d->vtable)) {
+                    VVLOG("Dead Arr %p", d);
+                } else {
+                    VVLOG("Dead Obj %p", d);
+                    GC_CHECK(((VTable *)d->vtable)->magic == VTABLE_MAGIC, 41);
+                    d->destroyVT();
+                    VVLOG("destroyed");
+                }
+                d += getObjectSize(d);
+            }
+            auto sz = d - (RefObject *)start;
+            st.freeSize += sz;
+            if (sz > (int)st.maxFreeBlock)
+                st.maxFreeBlock = sz;
+#ifdef PXT_GC_CHECKS
+            memset(start, 0xff, WORDS_TO_BYTES(sz));
+#endif
+            start->vtable = (sz << 2) | FREE_MASK;
+            if (sz <= 1)
+                continue;
+#ifdef PXT_GC_NURSERY
+            if (h == nursery) {
+                appendFree(&st.nurseryFree, &st.lastNursery, start);
+                continue;
+            }
+#endif
+            if (sz <= GC_MAX_SIZE_CLASS_WORDS) {
+                auto c = freeSizeClass[sz];
+                appendFree(&st.classFree[c], &st.classLast[c], start);
+            } else {
+                appendFree(&st.firstFree, &st.lastFree, start);
+            }
+        }
+    }
+}
+
+#ifdef PXT_GC_PARALLEL
+static void parallelSweep(SweepState &st);
+#endif
+
+#ifdef GC_LARGE_SPACE
+// largeFree is sorted by address, so that neighbouring runs can be merged
+static void freeLarge(LargeObject *p) {
+    LargeObject *prev = NULL, *next = largeFree;
+    while (next && next < p) {
+        prev = next;
+        next = next->next;
+    }
+    if (next && (uint8_t *)p + p->size == (uint8_t *)next) {
+        p->size += next->size;
+        next = next->next;
+    }
+    p->next = next;
+    if (prev && (uint8_t *)prev + prev->size == (uint8_t *)p) {
+        prev->size += p->size;
+        prev->next = next;
+    } else if (prev) {
+        prev->next = p;
+    } else {
+        largeFree = p;
+    }
+}
+
+static void sweepLarge() {
+    largeLiveBytes = 0;
+    largeBytesSinceGC = 0;
+    for (auto pp = &largeObjects; *pp;) {
+        auto p = *pp;
+        auto d = p->data;
+        if (IS_LIVE(d->vtable)) {
+#ifndef PXT_GC_NURSERY
+            d->vtable &= ~MARKED_MASK;
+#endif
+            largeLiveBytes += p->size;
+            pp = &p->next;
+            continue;
+        }
+        if (!IS_FREE(d->vtable) && !IS_ARRAY(d->vtable)) {
+            VVLOG("Dead Large %p", d);
+            GC_CHECK(((VTable *)d->vtable)->magic == VTABLE_MAGIC, 41);
+            d->destroyVT();
+        }
+        *pp = p->next;
+        freeLarge(p);
+    }
+}
+
+static void *allocLarge(size_t numbytes) {
+    uintptr_t size = (numbytes + sizeof(LargeObject) + GC_LARGE_PAGE_SIZE - 1) &
+                     ~(uintptr_t)(GC_LARGE_PAGE_SIZE - 1);
+    LargeObject *p = NULL;
+    for (int i = 0; !p; ++i) {
+        LargeObject **best = NULL;
+        for (auto pp = &largeFree; *pp; pp = &(*pp)->next) {
+            if ((*pp)->size >= size && (!best || (*pp)->size < (*best)->size))
+                best = pp;
+        }
+        if (best) {
+            p = *best;
+            if (p->size > size) {
+                // the rest stays in the same place on the list
+                auto rest = (LargeObject *)((uint8_t *)p + size);
+                rest->size = p->size - size;
+                rest->next = p->next;
+                *best = rest;
+                p->size = size;
+            } else {
+                *best = p->next;
+            }
+        } else if (i == 0 &&
+                   largeBytesSinceGC >= max(largeLiveBytes, (uintptr_t)GC_LARGE_MIN_BYTES_BEFORE_GC)) {
+            // the space has about doubled since the last collection; see what's dead first
+            gc(0);
+        } else {
+            p = (LargeObject *)GC_ALLOC_BLOCK(size);
+            p->size = size;
+            gcStats.totalBytes += size;
+            LOG("GC large %db @ %p", (int)size, p);
+        }
+    }
+    largeBytesSinceGC += p->size;
+    p->next = largeObjects;
+    largeObjects = p;
+    p->data[0].vtable = 0;
+    return p->data;
+}
+#endif
+
+static void sweep(int flags) {
+    SweepState st;
+    memset(&st, 0, sizeof(st));
+
+#ifdef PXT_GC_NURSERY
+    if (flags & GC_MINOR)
+        gcStats.numMinorGC++;
+    else
+#endif
+        gcStats.numGC++;
+
+#ifdef PXT_GC_PARALLEL
+    parallelSweep(st);
+#else
+    for (auto h = firstBlock; h; h = h->next) {
+#ifdef PXT_GC_NURSERY
+        // minor collections leave the old space alone
+        if ((flags & GC_MINOR) && h != nursery)
+            continue;
+#endif
+        sweepBlock(h, st);
+    }
+#endif
+#ifdef GC_LARGE_SPACE
+    sweepLarge();
+#endif
+
+    uint32_t freeSize = st.freeSize;
+    uint32_t totalSize = st.totalSize;
+    uint32_t maxFreeBlock = st.maxFreeBlock;
+
+#ifdef PXT_GC_TELEMETRY
+    currRecord.usedBytesBefore = lastUsedBytes + allocatedSinceGC;
+    currRecord.usedBytesAfter = WORDS_TO_BYTES(totalSize - freeSize);
+    currRecord.freeBytes = WORDS_TO_BYTES(freeSize);
+    currRecord.maxFreeBlockBytes = WORDS_TO_BYTES(maxFreeBlock);
+    memcpy(currRecord.liveObjects, st.liveObjects, sizeof(st.liveObjects));
+    memcpy(currRecord.liveBytes, st.liveBytes, sizeof(st.liveBytes));
+#ifdef PXT_GC_NURSERY
+    if (flags & GC_MINOR)
+        currRecord.flags |= GC_TELEMETRY_MINOR;
+    else
+#endif
+        lastUsedBytes = currRecord.usedBytesAfter;
+    allocatedSinceGC = 0;
+#endif
+
+#ifdef PXT_GC_NURSERY
+    nurseryFree = st.nurseryFree;
+#endif
+
+#ifdef PXT_GC_NURSERY
+    if (flags & GC_MINOR) {
+        freeSize = WORDS_TO_BYTES(freeSize);
+        if (flags & 1)
+            DMESG("GC minor %d free in nursery", freeSize);
+        else
+            LOG("GC minor %d free in nursery", freeSize);
+        return;
+    }
+#endif
+
+    firstFree = st.firstFree;
+    memcpy(sizeClassFree, st.classFree, sizeof(sizeClassFree));
+
+    if (midPtr) {
+        uint32_t currFree = 0;
+        auto limit = freeSize * 1 / 2;
+        for (auto p = firstFree; p; p = p->nextFree) {
+            auto len = VAR_BLOCK_WORDS(p->vtable);
+            currFree += len;
+            if (currFree > limit) {
+                midPtr = (uint8_t *)p + ((limit - currFree + len) << 2);
+                break;
+            }
+        }
+    }
+
+    freeSize = WORDS_TO_BYTES(freeSize);
+    totalSize = WORDS_TO_BYTES(totalSize);
+    maxFreeBlock = WORDS_TO_BYTES(maxFreeBlock);
 
     gcStats.lastFreeBytes = freeSize;
     gcStats.lastMaxBlockBytes = maxFreeBlock;
 
+#ifdef PXT_GC_INCREMENTAL
+    markInProgress = false;
+    bytesSinceGC = 0;
+#endif
+
     if (gcStats.minFreeBytes == 0 || gcStats.minFreeBytes > freeSize)
         gcStats.minFreeBytes = freeSize;
 
@@ -578,18 +1448,500 @@ static void sweep(int flags) {
 #endif
 }
 
+#ifdef PXT_GC_PARALLEL
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t poolDoneCond = PTHREAD_COND_INITIALIZER;
+static bool poolStarted;
+static unsigned poolEpoch, poolRunning;
+static void (*poolTask)(GCWorker *);
+static int numIdleMarkers;
+static GCBlock **sweepBlocks;
+static SweepState *sweepStates;
+static unsigned numSweepBlocks;
+
+static void *gcWorkerMain(void *arg) {
+    auto w = (GCWorker *)arg;
+    unsigned seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&poolLock);
+        while (poolEpoch == seen)
+            pthread_cond_wait(&poolCond, &poolLock);
+        seen = poolEpoch;
+        auto task = poolTask;
+        pthread_mutex_unlock(&poolLock);
+
+        task(w);
+
+        pthread_mutex_lock(&poolLock);
+        if (--poolRunning == 0)
+            pthread_cond_signal(&poolDoneCond);
+        pthread_mutex_unlock(&poolLock);
+    }
+    return NULL;
+}
+
+// runs task() on all workers, including the current thread, and waits for them to finish
+static void runOnWorkers(void (*task)(GCWorker *)) {
+    if (!poolStarted) {
+        poolStarted = true;
+        for (unsigned i = 0; i < PXT_GC_THREADS; ++i) {
+            gcWorkers[i].id = i;
+            pthread_mutex_init(&gcWorkers[i].queue.lock, NULL);
+            if (i > 0)
+                pthread_create(&gcWorkers[i].thread, NULL, gcWorkerMain, &gcWorkers[i]);
+        }
+    }
+
+    pthread_mutex_lock(&poolLock);
+    poolTask = task;
+    poolRunning = PXT_GC_THREADS - 1;
+    poolEpoch++;
+    pthread_cond_broadcast(&poolCond);
+    pthread_mutex_unlock(&poolLock);
+
+    task(&gcWorkers[0]);
+
+    pthread_mutex_lock(&poolLock);
+    while (poolRunning)
+        pthread_cond_wait(&poolDoneCond, &poolLock);
+    pthread_mutex_unlock(&poolLock);
+}
+
+static TValue findWork(GCWorker *w) {
+    auto r = dequeTake(&w->queue, false);
+    for (unsigned i = 1; !r && i < PXT_GC_THREADS; ++i)
+        r = dequeTake(&gcWorkers[(w->id + i) % PXT_GC_THREADS].queue, true);
+    return r;
+}
+
+static bool anyWork() {
+    for (unsigned i = 0; i < PXT_GC_THREADS; ++i) {
+        auto q = &gcWorkers[i].queue;
+        if (__atomic_load_n(&q->tail, __ATOMIC_RELAXED) !=
+            __atomic_load_n(&q->head, __ATOMIC_RELAXED))
+            return true;
+    }
+    return false;
+}
+
+static void markTask(GCWorker *w) {
+    currWorker = w;
+    for (;;) {
+        auto curr = (RefObject *)findWork(w);
+        if (curr) {
+            auto scan = getScanMethod(curr->vtable & ~ANY_MARKED_MASK);
+            if (scan)
+                scan(curr);
+            continue;
+        }
+        // we're done when all workers are out of work at the same time; as long as
+        // some worker is still scanning, it may produce more
+        __atomic_add_fetch(&numIdleMarkers, 1, __ATOMIC_SEQ_CST);
+        for (;;) {
+            if (__atomic_load_n(&numIdleMarkers, __ATOMIC_SEQ_CST) == PXT_GC_THREADS) {
+                currWorker = NULL;
+                return;
+            }
+            if (anyWork()) {
+                __atomic_sub_fetch(&numIdleMarkers, 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+static void parallelMark(int flags) {
+    // roots go to the queue of the first worker, and the others steal from there
+    currWorker = &gcWorkers[0];
+    mark(flags);
+    currWorker = NULL;
+    numIdleMarkers = 0;
+    runOnWorkers(markTask);
+}
+
+static void sweepTask(GCWorker *w) {
+    for (unsigned i = w->id; i < numSweepBlocks; i += PXT_GC_THREADS)
+        sweepBlock(sweepBlocks[i], sweepStates[i]);
+}
+
+// blocks are swept in parallel, and then their free lists are joined in address order
+static void parallelSweep(SweepState &st) {
+    unsigned n = 0;
+    for (auto h = firstBlock; h; h = h->next)
+        n++;
+    sweepBlocks = (GCBlock **)xmalloc(n * sizeof(GCBlock *));
+    sweepStates = (SweepState *)xmalloc(n * sizeof(SweepState));
+    memset(sweepStates, 0, n * sizeof(SweepState));
+    n = 0;
+    for (auto h = firstBlock; h; h = h->next)
+        sweepBlocks[n++] = h;
+    numSweepBlocks = n;
+
+    runOnWorkers(sweepTask);
+
+    for (unsigned i = 0; i < n; ++i) {
+        auto &bs = sweepStates[i];
+        appendList(&st.firstFree, &st.lastFree, bs.firstFree, bs.lastFree);
+        for (unsigned c = 0; c < GC_NUM_SIZE_CLASSES; ++c)
+            appendList(&st.classFree[c], &st.classLast[c], bs.classFree[c], bs.classLast[c]);
+        st.freeSize += bs.freeSize;
+        st.totalSize += bs.totalSize;
+        if (bs.maxFreeBlock > st.maxFreeBlock)
+            st.maxFreeBlock = bs.maxFreeBlock;
+#ifdef PXT_GC_TELEMETRY
+        for (unsigned t = 0; t < GC_TELEMETRY_TYPES; ++t) {
+            st.liveObjects[t] += bs.liveObjects[t];
+            st.liveBytes[t] += bs.liveBytes[t];
+        }
+#endif
+    }
+
+    xfree(sweepBlocks);
+    xfree(sweepStates);
+    sweepBlocks = NULL;
+    sweepStates = NULL;
+    numSweepBlocks = 0;
+}
+#endif
+
+// Interned strings, a weak set: the GC drops the strings nothing else refers to. The hashes are
+// kept, as the GC can't read the data of every kind of string.
+struct InternEntry {
+    String str;
+    uint32_t hash;
+};
+static PXT_TLS InternEntry *internTable;
+static PXT_TLS unsigned internMask, internCount;
+
+static void resizeInternTable(unsigned numSlots, bool dropDead) {
+    auto old = internTable;
+    auto oldSlots = old ? internMask + 1 : 0;
+    internTable = (InternEntry *)xmalloc(numSlots * sizeof(InternEntry));
+    memset(internTable, 0, numSlots * sizeof(InternEntry));
+    internMask = numSlots - 1;
+    internCount = 0;
+    for (unsigned i = 0; i < oldSlots; ++i) {
+        auto e = old[i];
+        if (!e.str)
+            continue;
+        // only called between marking and sweeping when dropping
+        if (dropDead && inGCArea(e.str) && !IS_LIVE(VT(e.str)))
+            continue;
+        auto j = e.hash & internMask;
+        while (internTable[j].str)
+            j = (j + 1) & internMask;
+        internTable[j] = e;
+        internCount++;
+    }
+    xfree(old);
+}
+
+static void sweepInternTable() {
+    if (internTable)
+        resizeInternTable(internMask + 1, true);
+}
+
+String gcInternString(String s) {
+    if (!s)
+        return s;
+    auto len = s->getUTF8Size();
+    auto data = s->getUTF8Data();
+    auto h = hash_fnv1(data, len);
+
+    if (internTable) {
+        for (auto i = h & internMask; internTable[i].str; i = (i + 1) & internMask) {
+            auto e = internTable[i];
+            if (e.hash == h && (e.str == s || (e.str->getUTF8Size() == len &&
+                                               memcmp(e.str->getUTF8Data(), data, len) == 0))) {
+#ifdef PXT_GC_INCREMENTAL
+                // the string may not be marked yet, while nothing but the caller refers to it
+                if (markInProgress)
+                    gcProcess((TValue)e.str);
+#endif
+                return e.str;
+            }
+        }
+    }
+
+    // an interface member name is the string the maps and lookupMapKey() know by pointer
+    if (!isReadOnly((TValue)s)) {
+        int key = pxtrt::lookupMapKeyData(data, len);
+        if (key)
+            s = pxtrt::mapKeyName(key);
+    }
+
+    if (!internTable || (internCount + 1) * 2 > internMask + 1)
+        resizeInternTable(internTable ? (internMask + 1) * 2 : 64, false);
+    auto i = h & internMask;
+    while (internTable[i].str)
+        i = (i + 1) & internMask;
+    internTable[i].str = s;
+    internTable[i].hash = h;
+    internCount++;
+    return s;
+}
+
 void gc(int flags) {
+    PXT_TRACE_SPAN(GC, flags, 0);
+    auto startTime = current_time_us();
     startPerfCounter(PerfCounters::GC);
     GC_CHECK(!(inGC & IN_GC_COLLECT), 40);
     inGC |= IN_GC_COLLECT;
+#ifdef PXT_GC_NURSERY
+    if (needFullGC || !nursery)
+        flags &= ~GC_MINOR;
+    sealNursery();
+    if (!(flags & GC_MINOR))
+        clearMarks();
+#else
+    sealBumpRegion();
+#endif
+#ifdef PXT_GC_INCREMENTAL
+    if (markInProgress)
+        gcDrain();
+#endif
     VLOG("GC mark");
+#ifdef PXT_GC_PARALLEL
+    parallelMark(flags);
+#else
     mark(flags);
+#endif
+#ifdef PXT_GC_NURSERY
+    if (flags & GC_MINOR)
+        scanRemembered();
+    rememberedSet.setLength(0);
+    needFullGC = false;
+#endif
+    sweepInternTable();
     VLOG("GC sweep");
     sweep(flags);
     VLOG("GC done");
     stopPerfCounter(PerfCounters::GC);
     inGC &= ~IN_GC_COLLECT;
+    recordPause(startTime);
+
+#ifdef PXT_GC_TELEMETRY
+    if (!gcTelemetry)
+        gcTelemetry = (GCRecord *)xmalloc(PXT_GC_TELEMETRY_SIZE * sizeof(GCRecord));
+    currRecord.timeMs = current_time_ms();
+    currRecord.pauseUs = (uint32_t)(current_time_us() - startTime);
+    gcTelemetry[numGCRecords++ % PXT_GC_TELEMETRY_SIZE] = currRecord;
+    memset(&currRecord, 0, sizeof(currRecord));
+#endif
+}
+
+#ifdef PXT_GC_COMPACT
+// Sliding compaction, for when an allocation fails with enough memory free, just not in one
+// piece. Live objects slide towards the start of the heap in the order they are in, and the
+// fields pointing at them are found by threading (Jonkers): each field is put on a list that
+// starts at the header of the object it points to, so that the new address can be written into
+// all of them at once. This takes two walks over the heap and no memory on the side.
+//
+// Only fields of objects in the heap get updated. Whatever the roots (stacks, globals,
+// registerGC() and registerGCObj()) point at or into stays where it is, and so does what those
+// objects point at directly; as do PERMA_MASK blocks and large objects. Native code which keeps
+// pointers to the heap other than in its stack and registered roots must not allocate.
+
+static int compareWords(const void *a, const void *b) {
+    auto x = *(const uintptr_t *)a, y = *(const uintptr_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// whether a word of the roots points into [start, end); pinCandidates is sorted
+static bool pinCandidateIn(void *start, void *end) {
+    auto data = (uintptr_t *)pinCandidates.getData();
+    unsigned lo = 0, hi = pinCandidates.getLength();
+    while (lo < hi) {
+        auto mid = (lo + hi) / 2;
+        if (data[mid] < (uintptr_t)start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < pinCandidates.getLength() && data[lo] < (uintptr_t)end;
+}
+
+// both for the pointers to p and the ones in p, which native code may have gotten from it
+static void pinChildren(RefObject *p) {
+    auto vt = p->vtable;
+    if (IS_VAR_BLOCK(vt))
+        return;
+    auto scan = getScanMethod((VTable *)(vt & ~ANY_MARKED_MASK));
+    if (scan) {
+        compactPhase = COMPACT_PIN;
+        scan(p);
+    }
+}
+
+static void pinObjects() {
+    for (auto h = firstBlock; h; h = h->next) {
+        auto d = h->data;
+        auto end = d + BYTES_TO_WORDS(h->blockSize);
+        while (d < end) {
+            auto sz = getObjectSize(d);
+            if (IS_LIVE(d->vtable)) {
+                bool root = pinCandidateIn(d, d + sz);
+                if (root || IS_PERMA(d->vtable))
+                    d->vtable |= MARKED_MASK | PINNED_MASK;
+                if (root)
+                    pinChildren(d);
+            }
+            d += sz;
+        }
+    }
+#ifdef GC_LARGE_SPACE
+    for (auto p = largeObjects; p; p = p->next) {
+        auto d = p->data;
+        if (!IS_LIVE(d->vtable))
+            continue;
+        d->vtable |= MARKED_MASK | PINNED_MASK;
+        if (pinCandidateIn(d, (uint8_t *)p + p->size))
+            pinChildren(d);
+    }
+#endif
+}
+
+// the header of p, which may be at the end of the list of fields threaded onto it
+static uintptr_t realHeader(RefObject *p) {
+    auto vt = p->vtable;
+    while (IS_THREADED(vt))
+        vt = *(uintptr_t *)(vt & ~ANY_MARKED_MASK);
+    return vt;
+}
+
+// write the address p is going to into the fields threaded onto it, and put the header back
+static void unthread(RefObject *p, RefObject *to) {
+    auto vt = p->vtable;
+    if (!IS_THREADED(vt))
+        return;
+    // arrays are pointed at past their header
+    auto addr = IS_ARRAY(realHeader(p)) ? (uintptr_t)(to + 1) : (uintptr_t)to;
+    while (IS_THREADED(vt)) {
+        auto field = (uintptr_t *)(vt & ~ANY_MARKED_MASK);
+        vt = *field;
+        *field = addr;
+    }
+    p->vtable = vt;
+}
+
+static void threadFields(RefObject *p) {
+    auto vt = p->vtable;
+    compactPhase = COMPACT_THREAD;
+    if (IS_VAR_BLOCK(vt)) {
+        // the unused part of arrays is zeroed
+        if (vt & VALUES_MASK)
+            gcScanMany((TValue *)(p + 1), VAR_BLOCK_WORDS(vt) - 1);
+    } else {
+        auto scan = getScanMethod((VTable *)(vt & ~ANY_MARKED_MASK));
+        if (scan)
+            scan(p);
+    }
+}
+
+// update the fields pointing forward, and thread the ones in the block
+static void compactForward(GCBlock *h) {
+    auto d = h->data;
+    auto end = d + BYTES_TO_WORDS(h->blockSize);
+    auto free = d;
+    while (d < end) {
+        if (IS_THREADED(d->vtable) || IS_LIVE(d->vtable)) {
+            if (IS_PINNED(realHeader(d)))
+                free = d;
+            unthread(d, free);
+            auto sz = getObjectSize(d);
+            threadFields(d);
+            free += sz;
+            d += sz;
+        } else {
+            auto sz = getObjectSize(d);
+            if (!IS_FREE(d->vtable)) {
+                if (!IS_ARRAY(d->vtable)) {
+                    GC_CHECK(((VTable *)d->vtable)->magic == VTABLE_MAGIC, 41);
+                    d->destroyVT();
+                }
+                d->vtable = (sz << 2) | FREE_MASK;
+            }
+            d += sz;
+        }
+    }
+}
+
+// update the fields pointing backward, and move the objects
+static void compactSlide(GCBlock *h) {
+    auto d = h->data;
+    auto end = d + BYTES_TO_WORDS(h->blockSize);
+    auto free = d;
+    while (d < end) {
+        if (!IS_THREADED(d->vtable) && !IS_LIVE(d->vtable)) {
+            d += getObjectSize(d);
+            continue;
+        }
+        bool pinned = IS_PINNED(realHeader(d));
+        if (pinned) {
+            if (free < d)
+                free->vtable = ((d - free) << 2) | FREE_MASK;
+            free = d;
+        }
+        unthread(d, free);
+        auto sz = getObjectSize(d);
+        d->vtable &= ~(uintptr_t)(PINNED_MASK | VALUES_MASK);
+        if (!pinned)
+            memmove(free, d, WORDS_TO_BYTES(sz));
+        free += sz;
+        d += sz;
+    }
+    if (free < end)
+        free->vtable = ((end - free) << 2) | FREE_MASK;
+}
+
+static void gcCompact() {
+    PXT_TRACE_SPAN(GC, 0, 0);
+    auto startTime = current_time_us();
+    startPerfCounter(PerfCounters::GC);
+    GC_CHECK(!(inGC & IN_GC_COLLECT), 40);
+    inGC |= IN_GC_COLLECT;
+    sealBumpRegion();
+
+    compactPhase = COMPACT_MARK;
+    mark(0);
+    compactPhase = 0;
+    sweepInternTable();
+    qsort(pinCandidates.getData(), pinCandidates.getLength(), sizeof(TValue), compareWords);
+    pinObjects();
+
+    // these don't move, so their fields can be threaded right away
+    compactPhase = COMPACT_THREAD;
+    for (unsigned i = 0; internTable && i <= internMask; ++i)
+        if (internTable[i].str)
+            compactRef(&internTable[i].str, false);
+#ifdef GC_LARGE_SPACE
+    for (auto p = largeObjects; p; p = p->next)
+        if (IS_LIVE(p->data->vtable))
+            threadFields(p->data);
+#endif
+
+    // objects stay in their block; the two walks have to see the blocks in the same order
+    for (auto h = firstBlock; h; h = h->next)
+        compactForward(h);
+    for (auto h = firstBlock; h; h = h->next)
+        compactSlide(h);
+    compactPhase = 0;
+
+#ifdef GC_LARGE_SPACE
+    for (auto p = largeObjects; p; p = p->next)
+        p->data->vtable &= ~(uintptr_t)(PINNED_MASK | VALUES_MASK);
+#endif
+    pinCandidates.destroy();
+
+    sweep(0);
+    stopPerfCounter(PerfCounters::GC);
+    inGC &= ~IN_GC_COLLECT;
+    recordPause(startTime);
+    DMESG("GC compact: %d free, %d in one piece", gcStats.lastFreeBytes, gcStats.lastMaxBlockBytes);
 }
+#endif
 
 #ifdef GC_GET_HEAP_SIZE
 extern "C" void free(void *ptr) {
@@ -681,7 +2033,13 @@ void *app_alloc(int numbytes) {
         return NULL;
 
     // gc(0);
+#ifdef PXT_GC_NURSERY
+    inAppAlloc = true;
+    auto r = (uintptr_t *)gcAllocateArray(numbytes);
+    inAppAlloc = false;
+#else
     auto r = (uintptr_t *)gcAllocateArray(numbytes);
+#endif
     r[-1] |= PERMA_MASK;
     return r;
 }
@@ -702,6 +2060,17 @@ void gcReset() {
 
     gcRoots.setLength(0);
 
+    xfree(internTable);
+    internTable = NULL;
+    internCount = internMask = 0;
+
+#ifdef PXT_GC_INCREMENTAL
+    // drop any marking in progress
+    workQueue.setLength(0);
+    markInProgress = false;
+    bytesSinceGC = 0;
+#endif
+
     if (inGC)
         oops(41);
 
@@ -709,30 +2078,75 @@ void gcReset() {
         oops(41);
 
     memset(&gcStats, 0, sizeof(gcStats));
+#ifdef PXT_GC_TELEMETRY
+    numGCRecords = 0;
+    lastUsedBytes = 0;
+    allocatedSinceGC = 0;
+    memset(&currRecord, 0, sizeof(currRecord));
+#endif
+    totalPauseUs = 0;
+    numPauses = 0;
+#ifndef PXT_GC_NURSERY
+    bumpPtr = bumpLimit = NULL;
+#endif
     firstFree = NULL;
+    memset(sizeClassFree, 0, sizeof(sizeClassFree));
+#ifdef GC_LARGE_SPACE
+    while (largeObjects) {
+        auto p = largeObjects;
+        largeObjects = p->next;
+        freeLarge(p);
+    }
+    for (auto p = largeFree; p; p = p->next)
+        gcStats.totalBytes += p->size;
+    largeLiveBytes = largeBytesSinceGC = 0;
+#endif
     for (auto h = firstBlock; h; h = h->next) {
+#ifdef PXT_GC_NURSERY
+        if (h == nursery) {
+            gcStats.numBlocks++;
+            gcStats.totalBytes += nursery->blockSize;
+            nursery->data[0].vtable = FREE_MASK | (TOWORDS(nursery->blockSize) << 2);
+            nurseryFree = NULL;
+            nurseryPtr = (uint8_t *)nursery->data;
+            nurseryLimit = nurseryPtr + nursery->blockSize;
+            continue;
+        }
+#endif
         setupFreeBlock(h);
     }
+#ifdef PXT_GC_NURSERY
+    rememberedSet.setLength(0);
+    needFullGC = false;
+#endif
 }
 
 #ifdef PXT_VM
-static uint8_t *preallocBlock;
-static uint8_t *preallocPointer;
+// Images are loaded into a block of their own, which can happen on any thread,
+// while another program runs (see vmPreloadFile()).
+static __thread uint8_t *preallocBlock;
+static __thread uint8_t *preallocPointer;
 
 #define PREALLOC_SIZE (1024 * 1024)
 
 void gcPreStartup() {
-    xfree(preallocBlock);
     preallocBlock = (uint8_t *)xmalloc(PREALLOC_SIZE);
     preallocPointer = preallocBlock;
     if (!isReadOnly((TValue)preallocBlock))
         oops(40);
-    inGC |= IN_GC_PREALLOC;
+}
+
+// stop allocating in the block and return it; it belongs to the loaded image from now on
+void *gcPreallocDone() {
+    auto r = preallocBlock;
+    preallocBlock = preallocPointer = NULL;
+    return r;
 }
 
 void gcStartup() {
-    inGC &= ~IN_GC_PREALLOC;
-    preallocPointer = NULL;
+#ifdef PXT_GC_INCREMENTAL
+    gcSliceUs = getConfig(CFG_GC_INCREMENTAL_SLICE_US, 0);
+#endif
 }
 
 void *gcPrealloc(int numbytes) {
@@ -749,27 +2163,142 @@ void *gcPrealloc(int numbytes) {
 }
 
 bool inGCPrealloc() {
-    return (inGC & IN_GC_PREALLOC) != 0;
+    return preallocPointer != NULL;
 }
 #endif
 
+#ifdef PXT_GC_NURSERY
+static void allocateNursery() {
+    nursery = (GCBlock *)GC_ALLOC_BLOCK(PXT_GC_NURSERY_SIZE);
+    nursery->blockSize = PXT_GC_NURSERY_SIZE - sizeof(GCBlock);
+    DMESG("GC nursery %db @ %p", nursery->blockSize, nursery);
+    gcStats.numBlocks++;
+    gcStats.totalBytes += nursery->blockSize;
+    nurseryPtr = (uint8_t *)nursery->data;
+    nurseryLimit = nurseryPtr + nursery->blockSize;
+    linkFreeBlock(nursery);
+}
+
+static bool nextNurseryHole() {
+    auto p = nurseryFree;
+    if (!p)
+        return false;
+    nurseryFree = p->nextFree;
+    nurseryPtr = (uint8_t *)p;
+    nurseryLimit = nurseryPtr + WORDS_TO_BYTES(VAR_BLOCK_WORDS(p->vtable));
+    return true;
+}
+
+static void *nurseryAlloc(size_t numwords) {
+    if (!nursery)
+        allocateNursery();
+    auto numbytes = WORDS_TO_BYTES(numwords);
+    for (int i = 0;; ++i) {
+        if (nurseryPtr + numbytes <= nurseryLimit) {
+            auto r = (RefObject *)nurseryPtr;
+            nurseryPtr += numbytes;
+            r->vtable = 0;
+            return r;
+        }
+        // hole too small, move on to the next one; the rest of this one goes to waste
+        // until the next collection
+        sealNursery();
+        if (nextNurseryHole())
+            continue;
+        if (i > 0)
+            // still no luck after collecting, use the main heap
+            return NULL;
+        gc(GC_MINOR);
+    }
+}
+#endif
+
+#ifndef GC_LARGE_SPACE
+// Big objects go to the smallest free block they fit in, at its end, so that what is left
+// for small objects stays in one piece.
+static void *allocBestFit(size_t numwords) {
+    RefBlock *best = NULL, *bestPrev = NULL, *prev = NULL;
+    for (auto p = firstFree; p; prev = p, p = p->nextFree) {
+        GC_CHECK(IS_FREE(p->vtable), 43);
+        auto len = VAR_BLOCK_WORDS(p->vtable);
+        if (len >= numwords && (!best || len < VAR_BLOCK_WORDS(best->vtable))) {
+            best = p;
+            bestPrev = prev;
+        }
+    }
+    if (!best)
+        return NULL;
+    auto left = VAR_BLOCK_WORDS(best->vtable) - numwords;
+    if (left > GC_MAX_SIZE_CLASS_WORDS) {
+        // stays on the list, just shorter
+        best->vtable = (left << 2) | FREE_MASK;
+    } else {
+        if (bestPrev)
+            bestPrev->nextFree = best->nextFree;
+        else
+            firstFree = best->nextFree;
+        if (left)
+            best->vtable = (left << 2) | FREE_MASK;
+        if (left >= 2)
+            addSizeClassFree(best, left);
+    }
+    auto r = (RefObject *)((void **)best + left);
+    r->vtable = 0;
+    return r;
+}
+#endif
+
+static void *allocSmall(size_t numwords) {
+    for (unsigned c = allocSizeClass[numwords]; c < GC_NUM_SIZE_CLASSES; ++c) {
+        auto p = sizeClassFree[c];
+        if (!p)
+            continue;
+        GC_CHECK(!isReadOnly((TValue)p), 49);
+        GC_CHECK(IS_FREE(p->vtable), 43);
+        sizeClassFree[c] = p->nextFree; // read before nf below possibly overwrites it
+        int left = (int)(VAR_BLOCK_WORDS(p->vtable) - numwords);
+        GC_CHECK(0 <= left && left < GC_MAX_SIZE_CLASS_WORDS, 44);
+        if (left) {
+            auto nf = (RefBlock *)((void **)p + numwords);
+            nf->vtable = (left << 2) | FREE_MASK;
+            if (left >= 2)
+                addSizeClassFree(nf, left);
+        }
+        p->vtable = 0;
+        return p;
+    }
+    return NULL;
+}
+
 void *gcAllocate(int numbytes) {
     size_t numwords = BYTES_TO_WORDS(ALIGN_TO_WORD(numbytes));
     // VVLOG("alloc %d bytes %d words", numbytes, numwords);
 
+#ifdef GC_LARGE_SPACE
+    if (numbytes > GC_MAX_LARGE_ALLOC_SIZE)
+#else
     if (numbytes > GC_MAX_ALLOC_SIZE)
+#endif
         target_panic(PANIC_GC_TOO_BIG_ALLOCATION);
 
-    if (PXT_IN_ISR() || (inGC & (IN_GC_ALLOC | IN_GC_COLLECT | IN_GC_FREEZE)))
-        target_panic(PANIC_CALLED_FROM_ISR);
-
 #ifdef PXT_VM
+    // before looking at inGC, which belongs to the running program
     if (inGCPrealloc())
         return gcPrealloc(numbytes);
 #endif
 
+    if (PXT_IN_ISR() || (inGC & (IN_GC_ALLOC | IN_GC_COLLECT | IN_GC_FREEZE)))
+        target_panic(PANIC_CALLED_FROM_ISR);
+
     inGC |= IN_GC_ALLOC;
 
+#ifdef PXT_GC_INCREMENTAL
+    bytesSinceGC += numbytes;
+#endif
+#ifdef PXT_GC_TELEMETRY
+    allocatedSinceGC += numbytes;
+#endif
+
 #if defined(PXT_GC_CHECKS) && !defined(PXT_VM)
     {
         auto curr = getThreadContext();
@@ -782,7 +2311,46 @@ void *gcAllocate(int numbytes) {
     gc(0);
 #endif
 
+#ifdef GC_LARGE_SPACE
+    if (numbytes > GC_LARGE_OBJECT_SIZE) {
+        auto r = allocLarge(numbytes);
+        inGC &= ~IN_GC_ALLOC;
+        return r;
+    }
+#endif
+
+#ifdef PXT_GC_NURSERY
+    if (numwords <= NURSERY_MAX_ALLOC_WORDS && !inAppAlloc) {
+        auto r = nurseryAlloc(numwords);
+        if (r) {
+            inGC &= ~IN_GC_ALLOC;
+            return r;
+        }
+    }
+#endif
+
+#ifdef PXT_GC_COMPACT
+    bool compacted = false;
+#endif
     for (int i = 0;; ++i) {
+        if (numwords <= GC_MAX_SIZE_CLASS_WORDS) {
+            auto r = allocSmall(numwords);
+            if (r) {
+                inGC &= ~IN_GC_ALLOC;
+                return r;
+            }
+        }
+
+#ifndef GC_LARGE_SPACE
+        if (numbytes > GC_LARGE_OBJECT_SIZE) {
+            auto r = allocBestFit(numwords);
+            if (r) {
+                inGC &= ~IN_GC_ALLOC;
+                return r;
+            }
+        }
+#endif
+
         RefBlock *prev = NULL;
         for (auto p = firstFree; p; p = p->nextFree) {
             VVLOG("p=%p", p);
@@ -802,9 +2370,12 @@ void *gcAllocate(int numbytes) {
                 // VVLOG("nf=%p nef=%p", nf, nextFree);
                 if (left)
                     nf->vtable = (left << 2) | FREE_MASK;
-                if (left >= 2) {
+                if (left > GC_MAX_SIZE_CLASS_WORDS) {
                     nf->nextFree = nextFree;
                 } else {
+                    // small leftovers would only slow down the walk over firstFree
+                    if (left >= 2)
+                        addSizeClassFree(nf, left);
                     nf = nextFree;
                 }
                 if (prev)
@@ -824,6 +2395,14 @@ void *gcAllocate(int numbytes) {
         // we didn't find anything, try GC
         if (i == 0)
             gc(0);
+#ifdef PXT_GC_COMPACT
+        // there's enough free, but in pieces
+        else if (i == 1 && !compacted && gcStats.lastFreeBytes >= (uint32_t)numbytes) {
+            compacted = true;
+            gcCompact();
+            i = 0;
+        }
+#endif
         // GC didn't help, try new block
         else if (i == 1)
             allocateBlock();
@@ -833,6 +2412,70 @@ void *gcAllocate(int numbytes) {
     }
 }
 
+#ifndef PXT_GC_NURSERY
+// take a region off the first free block that has one, without collecting
+static bool refillBumpRegion() {
+    uint32_t words = BYTES_TO_WORDS(GC_BUMP_REGION_SIZE);
+    RefBlock *prev = NULL;
+    for (auto p = firstFree; p; p = p->nextFree) {
+        // same as in gcAllocate(), it's better to collect than to go past midPtr
+        if ((uint8_t *)p > midPtr)
+            break;
+        auto len = VAR_BLOCK_WORDS(p->vtable);
+        if (len >= words) {
+            auto nextFree = p->nextFree;
+            RefBlock *nf;
+            if (len - words > GC_MAX_SIZE_CLASS_WORDS) {
+                nf = (RefBlock *)((void **)p + words);
+                nf->vtable = ((len - words) << 2) | FREE_MASK;
+                nf->nextFree = nextFree;
+            } else {
+                // not worth leaving behind
+                words = len;
+                nf = nextFree;
+            }
+            if (prev)
+                prev->nextFree = nf;
+            else
+                firstFree = nf;
+            bumpPtr = (uint8_t *)p;
+            bumpLimit = bumpPtr + WORDS_TO_BYTES(words);
+#ifdef PXT_GC_INCREMENTAL
+            bytesSinceGC += WORDS_TO_BYTES(words);
+#endif
+#ifdef PXT_GC_TELEMETRY
+            allocatedSinceGC += WORDS_TO_BYTES(words);
+#endif
+            return true;
+        }
+        prev = p;
+    }
+    return false;
+}
+#endif
+
+// Same as gcAllocate(), but quicker for the small objects of a fixed size, which are allocated
+// the most, ie. class instances; the bump is all there is to it most of the time.
+void *gcAllocateFixed(int numbytes) {
+#if !defined(PXT_GC_NURSERY) && !defined(PXT_GC_STRESS)
+    numbytes = ALIGN_TO_WORD(numbytes);
+    if (!inGC && !inGCPrealloc() && !PXT_IN_ISR()) {
+        if (bumpPtr + numbytes > bumpLimit && numbytes <= GC_BUMP_REGION_SIZE / 4) {
+            sealBumpRegion();
+            refillBumpRegion();
+        }
+        if (bumpPtr + numbytes <= bumpLimit) {
+            auto r = (RefObject *)bumpPtr;
+            bumpPtr += numbytes;
+            r->vtable = 0;
+            return r;
+        }
+    }
+#endif
+    // with the nursery, gcAllocate() bumps anyway
+    return gcAllocate(numbytes);
+}
+
 static void removePtr(TValue v) {
     int len = gcRoots.getLength();
     auto data = gcRoots.getData();
@@ -890,7 +2533,8 @@ void unregisterGCPtr(TValue ptr) {
 }
 
 void RefImage::scan(RefImage *t) {
-    gcScan((TValue)t->buffer);
+    gcScanField((TValue *)&t->buffer);
+    gcScanField((TValue *)&t->spans);
 }
 
 void RefCollection::scan(RefCollection *t) {
@@ -902,12 +2546,14 @@ void RefAction::scan(RefAction *t) {
 }
 
 void RefRefLocal::scan(RefRefLocal *t) {
-    gcScan(t->v);
+    gcScanField(&t->v);
 }
 
 void RefMap::scan(RefMap *t) {
     gcScanSegment(t->keys);
     gcScanSegment(t->values);
+    if (t->index)
+        gcMarkArrayField(&t->index);
 }
 
 void RefRecord_scan(RefRecord *r) {
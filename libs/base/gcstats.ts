@@ -4,6 +4,18 @@ namespace control {
         return null
     }
 
+    //% shim=pxt::getGCTelemetry
+    function getGCTelemetry(): Buffer {
+        return null
+    }
+
+    /**
+     * Print records of recent garbage collections to DMESG
+     */
+    //% shim=pxt::dumpGCTelemetry
+    export function dumpGCTelemetry(): void {
+    }
+
     export interface GCStats {
         numGC: number;
         numBlocks: number;
@@ -11,6 +23,11 @@ namespace control {
         lastFreeBytes: number;
         lastMaxBlockBytes: number;
         minFreeBytes: number;
+        numMinorGC: number;
+        maxPauseUs: number;
+        meanPauseUs: number;
+        boxCacheHits: number;
+        boxCacheMisses: number;
     }
 
     /**
@@ -29,6 +46,11 @@ namespace control {
         addField("lastFreeBytes")
         addField("lastMaxBlockBytes")
         addField("minFreeBytes")
+        addField("numMinorGC")
+        addField("maxPauseUs")
+        addField("meanPauseUs")
+        addField("boxCacheHits")
+        addField("boxCacheMisses")
 
         return res
 
@@ -36,5 +58,60 @@ namespace control {
             res[name] = buf.getNumber(NumberFormat.UInt32LE, off)
             off += 4
         }
-    }    
-}
\ No newline at end of file
+    }
+
+    export interface GCRecord {
+        timeMs: number;
+        pauseUs: number;
+        minor: boolean;
+        usedBytesBefore: number;
+        usedBytesAfter: number;
+        freeBytes: number;
+        maxFreeBlockBytes: number;
+        numPendingArrays: number;
+        // indexed by type name: data, string, number, buffer, function, image,
+        // array, reflocal, map, mimage, mmap, user
+        liveObjects: any;
+        liveBytes: any;
+    }
+
+    const gcTypeNames = ["data", "string", "number", "buffer", "function", "image",
+        "array", "reflocal", "map", "mimage", "mmap", "user"]
+
+    /**
+     * Get records of recent garbage collections, oldest first;
+     * this is only available when the runtime is compiled with PXT_GC_TELEMETRY
+     */
+    export function gcTelemetry(): GCRecord[] {
+        const buf = getGCTelemetry()
+        if (!buf)
+            return null
+        const recordSize = (8 + 2 * gcTypeNames.length) * 4
+        const res: GCRecord[] = []
+        for (let off = 0; off + recordSize <= buf.length; off += recordSize) {
+            const rec: any = {}
+            let p = off
+            const next = () => {
+                const v = buf.getNumber(NumberFormat.UInt32LE, p)
+                p += 4
+                return v
+            }
+            rec.timeMs = next()
+            rec.pauseUs = next()
+            rec.minor = !!(next() & 1)
+            rec.usedBytesBefore = next()
+            rec.usedBytesAfter = next()
+            rec.freeBytes = next()
+            rec.maxFreeBlockBytes = next()
+            rec.numPendingArrays = next()
+            rec.liveObjects = {}
+            rec.liveBytes = {}
+            for (const n of gcTypeNames)
+                rec.liveObjects[n] = next()
+            for (const n of gcTypeNames)
+                rec.liveBytes[n] = next()
+            res.push(rec)
+        }
+        return res
+    }
+}
@@ -0,0 +1,469 @@
+#include "pxtbase.h"
+
+// JSON.parse() and JSON.stringify() in json.ts come here first. Parsing is one pass over the
+// UTF-8 data, making the maps, arrays, strings and numbers as it goes; keys that the program
+// has as literals are replaced by those, so that the maps get shapes. Stringifying builds the
+// output in one growing buffer, and gives up (leaving it to json.ts) on anything that isn't
+// plain data, like class instances or functions.
+
+#define JSON_MAX_DEPTH 64
+
+namespace JSON {
+
+class Parser {
+  public:
+    const char *start, *ptr, *end;
+    const char *errorMsg;
+    int depth;
+
+    void error(const char *msg) {
+        if (!errorMsg) {
+            errorMsg = msg;
+            DMESG("Invalid JSON: %s at position %d", msg, (int)(ptr - start));
+            ptr = end;
+        }
+    }
+
+    int skipWS() {
+        while (ptr < end) {
+            char c = *ptr;
+            if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+                ptr++;
+            else
+                return (uint8_t)c;
+        }
+        return 0;
+    }
+
+    bool keyword(const char *kw, int len) {
+        if (end - ptr >= len && memcmp(ptr, kw, len) == 0) {
+            ptr += len;
+            return true;
+        }
+        return false;
+    }
+
+    String doString(bool isKey);
+    TValue doNumber();
+    TValue doArray();
+    TValue doObject();
+    TValue value();
+};
+
+static int hexValue(char c) {
+    if ('0' <= c && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if ('a' <= c && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// surrogates are written as they are, and mkString() joins the pairs
+static int writeUTF8(char *dst, unsigned c) {
+    if (c < 0x80) {
+        dst[0] = c;
+        return 1;
+    } else if (c < 0x800) {
+        dst[0] = 0xc0 | (c >> 6);
+        dst[1] = 0x80 | (c & 0x3f);
+        return 2;
+    } else {
+        dst[0] = 0xe0 | (c >> 12);
+        dst[1] = 0x80 | ((c >> 6) & 0x3f);
+        dst[2] = 0x80 | (c & 0x3f);
+        return 3;
+    }
+}
+
+String Parser::doString(bool isKey) {
+    const char *beg = ++ptr;
+    bool escaped = false;
+    while (ptr < end && *ptr != '"') {
+        if (*ptr == '\\') {
+            escaped = true;
+            ptr++;
+        }
+        ptr++;
+    }
+    if (ptr >= end) {
+        error("unterminated string");
+        return NULL;
+    }
+    unsigned len = ptr++ - beg;
+
+    if (!escaped) {
+        if (isKey) {
+            int key = pxtrt::lookupMapKeyData(beg, len);
+            if (key)
+                return pxtrt::mapKeyName(key);
+        }
+        // the input is a String already, so it's canonical
+        return mkStringCore(beg, len);
+    }
+
+    // escapes never make it longer
+    char tmp[64];
+    char *dst = len <= sizeof(tmp) ? tmp : (char *)app_alloc(len);
+    unsigned n = 0;
+    for (const char *p = beg; p < beg + len; ++p) {
+        char c = *p;
+        if (c == '\\') {
+            c = *++p;
+            if (c == 'b')
+                c = '\b';
+            else if (c == 'f')
+                c = '\f';
+            else if (c == 'n')
+                c = '\n';
+            else if (c == 'r')
+                c = '\r';
+            else if (c == 't')
+                c = '\t';
+            else if (c == 'u') {
+                unsigned code = 0;
+                for (int i = 1; i <= 4; ++i) {
+                    int d = p + i < beg + len ? hexValue(p[i]) : -1;
+                    if (d < 0) {
+                        code = 0x10000;
+                        break;
+                    }
+                    code = (code << 4) | d;
+                }
+                if (code > 0xffff) {
+                    if (dst != tmp)
+                        app_free(dst);
+                    error("invalid \\u escape");
+                    return NULL;
+                }
+                n += writeUTF8(dst + n, code);
+                p += 4;
+                continue;
+            }
+        }
+        dst[n++] = c;
+    }
+
+    String r = mkString(dst, n);
+    if (dst != tmp)
+        app_free(dst);
+    if (isKey) {
+        int key = pxtrt::lookupMapKey(r);
+        if (key)
+            return pxtrt::mapKeyName(key);
+    }
+    return r;
+}
+
+TValue Parser::doNumber() {
+    const char *beg = ptr;
+    while (ptr < end) {
+        char c = *ptr;
+        if (('0' <= c && c <= '9') || c == '+' || c == '-' || c == '.' || c == 'e' || c == 'E')
+            ptr++;
+        else
+            break;
+    }
+
+    // most are small integers, which don't need floating point
+    const char *p = beg;
+    bool neg = *p == '-';
+    if (neg)
+        p++;
+    if (ptr > p && ptr - p <= 9) {
+        int v = 0;
+        while (p < ptr && '0' <= *p && *p <= '9')
+            v = v * 10 + (*p++ - '0');
+        if (p == ptr && !(neg && v == 0))
+            return fromInt(neg ? -v : v);
+    }
+
+    // the data of the String is NUL-terminated, so this can't go past the end
+    char *endp;
+    NUMBER v = String_::mystrtod(beg, &endp);
+    if (isnan(v) || endp == beg) {
+        error("expecting number");
+        return NULL;
+    }
+    return fromDouble(v);
+}
+
+TValue Parser::doArray() {
+    if (++depth > JSON_MAX_DEPTH) {
+        error("nesting too deep");
+        return NULL;
+    }
+
+    auto r = Array_::mk();
+    registerGCObj(r);
+    ptr++;
+    for (;;) {
+        int c = skipWS();
+        if (c == ']') {
+            ptr++;
+            break;
+        }
+        TValue v = value();
+        if (errorMsg)
+            break;
+        // growing the array can collect
+        registerGCPtr(v);
+        Array_::push(r, v);
+        unregisterGCPtr(v);
+        c = skipWS();
+        if (c == ',') {
+            ptr++;
+            continue;
+        }
+        if (c == ']')
+            continue;
+        error("expecting comma");
+    }
+    unregisterGCObj(r);
+    depth--;
+    return (TValue)r;
+}
+
+TValue Parser::doObject() {
+    if (++depth > JSON_MAX_DEPTH) {
+        error("nesting too deep");
+        return NULL;
+    }
+
+    auto r = pxtrt::mkMap();
+    registerGCObj(r);
+    ptr++;
+    for (;;) {
+        int c = skipWS();
+        if (c == '}') {
+            ptr++;
+            break;
+        }
+        if (c != '"') {
+            error("expecting key");
+            break;
+        }
+        String k = doString(true);
+        if (errorMsg)
+            break;
+        c = skipWS();
+        if (c != ':') {
+            error("expecting colon");
+            break;
+        }
+        ptr++;
+        registerGCObj(k);
+        TValue v = value();
+        if (!errorMsg) {
+            registerGCPtr(v);
+            pxtrt::mapSetByString(r, k, v);
+            unregisterGCPtr(v);
+        }
+        unregisterGCObj(k);
+        if (errorMsg)
+            break;
+        c = skipWS();
+        if (c == ',') {
+            ptr++;
+            continue;
+        }
+        if (c == '}')
+            continue;
+        error("expecting comma");
+    }
+    unregisterGCObj(r);
+    depth--;
+    return (TValue)r;
+}
+
+TValue Parser::value() {
+    if (errorMsg)
+        return NULL;
+
+    int c = skipWS();
+    if (c == '{')
+        return doObject();
+    else if (c == '[')
+        return doArray();
+    else if (('0' <= c && c <= '9') || c == '-')
+        return doNumber();
+    else if (c == '"')
+        return (TValue)doString(false);
+    else if (c == 't' && keyword("true", 4))
+        return TAG_TRUE;
+    else if (c == 'f' && keyword("false", 5))
+        return TAG_FALSE;
+    else if (c == 'n' && keyword("null", 4))
+        return TAG_NULL;
+
+    error("unexpected token");
+    return NULL;
+}
+
+/**
+ * Parses JSON text; undefined when it isn't valid.
+ */
+//%
+TValue _parse(String s) {
+    Parser p;
+    p.start = p.ptr = s->getUTF8Data();
+    p.end = p.start + s->getUTF8Size();
+    p.errorMsg = NULL;
+    p.depth = 0;
+    TValue r = p.value();
+    if (p.skipWS())
+        p.error("excessive input");
+    return p.errorMsg ? TAG_UNDEFINED : r;
+}
+
+class Stringifier {
+  public:
+    char *buf;
+    unsigned len, size;
+    int indent, depth;
+    bool failed;
+
+    void grow(unsigned n) {
+        if (len + n <= size)
+            return;
+        while (size < len + n)
+            size *= 2;
+        auto nbuf = (char *)app_alloc(size);
+        memcpy(nbuf, buf, len);
+        app_free(buf);
+        buf = nbuf;
+    }
+
+    void add(const char *s, unsigned n) {
+        grow(n);
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+
+    void add(char c) {
+        grow(1);
+        buf[len++] = c;
+    }
+
+    void newLine() {
+        grow(1 + depth * indent);
+        buf[len++] = '\n';
+        memset(buf + len, ' ', depth * indent);
+        len += depth * indent;
+    }
+
+    void doString(String s);
+    void go(TValue v);
+};
+
+void Stringifier::doString(String s) {
+    auto data = s->getUTF8Data();
+    auto n = s->getUTF8Size();
+    grow(n + 2);
+    buf[len++] = '"';
+    unsigned i = 0;
+    while (i < n) {
+        // the long runs that need no escaping go in one step
+        unsigned run = i;
+        while (run < n && (uint8_t)data[run] >= 0x20 && data[run] != '"' && data[run] != '\\')
+            run++;
+        add(data + i, run - i);
+        if (run == n)
+            break;
+        char c = data[run];
+        char esc = c == '"' ? '"' : c == '\\' ? '\\' : c == '\n' ? 'n' : c == '\r' ? 'r' : c == '\t' ? 't' : c == '\b' ? 'b' : c == '\f' ? 'f' : 0;
+        if (esc) {
+            char tmp[2] = {'\\', esc};
+            add(tmp, 2);
+        } else {
+            static const char hex[] = "0123456789abcdef";
+            char tmp[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+            add(tmp, 6);
+        }
+        i = run + 1;
+    }
+    add('"');
+}
+
+void Stringifier::go(TValue v) {
+    if (failed)
+        return;
+
+    if (v == TAG_UNDEFINED) {
+        add("undefined", 9);
+    } else if (v == TAG_NULL) {
+        add("null", 4);
+    } else if (v == TAG_TRUE) {
+        add("true", 4);
+    } else if (v == TAG_FALSE) {
+        add("false", 5);
+    } else if (isInt(v)) {
+        char tmp[16];
+        itoa(numValue(v), tmp);
+        add(tmp, strlen(tmp));
+    } else if (valType(v) == ValType::Number) {
+        auto s = numops::toString(v);
+        add(s->getUTF8Data(), s->getUTF8Size());
+    } else if (valType(v) == ValType::String) {
+        doString((String)v);
+    } else {
+        auto vt = getAnyVTable(v);
+        BuiltInType classNo = vt ? vt->classNo : (BuiltInType)0;
+        bool isArray = classNo == BuiltInType::RefCollection;
+        if ((!isArray && classNo != BuiltInType::RefMap) || depth >= JSON_MAX_DEPTH) {
+            failed = true;
+            return;
+        }
+
+        unsigned n = isArray ? ((RefCollection *)v)->length() : ((RefMap *)v)->numKeys();
+        if (n == 0) {
+            add(isArray ? "[]" : "{}", 2);
+            return;
+        }
+
+        add(isArray ? '[' : '{');
+        depth++;
+        for (unsigned i = 0; i < n; ++i) {
+            if (indent)
+                newLine();
+            if (isArray) {
+                go(((RefCollection *)v)->getAt(i));
+            } else {
+                auto map = (RefMap *)v;
+                doString((String)map->keyData()[i]);
+                if (indent)
+                    add(": ", 2);
+                else
+                    add(':');
+                go(map->values.get(i));
+            }
+            if (i != n - 1)
+                add(',');
+        }
+        depth--;
+        if (indent)
+            newLine();
+        add(isArray ? ']' : '}');
+    }
+}
+
+/**
+ * Converts plain data to JSON text, indented by the given number of spaces; undefined when
+ * there is something else in it.
+ */
+//%
+TValue _stringify(TValue v, int indent) {
+    Stringifier s;
+    s.size = 64;
+    s.buf = (char *)app_alloc(s.size);
+    s.len = 0;
+    s.indent = max(0, min(indent, 10));
+    s.depth = 0;
+    s.failed = false;
+    s.go(v);
+    TValue r = s.failed ? TAG_UNDEFINED : (TValue)mkStringCore(s.buf, s.len);
+    app_free(s.buf);
+    return r;
+}
+
+} // namespace JSON
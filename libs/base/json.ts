@@ -36,171 +36,6 @@ namespace JSON {
     }
 
 
-    class Parser {
-        ptr: number
-        s: string
-        errorMsg: string
-
-        error(msg: string) {
-            if (!this.errorMsg) {
-                this.errorMsg = msg + " at position " + this.ptr
-                this.ptr = this.s.length
-            }
-        }
-
-        skipWS() {
-            for (; ;) {
-                const c = this.nextChar()
-                if (c == 0x20 || c == 0x0a || c == 0x0d || c == 0x09) {
-                    // OK
-                } else {
-                    this.ptr--
-                    return c
-                }
-            }
-        }
-
-        nextChar() {
-            if (this.ptr < this.s.length)
-                return this.s.charCodeAt(this.ptr++)
-            return 0
-        }
-
-        doString() {
-            let r = ""
-            this.ptr++
-            for (; ;) {
-                const c = this.s.charAt(this.ptr++)
-                if (c == "\"")
-                    return r
-                if (c == "\\") {
-                    let q = this.s.charAt(this.ptr++)
-                    if (q == "b") q = "\b"
-                    else if (q == "n") q = "\n"
-                    else if (q == "r") q = "\r"
-                    else if (q == "t") q = "\t"
-                    else if (q == "u") {
-                        q = String.fromCharCode(parseIntRadix(this.s.slice(this.ptr, this.ptr + 4), 16))
-                        this.ptr += 4
-                    }
-                    r += q
-                } else {
-                    r += c
-                }
-            }
-        }
-
-        doArray(): any[] {
-            const r = []
-            this.ptr++
-            for (; ;) {
-                let c = this.skipWS()
-                if (c == 0x5d) {
-                    this.ptr++
-                    return r
-                }
-                const v = this.value()
-                if (this.errorMsg)
-                    return null
-                r.push(v)
-                c = this.skipWS()
-                if (c == 0x2c) {
-                    this.ptr++
-                    continue
-                }
-                if (c == 0x5d)
-                    continue
-                this.error("expecting comma")
-            }
-        }
-
-        doObject() {
-            const r: any = {}
-            this.ptr++
-            for (; ;) {
-                let c = this.skipWS()
-                if (c == 0x7d) {
-                    this.ptr++
-                    return r
-                }
-                if (c != 0x22) {
-                    this.error("expecting key")
-                    return r
-                }
-                const k = this.doString()
-                c = this.skipWS()
-                if (c != 0x3a) {
-                    this.error("expecting colon")
-                    return r
-                }
-                this.ptr++
-                const v = this.value()
-                if (this.errorMsg)
-                    return null
-                r[k] = v
-                c = this.skipWS()
-                if (c == 0x2c) {
-                    this.ptr++
-                    continue
-                }
-                if (c == 0x7d)
-                    continue
-                this.error("expecting comma, got " + String.fromCharCode(c))
-            }
-        }
-
-        doNumber() {
-            const beg = this.ptr
-            for (; ;) {
-                const c = this.nextChar()
-                if ((0x30 <= c && c <= 0x39) || c == 0x2b || c == 0x2d || c == 0x2e || c == 0x45 || c == 0x65) {
-                    // one more
-                } else {
-                    this.ptr--
-                    break
-                }
-            }
-            const ss = this.s.slice(beg, this.ptr)
-            if (ss.length == 0) {
-                this.error("expecting number")
-                return 0
-            }
-            return parseFloat(ss)
-        }
-
-        checkKw(k: string) {
-            if (this.s.slice(this.ptr, this.ptr + k.length) == k) {
-                this.ptr += k.length
-                return true
-            }
-            return false
-        }
-
-        value() {
-            if (this.errorMsg)
-                return null
-
-            const c = this.skipWS()
-            if (c == 0x7b)
-                return this.doObject()
-            else if (c == 0x5b)
-                return this.doArray()
-            else if ((0x30 <= c && c <= 0x39) || c == 0x2d)
-                return this.doNumber()
-            else if (c == 0x22)
-                return this.doString()
-            else if (c == 0x74 && this.checkKw("true"))
-                return true
-            else if (c == 0x66 && this.checkKw("false"))
-                return false
-            else if (c == 0x6e && this.checkKw("null"))
-                return null
-
-            this.error("unexpected token")
-            return null
-        }
-    }
-
     class Stringifier {
         currIndent: string
         indentStep: string
@@ -287,6 +122,9 @@ namespace JSON {
      * @param indent Adds indentation, white space, and line break characters to the return-value JSON text to make it easier to read.
      */
     export function stringify(value: any, replacer: any = null, indent: number = 0) {
+        const r = _stringify(value, indent)
+        if (r !== undefined)
+            return r
         const ss = new Stringifier()
         ss.currIndent = ""
         indent |= 0
@@ -306,17 +144,6 @@ namespace JSON {
      * @param text A valid JSON string.
      */
     export function parse(s: string) {
-        const p = new Parser()
-        p.ptr = 0
-        p.s = s
-        const r = p.value()
-        if (p.skipWS()) {
-            p.error("excessive input")
-        }
-        if (p.errorMsg) {
-            control.dmesg("Invalid JSON: " + p.errorMsg)
-            return undefined
-        }
-        return r
+        return _parse(s)
     }
 }
@@ -76,6 +76,26 @@ namespace Math {
     export function icos(theta: number) {
         return isin(theta + 16384);
     }
+
+    /**
+     * Returns the sine of an angle in whole degrees, times 1024, from a table.
+     * @param deg the angle in degrees, eg: 30
+     */
+    //% shim=Math_::isinDeg
+    //% help=math/isin-deg weight=9 advanced=true blockGap=8
+    export function isinDeg(deg: number): number {
+        return Math.round(Math.sin((deg | 0) * Math.PI / 180) * 1024);
+    }
+
+    /**
+     * Returns the cosine of an angle in whole degrees, times 1024, from a table.
+     * @param deg the angle in degrees, eg: 60
+     */
+    //% shim=Math_::icosDeg
+    //% help=math/icos-deg weight=8 advanced=true blockGap=8
+    export function icosDeg(deg: number): number {
+        return Math.round(Math.cos((deg | 0) * Math.PI / 180) * 1024);
+    }
 }
 
 namespace Number {
@@ -34,7 +34,7 @@ RefRecord *mkClassInstance(VTable *vtable) {
     intcheck(vtable->methods[0] == &RefRecord_destroy, PANIC_SIZE, 3);
     // intcheck(vtable->methods[1] == &RefRecord_print, PANIC_SIZE, 4);
 
-    void *ptr = gcAllocate(vtable->numbytes);
+    void *ptr = gcAllocateFixed(vtable->numbytes);
     RefRecord *r = new (ptr) RefRecord(vtable);
     memset(r->fields, 0, vtable->numbytes - sizeof(RefRecord));
     MEMDBG("mkClass: vt=%p => %p", vtable, r);
@@ -54,12 +54,14 @@ TValue RefRecord::ldref(int idx) {
 
 void RefRecord::st(int idx, TValue v) {
     // intcheck((reflen == 255 ? 0 : reflen) <= idx && idx < len, PANIC_OUT_OF_BOUNDS, 3);
+    gcWriteBarrier(this, v);
     fields[idx] = v;
 }
 
 void RefRecord::stref(int idx, TValue v) {
     // DMESG("ST %p len=%d reflen=%d idx=%d", this, len, reflen, idx);
     // intcheck(0 <= idx && idx < reflen, PANIC_OUT_OF_BOUNDS, 4);
+    gcWriteBarrier(this, v);
     fields[idx] = v;
 }
 
@@ -84,6 +86,7 @@ void RefRecord_print(RefRecord *r) {
 
 void Segment::set(unsigned i, TValue value) {
     if (i < size) {
+        gcWriteBarrierArray(data, value);
         data[i] = value;
     } else if (i < Segment::MaxSize) {
         growByMin(i + 1);
@@ -110,12 +113,9 @@ static inline int growthFactor(int size) {
     if (size < 64) {
         return size * 2; // Double
     }
-    if (size < 512) {
-        return size * 5 / 3; // Grow by 1.66 rate
-    }
-    // Grow by constant rate
-    if ((unsigned)size + 256 < Segment::MaxSize)
-        return size + 256;
+    // Grow by 1.5 rate; growing by a constant would make pushes quadratic
+    if ((unsigned)size * 3 / 2 < Segment::MaxSize)
+        return size * 3 / 2;
     else
         return Segment::MaxSize;
 }
@@ -190,16 +190,36 @@ void Segment::growByMin(ramint_t minSize) {
 
         data = tmp;
         size = newSize;
+        gcRememberSegment(this);
 
 #ifdef DEBUG_BUILD
         DMESG("growBy - after reallocation");
         this->print();
 #endif
     }
-    // else { no shrinking yet; }
     return;
 }
 
+// Once the length drops to a quarter of the capacity, move the elements to a new array with
+// room for twice the length, so that arrays which spiked don't keep their peak capacity.
+// The old array is reclaimed by the next collection. This has to be called while all the
+// current elements are still in the segment, as the allocation may trigger a GC.
+void Segment::shrinkFor(ramint_t newLength) {
+    if (size <= SEGMENT_SHRINK_MIN_SIZE || newLength >= size / 4)
+        return;
+
+    ramint_t newSize = max((ramint_t)(newLength * 2), (ramint_t)(SEGMENT_SHRINK_MIN_SIZE / 2));
+    ramint_t keep = min(length, newSize);
+    TValue *tmp = (TValue *)(gcAllocateArray(newSize * sizeof(TValue)));
+    memcpy(tmp, data, keep * sizeof(TValue));
+    memset(tmp + keep, 0, (newSize - keep) * sizeof(TValue));
+
+    data = tmp;
+    size = newSize;
+    length = keep;
+    gcRememberSegment(this);
+}
+
 void Segment::ensure(ramint_t newSize) {
     if (newSize < size) {
         return;
@@ -210,6 +230,10 @@ void Segment::ensure(ramint_t newSize) {
 void Segment::setLength(unsigned newLength) {
     if (newLength > size) {
         ensure(newLength);
+    } else if (newLength < length) {
+        shrinkFor(newLength);
+        // elements beyond length are not scanned by the GC, so they must not come back
+        memset(data + newLength, 0, (length - newLength) * sizeof(TValue));
     }
     length = newLength;
     return;
@@ -222,6 +246,7 @@ TValue Segment::pop() {
 #endif
 
     if (length > 0) {
+        shrinkFor(length - 1);
         --length;
         TValue value = data[length];
         data[length] = Segment::DefaultValue;
@@ -238,6 +263,7 @@ TValue Segment::remove(unsigned i) {
     this->print();
 #endif
     if (i < length) {
+        shrinkFor(length - 1);
         // value to return
         TValue ret = data[i];
         if (i + 1 < length) {
@@ -268,6 +294,7 @@ void Segment::insert(unsigned i, TValue value) {
         // Move the rest of the elements to fill in the gap.
         memmove(data + i + 1, data + i, (length - i) * sizeof(void *));
 
+        gcWriteBarrierArray(data, value);
         data[i] = value;
         length++;
     } else {
@@ -335,17 +362,144 @@ void RefRefLocal::destroy(RefRefLocal *t) {
     decr(t->v);
 }
 
-PXT_VTABLE_CTOR(RefMap) {}
+int MapShape::findIdx(String key) {
+    // fast path
+    for (unsigned i = 0; i < numKeys; ++i) {
+        if (keys[i] == key)
+            return i;
+    }
+
+    auto keylen = key->getUTF8Size();
+    auto keydata = key->getUTF8Data();
+    for (unsigned i = 0; i < numKeys; ++i) {
+        auto s = keys[i];
+        if (s->getUTF8Size() == keylen && memcmp(keydata, s->getUTF8Data(), keylen) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+MapShape *MapShape::withKey(String key) {
+    auto keylen = key->getUTF8Size();
+    auto keydata = key->getUTF8Data();
+
+    for (auto p = firstChild; p; p = p->nextSibling) {
+        auto s = p->keys[numKeys];
+        if (s == key ||
+            (s->getUTF8Size() == keylen && memcmp(keydata, s->getUTF8Data(), keylen) == 0))
+            return p;
+    }
+
+    // keys computed at runtime suggest the map is used as a dictionary
+    if (!isReadOnly((TValue)key) || numKeys >= PXT_MAP_SHAPE_MAX_KEYS)
+        return NULL;
+
+    auto r = (MapShape *)app_alloc(sizeof(MapShape) + (numKeys + 1) * sizeof(String));
+    r->firstChild = NULL;
+    r->numKeys = numKeys + 1;
+    memcpy(r->keys, keys, numKeys * sizeof(String));
+    r->keys[numKeys] = key;
+    r->nextSibling = firstChild;
+    firstChild = r;
+    return r;
+}
+
+PXT_VTABLE_CTOR(RefMap) {
+    shape = NULL;
+    index = NULL;
+    indexMask = 0;
+}
 
 void RefMap::destroy(RefMap *t) {
     t->keys.destroy();
     t->values.destroy();
+    t->index = NULL;
+}
+
+static inline uint32_t mapKeyHash(String key) {
+    return hash_fnv1(key->getUTF8Data(), key->getUTF8Size());
+}
+
+void RefMap::indexKey(ramint_t *idx, unsigned i) {
+    auto h = mapKeyHash((String)keys.get(i)) & indexMask;
+    while (idx[h])
+        h = (h + 1) & indexMask;
+    idx[h] = i + 1;
+}
+
+void RefMap::buildIndex() {
+    auto len = keys.getLength();
+    unsigned numSlots = 32;
+    while (numSlots < len * 2)
+        numSlots <<= 1;
+    if (numSlots > PXT_MAP_INDEX_MAX_SLOTS) {
+        index = NULL;
+        return;
+    }
+
+    // this may trigger GC - only store the index when it's complete
+    auto idx = (ramint_t *)gcAllocateArray(numSlots * sizeof(ramint_t));
+    memset(idx, 0, numSlots * sizeof(ramint_t));
+    indexMask = numSlots - 1;
+    for (unsigned i = 0; i < len; ++i)
+        indexKey(idx, i);
+    index = idx;
+    gcRememberObject(this);
+}
+
+void RefMap::keyAdded() {
+    if (!index)
+        return;
+    auto len = keys.getLength();
+    // keep the load factor under 1/2
+    if (len * 2 > indexMask + 1)
+        buildIndex();
+    else
+        indexKey(index, len - 1);
+}
+
+void RefMap::keysRemoved() {
+    // indices of the following keys have shifted; rebuild lazily on next lookup
+    index = NULL;
+}
+
+void RefMap::toDictionary() {
+    if (!shape)
+        return;
+    auto sh = shape;
+    // keys are read-only, so it's fine for them to be only referenced from the shape for now
+    keys.setLength(sh->numKeys);
+    memcpy(keys.getData(), sh->keys, sh->numKeys * sizeof(String));
+    shape = NULL;
 }
 
 int RefMap::findIdx(String key) {
+    if (shape)
+        return shape->findIdx(key);
+
     auto len = keys.getLength();
     auto data = (String *)keys.getData();
 
+    if (!index && len >= PXT_MAP_INDEX_MIN_KEYS && len * 2 <= PXT_MAP_INDEX_MAX_SLOTS)
+        buildIndex();
+
+    if (index) {
+        auto keylen = key->getUTF8Size();
+        auto keydata = key->getUTF8Data();
+        auto h = hash_fnv1(keydata, keylen) & indexMask;
+        for (;;) {
+            auto e = index[h];
+            if (!e)
+                return -1;
+            auto s = data[e - 1];
+            if (s == key ||
+                (s->getUTF8Size() == keylen && memcmp(keydata, s->getUTF8Data(), keylen) == 0))
+                return e - 1;
+            h = (h + 1) & indexMask;
+        }
+    }
+
     // fast path
     for (unsigned i = 0; i < len; ++i) {
         if (data[i] == key)
@@ -365,7 +519,7 @@ int RefMap::findIdx(String key) {
 }
 
 void RefMap::print(RefMap *t) {
-    DMESG("RefMap %p size=%d", t, t->keys.getLength());
+    DMESG("RefMap %p size=%d shape=%p", t, t->numKeys(), t->shape);
 }
 
 void debugMemLeaks() {}
@@ -376,9 +530,9 @@ void error(PXT_PANIC code, int subcode) {
 }
 
 #ifndef PXT_VM
-uint16_t *bytecode;
+PXT_TLS uint16_t *bytecode;
 #endif
-TValue *globals;
+PXT_TLS TValue *globals;
 
 void checkStr(bool cond, const char *msg) {
     if (!cond) {
@@ -494,13 +648,13 @@ RefCollection *keysOf(TValue v) {
     if (getAnyVTable(v) != &RefMap_vtable)
         return r;
     auto rm = (RefMap *)v;
-    auto len = rm->keys.getLength();
+    auto len = rm->numKeys();
     if (!len)
         return r;
     registerGCObj(r);
     r->setLength(len);
     auto dst = r->getData();
-    memcpy(dst, rm->keys.getData(), len * sizeof(TValue));
+    memcpy(dst, rm->keyData(), len * sizeof(TValue));
     unregisterGCObj(r);
     return r;
 }
@@ -510,8 +664,10 @@ TValue mapDeleteByString(RefMap *map, String key) {
         target_panic(PANIC_DELETE_ON_CLASS);
     int i = map->findIdx(key);
     if (i >= 0) {
+        map->toDictionary();
         map->keys.remove(i);
         map->values.remove(i);
+        map->keysRemoved();
     }
     return TAG_TRUE;
 }
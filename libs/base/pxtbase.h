@@ -58,6 +58,11 @@ void *operator new(size_t size);
 #include "platform.h"
 #include "pxtcore.h"
 
+// runtime state is thread-local when several VM instances run in one process
+#ifndef PXT_TLS
+#define PXT_TLS
+#endif
+
 #ifndef PXT_REGISTER_RESET
 #define PXT_REGISTER_RESET(fn) ((void)0)
 #endif
@@ -146,6 +151,9 @@ unsigned afterProgramPage();
 //%
 void dumpDmesg();
 uint32_t hash_fnv1(const void *data, unsigned len);
+// CRC32 of a prefix of the data, on chips that have a CRC unit; returns the number of bytes
+// it did, and updates the state, which starts at 0xffffffff (so not yet complemented)
+unsigned crc32Hardware(const uint8_t *data, unsigned len, uint32_t *state);
 
 // also defined DMESG macro
 // end
@@ -291,8 +299,8 @@ typedef enum {
 } PXT_PANIC;
 
 extern const uintptr_t functionsAndBytecode[];
-extern TValue *globals;
-extern uint16_t *bytecode;
+extern PXT_TLS TValue *globals;
+extern PXT_TLS uint16_t *bytecode;
 class RefRecord;
 
 // Utility functions
@@ -339,6 +347,24 @@ void anyPrint(TValue v);
 
 //%
 int getConfig(int key, int defl = -1);
+// the value of key in the config, if it's there
+bool lookupConfig(int key, int *value);
+
+// getConfig() for keys read on hot paths, eg. on every read of a button; the config doesn't
+// change while the program runs, so key is only looked up the first time
+template <int key> int getConfigCached(int defl = -1) {
+#ifdef PXT_VM
+    return getConfig(key, defl);
+#else
+    static bool looked, found;
+    static int value;
+    if (!looked) {
+        looked = true;
+        found = lookupConfig(key, &value);
+    }
+    return found ? value : defl;
+#endif
+}
 
 //%
 int toInt(TNumber v);
@@ -378,6 +404,10 @@ struct HandlerBinding {
     int source;
     int value;
     Action action;
+    // next in the same bucket of the (source, value) index
+    HandlerBinding *hashNext;
+    // increasing in creation order; [next] always points to a lower one
+    uint32_t seq;
 };
 HandlerBinding *findBinding(int source, int value);
 HandlerBinding *nextBinding(HandlerBinding *curr, int source, int value);
@@ -422,6 +452,21 @@ inline void oops(int subcode = 0) {
 }
 
 class RefObject;
+class Segment;
+
+// Write barriers; these need to be called when a (possibly) GC-allocated value is stored
+// in an existing object, outside of the object initialization.
+#if defined(PXT_GC_NURSERY) || defined(PXT_GC_INCREMENTAL)
+void gcWriteBarrier(RefObject *obj, TValue v);
+void gcWriteBarrierArray(TValue *data, TValue v);
+void gcRememberObject(RefObject *obj);
+void gcRememberSegment(Segment *seg);
+#else
+inline void gcWriteBarrier(RefObject *, TValue) {}
+inline void gcWriteBarrierArray(TValue *, TValue) {}
+inline void gcRememberObject(RefObject *) {}
+inline void gcRememberSegment(Segment *) {}
+#endif
 
 typedef void (*RefObjectMethod)(RefObject *self);
 typedef unsigned (*RefObjectSizeMethod)(RefObject *self);
@@ -533,6 +578,11 @@ class RefObject {
     inline bool isReadOnly() { return pxt::isReadOnly((TValue)this); }
 };
 
+// segments with at most this capacity are never shrunk
+#ifndef SEGMENT_SHRINK_MIN_SIZE
+#define SEGMENT_SHRINK_MIN_SIZE 32
+#endif
+
 class Segment {
   private:
     TValue *data;
@@ -542,6 +592,7 @@ class Segment {
     // this just gives max value of ramint_t
     void growByMin(ramint_t minSize);
     void ensure(ramint_t newSize);
+    void shrinkFor(ramint_t newLength);
 
   public:
     static constexpr ramint_t MaxSize = (((1U << (8 * sizeof(ramint_t) - 1)) - 1) << 1) + 1;
@@ -566,6 +617,8 @@ class Segment {
     void print();
 
     TValue *getData() { return data; }
+    // for the GC, which may move the data
+    TValue **dataField() { return &data; }
 };
 
 // Low-Level segment using system malloc
@@ -576,7 +629,7 @@ class LLSegment {
     ramint_t size;
 
   public:
-    LLSegment() : data(nullptr), length(0), size(0) {}
+    constexpr LLSegment() : data(nullptr), length(0), size(0) {}
 
     void set(unsigned idx, TValue v);
     void push(TValue value) { set(length, value); }
@@ -608,10 +661,40 @@ class RefCollection : public RefObject {
     TValue *getData() { return head.getData(); }
 };
 
+// Shared, immutable ordered list of keys of a RefMap (a "hidden class").
+// Shapes only ever hold read-only (literal) keys, and are allocated with app_alloc(),
+// so the GC doesn't need to scan them.
+#ifndef PXT_MAP_SHAPE_MAX_KEYS
+#define PXT_MAP_SHAPE_MAX_KEYS 32
+#endif
+
+struct MapShape {
+    MapShape *firstChild;  // shapes with one more key
+    MapShape *nextSibling; // other shapes with the same parent
+    uint32_t numKeys;
+    BoxedString *keys[0];
+
+    int findIdx(BoxedString *key);
+    // returns NULL if the key can't be part of a shape
+    MapShape *withKey(BoxedString *key);
+};
+
+// maps with at least this many keys get a hash index over keys[]
+#ifndef PXT_MAP_INDEX_MIN_KEYS
+#define PXT_MAP_INDEX_MIN_KEYS 16
+#endif
+// the index is a single GC array, so it has to stay well below the GC block size
+#define PXT_MAP_INDEX_MAX_SLOTS 2048
+
 class RefMap : public RefObject {
   public:
+    // when shape is set, keys[] is empty and values[] is indexed as shape->keys[]
+    MapShape *shape;
     Segment keys;
     Segment values;
+    // open-addressed; entries are indices into keys[] plus one, 0 means empty slot
+    ramint_t *index;
+    uint32_t indexMask;
 
     RefMap();
     static void destroy(RefMap *map);
@@ -619,6 +702,18 @@ class RefMap : public RefObject {
     static unsigned gcsize(RefMap *coll);
     static void print(RefMap *map);
     int findIdx(BoxedString *key);
+    // to be called after keys[] is modified
+    void keyAdded();
+    void keysRemoved();
+    // switch from shared shape to own keys[]
+    void toDictionary();
+
+    unsigned numKeys() { return shape ? shape->numKeys : keys.getLength(); }
+    TValue *keyData() { return shape ? (TValue *)shape->keys : keys.getData(); }
+
+  private:
+    void buildIndex();
+    void indexKey(ramint_t *idx, unsigned i);
 };
 
 // A ref-counted, user-defined JS object.
@@ -636,7 +731,8 @@ class RefRecord : public RefObject {
 };
 
 static inline VTable *getVTable(RefObject *r) {
-    return (VTable *)(r->vtable & ~1);
+    // the second bit is only set while compacting, see gc.cpp
+    return (VTable *)(r->vtable & ~3);
 }
 
 static inline VTable *getAnyVTable(TValue v) {
@@ -687,6 +783,7 @@ class RefAction : public RefObject {
         // DMESG("ST [%d] = %d ", idx, v); this->print();
         intcheck(0 <= idx && idx < len, PANIC_OUT_OF_BOUNDS, 10);
         intcheck(fields[idx] == 0, PANIC_OUT_OF_BOUNDS, 11); // only one assignment permitted
+        gcWriteBarrier(this, v);
         fields[idx] = v;
     }
 };
@@ -727,6 +824,9 @@ class BoxedString : public RefObject {
         struct {
             BoxedString *left;
             BoxedString *right;
+            // cached, so that these don't need flattening
+            uint16_t size;
+            uint16_t length;
         } cons;
         struct {
             uint16_t size;
@@ -807,9 +907,15 @@ class BoxedBuffer : public RefObject {
 // 87 BB WW WW HH HH 00 00 DATA
 // that is: 0x87, 0x01 or 0x04 - bpp, width in little endian, height, 0x00, 0x00 followed by data
 // for 4 bpp images, rows are word-aligned (as in legacy)
+// 8 and 16 bpp images (hosted targets only) are row-major instead: a palette index or a little
+// endian RGB565 color per pixel, row after row without padding
 
 #define IMAGE_HEADER_MAGIC 0x87
 
+// Compressed 4 bpp images have the same header with this magic, followed by run-length encoded
+// columns; they are drawn straight from the buffer (see image.cpp)
+#define IMAGE_RLE_MAGIC 0x88
+
 struct ImageHeader {
     uint8_t magic;
     uint8_t bpp;
@@ -822,6 +928,8 @@ struct ImageHeader {
 class RefImage : public RefObject {
   public:
     BoxedBuffer *buffer;
+    // opaque spans of a 4bpp image, built when it's first drawn transparently; see image.cpp
+    BoxedBuffer *spans;
 
     RefImage(BoxedBuffer *buf);
     RefImage(uint32_t sz);
@@ -839,7 +947,11 @@ class RefImage : public RefObject {
     int wordHeight();
     int bpp() { return header()->bpp; }
 
-    bool hasPadding() { return (height() & 0x7) != 0; }
+    bool hasPadding() { return bpp() <= 4 && (height() & 0x7) != 0; }
+
+    // 8 or 16 bpp, stored row-major
+    bool isWide() { return bpp() >= 8; }
+    int rowBytes() { return width() * (bpp() >> 3); }
 
     uint8_t *pix() { return header()->pixels; }
 
@@ -855,6 +967,8 @@ class RefImage : public RefObject {
     }
 
     uint8_t *pix(int x, int y) {
+        if (isWide())
+            return &pix()[rowBytes() * y + x * (bpp() >> 3)];
         uint8_t *d = &pix()[byteHeight() * x];
         if (y) {
             if (bpp() == 1)
@@ -869,6 +983,8 @@ class RefImage : public RefObject {
     bool inRange(int x, int y);
     void clamp(int *x, int *y);
     void makeWritable();
+    // same, when only pixels in the given rectangle (possibly out of range) change
+    void makeWritable(int x, int y, int w, int h);
 
     static void destroy(RefImage *t);
     static void scan(RefImage *t);
@@ -877,6 +993,12 @@ class RefImage : public RefObject {
 };
 
 RefImage *mkImage(int w, int h, int bpp);
+// RGB565 colors of 1 and 4 bpp images drawn on 16 bpp ones, from n <= 16 RGB triplets
+void setImagePalette(const uint8_t *rgb, int n);
+// area of img changed since the previous call, for display drivers, and with bands the changed
+// bands of dirtyBandWidth() columns as a bit mask; see image.cpp
+bool takeDirtyRect(RefImage *img, int *x, int *y, int *w, int *h, uint32_t *bands = NULL);
+int dirtyBandWidth(RefImage *img);
 
 typedef BoxedBuffer *Buffer;
 typedef BoxedString *String;
@@ -918,6 +1040,7 @@ void seedRandom(unsigned seed);
 void seedAddRandom(unsigned seed);
 // max is inclusive
 unsigned getRandom(unsigned max);
+void fillRandom(uint8_t *dst, unsigned len);
 
 ValType valType(TValue v);
 
@@ -937,6 +1060,8 @@ static inline void unregisterGCObj(RefObject *ptr) {
     unregisterGCPtr((TValue)ptr);
 }
 void gc(int flags);
+// total time spent in GC pauses so far
+uint64_t gcPauseTotalUs();
 
 struct StackSegment {
     void *top;
@@ -974,11 +1099,32 @@ void setThreadContext(ThreadContext *ctx);
 void gcProcessStacks(int flags);
 #endif
 
+// The CPU use of a fiber, for control.fiberStats(); platforms that can't tell report none.
+#define PXT_MAX_FIBER_STATS 24
+struct FiberStats {
+    uint32_t id;
+    uint32_t runUs;
+    uint32_t switches;
+    uint32_t stackBytes; // at most, so far
+    uint32_t handler;    // where the code the fiber was started for is, or 0
+};
+int getFiberStats(FiberStats *dest, int max);
+
 void gcProcess(TValue v);
+// gcProcess() of each, but draining the work queue only once
+void gcProcessMany(TValue *data, unsigned len);
+#ifdef PXT_GC_COMPACT
+// keep the object v points into in place; for conservatively scanned words, which may not be
+// values, and so can't be given to gcProcess()
+void gcPin(TValue v);
+#endif
 void gcFreeze();
+// the one string of all the equal ones passed here, weakly held; see control.intern()
+String gcInternString(String s);
 #ifdef PXT_VM
 void gcStartup();
 void gcPreStartup();
+void *gcPreallocDone();
 void *gcPrealloc(int numbytes);
 bool inGCPrealloc();
 #else
@@ -992,11 +1138,31 @@ void gcReset();
 void systemReset();
 
 void *gcAllocate(int numbytes);
+void *gcAllocateFixed(int numbytes);
 void *gcAllocateArray(int numbytes);
+#ifndef PXT64
+#ifndef PXT_BOX_CACHE
+// number of recently boxed doubles fromDouble() re-uses; 0 to disable
+#define PXT_BOX_CACHE 32
+#endif
+#if PXT_BOX_CACHE
+struct BoxCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+};
+extern PXT_TLS BoxCacheStats boxCacheStats;
+#endif
+#endif
 extern "C" void *app_alloc(int numbytes);
 extern "C" void *app_free(void *ptr);
 extern "C" void *app_alloc_at(void *at, int numbytes);
 void gcPreAllocateBlock(uint32_t sz);
+#ifdef PXT_GC_INCREMENTAL
+// do a bit of marking work; called between fiber switches
+void gcIncrementalStep();
+#else
+inline void gcIncrementalStep() {}
+#endif
 
 #ifdef PXT64
 #define TOWORDS(bytes) (((bytes) + 7) >> 3)
@@ -1008,7 +1174,7 @@ void gcPreAllocateBlock(uint32_t sz);
 #define soft_panic target_panic
 #endif
 
-extern int debugFlags;
+extern PXT_TLS int debugFlags;
 
 enum class PerfCounters {
     GC,
@@ -1025,7 +1191,7 @@ struct PerfCounter {
     uint32_t start;
 };
 
-extern struct PerfCounter *perfCounters;
+extern PXT_TLS struct PerfCounter *perfCounters;
 
 void initPerfCounters();
 //%
@@ -1041,10 +1207,59 @@ inline void initPerfCounters() {}
 inline void dumpPerfCounters() {}
 #endif
 
+// Binary trace: fixed-size records of (time, event, two arguments) in a ring, cheap enough to
+// leave in hot paths. Build with PXT_TRACE; otherwise the macros compile to nothing.
+// scripts/trace2json.js turns a dump into Chrome trace JSON; keep its names in sync.
+enum class TraceEvent {
+    None,
+    FiberRun,      // fiber, 0; it runs until the next one
+    EventDispatch, // source, value
+    GC,            // flags, 0
+    GCEnd,
+    ScreenUpdate, // width, height
+    ScreenUpdateEnd,
+    MixerFill, // samples, 0
+    MixerFillEnd,
+    User = 0x100, // and up, for anything else
+};
+
+#ifdef PXT_TRACE
+#ifndef PXT_TRACE_SIZE
+#define PXT_TRACE_SIZE 512 // records; power of 2
+#endif
+
+struct TraceRecord {
+    uint32_t time; // us
+    uint32_t event;
+    uint32_t arg0;
+    uint32_t arg1;
+};
+
+void traceEvent(int event, uint32_t arg0, uint32_t arg1);
+// copy the records, oldest first, as many as fit; returns the number of bytes
+int traceRead(uint8_t *dst, int maxSize);
+
+// an event, and the one after it in TraceEvent when leaving the scope
+struct TraceSpan {
+    int event;
+    TraceSpan(int event, uint32_t arg0, uint32_t arg1) : event(event) {
+        traceEvent(event, arg0, arg1);
+    }
+    ~TraceSpan() { traceEvent(event + 1, 0, 0); }
+};
+
+#define PXT_TRACE_EVENT(ev, a, b) pxt::traceEvent((int)pxt::TraceEvent::ev, a, b)
+#define PXT_TRACE_SPAN(ev, a, b) pxt::TraceSpan _traceSpan((int)pxt::TraceEvent::ev, a, b)
+#else
+#define PXT_TRACE_EVENT(ev, a, b) ((void)0)
+#define PXT_TRACE_SPAN(ev, a, b) ((void)0)
+#endif
+
 #ifdef PXT_VM
 String mkInternalString(const char *str);
 #define PXT_DEF_STRING(name, val) String name = mkInternalString(val);
-#else
+#elif !defined(PXT_DEF_STRING)
+// the compiler finds these in the binary, and puts the vtable and length over the "@PXT@:"
 #define PXT_DEF_STRING(name, val)                                                                  \
     static const char name[] __attribute__((aligned(4))) = "@PXT@:" val;
 #endif
@@ -1085,6 +1300,10 @@ TValue mapGet(RefMap *map, unsigned key);
 void mapSetByString(RefMap *map, String key, TValue val);
 //%
 void mapSet(RefMap *map, unsigned key, TValue val);
+// like lookupMapKey(), for a key that isn't a String yet
+int lookupMapKeyData(const char *data, unsigned len);
+// the literal String of a key returned by lookupMapKey()
+String mapKeyName(int key);
 } // namespace pxtrt
 
 namespace pins {
@@ -1094,6 +1313,8 @@ Buffer createBuffer(int size);
 namespace String_ {
 //%
 int compare(String a, String b);
+// stops at the first character that isn't part of the number
+NUMBER mystrtod(const char *p, char **endp);
 } // namespace String_
 
 namespace Array_ {
@@ -1119,6 +1340,8 @@ void insertAt(RefCollection *c, int x, TValue value);
 int indexOf(RefCollection *c, TValue x, int start);
 //%
 bool removeElement(RefCollection *c, TValue x);
+// exposed as pxt::sortArray
+bool sort(RefCollection *c, Action cmp);
 } // namespace Array_
 
 #define NEW_GC(T, ...) new (gcAllocate(sizeof(T))) T(__VA_ARGS__)
@@ -0,0 +1,285 @@
+/**
+ * A fixed number of bytes or numbers in one format, kept in order in a buffer that wraps around,
+ * eg. a sliding window of sensor samples. Adding and removing elements at either end doesn't
+ * move the others, and when it is full push() drops the oldest element.
+ */
+class RingBuffer {
+    /**
+     * The buffer holding the elements; see linearize()
+     */
+    buffer: Buffer
+    protected format: NumberFormat
+    protected elementSize: number
+    protected start: number
+    protected count: number
+
+    /**
+     * @param capacity the most elements it holds
+     * @param format the format of the elements; bytes if not given
+     */
+    constructor(capacity: number, format = NumberFormat.UInt8LE) {
+        this.format = format
+        this.elementSize = Buffer.sizeOfNumberFormat(format)
+        this.buffer = Buffer.create(Math.max(1, capacity) * this.elementSize)
+        this.start = 0
+        this.count = 0
+    }
+
+    /**
+     * The most elements it holds
+     */
+    get capacity() {
+        return Math.idiv(this.buffer.length, this.elementSize)
+    }
+
+    /**
+     * Number of elements in it
+     */
+    get length() {
+        return this.count
+    }
+
+    /**
+     * Remove all elements
+     */
+    clear() {
+        this.start = 0
+        this.count = 0
+    }
+
+    // position in buffer, in elements, of the element at index, counting from the oldest
+    protected wrap(index: number) {
+        const i = this.start + index
+        const cap = this.capacity
+        return i >= cap ? i - cap : i
+    }
+
+    protected offset(index: number) {
+        return this.wrap(index) * this.elementSize
+    }
+
+    /**
+     * Get the element at `index`, 0 being the oldest; undefined when there is none
+     */
+    get(index: number): number {
+        if (index < 0 || index >= this.count)
+            return undefined
+        return this.buffer.getNumber(this.format, this.offset(index))
+    }
+
+    /**
+     * Set the element at `index`, 0 being the oldest
+     */
+    set(index: number, value: number) {
+        if (index >= 0 && index < this.count)
+            this.buffer.setNumber(this.format, this.offset(index), value)
+    }
+
+    /**
+     * Add an element after the newest one, dropping the oldest one when it is full
+     */
+    push(value: number) {
+        if (this.count == this.capacity) {
+            this.start = this.wrap(1)
+            this.count--
+        }
+        this.buffer.setNumber(this.format, this.offset(this.count), value)
+        this.count++
+    }
+
+    /**
+     * Remove the newest element and return it; undefined when it is empty
+     */
+    pop(): number {
+        if (this.count == 0)
+            return undefined
+        return this.buffer.getNumber(this.format, this.offset(--this.count))
+    }
+
+    /**
+     * Remove the oldest element and return it; undefined when it is empty
+     */
+    shift(): number {
+        if (this.count == 0)
+            return undefined
+        const r = this.buffer.getNumber(this.format, this.offset(0))
+        this.start = this.wrap(1)
+        this.count--
+        return r
+    }
+
+    /**
+     * Add the elements in `data`, in the format of the ring, after the newest one, dropping the
+     * oldest ones when they don't fit. They are copied with at most two writes.
+     */
+    pushBuffer(data: Buffer) {
+        const size = this.elementSize
+        const cap = this.capacity
+        let n = Math.idiv(data.length, size)
+        let srcOff = 0
+        if (n > cap) {
+            srcOff = (n - cap) * size
+            n = cap
+        }
+        if (n == 0)
+            return
+        const drop = this.count + n - cap
+        if (drop > 0) {
+            this.start = this.wrap(drop)
+            this.count -= drop
+        }
+        const end = this.offset(this.count)
+        const first = Math.min(n * size, this.buffer.length - end)
+        this.buffer.write(end, srcOff == 0 && first == data.length ? data : data.slice(srcOff, first))
+        if (first < n * size)
+            this.buffer.write(0, data.slice(srcOff + first, n * size - first))
+        this.count += n
+    }
+
+    /**
+     * Remove up to `count` of the oldest elements
+     */
+    discard(count: number) {
+        count = Math.max(0, Math.min(count, this.count))
+        this.start = this.wrap(count)
+        this.count -= count
+        if (this.count == 0)
+            this.start = 0
+    }
+
+    /**
+     * Remove up to `count` of the oldest elements, and return their bytes. When they don't wrap
+     * around, that is one slice() of `buffer`.
+     */
+    shiftBuffer(count: number) {
+        const size = this.elementSize
+        const n = Math.max(0, Math.min(count, this.count))
+        const first = Math.min(n, this.capacity - this.start)
+        let r: Buffer
+        if (first == n) {
+            r = this.buffer.slice(this.start * size, n * size)
+        } else {
+            r = Buffer.create(n * size)
+            r.write(0, this.buffer.slice(this.start * size, first * size))
+            r.write(first * size, this.buffer.slice(0, (n - first) * size))
+        }
+        this.discard(n)
+        return r
+    }
+
+    /**
+     * Remove up to `count` of the oldest bytes, and return them decoded as UTF-8; for rings of
+     * bytes. When they don't wrap around, they are decoded in place.
+     */
+    shiftString(count: number) {
+        const n = Math.max(0, Math.min(count, this.count))
+        if (this.start + n > this.capacity)
+            return this.shiftBuffer(n).toString()
+        const r = this.buffer.sliceToString(this.start * this.elementSize, n * this.elementSize)
+        this.discard(n)
+        return r
+    }
+
+    /**
+     * Move the oldest elements to `dst` from `offset` on, as many as fit; returns how many.
+     */
+    shiftInto(dst: Buffer, offset = 0) {
+        const size = this.elementSize
+        const n = Math.min(this.count, Math.idiv(dst.length - offset, size))
+        if (n <= 0)
+            return 0
+        const first = Math.min(n, this.capacity - this.start)
+        dst.write(offset, this.buffer.slice(this.start * size, first * size))
+        if (first < n)
+            dst.write(offset + first * size, this.buffer.slice(0, (n - first) * size))
+        this.discard(n)
+        return n
+    }
+
+    /**
+     * Index of the first element equal to `value`, from `start` on; -1 if there is none. Rings
+     * of bytes are searched natively.
+     */
+    indexOf(value: number, start = 0) {
+        start = Math.max(0, start)
+        if (this.format == NumberFormat.UInt8LE) {
+            const cap = this.capacity
+            let idx = start
+            while (idx < this.count) {
+                const pos = this.wrap(idx)
+                const n = Math.min(this.count - idx, cap - pos)
+                const r = this.buffer.indexOfByte(value, pos, n)
+                if (r >= 0)
+                    return idx + r - pos
+                idx += n
+            }
+            return -1
+        }
+        for (let i = start; i < this.count; ++i)
+            if (this.get(i) == value)
+                return i
+        return -1
+    }
+
+    // calls f() on the one or two runs of elements, in order; f gets element indices in buffer
+    protected runs(f: (start: number, count: number) => void) {
+        const cap = this.capacity
+        const first = Math.min(this.count, cap - this.start)
+        if (first > 0)
+            f(this.start, first)
+        if (first < this.count)
+            f(0, this.count - first)
+    }
+
+    /**
+     * Sum of all elements
+     */
+    sum() {
+        let r = 0
+        this.runs((start, count) => r += this.buffer.sumNumbers(this.format, start, count))
+        return r
+    }
+
+    /**
+     * Smallest element, or Infinity if it is empty
+     */
+    min() {
+        let r = Infinity
+        this.runs((start, count) => r = Math.min(r, this.buffer.minNumbers(this.format, start, count)))
+        return r
+    }
+
+    /**
+     * Largest element, or -Infinity if it is empty
+     */
+    max() {
+        let r = -Infinity
+        this.runs((start, count) => r = Math.max(r, this.buffer.maxNumbers(this.format, start, count)))
+        return r
+    }
+
+    /**
+     * Move the elements in place so that they are in order at the start of `buffer`, and return
+     * it; the oldest is at offset 0. Costs one pass over the buffer, when they wrap around.
+     */
+    linearize() {
+        if (this.start != 0) {
+            this.buffer.rotate(this.start * this.elementSize)
+            this.start = 0
+        }
+        return this.buffer
+    }
+
+    /**
+     * Copy the elements, oldest first, into a regular array
+     */
+    toArray(): number[] {
+        const r: number[] = []
+        this.runs((start, count) => {
+            const part = this.buffer.unpackNumbers(this.format, start * this.elementSize, count)
+            for (const v of part)
+                r.push(v)
+        })
+        return r
+    }
+}
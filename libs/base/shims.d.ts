@@ -66,6 +66,23 @@ declare interface Buffer {
     //% shim=BufferMethods::toString
     toString(): string;
 
+    /**
+     * Convert a fragment of a buffer to string assuming UTF8 encoding, without copying the fragment
+     * to a new buffer first.
+     * @param offset where the fragment starts, eg: 0
+     * @param length the number of bytes in it; if negative, the rest of the buffer, eg: -1
+     */
+    //% offset.defl=0 length.defl=-1 shim=BufferMethods::sliceToString
+    sliceToString(offset?: int32, length?: int32): string;
+
+    /**
+     * Return the offset of the first byte equal to `value` in a fragment of the buffer, or -1.
+     * @param start where the fragment starts, eg: 0
+     * @param length the number of bytes in it; if negative, the rest of the buffer, eg: -1
+     */
+    //% start.defl=0 length.defl=-1 shim=BufferMethods::indexOfByte
+    indexOfByte(value: int32, start?: int32, length?: int32): int32;
+
     /**
      * Convert a buffer to its hexadecimal representation.
      */
@@ -93,6 +110,102 @@ declare interface Buffer {
      */
     //% shim=BufferMethods::hash
     hash(bits: int32): uint32;
+
+    /**
+     * Compute the CRC32 checksum of the buffer (the one of zlib, PNG and Ethernet).
+     */
+    //% shim=BufferMethods::crc32
+    crc32(): uint32;
+
+    /**
+     * Compute the 32-bit xxHash of the buffer; much faster than hash(), and also non-cryptographic.
+     * @param seed changes the hash, eg: 0
+     */
+    //% seed.defl=0 shim=BufferMethods::hash32
+    hash32(seed?: int32): uint32;
+
+    /**
+     * Compute the SHA-256 digest of the buffer, as a new 32-byte buffer.
+     */
+    //% shim=BufferMethods::sha256
+    sha256(): Buffer;
+
+    /**
+     * Set `count` numbers in specified format, starting at element `start`, to `value`.
+     * The format is in the low byte of formatStart and start in the rest, to fit in 4 arguments.
+     */
+    //% shim=BufferMethods::_fillNumbers
+    _fillNumbers(formatStart: int32, value: number, count: int32): void;
+
+    /**
+     * Sum `count` numbers in specified format, starting at element `start`.
+     */
+    //% start.defl=0 count.defl=-1 shim=BufferMethods::sumNumbers
+    sumNumbers(format: NumberFormat, start?: int32, count?: int32): number;
+
+    /**
+     * Find the smallest of `count` numbers in specified format, starting at element `start`.
+     */
+    //% start.defl=0 count.defl=-1 shim=BufferMethods::minNumbers
+    minNumbers(format: NumberFormat, start?: int32, count?: int32): number;
+
+    /**
+     * Find the largest of `count` numbers in specified format, starting at element `start`.
+     */
+    //% start.defl=0 count.defl=-1 shim=BufferMethods::maxNumbers
+    maxNumbers(format: NumberFormat, start?: int32, count?: int32): number;
+
+    /**
+     * Replace every number `x` in specified format with `x * mul + add`.
+     */
+    //% shim=BufferMethods::scaleNumbers
+    scaleNumbers(format: NumberFormat, mul: number, add: number): void;
+
+    /**
+     * Copy numbers from `src` in `srcFormat` to current buffer in `format`, converting them;
+     * copies as many as fit in both buffers.
+     */
+    //% shim=BufferMethods::copyNumbers
+    copyNumbers(format: NumberFormat, src: Buffer, srcFormat: NumberFormat): void;
+
+    /**
+     * Write numbers from `values` in specified format, starting at byte `offset`; writes as many as
+     * fit in the buffer, and returns how many that is.
+     */
+    //% shim=BufferMethods::packNumbers
+    packNumbers(format: NumberFormat, offset: int32, values: number[]): int32;
+
+    /**
+     * Read `count` numbers in specified format, starting at byte `offset`, into an array; by default
+     * all that fit in the buffer.
+     */
+    //% count.defl=-1 shim=BufferMethods::unpackNumbers
+    unpackNumbers(format: NumberFormat, offset: int32, count?: int32): number[];
+
+    /**
+     * Compress the buffer (LZ4 format, with the size in front), for storing or sending it.
+     * @param level from 1 (least memory, 1kB) to 5 (best, 16kB), eg: 3
+     */
+    //% level.defl=3 shim=BufferMethods::compress
+    compress(level?: int32): Buffer;
+
+    /**
+     * Return the data of a buffer made with compress(), or undefined if it is not valid.
+     */
+    //% shim=BufferMethods::decompress
+    decompress(): Buffer;
+
+    /**
+     * Convert a buffer to its base64 representation (standard alphabet, with padding).
+     */
+    //% shim=BufferMethods::toBase64
+    toBase64(): string;
+
+    /**
+     * Fill the buffer with random bytes.
+     */
+    //% shim=BufferMethods::fillRandom
+    fillRandom(): void;
 }
 declare namespace control {
 
@@ -109,6 +222,21 @@ declare namespace control {
      */
     //% deprecated=1 shim=control::createBufferFromUTF8
     function createBufferFromUTF8(str: string): Buffer;
+
+    /**
+     * Create a new buffer, decoding a hex string; undefined if it has anything but hex digits.
+     * @param str the hex digits, two for each byte
+     */
+    //% deprecated=1 shim=control::createBufferFromHex
+    function createBufferFromHex(str: string): Buffer;
+
+    /**
+     * Create a new buffer, decoding a base64 string; undefined if it is not valid base64.
+     * Whitespace and padding are skipped.
+     * @param str the base64 data
+     */
+    //% deprecated=1 shim=control::createBufferFromBase64
+    function createBufferFromBase64(str: string): Buffer;
 }
 declare namespace loops {
 
@@ -234,6 +362,44 @@ declare namespace control {
      */
     //% shim=control::profilingEnabled
     function profilingEnabled(): boolean;
+
+    /**
+     * Send the binary trace over serial, in hex after a "TRACE:" line, when it is enabled in the
+     * current build; scripts/trace2json.js reads it back.
+     */
+    //% shim=control::dumpTrace
+    function dumpTrace(): void;
+
+    /**
+     * Get the one string shared by all the equal strings interned, so that they compare, and are
+     * found in maps, by pointer. Strings equal to a property name become that name.
+     */
+    //% shim=control::intern
+    function intern(s: string): string;
+
+    /**
+     * Get the CPU use of each fiber, as five Int32LE values per fiber: an id, how long it ran
+     * for in us, how many times it was switched to, the most stack it used in bytes, and where
+     * the function it was started for is, or 0. On hardware the accounting starts with the
+     * first call, and samples the running fiber every millisecond.
+     */
+    //% shim=control::fiberStats
+    function fiberStats(): Buffer;
+}
+declare namespace JSON {
+
+    /**
+     * Parses JSON text; undefined when it isn't valid.
+     */
+    //% shim=JSON::_parse
+    function _parse(s: string): any;
+
+    /**
+     * Converts plain data to JSON text, indented by the given number of spaces; undefined when
+     * there is something else in it.
+     */
+    //% shim=JSON::_stringify
+    function _stringify(v: any, indent: int32): any;
 }
 
 // Auto-generated. Do not edit. Really.
@@ -29,6 +29,356 @@ namespace pxsim.BufferMethods {
         else
             return ((h ^ (h >>> bits)) & ((1 << bits) - 1)) >>> 0
     }
+
+    let crc32Table: Uint32Array
+
+    export function crc32(buf: RefBuffer) {
+        if (!crc32Table) {
+            crc32Table = new Uint32Array(256)
+            for (let i = 0; i < 256; ++i) {
+                let c = i
+                for (let k = 0; k < 8; ++k)
+                    c = c & 1 ? (c >>> 1) ^ 0xedb88320 : c >>> 1
+                crc32Table[i] = c
+            }
+        }
+        const data = buf.data
+        let crc = 0xffffffff
+        for (let i = 0; i < data.length; ++i)
+            crc = crc32Table[(crc ^ data[i]) & 0xff] ^ (crc >>> 8)
+        return ~crc >>> 0
+    }
+
+    export function hash32(buf: RefBuffer, seed = 0) {
+        const imul = (Math as any).imul
+        const P1 = 2654435761, P2 = 2246822519, P3 = 3266489917, P4 = 668265263, P5 = 374761393
+        const rotl = (x: number, r: number) => (x << r) | (x >>> (32 - r))
+        const round = (v: number, input: number) => imul(rotl((v + imul(input, P2)) | 0, 13), P1)
+        const data = buf.data
+        const n = data.length
+        const read32 = (p: number) => data[p] | (data[p + 1] << 8) | (data[p + 2] << 16) | (data[p + 3] << 24)
+        let p = 0
+        let h: number
+        seed |= 0
+        if (n >= 16) {
+            let v1 = (seed + P1 + P2) | 0, v2 = (seed + P2) | 0, v3 = seed, v4 = (seed - P1) | 0
+            for (; p + 16 <= n; p += 16) {
+                v1 = round(v1, read32(p))
+                v2 = round(v2, read32(p + 4))
+                v3 = round(v3, read32(p + 8))
+                v4 = round(v4, read32(p + 12))
+            }
+            h = (rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18)) | 0
+        } else {
+            h = (seed + P5) | 0
+        }
+        h = (h + n) | 0
+        for (; p + 4 <= n; p += 4)
+            h = imul(rotl((h + imul(read32(p), P3)) | 0, 17), P4)
+        for (; p < n; p++)
+            h = imul(rotl((h + imul(data[p], P5)) | 0, 11), P1)
+        h ^= h >>> 15
+        h = imul(h, P2)
+        h ^= h >>> 13
+        h = imul(h, P3)
+        h ^= h >>> 16
+        return h >>> 0
+    }
+
+    const sha256K = [
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    ]
+
+    // WebCrypto only has the async digest(), so this is done here
+    export function sha256(buf: RefBuffer): RefBuffer {
+        const n = buf.data.length
+        const padded = new Uint8Array(((n + 8) >> 6) * 64 + 64)
+        padded.set(buf.data)
+        padded[n] = 0x80
+        const bits = n * 8
+        for (let k = 0; k < 8; ++k)
+            padded[padded.length - 1 - k] = Math.floor(bits / Math.pow(2, k * 8)) & 0xff
+        const rotr = (x: number, r: number) => (x >>> r) | (x << (32 - r))
+        const state = [0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19]
+        const w = new Array<number>(64)
+        for (let off = 0; off < padded.length; off += 64) {
+            for (let i = 0; i < 16; ++i) {
+                const q = off + i * 4
+                w[i] = (padded[q] << 24) | (padded[q + 1] << 16) | (padded[q + 2] << 8) | padded[q + 3]
+            }
+            for (let i = 16; i < 64; ++i) {
+                const s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >>> 3)
+                const s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >>> 10)
+                w[i] = (w[i - 16] + s0 + w[i - 7] + s1) | 0
+            }
+            let [a, b, c, d, e, f, g, h] = state
+            for (let i = 0; i < 64; ++i) {
+                const t1 = (h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256K[i] + w[i]) | 0
+                const t2 = ((rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c))) | 0
+                h = g
+                g = f
+                f = e
+                e = (d + t1) | 0
+                d = c
+                c = b
+                b = a
+                a = (t1 + t2) | 0
+            }
+            const vals = [a, b, c, d, e, f, g, h]
+            for (let i = 0; i < 8; ++i)
+                state[i] = (state[i] + vals[i]) | 0
+        }
+        const res = BufferMethods.createBuffer(32)
+        for (let k = 0; k < 32; ++k)
+            res.data[k] = state[k >> 2] >>> (24 - (k & 3) * 8)
+        return res
+    }
+
+    function numberFormatSize(format: NumberFormat) {
+        switch (format) {
+            case NumberFormat.Int8LE:
+            case NumberFormat.UInt8LE:
+            case NumberFormat.Int8BE:
+            case NumberFormat.UInt8BE:
+                return 1
+            case NumberFormat.Int16LE:
+            case NumberFormat.UInt16LE:
+            case NumberFormat.Int16BE:
+            case NumberFormat.UInt16BE:
+                return 2
+            case NumberFormat.Float64LE:
+            case NumberFormat.Float64BE:
+                return 8
+            default:
+                return 4
+        }
+    }
+
+    function numberRange(buf: RefBuffer, format: NumberFormat, start: number, count: number) {
+        const total = Math.floor(buf.data.length / numberFormatSize(format))
+        if (start < 0 || start > total)
+            start = total
+        if (count < 0 || count > total - start)
+            count = total - start
+        return { start, count }
+    }
+
+    function forNumbers(buf: RefBuffer, format: NumberFormat, start: number, count: number,
+        f: (off: number) => void) {
+        const sz = numberFormatSize(format)
+        const r = numberRange(buf, format, start, count)
+        for (let i = r.start; i < r.start + r.count; ++i)
+            f(i * sz)
+        return r.count
+    }
+
+    export function sliceToString(buf: RefBuffer, offset = 0, length = -1) {
+        return BufferMethods.toString(BufferMethods.slice(buf, Math.max(0, offset), length))
+    }
+
+    export function indexOfByte(buf: RefBuffer, value: number, start = 0, length = -1) {
+        const data = buf.data
+        start = Math.max(0, Math.min(data.length, start))
+        const end = length < 0 ? data.length : Math.min(data.length, start + length)
+        const r = data.subarray(start, end).indexOf(value & 0xff)
+        return r < 0 ? -1 : start + r
+    }
+
+    export function _fillNumbers(buf: RefBuffer, formatStart: number, value: number, count: number) {
+        const format: NumberFormat = formatStart & 0xff
+        forNumbers(buf, format, formatStart >> 8, count, off => setNumber(buf, format, off, value))
+    }
+
+    export function sumNumbers(buf: RefBuffer, format: NumberFormat, start = 0, count = -1) {
+        let r = 0
+        forNumbers(buf, format, start, count, off => r += getNumber(buf, format, off))
+        return r
+    }
+
+    export function minNumbers(buf: RefBuffer, format: NumberFormat, start = 0, count = -1) {
+        let r = Infinity
+        forNumbers(buf, format, start, count, off => r = Math.min(r, getNumber(buf, format, off)))
+        return r
+    }
+
+    export function maxNumbers(buf: RefBuffer, format: NumberFormat, start = 0, count = -1) {
+        let r = -Infinity
+        forNumbers(buf, format, start, count, off => r = Math.max(r, getNumber(buf, format, off)))
+        return r
+    }
+
+    export function scaleNumbers(buf: RefBuffer, format: NumberFormat, mul: number, add: number) {
+        forNumbers(buf, format, 0, -1, off => setNumber(buf, format, off, getNumber(buf, format, off) * mul + add))
+    }
+
+    export function copyNumbers(buf: RefBuffer, format: NumberFormat, src: RefBuffer, srcFormat: NumberFormat) {
+        const srcSz = numberFormatSize(srcFormat)
+        const count = Math.min(numberRange(buf, format, 0, -1).count, numberRange(src, srcFormat, 0, -1).count)
+        forNumbers(buf, format, 0, count, off => {
+            const v = getNumber(src, srcFormat, off / numberFormatSize(format) * srcSz)
+            setNumber(buf, format, off, v)
+        })
+    }
+
+    function numberBytes(buf: RefBuffer, format: NumberFormat, offset: number, count: number) {
+        const sz = numberFormatSize(format)
+        const fits = offset >= 0 && offset <= buf.data.length ? Math.floor((buf.data.length - offset) / sz) : 0
+        if (count < 0 || count > fits)
+            count = fits
+        return count
+    }
+
+    export function packNumbers(buf: RefBuffer, format: NumberFormat, offset: number, values: RefCollection) {
+        const sz = numberFormatSize(format)
+        const vals = values.toArray() as number[]
+        const count = numberBytes(buf, format, offset, vals.length)
+        for (let i = 0; i < count; ++i)
+            setNumber(buf, format, offset + i * sz, vals[i])
+        return count
+    }
+
+    export function unpackNumbers(buf: RefBuffer, format: NumberFormat, offset: number, count = -1) {
+        const sz = numberFormatSize(format)
+        count = numberBytes(buf, format, offset, count)
+        const res = new RefCollection()
+        for (let i = 0; i < count; ++i)
+            res.push(getNumber(buf, format, offset + i * sz))
+        return res
+    }
+
+    // same as lz4Compress() in buffer.cpp, which has the details
+    function lz4Length(out: number[], len: number) {
+        for (; len >= 255; len -= 255)
+            out.push(255)
+        out.push(len)
+    }
+
+    function lz4Sequence(out: number[], src: Uint8Array, lit: number, litLen: number, dist: number, matchLen: number) {
+        out.push((Math.min(litLen, 15) << 4) | (matchLen >= 0 ? Math.min(matchLen, 15) : 0))
+        if (litLen >= 15)
+            lz4Length(out, litLen - 15)
+        for (let i = 0; i < litLen; ++i)
+            out.push(src[lit + i])
+        if (matchLen >= 0) {
+            out.push(dist & 0xff, dist >> 8)
+            if (matchLen >= 15)
+                lz4Length(out, matchLen - 15)
+        }
+    }
+
+    export function compress(buf: RefBuffer, level = 3) {
+        const src = buf.data
+        const n = src.length
+        const hashLog = 8 + Math.max(1, Math.min(5, level))
+        const table = new Uint16Array(1 << hashLog)
+        const read32 = (p: number) => (src[p] | (src[p + 1] << 8) | (src[p + 2] << 16) | (src[p + 3] << 24)) >>> 0
+        const out = [n & 0xff, (n >> 8) & 0xff, (n >> 16) & 0xff, n >>> 24]
+        let anchor = 0
+        if (n > 12) {
+            const mfLimit = n - 12, matchLimit = n - 5
+            let ip = 0, misses = 0
+            while (ip < mfLimit) {
+                const seq = read32(ip)
+                const h = (Math as any).imul(seq, 2654435761) >>> (32 - hashLog)
+                const dist = (ip - table[h]) & 0xffff
+                table[h] = ip & 0xffff
+                if (dist == 0 || dist > ip || read32(ip - dist) != seq) {
+                    ip += 1 + (misses++ >> 6)
+                    continue
+                }
+                misses = 0
+                let match = ip - dist
+                while (ip > anchor && match > 0 && src[ip - 1] == src[match - 1]) {
+                    ip--
+                    match--
+                }
+                let p = ip + 4, m = match + 4
+                while (p < matchLimit && src[p] == src[m]) {
+                    p++
+                    m++
+                }
+                lz4Sequence(out, src, anchor, ip - anchor, dist, p - ip - 4)
+                ip = anchor = p
+            }
+        }
+        lz4Sequence(out, src, anchor, n - anchor, 0, -1)
+        const res = BufferMethods.createBuffer(out.length)
+        res.data.set(out)
+        return res
+    }
+
+    export function decompress(buf: RefBuffer): RefBuffer {
+        const src = buf.data
+        if (src.length < 4)
+            return undefined
+        const size = (src[0] | (src[1] << 8) | (src[2] << 16) | (src[3] << 24)) >>> 0
+        if (size > (src.length - 4) * 255 + 16)
+            return undefined
+        const res = BufferMethods.createBuffer(size)
+        const dst = res.data
+        let ip = 4, op = 0
+        const readLength = (len: number) => {
+            if (len == 15) {
+                let b = 255
+                while (b == 255) {
+                    if (ip >= src.length)
+                        return -1
+                    b = src[ip++]
+                    len += b
+                }
+            }
+            return len
+        }
+        while (ip < src.length) {
+            const token = src[ip++]
+            const litLen = readLength(token >> 4)
+            if (litLen < 0 || litLen > src.length - ip || litLen > size - op)
+                return undefined
+            dst.set(src.subarray(ip, ip + litLen), op)
+            ip += litLen
+            op += litLen
+            if (ip == src.length)
+                break
+            if (src.length - ip < 2)
+                return undefined
+            const dist = src[ip] | (src[ip + 1] << 8)
+            ip += 2
+            if (dist == 0 || dist > op)
+                return undefined
+            let matchLen = readLength(token & 15)
+            if (matchLen < 0 || matchLen + 4 > size - op)
+                return undefined
+            for (matchLen += 4; matchLen > 0; matchLen--, op++)
+                dst[op] = dst[op - dist]
+        }
+        return op == size ? res : undefined
+    }
+
+    export function fillRandom(buf: RefBuffer) {
+        const d = buf.data
+        for (let i = 0; i < d.length; ++i)
+            d[i] = Math.floor(Math.random() * 256)
+    }
+
+    const base64Alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+    export function toBase64(buf: RefBuffer) {
+        const src = buf.data
+        let r = ""
+        for (let i = 0; i < src.length; i += 3) {
+            const v = (src[i] << 16) | ((src[i + 1] || 0) << 8) | (src[i + 2] || 0)
+            r += base64Alphabet[v >> 18] + base64Alphabet[(v >> 12) & 63]
+            r += i + 1 < src.length ? base64Alphabet[(v >> 6) & 63] : "="
+            r += i + 2 < src.length ? base64Alphabet[v & 63] : "="
+        }
+        return r
+    }
 }
 
 namespace pxsim.control {
@@ -114,6 +464,35 @@ namespace pxsim.control {
     export function createBuffer(size: number) {
         return BufferMethods.createBuffer(size)
     }
+    export function createBufferFromHex(str: string): RefBuffer {
+        if (!/^([0-9a-fA-F][0-9a-fA-F])*[^]?$/.test(str))
+            return undefined
+        const res = BufferMethods.createBuffer(str.length >> 1)
+        for (let i = 0; i < res.data.length; ++i)
+            res.data[i] = parseInt(str.substr(i * 2, 2), 16)
+        return res
+    }
+    export function createBufferFromBase64(str: string): RefBuffer {
+        str = str.replace(/[=\s]/g, "").replace(/-/g, "+").replace(/_/g, "/")
+        if (!/^[A-Za-z0-9+/]*$/.test(str) || str.length % 4 == 1)
+            return undefined
+        const res = BufferMethods.createBuffer((str.length * 3) >> 2)
+        let acc = 0, n = 0, op = 0
+        for (let i = 0; i < str.length; ++i) {
+            acc = ((acc << 6) | "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/".indexOf(str[i])) & 0xffffff
+            if (++n == 4) {
+                res.data[op++] = acc >> 16
+                res.data[op++] = (acc >> 8) & 0xff
+                res.data[op++] = acc & 0xff
+                n = 0
+            }
+        }
+        if (n >= 2)
+            res.data[op++] = (acc >> (n == 2 ? 4 : 10)) & 0xff
+        if (n == 3)
+            res.data[op++] = (acc >> 2) & 0xff
+        return res
+    }
     export function dmesg(msg: string) {
         console.log(`DMESG: ${msg}`);
     }
@@ -158,6 +537,17 @@ namespace pxsim.control {
     export function profilingEnabled() {
         return !!runtime.perfCounters
     }
+    export function dumpTrace() { }
+
+    // JS strings compare by value already
+    export function intern(s: string) {
+        return s;
+    }
+
+    // the simulator has no fibers of its own to account for
+    export function fiberStats() {
+        return BufferMethods.createBuffer(0);
+    }
 
     export function __log(priority: number, str: string) {
         let prefix = "";
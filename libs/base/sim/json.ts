@@ -0,0 +1,18 @@
+// the one of the browser, which pxsim.JSON hides inside of the namespace
+const browserJSON = JSON
+
+namespace pxsim.JSON {
+    export function _parse(s: string): any {
+        try {
+            return browserJSON.parse(s)
+        } catch (e) {
+            console.log("Invalid JSON: " + e.message)
+            return undefined
+        }
+    }
+
+    export function _stringify(v: any, indent: number): any {
+        // json.ts does it, with the same output as on the devices
+        return undefined
+    }
+}
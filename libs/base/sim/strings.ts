@@ -0,0 +1,27 @@
+namespace pxsim.String_ {
+    // see splitOn() and replaceEvery() in core.cpp
+    export function splitOn(s: string, separator: string) {
+        const r = new RefCollection()
+        for (const part of s.split(separator))
+            r.push(part)
+        return r
+    }
+
+    export function replaceEvery(s: string, search: string, replacement: string) {
+        if (!search)
+            return s
+        return s.split(search).join(replacement)
+    }
+}
+
+namespace pxsim.Array_ {
+    // see joinWith() in core.cpp; undefined and null are empty
+    export function joinWith(c: RefCollection, separator: string) {
+        const parts: string[] = []
+        for (let i = 0; i < c.getLength(); ++i) {
+            const v = c.getAt(i)
+            parts.push(v === undefined || v === null ? "" : v + "")
+        }
+        return parts.join(separator)
+    }
+}
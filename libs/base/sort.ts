@@ -0,0 +1,43 @@
+namespace helpers {
+    //% shim=pxt::sortArray
+    declare function sortArray(arr: any[], cmp: (a: any, b: any) => number): boolean;
+
+    function mergeSort<T>(arr: T[], tmp: T[], lo: number, hi: number, cmp: (a: T, b: T) => number) {
+        if (hi - lo < 2)
+            return
+        const mid = (lo + hi) >> 1
+        mergeSort(arr, tmp, lo, mid, cmp)
+        mergeSort(arr, tmp, mid, hi, cmp)
+        if (cmp(arr[mid], arr[mid - 1]) >= 0)
+            return
+        for (let i = lo; i < mid; ++i)
+            tmp[i - lo] = arr[i]
+        let i = 0, j = mid, k = lo
+        const n = mid - lo
+        while (i < n && j < hi) {
+            if (cmp(arr[j], tmp[i]) < 0)
+                arr[k++] = arr[j++]
+            else
+                arr[k++] = tmp[i++]
+        }
+        while (i < n)
+            arr[k++] = tmp[i++]
+    }
+
+    export function arraySortStable<T>(arr: T[], cmp?: (a: T, b: T) => number): T[] {
+        if (!sortArray(arr, cmp))
+            mergeSort(arr, [], 0, arr.length, cmp)
+        return arr
+    }
+}
+
+interface Array<T> {
+    /**
+     * Sort the elements of the array in place, natively where possible, and return the array.
+     * The sort is stable. Without a comparator, numbers are sorted numerically, followed by NaN,
+     * strings, other objects and undefined.
+     * @param cmp returns a negative number if the first argument goes before the second one
+     */
+    //% helper=arraySortStable
+    sortStable(cmp?: (a: T, b: T) => number): T[];
+}
@@ -0,0 +1,28 @@
+interface String {
+    /**
+     * Split the string at each occurrence of separator, or into characters when it's empty.
+     * Like split(), but the parts are cut out natively, and the array is allocated once.
+     * @param separator the string to split at
+     */
+    //% shim=String_::splitOn
+    splitOn(separator: string): string[];
+
+    /**
+     * Replace every occurrence of search with replacement, natively and with a single
+     * allocation; nothing is replaced when search is empty.
+     * @param search the string to look for
+     * @param replacement the string to put in its place
+     */
+    //% shim=String_::replaceEvery
+    replaceEvery(search: string, replacement: string): string;
+}
+
+interface Array<T> {
+    /**
+     * Join the elements into a string with separator between them, as join() does, but natively
+     * and with a single allocation of the result.
+     * @param separator the string to put between the elements
+     */
+    //% shim=Array_::joinWith
+    joinWith(separator: string): string;
+}
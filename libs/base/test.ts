@@ -11,4 +11,54 @@ function check(cond:boolean) { control.assert(cond, 108) }
 
 check(Buffer.pack("<2h", [0x3412, 0x7856]).toHex() == "12345678")
 check(Buffer.pack(">hh", [0x3412, 0x7856]).toHex() == "34127856")
-check(Buffer.fromHex("F00d").toHex() == "f00d")
\ No newline at end of file
+check(Buffer.fromHex("F00d").toHex() == "f00d")
+check(Buffer.fromUTF8("fooba").toBase64() == "Zm9vYmE=" && Buffer.fromBase64("Zm9v\nYmE").toString() == "fooba")
+const lz = Buffer.fromUTF8("telemetry telemetry telemetry telemetry")
+check(lz.compress().length < lz.length && lz.compress().decompress().equals(lz))
+for (let k = 0; k < 20; ++k) {
+    const v = Math.randomRange(-3, 3)
+    check(v >= -3 && v <= 3 && v == (v | 0))
+}
+check(Math.isinDeg(30) == 512 && Math.isinDeg(-90) == -1024 && Math.icosDeg(420) == 512)
+const rnd = Buffer.create(33)
+rnd.fillRandom()
+check(!rnd.equals(Buffer.create(33)))
+const ta = new Int16Array(4)
+ta.fill(3, 1)
+ta.scale(2, -1)
+check(ta.sum() == 14 && ta.min() == -1 && ta.max() == 5)
+const fa = new Float32Array(4)
+fa.copyFrom(ta)
+check(fa.get(1) == 5 && fa.sum() == 14)
+const pb = Buffer.create(8)
+check(pb.packNumbers(NumberFormat.Int16BE, 2, [0x1234, -2, 7]) == 3 && pb.toHex() == "00001234fffe0007")
+check(pb.unpackNumbers(NumberFormat.UInt16LE, 2, 2).join(",") == "13330,65279")
+check(fa.setFromArray([1.5, 2], 2) == 2 && fa.get(3) == 2 && fa.toArray().join(",") == "-1,5,1.5,2")
+
+const sa = [3, 1.5, 2, -1]
+check(sa.sortStable().join(",") == "-1,1.5,2,3")
+const sb = ["b", "a", "c"]
+check(sb.sortStable((x, y) => x < y ? 1 : x > y ? -1 : 0).join(",") == "c,b,a")
+const jo = JSON.parse(" {\"a\": [1, -2.5, \"x\\n\\u00e9\"], \"b\": {\"c\": null, \"d\": true}} ")
+check(jo.a[1] == -2.5 && jo.a[2] == "x\né" && jo.b.d && jo.b.c === null)
+check(JSON.stringify(jo) == "{\"a\":[1,-2.5,\"x\\né\"],\"b\":{\"c\":null,\"d\":true}}")
+check(JSON.stringify([1, [2]], null, 2) == "[\n  1,\n  [\n    2\n  ]\n]")
+check(JSON.parse("[1,]x") === undefined)
+const hb = Buffer.fromUTF8("123456789")
+check(hb.crc32() == 0xcbf43926 && Buffer.create(0).hash32() == 0x02cc5d05)
+check(Buffer.fromUTF8("abc").sha256().toHex() == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad")
+const rb = new RingBuffer(3, NumberFormat.Int16LE)
+rb.push(1); rb.push(2); rb.push(-3); rb.push(4)
+check(rb.length == 3 && rb.get(0) == 2 && rb.sum() == 3 && rb.min() == -3 && rb.toArray().join(",") == "2,-3,4")
+check(rb.shift() == 2 && rb.pop() == 4 && rb.length == 1)
+const rbb = new RingBuffer(4)
+rbb.pushBuffer(Buffer.fromHex("0102030405"))
+check(rbb.linearize().toHex() == "02030405")
+rbb.pushBuffer(Buffer.fromUTF8("a\r\nb"))
+check(rbb.indexOf(0x0a) == 2 && rbb.shiftString(1) == "a" && rbb.shiftBuffer(2).toHex() == "0d0a" && rbb.length == 1)
+check(Buffer.fromUTF8("hello").indexOfByte(0x6c, 3) == 3)
+const ik = "ke" + (1 + 1)
+check(control.intern(ik) == control.intern("ke2") && control.intern("x" + ik) != control.intern(ik))
+check("a,b,,c".splitOn(",").length == 4 && "abc".splitOn("").length == 3)
+check([1, null, "x"].joinWith("-") == "1--x" && "aXbXc".replaceEvery("X", "yy") == "ayybyyc")
+check([1, 2, 1].indexOf(1, 1) == 2 && ["a", "bc"].indexOf("b" + "c") == 1 && [1, 2].indexOf(3) == -1)
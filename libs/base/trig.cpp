@@ -4,12 +4,110 @@
 
 using namespace std;
 
+// With CFG_FAST_MATH set, sin(), cos(), atan2() and sqrt() are done in single precision, with a
+// table and a polynomial, instead of with the double precision functions of libm, which take
+// thousands of cycles on parts without an FPU. The error is below 2e-5 for sin() and cos(),
+// 1.5e-5 radians for atan2(), and that of single precision for sqrt().
+
 namespace Math_ {
 
 #define SINGLE(op) return fromDouble(::op(toDouble(x)));
 
+// sin(i * pi / 512) * 32767, a quarter of a turn in 256 steps
+static const int16_t sinTable[257] = {
+    0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809, 2009, 2210,
+    2410, 2611, 2811, 3012, 3212, 3412, 3612, 3811, 4011, 4210, 4410, 4609,
+    4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195, 6393, 6590, 6786, 6983,
+    7179, 7375, 7571, 7767, 7962, 8157, 8351, 8545, 8739, 8933, 9126, 9319,
+    9512, 9704, 9896, 10087, 10278, 10469, 10659, 10849, 11039, 11228, 11417, 11605,
+    11793, 11980, 12167, 12353, 12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828,
+    14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269, 15446, 15623, 15800, 15976,
+    16151, 16325, 16499, 16673, 16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+    18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357, 19519, 19680, 19841, 20000,
+    20159, 20317, 20475, 20631, 20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856,
+    22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027, 23170, 23311, 23452, 23592,
+    23731, 23870, 24007, 24143, 24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+    25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198, 26319, 26438, 26556, 26674,
+    26790, 26905, 27019, 27133, 27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001,
+    28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803, 28898, 28992, 29085, 29177,
+    29268, 29358, 29447, 29534, 29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+    30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783, 30852, 30919, 30985, 31050,
+    31113, 31176, 31237, 31297, 31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736,
+    31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098, 32137, 32176, 32213, 32250,
+    32285, 32318, 32351, 32382, 32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+    32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717, 32728, 32737, 32745, 32752,
+    32757, 32761, 32765, 32766, 32767,
+};
+
+// sin(i degrees) * 1024
+static const int16_t sinDegTable[91] = {
+    0, 18, 36, 54, 71, 89, 107, 125, 143, 160, 178, 195,
+    213, 230, 248, 265, 282, 299, 316, 333, 350, 367, 384, 400,
+    416, 433, 449, 465, 481, 496, 512, 527, 543, 558, 573, 587,
+    602, 616, 630, 644, 658, 672, 685, 698, 711, 724, 737, 749,
+    761, 773, 784, 796, 807, 818, 828, 839, 849, 859, 868, 878,
+    887, 896, 904, 912, 920, 928, 935, 943, 949, 956, 962, 968,
+    974, 979, 984, 989, 994, 998, 1002, 1005, 1008, 1011, 1014, 1016,
+    1018, 1020, 1022, 1023, 1023, 1024, 1024,
+};
+
+static inline bool fastMath() {
+    return getConfigCached<CFG_FAST_MATH>(0) != 0;
+}
+
+// M_PI is not there in strict C++
+#define FAST_MATH_PI 3.14159265358979323846
+// beyond this many 1024ths of a turn, which don't fit in an int, angles are left to libm
+#define FAST_SIN_RANGE 1e9
+
+// sin() of t 1024ths of a turn
+static bool fastSin(double t, TNumber &res) {
+    if (!(-FAST_SIN_RANGE < t && t < FAST_SIN_RANGE))
+        return false;
+    double n = ::floor(t);
+    float f = (float)(t - n);
+    int i = (int)n & 1023;
+    int q = i >> 8;
+    i &= 255;
+    int a, b;
+    if (q & 1) {
+        a = sinTable[256 - i];
+        b = sinTable[255 - i];
+    } else {
+        a = sinTable[i];
+        b = sinTable[i + 1];
+    }
+    float v = (a + (b - a) * f) * (1.0f / 32767);
+    res = fromDouble(q & 2 ? -v : v);
+    return true;
+}
+
+// atan(z) for z in [0, 1]
+static inline float fastAtan(float z) {
+    float z2 = z * z;
+    return z * (0.9998660f +
+                z2 * (-0.3302995f + z2 * (0.1801410f + z2 * (-0.0851330f + z2 * 0.0208351f))));
+}
+
 //%
 TNumber atan2(TNumber y, TNumber x) {
+    if (fastMath()) {
+        float fx = (float)toDouble(x), fy = (float)toDouble(y);
+        float ax = fabsf(fx), ay = fabsf(fy);
+        // NaNs and infinities are left to libm
+        if (ax < 3e38f && ay < 3e38f) {
+            float r = 0;
+            if (ay <= ax) {
+                if (ax > 0)
+                    r = fastAtan(ay / ax);
+            } else {
+                r = (float)(FAST_MATH_PI / 2) - fastAtan(ax / ay);
+            }
+            if (signbit(fx))
+                r = (float)FAST_MATH_PI - r;
+            return fromDouble(signbit(fy) ? -r : r);
+        }
+    }
     return fromDouble(::atan2(toDouble(y), toDouble(x)));
 }
 
@@ -17,10 +115,20 @@ TNumber atan2(TNumber y, TNumber x) {
 TNumber tan(TNumber x){SINGLE(tan)}
 
 //%
-TNumber sin(TNumber x){SINGLE(sin)}
+TNumber sin(TNumber x) {
+    TNumber res;
+    if (fastMath() && fastSin(toDouble(x) * (512 / FAST_MATH_PI), res))
+        return res;
+    SINGLE(sin)
+}
 
 //%
-TNumber cos(TNumber x){SINGLE(cos)}
+TNumber cos(TNumber x) {
+    TNumber res;
+    if (fastMath() && fastSin(toDouble(x) * (512 / FAST_MATH_PI) + 256, res))
+        return res;
+    SINGLE(cos)
+}
 
 //%
 TNumber atan(TNumber x){SINGLE(atan)}
@@ -32,6 +140,30 @@ TNumber asin(TNumber x){SINGLE(asin)}
 TNumber acos(TNumber x){SINGLE(acos)}
 
 //%
-TNumber sqrt(TNumber x){SINGLE(sqrt)}
+TNumber sqrt(TNumber x) {
+    if (fastMath())
+        return fromDouble(sqrtf((float)toDouble(x)));
+    SINGLE(sqrt)
+}
+
+//%
+int isinDeg(int deg) {
+    deg %= 360;
+    if (deg < 0)
+        deg += 360;
+    int sign = 1;
+    if (deg >= 180) {
+        deg -= 180;
+        sign = -1;
+    }
+    if (deg > 90)
+        deg = 180 - deg;
+    return sign * sinDegTable[deg];
+}
 
-}
\ No newline at end of file
+//%
+int icosDeg(int deg) {
+    return isinDeg(deg % 360 + 90);
+}
+
+}
@@ -0,0 +1,139 @@
+/**
+ * An array of numbers stored in a buffer in a fixed format. Unlike number[], elements are not
+ * boxed, and fill/sum/min/max/scale and conversions between arrays run natively.
+ */
+class NumberArray {
+    /**
+     * The buffer holding the elements
+     */
+    buffer: Buffer
+    protected format: NumberFormat
+    protected shift: number
+
+    /**
+     * @param length number of elements; ignored when `buffer` is given
+     * @param buffer existing buffer to use for the elements
+     */
+    constructor(format: NumberFormat, shift: number, length: number, buffer?: Buffer) {
+        this.format = format
+        this.shift = shift
+        this.buffer = buffer || Buffer.create(length << shift)
+    }
+
+    /**
+     * Number of elements in the array
+     */
+    get length() {
+        return this.buffer.length >> this.shift
+    }
+
+    /**
+     * Get the element at `index`
+     */
+    get(index: number) {
+        return this.buffer.getNumber(this.format, index << this.shift)
+    }
+
+    /**
+     * Set the element at `index`; the value is converted to the format of the array
+     */
+    set(index: number, value: number) {
+        this.buffer.setNumber(this.format, index << this.shift, value)
+    }
+
+    /**
+     * Set elements from `start` up to, but not including, `end` to `value`
+     */
+    fill(value: number, start?: number, end?: number) {
+        if (start == null) start = 0
+        const count = end == null ? -1 : Math.max(0, end - start)
+        this.buffer.fillNumbers(this.format, value, start, count)
+    }
+
+    /**
+     * Sum of all elements
+     */
+    sum() {
+        return this.buffer.sumNumbers(this.format)
+    }
+
+    /**
+     * Smallest element, or Infinity if the array is empty
+     */
+    min() {
+        return this.buffer.minNumbers(this.format)
+    }
+
+    /**
+     * Largest element, or -Infinity if the array is empty
+     */
+    max() {
+        return this.buffer.maxNumbers(this.format)
+    }
+
+    /**
+     * Replace every element `x` with `x * mul + add`
+     */
+    scale(mul: number, add = 0) {
+        this.buffer.scaleNumbers(this.format, mul, add)
+    }
+
+    /**
+     * Replace every element with the result of `f`
+     */
+    map(f: (value: number, index: number) => number) {
+        const len = this.length
+        for (let i = 0; i < len; ++i)
+            this.set(i, f(this.get(i), i))
+    }
+
+    /**
+     * Copy elements of `src` to this array, converting them to the format of this array;
+     * copies as many as fit in both arrays.
+     */
+    copyFrom(src: NumberArray) {
+        this.buffer.copyNumbers(this.format, src.buffer, src.format)
+    }
+
+    /**
+     * Set elements from `start` on to the numbers in `values`, as many as fit; returns how many
+     * were set.
+     */
+    setFromArray(values: number[], start = 0) {
+        return this.buffer.packNumbers(this.format, start << this.shift, values)
+    }
+
+    /**
+     * Copy the elements into a regular array
+     */
+    toArray(): number[] {
+        return this.buffer.toArray(this.format)
+    }
+}
+
+/**
+ * An array of 16 bit signed integers, eg. audio samples
+ */
+class Int16Array extends NumberArray {
+    constructor(length: number, buffer?: Buffer) {
+        super(NumberFormat.Int16LE, 1, length, buffer)
+    }
+}
+
+/**
+ * An array of 32 bit signed integers
+ */
+class Int32Array extends NumberArray {
+    constructor(length: number, buffer?: Buffer) {
+        super(NumberFormat.Int32LE, 2, length, buffer)
+    }
+}
+
+/**
+ * An array of 32 bit floating point numbers
+ */
+class Float32Array extends NumberArray {
+    constructor(length: number, buffer?: Buffer) {
+        super(NumberFormat.Float32LE, 2, length, buffer)
+    }
+}
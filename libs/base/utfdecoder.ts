@@ -38,7 +38,7 @@ class UTF8Decoder {
         if (i >= this.buf.length)
             return undefined;
         else {
-            const s = this.buf.slice(0, i).toString();
+            const s = this.buf.sliceToString(0, i);
             if (i + 1 == this.buf.length)
                 this.buf = undefined;
             else
@@ -75,7 +75,7 @@ class UTF8Decoder {
         } else if (length == 0) { // data yet
             return "";
         } else {
-            const s = this.buf.slice(0, length).toString();
+            const s = this.buf.sliceToString(0, length);
             this.buf = this.buf.slice(length);
             return s;
         }
@@ -314,19 +314,13 @@ namespace tiles.legacy {
             const y0 = Math.max(0, camera.drawOffsetY >> this.scale);
             const yn = Math.min(this._mapImage.height, ((camera.drawOffsetY + target.height) >> this.scale) + 1);
 
-            for (let x = x0; x <= xn; ++x) {
-                for (let y = y0; y <= yn; ++y) {
-                    const index = this._mapImage.getPixel(x, y);
-                    const tile = this._tileSets[index] || this.generateTile(index);
-                    if (tile) {
-                        target.drawTransparentImage(
-                            tile.image,
-                            ((x - x0) << this.scale) - offsetX,
-                            ((y - y0) << this.scale) - offsetY
-                        );
-                    }
-                }
+            const tiles: Image[] = [];
+            for (let index = 0; index <= 0xf; ++index) {
+                // a missing tile 0 would be generated fully transparent
+                const tile = this._tileSets[index] || (index ? this.generateTile(index) : null);
+                tiles.push(tile ? tile.image : null);
             }
+            helpers.imageDrawColorTiles(target, tiles, this._mapImage, camera.drawOffsetX, camera.drawOffsetY);
 
             if (game.debug) {
                 // render debug grid overlay
@@ -10,6 +10,8 @@ namespace sensors {
     /* TCS34725 register addresses (Page 20)*/
 
     const TCS34725_REGISTER_COMMAND = 0x80		// Specifies register address 
+    const TCS34725_REGISTER_COMMAND_AUTO_INCREMENT = 0x20	// Auto-increment protocol transaction: a read goes on to the registers after the one addressed
+    const TCS34725_REGISTER_COMMAND_CLEAR_INT = 0xE6	// Special function: RGBC interrupt clear
 
     const TCS34725_REGISTER_ENABLE = 0x00		// Enables states and interrupts
     const TCS34725_REGISTER_AIEN_ENABLE = 0x10	// RGBC interrupt enable. When asserted, permits RGBC interrupts to be generated.
@@ -97,19 +99,33 @@ namespace sensors {
     }
 
 
+    const TCS34725_SAMPLES = 16                 // samples kept in TCS34725.samples
+
     export class TCS34725 implements sensors.ColorSensor {
         isConnected: boolean;
         atimeIntegrationValue: TCS34725_ATIME;
         gainSensorValue: TCS34725_AGAIN;
-
-        constructor() {
+        /**
+         * The latest samples, oldest first; each is four UInt16LE values: clear, red, green, blue
+         */
+        samples: RingBuffer;
+        private interruptPin: DigitalInOutPin;
+        private sampling: boolean;
+
+        /**
+         * @param interruptPin the pin the INT output of the sensor is wired to, if it is; without
+         * it, a background fiber checks for new samples every integration cycle
+         */
+        constructor(interruptPin?: DigitalInOutPin) {
             this.isConnected = false;
             this.atimeIntegrationValue = 0;
             this.gainSensorValue = 0;
+            this.samples = new RingBuffer(4 * TCS34725_SAMPLES, NumberFormat.UInt16LE);
+            this.interruptPin = interruptPin;
+            this.sampling = false;
 
             this.start(TCS34725_ATIME.ATIME_2_4_MS, TCS34725_AGAIN.AGAIN_1X);
         }
-
         private connect() {
             let retry = 0;
             while (!this.isConnected && retry < 5) {
@@ -135,36 +151,59 @@ namespace sensors {
             basic.pause(300);
 
 
+            //REGISTER FORMAT:   CMD | TRANSACTION | ADDRESS
+            //REGISTER VALUE:    TCS34725_REGISTER_COMMAND (0x80) | TCS34725_REGISTER_PERS (0x0C)
+            //REGISTER WRITE:    TCS34725_APERS.APERS_0_CLEAR (0x00), so that every cycle sets the interrupt
+            pins.i2cWriteRegister(TCS34725_I2C_ADDRESS, TCS34725_REGISTER_COMMAND | TCS34725_REGISTER_PERS, TCS34725_APERS.APERS_0_CLEAR);
+
             //REGISTER FORMAT:   CMD | TRANSACTION | ADDRESS
             //REGISTER VALUE:    TCS34725_REGISTER_COMMAND (0x80) | TCS34725_REGISTER_ENABLE (0x00)
-            //REGISTER WRITE:    TCS34725_REGISTER_PON_ENABLE (0x01) | TCS34725_REGISTER_AEN_ENABLE (0x02)        
-            pins.i2cWriteRegister(TCS34725_I2C_ADDRESS, TCS34725_REGISTER_COMMAND | TCS34725_REGISTER_ENABLE, TCS34725_REGISTER_PON_ENABLE | TCS34725_REGISTER_AEN_ENABLE);
+            //REGISTER WRITE:    TCS34725_REGISTER_PON_ENABLE (0x01) | TCS34725_REGISTER_AEN_ENABLE (0x02) | TCS34725_REGISTER_AIEN_ENABLE (0x10)
+            pins.i2cWriteRegister(TCS34725_I2C_ADDRESS, TCS34725_REGISTER_COMMAND | TCS34725_REGISTER_ENABLE, TCS34725_REGISTER_PON_ENABLE | TCS34725_REGISTER_AEN_ENABLE | TCS34725_REGISTER_AIEN_ENABLE);
+
+            basic.pause(this.integrationTime());
+        }
+
+        // ms an integration cycle takes, in 2.4ms steps
+        private integrationTime() {
+            return Math.ceil((256 - this.atimeIntegrationValue) * 2.4);
+        }
 
-            this.pauseSensorForIntegrationTime();
+        // reads the status and all four channels in one burst, clearing the interrupt in the same
+        // transaction; when a cycle completed since the last one, pushes the channels to samples
+        private sample(): boolean {
+            const reg = control.createBuffer(1);
+            reg[0] = TCS34725_REGISTER_COMMAND | TCS34725_REGISTER_COMMAND_AUTO_INCREMENT | TCS34725_REGISTER_STATUS;
+            const clear = control.createBuffer(1);
+            clear[0] = TCS34725_REGISTER_COMMAND_CLEAR_INT;
+            const data = new pins.I2CTransaction()
+                .write(TCS34725_I2C_ADDRESS, reg, true)
+                .read(TCS34725_I2C_ADDRESS, 9)
+                .write(TCS34725_I2C_ADDRESS, clear)
+                .run();
+            if (!data || !(data[0] & TCS34725_REGISTER_STATUS_AINT))
+                return false;
+            this.samples.pushBuffer(data.slice(1, 8));
+            return true;
         }
 
-        private pauseSensorForIntegrationTime() {
-            switch (this.atimeIntegrationValue) {
-                case TCS34725_ATIME.ATIME_2_4_MS: {
-                    basic.pause(2.4);
-                    break;
-                }
-                case TCS34725_ATIME.ATIME_24_MS: {
-                    basic.pause(24);
-                    break;
-                }
-                case TCS34725_ATIME.ATIME_100_MS: {
-                    basic.pause(100);
-                    break;
-                }
-                case TCS34725_ATIME.ATIME_154_MS: {
-                    basic.pause(154);
-                    break;
-                }
-                case TCS34725_ATIME.ATIME_700_MS: {
-                    basic.pause(700);
-                    break;
-                }
+        // samples on each falling edge of the interrupt pin, or every cycle in the background
+        private startSampling() {
+            if (this.sampling)
+                return;
+            this.sampling = true;
+            if (this.interruptPin) {
+                this.interruptPin.setPull(PinPullMode.PullUp);
+                this.interruptPin.onEvent(PinEvent.Fall, () => this.sample());
+                // in case it was already asserted, when no edge will come
+                this.sample();
+            } else {
+                control.runInBackground(() => {
+                    while (true) {
+                        pause(this.integrationTime());
+                        this.sample();
+                    }
+                });
             }
         }
 
@@ -208,8 +247,14 @@ namespace sensors {
             this.setATIMEintegration(atime);
             this.setGAINsensor(gain);
             this.turnSensorOn();
+            if (this.isConnected)
+                this.startSampling();
         }
 
+        /**
+         * The latest sample as an RGB color, normalized by the clear channel; doesn't wait for
+         * the sensor
+         */
         color(): number {
             //Always check that sensor is/was turned on
             this.connect();
@@ -217,23 +262,17 @@ namespace sensors {
             if (!this.isConnected)
                 return 0;
 
-            //REGISTER FORMAT:   CMD | TRANSACTION | ADDRESS
-            //REGISTER READ:     TCS34725_REGISTER_COMMAND (0x80) | TCS34725_REGISTER_RDATAL (0x16)          
-            const redColorValue = pins.i2cReadRegister(TCS34725_I2C_ADDRESS, TCS34725_REGISTER_COMMAND | TCS34725_REGISTER_RDATAL, NumberFormat.UInt16LE);
-
-            //REGISTER FORMAT:   CMD | TRANSACTION | ADDRESS
-            //REGISTER READ:     TCS34725_REGISTER_COMMAND (0x80) | TCS34725_REGISTER_GDATAL (0x18)          
-            const greenColorValue = pins.i2cReadRegister(TCS34725_I2C_ADDRESS, TCS34725_REGISTER_COMMAND | TCS34725_REGISTER_GDATAL, NumberFormat.UInt16LE);
-
-            //REGISTER FORMAT:   CMD | TRANSACTION | ADDRESS
-            //REGISTER READ:     TCS34725_REGISTER_COMMAND (0x80) | TCS34725_REGISTER_BDATAL (0x1A)          
-            const blueColorValue = pins.i2cReadRegister(TCS34725_I2C_ADDRESS, TCS34725_REGISTER_COMMAND | TCS34725_REGISTER_BDATAL, NumberFormat.UInt16LE);
-
-            //REGISTER FORMAT:   CMD | TRANSACTION | ADDRESS
-            //REGISTER READ:     TCS34725_REGISTER_COMMAND (0x80) | TCS34725_REGISTER_CDATAL (0x14)          
-            const clearColorValue = pins.i2cReadRegister(TCS34725_I2C_ADDRESS, TCS34725_REGISTER_COMMAND | TCS34725_REGISTER_CDATAL, NumberFormat.UInt16LE);
+            this.startSampling();
+            if (this.samples.length == 0)
+                this.sample();
+            const n = this.samples.length;
+            if (n == 0)
+                return 0;
 
-            this.pauseSensorForIntegrationTime();
+            const clearColorValue = this.samples.get(n - 4);
+            const redColorValue = this.samples.get(n - 3);
+            const greenColorValue = this.samples.get(n - 2);
+            const blueColorValue = this.samples.get(n - 1);
 
             if (clearColorValue == 0)
                 return 0;
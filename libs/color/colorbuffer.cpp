@@ -0,0 +1,86 @@
+#include "pxt.h"
+
+// The conversions of colorbuffer.ts over whole buffers; it has the same in TypeScript, for the
+// simulator.
+
+namespace color {
+
+static int minLength(Buffer a, Buffer b) {
+    return a->length < b->length ? a->length : b->length;
+}
+
+// as hsv() in colors.ts, which is FastLED's rainbow
+static uint32_t hsvToRgb(int hue, int sat, int val) {
+    int h = (hue % 255) * 192 / 255;
+    int floor = val * (255 - sat) / 255;
+    int amplitude = val - floor;
+    int offset = h & 0x3f;
+    int up = offset * amplitude * 4 / 255 + floor;
+    int down = (0x3f - offset) * amplitude * 4 / 255 + floor;
+    int r, g, b;
+    switch (h >> 6) {
+    case 0:
+        r = down, g = up, b = floor;
+        break;
+    case 1:
+        r = floor, g = down, b = up;
+        break;
+    default:
+        r = up, g = floor, b = down;
+        break;
+    }
+    return ((r & 0xff) << 16) | ((g & 0xff) << 8) | (b & 0xff);
+}
+
+/**
+ * Convert the HSV colors in src, a byte for each of hue, saturation and value, into RGB ones in
+ * dst, which may be src
+ */
+//%
+void hsvToRgbBuffer(Buffer dst, Buffer src) {
+    int n = minLength(dst, src) / 3 * 3;
+    for (int i = 0; i < n; i += 3) {
+        auto c = hsvToRgb(src->data[i], src->data[i + 1], src->data[i + 2]);
+        dst->data[i] = c >> 16;
+        dst->data[i + 1] = c >> 8;
+        dst->data[i + 2] = c;
+    }
+}
+
+/**
+ * Replace the red, green and blue of each color, the last three of its stride bytes, with their
+ * entries in lut, which has 256
+ */
+//%
+void mapChannels(Buffer buf, Buffer lut, int stride) {
+    if (lut->length < 256 || stride < 3)
+        return;
+    auto table = lut->data;
+    auto p = buf->data;
+    auto end = p + buf->length / stride * stride;
+    for (p += stride - 3; p < end; p += stride) {
+        p[0] = table[p[0]];
+        p[1] = table[p[1]];
+        p[2] = table[p[2]];
+    }
+}
+
+/**
+ * Set each byte of dst to the one of a, blended towards the one of b by alpha, from 0 (a) to 255
+ * (b), rounding to nearest; dst may be a or b
+ */
+//%
+void lerpBuffers(Buffer dst, Buffer a, Buffer b, int alpha) {
+    if (alpha < 0)
+        alpha = 0;
+    else if (alpha > 255)
+        alpha = 255;
+    int n = minLength(a, b);
+    if (dst->length < n)
+        n = dst->length;
+    int malpha = 255 - alpha;
+    for (int i = 0; i < n; ++i)
+        dst->data[i] = (a->data[i] * malpha + b->data[i] * alpha + 127) / 255;
+}
+
+} // namespace color
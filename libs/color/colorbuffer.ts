@@ -1,4 +1,54 @@
 namespace color {
+    // colorbuffer.cpp does these on the devices
+
+    //% shim=color::hsvToRgbBuffer
+    function hsvToRgbBuffer(dst: Buffer, src: Buffer) {
+        const n = Math.idiv(Math.min(dst.length, src.length), 3) * 3;
+        for (let i = 0; i < n; i += 3) {
+            const c = hsv(src[i], src[i + 1], src[i + 2]);
+            dst[i] = (c >> 16) & 0xff;
+            dst[i + 1] = (c >> 8) & 0xff;
+            dst[i + 2] = c & 0xff;
+        }
+    }
+
+    //% shim=color::mapChannels
+    function mapChannels(buf: Buffer, lut: Buffer, stride: number) {
+        if (lut.length < 256 || stride < 3)
+            return;
+        const end = Math.idiv(buf.length, stride) * stride;
+        for (let i = stride - 3; i < end; i += stride) {
+            buf[i] = lut[buf[i]];
+            buf[i + 1] = lut[buf[i + 1]];
+            buf[i + 2] = lut[buf[i + 2]];
+        }
+    }
+
+    //% shim=color::lerpBuffers
+    function lerpBuffers(dst: Buffer, a: Buffer, b: Buffer, alpha: number) {
+        alpha = Math.max(0, Math.min(255, alpha | 0));
+        const n = Math.min(dst.length, Math.min(a.length, b.length));
+        const malpha = 255 - alpha;
+        for (let i = 0; i < n; ++i)
+            dst[i] = Math.idiv(a[i] * malpha + b[i] * alpha + 127, 255);
+    }
+
+    let gammaLut: Buffer;
+    let gammaLutValue: number;
+
+    /**
+     * The table of x^gamma for x from 0 to 255, scaled to 0 to 255; see ColorBuffer.mapChannels()
+     */
+    export function gammaTable(gamma: number): Buffer {
+        if (!gammaLut || gammaLutValue !== gamma) {
+            gammaLut = control.createBuffer(256);
+            for (let i = 0; i < 256; ++i)
+                gammaLut[i] = Math.round(Math.pow(i / 255, gamma) * 255);
+            gammaLutValue = gamma;
+        }
+        return gammaLut;
+    }
+
     export enum ColorBufferLayout {
         /**
          * 24bit RGB color
@@ -28,6 +78,16 @@ namespace color {
             return b;
         }
 
+        /**
+         * Converts a buffer of HSV colors, a byte for each of hue, saturation and value, into RGB
+         * ones, as hsv() does
+         */
+        static fromHSV(hsv: Buffer) {
+            const b = new ColorBuffer(Math.idiv(hsv.length, 3));
+            hsvToRgbBuffer(b.buf, hsv);
+            return b;
+        }
+
         get stride() {
             return this.layout == ColorBufferLayout.RGB ? 3 : 4;
         }
@@ -78,6 +138,24 @@ namespace color {
             return output;
         }
 
+        /**
+         * Replaces the red, green and blue of each color by their entries in a table of 256 bytes,
+         * eg. gammaTable(2.2); alpha is left as is
+         */
+        mapChannels(lut: Buffer) {
+            mapChannels(this.buf, lut, this.stride);
+        }
+
+        /**
+         * Sets the colors to those of a blended towards those of b, from alpha 0 (a) to 255 (b);
+         * all three have to have the same layout, and as many colors as the shortest are set
+         */
+        lerp(a: ColorBuffer, b: ColorBuffer, alpha: number) {
+            if (a.layout != this.layout || b.layout != this.layout)
+                return;
+            lerpBuffers(this.buf, a.buf, b.buf, alpha);
+        }
+
         /**
          * Writes the content of the src color buffer starting at the start dstOffset in the current buffer
          * @param dstOffset
@@ -5,6 +5,15 @@
 #include <signal.h>
 #include <stdarg.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+// Lines are put in a ring by whoever logs them, and a writer thread takes them to the file and
+// stderr every DMESG_WRITE_MS (or sooner when the ring fills up), syncing the file every
+// DMESG_SYNC_MS. dmesg_flush() writes and syncs everything right away, on panics and exits.
+#define DMESG_RING_SIZE (64 * 1024) // power of 2
+#define DMESG_WRITE_MS 50
+#define DMESG_SYNC_MS 1000
 
 namespace pxt {
 
@@ -14,37 +23,68 @@ static int dmesgPtr;
 static int dmesgSerialPtr;
 static char dmesgBuf[4096];
 
+static char ring[DMESG_RING_SIZE];
+static uint32_t ringWr, ringRd; // free running
+static uint32_t numDropped;     // lines that didn't fit in the ring
+static bool writerRunning;
+// held while putting lines into the ring or dmesgBuf, but not while writing them out
+static pthread_mutex_t ringMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ringFilling = PTHREAD_COND_INITIALIZER;
+// held while writing to the file, so that the writer and dmesg_flush() don't both do it
+static pthread_mutex_t ioMutex = PTHREAD_MUTEX_INITIALIZER;
+
 void dumpDmesg() {
+    pthread_mutex_lock(&ringMutex);
     auto len = dmesgPtr - dmesgSerialPtr;
+    auto start = dmesgSerialPtr;
+    dmesgSerialPtr = dmesgPtr;
+    pthread_mutex_unlock(&ringMutex);
     if (len == 0)
         return;
-    sendSerial(dmesgBuf + dmesgSerialPtr, len);
-    dmesgSerialPtr = dmesgPtr;
+    sendSerial(dmesgBuf + start, len);
 }
 
+static void writeOut(const char *buf, uint32_t len) {
+    fwrite(buf, 1, len, dmesgFile);
+    if (dmesgFile != stderr)
+        fwrite(buf, 1, len, stderr);
+}
 
-static void dmesgRaw(const char *buf, uint32_t len) {
+// with ioMutex held
+static void drainRing() {
     if (!dmesgFile) {
         dmesgFile = fopen("/tmp/dmesg.txt", "w");
         if (!dmesgFile)
             dmesgFile = stderr;
     }
 
-    if (len > sizeof(dmesgBuf) / 2)
-        return;
-    if (dmesgPtr + len > sizeof(dmesgBuf)) {
-        dmesgPtr = 0;
-        dmesgSerialPtr = 0;
+    pthread_mutex_lock(&ringMutex);
+    uint32_t rd = ringRd, wr = ringWr;
+    uint32_t dropped = numDropped;
+    numDropped = 0;
+    pthread_mutex_unlock(&ringMutex);
+
+    // the loggers don't write over [rd, wr) until ringRd moves
+    while (rd != wr) {
+        uint32_t off = rd & (DMESG_RING_SIZE - 1);
+        uint32_t len = min(wr - rd, DMESG_RING_SIZE - off);
+        writeOut(ring + off, len);
+        rd += len;
+    }
+    if (dropped) {
+        char buf[60];
+        snprintf(buf, sizeof(buf), "[dmesg: %u lines dropped]\n", dropped);
+        writeOut(buf, strlen(buf));
     }
-    memcpy(dmesgBuf + dmesgPtr, buf, len);
-    dmesgPtr += len;
-    fwrite(buf, 1, len, dmesgFile);
 
-    fwrite(buf, 1, len, stderr);
-}
+    pthread_mutex_lock(&ringMutex);
+    ringRd = rd;
+    pthread_mutex_unlock(&ringMutex);
 
-static void dmesgFlushRaw() {
     fflush(dmesgFile);
+}
+
+static void syncFile() {
 #ifdef __linux__
     fdatasync(fileno(dmesgFile));
 #else
@@ -52,16 +92,95 @@ static void dmesgFlushRaw() {
 #endif
 }
 
+static uint64_t nowMs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+static void *dmesgWriter(void *) {
+    uint64_t lastSync = nowMs();
+    bool unsynced = false;
+    for (;;) {
+        auto deadline = nowMs() + DMESG_WRITE_MS;
+        struct timespec ts;
+        ts.tv_sec = deadline / 1000;
+        ts.tv_nsec = (deadline % 1000) * 1000000;
+
+        pthread_mutex_lock(&ringMutex);
+        pthread_cond_timedwait(&ringFilling, &ringMutex, &ts);
+        bool pending = ringRd != ringWr || numDropped;
+        pthread_mutex_unlock(&ringMutex);
+
+        pthread_mutex_lock(&ioMutex);
+        if (pending) {
+            drainRing();
+            unsynced = true;
+        }
+        if (unsynced && nowMs() - lastSync >= DMESG_SYNC_MS) {
+            syncFile();
+            lastSync = nowMs();
+            unsynced = false;
+        }
+        pthread_mutex_unlock(&ioMutex);
+    }
+    return NULL;
+}
+
+void dmesg_flush() {
+    pthread_mutex_lock(&ioMutex);
+    drainRing();
+    syncFile();
+    pthread_mutex_unlock(&ioMutex);
+}
+
+static void dmesgRaw(const char *buf, uint32_t len) {
+    if (len > sizeof(dmesgBuf) / 2)
+        return;
+
+    pthread_mutex_lock(&ringMutex);
+    if (!writerRunning) {
+        writerRunning = true;
+        pthread_t pid;
+        pthread_create(&pid, NULL, dmesgWriter, NULL);
+        pthread_detach(pid);
+    }
+
+    if (dmesgPtr + len > sizeof(dmesgBuf)) {
+        dmesgPtr = 0;
+        dmesgSerialPtr = 0;
+    }
+    memcpy(dmesgBuf + dmesgPtr, buf, len);
+    dmesgPtr += len;
+
+    uint32_t used = ringWr - ringRd;
+    if (used + len > DMESG_RING_SIZE) {
+        numDropped++;
+    } else {
+        uint32_t off = ringWr & (DMESG_RING_SIZE - 1);
+        uint32_t first = min(len, DMESG_RING_SIZE - off);
+        memcpy(ring + off, buf, first);
+        memcpy(ring, buf + first, len - first);
+        ringWr += len;
+        if (used + len > DMESG_RING_SIZE / 2)
+            pthread_cond_signal(&ringFilling);
+    }
+    pthread_mutex_unlock(&ringMutex);
+}
+
 void vdmesg(const char *format, va_list arg) {
     char buf[500];
 
-    snprintf(buf, sizeof(buf), "[%8d] ", current_time_ms());
-    dmesgRaw(buf, strlen(buf));
-    vsnprintf(buf, sizeof(buf), format, arg);
-    dmesgRaw(buf, strlen(buf));
-    dmesgRaw("\n", 1);
-
-    dmesgFlushRaw();
+    // all of the line in one go, so that lines logged from several threads don't mix
+    int len = snprintf(buf, sizeof(buf), "[%8d] ", current_time_ms());
+    int room = sizeof(buf) - len - 1;
+    int n = vsnprintf(buf + len, room, format, arg);
+    if (n > room - 1)
+        n = room - 1;
+    if (n > 0)
+        len += n;
+    buf[len++] = '\n';
+    dmesgRaw(buf, len);
 }
 
 void dmesg(const char *format, ...) {
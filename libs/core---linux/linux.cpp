@@ -10,11 +10,8 @@
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <errno.h>
-
-#if defined(__linux__) && !defined(POKY)
-#include <malloc.h>
-#define MALLOC_STATS
-#endif
+#include <ucontext.h>
+#include <atomic>
 
 // should this be something like CXX11 or whatever?
 #ifdef PXT_VM
@@ -25,26 +22,72 @@
 
 #define THREAD_DBG(...)
 
+// of xmalloc() memory, 0 for no limit
+#ifndef MALLOC_LIMIT
+#ifdef POKY
+#define MALLOC_LIMIT 0
+#else
 #define MALLOC_LIMIT (8 * 1024 * 1024)
-#define MALLOC_CHECK_PERIOD (1024 * 1024)
+#endif
+#endif
 
-void *xmalloc(size_t sz) {
-#ifdef MALLOC_STATS
-    static size_t allocBytes = 0;
-    allocBytes += sz;
-    if (allocBytes >= MALLOC_CHECK_PERIOD) {
-        allocBytes = 0;
-        auto info = mallinfo();
-        // DMESG("malloc used: %d kb", info.uordblks / 1024);
-        if (info.uordblks > MALLOC_LIMIT) {
-            target_panic(PANIC_MEMORY_LIMIT_EXCEEDED);
-        }
+// Every xmalloc() block starts with its size and tag, so that the bytes in use are known
+// exactly and checking the limit is a compare; mallinfo() was slow, and off with many arenas.
+#define MALLOC_MAGIC 0x786d6c63
+
+struct MallocHeader {
+    uint64_t size; // also keeps the block 16-byte aligned, like malloc() does
+    uint32_t tag;
+    uint32_t magic; // MALLOC_MAGIC ^ size, to tell the blocks from plain malloc() ones
+};
+
+static std::atomic<size_t> mallocBytes[(int)MallocTag::Count];
+static std::atomic<int> mallocBlocks[(int)MallocTag::Count];
+static std::atomic<size_t> mallocTotal;
+
+static const char *mallocTagNames[] = {"other", "fiber", "scheduler", "screen", "serial"};
+static_assert(sizeof(mallocTagNames) / sizeof(mallocTagNames[0]) == (int)MallocTag::Count,
+              "MallocTag names");
+
+void *xmalloc_tagged(size_t sz, MallocTag tag) {
+    auto used = mallocTotal.fetch_add(sz, std::memory_order_relaxed) + sz;
+#if MALLOC_LIMIT
+    if (used > MALLOC_LIMIT && !pxt::paniced) {
+        pxt::dumpMallocStats();
+        target_panic(PANIC_MEMORY_LIMIT_EXCEEDED);
     }
+#else
+    (void)used;
 #endif
-    auto r = malloc(sz);
-    if (r == NULL)
+    auto h = (MallocHeader *)malloc(sizeof(MallocHeader) + sz);
+    if (h == NULL)
         oops(50); // shouldn't happen
-    return r;
+    h->size = sz;
+    h->tag = (uint32_t)tag;
+    h->magic = MALLOC_MAGIC ^ (uint32_t)sz;
+    mallocBytes[(int)tag].fetch_add(sz, std::memory_order_relaxed);
+    mallocBlocks[(int)tag].fetch_add(1, std::memory_order_relaxed);
+    return h + 1;
+}
+
+void *xmalloc(size_t sz) {
+    return xmalloc_tagged(sz, MallocTag::Other);
+}
+
+void xfree(void *p) {
+    if (!p)
+        return;
+    auto h = (MallocHeader *)p - 1;
+    if (h->magic != (MALLOC_MAGIC ^ (uint32_t)h->size) || h->tag >= (uint32_t)MallocTag::Count) {
+        // straight from malloc(), by some library
+        free(p);
+        return;
+    }
+    h->magic = 0;
+    mallocTotal.fetch_sub(h->size, std::memory_order_relaxed);
+    mallocBytes[h->tag].fetch_sub(h->size, std::memory_order_relaxed);
+    mallocBlocks[h->tag].fetch_sub(1, std::memory_order_relaxed);
+    free(h);
 }
 
 void *operator new(size_t size) {
@@ -68,35 +111,119 @@ static pthread_mutex_t execMutex;
 static pthread_mutex_t eventMutex;
 static pthread_cond_t newEventBroadcast;
 
+// All fibers run on the thread that called initRuntime(), switched with swapcontext() when
+// they sleep or wait, much like CODAL does on the devices. They hold execMutex while running
+// (i.e. apart from when the scheduler waits for an event or a timer).
 struct Thread {
     struct Thread *next;
+    struct Thread *prev; // in allThreads, so that disposing doesn't walk the list
     Action act;
     TValue arg0;
     TValue data0;
     TValue data1;
-    pthread_t pid;
-    pthread_cond_t waitCond;
+    void (*runner)(Thread *);
+    ThreadContext *threadCtx;
+    ucontext_t ctx;
+    uint8_t *stack;          // NULL for the main fiber, which runs on the thread's own
+    struct Thread *runNext;  // in the run queue
+    struct Thread *waitNext; // in its waiters[] bucket
+    uint32_t waitSeq;
+    uint32_t wakeTime; // ms; 0 when not sleeping
+    bool done;
     int waitSource;
     int waitValue;
 };
 
 static struct Thread *allThreads;
-static struct Event *eventHead, *eventTail;
+static struct Thread *currentThread;
+static pthread_t userThread;
+
+// fibers that are neither sleeping nor waiting for an event, in FIFO order
+static Thread *runHead, *runTail;
+
+// sleeping fibers, as a binary min-heap on wakeTime
+static Thread **sleepers;
+static int numSleepers, sleepersCap;
+
+// fibers waiting for events, hashed on (waitSource, waitValue), in FIFO order in each bucket
+#define WAIT_BUCKETS 64
+static struct {
+    Thread *head, *tail;
+} waiters[WAIT_BUCKETS];
+static uint32_t waitSeq;
+
+// when nothing is runnable, don't block for longer than this, so that a panic is noticed
+#define MAX_IDLE_WAIT_US 100000
+
+// reserved address space; pages are only backed once the fiber touches them
+#ifndef FIBER_STACK_SIZE
+#define FIBER_STACK_SIZE (1024 * 1024)
+#endif
+#define FIBER_GUARD_SIZE 4096
+
+static ucontext_t schedulerCtx;
 
 struct Event {
-    struct Event *next;
     int source;
     int value;
 };
 
 Event lastEvent;
 
-Event *mkEvent(int source, int value) {
-    auto res = new Event();
-    memset(res, 0, sizeof(Event));
-    res->source = source;
-    res->value = value;
-    return res;
+// Bounded lock-free queue of raised events; many threads raise events,
+// only the dispatcher takes them out. See Vyukov's bounded MPMC queue.
+#define EVENT_QUEUE_SIZE 256 // power of 2
+
+struct EventSlot {
+    // the queue position this slot is for, minus the slot index (so that zero-init works);
+    // equal to the position when free and to position+1 when holding an event
+    std::atomic<uint32_t> seq;
+    Event ev;
+};
+
+static EventSlot eventSlots[EVENT_QUEUE_SIZE];
+static std::atomic<uint32_t> eventEnqPos;
+static uint32_t eventDeqPos;
+static std::atomic<uint32_t> numDroppedEvents;
+// set while the dispatcher is (about to be) blocked on newEventBroadcast
+static std::atomic<bool> dispatcherWaiting;
+
+static bool pushEvent(int source, int value) {
+    uint32_t pos = eventEnqPos.load(std::memory_order_relaxed);
+    EventSlot *slot;
+    for (;;) {
+        auto idx = pos & (EVENT_QUEUE_SIZE - 1);
+        slot = &eventSlots[idx];
+        int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) + idx - pos);
+        if (diff == 0) {
+            if (eventEnqPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = eventEnqPos.load(std::memory_order_relaxed);
+        }
+    }
+    slot->ev.source = source;
+    slot->ev.value = value;
+    slot->seq.store(pos + 1 - (pos & (EVENT_QUEUE_SIZE - 1)));
+    return true;
+}
+
+static bool popEvent(Event &ev) {
+    auto pos = eventDeqPos;
+    auto idx = pos & (EVENT_QUEUE_SIZE - 1);
+    auto slot = &eventSlots[idx];
+    if (slot->seq.load() + idx != pos + 1)
+        return false; // empty, or the producer is not done yet
+    ev = slot->ev;
+    slot->seq.store(pos + EVENT_QUEUE_SIZE - idx, std::memory_order_release);
+    eventDeqPos = pos + 1;
+    return true;
+}
+
+uint32_t droppedEvents() {
+    return numDroppedEvents.load();
 }
 
 volatile bool paniced;
@@ -106,6 +233,14 @@ int tryLockUser() {
     return pthread_mutex_trylock(&execMutex);
 }
 
+void dumpMallocStats() {
+    DMESG("malloc: %d kb in use", (int)(mallocTotal.load() / 1024));
+    for (int i = 0; i < (int)MallocTag::Count; ++i)
+        if (mallocBlocks[i])
+            DMESG("  %s: %d bytes in %d blocks", mallocTagNames[i], (int)mallocBytes[i].load(),
+                  mallocBlocks[i].load());
+}
+
 extern "C" void target_panic(int error_code) {
     char buf[50];
     int prevErr = errno;
@@ -118,6 +253,7 @@ extern "C" void target_panic(int error_code) {
     drawPanic(error_code);
     DMESG("PANIC %d", error_code);
     DMESG("errno=%d %s", prevErr, strerror(prevErr));
+    dmesg_flush();
 
     for (int i = 0; i < 10; ++i) {
         sendSerial(buf, strlen(buf));
@@ -143,10 +279,14 @@ void sleep_core_us(uint64_t us) {
         ;
 }
 
+static void schedule();
+
 void sleep_ms(uint32_t ms) {
-    stopUser();
-    sleep_core_us(ms * 1000);
-    startUser();
+    auto t = currentThread;
+    t->wakeTime = current_time_ms() + ms;
+    if (!t->wakeTime)
+        t->wakeTime = 1; // 0 is for not sleeping
+    schedule();
 }
 
 void sleep_us(uint64_t us) {
@@ -171,57 +311,182 @@ int current_time_ms() {
     return current_time_us() / 1000;
 }
 
-void disposeThread(Thread *t) {
-    if (allThreads == t) {
-        allThreads = t->next;
-    } else {
-        for (auto tt = allThreads; tt; tt = tt->next) {
-            if (tt->next == t) {
-                tt->next = t->next;
-                break;
-            }
+static void makeRunnable(Thread *t) {
+    t->runNext = NULL;
+    if (runTail)
+        runTail->runNext = t;
+    else
+        runHead = t;
+    runTail = t;
+}
+
+static Thread *nextRunnable() {
+    auto t = runHead;
+    if (t) {
+        runHead = t->runNext;
+        if (!runHead)
+            runTail = NULL;
+        t->runNext = NULL;
+    }
+    return t;
+}
+
+static void addSleeper(Thread *t) {
+    if (numSleepers == sleepersCap) {
+        sleepersCap = sleepersCap ? sleepersCap * 2 : 16;
+        auto tmp = (Thread **)xmalloc_tagged(sleepersCap * sizeof(Thread *), MallocTag::Scheduler);
+        if (sleepers) {
+            memcpy(tmp, sleepers, numSleepers * sizeof(Thread *));
+            xfree(sleepers);
         }
+        sleepers = tmp;
+    }
+    int i = numSleepers++;
+    while (i > 0) {
+        int parent = (i - 1) >> 1;
+        if ((int)(sleepers[parent]->wakeTime - t->wakeTime) <= 0)
+            break;
+        sleepers[i] = sleepers[parent];
+        i = parent;
+    }
+    sleepers[i] = t;
+}
+
+static Thread *popSleeper() {
+    auto res = sleepers[0];
+    auto last = sleepers[--numSleepers];
+    int i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= numSleepers)
+            break;
+        if (c + 1 < numSleepers && (int)(sleepers[c + 1]->wakeTime - sleepers[c]->wakeTime) < 0)
+            c++;
+        if ((int)(last->wakeTime - sleepers[c]->wakeTime) <= 0)
+            break;
+        sleepers[i] = sleepers[c];
+        i = c;
+    }
+    sleepers[i] = last;
+    return res;
+}
+
+static void wakeSleepers() {
+    uint32_t now = current_time_ms();
+    while (numSleepers && (int)(now - sleepers[0]->wakeTime) >= 0) {
+        auto t = popSleeper();
+        t->wakeTime = 0;
+        makeRunnable(t);
+    }
+}
+
+// disposed fibers with their stacks, so that starting event handlers doesn't map memory
+#define MAX_POOLED_FIBERS 16
+static Thread *fiberPool;
+static int numPooledFibers;
+
+static uint8_t *allocStack() {
+    auto r = (uint8_t *)mmap(NULL, FIBER_STACK_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANON | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (r == MAP_FAILED) {
+        DMESG("fiber stack mmap failed; err=%d", errno);
+        target_panic(PANIC_INTERNAL_ERROR);
     }
+    // running off the end faults, instead of scribbling over the neighbour
+    mprotect(r, FIBER_GUARD_SIZE, PROT_NONE);
+    return r;
+}
+
+// called from the scheduler, never on the stack of t
+void disposeThread(Thread *t) {
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        allThreads = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
     unregisterGC(&t->act, 4);
-    pthread_cond_destroy(&t->waitCond);
-    delete t;
+
+    if (t->stack && numPooledFibers < MAX_POOLED_FIBERS) {
+        t->next = fiberPool;
+        fiberPool = t;
+        numPooledFibers++;
+        return;
+    }
+    if (t->stack)
+        munmap(t->stack, FIBER_STACK_SIZE);
+    xfree(t);
+}
+
+// switch to the scheduler, until this fiber is woken up
+static void schedule() {
+    auto t = currentThread;
+    if (!t->wakeTime && !t->waitSource && !t->done)
+        oops(55);
+    swapcontext(&t->ctx, &schedulerCtx);
+}
+
+static void fiberEntry() {
+    auto t = currentThread;
+    t->runner(t);
+    t->done = true;
+    schedule();
 }
 
 static void runAct(Thread *thr) {
-    startUser();
     pxt::runAction1(thr->act, thr->arg0);
-    stopUser();
-    disposeThread(thr);
 }
 
 static void mainThread(Thread *) {}
 
-void setupThread(Action a, TValue arg = 0, void (*runner)(Thread *) = NULL, TValue d0 = 0,
-                 TValue d1 = 0) {
+Thread *setupThread(Action a, TValue arg = 0, void (*runner)(Thread *) = NULL, TValue d0 = 0,
+                    TValue d1 = 0) {
     if (runner == NULL)
         runner = runAct;
-    auto thr = new Thread();
+    // volatile, as it is used after getcontext(), which may return twice; the stack is read back
+    // from it there for the same reason
+    Thread *volatile thr = NULL;
+    uint8_t *stack = NULL;
+    if (runner != mainThread) {
+        thr = fiberPool;
+        if (thr) {
+            fiberPool = thr->next;
+            numPooledFibers--;
+            stack = thr->stack;
+        } else {
+            stack = allocStack();
+        }
+    }
+    if (!thr)
+        thr = (Thread *)xmalloc_tagged(sizeof(Thread), MallocTag::Fiber);
     memset(thr, 0, sizeof(Thread));
     thr->next = allThreads;
+    if (allThreads)
+        allThreads->prev = thr;
     allThreads = thr;
     registerGC(&thr->act, 4);
     thr->act = a;
     thr->arg0 = arg;
     thr->data0 = d0;
     thr->data1 = d1;
-    pthread_cond_init(&thr->waitCond, NULL);
-    if (runner == mainThread) {
-        thr->pid = pthread_self();
-    } else {
-        pthread_create(&thr->pid, NULL, (void *(*)(void *))runner, thr);
-        THREAD_DBG("setup thread: %p (pid %p)", thr, thr->pid);
-        pthread_detach(thr->pid);
+    thr->runner = runner;
+    thr->stack = stack;
+    if (stack) {
+        getcontext(&thr->ctx);
+        thr->ctx.uc_stack.ss_sp = thr->stack + FIBER_GUARD_SIZE;
+        thr->ctx.uc_stack.ss_size = FIBER_STACK_SIZE - FIBER_GUARD_SIZE;
+        thr->ctx.uc_link = NULL;
+        makecontext(&thr->ctx, fiberEntry, 0);
+        makeRunnable(thr);
+        THREAD_DBG("setup thread: %p", thr);
     }
+    return thr;
 }
 
 void releaseFiber() {
-    stopUser();
-    pthread_exit(NULL);
+    currentThread->done = true;
+    schedule();
+    oops(56); // not woken up once done
 }
 
 void runInParallel(Action a) {
@@ -229,7 +494,6 @@ void runInParallel(Action a) {
 }
 
 static void runFor(Thread *t) {
-    startUser();
     while (true) {
         pxt::runAction0(t->act);
         sleep_ms(20);
@@ -240,30 +504,63 @@ void runForever(Action a) {
     setupThread(a, 0, runFor);
 }
 
+static inline unsigned waitBucket(int source, int value) {
+    return ((uint32_t)source * 0x9e3779b1 ^ (uint32_t)value) % WAIT_BUCKETS;
+}
+
 void waitForEvent(int source, int value) {
     THREAD_DBG("waitForEv: %d %d", source, value);
-    auto self = pthread_self();
-    for (auto t = allThreads; t; t = t->next) {
-        THREAD_DBG("t: %p", t);
-        if (t->pid == self) {
-            pthread_mutex_lock(&eventMutex);
-            t->waitSource = source;
-            t->waitValue = value;
-            stopUser();
-            // spourious wake ups may occur they say
-            while (t->waitSource) {
-                pthread_cond_wait(&t->waitCond, &eventMutex);
-            }
-            pthread_mutex_unlock(&eventMutex);
-            startUser();
-            return;
+    auto t = currentThread;
+    if (!t) {
+        DMESG("current thread not registered!");
+        oops(52);
+    }
+    t->waitSource = source;
+    t->waitValue = value;
+    t->waitSeq = ++waitSeq;
+    t->waitNext = NULL;
+    auto b = &waiters[waitBucket(source, value)];
+    if (b->tail)
+        b->tail->waitNext = t;
+    else
+        b->head = t;
+    b->tail = t;
+    schedule();
+}
+
+// the fiber that waits longest for exactly (source, value)
+static Thread *firstWaiter(int source, int value) {
+    for (auto t = waiters[waitBucket(source, value)].head; t; t = t->waitNext)
+        if (t->waitSource == source && t->waitValue == value)
+            return t;
+    return NULL;
+}
+
+// wake fibers waiting for exactly (source, value), or just [only] if given
+static void wakeWaiters(int source, int value, Thread *only) {
+    auto b = &waiters[waitBucket(source, value)];
+    Thread *prev = NULL;
+    for (auto t = b->head; t;) {
+        auto n = t->waitNext;
+        if (t->waitSource == source && t->waitValue == value && (!only || t == only)) {
+            if (prev)
+                prev->waitNext = n;
+            else
+                b->head = n;
+            if (b->tail == t)
+                b->tail = prev;
+            t->waitNext = NULL;
+            t->waitSource = 0; // once!
+            makeRunnable(t);
+        } else {
+            prev = t;
         }
+        t = n;
     }
-    DMESG("current thread not registered!");
-    oops(52);
 }
 
 static void dispatchEvent(Event &e) {
+    PXT_TRACE_EVENT(EventDispatch, e.source, e.value);
     lastEvent = e;
 
     auto curr = findBinding(e.source, e.value);
@@ -273,39 +570,91 @@ static void dispatchEvent(Event &e) {
     }
 }
 
-static void *evtDispatcher(void *dummy) {
-    pthread_mutex_lock(&eventMutex);
-    while (true) {
-        pthread_cond_wait(&newEventBroadcast, &eventMutex);
-        while (eventHead != NULL) {
-            if (paniced)
-                return 0;
-            Event *ev = eventHead;
-            eventHead = ev->next;
-            if (eventHead == NULL)
-                eventTail = NULL;
-
-            for (auto thr = allThreads; thr; thr = thr->next) {
-                if (paniced)
-                    return 0;
-                if (thr->waitSource == 0)
-                    continue;
-                if (thr->waitValue != ev->value && thr->waitValue != DEVICE_EVT_ANY)
-                    continue;
-                if (thr->waitSource == ev->source) {
-                    thr->waitSource = 0; // once!
-                    pthread_cond_broadcast(&thr->waitCond);
-                } else if (thr->waitSource == DEVICE_ID_NOTIFY &&
-                           ev->source == DEVICE_ID_NOTIFY_ONE) {
-                    thr->waitSource = 0; // once!
-                    pthread_cond_broadcast(&thr->waitCond);
-                    break; // do not wake up any other threads
-                }
+static void wakeFibers() {
+    Event ev;
+    while (popEvent(ev)) {
+        wakeWaiters(ev.source, ev.value, NULL);
+        if (ev.value != DEVICE_EVT_ANY)
+            wakeWaiters(ev.source, DEVICE_EVT_ANY, NULL);
+
+        if (ev.source == DEVICE_ID_NOTIFY_ONE) {
+            // do not wake up any other threads than the one waiting longest
+            auto t = firstWaiter(DEVICE_ID_NOTIFY, ev.value);
+            if (ev.value != DEVICE_EVT_ANY) {
+                auto u = firstWaiter(DEVICE_ID_NOTIFY, DEVICE_EVT_ANY);
+                if (u && (!t || (int)(u->waitSeq - t->waitSeq) < 0))
+                    t = u;
             }
+            if (t)
+                wakeWaiters(t->waitSource, t->waitValue, t);
+        }
+
+        dispatchEvent(ev);
+    }
+}
+
+static bool eventPending() {
+    auto idx = eventDeqPos & (EVENT_QUEUE_SIZE - 1);
+    return eventSlots[idx].seq.load() + idx == eventDeqPos + 1;
+}
 
-            dispatchEvent(*ev);
-            delete ev;
+// block until an event is raised or the first sleeper is due, letting go of the user lock
+static void waitForWork() {
+    uint64_t us = MAX_IDLE_WAIT_US;
+    if (numSleepers) {
+        int left = sleepers[0]->wakeTime - current_time_ms();
+        if (left <= 0)
+            return;
+        if ((uint64_t)left * 1000 < us)
+            us = left * 1000;
+    }
+
+    auto deadline = currTime() + us;
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000;
+    ts.tv_nsec = (deadline % 1000000) * 1000;
+
+    stopUser();
+    pthread_mutex_lock(&eventMutex);
+    dispatcherWaiting = true;
+    // check again, in case an event was raised just before the flag was set
+    if (!eventPending() && !paniced)
+        pthread_cond_timedwait(&newEventBroadcast, &eventMutex, &ts);
+    dispatcherWaiting = false;
+    pthread_mutex_unlock(&eventMutex);
+    startUser();
+}
+
+static void schedulerLoop() {
+    for (;;) {
+        // the fiber that just switched here
+        auto prev = currentThread;
+        if (prev) {
+            currentThread = NULL;
+            if (prev->done)
+                disposeThread(prev);
+            else if (prev->wakeTime)
+                addSleeper(prev);
+            // otherwise it waits for an event, and wakeFibers() will queue it
+        }
+
+        if (paniced) {
+            // target_panic() is on its way to exit
+            stopUser();
+            while (true)
+                sleep_core_us(100000);
+        }
+        wakeFibers();
+        wakeSleepers();
+        auto t = nextRunnable();
+        if (!t) {
+            waitForWork();
+            continue;
         }
+
+        currentThread = t;
+        PXT_TRACE_EVENT(FiberRun, (uint32_t)(uintptr_t)t, 0);
+        swapcontext(&schedulerCtx, &t->ctx);
     }
 }
 
@@ -318,18 +667,18 @@ int allocateNotifyEvent() {
 }
 
 void raiseEvent(int id, int event) {
-    auto e = mkEvent(id, event);
-    pthread_mutex_lock(&eventMutex);
-    if (eventTail == NULL) {
-        if (eventHead != NULL)
-            oops(51);
-        eventHead = eventTail = e;
-    } else {
-        eventTail->next = e;
-        eventTail = e;
+    if (!pushEvent(id, event)) {
+        // the dispatcher doesn't keep up; the event is lost
+        auto n = ++numDroppedEvents;
+        if ((n & (n - 1)) == 0)
+            DMESG("event queue full; %d events dropped", n);
+        return;
+    }
+    if (dispatcherWaiting.load()) {
+        pthread_mutex_lock(&eventMutex);
+        pthread_cond_broadcast(&newEventBroadcast);
+        pthread_mutex_unlock(&eventMutex);
     }
-    pthread_cond_broadcast(&newEventBroadcast);
-    pthread_mutex_unlock(&eventMutex);
 }
 
 void registerWithDal(int id, int event, Action a, int flags) {
@@ -353,42 +702,84 @@ void initRuntime() {
 
     target_startup();
 
-    pthread_t disp;
-    pthread_create(&disp, NULL, evtDispatcher, NULL);
-    pthread_detach(disp);
-    setupThread(0, 0, mainThread);
+    // the scheduler runs when the main fiber first sleeps or waits, on a stack of its own
+    auto schedStack = allocStack();
+    getcontext(&schedulerCtx);
+    schedulerCtx.uc_stack.ss_sp = schedStack + FIBER_GUARD_SIZE;
+    schedulerCtx.uc_stack.ss_size = FIBER_STACK_SIZE - FIBER_GUARD_SIZE;
+    schedulerCtx.uc_link = NULL;
+    makecontext(&schedulerCtx, schedulerLoop, 0);
+    userThread = pthread_self();
+    currentThread = setupThread(0, 0, mainThread);
     target_init();
     screen_init();
     initKeys();
     startUser();
 }
 
+// The GC heap is one range, reserved up front at GC_BASE and backed by the kernel as blocks get
+// used, so that adding a block takes no syscall, and with transparent huge pages marking takes
+// fewer TLB misses. If the range can't be had, or runs out, blocks are mapped one at a time.
 #define GC_BASE 0x20000000
 #define GC_PAGE_SIZE 4096
+#ifndef GC_RESERVE_SIZE
+#define GC_RESERVE_SIZE (256 * 1024 * 1024)
+#endif
+
+uint8_t *gcAreaStart, *gcAreaEnd;
+static uint8_t *gcReserveEnd;
+
+static void reserveGCArea() {
+    gcAreaStart = gcAreaEnd = (uint8_t *)GC_BASE;
+    void *r = mmap(gcAreaStart, GC_RESERVE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    if (r == MAP_FAILED)
+        return;
+    if (r != gcAreaStart) {
+        DMESG("GC range at %p not available", gcAreaStart);
+        munmap(r, GC_RESERVE_SIZE);
+        return;
+    }
+    gcReserveEnd = gcAreaStart + GC_RESERVE_SIZE;
+#ifdef MADV_HUGEPAGE
+    madvise(r, GC_RESERVE_SIZE, MADV_HUGEPAGE);
+#endif
+}
+
 void *gcAllocBlock(size_t sz) {
-    static uint8_t *currPtr = (uint8_t *)GC_BASE;
+    if (!gcAreaStart)
+        reserveGCArea();
     sz = (sz + GC_PAGE_SIZE - 1) & ~(GC_PAGE_SIZE - 1);
-    void *r = mmap(currPtr, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
-    if (r == MAP_FAILED) {
-        DMESG("mmap %p failed; err=%d", currPtr, errno);
-        target_panic(PANIC_INTERNAL_ERROR);
-    }
-    currPtr = (uint8_t *)r + sz;
-    if (isReadOnly((TValue)r)) {
-        DMESG("mmap returned read-only address: %p", r);
-        target_panic(PANIC_INTERNAL_ERROR);
+    uint8_t *r = gcAreaEnd;
+    if (r + sz > gcReserveEnd) {
+        void *m = mmap(r, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (m == MAP_FAILED) {
+            DMESG("mmap %p failed; err=%d", r, errno);
+            target_panic(PANIC_INTERNAL_ERROR);
+        }
+        r = (uint8_t *)m;
+        if (isReadOnly((TValue)r)) {
+            DMESG("mmap returned read-only address: %p", r);
+            target_panic(PANIC_INTERNAL_ERROR);
+        }
+        // not where asked for; the range now also covers whatever is in between
+        if (r < gcAreaStart)
+            gcAreaStart = r;
     }
+    if (r + sz > gcAreaEnd)
+        gcAreaEnd = r + sz;
     return r;
 }
 
-static __thread ThreadContext *threadCtx;
-
 ThreadContext *getThreadContext() {
-    return threadCtx;
+    // other threads (serial, audio, ...) don't run user code
+    if (!currentThread || !pthread_equal(pthread_self(), userThread))
+        return NULL;
+    return currentThread->threadCtx;
 }
 
 void setThreadContext(ThreadContext *ctx) {
-    threadCtx = ctx;
+    currentThread->threadCtx = ctx;
 }
 
 void *threadAddressFor(ThreadContext *, void *sp) {
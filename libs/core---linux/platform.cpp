@@ -14,6 +14,8 @@ static void initRandomSeed() {
     seedRandom(seed);
 }
 
+#ifndef PXT_VM
+// the VM has its own, in target.cpp
 void sendSerial(const char *data, int len) {
     /*
     if (!serial) {
@@ -23,6 +25,7 @@ void sendSerial(const char *data, int len) {
     serial->send((uint8_t*)data, len);
     */
 }
+#endif
 
 extern "C" void drawPanic(int code)
 {
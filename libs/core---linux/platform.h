@@ -33,6 +33,8 @@ namespace pxt
 
 #define IMAGE_BITS 4
 #define PXT_GC_THREAD_LIST 1
+// mark and sweep the heap using several threads; see PXT_GC_THREADS in gc.cpp
+//#define PXT_GC_PARALLEL 1
 
 #define PXT_IN_ISR() false
 
@@ -4,6 +4,7 @@
 #include "pxtbase.h"
 
 #define OUTPUT_BITS 12
+#define MAX_SOUNDS 12
 
 #define DEVICE_EVT_ANY 0
 #define DEVICE_ID_NOTIFY_ONE 1022
@@ -17,11 +18,15 @@ typedef serial::LinuxSerialDevice *SerialDevice;
 
 namespace pxt {
 void raiseEvent(int id, int event);
+// number of events lost, because the event queue was full
+uint32_t droppedEvents();
 int allocateNotifyEvent();
 void sleep_core_us(uint64_t us);
 void startUser();
 void stopUser();
 int tryLockUser();
+// write out and sync the DMESG lines still queued
+void dmesg_flush();
 
 void target_disable_irq();
 void target_enable_irq();
@@ -4,12 +4,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
+
+// what the xmalloc_tagged() memory is for, in the dumpMallocStats() report
+enum class MallocTag { Other, Fiber, Scheduler, Screen, Serial, Count };
 
 namespace pxt {
 void dmesg(const char *fmt, ...);
 void vdmesg(const char *format, va_list arg);
 #define DMESG pxt::dmesg
 void *gcAllocBlock(size_t sz);
+// where the GC blocks are, see gcAllocBlock()
+extern uint8_t *gcAreaStart, *gcAreaEnd;
+// DMESG the xmalloc() bytes in use, per tag
+void dumpMallocStats();
 }
 
 static inline void itoa(int v, char *dst) {
@@ -17,9 +25,14 @@ static inline void itoa(int v, char *dst) {
 }
 
 extern "C" void *xmalloc(size_t sz);
-#define xfree free
+extern "C" void xfree(void *p);
+void *xmalloc_tagged(size_t sz, MallocTag tag);
 
 #define GC_ALLOC_BLOCK gcAllocBlock
+#ifndef PXT_VM
+// the VM's blocks aren't in one range, so it checks them one by one
+#define GC_IN_AREA(p) (pxt::gcAreaStart <= (uint8_t *)(p) && (uint8_t *)(p) < pxt::gcAreaEnd)
+#endif
 
 #ifndef POKY
 // This seems to degrade performance - probably due to cache size
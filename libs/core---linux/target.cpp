@@ -9,6 +9,7 @@
 namespace pxt {
 
 void target_exit() {
+    dmesg_flush();
     kill(getpid(), SIGTERM);
 }
 
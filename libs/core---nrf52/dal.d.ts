@@ -778,6 +778,8 @@ declare const enum DAL {
     CFG_NUM_ONBOARD_DOTSTARS = 221,
     CFG_PIN_ONBOARD_NEOPIXEL = 222,
     CFG_NUM_ONBOARD_NEOPIXELS = 223,
+    CFG_GC_INCREMENTAL_SLICE_US = 224,
+    CFG_FAST_MATH = 225,
     CFG_MATRIX_KEYPAD_MESSAGE_ID = 239,
     CFG_NUM_MATRIX_KEYPAD_ROWS = 240,
     CFG_PIN_MATRIX_KEYPAD_ROW0 = 241,
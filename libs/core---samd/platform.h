@@ -68,6 +68,10 @@ typedef int PinName;
 
 #define IMAGE_BITS 4
 
+// slide the heap together when an allocation only fails because the free memory is in pieces;
+// native code must then keep pointers to the heap only on the stack or in registerGC() roots
+//#define PXT_GC_COMPACT 1
+
 // The parameters below needs tuning!
 
 #define PA00 0
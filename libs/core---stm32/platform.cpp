@@ -241,6 +241,71 @@ int *getBootloaderConfigData() {
     return NULL;
 }
 
+#ifdef PXT_DMA_MEMOPS
+// Only DMA2 can do memory-to-memory transfers, on any stream; stream 4 isn't used by the SPI,
+// serial and I2C drivers of the boards we run on. The source is the peripheral port, which
+// doesn't increment for fills.
+#define MEMOPS_STREAM DMA2_Stream4
+#define MEMOPS_CLEAR_FLAGS                                                                         \
+    (DMA_HIFCR_CTCIF4 | DMA_HIFCR_CHTIF4 | DMA_HIFCR_CTEIF4 | DMA_HIFCR_CDMEIF4 | DMA_HIFCR_CFEIF4)
+#define MEMOPS_MAX_LEN (0xffff * 4)
+
+static bool dmaRunning;
+static uint32_t dmaPattern;
+
+static bool dmaReachable(const void *p) {
+    // the CCM RAM of F405/F407 isn't on the bus matrix
+    auto addr = (uintptr_t)p;
+    return addr < 0x10000000 || addr >= 0x20000000;
+}
+
+static bool dmaStart(void *dst, const void *src, int len, bool increment) {
+    if (dmaRunning || len <= 0 || len > MEMOPS_MAX_LEN || ((uintptr_t)dst & 3) ||
+        ((uintptr_t)src & 3) || (len & 3) || !dmaReachable(dst) || !dmaReachable(src))
+        return false;
+
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+    auto s = MEMOPS_STREAM;
+    if (s->CR & DMA_SxCR_EN)
+        return false; // someone else's transfer
+
+    DMA2->HIFCR = MEMOPS_CLEAR_FLAGS;
+    s->PAR = (uint32_t)src;
+    s->M0AR = (uint32_t)dst;
+    s->NDTR = len >> 2;
+    // memory-to-memory needs the FIFO; drain it when full
+    s->FCR = DMA_SxFCR_DMDIS | DMA_SxFCR_FTH_0 | DMA_SxFCR_FTH_1;
+    s->CR = DMA_SxCR_DIR_1 | DMA_SxCR_MINC | (increment ? DMA_SxCR_PINC : 0) |
+            DMA_SxCR_PSIZE_1 | DMA_SxCR_MSIZE_1 | DMA_SxCR_PL_1;
+    s->CR |= DMA_SxCR_EN;
+    dmaRunning = true;
+    return true;
+}
+
+bool dmaCopyStart(void *dst, const void *src, int len) {
+    return dmaStart(dst, src, len, true);
+}
+
+bool dmaFillStart(void *dst, uint8_t v, int len) {
+    if (dmaRunning)
+        return false;
+    dmaPattern = 0x01010101 * v;
+    return dmaStart(dst, &dmaPattern, len, false);
+}
+
+bool dmaWait() {
+    if (!dmaRunning)
+        return true;
+    while (!(DMA2->HISR & (DMA_HISR_TCIF4 | DMA_HISR_TEIF4)))
+        ;
+    bool ok = !(DMA2->HISR & DMA_HISR_TEIF4);
+    MEMOPS_STREAM->CR &= ~DMA_SxCR_EN;
+    DMA2->HIFCR = MEMOPS_CLEAR_FLAGS;
+    dmaRunning = false;
+    return ok;
+}
+#endif
+
 #define STM32_UUID ((uint32_t *)0x1FFF7A10)
 
 static void writeHex(char *buf, uint32_t n) {
@@ -266,6 +331,26 @@ void platform_usb_init() {
 #endif
 }
 
+#ifdef CRC
+// The CRC unit does the CRC32 of zlib MSB first; reversing the bits of the words going in and of
+// the result makes it LSB first, like BufferMethods::crc32(). The odd bytes at the end are left to
+// the table. It starts at 0xffffffff after a reset, which is where BufferMethods::crc32() starts.
+unsigned crc32Hardware(const uint8_t *data, unsigned len, uint32_t *state) {
+    unsigned n = len & ~3U;
+    if (n < 16)
+        return 0;
+    __HAL_RCC_CRC_CLK_ENABLE();
+    CRC->CR = CRC_CR_RESET;
+    for (unsigned i = 0; i < n; i += 4) {
+        uint32_t w;
+        memcpy(&w, data + i, 4);
+        CRC->DR = __RBIT(w);
+    }
+    *state = __RBIT(CRC->DR);
+    return n;
+}
+#endif
+
 } // namespace pxt
 
 void cpu_clock_init() {}
@@ -71,6 +71,19 @@ struct F4_Settings {
 
 #define IMAGE_BITS 4
 
+#ifdef STM32F4
+// large copies and fills of pixels in image.cpp are shared between the CPU and a DMA stream
+#define PXT_DMA_MEMOPS 1
+namespace pxt {
+// start a copy or fill of len bytes, all word-aligned; false when the stream is busy or can't
+// reach the memory
+bool dmaCopyStart(void *dst, const void *src, int len);
+bool dmaFillStart(void *dst, uint8_t v, int len);
+// wait for the transfer started; false on a transfer error
+bool dmaWait();
+} // namespace pxt
+#endif
+
 
 // The parameters below needs tuning!
 
@@ -8,6 +8,11 @@ int pressureLevelByButtonId(int btnId, int codalId) {
     return 0; // TODO
 }
 
+//% expose
+Buffer buttonSnapshot() {
+    return NULL; // the buttons are tracked from their events
+}
+
 //% expose
 void setupButton(int buttonId, int key) {
     (void)buttonId;
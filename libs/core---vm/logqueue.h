@@ -0,0 +1,86 @@
+#ifndef __PXT_LOGQUEUE_H
+#define __PXT_LOGQUEUE_H
+
+// The ring behind pxt_get_logs(); in a header of its own so that cpptests/queue.cpp can test it.
+// Uses min() of pxtbase.h.
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+namespace pxt {
+
+// The VM writes (with the irq lock held, so one at a time) and the host reads, from its own
+// thread, without taking any lock. Positions are byte sequence numbers that only go up; once the
+// writer is a whole buffer ahead of a reader, the oldest bytes are lost and the reader skips them.
+#ifndef LOG_QUEUE_SIZE
+#define LOG_QUEUE_SIZE (128 * 1024) // power of 2
+#endif
+class LogQueue {
+    char buffer[LOG_QUEUE_SIZE];
+    // the end of the bytes being written and of those written, as in a seqlock
+    std::atomic<uint32_t> wrStart, wrEnd;
+
+  public:
+    uint32_t rdPos; // for read()
+    LogQueue();
+    void write(const char *buf, int len);
+    // copies the bytes from pos on (or from the oldest still there), moving pos past them
+    int readFrom(uint32_t &pos, char *dst, int len);
+    int read(char *dst, int len) { return readFrom(rdPos, dst, len); }
+    uint32_t position() { return wrEnd.load(std::memory_order_acquire); }
+};
+
+inline LogQueue::LogQueue() {
+    wrStart = 0;
+    wrEnd = 0;
+    rdPos = 0;
+}
+
+inline void LogQueue::write(const char *buf, int len) {
+    if (len > LOG_QUEUE_SIZE) {
+        buf += len - LOG_QUEUE_SIZE;
+        len = LOG_QUEUE_SIZE;
+    }
+    uint32_t pos = wrEnd.load(std::memory_order_relaxed);
+    wrStart.store(pos + len, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    uint32_t off = pos & (LOG_QUEUE_SIZE - 1);
+    int first = min(len, LOG_QUEUE_SIZE - (int)off);
+    memcpy(buffer + off, buf, first);
+    memcpy(buffer, buf + first, len - first);
+    wrEnd.store(pos + len, std::memory_order_release);
+}
+
+inline int LogQueue::readFrom(uint32_t &pos, char *dst, int len) {
+    uint32_t end = wrEnd.load(std::memory_order_acquire);
+    if ((int32_t)(end - pos) < 0 || end - pos > LOG_QUEUE_SIZE)
+        pos = end - min(end, (uint32_t)LOG_QUEUE_SIZE);
+    int n = min(len, (int)(end - pos));
+    if (n <= 0)
+        return 0;
+    uint32_t off = pos & (LOG_QUEUE_SIZE - 1);
+    int first = min(n, LOG_QUEUE_SIZE - (int)off);
+    memcpy(dst, buffer + off, first);
+    memcpy(dst + first, buffer, n - first);
+
+    // whatever the writer got to meanwhile is not to be trusted
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t start = wrStart.load(std::memory_order_relaxed);
+    if (start - pos > LOG_QUEUE_SIZE) {
+        int lost = start - LOG_QUEUE_SIZE - pos;
+        if (lost >= n) {
+            pos = start - LOG_QUEUE_SIZE;
+            return 0;
+        }
+        memmove(dst, dst + lost, n - lost);
+        pos += lost;
+        n -= lost;
+    }
+    pos += n;
+    return n;
+}
+
+} // namespace pxt
+
+#endif
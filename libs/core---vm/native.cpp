@@ -0,0 +1,528 @@
+#include "pxt.h"
+#include <stdio.h>
+
+#ifdef __MINGW32__
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+// Images can run as native code instead of being interpreted. pxt_vm_translate() writes C for
+// an image, with a C function for every function of the image. The host compiles that to a
+// shared library, which is kept by the program hash with the cache (see vmcache::nativePath()),
+// and loaded along with the image when it's there and was made from the same image.
+//
+// The C calls the same opcode and rtcall functions as exec_loop(), and does the simplest ones
+// (locals, pushes and pops, small literals) inline. Every instruction has a label, and the jumps
+// in a function are gotos. Calls, returns, throws and rtcalls that block or call toString()
+// change pc, and go back to runNative(), which goes on in the function where pc is.
+//
+// The translator doesn't check the image beyond what it needs to read it, as the native code
+// only runs once the same image passed verification.
+
+namespace pxt {
+
+#define VM_NATIVE_MAGIC 0x4e565850 // PXVN
+// bump when the structures below or the translation change
+#define VM_NATIVE_VERSION 1
+
+#if defined(__MINGW32__)
+#define VM_NATIVE_EXT ".dll"
+#elif defined(__APPLE__)
+#define VM_NATIVE_EXT ".dylib"
+#else
+#define VM_NATIVE_EXT ".so"
+#endif
+
+// these two have to match the C in nativeHeader below
+struct VMNativeEnv {
+    uint16_t *imgbase;
+    uint16_t **pc;
+    TValue **sp;
+    TValue *r0;
+    TValue **rtcallSp;
+    OpFun *opcodes;
+    volatile int *panicCode;
+};
+
+// exported as pxt_vm_native by the library
+struct VMNativeImage {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pointerSize;
+    uint32_t imageSize;
+    uint64_t programHash;
+    uint64_t hexHash;
+    uint32_t numFunctions;
+    // where the code of each function starts, in 16 bit words from the start of the image
+    const uint32_t *offsets;
+    const VMNativeFn *functions;
+};
+
+static const char nativeHeader[] = R"(#include <stdint.h>
+
+struct env {
+    uint16_t *imgbase;
+    uint16_t **pc;
+    void ***sp;
+    void **r0;
+    void ***rtcallSp;
+    void (**opcodes)(void *, unsigned);
+    volatile int *panicCode;
+};
+
+struct image {
+    uint32_t magic, version, pointerSize, imageSize;
+    uint64_t programHash, hexHash;
+    uint32_t numFunctions;
+    const uint32_t *offsets;
+    void (*const *functions)(void *, const struct env *);
+};
+
+#define AT(n) (env->imgbase + (n))
+#define SETPC(n) (*env->pc = AT(n))
+#define LEFT(n) (*env->pc != AT(n))
+#define STOPPED() (*env->panicCode)
+#define R0 (*env->r0)
+#define SP (*env->sp)
+#define PUSH() (*--SP = R0)
+#define OP(i, arg) env->opcodes[i](ctx, arg)
+#define RTCALL(i) (*env->rtcallSp = SP, ((void (*)(void *))env->opcodes[i])(ctx))
+
+#ifdef _WIN32
+#define EXPORT __declspec(dllexport)
+#else
+#define EXPORT __attribute__((visibility("default")))
+#endif
+)";
+
+void op_stloc(FiberContext *ctx, unsigned arg);
+void op_ldloc(FiberContext *ctx, unsigned arg);
+void op_ldcap(FiberContext *ctx, unsigned arg);
+void op_stglb(FiberContext *ctx, unsigned arg);
+void op_ldglb(FiberContext *ctx, unsigned arg);
+void op_ldlit(FiberContext *ctx, unsigned arg);
+void op_ldnumber(FiberContext *ctx, unsigned arg);
+void op_jmp(FiberContext *ctx, unsigned arg);
+void op_jmpz(FiberContext *ctx, unsigned arg);
+void op_jmpnz(FiberContext *ctx, unsigned arg);
+void op_newobj(FiberContext *ctx, unsigned arg);
+void op_ldfld(FiberContext *ctx, unsigned arg);
+void op_stfld(FiberContext *ctx, unsigned arg);
+void op_ret(FiberContext *ctx, unsigned arg);
+void op_pop(FiberContext *ctx, unsigned arg);
+void op_popmany(FiberContext *ctx, unsigned arg);
+void op_pushmany(FiberContext *ctx, unsigned arg);
+void op_push(FiberContext *ctx, unsigned arg);
+void op_ldspecial(FiberContext *ctx, unsigned arg);
+void op_ldint(FiberContext *ctx, unsigned arg);
+void op_ldintneg(FiberContext *ctx, unsigned arg);
+void op_try(FiberContext *ctx, unsigned arg);
+void op_checkinst(FiberContext *ctx, unsigned arg);
+
+// opcodes that never change pc, so the code goes on without checking it
+static bool keepsPC(OpFun fn) {
+    return fn == op_ldcap || fn == op_stglb || fn == op_ldglb || fn == op_ldlit ||
+           fn == op_ldnumber || fn == op_newobj || fn == op_ldfld || fn == op_stfld ||
+           fn == op_pushmany || fn == op_try || fn == op_checkinst;
+}
+
+// the functions of the opcode map, indexed like VMImage::opcodes; NULL for unknown names
+static OpFun *readOpcodes(VMImageSection *sect, unsigned &numOpcodes) {
+    auto curr = sect->data;
+    auto endp = sect->data + sect->size - 8;
+    if (sect->size <= 8 || endp[-1] != 0)
+        return NULL;
+    numOpcodes = 0;
+    for (auto p = curr; p < endp; ++p)
+        if (*p == 0)
+            numOpcodes++;
+    auto res = (OpFun *)calloc(numOpcodes, sizeof(OpFun));
+    for (unsigned i = 0; curr < endp; ++i) {
+        if (*curr)
+            for (auto st = staticOpcodes; st->name; st++)
+                if (strcmp(st->name, (const char *)curr) == 0) {
+                    res[i] = st->fn;
+                    break;
+                }
+        while (*curr)
+            curr++;
+        curr++;
+    }
+    return res;
+}
+
+static bool translateFunction(FILE *out, uint16_t *imgbase, VMImageSection *sect, unsigned idx,
+                              OpFun *opcodes, unsigned numOpcodes) {
+    if (sect->size <= VM_FUNCTION_CODE_OFFSET)
+        return false;
+    auto code = (uint16_t *)((uint8_t *)sect + VM_FUNCTION_CODE_OFFSET);
+    unsigned base = code - imgbase;
+    unsigned lastPC = (sect->size - VM_FUNCTION_CODE_OFFSET) >> 1;
+    // where instructions start, as jumps can only go there
+    auto starts = (uint8_t *)calloc(lastPC, 1);
+    bool ok = true;
+
+    fprintf(out, "static void f%u(void *ctx, const struct env *env) {\n", idx);
+    for (int pass = 0; pass < 2 && ok; ++pass) {
+        if (pass == 1)
+            fprintf(out, "    default:\n        return;\n    }\n");
+        unsigned pc = 0;
+        bool atEnd = false;
+        while (pc < lastPC) {
+            if (code[pc] == 0 && atEnd) {
+                pc++;
+                continue;
+            }
+            unsigned startPC = pc;
+            DecodedOp op;
+            if (code[pc] >> 14 == 0b11 && pc + 1 >= lastPC) {
+                ok = false;
+                break;
+            }
+            pc = decodeOp(code, pc, op);
+            OpFun fn = op.opIdx < numOpcodes ? opcodes[op.opIdx] : NULL;
+            if (!fn) {
+                ok = false;
+                break;
+            }
+            atEnd = fn == op_ret || fn == op_jmp;
+            unsigned at = base + startPC, next = base + pc;
+
+            if (pass == 0) {
+                if (startPC == 0)
+                    fprintf(out, "    switch (*env->pc - env->imgbase) {\n");
+                fprintf(out, "    case %u:\n        goto L%u;\n", at, at);
+                starts[startPC] = 1;
+                continue;
+            }
+
+            int target = (int)pc + (int)op.arg;
+            bool canGoto = 0 <= target && target < (int)lastPC && starts[target];
+            unsigned targetAt = base + target;
+
+            fprintf(out, "L%u:\n    ", at);
+            if (op.isRtCall)
+                fprintf(out, "SETPC(%u);\n    RTCALL(%u);\n", next, op.opIdx);
+            else if (fn == op_ldloc)
+                fprintf(out, "R0 = SP[%u];\n", op.arg);
+            else if (fn == op_stloc)
+                fprintf(out, "SP[%u] = R0;\n", op.arg);
+            else if (fn == op_push)
+                fprintf(out, "PUSH();\n");
+            else if (fn == op_pop)
+                fprintf(out, "R0 = *SP++;\n");
+            else if (fn == op_popmany)
+                fprintf(out, "SP += %u;\n", op.arg);
+            else if (fn == op_ldint || fn == op_ldintneg || fn == op_ldspecial) {
+                TValue v = fn == op_ldint      ? TAG_NUMBER(op.arg)
+                           : fn == op_ldintneg ? TAG_NUMBER(-(int)op.arg)
+                                               : (TValue)(uintptr_t)op.arg;
+                fprintf(out, "R0 = (void *)(uintptr_t)0x%llxULL;\n",
+                        (unsigned long long)(uintptr_t)v);
+            } else if (fn == op_jmp)
+                fprintf(out, "SETPC(%u);\n", targetAt);
+            else
+                fprintf(out, "SETPC(%u);\n    OP(%u, %uU);\n", next, op.opIdx, op.arg);
+
+            if (op.hasPush)
+                fprintf(out, "    PUSH();\n");
+
+            if (fn == op_jmp) {
+                if (canGoto)
+                    fprintf(out, "    if (!STOPPED())\n        goto L%u;\n", targetAt);
+                fprintf(out, "    return;\n");
+            } else if ((fn == op_jmpz || fn == op_jmpnz) && canGoto) {
+                fprintf(out, "    if (LEFT(%u)) {\n        if (!STOPPED())\n            goto L%u;\n"
+                             "        return;\n    }\n",
+                        next, targetAt);
+            } else if (op.isRtCall || (fn != op_ldloc && fn != op_stloc && fn != op_push &&
+                                       fn != op_pop && fn != op_popmany && fn != op_ldint &&
+                                       fn != op_ldintneg && fn != op_ldspecial && !keepsPC(fn))) {
+                fprintf(out, "    if (LEFT(%u))\n        return;\n", next);
+            }
+        }
+    }
+    // only reached with invalid code; runNative() then finds no function at pc
+    fprintf(out, "    return;\n}\n\n");
+    free(starts);
+    return ok;
+}
+
+static VMImageHeader *imageHeader(uint8_t *data, unsigned len) {
+    auto sect = (VMImageSection *)data;
+    if (len < sizeof(VMImageSection) + sizeof(VMImageHeader) ||
+        sect->type != SectionType::InfoHeader ||
+        sect->size < sizeof(VMImageSection) + sizeof(VMImageHeader) || sect->size > len)
+        return NULL;
+    auto hd = (VMImageHeader *)sect->data;
+    if (hd->magic0 != VM_MAGIC0 || hd->magic1 != VM_MAGIC1)
+        return NULL;
+    return hd;
+}
+
+// Writes the C for the image at [data] to [out]; false if it's not an image this runtime runs.
+static bool translateImage(uint8_t *data, unsigned len, FILE *out) {
+    auto hd = imageHeader(data, len);
+    if (!hd || (len & 7))
+        return false;
+
+    auto start = (uint64_t *)data, end = (uint64_t *)(data + len);
+    OpFun *opcodes = NULL;
+    unsigned numOpcodes = 0, numSections = 0;
+    for (auto p = start; p < end;) {
+        auto sect = (VMImageSection *)p;
+        if (sect->size < 8 || (sect->size & 7) || sect->size > (uint8_t *)end - (uint8_t *)p) {
+            free(opcodes);
+            return false;
+        }
+        if (sect->type == SectionType::OpCodeMap && !opcodes)
+            opcodes = readOpcodes(sect, numOpcodes);
+        numSections++;
+        p += sect->size >> 3;
+    }
+    if (!opcodes)
+        return false;
+
+    fprintf(out, "// native code of a PXT VM image, written by pxt_vm_translate()\n\n%s\n",
+            nativeHeader);
+
+    auto offsets = (uint32_t *)malloc(numSections * sizeof(uint32_t));
+    unsigned numFunctions = 0;
+    bool ok = true;
+    for (auto p = start; p < end && ok; p += ((VMImageSection *)p)->size >> 3) {
+        auto sect = (VMImageSection *)p;
+        if (sect->type != SectionType::Function)
+            continue;
+        offsets[numFunctions] =
+            (uint16_t *)((uint8_t *)sect + VM_FUNCTION_CODE_OFFSET) - (uint16_t *)data;
+        ok = translateFunction(out, (uint16_t *)data, sect, numFunctions, opcodes, numOpcodes);
+        numFunctions++;
+    }
+
+    if (ok && numFunctions) {
+        fprintf(out, "static const uint32_t offsets[] = {");
+        for (unsigned i = 0; i < numFunctions; ++i)
+            fprintf(out, "%s%u", i % 8 ? ", " : "\n    ", offsets[i]);
+        fprintf(out, "\n};\n\nstatic void (*const functions[])(void *, const struct env *) = {");
+        for (unsigned i = 0; i < numFunctions; ++i)
+            fprintf(out, "%sf%u", i % 8 ? ", " : "\n    ", i);
+        fprintf(out,
+                "\n};\n\nEXPORT const struct image pxt_vm_native = {\n    0x%x, %d, %d, %u, "
+                "0x%llxULL, 0x%llxULL, %u, offsets, functions,\n};\n",
+                VM_NATIVE_MAGIC, VM_NATIVE_VERSION, (int)sizeof(void *), len,
+                (unsigned long long)hd->programHash, (unsigned long long)hd->hexHash,
+                numFunctions);
+    }
+
+    free(offsets);
+    free(opcodes);
+    return ok && numFunctions;
+}
+
+static uint8_t *readFile(const char *path, unsigned &len) {
+    auto f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    len = (unsigned)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    auto data = (uint8_t *)malloc(len + 8);
+    if (fread(data, 1, len, f) != len) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+static int translateFile(const char *imagePath, const char *cPath) {
+    unsigned len;
+    auto data = readFile(imagePath, len);
+    if (!data)
+        return -1;
+    auto out = fopen(cPath, "w");
+    int r = -2;
+    if (out) {
+        r = translateImage(data, len, out) ? 0 : -3;
+        if (fclose(out))
+            r = -2;
+        if (r)
+            remove(cPath);
+    }
+    free(data);
+    return r;
+}
+
+static pthread_mutex_t compilerMutex = PTHREAD_MUTEX_INITIALIZER;
+static char *nativeCompiler;
+
+static void *translateWorker(void *arg) {
+    auto imagePath = (char *)arg;
+    pthread_mutex_lock(&compilerMutex);
+    auto compiler = nativeCompiler ? strdup(nativeCompiler) : NULL;
+    pthread_mutex_unlock(&compilerMutex);
+
+    unsigned len;
+    auto data = compiler ? readFile(imagePath, len) : NULL;
+    auto hd = data ? imageHeader(data, len) : NULL;
+    auto libPath = hd ? vmcache::nativePath(hd->programHash, VM_NATIVE_EXT) : NULL;
+    auto cPath = hd ? vmcache::nativePath(hd->programHash, ".c") : NULL;
+    FILE *exists = libPath ? fopen(libPath, "rb") : NULL;
+
+    if (exists) {
+        // the same program under another id
+        fclose(exists);
+    } else if (libPath && cPath && translateFile(imagePath, cPath) == 0) {
+        auto cmdLen = strlen(compiler) + strlen(libPath) + strlen(cPath) + 20;
+        auto cmd = (char *)malloc(cmdLen);
+        snprintf(cmd, cmdLen, "%s -o \"%s.tmp\" \"%s\"", compiler, libPath, cPath);
+        dmesg("compiling %s", cPath);
+        if (system(cmd) == 0) {
+            snprintf(cmd, cmdLen, "%s.tmp", libPath);
+            if (rename(cmd, libPath))
+                remove(cmd);
+        } else {
+            dmesg("compile failed: %s", cmd);
+        }
+        remove(cPath);
+        free(cmd);
+    }
+
+    free(libPath);
+    free(cPath);
+    free(data);
+    free(compiler);
+    free(imagePath);
+    return NULL;
+}
+
+// Translates and compiles the image at [path], now that it's in the cache, if a compiler is
+// set; this takes a while, so it's done on a thread of its own.
+void translateInBackground(const char *path) {
+    pthread_mutex_lock(&compilerMutex);
+    bool on = nativeCompiler != NULL;
+    pthread_mutex_unlock(&compilerMutex);
+    if (!on)
+        return;
+    pthread_t pt;
+    if (pthread_create(&pt, NULL, translateWorker, strdup(path)) == 0)
+        pthread_detach(pt);
+}
+
+void loadNativeCode(VMImage *img) {
+#ifndef PXT_VM_PROFILE
+    auto path = vmcache::nativePath(img->infoHeader->programHash, VM_NATIVE_EXT);
+    if (!path)
+        return;
+#ifdef __MINGW32__
+    auto lib = (void *)LoadLibraryA(path);
+    auto ni = lib ? (VMNativeImage *)GetProcAddress((HMODULE)lib, "pxt_vm_native") : NULL;
+#else
+    auto lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    auto ni = lib ? (VMNativeImage *)dlsym(lib, "pxt_vm_native") : NULL;
+#endif
+    auto len = (uint8_t *)img->dataEnd - (uint8_t *)img->dataStart;
+    auto hd = img->infoHeader;
+
+    VMNativeFn *code = NULL;
+    if (ni && ni->magic == VM_NATIVE_MAGIC && ni->version == VM_NATIVE_VERSION &&
+        ni->pointerSize == sizeof(void *) && ni->imageSize == len &&
+        ni->programHash == hd->programHash && ni->hexHash == hd->hexHash) {
+        auto numWords = len / 2;
+        code = (VMNativeFn *)xmalloc(numWords * sizeof(VMNativeFn));
+        memset(code, 0, numWords * sizeof(VMNativeFn));
+        unsigned k = 0;
+        for (unsigned i = 0; i < img->numSections && code; ++i) {
+            auto sect = img->sections[i];
+            if (sect->type != SectionType::Function)
+                continue;
+            unsigned off = (uint16_t *)((uint8_t *)sect + VM_FUNCTION_CODE_OFFSET) -
+                           (uint16_t *)img->dataStart;
+            auto endOff = off + ((sect->size - VM_FUNCTION_CODE_OFFSET) >> 1);
+            if (k >= ni->numFunctions || ni->offsets[k] != off) {
+                xfree(code);
+                code = NULL;
+                break;
+            }
+            for (auto w = off; w < endOff; ++w)
+                code[w] = ni->functions[k];
+            k++;
+        }
+        if (code && k != ni->numFunctions) {
+            xfree(code);
+            code = NULL;
+        }
+    }
+
+    if (code) {
+        dmesg("native code from %s", path);
+        img->nativeCode = code;
+        img->nativeLib = lib;
+    } else if (lib) {
+        dmesg("native code in %s is not for this image", path);
+#ifdef __MINGW32__
+        FreeLibrary((HMODULE)lib);
+#else
+        dlclose(lib);
+#endif
+    }
+    free(path);
+#endif
+}
+
+void unloadNativeCode(VMImage *img) {
+    if (!img->nativeLib)
+        return;
+    xfree(img->nativeCode);
+#ifdef __MINGW32__
+    FreeLibrary((HMODULE)img->nativeLib);
+#else
+    dlclose(img->nativeLib);
+#endif
+    img->nativeCode = NULL;
+    img->nativeLib = NULL;
+}
+
+// exec_loop() for images with native code
+void runNative(FiberContext *ctx) {
+    auto code = ctx->img->nativeCode;
+    VMNativeEnv env = {ctx->imgbase, &ctx->pc,            &ctx->sp,  &ctx->r0,
+                       &ctx->rtcallSp, ctx->img->opcodes, &panicCode};
+    while (ctx->pc) {
+        if (panicCode)
+            break;
+        auto fn = code[ctx->pc - ctx->imgbase];
+        if (!fn) {
+            DMESG("no native code at 0x%x",
+                  (int)((uint8_t *)ctx->pc - (uint8_t *)ctx->img->dataStart));
+            target_panic(PANIC_VM_ERROR);
+        }
+        fn(ctx, &env);
+    }
+}
+
+} // namespace pxt
+
+/*
+Writes the image at [imagePath] as C to [cPath]; compiled to a shared library, with something
+like "cc -O2 -shared -fPIC", and put at the path that vmcache::nativePath() gives for the
+program hash, it is used instead of the interpreter when the image is started. Returns 0, or a
+negative number when the image can't be read or translated, or [cPath] can't be written.
+*/
+DLLEXPORT int pxt_vm_translate(const char *imagePath, const char *cPath) {
+    return pxt::translateFile(imagePath, cPath);
+}
+
+/*
+Sets the command that compiles translated images, eg. "cc -O2 -shared -fPIC"; the output and
+the source paths go at the end. Then images saved with pxt_vm_save_in_cache() are translated
+and compiled in the background, and run as native code from the next time they're started.
+NULL turns that off.
+*/
+DLLEXPORT void pxt_vm_set_native_compiler(const char *cmd) {
+    pthread_mutex_lock(&pxt::compilerMutex);
+    free(pxt::nativeCompiler);
+    pxt::nativeCompiler = cmd ? strdup(cmd) : NULL;
+    pthread_mutex_unlock(&pxt::compilerMutex);
+}
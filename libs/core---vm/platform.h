@@ -39,6 +39,24 @@ namespace pxt
 
 #define GC_BLOCK_SIZE (1024 * 64)
 
+// allocate new objects in a nursery block, collected separately from the main heap
+//#define PXT_GC_NURSERY 1
+// mark the heap in small slices between fiber switches; see CFG_GC_INCREMENTAL_SLICE_US
+//#define PXT_GC_INCREMENTAL 1
+// mark and sweep the heap using several threads; see PXT_GC_THREADS in gc.cpp
+//#define PXT_GC_PARALLEL 1
+
+// run several independent programs in one process, each on its own thread;
+// see pxt_vm_instance_start()
+//#define PXT_VM_MULTI 1
+
+#ifdef PXT_VM_MULTI
+#define PXT_TLS __thread
+#define PXT_VM_MAX_INSTANCES 16
+#else
+#define PXT_VM_MAX_INSTANCES 1
+#endif
+
 #define PXT_REGISTER_RESET(fn) pxt::registerResetFunction(fn)
 
 #ifdef __APPLE__
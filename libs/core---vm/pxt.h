@@ -6,6 +6,7 @@
 #include "vm.h"
 
 #define OUTPUT_BITS 12
+#define MAX_SOUNDS 12
 
 #define DEVICE_EVT_ANY 0
 #define DEVICE_ID_NOTIFY_ONE 1022
@@ -13,6 +14,8 @@
 
 namespace pxt {
 void raiseEvent(int id, int event);
+// number of events lost, because the event queue was full
+uint32_t droppedEvents();
 int allocateNotifyEvent();
 void sleep_core_us(uint64_t us);
 
@@ -27,7 +30,7 @@ extern "C" void target_init();
 extern volatile bool paniced;
 extern char **initialArgv;
 void target_exit();
-extern volatile int panicCode;
+extern PXT_TLS volatile int panicCode;
 
 // Buffer, Sound, and Image share representation.
 typedef Buffer Sound;
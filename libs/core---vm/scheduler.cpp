@@ -8,6 +8,7 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <errno.h>
+#include <atomic>
 
 // __MINGW32__ is defined on both mingw32 and mingw64
 #ifdef __MINGW32__
@@ -27,6 +28,15 @@ void *xmalloc(size_t sz) {
     return r;
 }
 
+void xfree(void *p) {
+    free(p);
+}
+
+// the VM doesn't keep the per-tag counts of core---linux
+void *xmalloc_tagged(size_t sz, MallocTag) {
+    return xmalloc(sz);
+}
+
 void *operator new(size_t size) {
     return xmalloc(size);
 }
@@ -43,32 +53,109 @@ void operator delete[](void *p) THROW {
 
 namespace pxt {
 
-static uint64_t startTime;
+static PXT_TLS uint64_t startTime;
+
+static PXT_TLS FiberContext *allFibers;
+PXT_TLS FiberContext *currentFiber;
+
+// fibers that are neither sleeping nor waiting for an event, in FIFO order
+static PXT_TLS FiberContext *runHead, *runTail;
+
+// sleeping fibers, as a binary min-heap on wakeTime
+static PXT_TLS FiberContext **sleepers;
+static PXT_TLS int numSleepers, sleepersCap;
 
-FiberContext *allFibers;
-FiberContext *currentFiber;
-static pthread_mutex_t eventMutex;
-static pthread_cond_t newEventBroadcast;
+// fibers waiting for events, hashed on (waitSource, waitValue), in FIFO order in each bucket
+#define WAIT_BUCKETS 64
+static PXT_TLS struct {
+    FiberContext *head, *tail;
+} waiters[WAIT_BUCKETS];
+static PXT_TLS uint32_t waitSeq;
 
-static struct Event *eventHead, *eventTail;
+// when nothing is runnable, don't block for longer than this, so that panicCode is noticed
+#define MAX_IDLE_WAIT_US 100000
 
 struct Event {
-    struct Event *next;
     int source;
     int value;
 };
 
-Event lastEvent;
+static PXT_TLS Event lastEvent;
 
-Event *mkEvent(int source, int value) {
-    auto res = new Event();
-    memset(res, 0, sizeof(Event));
-    res->source = source;
-    res->value = value;
-    return res;
+// Bounded lock-free queue of raised events; many threads raise events,
+// only the dispatcher takes them out. See Vyukov's bounded MPMC queue.
+#define EVENT_QUEUE_SIZE 256 // power of 2
+
+struct EventSlot {
+    // the queue position this slot is for, minus the slot index (so that zero-init works);
+    // equal to the position when free and to position+1 when holding an event
+    std::atomic<uint32_t> seq;
+    Event ev;
+};
+
+struct EventQueue {
+    EventSlot slots[EVENT_QUEUE_SIZE];
+    std::atomic<uint32_t> enqPos;
+    uint32_t deqPos;
+    std::atomic<uint32_t> numDropped;
+    // set while the dispatcher is (about to be) blocked on newEvent
+    std::atomic<bool> dispatcherWaiting;
+    pthread_mutex_t mutex;
+    pthread_cond_t newEvent;
+};
+
+// one per VM instance, so that the host can raise events on an instance from any thread
+static EventQueue eventQueues[PXT_VM_MAX_INSTANCES];
+// the queue of the instance running on this thread; other threads started by the
+// program (serial, audio, ...) raise their events on the first instance
+static PXT_TLS EventQueue *events = &eventQueues[0];
+
+static bool pushEvent(EventQueue *q, int source, int value) {
+    uint32_t pos = q->enqPos.load(std::memory_order_relaxed);
+    EventSlot *slot;
+    for (;;) {
+        auto idx = pos & (EVENT_QUEUE_SIZE - 1);
+        slot = &q->slots[idx];
+        int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) + idx - pos);
+        if (diff == 0) {
+            if (q->enqPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = q->enqPos.load(std::memory_order_relaxed);
+        }
+    }
+    slot->ev.source = source;
+    slot->ev.value = value;
+    slot->seq.store(pos + 1 - (pos & (EVENT_QUEUE_SIZE - 1)));
+    return true;
+}
+
+static bool popEvent(Event &ev) {
+    auto q = events;
+    auto pos = q->deqPos;
+    auto idx = pos & (EVENT_QUEUE_SIZE - 1);
+    auto slot = &q->slots[idx];
+    if (slot->seq.load() + idx != pos + 1)
+        return false; // empty, or the producer is not done yet
+    ev = slot->ev;
+    slot->seq.store(pos + EVENT_QUEUE_SIZE - idx, std::memory_order_release);
+    q->deqPos = pos + 1;
+    return true;
+}
+
+uint32_t droppedEvents() {
+    return events->numDropped.load();
 }
 
-volatile int panicCode;
+static bool eventPending() {
+    auto q = events;
+    auto idx = q->deqPos & (EVENT_QUEUE_SIZE - 1);
+    return q->slots[idx].seq.load() + idx == q->deqPos + 1;
+}
+
+PXT_TLS volatile int panicCode;
 extern "C" void drawPanic(int code);
 
 void schedule() {
@@ -102,7 +189,7 @@ extern "C" void target_panic(int error_code) {
 }
 
 DLLEXPORT int pxt_get_panic_code() {
-    return panicCode;
+    return vmInstancePanicCode(&vmInstances[0]);
 }
 
 void soft_panic(int errorCode) {
@@ -151,6 +238,116 @@ int current_time_ms() {
     return (int)(current_time_us() / 1000);
 }
 
+static void makeRunnable(FiberContext *f) {
+    f->runNext = NULL;
+    if (runTail)
+        runTail->runNext = f;
+    else
+        runHead = f;
+    runTail = f;
+}
+
+static FiberContext *nextRunnable() {
+    auto f = runHead;
+    if (f) {
+        runHead = f->runNext;
+        if (!runHead)
+            runTail = NULL;
+        f->runNext = NULL;
+    }
+    return f;
+}
+
+static void addSleeper(FiberContext *f) {
+    if (numSleepers == sleepersCap) {
+        sleepersCap = sleepersCap ? sleepersCap * 2 : 16;
+        auto tmp = (FiberContext **)xmalloc(sleepersCap * sizeof(FiberContext *));
+        if (sleepers) {
+            memcpy(tmp, sleepers, numSleepers * sizeof(FiberContext *));
+            xfree(sleepers);
+        }
+        sleepers = tmp;
+    }
+    int i = numSleepers++;
+    while (i > 0) {
+        int parent = (i - 1) >> 1;
+        if (sleepers[parent]->wakeTime <= f->wakeTime)
+            break;
+        sleepers[i] = sleepers[parent];
+        i = parent;
+    }
+    sleepers[i] = f;
+}
+
+static FiberContext *popSleeper() {
+    auto res = sleepers[0];
+    auto last = sleepers[--numSleepers];
+    int i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= numSleepers)
+            break;
+        if (c + 1 < numSleepers && sleepers[c + 1]->wakeTime < sleepers[c]->wakeTime)
+            c++;
+        if (last->wakeTime <= sleepers[c]->wakeTime)
+            break;
+        sleepers[i] = sleepers[c];
+        i = c;
+    }
+    sleepers[i] = last;
+    return res;
+}
+
+static void wakeSleepers() {
+    auto now = current_time_ms();
+    while (numSleepers && now >= (int)sleepers[0]->wakeTime) {
+        auto f = popSleeper();
+        f->wakeTime = 0;
+        makeRunnable(f);
+    }
+}
+
+// block until an event is raised or the first sleeper is due
+static void waitForWork() {
+    uint64_t us = MAX_IDLE_WAIT_US;
+    if (numSleepers) {
+        auto now = current_time_us();
+        auto due = sleepers[0]->wakeTime * 1000;
+        if (due <= now)
+            return;
+        if (due - now < us)
+            us = due - now;
+    }
+
+    auto deadline = currTime() + us;
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000;
+    ts.tv_nsec = (deadline % 1000000) * 1000;
+
+    auto q = events;
+    pthread_mutex_lock(&q->mutex);
+    q->dispatcherWaiting = true;
+    if (!eventPending() && !panicCode)
+        pthread_cond_timedwait(&q->newEvent, &q->mutex, &ts);
+    q->dispatcherWaiting = false;
+    pthread_mutex_unlock(&q->mutex);
+}
+
+// disposed fibers with their stacks, so that starting event handlers doesn't allocate
+#define MAX_POOLED_FIBERS 16
+static PXT_TLS FiberContext *fiberPool;
+static PXT_TLS int numPooledFibers;
+
+// room for a few calls of the deepest function; growStack() takes care of the rest
+static uint32_t initialStackSize() {
+    uint32_t sz = 2 * (vmImg ? vmImg->maxStackDepth : 0) + 32;
+    if (sz < 64)
+        sz = 64;
+    if (sz > VM_STACK_SIZE)
+        sz = VM_STACK_SIZE;
+    return sz;
+}
+
 void disposeFiber(FiberContext *t) {
     if (allFibers == t) {
         allFibers = t->next;
@@ -163,17 +360,38 @@ void disposeFiber(FiberContext *t) {
         }
     }
 
+    // keep it for reuse, unless its stack has grown
+    if (numPooledFibers < MAX_POOLED_FIBERS && t->stackSize == initialStackSize()) {
+        t->next = fiberPool;
+        fiberPool = t;
+        numPooledFibers++;
+        return;
+    }
+
     xfree(t->stackBase);
     xfree(t);
 }
 
 FiberContext *setupThread(Action a, TValue arg = 0) {
     //DMESG("setup thread: %p", a);
-    auto t = (FiberContext *)xmalloc(sizeof(FiberContext));
+    auto stackSize = initialStackSize();
+    FiberContext *t = fiberPool;
+    TValue *stack = NULL;
+    if (t) {
+        fiberPool = t->next;
+        numPooledFibers--;
+        if (t->stackSize == stackSize)
+            stack = t->stackBase;
+        else
+            xfree(t->stackBase); // the image has changed
+    } else {
+        t = (FiberContext *)xmalloc(sizeof(FiberContext));
+    }
     memset(t, 0, sizeof(*t));
-    t->stackBase = (TValue *)xmalloc(VM_STACK_SIZE * sizeof(TValue));
-    t->stackLimit = t->stackBase + VM_MAX_FUNCTION_STACK + 5;
-    t->sp = t->stackBase + VM_STACK_SIZE;
+    t->stackBase = stack ? stack : (TValue *)xmalloc(stackSize * sizeof(TValue));
+    t->stackSize = stackSize;
+    t->stackLimit = t->stackBase + vmImg->maxStackDepth + 5;
+    t->sp = t->stackBase + stackSize;
     *--t->sp = (TValue)0xf00df00df00df00d;
     *--t->sp = 0;
     *--t->sp = 0;
@@ -202,6 +420,8 @@ FiberContext *setupThread(Action a, TValue arg = 0) {
     else
         allFibers = t;
 
+    makeRunnable(t);
+
     return t;
 }
 
@@ -214,13 +434,58 @@ void runForever(Action a) {
     f->foreverPC = f->resumePC;
 }
 
+static inline unsigned waitBucket(int source, int value) {
+    return ((uint32_t)source * 0x9e3779b1 ^ (uint32_t)value) % WAIT_BUCKETS;
+}
+
 void waitForEvent(int source, int value) {
-    currentFiber->waitSource = source;
-    currentFiber->waitValue = value;
+    auto f = currentFiber;
+    f->waitSource = source;
+    f->waitValue = value;
+    f->waitSeq = ++waitSeq;
+    f->waitNext = NULL;
+    auto b = &waiters[waitBucket(source, value)];
+    if (b->tail)
+        b->tail->waitNext = f;
+    else
+        b->head = f;
+    b->tail = f;
     schedule();
 }
 
+// the fiber that waits longest for exactly (source, value)
+static FiberContext *firstWaiter(int source, int value) {
+    for (auto f = waiters[waitBucket(source, value)].head; f; f = f->waitNext)
+        if (f->waitSource == source && f->waitValue == value)
+            return f;
+    return NULL;
+}
+
+// wake fibers waiting for exactly (source, value), or just [only] if given
+static void wakeWaiters(int source, int value, FiberContext *only) {
+    auto b = &waiters[waitBucket(source, value)];
+    FiberContext *prev = NULL;
+    for (auto f = b->head; f;) {
+        auto n = f->waitNext;
+        if (f->waitSource == source && f->waitValue == value && (!only || f == only)) {
+            if (prev)
+                prev->waitNext = n;
+            else
+                b->head = n;
+            if (b->tail == f)
+                b->tail = prev;
+            f->waitNext = NULL;
+            f->waitSource = 0;
+            makeRunnable(f);
+        } else {
+            prev = f;
+        }
+        f = n;
+    }
+}
+
 static void dispatchEvent(Event &e) {
+    PXT_TRACE_EVENT(EventDispatch, e.source, e.value);
     lastEvent = e;
 
     auto curr = findBinding(e.source, e.value);
@@ -233,83 +498,87 @@ static void dispatchEvent(Event &e) {
 }
 
 static void wakeFibers() {
-    for (;;) {
-        pthread_mutex_lock(&eventMutex);
-        if (eventHead == NULL) {
-            pthread_mutex_unlock(&eventMutex);
-            return;
-        }
-        Event *ev = eventHead;
-        eventHead = ev->next;
-        if (eventHead == NULL)
-            eventTail = NULL;
-        pthread_mutex_unlock(&eventMutex);
-
-        for (auto thr = allFibers; thr; thr = thr->next) {
-            if (thr->waitSource == 0)
-                continue;
-            if (thr->waitValue != ev->value && thr->waitValue != DEVICE_EVT_ANY)
-                continue;
-            if (thr->waitSource == ev->source) {
-                thr->waitSource = 0;
-            } else if (thr->waitSource == DEVICE_ID_NOTIFY && ev->source == DEVICE_ID_NOTIFY_ONE) {
-                thr->waitSource = 0;
-                break; // do not wake up any other threads
+    Event ev;
+    while (popEvent(ev)) {
+        wakeWaiters(ev.source, ev.value, NULL);
+        if (ev.value != DEVICE_EVT_ANY)
+            wakeWaiters(ev.source, DEVICE_EVT_ANY, NULL);
+
+        if (ev.source == DEVICE_ID_NOTIFY_ONE) {
+            // only wake up the fiber waiting longest
+            auto f = firstWaiter(DEVICE_ID_NOTIFY, ev.value);
+            if (ev.value != DEVICE_EVT_ANY) {
+                auto g = firstWaiter(DEVICE_ID_NOTIFY, DEVICE_EVT_ANY);
+                if (g && (!f || (int)(g->waitSeq - f->waitSeq) < 0))
+                    f = g;
             }
+            if (f)
+                wakeWaiters(f->waitSource, f->waitValue, f);
         }
 
-        dispatchEvent(*ev);
-        delete ev;
+        dispatchEvent(ev);
     }
 }
 
 static void mainRunLoop() {
-    FiberContext *f = NULL;
     for (;;) {
         if (panicCode)
             return;
         wakeFibers();
-        auto now = current_time_ms();
-        auto fromBeg = false;
+        wakeSleepers();
+        auto f = nextRunnable();
         if (!f) {
-            f = allFibers;
-            fromBeg = true;
+            waitForWork();
+            continue;
         }
-        while (f) {
-            if (f->wakeTime && now >= (int)f->wakeTime)
-                f->wakeTime = 0;
-            if (!f->wakeTime && !f->waitSource)
-                break;
-            f = f->next;
-        }
-        if (f) {
-            currentFiber = f;
-            f->pc = f->resumePC;
-            f->resumePC = NULL;
-            exec_loop(f);
-            if (panicCode)
-                return;
-            auto n = f->next;
-            if (f->resumePC == NULL) {
-                if (f->foreverPC) {
-                    f->resumePC = f->foreverPC;
-                    f->wakeTime = current_time_ms() + 20;
-                    // restore stack, as setupThread() does it
-                    for (int i = 0; i < 5; ++i) {
-                        if (*--f->sp == TAG_STACK_BOTTOM)
-                            break;
-                    }
-                    if (*f->sp != TAG_STACK_BOTTOM)
-                        target_panic(PANIC_INVALID_IMAGE);
-                } else {
-                    disposeFiber(f);
+
+        currentFiber = f;
+        PXT_TRACE_EVENT(FiberRun, (uint32_t)(uintptr_t)f, 0);
+        f->pc = f->resumePC;
+        f->resumePC = NULL;
+        auto start = current_time_us();
+        exec_loop(f);
+        f->runUs += current_time_us() - start;
+        f->switches++;
+        if (panicCode)
+            return;
+        gcIncrementalStep();
+        if (f->resumePC == NULL) {
+            if (f->foreverPC) {
+                f->resumePC = f->foreverPC;
+                f->wakeTime = current_time_ms() + 20;
+                // restore stack, as setupThread() does it
+                for (int i = 0; i < 5; ++i) {
+                    if (*--f->sp == TAG_STACK_BOTTOM)
+                        break;
                 }
+                if (*f->sp != TAG_STACK_BOTTOM)
+                    target_panic(PANIC_INVALID_IMAGE);
+                addSleeper(f);
+            } else {
+                disposeFiber(f);
             }
-            f = n;
-        } else if (fromBeg) {
-            sleep_core_us(1000);
+        } else if (f->wakeTime) {
+            addSleeper(f);
         }
+        // otherwise it waits for an event, and wakeFibers() will queue it
+    }
+}
+
+int getFiberStats(FiberStats *dest, int max) {
+    int n = 0;
+    for (auto f = allFibers; f && n < max; f = f->next) {
+        auto &st = dest[n++];
+        st.id = (uint32_t)(uintptr_t)f;
+        st.runUs = (uint32_t)f->runUs;
+        st.switches = f->switches;
+        // the stack only grows when a call would run out of it
+        st.stackBytes = f->stackSize * sizeof(TValue);
+        st.handler = f->currAction ? (uint32_t)((uint8_t *)f->currAction->func -
+                                                (uint8_t *)f->imgbase)
+                                   : 0;
     }
+    return n;
 }
 
 int allocateNotifyEvent() {
@@ -317,23 +586,84 @@ int allocateNotifyEvent() {
     return ++notifyId;
 }
 
+static void wakeDispatcher(EventQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    pthread_cond_broadcast(&q->newEvent);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static void queueEvent(EventQueue *q, int id, int event) {
+    if (!pushEvent(q, id, event)) {
+        // the main loop doesn't keep up; the event is lost
+        auto n = ++q->numDropped;
+        if ((n & (n - 1)) == 0)
+            DMESG("event queue full; %d events dropped", n);
+        return;
+    }
+    if (q->dispatcherWaiting.load())
+        wakeDispatcher(q);
+}
+
 void raiseEvent(int id, int event) {
-    auto e = mkEvent(id, event);
-    pthread_mutex_lock(&eventMutex);
-    if (eventTail == NULL) {
-        if (eventHead != NULL)
-            oops(51);
-        eventHead = eventTail = e;
-    } else {
-        eventTail->next = e;
-        eventTail = e;
+    queueEvent(events, id, event);
+}
+
+void raiseInstanceEvent(VMInstance *inst, int id, int event) {
+    queueEvent(&eventQueues[inst - vmInstances], id, event);
+}
+
+uint32_t instanceDroppedEvents(VMInstance *inst) {
+    return eventQueues[inst - vmInstances].numDropped.load();
+}
+
+PXT_TLS VMInstance *currInstance;
+// guards VMInstance::panicCode and exitCode
+static pthread_mutex_t instanceMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void bindVMInstance(VMInstance *inst) {
+    currInstance = inst;
+    panicCode = 0;
+    events = &eventQueues[inst - vmInstances];
+    pthread_mutex_lock(&instanceMutex);
+    inst->panicCode = &panicCode;
+    inst->exitCode = 0;
+    pthread_mutex_unlock(&instanceMutex);
+}
+
+void unbindVMInstance() {
+    auto inst = currInstance;
+    if (!inst)
+        return;
+    pthread_mutex_lock(&instanceMutex);
+    if (inst->panicCode == &panicCode) {
+        inst->exitCode = panicCode;
+        inst->panicCode = NULL;
     }
-    pthread_cond_broadcast(&newEventBroadcast);
-    pthread_mutex_unlock(&eventMutex);
+    pthread_mutex_unlock(&instanceMutex);
+    currInstance = NULL;
+}
+
+void stopVMInstance(VMInstance *inst) {
+    pthread_mutex_lock(&instanceMutex);
+    if (inst->panicCode && !*inst->panicCode)
+        *inst->panicCode = -1;
+    pthread_mutex_unlock(&instanceMutex);
+    wakeDispatcher(&eventQueues[inst - vmInstances]);
+}
+
+int vmInstancePanicCode(VMInstance *inst) {
+    pthread_mutex_lock(&instanceMutex);
+    int r = inst->panicCode ? *inst->panicCode : inst->exitCode;
+    pthread_mutex_unlock(&instanceMutex);
+    return r;
+}
+
+DLLEXPORT int pxt_dropped_events() {
+    return instanceDroppedEvents(&vmInstances[0]);
 }
 
 DLLEXPORT void pxt_raise_event(int id, int event) {
-    raiseEvent(id, event);
+    raiseInstanceEvent(&vmInstances[0], id, event);
 }
 
 void registerWithDal(int id, int event, Action a, int flags) {
@@ -379,8 +709,12 @@ void initRuntime() {
 uint8_t *gcBase;
 #endif
 
+// blocks come from one address range shared by all VM instances
+static pthread_mutex_t gcBlockMutex = PTHREAD_MUTEX_INITIALIZER;
+
 void *gcAllocBlock(size_t sz) {
     static uint8_t *currPtr = (uint8_t *)GC_BASE;
+    pthread_mutex_lock(&gcBlockMutex);
     sz = (sz + GC_PAGE_SIZE - 1) & ~(GC_PAGE_SIZE - 1);
 #ifdef __MINGW32__
     void *r = VirtualAlloc(currPtr, sz, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
@@ -405,6 +739,7 @@ void *gcAllocBlock(size_t sz) {
 #endif
 
     currPtr = (uint8_t *)r + sz;
+    pthread_mutex_unlock(&gcBlockMutex);
     if (isReadOnly((TValue)r)) {
         DMESG("mmap returned read-only address: %p", r);
         target_panic(PANIC_INTERNAL_ERROR);
@@ -415,10 +750,11 @@ void *gcAllocBlock(size_t sz) {
 void gcProcessStacks(int flags) {
     int cnt = 0;
     for (auto f = allFibers; f; f = f->next) {
-        auto end = f->stackBase + VM_STACK_SIZE - 1;
+        auto end = f->stackBase + f->stackSize - 1;
         auto ptr = f->sp;
         gcProcess((TValue)f->currAction);
         gcProcess((TValue)f->r0);
+        gcProcess((TValue)f->convertedStrings);
         if (flags & 2)
             DMESG("RS%d:%p/%d", cnt++, ptr, end - ptr);
         // VLOG("mark: %p - %p", ptr, end);
@@ -460,6 +796,9 @@ void systemReset() {
     coreReset(); // clears handler bindings
 
     currentFiber = NULL;
+    runHead = runTail = NULL;
+    numSleepers = 0;
+    memset(waiters, 0, sizeof(waiters));
     while (allFibers) {
         disposeFiber(allFibers);
     }
@@ -470,6 +809,7 @@ void systemReset() {
     // mark all GC memory as free
     gcReset();
 
+    unbindVMInstance();
     pthread_exit(NULL);
 }
 
@@ -1,4 +1,5 @@
 #include "pxt.h"
+#include "logqueue.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -25,110 +26,49 @@ void target_startup() {}
 static FILE *dmesgFile;
 #endif
 
-#define LOG_QUEUE_SIZE (128 * 1024)
-class LogQueue {
-    void writeCore(const char *buf, int len);
-
-  public:
-    int ptr;
-    char buffer[LOG_QUEUE_SIZE];
-    int rdPtr;
-    int numWrap;
-    LogQueue();
-    int write(const char *buf, int len);
-    int read(char *buf, int len);
-};
-
-LogQueue::LogQueue() {
-    ptr = 0;
-    rdPtr = 0;
-    numWrap = 0;
-    memset(buffer, 0, sizeof(buffer));
-}
-
-void LogQueue::writeCore(const char *buf, int len) {
-    memcpy(buffer + ptr, buf, len);
-    // did we pass it?
-    if (ptr < rdPtr && rdPtr <= ptr + len)
-        rdPtr = -1;
-    ptr += len;
-}
-
-int LogQueue::read(char *buf, int len) {
-    if (rdPtr < 0) {
-        if (numWrap == 0) {
-            rdPtr = 0;
-        } else {
-            rdPtr = ptr + 1;
-        }
-    }
-
-    if (rdPtr <= ptr) {
-        int av = ptr - rdPtr;
-        if (len > av)
-            len = av;
-        memcpy(buf, buffer + rdPtr, len);
-        rdPtr += len;
-    } else {
-        int latter = sizeof(buffer) - rdPtr;
-
-        if (latter >= len) {
-            memcpy(buf, buffer + rdPtr, len);
-            rdPtr += len;
-        } else {
-            memcpy(buf, buffer + rdPtr, latter);
-            buf += latter;
-            int len2 = len - latter;
-            if (len2 > ptr)
-                len2 = ptr;
-            memcpy(buf, buffer, len2);
-            rdPtr = len2;
-            len = latter + len2;
-        }
-    }
-
-    if (rdPtr >= (int)sizeof(buffer))
-        rdPtr = 0;
-
-    return len;
-}
-
-int LogQueue::write(const char *buf, int len) {
-    if (len > (int)sizeof(buffer) / 2)
-        return -1;
-
-    int left = sizeof(buffer) - ptr;
-
-    if (left < len + 1) {
-        writeCore(buf, left);
-        buf += left;
-        len -= left;
-        ptr = 0;
-        numWrap++;
-        if (rdPtr == 0)
-            rdPtr = -1;
-    }
-
-    writeCore(buf, len);
-    buffer[ptr] = 0;
-
-    return 0;
-}
-
 void dumpDmesg() {
     // not enabled
 }
 } // namespace pxt
 
 LogQueue codalLogStore;
+LogQueue serialLogStore;
+
+static LogQueue *getLogQueue(int logtype) {
+    if (logtype == 0)
+        return &codalLogStore;
+    if (logtype == 2)
+        return &serialLogStore;
+    return NULL;
+}
 
+// logtype 0 is DMESG, 1 the binary trace and 2 the serial output
 DLLEXPORT int pxt_get_logs(int logtype, char *dst, int maxSize) {
-    if (logtype != 0)
+#ifdef PXT_TRACE
+    // TraceRecords, for scripts/trace2json.js
+    if (logtype == 1)
+        return pxt::traceRead((uint8_t *)dst, maxSize);
+#endif
+    auto q = getLogQueue(logtype);
+    if (!q)
         return 0;
-    target_disable_irq();
-    int r = codalLogStore.read(dst, maxSize);
-    target_enable_irq();
-    return r;
+    return q->read(dst, maxSize);
+}
+
+// Like pxt_get_logs(), but reads from *pos (start with 0) and moves it past what was read; if it
+// moves by more than was returned, the bytes in between were lost. Any number of readers can
+// keep their own position.
+DLLEXPORT int pxt_get_logs_from(int logtype, uint32_t *pos, char *dst, int maxSize) {
+    auto q = getLogQueue(logtype);
+    if (!q)
+        return 0;
+    return q->readFrom(*pos, dst, maxSize);
+}
+
+// the position the next byte written will have
+DLLEXPORT uint32_t pxt_get_logs_position(int logtype) {
+    auto q = getLogQueue(logtype);
+    return q ? q->position() : 0;
 }
 
 namespace pxt {
@@ -141,8 +81,7 @@ static void dmesgRaw(const char *buf, uint32_t len) {
     }
 #endif
 
-    if (codalLogStore.write(buf, len) != 0)
-        return; // if message too long, skip
+    codalLogStore.write(buf, len);
 
 #ifdef LOG_TO_FILE
     fwrite(buf, 1, len, dmesgFile);
@@ -152,6 +91,12 @@ static void dmesgRaw(const char *buf, uint32_t len) {
 #endif
 }
 
+void sendSerial(const char *data, int len) {
+    target_disable_irq();
+    serialLogStore.write(data, len);
+    target_enable_irq();
+}
+
 void deepSleep() {
     // nothing to do
 }
@@ -1,5 +1,10 @@
 #include "pxt.h"
 
+#ifndef __MINGW32__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 namespace pxt {
 
 VMImage *setVMImgError(VMImage *img, int code, void *pos) {
@@ -208,10 +213,117 @@ static VMImage *loadIfaceNames(VMImage *img) {
 }
 
 void validateFunction(VMImage *img, VMImageSection *sect, int debug);
+void indexFunction(VMImage *img, VMImageSection *sect);
+#ifdef PXT_VM_THREADED
+void prepareFuse(VMImage *img);
+void fuseFunction(VMImage *img, VMImageSection *sect);
+#endif
+
+// with less code than this, functions are validated on the loading thread
+#define PARALLEL_VALIDATION_MIN_BYTES (64 * 1024)
+#define MAX_VALIDATION_THREADS 8
+
+struct ValidationJob {
+    VMImage *img;
+    VMImageSection **fns;
+    unsigned numFns;
+    unsigned next;
+};
+
+static void validateOne(VMImage *img, VMImageSection *sect, int debug) {
+    if (img->preverified)
+        indexFunction(img, sect);
+    else
+        validateFunction(img, sect, debug);
+#ifdef PXT_VM_THREADED
+    if (!img->errorCode)
+        fuseFunction(img, sect);
+#endif
+}
+
+static void *validationWorker(void *arg) {
+    auto job = (ValidationJob *)arg;
+    for (;;) {
+        auto i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->numFns || __atomic_load_n(&job->img->errorCode, __ATOMIC_RELAXED))
+            break;
+        validateOne(job->img, job->fns[i], 0);
+    }
+    return NULL;
+}
+
+static unsigned numValidationThreads(unsigned codeBytes) {
+    if (codeBytes < PARALLEL_VALIDATION_MIN_BYTES)
+        return 1;
+    int n = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+    n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n < 1)
+        n = 1;
+    if (n > MAX_VALIDATION_THREADS)
+        n = MAX_VALIDATION_THREADS;
+    return n;
+}
+
+// Functions are independent of each other, so big images are validated by several threads.
+// Errors are then reported by validating again in order, so it's always the first one.
+static VMImage *validateFunctionBodies(VMImage *img, VMImageSection **fns, unsigned numFns,
+                                       unsigned codeBytes) {
+    auto numThreads = numValidationThreads(codeBytes);
+    if (numThreads > 1 && numFns > 1) {
+        ValidationJob job = {img, fns, numFns, 0};
+        pthread_t threads[MAX_VALIDATION_THREADS];
+        for (unsigned i = 1; i < numThreads; ++i)
+            pthread_create(&threads[i], NULL, validationWorker, &job);
+        validationWorker(&job);
+        for (unsigned i = 1; i < numThreads; ++i)
+            pthread_join(threads[i], NULL);
+        if (!img->errorCode)
+            return NULL;
+        img->errorCode = 0;
+        img->errorOffset = 0;
+    }
+
+    for (unsigned i = 0; i < numFns; ++i) {
+        validateOne(img, fns[i], 0);
+        if (img->errorCode) {
+            // try again with debug
+            if (!img->preverified)
+                validateFunction(img, fns[i], 1);
+            return img;
+        }
+    }
+    return NULL;
+}
 
 static VMImage *validateFunctions(VMImage *img) {
+    auto numWords = (img->dataEnd - img->dataStart) * 4;
+    img->inlineCacheIndex = (uint16_t *)xmalloc(numWords * sizeof(uint16_t));
+    memset(img->inlineCacheIndex, 0, numWords * sizeof(uint16_t));
+#ifdef PXT_VM_THREADED
+    img->threadedCode = (VMThreadedOp *)xmalloc(numWords * sizeof(VMThreadedOp));
+    memset(img->threadedCode, 0, numWords * sizeof(VMThreadedOp));
+#endif
+
+    if (img->preverified)
+        img->maxStackDepth = img->infoHeader->verifiedMaxStackDepth;
+#ifdef PXT_VM_THREADED
+    prepareFuse(img);
+#endif
+
+    // vtables are checked here, functions are collected for validateFunctionBodies()
+    auto fns = ALLOC_ARRAY(VMImageSection *, img->numSections);
+    unsigned numFns = 0, codeBytes = 0;
+
     FOR_SECTIONS() {
-        if (sect->type == SectionType::VTable) {
+        if (sect->type == SectionType::Function) {
+            fns[numFns++] = sect;
+            codeBytes += sect->size;
+            continue;
+        }
+
+        if (sect->type == SectionType::VTable && !img->preverified) {
             uint8_t *endp = sect->data + sect->size - 8;
             auto vt = (VTable *)sect->data;
             auto multBase = (uint16_t *)&vt->methods[VM_NUM_CPP_METHODS];
@@ -267,16 +379,19 @@ static VMImage *validateFunctions(VMImage *img) {
             while (p < endp)
                 CHECK(*p++ == 0, 1040);
         }
-
-        if (sect->type == SectionType::Function) {
-            validateFunction(img, sect, 0);
-            if (img->errorCode) {
-                // try again with debug
-                validateFunction(img, sect, 1);
-                return img;
-            }
-        }
     }
+
+    if (validateFunctionBodies(img, fns, numFns, codeBytes))
+        return img;
+
+    // see indexOp()
+    if (img->numInlineCaches > 0xffff)
+        img->numInlineCaches = 0xffff;
+    // slot 0 is never used
+    auto icSize = (img->numInlineCaches + 1) * sizeof(VMInlineCache);
+    img->inlineCaches = (VMInlineCache *)xmalloc(icSize);
+    memset(img->inlineCaches, 0, icSize);
+
     return NULL;
 }
 
@@ -308,9 +423,10 @@ static VMImage *injectVTables(VMImage *img) {
     return NULL;
 }
 
-VMImage *loadVMImage(void *data, unsigned length) {
+VMImage *loadVMImage(void *data, unsigned length, bool preverified) {
     auto img = new VMImage();
     memset(img, 0, sizeof(*img));
+    img->preverified = preverified;
 
     DMESG("loading image at %p (%d bytes)", data, length);
 
@@ -320,12 +436,24 @@ VMImage *loadVMImage(void *data, unsigned length) {
     img->dataStart = (uint64_t *)data;
     img->dataEnd = (uint64_t *)((uint8_t *)data + length);
 
-    if (countSections(img) || loadSections(img) || loadIfaceNames(img) || validateFunctions(img) ||
-        injectVTables(img)) {
+    if (countSections(img) || loadSections(img) || loadIfaceNames(img) || validateFunctions(img)) {
         // error!
         return img;
     }
 
+    // while the sections of functions still have their headers
+    loadNativeCode(img);
+
+    if (injectVTables(img))
+        return img;
+
+#ifdef PXT_VM_PROFILE
+    img->opcodeCounts = (uint64_t *)xmalloc(img->numOpcodes * sizeof(uint64_t));
+    memset(img->opcodeCounts, 0, img->numOpcodes * sizeof(uint64_t));
+    img->functionSamples = (uint32_t *)xmalloc(img->numSections * sizeof(uint32_t));
+    memset(img->functionSamples, 0, img->numSections * sizeof(uint32_t));
+#endif
+
     DMESG("image loaded");
 
     return img;
@@ -334,7 +462,24 @@ VMImage *loadVMImage(void *data, unsigned length) {
 void unloadVMImage(VMImage *img) {
     if (!img)
         return;
-    free(img->dataStart);
+#ifndef __MINGW32__
+    if (img->mappedSize)
+        munmap(img->dataStart, img->mappedSize);
+    else
+#endif
+        free(img->dataStart);
+#ifdef PXT_VM_PROFILE
+    unprofileImage(img);
+    xfree(img->opcodeCounts);
+    xfree(img->functionSamples);
+#endif
+    xfree(img->preallocBlock);
+    xfree(img->inlineCacheIndex);
+    xfree(img->inlineCaches);
+    unloadNativeCode(img);
+#ifdef PXT_VM_THREADED
+    xfree(img->threadedCode);
+#endif
     memset(img, 0, sizeof(*img));
     delete img;
 }
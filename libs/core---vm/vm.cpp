@@ -16,6 +16,10 @@
 //#define TRACE DMESG
 #define TRACE NOLOG
 
+namespace numops {
+TNumber adds(TNumber a, TNumber b);
+}
+
 namespace pxt {
 
 //%
@@ -113,6 +117,7 @@ void op_stfld(FiberContext *ctx, unsigned arg) {
     SPLIT_ARG2(fldId, classId);
     auto obj = POPVAL();
     checkClass(ctx, obj, classId, fldId);
+    gcWriteBarrier((RefObject *)obj, ctx->r0);
     ((RefRecord *)obj)->fields[fldId] = ctx->r0;
 }
 
@@ -125,9 +130,35 @@ static RefAction *bindAction(FiberContext *ctx, RefAction *ra, TValue obj) {
     return act;
 }
 
+// moves the stack to one twice as big, up to VM_STACK_SIZE
+void growStack(FiberContext *ctx) {
+    auto newSize = ctx->stackSize * 2;
+    if (newSize > VM_STACK_SIZE)
+        newSize = VM_STACK_SIZE;
+    if (newSize <= ctx->stackSize)
+        error(PANIC_STACK_OVERFLOW);
+
+    auto oldTop = ctx->stackBase + ctx->stackSize;
+    auto used = oldTop - ctx->sp;
+    auto newBase = (TValue *)xmalloc(newSize * sizeof(TValue));
+    auto newTop = newBase + newSize;
+    memcpy(newTop - used, ctx->sp, used * sizeof(TValue));
+
+    // try frames keep pointers into the stack
+    auto delta = (uintptr_t)newTop - (uintptr_t)oldTop;
+    for (auto tf = ctx->tryFrame; tf; tf = tf->parent)
+        tf->registers[2] += delta;
+
+    xfree(ctx->stackBase);
+    ctx->stackBase = newBase;
+    ctx->stackSize = newSize;
+    ctx->sp = newTop - used;
+    ctx->stackLimit = newBase + ctx->img->maxStackDepth + 5;
+}
+
 static inline void runAction(FiberContext *ctx, RefAction *ra) {
     if (ctx->sp < ctx->stackLimit)
-        error(PANIC_STACK_OVERFLOW);
+        growStack(ctx);
 
     PUSH((TValue)ctx->currAction);
     PUSH(VM_ENCODE_PC(ctx->pc - ctx->imgbase));
@@ -182,6 +213,8 @@ void op_callind(FiberContext *ctx, unsigned arg) {
     callind(ctx, (RefAction *)fn, arg);
 }
 
+static void toStringReturned(FiberContext *ctx);
+
 //%
 void op_ret(FiberContext *ctx, unsigned arg) {
     SPLIT_ARG(retNumArgs, numTmps);
@@ -200,6 +233,8 @@ void op_ret(FiberContext *ctx, unsigned arg) {
 
     if (retaddr == (intptr_t)TAG_STACK_BOTTOM) {
         ctx->pc = NULL;
+    } else if (retaddr == (intptr_t)TAG_TO_STRING_RETURN) {
+        toStringReturned(ctx);
     } else {
         ctx->pc = ctx->imgbase + VM_DECODE_PC(retaddr);
     }
@@ -252,15 +287,18 @@ void op_try(FiberContext *ctx, unsigned arg) {
     f->registers[2] = (uintptr_t)ctx->sp;
 }
 
+// Exceptions are only ever thrown by the throwValue() and endFinally() calls of the program,
+// which exec_loop() makes directly, so once the handler's state is in place those just return,
+// and the loop goes on from the handler; there is nothing to unwind on the native stack.
 void restoreVMExceptionState(TryFrame *tf, FiberContext *ctx) {
     // TODO verification
+    auto sp = (TValue *)tf->registers[2];
     ctx->currAction = (RefAction *)tf->registers[0];
     ctx->pc = (uint16_t *)tf->registers[1];
-    ctx->sp = (TValue *)tf->registers[2];
-    longjmp(ctx->loopjmp, 1);
+    ctx->sp = sp;
 }
 
-static TValue lookupIfaceMember(TValue obj, VTable *vt, unsigned ifaceIdx) {
+static inline IfaceEntry *findIfaceEntry(VTable *vt, unsigned ifaceIdx) {
     uint32_t mult = vt->ifaceHashMult;
     uint32_t off = (ifaceIdx * mult) >> (mult & 0xff);
 
@@ -269,24 +307,54 @@ static TValue lookupIfaceMember(TValue obj, VTable *vt, unsigned ifaceIdx) {
     while (n--) {
         uint32_t off2 = multBase[off];
         auto ent = (struct IfaceEntry *)multBase + off2;
-
-        if (ent->memberId == ifaceIdx) {
-            if (ent->aux != 0) {
-                return vmImg->pointerLiterals[ent->method];
-            } else {
-                return ((RefRecord *)obj)->fields[ent->method - 1];
-            }
-        }
+        if (ent->memberId == ifaceIdx)
+            return ent;
         off++;
     }
 
     return NULL;
 }
 
+// the cache is keyed only by vtable, as the member index is fixed for a given call site
+static inline IfaceEntry *cachedIfaceEntry(VMInlineCache *ic, VTable *vt, unsigned ifaceIdx) {
+    if (ic) {
+        for (unsigned i = 0; i < VM_IC_WAYS; ++i)
+            if (ic->vtables[i] == vt)
+                return ic->entries[i];
+    }
+
+    auto ent = findIfaceEntry(vt, ifaceIdx);
+
+    if (ic && ent) {
+        auto i = ic->next++ % VM_IC_WAYS;
+        ic->vtables[i] = vt;
+        ic->entries[i] = ent;
+    }
+
+    return ent;
+}
+
+static inline VMInlineCache *siteInlineCache(FiberContext *ctx) {
+    // pc points just past the instruction, so we use the offset of its last word
+    auto idx = ctx->img->inlineCacheIndex[ctx->pc - 1 - ctx->imgbase];
+    return idx ? &ctx->img->inlineCaches[idx] : NULL;
+}
+
+static TValue lookupIfaceMember(TValue obj, VTable *vt, unsigned ifaceIdx) {
+    auto ent = findIfaceEntry(vt, ifaceIdx);
+    if (!ent)
+        return NULL;
+    if (ent->aux != 0) {
+        return vmImg->pointerLiterals[ent->method];
+    } else {
+        return ((RefRecord *)obj)->fields[ent->method - 1];
+    }
+}
+
 /* skip .d.ts */ enum class CallType { Call = 0, Get = 1, Set = 2 };
 
 static inline void callifaceCore(FiberContext *ctx, unsigned numArgs, unsigned ifaceIdx,
-                                 CallType getset) {
+                                 CallType getset, VMInlineCache *ic) {
     auto obj = ctx->sp[numArgs - 1];
     if (!isPointer(obj))
         failedCast(obj);
@@ -295,11 +363,27 @@ static inline void callifaceCore(FiberContext *ctx, unsigned numArgs, unsigned i
 
     if (!mult) {
         if (vt->classNo == BuiltInType::RefMap) {
+            auto map = (RefMap *)obj;
+            int idx = -1;
+            if (ic && map->shape) {
+                if (ic->mapShape == map->shape) {
+                    idx = ic->mapSlot;
+                } else {
+                    idx = map->findIdx((String)ctx->img->ifaceMemberNames[ifaceIdx + 1]);
+                    if (idx >= 0) {
+                        ic->mapShape = map->shape;
+                        ic->mapSlot = idx;
+                    }
+                }
+            }
             if (getset == CallType::Set) {
-                pxtrt::mapSet((RefMap *)obj, ifaceIdx, ctx->sp[0]);
+                if (idx >= 0)
+                    map->values.set(idx, ctx->sp[0]);
+                else
+                    pxtrt::mapSet(map, ifaceIdx, ctx->sp[0]);
                 POP(2); // and pop arguments
             } else {
-                ctx->r0 = pxtrt::mapGet((RefMap *)obj, ifaceIdx);
+                ctx->r0 = idx >= 0 ? map->values.get(idx) : pxtrt::mapGet(map, ifaceIdx);
                 if (getset == CallType::Call) {
                     shiftArg(ctx, numArgs);
                     op_callind(ctx, numArgs - 1);
@@ -311,50 +395,44 @@ static inline void callifaceCore(FiberContext *ctx, unsigned numArgs, unsigned i
         }
         missingProperty(obj);
     }
-    uint32_t off = (ifaceIdx * mult) >> (mult & 0xff);
 
-    unsigned n = 3;
-    auto multBase = (uint16_t *)&vt->methods[VM_NUM_CPP_METHODS];
-    while (n--) {
-        uint32_t off2 = multBase[off];
-        auto ent = (struct IfaceEntry *)multBase + off2;
+    auto ent = cachedIfaceEntry(ic, vt, ifaceIdx);
 
-        if (ent->memberId == ifaceIdx) {
-            if (ent->aux != 0) {
-                if (getset == CallType::Set) {
-                    ent++;
-                    if (ent->memberId != ifaceIdx)
-                        missingProperty(obj);
-                }
-                auto fn = (RefAction *)ctx->img->pointerLiterals[ent->method];
-                if (getset == CallType::Get && ent->aux == 2) {
-                    ctx->r0 = (TValue)bindAction(ctx, fn, obj);
-                    POP(1);
-                    return;
-                }
-                callind(ctx, fn, numArgs);
+    if (ent) {
+        if (ent->aux != 0) {
+            if (getset == CallType::Set) {
+                ent++;
+                if (ent->memberId != ifaceIdx)
+                    missingProperty(obj);
+            }
+            auto fn = (RefAction *)ctx->img->pointerLiterals[ent->method];
+            if (getset == CallType::Get && ent->aux == 2) {
+                ctx->r0 = (TValue)bindAction(ctx, fn, obj);
+                POP(1);
+                return;
+            }
+            callind(ctx, fn, numArgs);
+        } else {
+            if (getset == CallType::Set) {
+                // store field
+                gcWriteBarrier((RefObject *)obj, ctx->sp[0]);
+                ((RefRecord *)obj)->fields[ent->method - 1] = ctx->sp[0];
+                POP(2); // and pop arguments
             } else {
-                if (getset == CallType::Set) {
-                    // store field
-                    ((RefRecord *)obj)->fields[ent->method - 1] = ctx->sp[0];
-                    POP(2); // and pop arguments
+                // load field
+                ctx->r0 = ((RefRecord *)obj)->fields[ent->method - 1];
+                if (getset == CallType::Call) {
+                    // and call
+                    shiftArg(ctx, numArgs);
+                    op_callind(ctx, numArgs - 1);
                 } else {
-                    // load field
-                    ctx->r0 = ((RefRecord *)obj)->fields[ent->method - 1];
-                    if (getset == CallType::Call) {
-                        // and call
-                        shiftArg(ctx, numArgs);
-                        op_callind(ctx, numArgs - 1);
-                    } else {
-                        // if just loading, pop the object arg
-                        POP(1);
-                    }
+                    // if just loading, pop the object arg
+                    POP(1);
                 }
             }
-
-            return;
         }
-        off++;
+
+        return;
     }
 
     if (getset == CallType::Get) {
@@ -368,17 +446,17 @@ static inline void callifaceCore(FiberContext *ctx, unsigned numArgs, unsigned i
 //%
 void op_calliface(FiberContext *ctx, unsigned arg) {
     SPLIT_ARG(numArgs, ifaceIdx);
-    callifaceCore(ctx, numArgs, ifaceIdx, CallType::Call);
+    callifaceCore(ctx, numArgs, ifaceIdx, CallType::Call, siteInlineCache(ctx));
 }
 
 //%
 void op_callget(FiberContext *ctx, unsigned arg) {
-    callifaceCore(ctx, 1, arg, CallType::Get);
+    callifaceCore(ctx, 1, arg, CallType::Get, siteInlineCache(ctx));
 }
 
 //%
 void op_callset(FiberContext *ctx, unsigned arg) {
-    callifaceCore(ctx, 2, arg, CallType::Set);
+    callifaceCore(ctx, 2, arg, CallType::Set, siteInlineCache(ctx));
 }
 
 //%
@@ -397,7 +475,7 @@ void op_mapget(FiberContext *ctx, unsigned arg) {
             POP(1);
             ctx->r0 = TAG_UNDEFINED;
         } else {
-            callifaceCore(ctx, 1, k, CallType::Get);
+            callifaceCore(ctx, 1, k, CallType::Get, NULL);
         }
     }
 }
@@ -419,7 +497,7 @@ void op_mapset(FiberContext *ctx, unsigned arg) {
             missingProperty(obj);
         } else {
             ctx->sp[0] = ctx->r0;
-            callifaceCore(ctx, 2, k, CallType::Set);
+            callifaceCore(ctx, 2, k, CallType::Set, NULL);
         }
     }
 }
@@ -439,24 +517,64 @@ void op_checkinst(FiberContext *ctx, unsigned arg) {
     }
 }
 
-static TValue inlineInvoke(FiberContext *ctx, RefAction *fn, int numArgs) {
-    auto prevPC = ctx->pc;
-    auto prevR0 = ctx->r0;
-    jmp_buf loopjmp;
-    memcpy(&loopjmp, &ctx->loopjmp, sizeof(loopjmp));
-    // make sure call will push TAG_STACK_BOTTOM
-    ctx->pc = (uint16_t *)ctx->imgbase + 1;
-    callind(ctx, fn, numArgs);
-    ctx->img->execLock ^= 1;
-    exec_loop(ctx);
-    if (ctx->resumePC)
-        target_panic(PANIC_BLOCKING_TO_STRING);
-    ctx->img->execLock ^= 1;
-    auto r = ctx->r0;
-    ctx->pc = prevPC;
-    ctx->r0 = prevR0;
-    memcpy(&ctx->loopjmp, &loopjmp, sizeof(loopjmp));
-    return r;
+// A user toString() doesn't run in a nested exec_loop(). convertToString() leaves the rtcall
+// with longjmp(), and exec_loop() calls toString() like any other function, with
+// TAG_TO_STRING_RETURN for the return address. Once it returns, the rtcall runs again from the
+// start, and this time convertToString() takes the string from convertedStrings. So toString()
+// can throw, block, or convert other objects itself, like the rest of the program.
+//
+// Under the frame of toString() there is [obj, convertedStrings, rtcall pc, r0], and under that
+// the arguments of the rtcall.
+static void callToString(FiberContext *ctx, TValue obj, RefAction *fn) {
+    auto done = ctx->convertedStrings;
+    ctx->convertedStrings = NULL;
+    // drop whatever the rtcall pushed so far
+    ctx->sp = ctx->rtcallSp;
+    if (ctx->sp - 6 < ctx->stackLimit)
+        growStack(ctx);
+    PUSH(ctx->r0);
+    PUSH(VM_ENCODE_PC(ctx->pc - 1 - ctx->imgbase));
+    PUSH(done ? (TValue)done : TAG_UNDEFINED);
+    PUSH(obj);
+    PUSH(obj);
+    ctx->pc = ctx->imgbase + 2;
+    callind(ctx, fn, 1);
+    longjmp(ctx->convertJmp, 1);
+}
+
+// runs the rtcall at ctx->pc, as exec_loop() does
+static void rerunRtCall(FiberContext *ctx) {
+    ctx->rtcallSp = ctx->sp;
+#ifdef PXT_VM_THREADED
+    auto op = &ctx->img->threadedCode[ctx->pc - ctx->imgbase];
+    ctx->pc += op->size;
+    ((ApiFun)op->fn)(ctx);
+    if (op->flags & VM_THREADED_PUSH)
+        PUSH(ctx->r0);
+#else
+    uint16_t opcode = *ctx->pc++;
+    ((ApiFun)ctx->img->opcodes[opcode & 0x1fff])(ctx);
+    if (opcode & VM_RTCALL_PUSH_MASK)
+        PUSH(ctx->r0);
+#endif
+}
+
+static void toStringReturned(FiberContext *ctx) {
+    auto sp = ctx->sp;
+    auto done = (RefCollection *)sp[1];
+    if (sp[1] == TAG_UNDEFINED) {
+        done = Array_::mk();
+        sp[1] = (TValue)done;
+    }
+    Array_::push(done, sp[0]);
+    Array_::push(done, ctx->r0);
+    ctx->pc = ctx->imgbase + VM_DECODE_PC(sp[2]);
+    ctx->r0 = sp[3];
+    ctx->sp = sp + 4;
+    ctx->convertedStrings = done;
+    ctx->convertedIdx = 0;
+    rerunRtCall(ctx);
+    ctx->convertedStrings = NULL;
 }
 
 String convertToString(FiberContext *ctx, TValue v) {
@@ -473,9 +591,15 @@ String convertToString(FiberContext *ctx, TValue v) {
                 auto fn = lookupIfaceMember(v, vt, img->toStringKey);
                 if (fn && isPointer(fn) &&
                     getVTable((RefObject *)fn)->objectType == ValType::Function) {
-                    PUSH(v);
-                    v = inlineInvoke(ctx, (RefAction *)fn, 1);
-                    PUSH(v); // make sure it doesn't get collected
+                    auto done = ctx->convertedStrings;
+                    if (!done || ctx->convertedIdx >= done->length())
+                        callToString(ctx, v, (RefAction *)fn);
+                    if (done->getAt(ctx->convertedIdx) != v) {
+                        DMESG("rtcall converted other arguments when run again");
+                        target_panic(PANIC_VM_ERROR);
+                    }
+                    v = done->getAt(ctx->convertedIdx + 1);
+                    ctx->convertedIdx += 2;
                 }
             }
         }
@@ -488,36 +612,247 @@ String convertToString(FiberContext *ctx, TValue v) {
     return rr;
 }
 
+#ifdef PXT_VM_THREADED
+// Superinstructions - these are never emitted by the compiler, only by fuseFunction() below.
+// The arguments of both instructions are packed into a single word.
+
+static void op_ldloc_ldfld(FiberContext *ctx, unsigned arg) {
+    ctx->r0 = ctx->sp[arg & 0xff];
+    op_ldfld(ctx, arg >> 8);
+}
+
+static void op_ldloc_jmpz(FiberContext *ctx, unsigned arg) {
+    ctx->r0 = ctx->sp[arg & 0xff];
+    if (!toBoolQuick(ctx->r0))
+        ctx->pc += (int)arg >> 8;
+}
+
+static void op_push_ldlit(FiberContext *ctx, unsigned arg) {
+    PUSH(ctx->r0);
+    ctx->r0 = ctx->img->pointerLiterals[arg];
+}
+
+static void op_ldint_adds(FiberContext *ctx, unsigned arg) {
+    ctx->r0 = numops::adds(ctx->sp[0], TAG_NUMBER(arg));
+    POP(1);
+}
+#endif
+
+#ifdef PXT_VM_PROFILE
+// bumped by the profiler thread every VM_PROFILE_INTERVAL_US; exec_loop() samples the
+// running function whenever it sees a new value
+static volatile uint32_t profileTicks;
+static pthread_once_t profileOnce = PTHREAD_ONCE_INIT;
+
+// the image pxt_get_profile() reports on, that is the one started last
+static VMImage *profiledImage;
+static pthread_mutex_t profileMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *profileTimer(void *) {
+    for (;;) {
+        sleep_core_us(VM_PROFILE_INTERVAL_US);
+        profileTicks++;
+    }
+    return NULL;
+}
+
+static void startProfileTimer() {
+    pthread_t pt;
+    pthread_create(&pt, NULL, profileTimer, NULL);
+    pthread_detach(pt);
+}
+
+void profileImage(VMImage *img) {
+    pthread_once(&profileOnce, startProfileTimer);
+    pthread_mutex_lock(&profileMutex);
+    profiledImage = img;
+    pthread_mutex_unlock(&profileMutex);
+}
+
+void unprofileImage(VMImage *img) {
+    pthread_mutex_lock(&profileMutex);
+    if (profiledImage == img)
+        profiledImage = NULL;
+    pthread_mutex_unlock(&profileMutex);
+}
+
+static void profileSample(FiberContext *ctx) {
+    auto img = ctx->img;
+    img->lastProfileTick = profileTicks;
+    // the last section starting before pc
+    auto pc = (uintptr_t)ctx->pc;
+    unsigned lo = 0, hi = img->numSections;
+    while (hi - lo > 1) {
+        auto mid = (lo + hi) >> 1;
+        if ((uintptr_t)img->sections[mid] <= pc)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    img->functionSamples[lo]++;
+    img->numProfileSamples++;
+}
+
+#define PROFILE_OP(ctx, opIdx)                                                                     \
+    do {                                                                                           \
+        ctx->img->opcodeCounts[opIdx]++;                                                           \
+        if (ctx->img->lastProfileTick != profileTicks)                                             \
+            profileSample(ctx);                                                                    \
+    } while (0)
+
+#ifdef PXT_VM_THREADED
+// superinstructions are counted as their first instruction
+static inline unsigned opcodeIndex(const uint16_t *pc) {
+    uint16_t opcode = pc[0];
+    if (opcode >> 15 == 0)
+        return opcode & VM_OPCODE_BASE_MASK;
+    if (opcode >> 14 == 0b10)
+        return opcode & 0x1fff;
+    return pc[1] & VM_OPCODE_BASE_MASK;
+}
+#endif
+
+#define PROFILE_MAGIC 0x46505850 // PXPF
+#define PROFILE_VERSION 1
+
+/*
+Writes the profile of the last started image to [dst] and returns its size; nothing is
+written if that's more than [maxSize], or if there is no image (then 0 is returned).
+The format is little endian:
+    u32 magic, u32 version, u32 intervalUs, u32 numSamples, u32 numOpcodes, u32 numFunctions
+    numOpcodes times: u64 count, u16 opcode index, u8 nameLength, name
+    numFunctions times: u32 offset of the function section in the image, u32 samples
+Only opcodes and functions with non-zero counts are listed.
+*/
+DLLEXPORT int pxt_get_profile(uint8_t *dst, int maxSize) {
+    pthread_mutex_lock(&profileMutex);
+    auto img = profiledImage;
+    if (!img) {
+        pthread_mutex_unlock(&profileMutex);
+        return 0;
+    }
+
+    uint32_t numOps = 0, numFns = 0;
+    int size = 6 * 4;
+    for (unsigned i = 0; i < img->numOpcodes; ++i)
+        if (img->opcodeCounts[i]) {
+            numOps++;
+            size += 8 + 2 + 1 + (int)strlen(img->opcodeDescs[i]->name);
+        }
+    for (unsigned i = 0; i < img->numSections; ++i)
+        if (img->functionSamples[i]) {
+            numFns++;
+            size += 8;
+        }
+
+    if (dst && size <= maxSize) {
+        auto p = dst;
+        auto put = [&p](const void *src, int len) {
+            memcpy(p, src, len);
+            p += len;
+        };
+        uint32_t hd[] = {PROFILE_MAGIC,           PROFILE_VERSION, VM_PROFILE_INTERVAL_US,
+                         img->numProfileSamples, numOps,          numFns};
+        put(hd, sizeof(hd));
+        for (unsigned i = 0; i < img->numOpcodes; ++i) {
+            if (!img->opcodeCounts[i])
+                continue;
+            auto name = img->opcodeDescs[i]->name;
+            uint16_t idx = i;
+            uint8_t len = strlen(name);
+            put(&img->opcodeCounts[i], 8);
+            put(&idx, 2);
+            put(&len, 1);
+            put(name, len);
+        }
+        for (unsigned i = 0; i < img->numSections; ++i) {
+            if (!img->functionSamples[i])
+                continue;
+            uint32_t rec[] = {
+                (uint32_t)((uint8_t *)img->sections[i] - (uint8_t *)img->dataStart),
+                img->functionSamples[i]};
+            put(rec, sizeof(rec));
+        }
+    }
+
+    pthread_mutex_unlock(&profileMutex);
+    return size;
+}
+
+DLLEXPORT void pxt_reset_profile() {
+    pthread_mutex_lock(&profileMutex);
+    auto img = profiledImage;
+    if (img) {
+        memset(img->opcodeCounts, 0, img->numOpcodes * sizeof(uint64_t));
+        memset(img->functionSamples, 0, img->numSections * sizeof(uint32_t));
+        img->numProfileSamples = 0;
+    }
+    pthread_mutex_unlock(&profileMutex);
+}
+#else
+#define PROFILE_OP(ctx, opIdx) ((void)0)
+#endif
+
 void exec_loop(FiberContext *ctx) {
     if (ctx->img->execLock) {
         DMESG("image locked!");
         target_panic(PANIC_VM_ERROR);
     }
     ctx->img->execLock = 1;
+    // callToString() comes back here
+    setjmp(ctx->convertJmp);
+    if (ctx->img->nativeCode) {
+        runNative(ctx);
+        ctx->img->execLock = 0;
+        return;
+    }
+#ifdef PXT_VM_THREADED
+    auto threadedCode = ctx->img->threadedCode;
+    while (ctx->pc) {
+        if (panicCode)
+            break;
+        auto op = &threadedCode[ctx->pc - ctx->imgbase];
+        TRACE("0x%x: %p %d", (uint8_t *)ctx->pc - (uint8_t *)ctx->img->dataStart, op->fn,
+              (int)(ctx->stackBase + ctx->stackSize - ctx->sp));
+        PROFILE_OP(ctx, opcodeIndex(ctx->pc));
+        ctx->pc += op->size;
+        if (op->flags & VM_THREADED_RTCALL) {
+            ctx->rtcallSp = ctx->sp;
+            ((ApiFun)op->fn)(ctx);
+        } else
+            op->fn(ctx, op->arg);
+        if (op->flags & VM_THREADED_PUSH)
+            PUSH(ctx->r0);
+    }
+#else
     auto opcodes = ctx->img->opcodes;
-    setjmp(ctx->loopjmp);
     while (ctx->pc) {
         if (panicCode)
             break;
         uint16_t opcode = *ctx->pc++;
         TRACE("0x%x: %04x %d", (uint8_t *)ctx->pc - 2 - (uint8_t *)ctx->img->dataStart, opcode,
-              (int)(ctx->stackBase + VM_STACK_SIZE - ctx->sp));
+              (int)(ctx->stackBase + ctx->stackSize - ctx->sp));
         if (opcode >> 15 == 0) {
+            PROFILE_OP(ctx, opcode & VM_OPCODE_BASE_MASK);
             opcodes[opcode & VM_OPCODE_BASE_MASK](ctx, opcode >> VM_OPCODE_ARG_POS);
             if (opcode & VM_OPCODE_PUSH_MASK)
                 PUSH(ctx->r0);
         } else if (opcode >> 14 == 0b10) {
+            PROFILE_OP(ctx, opcode & 0x1fff);
+            ctx->rtcallSp = ctx->sp;
             ((ApiFun)opcodes[opcode & 0x1fff])(ctx);
             if (opcode & VM_RTCALL_PUSH_MASK)
                 PUSH(ctx->r0);
         } else {
             unsigned tmp = ((int32_t)opcode << (16 + 2)) >> (2 + VM_OPCODE_ARG_POS);
             opcode = *ctx->pc++;
+            PROFILE_OP(ctx, opcode & VM_OPCODE_BASE_MASK);
             opcodes[opcode & VM_OPCODE_BASE_MASK](ctx, (opcode >> VM_OPCODE_ARG_POS) + tmp);
             if (opcode & VM_OPCODE_PUSH_MASK)
                 PUSH(ctx->r0);
         }
     }
+#endif
     ctx->img->execLock = 0;
 }
 
@@ -542,6 +877,56 @@ namespace pxt {
         stackDepth[pc] = v;                                                                        \
     } while (0)
 
+// set up the threaded code and inline cache slot of the instruction at code[startPC..pc)
+static inline void indexOp(VMImage *img, uint16_t *code, unsigned startPC, unsigned pc, OpFun fn,
+                           const DecodedOp &op) {
+#ifdef PXT_VM_THREADED
+    if (img->threadedCode) {
+        auto top = &img->threadedCode[&code[startPC] - (uint16_t *)img->dataStart];
+        top->fn = fn;
+        top->arg = op.arg;
+        top->size = pc - startPC;
+        top->flags =
+            (op.hasPush ? VM_THREADED_PUSH : 0) | (op.isRtCall ? VM_THREADED_RTCALL : 0);
+    }
+#endif
+
+    if (!op.isRtCall && (fn == op_calliface || fn == op_callget || fn == op_callset) &&
+        img->inlineCacheIndex) {
+        // functions may be validated in parallel, see validateFunctionBodies()
+        auto idx = __atomic_add_fetch(&img->numInlineCaches, 1, __ATOMIC_RELAXED);
+        // index by the last word of the instruction, see siteInlineCache()
+        if (idx <= 0xffff)
+            img->inlineCacheIndex[&code[pc - 1] - (uint16_t *)img->dataStart] = idx;
+    }
+}
+
+// The part of validateFunction() that sets up runtime data, for images that passed
+// verification before (see vmcache::isVerified()); only the opcodes are still checked.
+void indexFunction(VMImage *img, VMImageSection *sect) {
+    unsigned pc = 0;
+    auto code = (uint16_t *)((uint8_t *)sect + VM_FUNCTION_CODE_OFFSET);
+    auto lastPC = (sect->size - VM_FUNCTION_CODE_OFFSET) >> 1;
+    auto atEnd = false;
+
+    while (pc < lastPC) {
+        unsigned startPC = pc;
+        if (code[pc] == 0 && atEnd) {
+            pc++;
+            continue;
+        }
+        DecodedOp op;
+        pc = decodeOp(code, pc, op);
+        if (op.opIdx >= img->numOpcodes)
+            FNERR(1227);
+        auto fn = img->opcodes[op.opIdx];
+        if (!fn)
+            FNERR(1228);
+        indexOp(img, code, startPC, pc, fn, op);
+        atEnd = fn == op_ret || fn == op_jmp;
+    }
+}
+
 void validateFunction(VMImage *img, VMImageSection *sect, int debug) {
     uint16_t stackDepth[sect->size / 2];
     memset(stackDepth, 0, sizeof(stackDepth));
@@ -551,6 +936,7 @@ void validateFunction(VMImage *img, VMImageSection *sect, int debug) {
     auto code = (uint16_t *)((uint8_t *)sect + VM_FUNCTION_CODE_OFFSET);
     auto lastPC = (sect->size - VM_FUNCTION_CODE_OFFSET) >> 1;
     auto atEnd = false;
+    unsigned maxDepth = 0;
 
     RefAction *ra = (RefAction *)sect;
 
@@ -563,37 +949,29 @@ void validateFunction(VMImage *img, VMImageSection *sect, int debug) {
     while (pc < lastPC) {
         if (currStack > VM_MAX_FUNCTION_STACK)
             FNERR(1204);
+        if ((unsigned)currStack > maxDepth)
+            maxDepth = currStack;
 
         FORCE_STACK(currStack, 1201, pc);
 
-        uint16_t opcode = code[pc++];
-        if (opcode == 0 && atEnd)
+        unsigned startPC = pc;
+        if (code[pc] == 0 && atEnd) {
+            pc++;
             continue; // allow padding at the end
+        }
 
         atEnd = false;
-        OpFun fn;
-        unsigned arg;
-        unsigned opIdx;
-        bool isRtCall = false;
-        bool hasPush = false;
+        DecodedOp op;
+        pc = decodeOp(code, pc, op);
+        if (op.isLong)
+            FORCE_STACK(0xffff, 1200, startPC + 1); // cannot jump here!
 
-        if (opcode >> 15 == 0) {
-            opIdx = opcode & VM_OPCODE_BASE_MASK;
-            arg = opcode >> VM_OPCODE_ARG_POS;
-            hasPush = !!(opcode & VM_OPCODE_PUSH_MASK);
-        } else if (opcode >> 14 == 0b10) {
-            opIdx = opcode & 0x1fff;
-            arg = 0;
-            isRtCall = true;
-            hasPush = !!(opcode & VM_RTCALL_PUSH_MASK);
-        } else {
-            unsigned tmp = ((int32_t)opcode << (16 + 2)) >> (2 + VM_OPCODE_ARG_POS);
-            FORCE_STACK(0xffff, 1200, pc); // cannot jump here!
-            opcode = code[pc++];
-            opIdx = opcode & VM_OPCODE_BASE_MASK;
-            arg = (opcode >> VM_OPCODE_ARG_POS) + tmp;
-            hasPush = !!(opcode & VM_OPCODE_PUSH_MASK);
-        }
+        OpFun fn;
+        unsigned arg = op.arg;
+        unsigned opIdx = op.opIdx;
+        bool isRtCall = op.isRtCall;
+        bool hasPush = op.hasPush;
+        uint16_t opcode = code[pc - 1];
 
         if (opIdx >= img->numOpcodes)
             FNERR(1227);
@@ -607,6 +985,7 @@ void validateFunction(VMImage *img, VMImageSection *sect, int debug) {
             FNERR(1228);
 
         fn = img->opcodes[opIdx];
+        indexOp(img, code, startPC, pc, fn, op);
 
         if (isRtCall) {
             if (opd->numArgs > 1) {
@@ -769,6 +1148,84 @@ void validateFunction(VMImage *img, VMImageSection *sect, int debug) {
         pc--;
         FNERR(1210);
     }
+
+    auto prevMax = __atomic_load_n(&img->maxStackDepth, __ATOMIC_RELAXED);
+    while (maxDepth > prevMax && !__atomic_compare_exchange_n(&img->maxStackDepth, &prevMax,
+                                                              maxDepth, true, __ATOMIC_RELAXED,
+                                                              __ATOMIC_RELAXED))
+        ;
+}
+
+#ifdef PXT_VM_THREADED
+// The entry for the second instruction is left intact, so it is still fine to jump or return
+// to it; only the first instruction of the pair is replaced with the superinstruction.
+static bool fusePair(VMThreadedOp *a, VMThreadedOp *b, OpFun addsFn) {
+    OpFun fused = NULL;
+    uint32_t arg = 0;
+
+    if (a->flags || b->size == 0)
+        return false;
+
+    if (a->fn == op_ldloc && a->arg < 0x100) {
+        if (b->fn == op_ldfld && b->arg < 0x1000000) {
+            fused = op_ldloc_ldfld;
+            arg = a->arg | (b->arg << 8);
+        } else if (b->fn == op_jmpz) {
+            int off = (int)b->arg;
+            if (off >= -0x800000 && off < 0x800000) {
+                fused = op_ldloc_jmpz;
+                arg = a->arg | ((uint32_t)off << 8);
+            }
+        }
+    } else if (a->fn == op_push && b->fn == op_ldlit) {
+        fused = op_push_ldlit;
+        arg = b->arg;
+    } else if (a->fn == op_ldint && addsFn && b->fn == addsFn) {
+        fused = op_ldint_adds;
+        arg = a->arg;
+    }
+
+    if (!fused)
+        return false;
+
+    a->fn = fused;
+    a->arg = arg;
+    a->size += b->size;
+    a->flags = b->flags & ~VM_THREADED_RTCALL;
+    return true;
+}
+
+// called before fuseFunction(), which may run on several threads at once
+void prepareFuse(VMImage *img) {
+    img->addsOpcode = -1;
+    for (unsigned i = 0; i < img->numOpcodes; ++i) {
+        auto opd = img->opcodeDescs[i];
+        if (opd && strcmp(opd->name, "numops::adds") == 0) {
+            img->addsOpcode = i;
+            break;
+        }
+    }
+}
+
+void fuseFunction(VMImage *img, VMImageSection *sect) {
+    auto code = (uint16_t *)((uint8_t *)sect + VM_FUNCTION_CODE_OFFSET);
+    auto lastPC = (sect->size - VM_FUNCTION_CODE_OFFSET) >> 1;
+    auto ops = &img->threadedCode[code - (uint16_t *)img->dataStart];
+
+    auto addsFn = img->addsOpcode > 0 ? img->opcodes[img->addsOpcode] : NULL;
+
+    unsigned pc = 0;
+    while (pc < lastPC) {
+        auto size = ops[pc].size;
+        if (size == 0) {
+            pc++; // padding
+            continue;
+        }
+        if (pc + size < lastPC)
+            fusePair(&ops[pc], &ops[pc + size], addsFn);
+        pc += size;
+    }
 }
+#endif
 
 } // namespace pxt
\ No newline at end of file
@@ -25,11 +25,23 @@
 
 // maximum size (in words) of stack in a single function
 #define VM_MAX_FUNCTION_STACK 200
+// maximum size (in words) of a fiber's stack; fibers start with a smaller one, see setupThread()
 #define VM_STACK_SIZE 1000
 
+// Define PXT_VM_THREADED to pre-decode function bodies at load time, so that exec_loop()
+// does a single indirect call per instruction instead of decoding the 16 bit opcodes.
+//#define PXT_VM_THREADED 1
+
+// Define PXT_VM_PROFILE to count executions of every opcode and rtcall, and to sample
+// the running function every VM_PROFILE_INTERVAL_US; see pxt_get_profile().
+//#define PXT_VM_PROFILE 1
+#define VM_PROFILE_INTERVAL_US 1000
+
 #define VM_ENCODE_PC(pc) ((TValue)(((pc) << 9) | 2))
 #define VM_DECODE_PC(pc) (((uintptr_t)pc) >> 9)
 #define TAG_STACK_BOTTOM VM_ENCODE_PC(1)
+// return address of a toString() called by convertToString()
+#define TAG_TO_STRING_RETURN VM_ENCODE_PC(2)
 
 #define PXTEXT extern
 #ifdef __MINGW32__
@@ -43,6 +55,9 @@ namespace pxt {
 struct FiberContext;
 typedef void (*OpFun)(FiberContext *ctx, unsigned arg);
 typedef void (*ApiFun)(FiberContext *ctx);
+struct VMNativeEnv;
+// a function of the image translated to native code, see native.cpp
+typedef void (*VMNativeFn)(FiberContext *ctx, const VMNativeEnv *env);
 
 // keep in sync with backvm.ts
 enum class SectionType : uint8_t {
@@ -81,12 +96,69 @@ struct OpcodeDesc {
     int numArgs;
 };
 
+#ifdef PXT_VM_THREADED
+#define VM_THREADED_PUSH 0x01
+#define VM_THREADED_RTCALL 0x02
+
+// one of these for every 16 bit word of the image; only the ones at instruction starts are used
+struct VMThreadedOp {
+    OpFun fn;
+    uint32_t arg;
+    uint16_t size; // in 16 bit words, including the extended-arg prefix
+    uint16_t flags;
+};
+#endif
+
+struct DecodedOp {
+    unsigned opIdx;
+    unsigned arg;
+    bool isRtCall;
+    bool hasPush;
+    bool isLong; // has the extended-arg prefix
+};
+
+// decode the instruction at code[pc] and return the pc of the next one
+static inline unsigned decodeOp(const uint16_t *code, unsigned pc, DecodedOp &op) {
+    uint16_t opcode = code[pc++];
+    op.isRtCall = false;
+    op.isLong = false;
+    if (opcode >> 15 == 0) {
+        op.opIdx = opcode & VM_OPCODE_BASE_MASK;
+        op.arg = opcode >> VM_OPCODE_ARG_POS;
+        op.hasPush = !!(opcode & VM_OPCODE_PUSH_MASK);
+    } else if (opcode >> 14 == 0b10) {
+        op.opIdx = opcode & 0x1fff;
+        op.arg = 0;
+        op.isRtCall = true;
+        op.hasPush = !!(opcode & VM_RTCALL_PUSH_MASK);
+    } else {
+        unsigned tmp = ((int32_t)opcode << (16 + 2)) >> (2 + VM_OPCODE_ARG_POS);
+        op.isLong = true;
+        opcode = code[pc++];
+        op.opIdx = opcode & VM_OPCODE_BASE_MASK;
+        op.arg = (opcode >> VM_OPCODE_ARG_POS) + tmp;
+        op.hasPush = !!(opcode & VM_OPCODE_PUSH_MASK);
+    }
+    return pc;
+}
+
 struct IfaceEntry {
     uint16_t memberId;
     uint16_t aux;
     uint32_t method;
 };
 
+// per call site cache for op_calliface, op_callget and op_callset
+#define VM_IC_WAYS 4
+struct VMInlineCache {
+    VTable *vtables[VM_IC_WAYS];
+    IfaceEntry *entries[VM_IC_WAYS];
+    uint32_t next;
+    // for RefMap objects with a shape
+    uint32_t mapSlot;
+    MapShape *mapShape;
+};
+
 extern const OpcodeDesc staticOpcodes[];
 
 struct VMImageHeader {
@@ -101,7 +173,11 @@ struct VMImageHeader {
     uint64_t lastUsageTime;
     uint64_t installationTime;
     uint64_t publicationTime;
-    uint8_t reserved[64];
+    // set by the runtime in cache entries that passed verification; see vmcache::isVerified()
+    uint64_t verifiedStamp;
+    uint32_t verifiedMaxStackDepth;
+    uint32_t reserved0;
+    uint8_t reserved[48];
     uint8_t name[128];
 };
 
@@ -117,15 +193,41 @@ struct VMImage {
     VMImageHeader *infoHeader;
     const OpcodeDesc **opcodeDescs;
     RefAction *entryPoint;
+#ifdef PXT_VM_THREADED
+    VMThreadedOp *threadedCode; // indexed by offset from dataStart in 16 bit words
+#endif
+    uint16_t *inlineCacheIndex; // same indexing as above; 0 means no cache
+    // when the image was translated to native code: the function at each word, same indexing
+    VMNativeFn *nativeCode;
+    void *nativeLib;
+    VMInlineCache *inlineCaches;
 
     uint32_t numSections;
     uint32_t numNumberLiterals;
     uint32_t numConfigDataEntries;
     uint32_t numOpcodes;
     uint32_t numIfaceMemberNames;
+    uint32_t numInlineCaches;
     uint32_t errorCode;
     uint32_t errorOffset;
+    // maximum stack depth of any function, as computed by the verifier
+    uint32_t maxStackDepth;
+    // non-zero when dataStart is mmap()ed from a file
+    uint32_t mappedSize;
+    // holds the arrays above, see gcPreStartup()
+    void *preallocBlock;
+#ifdef PXT_VM_PROFILE
+    uint64_t *opcodeCounts;   // indexed like opcodes
+    uint32_t *functionSamples; // indexed like sections
+    uint32_t numProfileSamples;
+    uint32_t lastProfileTick;
+#endif
+    // verified before, see vmcache::isVerified()
+    bool preverified;
     int toStringKey;
+#ifdef PXT_VM_THREADED
+    int addsOpcode;
+#endif
 
     int execLock;
 };
@@ -152,10 +254,19 @@ struct FiberContext {
 
     TryFrame *tryFrame;
     TValue thrownValue;
-    jmp_buf loopjmp;
+    // the stack pointer when the current rtcall started, see convertToString()
+    TValue *rtcallSp;
+    // when an rtcall runs again after the toString() calls of its arguments: the objects and
+    // their strings, in the order they were converted, and how many were used so far
+    RefCollection *convertedStrings;
+    unsigned convertedIdx;
+    // where convertToString() leaves the rtcall to call toString() from exec_loop()
+    jmp_buf convertJmp;
 
     TValue *stackBase;
     TValue *stackLimit;
+    // in words; the stack grows (towards stackBase) when a call would pass stackLimit
+    uint32_t stackSize;
 
     // wait_for_event
     int waitSource;
@@ -163,6 +274,17 @@ struct FiberContext {
 
     // for sleep
     uint64_t wakeTime;
+
+    // next in the queue of fibers ready to run
+    FiberContext *runNext;
+
+    // next in the same bucket of fibers waiting for events
+    FiberContext *waitNext;
+    uint32_t waitSeq;
+
+    // for control.fiberStats()
+    uint64_t runUs;
+    uint32_t switches;
 };
 
 
@@ -171,16 +293,53 @@ struct FiberContext {
 void restoreVMExceptionState(TryFrame *tf, FiberContext *ctx);
 #define pxt_restore_exception_state restoreVMExceptionState
 
-extern VMImage *vmImg;
-extern FiberContext *currentFiber;
-extern volatile int panicCode;
+extern PXT_TLS VMImage *vmImg;
+extern PXT_TLS FiberContext *currentFiber;
+extern PXT_TLS volatile int panicCode;
+
+// A program loaded into the VM, running on its own thread. Everything the program uses
+// is in PXT_TLS variables of that thread; this is what the host uses to control it.
+struct VMInstance {
+    pthread_t thread;
+    bool hasThread;
+    // the image to load
+    const char *filename;
+    uint8_t *data;
+    unsigned len;
+    // for vmStartFromUser(NULL)
+    const char *lastFN;
+    // &panicCode of the thread running the instance, NULL when it is not running
+    volatile int *panicCode;
+    // panicCode when the instance stopped
+    int exitCode;
+};
+
+extern VMInstance vmInstances[PXT_VM_MAX_INSTANCES];
+extern PXT_TLS VMInstance *currInstance;
+
+void bindVMInstance(VMInstance *inst);
+void unbindVMInstance();
+void stopVMInstance(VMInstance *inst);
+int vmInstancePanicCode(VMInstance *inst);
+void raiseInstanceEvent(VMInstance *inst, int id, int event);
+uint32_t instanceDroppedEvents(VMInstance *inst);
 
 void vmStart();
-VMImage *loadVMImage(void *data, unsigned length);
+VMImage *loadVMImage(void *data, unsigned length, bool preverified = false);
 void unloadVMImage(VMImage *img);
 VMImage *setVMImgError(VMImage *img, int code, void *pos);
 void exec_loop(FiberContext *ctx);
+void growStack(FiberContext *ctx);
 void vmStartFromUser(const char *fn);
+void vmPreloadFile(const char *fn);
+void loadNativeCode(VMImage *img);
+void unloadNativeCode(VMImage *img);
+void runNative(FiberContext *ctx);
+void translateInBackground(const char *path);
+#ifdef PXT_VM_PROFILE
+void profileImage(VMImage *img);
+void unprofileImage(VMImage *img);
+#endif
 
 #define DEF_CONVERSION(retp, tp, btp)                                                              \
     static inline retp tp(TValue v) {                                                              \
@@ -203,4 +362,10 @@ String convertToString(FiberContext *ctx, TValue v);
 
 } // namespace pxt
 
+namespace vmcache {
+bool isVerified(const char *path, uint8_t *data, unsigned len);
+void markVerified(const char *path, pxt::VMImage *img);
+char *nativePath(uint64_t programHash, const char *ext);
+} // namespace vmcache
+
 #endif
\ No newline at end of file
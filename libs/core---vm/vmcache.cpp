@@ -19,6 +19,28 @@ struct FullHeader {
     VMImageHeader header;
 };
 
+// once the cache directory is scanned, its headers are kept here
+struct CacheEntry {
+    CacheEntry *hashNext;
+    char *id;
+    uint32_t size;       // of the file
+    FullHeader fh;
+};
+
+#define CACHE_BUCKETS 256
+// unless set with pxt_vm_set_cache_budget()
+#define DEFAULT_CACHE_BUDGET (64 * 1024 * 1024)
+
+// the index is used from both the host and the VM threads
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static CacheEntry *cacheIndex[CACHE_BUCKETS];
+static bool cacheIndexLoaded;
+static uint64_t cacheBytes;
+static uint64_t cacheBudget = DEFAULT_CACHE_BUDGET;
+
+static void loadCacheIndex();
+static void clearCacheIndex();
+
 static char *scriptPath(const char *scriptId) {
     for (auto p = scriptId; *p; ++p)
         if (!isalnum(*p) && *p != '-' && *p != '_') {
@@ -38,6 +60,10 @@ static char *scriptPath(const char *scriptId) {
 }
 
 DLLEXPORT void pxt_vm_set_data_directory(const char *path) {
+    pthread_mutex_lock(&cacheMutex);
+    clearCacheIndex();
+    pthread_mutex_unlock(&cacheMutex);
+
     free(dataPath);
     dataPath = strdup(path);
 
@@ -55,29 +81,117 @@ DLLEXPORT void pxt_vm_set_data_directory(const char *path) {
     dmesg("set vm cached dir %s", dataPath);
 }
 
+static unsigned cacheBucket(const char *id) {
+    uint32_t h = 2166136261;
+    while (*id)
+        h = (h ^ (uint8_t)*id++) * 16777619;
+    return h % CACHE_BUCKETS;
+}
+
+static CacheEntry *findEntry(const char *id) {
+    for (auto e = cacheIndex[cacheBucket(id)]; e; e = e->hashNext)
+        if (strcmp(e->id, id) == 0)
+            return e;
+    return NULL;
+}
+
+static void removeEntry(CacheEntry *e) {
+    auto pp = &cacheIndex[cacheBucket(e->id)];
+    while (*pp != e)
+        pp = &(*pp)->hashNext;
+    *pp = e->hashNext;
+    cacheBytes -= e->size;
+    free(e->id);
+    free(e);
+}
+
+static CacheEntry *addEntry(const char *id, FullHeader *fh, uint32_t size) {
+    auto e = findEntry(id);
+    if (e) {
+        cacheBytes -= e->size;
+    } else {
+        e = (CacheEntry *)malloc(sizeof(CacheEntry));
+        e->id = strdup(id);
+        auto b = cacheBucket(id);
+        e->hashNext = cacheIndex[b];
+        cacheIndex[b] = e;
+    }
+    e->fh = *fh;
+    e->fh.header.name[127] = 0; // make sure it's NUL terminated
+    e->size = size;
+    cacheBytes += size;
+    return e;
+}
+
+static void clearCacheIndex() {
+    for (int i = 0; i < CACHE_BUCKETS; ++i)
+        while (cacheIndex[i])
+            removeEntry(cacheIndex[i]);
+    cacheIndexLoaded = false;
+}
+
+// entries that were never started count as used when installed
+static uint64_t lastUsed(CacheEntry *e) {
+    auto hd = &e->fh.header;
+    return hd->lastUsageTime > hd->installationTime ? hd->lastUsageTime : hd->installationTime;
+}
+
+// delete least recently used entries, other than [keep], until the cache fits the budget
+static void evictEntries(CacheEntry *keep) {
+    while (cacheBudget && cacheBytes > cacheBudget) {
+        CacheEntry *lru = NULL;
+        for (int i = 0; i < CACHE_BUCKETS; ++i)
+            for (auto e = cacheIndex[i]; e; e = e->hashNext)
+                if (e != keep && (!lru || lastUsed(e) < lastUsed(lru)))
+                    lru = e;
+        if (!lru)
+            break;
+        auto pathBuf = scriptPath(lru->id);
+        dmesg("evicting %s from cache (%d bytes)", lru->id, lru->size);
+        remove(pathBuf);
+        free(pathBuf);
+        removeEntry(lru);
+    }
+}
+
 int checkCache(const char *scriptId, bool updateTimestamp = true) {
-    auto pathBuf = scriptPath(scriptId);
-    if (!pathBuf)
-        return 0;
-    auto fh = fopen(pathBuf, updateTimestamp ? "r+b" : "rb");
-    free(pathBuf);
-    dmesg("cache %s for %s", fh ? "hit" : "miss", scriptId);
-    if (fh) {
-        if (updateTimestamp) {
+    pthread_mutex_lock(&cacheMutex);
+    loadCacheIndex();
+    auto e = findEntry(scriptId);
+    dmesg("cache %s for %s", e ? "hit" : "miss", scriptId);
+    if (e && updateTimestamp) {
+        int64_t now = time(NULL);
+        e->fh.header.lastUsageTime = now;
+        auto pathBuf = scriptPath(scriptId);
+        auto fh = fopen(pathBuf, "r+b");
+        free(pathBuf);
+        if (fh) {
             fseek(fh, OFFSET_OF(FullHeader, header.lastUsageTime), SEEK_SET);
-            int64_t now = time(NULL);
             fwrite(&now, 1, 8, fh);
+            fclose(fh);
+        } else {
+            // deleted behind our back
+            removeEntry(e);
+            e = NULL;
         }
-        fclose(fh);
-        return 1;
     }
-    return 0;
+    pthread_mutex_unlock(&cacheMutex);
+    return e ? 1 : 0;
 }
 
 DLLEXPORT int pxt_vm_cache_hit(const char *scriptId) {
     return checkCache(scriptId, false);
 }
 
+// bytes <= 0 means no limit
+DLLEXPORT void pxt_vm_set_cache_budget(int bytes) {
+    pthread_mutex_lock(&cacheMutex);
+    cacheBudget = bytes > 0 ? bytes : 0;
+    if (cacheIndexLoaded)
+        evictEntries(NULL);
+    pthread_mutex_unlock(&cacheMutex);
+}
+
 static int isValidHeader(FullHeader *fh) {
     auto hd = &fh->header;
     return fh->sect.type == SectionType::InfoHeader && fh->sect.size >= sizeof(FullHeader) &&
@@ -134,15 +248,31 @@ static DIR *openCacheDir() {
     return dp;
 }
 
-static bool nameExists(const char *name) {
+// scan the cache directory on first use; later changes go through the index
+static void loadCacheIndex() {
+    if (cacheIndexLoaded || !dataPath)
+        return;
+    cacheIndexLoaded = true;
     auto dp = openCacheDir();
     FullHeader fh;
     for (;;) {
-        if (!readEntry(dp, &fh))
+        auto id = readEntry(dp, &fh);
+        if (!id)
             break;
-        if (strcmp(name, (char *)fh.header.name) == 0)
-            return true;
+        auto filepath = scriptPath(id);
+        struct stat st;
+        if (stat(filepath, &st) == 0)
+            addEntry(id, &fh, (uint32_t)st.st_size);
+        free(filepath);
     }
+    dmesg("cache index: %d bytes", (int)cacheBytes);
+}
+
+static bool nameExists(const char *name) {
+    for (int i = 0; i < CACHE_BUCKETS; ++i)
+        for (auto e = cacheIndex[i]; e; e = e->hashNext)
+            if (strcmp(name, (char *)e->fh.header.name) == 0)
+                return true;
     return false;
 }
 
@@ -151,27 +281,27 @@ RefCollection *list() {
     auto res = Array_::mk();
     registerGCObj(res);
 
-    auto dp = openCacheDir();
-    FullHeader fh;
-    for (;;) {
-        auto id = readEntry(dp, &fh);
-        if (!id)
-            break;
-        char buf[1024];
-        for (auto p = fh.header.name; *p; p++) {
-            if (*p == '\"' || *p < 32)
-                *p = '_';
+    pthread_mutex_lock(&cacheMutex);
+    loadCacheIndex();
+    for (int i = 0; i < CACHE_BUCKETS; ++i) {
+        for (auto e = cacheIndex[i]; e; e = e->hashNext) {
+            auto hd = e->fh.header;
+            char buf[1024];
+            for (auto p = hd.name; *p; p++) {
+                if (*p == '\"' || *p < 32)
+                    *p = '_';
+            }
+            snprintf(buf, 1023,
+                     "{ \"id\": \"%s\", \"pubTime\": %lld, \"installTime\": %lld, "
+                     "\"usageTime\": %lld, \"name\": \"%s\" }",
+                     e->id, hd.publicationTime, hd.installationTime, hd.lastUsageTime, hd.name);
+            auto str = mkString(buf, -1);
+            registerGCObj(str);
+            Array_::push(res, (TValue)str);
+            unregisterGCObj(str);
         }
-        snprintf(buf, 1023,
-                 "{ \"id\": \"%s\", \"pubTime\": %lld, \"installTime\": %lld, \"usageTime\": %lld, "
-                 "\"name\": \"%s\" }",
-                 id, fh.header.publicationTime, fh.header.installationTime, fh.header.lastUsageTime,
-                 fh.header.name);
-        auto str = mkString(buf, -1);
-        registerGCObj(str);
-        Array_::push(res, (TValue)str);
-        unregisterGCObj(str);
     }
+    pthread_mutex_unlock(&cacheMutex);
 
     unregisterGCObj(res);
     return res;
@@ -184,6 +314,9 @@ static int renameImage(uint8_t *data, int len) {
     if (!isValidHeader(fh))
         return -2;
     fh->header.installationTime = (int64_t)time(NULL);
+    // only the runtime gets to say the image was verified
+    fh->header.verifiedStamp = 0;
+    fh->header.verifiedMaxStackDepth = 0;
     auto name = (char *)fh->header.name;
     name[101] = 0; // make sure we have space at the end
     dmesg("rename image from '%s'", name);
@@ -201,6 +334,30 @@ static int renameImage(uint8_t *data, int len) {
     return 0;
 }
 
+// write to a new file and rename it over the old one, so that a running copy,
+// which has the old one mmap()ed, is not affected
+static int writeEntry(const char *pathBuf, uint8_t *data, int len) {
+    auto tmpPath = (char *)malloc(strlen(pathBuf) + 8);
+    strcpy(tmpPath, pathBuf);
+    strcat(tmpPath, ".tmp");
+    auto fh = fopen(tmpPath, "wb");
+    int r = -1;
+    if (fh) {
+        fwrite(data, len, 1, fh);
+        fclose(fh);
+        r = rename(tmpPath, pathBuf);
+#ifdef __WIN32__
+        if (r) {
+            // rename() doesn't replace existing files on Windows
+            remove(pathBuf);
+            r = rename(tmpPath, pathBuf);
+        }
+#endif
+    }
+    free(tmpPath);
+    return r;
+}
+
 DLLEXPORT int pxt_vm_save_in_cache(const char *scriptId, uint8_t *data, int len) {
     if (!dataPath || len < 256)
         return -1;
@@ -214,21 +371,117 @@ DLLEXPORT int pxt_vm_save_in_cache(const char *scriptId, uint8_t *data, int len)
     auto pathBuf = scriptPath(scriptId);
     if (!pathBuf)
         return -3;
-    if (renameImage(data, len))
-        return -4;
-    auto fh = fopen(pathBuf, "wb");
-    dmesg("saving %s in cache, %d bytes", pathBuf, len);
+
+    pthread_mutex_lock(&cacheMutex);
+    loadCacheIndex();
+    int r = 0;
+    if (renameImage(data, len)) {
+        r = -4;
+    } else {
+        dmesg("saving %s in cache, %d bytes", pathBuf, len);
+        if (writeEntry(pathBuf, data, len)) {
+            r = -2;
+        } else {
+            evictEntries(addEntry(scriptId, (FullHeader *)data, len));
+            dmesg("saved.");
+            pxt::translateInBackground(pathBuf);
+        }
+    }
+    pthread_mutex_unlock(&cacheMutex);
+
     free(pathBuf);
-    if (!fh)
-        return -2;
-    fwrite(data, len, 1, fh);
-    fclose(fh);
-    dmesg("saved.");
-    return 0;
+    return r;
+}
+
+// Native code of images, see native.cpp; by program hash, as the same program can be in the
+// cache under several ids. NULL when there is no data directory.
+char *nativePath(uint64_t programHash, const char *ext) {
+    if (!dataPath)
+        return NULL;
+    auto pathBuf = (char *)malloc(strlen(dataPath) + 40 + strlen(ext));
+    strcpy(pathBuf, dataPath);
+    strcat(pathBuf, "/native-v0");
+#ifdef __WIN32__
+    mkdir(pathBuf);
+#else
+    mkdir(pathBuf, 0777);
+#endif
+    sprintf(pathBuf + strlen(pathBuf), "/%016llx%s", (unsigned long long)programHash, ext);
+    return pathBuf;
+}
+
+// bump when the verifier changes, so that images verified by older runtimes are checked again
+#define VERIFY_STAMP_VERSION 1
+
+// identifies the image and the runtime that verified it
+static uint64_t verifyStamp(VMImageHeader *hd, unsigned len) {
+    uint64_t words[] = {VERIFY_STAMP_VERSION, len, hd->hexHash, hd->programHash};
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto p = (uint8_t *)words;
+    for (unsigned i = 0; i < sizeof(words); ++i)
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    return h | 1;
+}
+
+// only entries written by pxt_vm_save_in_cache() can carry a stamp
+static bool isCachePath(const char *path) {
+    if (!dataPath || !path)
+        return false;
+    auto dirpath = scriptPath("");
+    auto dirLen = strlen(dirpath);
+    bool res = strncmp(path, dirpath, dirLen) == 0 && path[dirLen] == '/' && path[dirLen + 1];
+    free(dirpath);
+    if (res)
+        for (auto p = path + dirLen + 1; *p; ++p)
+            if (!isalnum(*p) && *p != '-' && *p != '_')
+                return false;
+    return res;
+}
+
+// Whether the image at [path] passed verification when it was last started from the cache;
+// such images are loaded without verifying them again.
+bool isVerified(const char *path, uint8_t *data, unsigned len) {
+    if (len < sizeof(FullHeader) || !isCachePath(path))
+        return false;
+    auto fh = (FullHeader *)data;
+    if (!isValidHeader(fh))
+        return false;
+    return fh->header.verifiedStamp == verifyStamp(&fh->header, len) &&
+           fh->header.verifiedMaxStackDepth > 0;
+}
+
+void markVerified(const char *path, pxt::VMImage *img) {
+    if (!isCachePath(path))
+        return;
+    auto fp = fopen(path, "r+b");
+    if (!fp)
+        return;
+    auto len = (unsigned)((uint8_t *)img->dataEnd - (uint8_t *)img->dataStart);
+    uint64_t stamp = verifyStamp(img->infoHeader, len);
+    uint32_t maxStackDepth = img->maxStackDepth;
+    fseek(fp, OFFSET_OF(FullHeader, header.verifiedMaxStackDepth), SEEK_SET);
+    fwrite(&maxStackDepth, 1, 4, fp);
+    // the stamp goes last, as it vouches for the rest
+    fseek(fp, OFFSET_OF(FullHeader, header.verifiedStamp), SEEK_SET);
+    fwrite(&stamp, 1, 8, fp);
+    fclose(fp);
+    dmesg("marked %s as verified", path);
 }
 
 DLLEXPORT void pxt_vm_start(const char *fn);
 
+// Load and verify the script on a background thread, so that starting it next is quick.
+DLLEXPORT int pxt_vm_preload(const char *scriptId) {
+    if (!checkCache(scriptId, false))
+        return -1;
+    auto pathBuf = scriptPath(scriptId);
+    dmesg("preloading %s", pathBuf);
+    vmPreloadFile(pathBuf);
+    free(pathBuf);
+    return 0;
+}
+
 DLLEXPORT int pxt_vm_cache_start(const char *scriptId) {
     if (!checkCache(scriptId))
         return -1;
@@ -255,7 +508,12 @@ void del(String name) {
     if (!pathBuf)
         return;
     dmesg("delete %s from cache", pathBuf);
+    pthread_mutex_lock(&cacheMutex);
     remove(pathBuf);
+    auto e = findEntry(scriptId);
+    if (e)
+        removeEntry(e);
+    pthread_mutex_unlock(&cacheMutex);
     free(pathBuf);
 }
 
@@ -1,37 +1,65 @@
 #include "pxt.h"
 
+#ifndef __MINGW32__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
 namespace pxt {
 
-VMImage *vmImg;
-
-static void vmStartCore(uint8_t *data, unsigned len) {
-    unloadVMImage(vmImg);
-    vmImg = NULL;
+PXT_TLS VMImage *vmImg;
+VMInstance vmInstances[PXT_VM_MAX_INSTANCES];
 
+// Load and verify an image, on any thread. [path] is set when the image comes from a file,
+// and [mappedSize] when it's mmap()ed. Returns NULL if the image is invalid.
+static VMImage *loadImage(uint8_t *data, unsigned len, const char *path = NULL,
+                          unsigned mappedSize = 0) {
     gcPreStartup();
 
-    auto img = loadVMImage(data, len);
+    auto preverified = path && vmcache::isVerified(path, data, len);
+    auto img = loadVMImage(data, len, preverified);
+    img->mappedSize = mappedSize;
+    img->preallocBlock = gcPreallocDone();
     if (img->errorCode) {
         dmesg("validation error %d at 0x%x", img->errorCode, img->errorOffset);
-        return;
+        unloadVMImage(img);
+        return NULL;
+    } else if (preverified) {
+        dmesg("Validation skipped, verified before");
     } else {
         dmesg("Validation OK");
+        if (path)
+            vmcache::markVerified(path, img);
     }
-    vmImg = img;
-
-    gcStartup();
-
-    globals = (TValue *)app_alloc(sizeof(TValue) * getNumGlobals());
-    memset(globals, 0, sizeof(TValue) * getNumGlobals());
-
-    initRuntime();
+    return img;
 }
 
-static void vmStartFile(const char *fn) {
+static VMImage *loadImageFile(const char *fn) {
+#ifndef __MINGW32__
+    int fd = open(fn, O_RDONLY);
+    if (fd < 0) {
+        dmesg("cannot open %s", fn);
+        return NULL;
+    }
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        // pages are only read when the program touches them; the few the loader patches
+        // (function headers, vtables) get private copies
+        data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        dmesg("cannot map %s", fn);
+        return NULL;
+    }
+    return loadImage((uint8_t *)data, (unsigned)st.st_size, fn, (unsigned)st.st_size);
+#else
     auto f = fopen(fn, "rb");
     if (!f) {
         dmesg("cannot open %s", fn);
-        return;
+        return NULL;
     }
 
     fseek(f, 0, SEEK_END);
@@ -41,74 +69,224 @@ static void vmStartFile(const char *fn) {
     fread(data, len, 1, f);
     fclose(f);
 
-    vmStartCore(data, len);
+    return loadImage(data, len, fn);
+#endif
 }
 
-static uint8_t *vm_data;
-static unsigned vm_len;
-static const char *vm_filename;
+static void vmStartImage(VMImage *img) {
+    unloadVMImage(vmImg);
+    vmImg = img;
+    if (!img)
+        return;
+#ifdef PXT_VM_PROFILE
+    profileImage(img);
+#endif
+
+    gcStartup();
+
+    globals = (TValue *)app_alloc(sizeof(TValue) * getNumGlobals());
+    memset(globals, 0, sizeof(TValue) * getNumGlobals());
 
-static void *multiStart(void *) {
-    if (vm_filename)
-        vmStartFile(vm_filename);
+    initRuntime();
+}
+
+// an image loaded ahead of time, see vmPreloadFile()
+static struct {
+    char *path;
+    pthread_t thread;
+    bool hasThread;
+    VMImage *img;
+    // of the file, when it was loaded
+    time_t mtime;
+    off_t size;
+} preloaded;
+static pthread_mutex_t preloadMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *preloadWorker(void *) {
+    preloaded.img = loadImageFile(preloaded.path);
+    return NULL;
+}
+
+// wait for the preload thread and forget about the image; preloadMutex is held
+static VMImage *takePreloaded() {
+    if (preloaded.hasThread) {
+        void *dummy;
+        pthread_join(preloaded.thread, &dummy);
+        preloaded.hasThread = false;
+    }
+    auto img = preloaded.img;
+    preloaded.img = NULL;
+    free(preloaded.path);
+    preloaded.path = NULL;
+    return img;
+}
+
+void vmPreloadFile(const char *fn) {
+    pthread_mutex_lock(&preloadMutex);
+    unloadVMImage(takePreloaded());
+    struct stat st;
+    if (stat(fn, &st) == 0) {
+        preloaded.path = strdup(fn);
+        preloaded.mtime = st.st_mtime;
+        preloaded.size = st.st_size;
+        preloaded.hasThread = true;
+        pthread_create(&preloaded.thread, NULL, preloadWorker, NULL);
+    }
+    pthread_mutex_unlock(&preloadMutex);
+}
+
+static void vmStartFile(const char *fn) {
+    VMImage *img = NULL;
+    pthread_mutex_lock(&preloadMutex);
+    if (preloaded.path && strcmp(preloaded.path, fn) == 0) {
+        struct stat st;
+        auto unchanged =
+            stat(fn, &st) == 0 && st.st_mtime == preloaded.mtime && st.st_size == preloaded.size;
+        img = takePreloaded();
+        if (img && !unchanged) {
+            dmesg("%s changed since preload", fn);
+            unloadVMImage(img);
+            img = NULL;
+        }
+        if (img)
+            dmesg("starting preloaded %s", fn);
+    }
+    pthread_mutex_unlock(&preloadMutex);
+
+    if (!img)
+        img = loadImageFile(fn);
+    vmStartImage(img);
+}
+
+static void vmStartCore(uint8_t *data, unsigned len) {
+    vmStartImage(loadImage(data, len));
+}
+
+static void *instanceMain(void *arg) {
+    auto inst = (VMInstance *)arg;
+    bindVMInstance(inst);
+    if (inst->filename)
+        vmStartFile(inst->filename);
     else
-        vmStartCore(vm_data, vm_len);
+        vmStartCore(inst->data, inst->len);
+    unbindVMInstance();
     return NULL;
 }
 
 void vmStart() {
+    bindVMInstance(&vmInstances[0]);
     auto fn = pxt::initialArgv[1];
     vmStartFile(fn);
 }
 
-pthread_t vm_thread;
-int vm_has_thread;
-
-static void spinThread() {
-    if (vm_has_thread) {
+static void stopThread(VMInstance *inst) {
+    if (inst->hasThread) {
         void *dummy;
-        if (!panicCode)
-            panicCode = -1;
-        pthread_join(vm_thread, &dummy);
-        vm_has_thread = 0;
+        stopVMInstance(inst);
+        pthread_join(inst->thread, &dummy);
+        inst->hasThread = 0;
     }
-    panicCode = 0;
-    pthread_create(&vm_thread, NULL, multiStart, NULL);
-    vm_has_thread = 1;
 }
 
-static void *startFromUserWorker(void *fn) {
+static void spinThread(VMInstance *inst) {
+    stopThread(inst);
+    inst->exitCode = 0;
+    pthread_create(&inst->thread, NULL, instanceMain, inst);
+    inst->hasThread = 1;
+}
+
+static void *startFromUserWorker(void *arg) {
+    auto inst = (VMInstance *)arg;
     void *dummy;
-    pthread_join(vm_thread, &dummy);
-    vm_thread = pthread_self();
-    panicCode = 0;
-    vmStartFile((char*)fn);
+    pthread_join(inst->thread, &dummy);
+    inst->thread = pthread_self();
+    bindVMInstance(inst);
+    vmStartFile(inst->lastFN);
+    unbindVMInstance();
     return NULL;
 }
 
-static const char *lastFN;
 void vmStartFromUser(const char *fn) {
+    auto inst = currInstance;
     pthread_t pt;
-    if (!fn && lastFN) {
-        dmesg("re-starting %s", lastFN);
-        fn = lastFN;
+    if (!fn && inst->lastFN) {
+        dmesg("re-starting %s", inst->lastFN);
+        fn = inst->lastFN;
     }
-    lastFN = fn;
+    inst->lastFN = fn;
     if (fn)
-        pthread_create(&pt, NULL, startFromUserWorker, (void*)fn);
+        pthread_create(&pt, NULL, startFromUserWorker, inst);
     systemReset();
 }
 
 DLLEXPORT void pxt_vm_start(const char *fn) {
-    vm_filename = fn;
-    spinThread();
+    vmInstances[0].filename = fn;
+    spinThread(&vmInstances[0]);
 }
 
 DLLEXPORT void pxt_vm_start_buffer(uint8_t *data, unsigned len) {
-    vm_filename = NULL;
-    vm_data = data;
-    vm_len = len;
-    spinThread();
+    auto inst = &vmInstances[0];
+    inst->filename = NULL;
+    inst->data = data;
+    inst->len = len;
+    spinThread(inst);
+}
+
+#ifdef PXT_VM_MULTI
+// Instance 0 is the one pxt_vm_start() uses; the others are started with
+// pxt_vm_instance_start*() and run in parallel to it and to each other.
+
+static VMInstance *allocInstance() {
+    for (int i = 1; i < PXT_VM_MAX_INSTANCES; ++i)
+        if (!vmInstances[i].hasThread)
+            return &vmInstances[i];
+    return NULL;
+}
+
+static VMInstance *lookupInstance(int id) {
+    if (id < 0 || id >= PXT_VM_MAX_INSTANCES || !vmInstances[id].hasThread)
+        return NULL;
+    return &vmInstances[id];
+}
+
+// returns the instance id, or -1 when all instances are in use
+DLLEXPORT int pxt_vm_instance_start(const char *fn) {
+    auto inst = allocInstance();
+    if (!inst)
+        return -1;
+    inst->filename = fn;
+    spinThread(inst);
+    return inst - vmInstances;
+}
+
+DLLEXPORT int pxt_vm_instance_start_buffer(uint8_t *data, unsigned len) {
+    auto inst = allocInstance();
+    if (!inst)
+        return -1;
+    inst->filename = NULL;
+    inst->data = data;
+    inst->len = len;
+    spinThread(inst);
+    return inst - vmInstances;
+}
+
+// stops the instance and waits for its thread; the id may be reused afterwards
+DLLEXPORT void pxt_vm_instance_stop(int id) {
+    auto inst = lookupInstance(id);
+    if (inst)
+        stopThread(inst);
+}
+
+DLLEXPORT int pxt_vm_instance_panic_code(int id) {
+    auto inst = lookupInstance(id);
+    return inst ? vmInstancePanicCode(inst) : 0;
+}
+
+DLLEXPORT void pxt_vm_instance_raise_event(int id, int src, int val) {
+    auto inst = lookupInstance(id);
+    if (inst)
+        raiseInstanceEvent(inst, src, val);
 }
+#endif
 
 } // namespace pxt
@@ -100,6 +100,7 @@ static void initCodal() {
 // for a given event, then [handlersMap] contains a valid entry for that
 // event.
 void dispatchEvent(Event e) {
+    PXT_TRACE_EVENT(EventDispatch, e.source, e.value);
     lastEvent = e;
 
     auto curr = findBinding(e.source, e.value);
@@ -110,16 +111,88 @@ void dispatchEvent(Event e) {
     }
 }
 
+// With this in the flags of registerWithDal(), the events of the binding are queued and a single
+// fiber runs the handler for them, one after the other, instead of a fiber (or at least a fork on
+// block) per event. For events raised often, whose handlers can wait for each other.
+#define PXT_EVENT_QUEUED 0x100
+#ifndef PXT_EVENT_QUEUE_SIZE
+#define PXT_EVENT_QUEUE_SIZE 16 // events beyond these, while the handler runs, are dropped
+#endif
+
+struct QueuedBinding {
+    QueuedBinding *next;
+    uint16_t id, event;
+    uint16_t notifyId;
+    bool waiting; // for notifyId
+    uint8_t head, len;
+    uint16_t values[PXT_EVENT_QUEUE_SIZE];
+};
+static QueuedBinding *queuedBindings;
+
+// called by the message bus, without forking, so it must not block
+static void queueEvent(Event e, void *arg) {
+    auto q = (QueuedBinding *)arg;
+    if (q->len == PXT_EVENT_QUEUE_SIZE)
+        return;
+    q->values[(q->head + q->len++) % PXT_EVENT_QUEUE_SIZE] = e.value;
+    if (q->waiting) {
+        q->waiting = false;
+        Event(DEVICE_ID_NOTIFY, q->notifyId);
+    }
+}
+
+static void queuedBindingLoop(void *arg) {
+    auto q = (QueuedBinding *)arg;
+    while (true) {
+        if (!q->len) {
+            q->waiting = true;
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, q->notifyId);
+            continue;
+        }
+        int value = q->values[q->head];
+        q->head = (q->head + 1) % PXT_EVENT_QUEUE_SIZE;
+        q->len--;
+        // the bindings are looked up for every event, so replacing the handler works as usual
+        dispatchEvent(Event(q->id, value, CREATE_ONLY));
+    }
+}
+
+static QueuedBinding *findQueuedBinding(int id, int event) {
+    for (auto q = queuedBindings; q; q = q->next)
+        if (q->id == id && q->event == event)
+            return q;
+    return NULL;
+}
+
+static void listenQueued(int id, int event) {
+    auto q = new QueuedBinding();
+    memset(q, 0, sizeof(*q));
+    q->id = id;
+    q->event = event;
+    q->notifyId = allocateNotifyEvent();
+    q->next = queuedBindings;
+    queuedBindings = q;
+    create_fiber(queuedBindingLoop, q);
+    devMessageBus.listen(id, event, queueEvent, q, MESSAGE_BUS_LISTENER_NONBLOCKING);
+}
+
 void registerWithDal(int id, int event, Action a, int flags) {
     // first time?
     if (!findBinding(id, event)) {
-        devMessageBus.listen(id, event, dispatchEvent, flags);
+        if (flags & PXT_EVENT_QUEUED)
+            listenQueued(id, event);
+        else
+            devMessageBus.listen(id, event, dispatchEvent, flags);
         if (event == 0) {
             // we're registering for all events on given ID
             // need to remove old listeners for specific events
             auto curr = findBinding(id, -1);
             while (curr) {
-                devMessageBus.ignore(id, curr->value, dispatchEvent);
+                // the fiber of a queued one stays, waiting for events that won't come
+                if (findQueuedBinding(id, curr->value))
+                    devMessageBus.ignore(id, curr->value, queueEvent);
+                else
+                    devMessageBus.ignore(id, curr->value, dispatchEvent);
                 curr = nextBinding(curr->next, id, -1);
             }
         }
@@ -144,13 +217,135 @@ void sleep_us(uint64_t us) {
     target_wait_us(us);
 }
 
+#define FOREVER_PERIOD_MS 20
+// the system tick of the components, while the low power idle is on
+#define LOW_POWER_TICK_PERIOD_US 50000
+
+// codal has no hook on context switches, so the fiber accounting samples the running fiber
+// from a timer interrupt; the run times and switches are the ones the samples saw
+#define FIBER_SAMPLE_US 997
+
+struct FiberAccount {
+    codal::Fiber *fiber;
+    uint32_t samples;
+    uint32_t switches;
+    uint32_t handler;
+};
+static FiberAccount fiberAccounts[PXT_MAX_FIBER_STATS];
+static codal::Fiber *lastSampledFiber;
+static bool fiberSampling;
+
+static FiberAccount *getFiberAccount(codal::Fiber *fib) {
+    FiberAccount *free = NULL;
+    for (auto &acc : fiberAccounts) {
+        if (acc.fiber == fib)
+            return &acc;
+        if (!acc.fiber && !free)
+            free = &acc;
+    }
+    if (free) {
+        free->fiber = fib;
+        free->samples = free->switches = free->handler = 0;
+    }
+    return free;
+}
+
+// called by the message bus from the timer interrupt
+static void sampleFiber(Event) {
+    auto fib = currentFiber;
+    auto acc = fib ? getFiberAccount(fib) : NULL;
+    if (!acc)
+        return;
+    acc->samples++;
+    if (fib != lastSampledFiber) {
+        acc->switches++;
+        lastSampledFiber = fib;
+    }
+}
+
+static void noteFiberHandler(Action a) {
+    auto handler = (uint32_t)(uintptr_t)((RefAction *)a)->func;
+    target_disable_irq();
+    auto acc = getFiberAccount(currentFiber);
+    if (acc) {
+        // codal recycles fibers; this one was running another handler
+        if (acc->handler != handler)
+            acc->samples = acc->switches = 0;
+        acc->handler = handler;
+    }
+    target_enable_irq();
+}
+
+int getFiberStats(FiberStats *dest, int max) {
+    if (!fiberSampling) {
+        fiberSampling = true;
+        int ev = allocateNotifyEvent();
+        devMessageBus.listen(DEVICE_ID_NOTIFY, ev, sampleFiber, MESSAGE_BUS_LISTENER_IMMEDIATE);
+        system_timer_event_every_us(FIBER_SAMPLE_US, DEVICE_ID_NOTIFY, ev);
+    }
+
+    int numFibers = codal::list_fibers(NULL);
+    auto fibers = (codal::Fiber **)xmalloc(sizeof(codal::Fiber *) * numFibers);
+    numFibers = codal::list_fibers(fibers);
+
+    int n = 0;
+    target_disable_irq();
+    for (auto &acc : fiberAccounts) {
+        if (!acc.fiber)
+            continue;
+        codal::Fiber *fib = NULL;
+        for (int i = 0; i < numFibers; ++i)
+            if (fibers[i] == acc.fiber)
+                fib = fibers[i];
+        // the fiber is gone; make room for new ones
+        if (!fib) {
+            acc.fiber = NULL;
+            continue;
+        }
+        if (n >= max)
+            continue;
+        auto &st = dest[n++];
+        st.id = (uint32_t)(uintptr_t)fib;
+        st.runUs = acc.samples * FIBER_SAMPLE_US;
+        st.switches = acc.switches;
+        // codal keeps the stack of a fiber in a buffer that only grows when it's too small
+        st.stackBytes = (uint8_t *)fib->stack_top - (uint8_t *)fib->stack_bottom;
+        st.handler = acc.handler;
+    }
+    target_enable_irq();
+
+    xfree(fibers);
+    return n;
+}
+
+static void parallel_stub(void *a) {
+    noteFiberHandler((Action)a);
+    runAction0((Action)a);
+}
+
 void forever_stub(void *a) {
+    noteFiberHandler((Action)a);
     while (true) {
+        auto start = current_time_ms();
         runAction0((Action)a);
-        fiber_sleep(20);
+        // a body that paused itself has waited long enough; sleeping again would only wake
+        // the device up once more
+        int left = FOREVER_PERIOD_MS - (int)(current_time_ms() - start);
+        if (left > 0)
+            fiber_sleep(left);
+        else
+            schedule();
     }
 }
 
+void setLowPowerIdle(bool enabled) {
+    // buttons and sensors are polled from the system tick, which wakes up the device even when
+    // all fibers sleep; a longer tick only makes them react a little later
+    system_timer_cancel_event(DEVICE_ID_COMPONENT, DEVICE_COMPONENT_EVT_SYSTEM_TICK);
+    system_timer_event_every_us(enabled ? LOW_POWER_TICK_PERIOD_US : SCHEDULER_TICK_PERIOD_US,
+                                DEVICE_ID_COMPONENT, DEVICE_COMPONENT_EVT_SYSTEM_TICK);
+}
+
 void runForever(Action a) {
     if (a != 0) {
         registerGCPtr(a);
@@ -161,7 +356,7 @@ void runForever(Action a) {
 void runInParallel(Action a) {
     if (a != 0) {
         registerGCPtr(a);
-        create_fiber((void (*)(void *))(void*)runAction0, (void *)a, fiberDone);
+        create_fiber(parallel_stub, (void *)a, fiberDone);
     }
 }
 
@@ -211,6 +406,22 @@ static void *threadAddressFor(codal::Fiber *fib, void *sp) {
     return (uint8_t *)sp + ((uint8_t *)fib->stack_top - (uint8_t *)tcb_get_stack_base(fib->tcb));
 }
 
+static void processFiberStack(codal::Fiber *fib, int flags, int &cnt) {
+    auto ctx = (ThreadContext *)fib->user_data;
+    if (!ctx)
+        return;
+    gcProcess(ctx->thrownValue);
+    for (auto seg = &ctx->stack; seg; seg = seg->next) {
+        auto ptr = (TValue *)threadAddressFor(fib, seg->top);
+        auto end = (TValue *)threadAddressFor(fib, seg->bottom);
+        if (flags & 2)
+            DMESG("RS%d:%p/%d", cnt++, ptr, end - ptr);
+        // VLOG("mark: %p - %p", ptr, end);
+        if (ptr < end)
+            gcProcessMany(ptr, end - ptr);
+    }
+}
+
 void gcProcessStacks(int flags) {
     // check scheduler is initialized
     if (!currentFiber) {
@@ -220,31 +431,27 @@ void gcProcessStacks(int flags) {
         return;
     }
 
+    int cnt = 0;
+#ifdef DEVICE_GET_FIBER_LIST_AVAILABLE
+    // the scheduler keeps them in a list already
+    for (auto fib = codal::get_fiber_list(); fib; fib = fib->next)
+        processFiberStack(fib, flags, cnt);
+#else
+    // kept from one collection to the next; only grows when there are more fibers
+    static codal::Fiber **fibers;
+    static int fibersCap;
     int numFibers = codal::list_fibers(NULL);
-    codal::Fiber **fibers = (codal::Fiber **)xmalloc(sizeof(codal::Fiber *) * numFibers);
+    if (numFibers > fibersCap) {
+        xfree(fibers);
+        fibersCap = numFibers + 4;
+        fibers = (codal::Fiber **)xmalloc(sizeof(codal::Fiber *) * fibersCap);
+    }
     int num2 = codal::list_fibers(fibers);
     if (numFibers != num2)
         oops(12);
-    int cnt = 0;
-
-    for (int i = 0; i < numFibers; ++i) {
-        auto fib = fibers[i];
-        auto ctx = (ThreadContext *)fib->user_data;
-        if (!ctx)
-            continue;
-        gcProcess(ctx->thrownValue);
-        for (auto seg = &ctx->stack; seg; seg = seg->next) {
-            auto ptr = (TValue *)threadAddressFor(fib, seg->top);
-            auto end = (TValue *)threadAddressFor(fib, seg->bottom);
-            if (flags & 2)
-                DMESG("RS%d:%p/%d", cnt++, ptr, end - ptr);
-            // VLOG("mark: %p - %p", ptr, end);
-            while (ptr < end) {
-                gcProcess(*ptr++);
-            }
-        }
-    }
-    xfree(fibers);
+    for (int i = 0; i < numFibers; ++i)
+        processFiberStack(fibers[i], flags, cnt);
+#endif
 }
 
 LowLevelTimer *getJACDACTimer() {
@@ -107,42 +107,73 @@ int HF2::stdRequest(UsbEndpointIn &ctrl, USBSetup &setup) {
 #define CTRL_OUT_REPORT_H 0x2
 #define CTRL_IN_REPORT_H 0x1
 
+// only one stream at a time, see HF2::streaming
+static uint32_t streamBuf[HF2_STREAM_PACKETS * 64 / 4];
+
+// fills the 64 byte packet at dst with the next part of data, and advances it
+static void fillPacket(uint8_t *dst, uint8_t flag, const void *&data, unsigned &size,
+                       uint32_t &prepend) {
+    int s = 63;
+    if (size <= 63) {
+        s = size;
+        memset(dst + 1 + s, 0, 63 - s);
+    } else {
+        flag = flag == HF2_FLAG_CMDPKT_LAST ? HF2_FLAG_CMDPKT_BODY : flag;
+    }
+    *dst++ = flag | s;
+    if (prepend + 1) {
+        memcpy(dst, &prepend, 4);
+        prepend = -1;
+        dst += 4;
+        s -= 4;
+        size -= 4;
+    }
+    memcpy(dst, data, s);
+    data = (const uint8_t *)data + s;
+    size -= s;
+}
+
 void HF2::sendBuffer(uint8_t flag, const void *data, unsigned size, uint32_t prepend) {
     if (!CodalUSB::usbInstance->isInitialised())
         return;
 
-    uint32_t buf[64 / 4]; // aligned
-
     if (prepend + 1)
         size += 4;
 
-    target_disable_irq();
-    while (size > 0) {
-        memset(buf + 1, 0, 60);
-        int s = 63;
-        if (size <= 63) {
-            s = size;
-            buf[0] = flag;
-        } else {
-            buf[0] = flag == HF2_FLAG_CMDPKT_LAST ? HF2_FLAG_CMDPKT_BODY : flag;
+    // HID reports are one packet each, and serial data is short, so these go out as before, with
+    // interrupts off for all of it; the host takes serial packets in between the ones of a
+    // response, so they can interrupt a stream
+    if (useHID || flag != HF2_FLAG_CMDPKT_LAST) {
+        uint32_t buf[64 / 4]; // aligned
+        target_disable_irq();
+        while (size > 0) {
+            fillPacket((uint8_t *)buf, flag, data, size, prepend);
+            in->write(buf, sizeof(buf));
         }
-        buf[0] |= s;
-        uint8_t *dst = (uint8_t *)buf;
-        dst++;
-        if (prepend + 1) {
-            memcpy(dst, &prepend, 4);
-            prepend = -1;
-            dst += 4;
-            s -= 4;
-            size -= 4;
-        }
-        memcpy(dst, data, s);
-        data = (const uint8_t *)data + s;
-        size -= s;
+        target_enable_irq();
+        return;
+    }
 
-        in->write(buf, sizeof(buf));
+    target_disable_irq();
+    if (streaming) {
+        // an interrupt, in the middle of a response or event; its packets can't go in between
+        droppedEvents++;
+        target_enable_irq();
+        return;
     }
+    streaming = true;
     target_enable_irq();
+
+    while (size > 0) {
+        int n = 0;
+        while (size > 0 && n < HF2_STREAM_PACKETS)
+            fillPacket((uint8_t *)streamBuf + 64 * n++, flag, data, size, prepend);
+        target_disable_irq();
+        in->write(streamBuf, 64 * n);
+        target_enable_irq();
+    }
+
+    streaming = false;
 }
 
 const InterfaceInfo *HF2::getInterfaceInfo() {
@@ -223,6 +254,16 @@ static void copy_words(void *dst0, const void *src0, uint32_t n_words) {
         *dst++ = *src++;
 }
 
+static uint16_t crc16(const uint8_t *data, uint32_t len) {
+    uint16_t crc = 0;
+    while (len--) {
+        crc ^= *data++ << 8;
+        for (int i = 0; i < 8; ++i)
+            crc = crc & 0x8000 ? crc << 1 ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
 #ifndef QUICK_BOOT
 #ifdef SAMD21
 #define DBL_TAP_PTR ((volatile uint32_t *)(HMCRAMC0_ADDR + HMCRAMC0_SIZE - 4))
@@ -239,6 +280,90 @@ static void jdLog(const uint8_t *frame) {
     jdLogger->sendEvent(HF2_EV_JDS_PACKET, frame, frame[2] + 12);
 }
 
+// Equal bytes it takes to end a run of changed ones; shorter gaps cost less to send than a new
+// run header. Has to be at least 4, for the size of the event (see screenLog()).
+#ifndef HF2_SCREEN_MIN_GAP
+#define HF2_SCREEN_MIN_GAP 4
+#endif
+
+// set by HF2_CMD_SCREEN_CONFIG, from the USB interrupt; the buffers are only touched by
+// screenLog(), from the fiber updating the screen
+static HF2 *screenLogger;
+static volatile uint32_t screenFps;
+static volatile bool screenKeyframe;
+static uint8_t *prevFrame, *frameEvent; // the frame the host has, and the event for the next
+static int prevFrameLen;
+static uint32_t lastFrameTime;
+
+static uint8_t *addRun(uint8_t *dst, int skip, const uint8_t *src, int len) {
+    *dst++ = skip;
+    *dst++ = skip >> 8;
+    *dst++ = len;
+    *dst++ = len >> 8;
+    memcpy(dst, src, len);
+    return dst + len;
+}
+
+static void screenLog(const uint8_t *pix, int width, int height, int len) {
+    if (!screenFps) {
+        if (prevFrame) {
+            xfree(prevFrame);
+            xfree(frameEvent);
+            prevFrame = frameEvent = NULL;
+        }
+        return;
+    }
+
+    auto now = current_time_ms();
+    if (prevFrame && now - lastFrameTime < 1000 / screenFps)
+        return;
+
+    if (!prevFrame || prevFrameLen != len) {
+        if (prevFrame) {
+            xfree(prevFrame);
+            xfree(frameEvent);
+        }
+        prevFrame = (uint8_t *)xmalloc(len);
+        // runs are at least HF2_SCREEN_MIN_GAP bytes apart, so only the first header adds to len
+        frameEvent = (uint8_t *)xmalloc(sizeof(HF2_SCREEN_FRAME_Event) + 4 + len);
+        prevFrameLen = len;
+        screenKeyframe = true;
+    }
+
+    auto ev = (HF2_SCREEN_FRAME_Event *)frameEvent;
+    ev->width = width;
+    ev->height = height;
+    auto dst = ev->runs;
+
+    if (screenKeyframe) {
+        screenKeyframe = false;
+        dst = addRun(dst, 0, pix, len);
+    } else {
+        int sent = 0;
+        for (int i = 0; i < len;) {
+            if (pix[i] == prevFrame[i]) {
+                i++;
+                continue;
+            }
+            int end = i + 1;
+            for (int j = end; j < len && j - end < HF2_SCREEN_MIN_GAP; ++j)
+                if (pix[j] != prevFrame[j])
+                    end = j + 1;
+            dst = addRun(dst, i - sent, pix + i, end - i);
+            sent = i = end;
+        }
+        if (dst == ev->runs)
+            return; // nothing changed
+    }
+
+    lastFrameTime = now;
+    memcpy(prevFrame, pix, len);
+    auto dropped = screenLogger->droppedEvents;
+    screenLogger->sendEvent(HF2_EV_SCREEN_FRAME, frameEvent, dst - frameEvent);
+    if (dropped != screenLogger->droppedEvents)
+        screenKeyframe = true;
+}
+
 int HF2::endpointRequest() {
     int sz = recv();
 
@@ -314,6 +439,17 @@ int HF2::endpointRequest() {
         copy_words(resp->data32, (void *)cmd->read_words.target_addr, tmp);
         return sendResponse(tmp << 2);
 
+    // lets the host see if the program is already there before it resets into the bootloader
+    case HF2_CMD_CHKSUM_PAGES:
+        checkDataSize(chksum_pages, 0);
+        tmp = cmd->chksum_pages.num_pages;
+        usb_assert(tmp <= sizeof(pkt.buf) / 2 - 2);
+        for (uint32_t i = 0; i < tmp; ++i)
+            resp->data16[i] = crc16((const uint8_t *)cmd->chksum_pages.target_addr +
+                                        i * HF2_CHKSUM_PAGE_SIZE,
+                                    HF2_CHKSUM_PAGE_SIZE);
+        return sendResponse(tmp << 1);
+
     case HF2_CMD_DMESG:
 #if DEVICE_DMESG_BUFFER_SIZE > 0
         return sendResponseWithData(codalLogStore.buffer, codalLogStore.ptr);
@@ -346,6 +482,13 @@ int HF2::endpointRequest() {
         }
         return sendResponse(0);
 
+    case HF2_CMD_SCREEN_CONFIG:
+        screenLogger = this;
+        screenFps = cmd->data32[0];
+        screenKeyframe = true;
+        pxt::logScreenFrame = screenLog;
+        return sendResponse(0);
+
     case HF2_CMD_JDS_SEND:
         if (pxt::sendJDFrame) {
             pxt::sendJDFrame(cmd->data8);
@@ -364,8 +507,10 @@ int HF2::endpointRequest() {
     return sendResponse(0);
 }
 
-HF2::HF2(HF2_Buffer &p) : gotSomePacket(false), ctrlWaiting(false), pkt(p), useHID(false) {
+HF2::HF2(HF2_Buffer &p)
+    : gotSomePacket(false), ctrlWaiting(false), streaming(false), pkt(p), useHID(false) {
     lastExchange = 0;
+    droppedEvents = 0;
 }
 
 static const InterfaceInfo dummyIfaceInfo = {
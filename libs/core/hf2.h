@@ -9,6 +9,12 @@
 // 260 bytes needed for biggest JD packets (with overheads)
 #define HF2_BUF_SIZE 260
 
+// On the bulk interface, responses and events go out this many 64 byte packets to an endpoint
+// write, with interrupts only off during the write
+#ifndef HF2_STREAM_PACKETS
+#define HF2_STREAM_PACKETS 4
+#endif
+
 typedef struct {
     uint16_t size;
     uint8_t serial;
@@ -24,12 +30,15 @@ typedef struct {
 class HF2 : public CodalUSBInterface {
     bool gotSomePacket;
     bool ctrlWaiting;
+    volatile bool streaming;
     uint32_t lastExchange;
 
   public:
     HF2_Buffer &pkt;
 
     bool useHID;
+    // events not sent because an interrupt tried to while a response or event was streamed
+    uint32_t droppedEvents;
 
     int sendResponse(int size);
     int recv();
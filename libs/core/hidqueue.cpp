@@ -0,0 +1,51 @@
+#include "pxt.h"
+#include "hidqueue.h"
+
+namespace pxt {
+
+void HIDQueue::sendLoop(void *arg) {
+    auto q = (HIDQueue *)arg;
+    while (true) {
+        if (!q->len) {
+            q->waiting = true;
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, q->notifyId);
+            continue;
+        }
+        HIDChange change = q->changes[q->head];
+        q->head = (q->head + 1) % PXT_HID_QUEUE_SIZE;
+        if (q->len-- == PXT_HID_QUEUE_SIZE)
+            Event(DEVICE_ID_NOTIFY, q->spaceId);
+        q->send(change);
+        if (change.text)
+            unregisterGCObj(change.text);
+    }
+}
+
+void HIDQueue::push(int kind, int arg, int a, int b, String text) {
+    if (!notifyId) {
+        notifyId = allocateNotifyEvent();
+        spaceId = allocateNotifyEvent();
+        create_fiber(sendLoop, this);
+    }
+
+    HIDChange change;
+    change.kind = kind;
+    change.arg = arg;
+    change.a = a;
+    change.b = b;
+    change.text = text;
+    if (len && !text && merge(changes[(head + len - 1) % PXT_HID_QUEUE_SIZE], change))
+        return;
+
+    while (len == PXT_HID_QUEUE_SIZE)
+        fiber_wait_for_event(DEVICE_ID_NOTIFY, spaceId);
+    if (text)
+        registerGCObj(text);
+    changes[(head + len++) % PXT_HID_QUEUE_SIZE] = change;
+    if (waiting) {
+        waiting = false;
+        Event(DEVICE_ID_NOTIFY, notifyId);
+    }
+}
+
+} // namespace pxt
@@ -0,0 +1,44 @@
+#ifndef __PXT_HIDQUEUE_H
+#define __PXT_HIDQUEUE_H
+
+#include "pxt.h"
+
+#ifndef PXT_HID_QUEUE_SIZE
+#define PXT_HID_QUEUE_SIZE 32 // callers wait when this many changes are queued
+#endif
+
+namespace pxt {
+
+// A change to a HID device, eg. a key going down or the mouse moving; what kind and arg mean is
+// up to the device.
+struct HIDChange {
+    uint8_t kind, arg;
+    int16_t a, b;
+    String text; // kept alive while queued
+};
+
+// The changes to a HID device, sent to the host one after the other by a fiber of their own, so
+// that callers queue them and go on instead of waiting for a report each. While a report goes
+// out, merge() can fold a change into the last one queued, eg. the moves of a stick or of the
+// mouse, so that they end up in the next report together.
+class HIDQueue {
+    uint16_t notifyId, spaceId;
+    bool waiting; // for notifyId
+    uint8_t head, len;
+    HIDChange changes[PXT_HID_QUEUE_SIZE];
+
+    static void sendLoop(void *arg);
+
+  protected:
+    // fold change into last, which is still queued; false if they are sent apart
+    virtual bool merge(HIDChange &last, const HIDChange &change) { return false; }
+    virtual void send(const HIDChange &change) = 0;
+
+  public:
+    HIDQueue() : notifyId(0), spaceId(0), waiting(false), head(0), len(0) {}
+    void push(int kind, int arg, int a = 0, int b = 0, String text = NULL);
+};
+
+} // namespace pxt
+
+#endif
@@ -5,6 +5,10 @@
 
 #ifdef CODAL_I2C
 
+// flags of an operation in I2C.transaction()
+#define I2C_OP_READ 0x01
+#define I2C_OP_REPEAT 0x02 // no stop after it, so the next one starts with a repeated start
+
 namespace pins {
 
 class CodalI2CProxy {
@@ -48,6 +52,48 @@ public:
   {
     return this->i2c.write(address << 1, buf->data, buf->length, repeat);
   }
+
+  static int opLength(const uint8_t *op) { return op[2] | (op[3] << 8); }
+
+  // ops is a list of: flags (I2C_OP_*), 7-bit address, 16-bit length, and for writes, the bytes.
+  // Returns what was read, all together, or NULL if any of them fails.
+  Buffer transaction(Buffer ops)
+  {
+    int readSize = 0;
+    for (int p = 0; p + 4 <= ops->length;) {
+      int len = opLength(ops->data + p);
+      p += 4;
+      if (ops->data[p - 4] & I2C_OP_READ)
+        readSize += len;
+      else
+        p += len;
+    }
+
+    Buffer res = mkBuffer(NULL, readSize);
+    registerGCObj(res);
+    int pos = 0;
+    int status = ErrorCode::DEVICE_OK;
+    for (int p = 0; p + 4 <= ops->length && status == ErrorCode::DEVICE_OK;) {
+      int flags = ops->data[p];
+      int address = ops->data[p + 1];
+      int len = opLength(ops->data + p);
+      bool repeat = (flags & I2C_OP_REPEAT) != 0;
+      p += 4;
+      if (flags & I2C_OP_READ) {
+        status = this->i2c.read(address << 1, res->data + pos, len, repeat);
+        pos += len;
+      } else {
+        if (p + len > ops->length)
+          break;
+        status = this->i2c.write(address << 1, ops->data + p, len, repeat);
+        p += len;
+      }
+    }
+    unregisterGCObj(res);
+    if (status != ErrorCode::DEVICE_OK)
+      res = 0;
+    return res;
+  }
 };
 
 }
@@ -71,6 +117,16 @@ int writeBuffer(I2C_ i2c, int address, Buffer buf, bool repeat = false)
   return i2c->writeBuffer(address, buf, repeat);
 }
 
+/**
+  * Run a list of reads and writes, packed by pins.I2CTransaction, one after the other.
+  * Returns the bytes read, or null if any of them fails.
+  */
+//%
+Buffer transaction(I2C_ i2c, Buffer ops)
+{
+  return i2c->transaction(ops);
+}
+
 }
 
 namespace pins {
@@ -90,6 +90,47 @@ namespace pins {
         return _i2c;        
     }
 
+    /**
+     * A list of reads and writes, run by the driver one after the other in one call, like a
+     * register write followed by a burst read.
+     */
+    export class I2CTransaction {
+        private ops: Buffer[] = [];
+
+        /**
+         * Write bytes to a 7-bit address; with repeat, the next one starts without a stop
+         */
+        write(address: number, data: Buffer, repeat = false): I2CTransaction {
+            this.ops.push(this.op(repeat ? 2 : 0, address, data.length).concat(data));
+            return this;
+        }
+
+        /**
+         * Read size bytes from a 7-bit address; with repeat, the next one starts without a stop
+         */
+        read(address: number, size: number, repeat = false): I2CTransaction {
+            this.ops.push(this.op(repeat ? 3 : 1, address, size));
+            return this;
+        }
+
+        /**
+         * Run all of them on the bus, or the default one. Returns the bytes read, all together,
+         * or null if any of them fails.
+         */
+        run(bus?: I2C): Buffer {
+            return (bus || i2c()).transaction(Buffer.concat(this.ops));
+        }
+
+        // flags, address and a 16-bit length, as in I2CMethods::transaction()
+        private op(flags: number, address: number, length: number) {
+            const op = control.createBuffer(4);
+            op[0] = flags;
+            op[1] = address;
+            op.setNumber(NumberFormat.UInt16LE, 2, length);
+            return op;
+        }
+    }
+
     export class I2CDevice {
         public address: number;
         public bus: I2C;
@@ -1,4 +1,5 @@
 #include "light.h"
+#include "port.h"
 
 // WS2812B timings, datasheet v1
 // 0 - 0.25-0.55us hi 0.70-1.00us low
@@ -49,53 +50,92 @@ bool isValidMOSIPin(DigitalInOutPin pin) {
 }
 
 // SPI
-void spiNeopixelSendBuffer(DevicePin *pin, const uint8_t *data, unsigned size) {
-    int32_t iptr = 0, optr = 120;
-    uint32_t len = optr + size * BIT_EXPANSION + 120;
-    uint8_t *expBuf = new uint8_t[len];
-    memset(expBuf, 0, len);
-    uint8_t imask = 0x80;
-    uint8_t omask = 0x80;
-
-#define WR(k)                                                                                      \
-    if (k)                                                                                         \
-        expBuf[optr] |= omask;                                                                     \
-    omask >>= 1;                                                                                   \
-    if (!omask) {                                                                                  \
-        omask = 0x80;                                                                              \
-        optr++;                                                                                    \
-    }
+// The bits of a nibble, expanded, and how many there are; filled on the first send. With
+// BIT_EXPANSION 5, a 0 only takes 4 bits, which is in the timings too.
+static uint32_t nibbleExpansion[16];
+static uint8_t nibbleBits[16];
+
+// A frame is expanded into one buffer while the one before is sent from the other, by DMA
+// where the SPI has it. They only grow, so that animations don't allocate on every frame.
+static uint8_t *expBufs[2];
+static uint32_t expBufSizes[2];
+static int currExpBuf;
+static volatile bool spiSending;
+static int spiDoneEvent;
 
-    while (iptr < (int)size) {
+static void spiNeopixelDone(void *) {
+    spiSending = false;
+    Event(DEVICE_ID_NOTIFY, spiDoneEvent);
+}
+
+static void initNibbleExpansion() {
+    for (int n = 0; n < 16; ++n) {
+        uint32_t v = 0;
+        int bits = 0;
+        for (uint8_t m = 0x8; m; m >>= 1) {
 #if BIT_EXPANSION == 3
-        WR(1);
-        WR(data[iptr] & imask);
-        WR(0);
+            v = (v << 3) | (n & m ? 0b110 : 0b100);
+            bits += 3;
 #elif BIT_EXPANSION == 5
-        WR(1);
-        if (data[iptr] & imask) {
-            WR(1);
-            WR(1);
-        } else {
-            WR(0);
-        }
-        WR(0);
-        WR(0);
+            if (n & m) {
+                v = (v << 5) | 0b11100;
+                bits += 5;
+            } else {
+                v = (v << 4) | 0b1000;
+                bits += 4;
+            }
 #else
 #error "invalid BIT_EXPANSION"
 #endif
+        }
+        nibbleExpansion[n] = v;
+        nibbleBits[n] = bits;
+    }
+}
 
-        imask >>= 1;
-        if (!imask) {
-            imask = 0x80;
-            iptr++;
+void spiNeopixelSendBuffer(DevicePin *pin, const uint8_t *data, unsigned size) {
+    uint32_t len = 120 + size * BIT_EXPANSION + 120;
+
+    if (!spiDoneEvent) {
+        spiDoneEvent = allocateNotifyEvent();
+        initNibbleExpansion();
+    }
+
+    // not the one being sent
+    int idx = currExpBuf ^ 1;
+    if (expBufSizes[idx] < len) {
+        delete[] expBufs[idx];
+        expBufs[idx] = new uint8_t[len];
+        expBufSizes[idx] = len;
+    }
+    uint8_t *expBuf = expBufs[idx];
+
+    memset(expBuf, 0, 120);
+    uint8_t *dst = expBuf + 120;
+    // bits not written yet are the low nbits of acc
+    uint32_t acc = 0;
+    int nbits = 0;
+    for (unsigned i = 0; i < 2 * size; ++i) {
+        uint8_t n = i & 1 ? data[i >> 1] & 0xf : data[i >> 1] >> 4;
+        acc = (acc << nibbleBits[n]) | nibbleExpansion[n];
+        nbits += nibbleBits[n];
+        while (nbits >= 8) {
+            nbits -= 8;
+            *dst++ = acc >> nbits;
         }
     }
+    if (nbits)
+        *dst++ = acc << (8 - nbits);
+    memset(dst, 0, expBuf + len - dst);
+
+    while (spiSending)
+        fiber_wait_for_event(DEVICE_ID_NOTIFY, spiDoneEvent);
 
     auto spi = pxt::getSPI(pin, NULL, NULL);
     spi->setFrequency(SPI_FREQ);
-    spi->transfer(expBuf, len, NULL, 0);
-    delete expBuf;
+    currExpBuf = idx;
+    spiSending = true;
+    spi->startTransfer(expBuf, len, NULL, 0, spiNeopixelDone, NULL);
 }
 
 void neopixelSendData(DevicePin *pin, int mode, const uint8_t *data, unsigned length) {
@@ -173,6 +213,147 @@ void dotStarSendData(DevicePin *data, DevicePin *clk, int mode, const uint8_t *b
         bitBangDotStarSendData(data, clk, mode, buf, length);
 }
 
+// Output registers of the GPIO port of a pin, for writing many pins of the port at once
+struct PortOut {
+    volatile uint32_t *set, *clr;
+    uint8_t clrShift; // STM32 clears with the upper half of BSRR
+    uint8_t port;
+    uint32_t mask;
+};
+
+#define PARALLEL_SUPPORTED PXT_PORTS_SUPPORTED
+#if PARALLEL_SUPPORTED
+static void getPortOut(DevicePin *pin, PortOut &p) {
+    int name = pin->name;
+    p.port = name / PXT_PORT_PINS;
+    p.mask = 1 << (name % PXT_PORT_PINS);
+    GPIOPort g;
+    getGPIOPort(p.port, g);
+    p.set = g.set;
+    p.clr = g.clr;
+    p.clrShift = g.clrShift;
+}
+#endif
+
+#if PARALLEL_SUPPORTED
+#define PARALLEL_MAX_STRIPS 8
+
+static inline void portWrite(PortOut &p, uint32_t setMask, uint32_t clrMask) {
+    *p.set = setMask;
+    *p.clr = clrMask << p.clrShift;
+}
+
+static inline void clockPulse(PortOut &clk) {
+    portWrite(clk, clk.mask, 0);
+    portWrite(clk, 0, clk.mask);
+}
+
+// Clocks out up to 8 DotStar strips at once, one bit of each per port write. The data pins have
+// to be on the same port; the clock is shared. Shorter buffers are padded with 0xff, which the
+// strips take as part of the end frame.
+static void parallelDotStarSendData(DevicePin **data, const uint8_t **bufs, const unsigned *lens,
+                                    int n, DevicePin *clk) {
+    PortOut dp, cp;
+    getPortOut(clk, cp);
+    clk->setDigitalValue(0);
+
+    // the port mask for each nibble of a bit slice; bit k is strip k
+    uint32_t masks[PARALLEL_MAX_STRIPS], loMask[16], hiMask[16];
+    uint32_t all = 0;
+    unsigned maxLen = 0;
+    for (int k = 0; k < n; ++k) {
+        data[k]->setDigitalValue(0);
+        getPortOut(data[k], dp);
+        masks[k] = dp.mask;
+        all |= dp.mask;
+        if (lens[k] > maxLen)
+            maxLen = lens[k];
+    }
+    for (int v = 0; v < 16; ++v) {
+        loMask[v] = hiMask[v] = 0;
+        for (int k = 0; k < 4; ++k)
+            if (v & (1 << k)) {
+                if (k < n)
+                    loMask[v] |= masks[k];
+                if (k + 4 < n)
+                    hiMask[v] |= masks[k + 4];
+            }
+    }
+
+    // start frame
+    portWrite(dp, 0, all);
+    for (int i = 0; i < 32; ++i)
+        clockPulse(cp);
+
+    for (unsigned i = 0; i < maxLen; ++i) {
+        // transpose: slice[j] has bit j, from the top, of every strip
+        uint8_t slice[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (int k = 0; k < n; ++k) {
+            uint8_t x = i < lens[k] ? bufs[k][i] : 0xff;
+            for (int j = 0; j < 8; ++j)
+                slice[j] |= ((x >> (7 - j)) & 1) << k;
+        }
+        for (int j = 0; j < 8; ++j) {
+            uint32_t on = loMask[slice[j] & 0xf] | hiMask[slice[j] >> 4];
+            portWrite(dp, on, all & ~on);
+            clockPulse(cp);
+        }
+    }
+
+    // end frame, as long as the longest strip needs
+    portWrite(dp, all, 0);
+    unsigned endBits = maxLen / 8 > 32 ? maxLen / 8 : 32;
+    for (unsigned i = 0; i < endBits; ++i)
+        clockPulse(cp);
+}
+#endif
+
+/**
+ * Send light buffers to several strips in one go. DotStar strips sharing the clock, with their
+ * data pins on the same port, are clocked out together; anything else is sent one strip after
+ * another.
+ * @param data the pins that the lights are connected to
+ * @param clk the clock line shared by the strips, if any
+ * @param mode the color encoding mode
+ * @param bufs the buffers to send, one for each pin
+ */
+//%
+void sendBuffers(RefCollection *data, DigitalInOutPin clk, int mode, RefCollection *bufs) {
+    if (!data || !bufs)
+        return;
+    int n = min(data->length(), bufs->length());
+
+#if PARALLEL_SUPPORTED
+    if (mode == LIGHTMODE_DOTSTAR && clk && n > 1 && n <= PARALLEL_MAX_STRIPS) {
+        DevicePin *pins[PARALLEL_MAX_STRIPS];
+        const uint8_t *ptrs[PARALLEL_MAX_STRIPS];
+        unsigned lens[PARALLEL_MAX_STRIPS];
+        PortOut first, p;
+        bool samePort = true;
+        for (int k = 0; k < n; ++k) {
+            pins[k] = (DevicePin *)data->getAt(k);
+            auto b = (Buffer)bufs->getAt(k);
+            if (!pins[k] || !b) {
+                samePort = false;
+                break;
+            }
+            ptrs[k] = b->data;
+            lens[k] = b->length;
+            getPortOut(pins[k], k ? p : first);
+            if (k && p.port != first.port)
+                samePort = false;
+        }
+        if (samePort) {
+            parallelDotStarSendData(pins, ptrs, lens, n, clk);
+            return;
+        }
+    }
+#endif
+
+    for (int k = 0; k < n; ++k)
+        sendBuffer((DevicePin *)data->getAt(k), clk, mode, (Buffer)bufs->getAt(k));
+}
+
 void sendBuffer(DevicePin *data, DevicePin *clk, int mode, Buffer buf) {
     if (!data || !buf || !buf->length)
         return;
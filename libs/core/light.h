@@ -20,6 +20,8 @@ namespace light {
     void sendBuffer(DigitalInOutPin data, DigitalInOutPin clk, int mode, Buffer buf);
 
     void neopixelSendData(DevicePin* pin, int mode, const uint8_t* data, unsigned length);
+    void dotStarSendData(DevicePin *data, DevicePin *clk, int mode, const uint8_t *buf,
+                         unsigned length);
 }
 
 #endif
\ No newline at end of file
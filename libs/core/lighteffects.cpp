@@ -0,0 +1,269 @@
+#include "light.h"
+
+// Effects rendered on a strip by a fiber, frame after frame, without running the program
+
+#define LIGHTMODE_RGBW 2
+#define LIGHTMODE_RGB_RGB 3
+#define LIGHTMODE_DOTSTAR 4
+
+// LightEffect in light/neopixel.ts
+#define EFFECT_COLOR_WIPE 0
+#define EFFECT_RAINBOW 1
+#define EFFECT_COMET 2
+#define EFFECT_SPARKLE 3
+#define EFFECT_GRADIENT 4
+
+#define EFFECT_FLAG_GAMMA 1
+
+namespace light {
+
+// as packed by NeoPixelStrip.startEffect()
+struct EffectConfig {
+    uint8_t effect;
+    uint8_t mode;
+    uint8_t brightness;
+    uint8_t flags;
+    uint16_t start;    // first pixel of the strip buffer to render at
+    uint16_t length;   // pixels to render
+    uint16_t interval; // ms between frames
+    uint16_t reserved;
+    uint32_t color, color2; // 0xRRGGBB
+};
+
+struct Effect {
+    Effect *next;
+    DevicePin *data, *clk;
+    Buffer pixels; // of the strip, which the effect renders into
+    uint8_t *out;  // pixels, with brightness and gamma
+    EffectConfig cfg;
+    int stride;
+    bool stopped; // freed by effectLoop(), which might be sending it
+    uint32_t frame, nextFrame;
+    uint8_t levels[256];
+};
+
+static Effect *effects;
+static bool effectLoopRunning;
+
+// color.hsv() at full saturation and value, for each hue; filled when a rainbow first starts
+static uint8_t *hueTable;
+
+static void initHueTable() {
+    hueTable = (uint8_t *)xmalloc(256 * 3);
+    for (int hue = 0; hue < 256; ++hue) {
+        // FastLED's hsv2rgb rainbow, as in color.hsv()
+        int h = (hue % 255) * 192 / 255;
+        int section = h / 0x40;
+        int up = (h % 0x40) * 4, down = (0x3f - h % 0x40) * 4;
+        uint8_t *p = hueTable + hue * 3;
+        p[0] = section == 0 ? down : section == 1 ? 0 : up;
+        p[1] = section == 0 ? up : section == 1 ? down : 0;
+        p[2] = section == 0 ? 0 : section == 1 ? up : down;
+    }
+}
+
+static uint8_t *pixelAt(Effect *e, int i) {
+    return e->pixels->data + (e->cfg.start + i) * e->stride;
+}
+
+// same byte order as NeoPixelStrip.setBufferRGB()
+static void setRGB(Effect *e, int i, int r, int g, int b) {
+    uint8_t *p = pixelAt(e, i);
+    switch (e->cfg.mode) {
+    case LIGHTMODE_RGB_RGB:
+        p[0] = r;
+        p[1] = g;
+        p[2] = b;
+        break;
+    case LIGHTMODE_DOTSTAR:
+        p[0] = 0xe0 | 0x1f;
+        p[1] = b;
+        p[2] = g;
+        p[3] = r;
+        break;
+    default:
+        p[0] = g;
+        p[1] = r;
+        p[2] = b;
+        break;
+    }
+}
+
+// color scaled by level/256
+static void setColor(Effect *e, int i, uint32_t color, int level) {
+    setRGB(e, i, ((color >> 16) & 0xff) * level >> 8, ((color >> 8) & 0xff) * level >> 8,
+           (color & 0xff) * level >> 8);
+}
+
+static void renderFrame(Effect *e) {
+    int n = e->cfg.length;
+    uint32_t f = e->frame;
+
+    switch (e->cfg.effect) {
+    case EFFECT_COLOR_WIPE: {
+        // on one at a time, then off one at a time
+        int p = f % (2 * n);
+        for (int i = 0; i < n; ++i)
+            setColor(e, i, e->cfg.color, (p < n ? i <= p : i > p - n) ? 256 : 0);
+        break;
+    }
+    case EFFECT_RAINBOW: {
+        if (!hueTable)
+            initHueTable();
+        int step = (128 + n - 1) / n;
+        for (int i = 0; i < n; ++i) {
+            const uint8_t *c = hueTable + ((i * 256 / n + f * step) & 0xff) * 3;
+            setRGB(e, i, c[0], c[1], c[2]);
+        }
+        break;
+    }
+    case EFFECT_COMET: {
+        int head = f % n;
+        int tail = n / 4 < 2 ? 2 : n / 4;
+        for (int i = 0; i < n; ++i) {
+            int d = head - i;
+            if (d < 0)
+                d += n;
+            setColor(e, i, e->cfg.color, d < tail ? 256 * (tail - d) / tail : 0);
+        }
+        break;
+    }
+    case EFFECT_SPARKLE: {
+        // fade what is there, and light up one at random
+        int first = e->cfg.mode == LIGHTMODE_DOTSTAR ? 1 : 0;
+        for (int i = 0; i < n; ++i) {
+            uint8_t *p = pixelAt(e, i);
+            for (int j = first; j < e->stride; ++j)
+                p[j] = p[j] * 3 / 4;
+        }
+        setColor(e, getRandom(n - 1), e->cfg.color, 256);
+        break;
+    }
+    case EFFECT_GRADIENT: {
+        // from color to color2 and back, moving along the strip
+        for (int i = 0; i < n; ++i) {
+            int t = ((i + f) % n) * 512 / n;
+            if (t > 256)
+                t = 512 - t;
+            uint32_t a = e->cfg.color, b = e->cfg.color2;
+            int r = (((a >> 16) & 0xff) * (256 - t) + ((b >> 16) & 0xff) * t) >> 8;
+            int g = (((a >> 8) & 0xff) * (256 - t) + ((b >> 8) & 0xff) * t) >> 8;
+            int bl = ((a & 0xff) * (256 - t) + (b & 0xff) * t) >> 8;
+            setRGB(e, i, r, g, bl);
+        }
+        break;
+    }
+    }
+}
+
+static void sendFrame(Effect *e) {
+    int len = e->pixels->length;
+    const uint8_t *src = e->pixels->data;
+    for (int i = 0; i < len; ++i)
+        e->out[i] = e->levels[src[i]];
+    // the APA102 brightness bytes go out as they are, as in NeoPixelStrip.show()
+    if (e->cfg.mode == LIGHTMODE_DOTSTAR) {
+        for (int i = 0; i < len; i += 4)
+            e->out[i] = 0xff;
+        dotStarSendData(e->data, e->clk, e->cfg.mode, e->out, len);
+    } else {
+        neopixelSendData(e->data, e->cfg.mode, e->out, len);
+    }
+}
+
+static void freeEffect(Effect *e) {
+    unregisterGCObj(e->pixels);
+    xfree(e->out);
+    delete e;
+}
+
+static void effectLoop(void *) {
+    while (effects) {
+        for (Effect **pp = &effects; *pp;) {
+            auto e = *pp;
+            if (e->stopped) {
+                *pp = e->next;
+                freeEffect(e);
+            } else {
+                pp = &e->next;
+            }
+        }
+
+        int wait = 100;
+        for (auto e = effects; e; e = e->next) {
+            if (e->stopped)
+                continue;
+            int left = e->nextFrame - current_time_ms();
+            if (left <= 0) {
+                e->nextFrame = current_time_ms() + e->cfg.interval;
+                renderFrame(e);
+                e->frame++;
+                // may wait for the frame before, during which effects can be stopped, but not
+                // freed
+                sendFrame(e);
+                left = e->cfg.interval;
+            }
+            if (left < wait)
+                wait = left;
+        }
+        fiber_sleep(wait < 1 ? 1 : wait);
+    }
+    effectLoopRunning = false;
+}
+
+/**
+ * Stop the effect running on the lights connected to the pin, if any
+ */
+//%
+void stopEffect(DigitalInOutPin data) {
+    for (auto e = effects; e; e = e->next)
+        if (e->data == data)
+            e->stopped = true;
+}
+
+/**
+ * Render an effect into the pixel buffer of a strip and send it, every few milliseconds, until
+ * stopEffect() is called. The config is packed by NeoPixelStrip.startEffect().
+ */
+//%
+void startEffect(DigitalInOutPin data, DigitalInOutPin clk, Buffer pixels, Buffer config) {
+    stopEffect(data);
+    if (!data || !pixels || !pixels->length || !config ||
+        config->length < (int)sizeof(EffectConfig))
+        return;
+
+    auto e = new Effect();
+    memset(e, 0, sizeof(*e));
+    memcpy(&e->cfg, config->data, sizeof(EffectConfig));
+    e->stride = e->cfg.mode == LIGHTMODE_DOTSTAR || e->cfg.mode == LIGHTMODE_RGBW ? 4 : 3;
+    int maxLength = pixels->length / e->stride - e->cfg.start;
+    if (e->cfg.length > maxLength)
+        e->cfg.length = maxLength < 0 ? 0 : maxLength;
+    if (!e->cfg.length) {
+        delete e;
+        return;
+    }
+    if (e->cfg.interval < 1)
+        e->cfg.interval = 1;
+
+    e->data = data;
+    e->clk = clk;
+    e->pixels = pixels;
+    registerGCObj(pixels);
+    e->out = (uint8_t *)xmalloc(pixels->length);
+    // brightness and gamma (2, close enough to the eye) in one go
+    for (int v = 0; v < 256; ++v) {
+        int g = e->cfg.flags & EFFECT_FLAG_GAMMA ? v * v / 255 : v;
+        e->levels[v] = (g * e->cfg.brightness) >> 8;
+    }
+    e->nextFrame = current_time_ms();
+
+    e->next = effects;
+    effects = e;
+    if (!effectLoopRunning) {
+        effectLoopRunning = true;
+        create_fiber(effectLoop, NULL);
+    }
+}
+
+} // namespace light
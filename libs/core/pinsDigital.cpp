@@ -1,4 +1,5 @@
 #include "pxt.h"
+#include "port.h"
 
 enum class PulseValue {
     //% block=high
@@ -97,6 +98,48 @@ void onEvent(DigitalInOutPin pin, PinEvent event, Action body) {
     }    
 }
 
+// A pin measured by pulseIn(); kept for good, as there are only a few pins, so that its notify
+// event isn't allocated again on every call.
+struct PulseWait {
+    PulseWait *next;
+    DevicePin *pin;
+    int notifyId;
+    int value; // the pulse event waited for, or 0 when the pin is free
+    uint64_t since;
+    volatile int duration;
+};
+static PulseWait *pulseWaits;
+
+// called by the message bus from the pin interrupt, which measured the pulse; the event
+// timestamp is the duration of the pulse
+static void pulseEnded(Event e, void *arg) {
+    auto w = (PulseWait *)arg;
+    if (w->value != e.value || w->duration >= 0)
+        return;
+    // a pulse that started before pulseIn() was called is only partly there
+    if (system_timer_current_time_us() - e.timestamp < w->since)
+        return;
+    w->duration = (int)e.timestamp;
+    Event(DEVICE_ID_NOTIFY, w->notifyId);
+}
+
+static PulseWait *getPulseWait(DevicePin *pin) {
+    for (auto w = pulseWaits; w; w = w->next)
+        if (w->pin == pin)
+            return w;
+    auto w = new PulseWait();
+    w->pin = pin;
+    w->notifyId = allocateNotifyEvent();
+    w->value = 0;
+    w->next = pulseWaits;
+    pulseWaits = w;
+    devMessageBus.listen(pin->id, DEVICE_PIN_EVT_PULSE_HI, pulseEnded, w,
+                         MESSAGE_BUS_LISTENER_IMMEDIATE);
+    devMessageBus.listen(pin->id, DEVICE_PIN_EVT_PULSE_LO, pulseEnded, w,
+                         MESSAGE_BUS_LISTENER_IMMEDIATE);
+    return w;
+}
+
 /**
 * Return the duration of a pulse in microseconds
 * @param name the pin which measures the pulse
@@ -111,21 +154,44 @@ void onEvent(DigitalInOutPin pin, PinEvent event, Action body) {
 //% pin.fieldOptions.width=220
 //% pin.fieldOptions.columns=4
 int pulseIn(DigitalInOutPin pin, PulseValue value, int maxDuration = 2000000) {
-    int pulse = PulseValue::High == value ? 1 : 0;
-    uint64_t tick = system_timer_current_time_us();
+    // the pin interrupt times the pulse, and the fiber sleeps until then
+    auto w = getPulseWait(pin);
+    uint64_t start = system_timer_current_time_us();
     uint64_t maxd = (uint64_t)maxDuration;
-    while (pin->getDigitalValue() != pulse) {
-        if (system_timer_current_time_us() - tick > maxd)
+
+    // another fiber is measuring this pin already
+    while (w->value) {
+        if (system_timer_current_time_us() - start > maxd)
             return 0;
+        fiber_wait_for_event(DEVICE_ID_NOTIFY, w->notifyId);
     }
 
-    uint64_t start = system_timer_current_time_us();
-    while (pin->getDigitalValue() == pulse) {
-        if (system_timer_current_time_us() - tick > maxd)
-            return 0;
+    w->since = start;
+    w->duration = -1;
+    w->value = (int)value;
+    pin->eventOn(DEVICE_PIN_EVENT_ON_PULSE);
+
+    int res = 0;
+    for (;;) {
+        if (w->duration >= 0) {
+            res = w->duration;
+            break;
+        }
+        uint64_t elapsed = system_timer_current_time_us() - start;
+        if (elapsed > maxd)
+            break;
+        // the pulse wakes us up; the timer is there for the time out, and in case the pulse
+        // ended just before we waited
+        system_timer_event_after_us(min(maxd - elapsed + 1, (uint64_t)50000), DEVICE_ID_NOTIFY,
+                                    w->notifyId);
+        fiber_wait_for_event(DEVICE_ID_NOTIFY, w->notifyId);
+        system_timer_cancel_event(DEVICE_ID_NOTIFY, w->notifyId);
     }
-    uint64_t end = system_timer_current_time_us();
-    return end - start;
+
+    w->value = 0;
+    // wake up any fiber waiting for the pin
+    Event(DEVICE_ID_NOTIFY, w->notifyId);
+    return res;
 }
 
 /**
@@ -148,6 +214,65 @@ void setPull(DigitalInOutPin name, PinPullMode pull) {
 
 }
 
+namespace pins {
+/**
+ * Get the GPIO port of a pin, for writePort() and readPort(); -1 if ports can't be used on this
+ * chip.
+ */
+//% help=pins/pin-port advanced=true
+int pinPort(DigitalInOutPin pin) {
+#if PXT_PORTS_SUPPORTED
+    if (pin)
+        return pin->name / PXT_PORT_PINS;
+#endif
+    return -1;
+}
+
+/**
+ * Get the bit of a pin in the mask of its GPIO port, for writePort() and readPort().
+ */
+//% help=pins/pin-port-mask advanced=true
+int pinPortMask(DigitalInOutPin pin) {
+#if PXT_PORTS_SUPPORTED
+    if (pin)
+        return 1 << (pin->name % PXT_PORT_PINS);
+#endif
+    return 0;
+}
+
+/**
+ * Set the pins of a GPIO port in mask to the bits of value, all at once. The pins have to be
+ * outputs already, eg. after digitalWrite().
+ * @param port the port, from pinPort()
+ * @param mask the pins to write, from pinPortMask()
+ * @param value the new levels of the pins
+ */
+//% help=pins/write-port advanced=true
+void writePort(int port, int mask, int value) {
+#if PXT_PORTS_SUPPORTED
+    GPIOPort p;
+    if (getGPIOPort(port, p))
+        gpioPortWrite(p, mask & value, mask & ~value);
+#endif
+}
+
+/**
+ * Read the pins of a GPIO port in mask, all at once. The pins have to be inputs already, eg.
+ * after digitalRead().
+ * @param port the port, from pinPort()
+ * @param mask the pins to read, from pinPortMask()
+ */
+//% help=pins/read-port advanced=true
+int readPort(int port, int mask) {
+#if PXT_PORTS_SUPPORTED
+    GPIOPort p;
+    if (getGPIOPort(port, p))
+        return *p.in & mask;
+#endif
+    return 0;
+}
+}
+
 namespace pxt {
 
 static void waitABit() {
@@ -155,6 +280,28 @@ static void waitABit() {
     //    asm volatile("nop");
 }
 
+#if PXT_PORTS_SUPPORTED
+// A pin as a bit of its GPIO port, when there's one.
+struct PortPin {
+    GPIOPort port;
+    uint32_t mask;
+    bool valid;
+
+    void init(Pin &pin) {
+        mask = 1 << (pin.name % PXT_PORT_PINS);
+        valid = getGPIOPort(pin.name / PXT_PORT_PINS, port);
+    }
+    void set(bool v) { gpioPortWrite(port, v ? mask : 0, v ? 0 : mask); }
+    bool get() { return (*port.in & mask) != 0; }
+};
+
+// the 74HC165 wants pulses of at least 25ns at 3.3V, which back to back port writes at over
+// 80MHz aren't
+static inline void portPulseDelay() {
+    asm volatile("nop\n nop\n nop\n nop");
+}
+#endif
+
 class ButtonMultiplexer : public CodalComponent {
   public:
     Pin &latch;
@@ -164,6 +311,10 @@ class ButtonMultiplexer : public CodalComponent {
     uint32_t invMask;
     uint16_t buttonIdPerBit[8];
     bool enabled;
+#if PXT_PORTS_SUPPORTED
+    // the shift register is read with port registers, on every system tick
+    PortPin latchBit, clockBit, dataBit;
+#endif
 
     ButtonMultiplexer(uint16_t id)
         : latch(*LOOKUP_PIN(BTNMX_LATCH)), clock(*LOOKUP_PIN(BTNMX_CLOCK)),
@@ -180,6 +331,12 @@ class ButtonMultiplexer : public CodalComponent {
         data.getDigitalValue(PullMode::Down);
         latch.setDigitalValue(1);
         clock.setDigitalValue(1);
+
+#if PXT_PORTS_SUPPORTED
+        latchBit.init(latch);
+        clockBit.init(clock);
+        dataBit.init(data);
+#endif
     }
 
     void disable() {
@@ -197,7 +354,34 @@ class ButtonMultiplexer : public CodalComponent {
         return false;
     }
 
+#if PXT_PORTS_SUPPORTED
+    uint32_t readBitsFromPorts(int bits) {
+        latchBit.set(0);
+        portPulseDelay();
+        latchBit.set(1);
+        portPulseDelay();
+
+        uint32_t state = 0;
+        for (int i = 0; i < bits; i++) {
+            state <<= 1;
+            if (dataBit.get())
+                state |= 1;
+
+            clockBit.set(0);
+            portPulseDelay();
+            clockBit.set(1);
+            portPulseDelay();
+        }
+
+        return state;
+    }
+#endif
+
     uint32_t readBits(int bits) {
+#if PXT_PORTS_SUPPORTED
+        if (latchBit.valid && clockBit.valid && dataBit.valid)
+            return readBitsFromPorts(bits);
+#endif
         latch.setDigitalValue(0);
         waitABit();
         latch.setDigitalValue(1);
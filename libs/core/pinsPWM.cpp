@@ -67,4 +67,165 @@ void servoSetContinuous(PwmOnlyPin name, bool continuous) {
     // used by simulator
 }
 
-}
\ No newline at end of file
+}
+// The servo sequencer moves many servos along keyframes from a native fiber, so that animations
+// don't take a call per servo per frame from the program.
+#define SERVO_SEQ_CHANNELS 32
+#define SERVO_SEQ_PERIOD_MS 20
+
+namespace pins {
+
+struct ServoSequencer {
+    DevicePin *pins[SERVO_SEQ_CHANNELS];
+    // the pulse each servo was set to last, and where the current keyframe moves it from
+    uint16_t pulse[SERVO_SEQ_CHANNELS];
+    uint16_t from[SERVO_SEQ_CHANNELS];
+    Buffer frames;
+    int channels;
+    int frame;
+    bool loop;
+    bool waiting;
+    int notifyId;
+    uint32_t frameStart;
+};
+static ServoSequencer *servoSeq;
+
+static ServoSequencer *getServoSequencer() {
+    if (!servoSeq)
+        servoSeq = new ServoSequencer();
+    return servoSeq;
+}
+
+static void servoSeqStop(ServoSequencer *s) {
+    if (s->frames) {
+        unregisterGCObj(s->frames);
+        s->frames = NULL;
+    }
+}
+
+static int servoSeqFrameSize(ServoSequencer *s) {
+    return 2 * (s->channels + 1);
+}
+
+static int servoSeqGet(ServoSequencer *s, int frame, int idx) {
+    auto p = s->frames->data + frame * servoSeqFrameSize(s) + 2 * idx;
+    return p[0] | (p[1] << 8);
+}
+
+static void servoSeqStartFrame(ServoSequencer *s, int frame) {
+    s->frame = frame;
+    s->frameStart = current_time_ms();
+    memcpy(s->from, s->pulse, sizeof(s->from));
+}
+
+// move the servos to where they are at now in the current keyframe; false when done
+static bool servoSeqStep(ServoSequencer *s) {
+    int numFrames = s->frames->length / servoSeqFrameSize(s);
+    // keyframes that take no time are all passed in one step, but only once around the loop
+    for (int n = 0; n <= numFrames; ++n) {
+        if (s->frame >= numFrames) {
+            if (!s->loop || !numFrames)
+                return false;
+            servoSeqStartFrame(s, 0);
+        }
+        int duration = servoSeqGet(s, s->frame, 0);
+        int t = current_time_ms() - s->frameStart;
+        bool last = t >= duration;
+        for (int i = 0; i < s->channels; ++i) {
+            int to = servoSeqGet(s, s->frame, i + 1);
+            // 0 leaves the servo where it is
+            if (!to || !s->pins[i])
+                continue;
+            int from = s->from[i] ? s->from[i] : to;
+            int p = last ? to : from + (to - from) * t / duration;
+            if (p != s->pulse[i]) {
+                s->pulse[i] = p;
+                s->pins[i]->setServoPulseUs(p);
+            }
+        }
+        if (!last)
+            return true;
+        // the next keyframe starts where this one was meant to end
+        int frameStart = s->frameStart + duration;
+        servoSeqStartFrame(s, s->frame + 1);
+        s->frameStart = frameStart;
+    }
+    return true;
+}
+
+static void servoSeqLoop(void *arg) {
+    auto s = (ServoSequencer *)arg;
+    while (true) {
+        if (!s->frames) {
+            s->waiting = true;
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, s->notifyId);
+            continue;
+        }
+        if (!servoSeqStep(s))
+            servoSeqStop(s);
+        else
+            fiber_sleep(SERVO_SEQ_PERIOD_MS);
+    }
+}
+
+/**
+ * Drive a servo from a channel of the servo sequencer.
+ * @param channel the channel, from 0 to 31
+ * @param pin the servo pin, or null to take the channel off its pin
+ */
+//% help=pins/servo-sequencer-attach advanced=true group="Servo"
+void servoSequencerAttach(int channel, PwmOnlyPin pin) {
+    if (channel < 0 || channel >= SERVO_SEQ_CHANNELS)
+        return;
+    auto s = getServoSequencer();
+    s->pins[channel] = pin;
+    s->pulse[channel] = 0;
+}
+
+/**
+ * Move the servos of the sequencer through keyframes. Each keyframe is 1 + channels UInt16LE
+ * values: the time to get there from the previous keyframe, in ms, and then the pulse of each
+ * channel in us, or 0 to leave the channel alone. The servos move in a straight line between
+ * keyframes, and are updated every 20ms.
+ * @param frames the keyframes
+ * @param channels the number of channels in each keyframe
+ * @param loop start over after the last keyframe
+ */
+//% help=pins/servo-sequencer-play advanced=true group="Servo"
+void servoSequencerPlay(Buffer frames, int channels, bool loop) {
+    auto s = getServoSequencer();
+    servoSeqStop(s);
+    if (!frames || channels <= 0 || channels > SERVO_SEQ_CHANNELS)
+        return;
+    registerGCObj(frames);
+    s->frames = frames;
+    s->channels = channels;
+    s->loop = loop;
+    servoSeqStartFrame(s, 0);
+    if (!s->notifyId) {
+        s->notifyId = allocateNotifyEvent();
+        create_fiber(servoSeqLoop, s);
+    } else if (s->waiting) {
+        s->waiting = false;
+        Event(DEVICE_ID_NOTIFY, s->notifyId);
+    }
+}
+
+/**
+ * Stop the servo sequencer; the servos stay where they are.
+ */
+//% help=pins/servo-sequencer-stop advanced=true group="Servo"
+void servoSequencerStop() {
+    if (servoSeq)
+        servoSeqStop(servoSeq);
+}
+
+/**
+ * Check if the servo sequencer is still moving the servos.
+ */
+//% help=pins/servo-sequencer-running advanced=true group="Servo"
+bool servoSequencerRunning() {
+    return servoSeq && servoSeq->frames != NULL;
+}
+
+} // namespace pins
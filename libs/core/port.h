@@ -0,0 +1,77 @@
+#ifndef __PXT_PORT_H
+#define __PXT_PORT_H
+
+#include "pxt.h"
+
+namespace pxt {
+
+// The registers of a GPIO port, to read or write many of its pins at once; pin name n is bit
+// n % PXT_PORT_PINS of port n / PXT_PORT_PINS.
+struct GPIOPort {
+    volatile uint32_t *set, *clr, *in;
+    uint8_t clrShift; // STM32 clears with the upper half of BSRR
+};
+
+#if defined(SAMD21) || defined(SAMD51)
+#define PXT_PORTS_SUPPORTED 1
+#define PXT_PORT_PINS 32
+static inline bool getGPIOPort(int port, GPIOPort &p) {
+    if (port < 0 || port >= PORT_GROUPS)
+        return false;
+    p.set = &PORT->Group[port].OUTSET.reg;
+    p.clr = &PORT->Group[port].OUTCLR.reg;
+    p.in = &PORT->Group[port].IN.reg;
+    p.clrShift = 0;
+    return true;
+}
+#elif defined(NRF52_SERIES)
+#define PXT_PORTS_SUPPORTED 1
+#define PXT_PORT_PINS 32
+static inline bool getGPIOPort(int port, GPIOPort &p) {
+#ifdef NRF_P1
+    if (port < 0 || port > 1)
+        return false;
+    auto gpio = port ? NRF_P1 : NRF_P0;
+#else
+    if (port != 0)
+        return false;
+    auto gpio = NRF_P0;
+#endif
+    p.set = &gpio->OUTSET;
+    p.clr = &gpio->OUTCLR;
+    p.in = &gpio->IN;
+    p.clrShift = 0;
+    return true;
+}
+#elif defined(STM32F4)
+#define PXT_PORTS_SUPPORTED 1
+#define PXT_PORT_PINS 16
+static inline bool getGPIOPort(int port, GPIOPort &p) {
+    if (port < 0 || port > 7)
+        return false;
+#ifndef GPIOF
+    // eg. the F401 has no F and G
+    if (port == 5 || port == 6)
+        return false;
+#endif
+    auto gpio = (GPIO_TypeDef *)(GPIOA_BASE + port * (GPIOB_BASE - GPIOA_BASE));
+    p.set = &gpio->BSRR;
+    p.clr = &gpio->BSRR;
+    p.in = &gpio->IDR;
+    p.clrShift = 16;
+    return true;
+}
+#else
+#define PXT_PORTS_SUPPORTED 0
+#endif
+
+#if PXT_PORTS_SUPPORTED
+static inline void gpioPortWrite(const GPIOPort &p, uint32_t setMask, uint32_t clrMask) {
+    *p.set = setMask;
+    *p.clr = clrMask << p.clrShift;
+}
+#endif
+
+} // namespace pxt
+
+#endif
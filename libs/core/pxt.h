@@ -68,6 +68,8 @@ extern codal::CodalDevice device;
 void set_usb_strings(const char *uf2_info);
 extern void (*logJDFrame)(const uint8_t *data);
 extern void (*sendJDFrame)(const uint8_t *data);
+// set while a host is watching the screen; called with the pixels of the frames shown
+extern void (*logScreenFrame)(const uint8_t *pix, int width, int height, int len);
 
 
 } // namespace pxt
@@ -87,6 +89,7 @@ codal::LowLevelTimer *allocateTimer();
 CODAL_I2C* getI2C(DigitalInOutPin sda, DigitalInOutPin scl);
 #endif
 CODAL_SPI* getSPI(DigitalInOutPin mosi, DigitalInOutPin miso, DigitalInOutPin sck);
+CODAL_SPI* getSPI(SPI_ spi);
 #ifdef CODAL_JACDAC_WIRE_SERIAL
 LowLevelTimer* getJACDACTimer();
 #endif
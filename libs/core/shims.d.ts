@@ -10,6 +10,31 @@ declare namespace light {
      */
     //% shim=light::sendBuffer
     function sendBuffer(data: DigitalInOutPin, clk: DigitalInOutPin, mode: int32, buf: Buffer): void;
+
+    /**
+     * Send light buffers to several strips in one go. DotStar strips sharing the clock, with their
+     * data pins on the same port, are clocked out together; anything else is sent one strip after
+     * another.
+     * @param data the pins that the lights are connected to
+     * @param clk the clock line shared by the strips, if any
+     * @param mode the color encoding mode
+     * @param bufs the buffers to send, one for each pin
+     */
+    //% shim=light::sendBuffers
+    function sendBuffers(data: DigitalInOutPin[], clk: DigitalInOutPin, mode: int32, bufs: Buffer[]): void;
+
+    /**
+     * Stop the effect running on the lights connected to the pin, if any
+     */
+    //% shim=light::stopEffect
+    function stopEffect(data: DigitalInOutPin): void;
+
+    /**
+     * Render an effect into the pixel buffer of a strip and send it, every few milliseconds, until
+     * stopEffect() is called. The config is packed by NeoPixelStrip.startEffect().
+     */
+    //% shim=light::startEffect
+    function startEffect(data: DigitalInOutPin, clk: DigitalInOutPin, pixels: Buffer, config: Buffer): void;
 }
 declare namespace control {
 
@@ -155,6 +180,40 @@ declare interface DigitalInOutPin {
     //% name.fieldOptions.columns=4 shim=DigitalInOutPinMethods::setPull
     setPull(pull: PinPullMode): void;
 }
+declare namespace pins {
+
+    /**
+     * Get the GPIO port of a pin, for writePort() and readPort(); -1 if ports can't be used on this
+     * chip.
+     */
+    //% help=pins/pin-port advanced=true shim=pins::pinPort
+    function pinPort(pin: DigitalInOutPin): int32;
+
+    /**
+     * Get the bit of a pin in the mask of its GPIO port, for writePort() and readPort().
+     */
+    //% help=pins/pin-port-mask advanced=true shim=pins::pinPortMask
+    function pinPortMask(pin: DigitalInOutPin): int32;
+
+    /**
+     * Set the pins of a GPIO port in mask to the bits of value, all at once. The pins have to be
+     * outputs already, eg. after digitalWrite().
+     * @param port the port, from pinPort()
+     * @param mask the pins to write, from pinPortMask()
+     * @param value the new levels of the pins
+     */
+    //% help=pins/write-port advanced=true shim=pins::writePort
+    function writePort(port: int32, mask: int32, value: int32): void;
+
+    /**
+     * Read the pins of a GPIO port in mask, all at once. The pins have to be inputs already, eg.
+     * after digitalRead().
+     * @param port the port, from pinPort()
+     * @param mask the pins to read, from pinPortMask()
+     */
+    //% help=pins/read-port advanced=true shim=pins::readPort
+    function readPort(port: int32, mask: int32): int32;
+}
 
 
 declare interface PwmPin {}
@@ -215,6 +274,40 @@ declare interface PwmOnlyPin {
     //% blockHidden=1 shim=PwmOnlyPinMethods::servoSetContinuous
     servoSetContinuous(continuous: boolean): void;
 }
+declare namespace pins {
+
+    /**
+     * Drive a servo from a channel of the servo sequencer.
+     * @param channel the channel, from 0 to 31
+     * @param pin the servo pin, or null to take the channel off its pin
+     */
+    //% help=pins/servo-sequencer-attach advanced=true group="Servo" shim=pins::servoSequencerAttach
+    function servoSequencerAttach(channel: int32, pin: PwmOnlyPin): void;
+
+    /**
+     * Move the servos of the sequencer through keyframes. Each keyframe is 1 + channels UInt16LE
+     * values: the time to get there from the previous keyframe, in ms, and then the pulse of each
+     * channel in us, or 0 to leave the channel alone. The servos move in a straight line between
+     * keyframes, and are updated every 20ms.
+     * @param frames the keyframes
+     * @param channels the number of channels in each keyframe
+     * @param loop start over after the last keyframe
+     */
+    //% help=pins/servo-sequencer-play advanced=true group="Servo" shim=pins::servoSequencerPlay
+    function servoSequencerPlay(frames: Buffer, channels: int32, loop: boolean): void;
+
+    /**
+     * Stop the servo sequencer; the servos stay where they are.
+     */
+    //% help=pins/servo-sequencer-stop advanced=true group="Servo" shim=pins::servoSequencerStop
+    function servoSequencerStop(): void;
+
+    /**
+     * Check if the servo sequencer is still moving the servos.
+     */
+    //% help=pins/servo-sequencer-running advanced=true group="Servo" shim=pins::servoSequencerRunning
+    function servoSequencerRunning(): boolean;
+}
 declare namespace control {
 
     /**
@@ -262,6 +355,13 @@ declare interface I2C {
      */
     //% repeat.defl=0 shim=I2CMethods::writeBuffer
     writeBuffer(address: int32, buf: Buffer, repeat?: boolean): int32;
+
+    /**
+     * Run a list of reads and writes, packed by pins.I2CTransaction, one after the other.
+     * Returns the bytes read, or null if any of them fails.
+     */
+    //% shim=I2CMethods::transaction
+    transaction(ops: Buffer): Buffer;
 }
 declare namespace pins {
 
@@ -302,6 +402,19 @@ declare interface SPI {
     //% argsNullable shim=SPIMethods::transfer
     transfer(command: Buffer, response: Buffer): void;
 
+    /**
+     * Start transferring buffers over the SPI bus, once the transfers started before are done; the
+     * buffers must not be changed until then, see waitTransfers()
+     */
+    //% argsNullable shim=SPIMethods::startTransfer
+    startTransfer(command: Buffer, response: Buffer): void;
+
+    /**
+     * Wait for the transfers started on the SPI bus to be done
+     */
+    //% shim=SPIMethods::waitTransfers
+    waitTransfers(): void;
+
     /**
      * Sets the SPI clock frequency
      */
@@ -70,6 +70,135 @@ namespace pxsim.light {
 
         runtime.queueDisplayUpdate();
     }
+
+    export function sendBuffers(data: RefCollection, clk: { id: number }, mode: number, bufs: RefCollection) {
+        const pins = data.toArray() as { id: number }[];
+        const buffers = bufs.toArray() as RefBuffer[];
+        for (let i = 0; i < Math.min(pins.length, buffers.length); ++i)
+            if (pins[i] && buffers[i])
+                sendBuffer(pins[i], clk, mode, buffers[i]);
+    }
+
+    // same as lighteffects.cpp
+    interface Effect {
+        timer: any;
+        frame: number;
+        out: RefBuffer;
+    }
+    const effects: pxsim.Map<Effect> = {};
+
+    function hue(h: number): number[] {
+        h = ((h % 255) * 192 / 255) | 0;
+        const section = (h / 0x40) | 0;
+        const up = (h % 0x40) * 4, down = (0x3f - h % 0x40) * 4;
+        return section == 0 ? [down, up, 0] : section == 1 ? [0, down, up] : [up, 0, down];
+    }
+
+    function renderEffect(px: Uint8Array, cfg: DataView, frame: number) {
+        const effect = cfg.getUint8(0), mode = cfg.getUint8(1);
+        const stride = mode == NeoPixelMode.RGBW || mode == NeoPixelMode.DotStar ? 4 : 3;
+        const start = cfg.getUint16(4, true);
+        const n = Math.min(cfg.getUint16(6, true), (px.length / stride | 0) - start);
+        const color = cfg.getUint32(12, true), color2 = cfg.getUint32(16, true);
+        if (n <= 0) return;
+
+        const setRGB = (i: number, r: number, g: number, b: number) => {
+            const o = (start + i) * stride;
+            if (mode == NeoPixelMode.RGB_RGB) {
+                px[o] = r; px[o + 1] = g; px[o + 2] = b;
+            } else if (mode == NeoPixelMode.DotStar) {
+                px[o] = 0xff; px[o + 1] = b; px[o + 2] = g; px[o + 3] = r;
+            } else {
+                px[o] = g; px[o + 1] = r; px[o + 2] = b;
+            }
+        };
+        const setColor = (i: number, c: number, level: number) =>
+            setRGB(i, ((c >> 16) & 0xff) * level >> 8, ((c >> 8) & 0xff) * level >> 8, (c & 0xff) * level >> 8);
+
+        switch (effect) {
+            case 0: {
+                const p = frame % (2 * n);
+                for (let i = 0; i < n; ++i)
+                    setColor(i, color, (p < n ? i <= p : i > p - n) ? 256 : 0);
+                break;
+            }
+            case 1: {
+                const step = Math.ceil(128 / n);
+                for (let i = 0; i < n; ++i) {
+                    const c = hue(((i * 256 / n | 0) + frame * step) & 0xff);
+                    setRGB(i, c[0], c[1], c[2]);
+                }
+                break;
+            }
+            case 2: {
+                const head = frame % n, tail = Math.max(2, n >> 2);
+                for (let i = 0; i < n; ++i) {
+                    let d = head - i;
+                    if (d < 0) d += n;
+                    setColor(i, color, d < tail ? (256 * (tail - d) / tail | 0) : 0);
+                }
+                break;
+            }
+            case 3: {
+                const first = mode == NeoPixelMode.DotStar ? 1 : 0;
+                for (let i = 0; i < n; ++i)
+                    for (let j = first; j < stride; ++j)
+                        px[(start + i) * stride + j] = px[(start + i) * stride + j] * 3 >> 2;
+                setColor(Math.floor(Math.random() * n), color, 256);
+                break;
+            }
+            case 4: {
+                for (let i = 0; i < n; ++i) {
+                    let t = (((i + frame) % n) * 512 / n) | 0;
+                    if (t > 256) t = 512 - t;
+                    const mix = (sh: number) => ((((color >> sh) & 0xff) * (256 - t) + ((color2 >> sh) & 0xff) * t) >> 8);
+                    setRGB(i, mix(16), mix(8), mix(0));
+                }
+                break;
+            }
+        }
+    }
+
+    export function stopEffect(data: { id: number }) {
+        const e = data && effects[data.id];
+        if (e) {
+            clearInterval(e.timer);
+            delete effects[data.id];
+        }
+    }
+
+    export function startEffect(data: { id: number }, clk: { id: number }, pixels: RefBuffer, config: RefBuffer) {
+        stopEffect(data);
+        if (!data || !pixels || !pixels.data.length || !config || config.data.length < 20)
+            return;
+        const cfg = new DataView(config.data.buffer, config.data.byteOffset, 20);
+        const mode = cfg.getUint8(1), brightness = cfg.getUint8(2), gamma = cfg.getUint8(3) & 1;
+        const levels: number[] = [];
+        for (let v = 0; v < 256; ++v)
+            levels[v] = ((gamma ? (v * v / 255 | 0) : v) * brightness) >> 8;
+        const r = runtime;
+        const e: Effect = {
+            timer: undefined,
+            frame: 0,
+            out: pxsim.BufferMethods.createBuffer(pixels.data.length)
+        };
+        const tick = () => {
+            if (r != runtime || r.dead) {
+                stopEffect(data);
+                return;
+            }
+            renderEffect(pixels.data, cfg, e.frame++);
+            for (let i = 0; i < pixels.data.length; ++i)
+                e.out.data[i] = levels[pixels.data[i]];
+            if (mode == NeoPixelMode.DotStar)
+                for (let i = 0; i < pixels.data.length; i += 4)
+                    e.out.data[i] = 0xff;
+            sendBuffer(data, clk, mode, e.out);
+        };
+        e.timer = setInterval(tick, Math.max(1, cfg.getUint16(8, true)));
+        effects[data.id] = e;
+        tick();
+    }
 }
 
 namespace pxsim.visuals {
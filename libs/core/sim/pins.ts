@@ -131,6 +131,86 @@ namespace pxsim.PwmOnlyPinMethods {
 }
 
 namespace pxsim.pins {
+    // see the servo sequencer in pinsPWM.cpp
+    const SERVO_SEQ_CHANNELS = 32, SERVO_SEQ_PERIOD_MS = 20
+
+    let servoPins: Pin[] = []
+    let servoPulses: number[] = []
+    let servoFrames: RefBuffer
+    let servoTimer: any
+
+    export function servoSequencerAttach(channel: number, pin: Pin) {
+        if (channel < 0 || channel >= SERVO_SEQ_CHANNELS)
+            return
+        servoPins[channel] = pin
+        servoPulses[channel] = 0
+    }
+
+    export function servoSequencerPlay(frames: RefBuffer, channels: number, loop: boolean) {
+        servoSequencerStop()
+        if (!frames || channels <= 0 || channels > SERVO_SEQ_CHANNELS)
+            return
+        const data = frames.data
+        const frameSize = 2 * (channels + 1)
+        const numFrames = (data.length / frameSize) | 0
+        const get = (f: number, i: number) => data[f * frameSize + 2 * i] | (data[f * frameSize + 2 * i + 1] << 8)
+        let frame = 0
+        let frameStart = Date.now()
+        let from = servoPulses.slice()
+        servoFrames = frames
+        const step = () => {
+            for (let n = 0; n <= numFrames; ++n) {
+                if (frame >= numFrames) {
+                    if (!loop || !numFrames)
+                        return false
+                    frame = 0
+                    frameStart = Date.now()
+                    from = servoPulses.slice()
+                }
+                const duration = get(frame, 0)
+                const t = Date.now() - frameStart
+                const last = t >= duration
+                for (let i = 0; i < channels; ++i) {
+                    const to = get(frame, i + 1)
+                    if (!to || !servoPins[i])
+                        continue
+                    const f = from[i] || to
+                    const p = last ? to : Math.round(f + (to - f) * t / duration)
+                    if (p != servoPulses[i]) {
+                        servoPulses[i] = p
+                        PwmOnlyPinMethods.servoSetPulse(servoPins[i], p)
+                    }
+                }
+                if (!last)
+                    return true
+                frame++
+                frameStart += duration
+                from = servoPulses.slice()
+            }
+            return true
+        }
+        const tick = () => {
+            if (servoFrames !== frames)
+                return
+            if (step())
+                servoTimer = setTimeout(tick, SERVO_SEQ_PERIOD_MS)
+            else
+                servoSequencerStop()
+        }
+        tick()
+    }
+
+    export function servoSequencerStop() {
+        if (servoTimer)
+            clearTimeout(servoTimer)
+        servoTimer = undefined
+        servoFrames = undefined
+    }
+
+    export function servoSequencerRunning() {
+        return !!servoFrames
+    }
+
     export function pinByCfg(key: number): Pin {
         const pin = pxsim.pxtcore.getPinCfg(key);
         markUsed(pin);
@@ -146,6 +226,22 @@ namespace pxsim.pins {
         return pxsim.BufferMethods.createBuffer(sz)
     }
 
+    // there are no GPIO ports in the simulator
+    export function pinPort(pin: DigitalInOutPin) {
+        return -1;
+    }
+
+    export function pinPortMask(pin: DigitalInOutPin) {
+        return 0;
+    }
+
+    export function writePort(port: number, mask: number, value: number) {
+    }
+
+    export function readPort(port: number, mask: number) {
+        return 0;
+    }
+
     export function createI2C(sda: DigitalInOutPin, scl: DigitalInOutPin) {
         const b = board() as EdgeConnectorBoard;
         markUsed(sda);
@@ -170,6 +266,20 @@ namespace pxsim.I2CMethods {
     export function writeBuffer(i2c: I2C, address: number, buf: RefBuffer, repeat?: boolean): number {
         return 0;
     }
+
+    export function transaction(i2c: I2C, ops: RefBuffer): RefBuffer {
+        // nothing answers in the simulator; zeros for what is read
+        let size = 0;
+        for (let p = 0; p + 4 <= ops.data.length;) {
+            const len = ops.data[p + 2] | (ops.data[p + 3] << 8);
+            p += 4;
+            if (ops.data[p - 4] & 1)
+                size += len;
+            else
+                p += len;
+        }
+        return control.createBuffer(size);
+    }
 }
 
 namespace pxsim.SPIMethods {
@@ -182,6 +292,13 @@ namespace pxsim.SPIMethods {
         device.transfer(command, response);
     }
 
+    export function startTransfer(device: pxsim.SPI, command: RefBuffer, response: RefBuffer) {
+        device.transfer(command, response);
+    }
+
+    export function waitTransfers(device: pxsim.SPI) {
+    }
+
     export function setFrequency(device: pxsim.SPI, frequency: number) {
         device.setFrequency(frequency);
     }
@@ -6,6 +6,9 @@ namespace pxsim.SerialDeviceMethods {
     export function setRxBufferSize(device: SerialDevice, size: number) {
         device.setRxBufferSize(size);
     }
+    export function rxOverruns(device: SerialDevice): number {
+        return 0;
+    }
 
     export function read(device: SerialDevice): number {
         return device.read();
@@ -1,14 +1,68 @@
 #include "pxt.h"
 #include "ErrorNo.h"
 
+// transfers started on a bus and not done yet, at most
+#define SPI_QUEUE_SIZE 4
+// smaller ones are done right away, when nothing is queued; starting DMA and switching fibers
+// takes longer than they do
+#define SPI_ASYNC_MIN_BYTES 32
+
 namespace pins {
 
+struct SPITransfer {
+    Buffer command, response;
+};
+
+static uint8_t *bufData(Buffer b) {
+    return b ? b->data : NULL;
+}
+
+static int bufLength(Buffer b) {
+    return b ? b->length : 0;
+}
+
 class CodalSPIProxy {
 private:
     DevicePin* mosi; 
     DevicePin* miso; 
     DevicePin* sck;
     CODAL_SPI spi;
+    // the last ones set, or -1 when the SPI may have been set up by someone else
+    int frequency, mode;
+
+    // Transfers are queued by fibers, and started one after the other by transferDone(),
+    // in the interrupt of the one before. The counters only grow; queue[finished % SIZE] is being
+    // sent when finished != queued, and the buffers of those before released stay registered
+    // with the GC, as they can't be unregistered in the interrupt.
+    SPITransfer queue[SPI_QUEUE_SIZE];
+    uint32_t queued, released;
+    volatile uint32_t finished;
+    int doneEvent;
+
+    void startNext() {
+        auto t = &queue[finished % SPI_QUEUE_SIZE];
+        spi.startTransfer(bufData(t->command), bufLength(t->command), bufData(t->response),
+                          bufLength(t->response), transferDone, this);
+    }
+
+    static void transferDone(void *p) {
+        auto self = (CodalSPIProxy *)p;
+        if (++self->finished != self->queued)
+            self->startNext();
+        Event(DEVICE_ID_NOTIFY, self->doneEvent);
+    }
+
+    void release() {
+        while (released != finished) {
+            auto t = &queue[released++ % SPI_QUEUE_SIZE];
+            if (t->command)
+                unregisterGCObj(t->command);
+            if (t->response)
+                unregisterGCObj(t->response);
+            t->command = t->response = NULL;
+        }
+    }
+
 public:
     CodalSPIProxy* next;
 
@@ -18,6 +72,12 @@ public:
         , miso(_miso)
         , sck(_sck)
         , spi(*_mosi, *_miso, *_sck) 
+        , frequency(-1)
+        , mode(-1)
+        , queued(0)
+        , released(0)
+        , finished(0)
+        , doneEvent(0)
         , next(NULL)
     {
     }
@@ -28,12 +88,21 @@ public:
         , miso(_miso)
         , sck(_sck)
         , spi(*_mosi, *_miso, *_sck, _cs) 
+        , frequency(-1)
+        , mode(-1)
+        , queued(0)
+        , released(0)
+        , finished(0)
+        , doneEvent(0)
         , next(NULL)
     {
     }
 #endif
 
+    // for drivers using the SPI directly, which may also set it up
     CODAL_SPI* getSPI() {
+        waitTransfers();
+        frequency = mode = -1;
         return &spi;
     }
 
@@ -42,23 +111,65 @@ public:
     }
 
     int write(int value) {
+        waitTransfers();
         return spi.write(value);
     }
 
+    // queue the transfer, waiting only when the queue is full
+    void startTransfer(Buffer command, Buffer response) {
+        if (!doneEvent)
+            doneEvent = allocateNotifyEvent();
+        release();
+        while (queued - released == SPI_QUEUE_SIZE) {
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, doneEvent);
+            release();
+        }
+        if (command)
+            registerGCObj(command);
+        if (response)
+            registerGCObj(response);
+        auto t = &queue[queued % SPI_QUEUE_SIZE];
+        t->command = command;
+        t->response = response;
+        target_disable_irq();
+        bool idle = finished == queued;
+        queued++;
+        target_enable_irq();
+        if (idle)
+            startNext();
+    }
+
+    // other fibers run in the meantime
+    void waitTransfers() {
+        while (finished != queued)
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, doneEvent);
+        release();
+    }
+
     void transfer(Buffer command, Buffer response) {
-        auto cdata = NULL == command ? NULL : command->data;
-        auto clength = NULL == command ? 0 : command->length;
-        auto rdata = NULL == response ? NULL : response->data;
-        auto rlength = NULL == response ? 0 : response->length;
-        spi.transfer(cdata, clength, rdata, rlength);
+        if (finished == queued && bufLength(command) + bufLength(response) < SPI_ASYNC_MIN_BYTES) {
+            spi.transfer(bufData(command), bufLength(command), bufData(response),
+                         bufLength(response));
+            return;
+        }
+        startTransfer(command, response);
+        waitTransfers();
     }
 
     void setFrequency(int frequency) {
+        if (frequency == this->frequency)
+            return;
+        waitTransfers();
         spi.setFrequency(frequency);
+        this->frequency = frequency;
     }
 
     void setMode(int mode) {
+        if (mode == this->mode)
+            return;
+        waitTransfers();
         spi.setMode(mode);
+        this->mode = mode;
     }
 };
 
@@ -117,6 +228,10 @@ CODAL_SPI* getSPI(DigitalInOutPin mosiPin, DigitalInOutPin misoPin, DigitalInOut
     return spi->getSPI();
 }
 
+CODAL_SPI* getSPI(SPI_ spi) {
+    return spi->getSPI();
+}
+
 }
 
 namespace SPIMethods {
@@ -141,6 +256,27 @@ void transfer(SPI_ device, Buffer command, Buffer response) {
     device->transfer(command, response);
 }
 
+/**
+* Start transferring buffers over the SPI bus, once the transfers started before are done; the
+* buffers must not be changed until then, see waitTransfers()
+*/
+//% argsNullable
+void startTransfer(SPI_ device, Buffer command, Buffer response) {
+    if (!device)
+        target_panic(PANIC_CAST_FROM_NULL);
+    if (!command && !response)
+        return;
+    device->startTransfer(command, response);
+}
+
+/**
+* Wait for the transfers started on the SPI bus to be done
+*/
+//%
+void waitTransfers(SPI_ device) {
+    device->waitTransfers();
+}
+
 /**
 * Sets the SPI clock frequency
 */
@@ -33,7 +33,12 @@ struct HF2_WRITE_FLASH_PAGE_Command {
 };
 // no result
 
+// CRC16-CCITT (starting at 0) of each page; in user space, where BININFO reports no pages,
+// they are HF2_CHKSUM_PAGE_SIZE bytes, the payload of a UF2 block
 #define HF2_CMD_CHKSUM_PAGES 0x0007
+#ifndef HF2_CHKSUM_PAGE_SIZE
+#define HF2_CHKSUM_PAGE_SIZE 256
+#endif
 struct HF2_CHKSUM_PAGES_Command {
     uint32_t target_addr;
     uint32_t num_pages;
@@ -69,6 +74,19 @@ struct HF2_WRITE_WORDS_Command {
 #define HF2_CMD_JDS_SEND 0x0021
 #define HF2_EV_JDS_PACKET 0x800020
 
+// data32[0] is the most frames a second to send as HF2_EV_SCREEN_FRAME, or 0 to stop; the next
+// frame sent has all of the pixels
+#define HF2_CMD_SCREEN_CONFIG 0x0022
+#define HF2_EV_SCREEN_FRAME 0x800022
+// the pixels are those of the Image, a column after another, each of byteHeight bytes (two
+// pixels a byte); runs are a uint16_t count of bytes that didn't change since the frame sent
+// before, a uint16_t count of bytes that did, and those bytes
+struct HF2_SCREEN_FRAME_Event {
+    uint16_t width;
+    uint16_t height;
+    uint8_t runs[0];
+};
+
 typedef struct {
     uint32_t command_id;
     uint16_t tag;
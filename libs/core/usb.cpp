@@ -160,5 +160,6 @@ void dumpDmesg() {
 
 void (*logJDFrame)(const uint8_t *data);
 void (*sendJDFrame)(const uint8_t *data);
+void (*logScreenFrame)(const uint8_t *pix, int width, int height, int len);
 
 } // namespace pxt
@@ -37,7 +37,41 @@ namespace datalogger {
          * Flushes any buffered data
          */
         flush(): void { 
-
+            storage.flush();
+        }
+    }
+}
+namespace datalogger {
+    /**
+     * A storage that keeps the log in a compact binary file, with each value rounded to a number
+     * of decimals. The USB drive shows it as CSV text, next to it with the extension changed to .csv.
+     */
+    export class BinaryFileStorage extends Storage {
+        filename: string;
+        decimals: number;
+        constructor(filename: string, decimals = 3) {
+            super()
+            this.filename = filename;
+            this.decimals = decimals;
+        }
+        /**
+         * Appends the headers in datalog
+         */
+        appendHeaders(headers: string[]): void {
+            // does nothing if the file already exists
+            storage.binLogStart(this.filename, headers.join("\n"), datalogger.SEPARATOR.charCodeAt(0), this.decimals);
+        }
+        /**
+         * Appends a row of data
+         */
+        appendRow(values: number[]): void {
+            storage.binLogRow(this.filename, values);
+        }
+        /**
+         * Flushes any buffered data
+         */
+        flush(): void {
+            storage.flush();
         }
     }
-}
\ No newline at end of file
+}
@@ -10,6 +10,12 @@
 #define SYNC_TIMEOUT 100
 #define QUICK_TIMEOUT 500
 
+// UF2 payloads are collected into blocks this big for ESP_FLASH_DATA, as in esptool
+#define FLASH_BLOCK_SIZE 1024
+
+// tried from the first, until the ESP answers at one
+static const uint32_t baudRates[] = {2000000, 1000000, 500000};
+
 namespace esp32spi {
 
 class WFlasher {
@@ -39,6 +45,8 @@ typedef struct RegionDescriptor {
 
 static uint32_t currUF2Block, flashSeq;
 static RegionDescriptor currRegion;
+static uint8_t *flashBuf; // FLASH_BLOCK_SIZE
+static uint32_t flashBufPos, regionWritten;
 
 typedef struct ESP_UF2_Block {
     uint32_t magicStart0;
@@ -314,6 +322,8 @@ static CmdHeader *sendRecvAndCheck(EspCommand cmd, const void *data, uint16_t da
                                    int timeout = QUICK_TIMEOUT) {
     sendEspCmd(cmd, data, dataSize);
     CmdHeader *res = readResponse(cmd, timeout);
+    if (!res)
+        return NULL;
     if (res->data[res->size - 4] != 0) {
         DMESG("command failed: %d, status=%x", cmd, res->data[res->size - 3]);
         return NULL;
@@ -426,10 +436,10 @@ static int matchesMD5(RegionDescriptor *desc) {
 
 static int flashBegin(uint32_t addr, uint32_t size) {
     uint32_t args[] = {
-        size,               // erase size
-        (size + 255) / 256, // num blocks
-        256,                // block size
-        addr,               // offset
+        size,                                             // erase size
+        (size + FLASH_BLOCK_SIZE - 1) / FLASH_BLOCK_SIZE, // num blocks
+        FLASH_BLOCK_SIZE,                                 // block size
+        addr,                                             // offset
     };
 
     // assume 6ms per page erase time
@@ -448,9 +458,23 @@ static int flashData(const void *data, int size, int seq) {
     uint8_t *d = (uint8_t *)malloc(sizeof(params) + size);
     memcpy(d, params, sizeof(params));
     memcpy(d + sizeof(params), data, size);
-    auto r = sendRecvAndCheck(ESP_FLASH_DATA, d, sizeof(params) + size, 1000);
+    // checked by the loader, over the data only
+    uint8_t checksum = 0xEF;
+    for (int i = 0; i < size; ++i)
+        checksum ^= ((const uint8_t *)data)[i];
+    sendEspCmd(ESP_FLASH_DATA, d, sizeof(params) + size, checksum);
     free(d);
-    return r ? 0 : -1;
+    auto r = readResponse(ESP_FLASH_DATA, 1000);
+    return r && r->data[r->size - 4] == 0 ? 0 : -1;
+}
+
+// sends what is in flashBuf, padded to a whole block
+static int flushFlashBuf() {
+    if (!flashBufPos)
+        return 0;
+    memset(flashBuf + flashBufPos, 0xff, FLASH_BLOCK_SIZE - flashBufPos);
+    flashBufPos = 0;
+    return flashData(flashBuf, FLASH_BLOCK_SIZE, flashSeq++);
 }
 
 static void cleanup() {
@@ -458,6 +482,8 @@ static void cleanup() {
     f->ser.abortDMA();
     free(lastResponse);
     lastResponse = NULL;
+    free(flashBuf);
+    flashBuf = NULL;
 }
 static void resetESP() {
     auto boot = LOOKUP_PIN(BOOT);
@@ -468,7 +494,7 @@ static void resetESP() {
     rst->setDigitalValue(1);
 }
 
-static int connectESP() {
+static int resetAndSync() {
     LOG("resetting ESP");
 
     LOOKUP_PIN(TX)->setDigitalValue(1); // without this we get glitch on first character
@@ -491,8 +517,8 @@ static int connectESP() {
 
     for (int i = 0; i < 300; ++i) {
         if (sync()) {
-            break;
             ok = 1;
+            break;
         }
         fiber_sleep(50);
     }
@@ -502,11 +528,27 @@ static int connectESP() {
 
     fiber_sleep(50);
 
-    changeBaud(500000);
+    return 0;
+}
 
-    LOG("synced!");
+static int connectESP() {
+    uint32_t w3 = 0;
+
+    // the loader starts at 115200 after a reset; if a rate doesn't work, go back there and try
+    // the next one
+    for (unsigned i = 0; i < sizeof(baudRates) / sizeof(baudRates[0]); ++i) {
+        getWFlasher()->ser.setBaud(115200);
+        if (resetAndSync() != 0)
+            return -1;
+        changeBaud(baudRates[i]);
+        w3 = readEFuse(3);
+        if (w3 != 0) {
+            LOG("synced at %d baud", baudRates[i]);
+            break;
+        }
+        LOG("no answer at %d baud", baudRates[i]);
+    }
 
-    uint32_t w3 = readEFuse(3);
     if (w3 == 0)
         return -2;
     LOG("chip: %d rev %d %s %d core %d MHz", (w3 >> 9) & 7, (w3 >> 15) & 1, w3 & 2 ? "noBT" : "BT",
@@ -556,6 +598,12 @@ int flashBlock(ESP_UF2_Block *block) {
     currUF2Block++;
 
     if (block->region.addr != currRegion.addr || block->region.size != currRegion.size) {
+        // the region before ended early
+        if (mode == MODE_WRITE && flushFlashBuf() != 0) {
+            LOG("failed to write! seq=%d", flashSeq);
+            mode = MODE_ERROR;
+            return 1;
+        }
         // need to recompute
         currRegion = block->region;
         if (matchesMD5(&currRegion)) {
@@ -569,13 +617,22 @@ int flashBlock(ESP_UF2_Block *block) {
             } else {
                 LOG("writing region at %x/%d", currRegion.addr, currRegion.size);
                 flashSeq = 0;
+                flashBufPos = 0;
+                regionWritten = 0;
+                if (!flashBuf)
+                    flashBuf = (uint8_t *)malloc(FLASH_BLOCK_SIZE);
                 mode = MODE_WRITE;
             }
         }
     }
 
     if (mode == MODE_WRITE) {
-        if (flashData(block->data, 256, flashSeq++) != 0) {
+        memcpy(flashBuf + flashBufPos, block->data, 256);
+        flashBufPos += 256;
+        regionWritten += 256;
+        if ((flashBufPos == FLASH_BLOCK_SIZE || regionWritten >= currRegion.size ||
+             currUF2Block == block->numBlocks) &&
+            flushFlashBuf() != 0) {
             LOG("failed to write! seq=%d", flashSeq);
             mode = MODE_ERROR;
             return 1;
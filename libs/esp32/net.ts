@@ -25,16 +25,19 @@ namespace esp32 {
             const miso = pins.pinByCfg(DAL.CFG_PIN_WIFI_MISO);
             const sck = pins.pinByCfg(DAL.CFG_PIN_WIFI_SCK);
             let spi: SPI;
+            // the ESP32 SPI slave takes up to 10MHz; a shared bus stays at 8MHz for the others
+            let frequency = 8000000;
             if (!mosi && !miso && !sck) {
                 spi = pins.spi();
             } else if (mosi && miso && sck) {
                 spi = pins.createSPI(mosi, miso, sck);
+                frequency = 10000000;
             } else {// SPI misconfigured
                 net.log("esp32 spi configuration error");
                 control.panic(control.PXT_PANIC.CODAL_HARDWARE_CONFIGURATION_ERROR);
             }
             if (spi)
-                return _defaultController = new NinaController(spi, cs, busy, reset, gpio0);
+                return _defaultController = new NinaController(spi, cs, busy, reset, gpio0, frequency);
         } else if (!cs && !busy && !reset) {
             return undefined;
             // do nothing, panic later
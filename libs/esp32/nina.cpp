@@ -0,0 +1,207 @@
+#include "pxt.h"
+
+// The SPI protocol of nina-fw (github.com/adafruit/nina-fw), used by NinaController in
+// ninacontroller.ts. A command is one frame: START_CMD, the command, the number of parameters,
+// each parameter with its 8 or 16 bit length, and END_CMD, padded to 4 bytes. The response is the
+// same with the reply flag set on the command. The ESP32 holds the busy pin high until it is ready
+// for the next frame; we sleep until the falling edge of it. Frames and parameters go out and come
+// in with one SPI transfer each (by DMA, where the SPI driver has it); only the headers are read
+// a byte at a time.
+
+#define LOG DMESG
+
+#define NINA_START_CMD 0xE0
+#define NINA_END_CMD 0xEE
+#define NINA_ERR_CMD 0xEF
+#define NINA_REPLY_FLAG 0x80
+
+// flags for ninaCommand()
+#define NINA_SEND_LEN16 0x01
+#define NINA_RECV_LEN16 0x02
+
+#define NINA_READY_TIMEOUT 10000
+#define NINA_RESPONSE_TIMEOUT 100
+
+namespace esp32spi {
+
+class NinaSPI {
+  public:
+    CODAL_SPI *spi;
+    DevicePin *cs;
+    DevicePin *busy;
+    int readyEvent;
+    int doneEvent;
+    volatile bool transferring;
+
+    NinaSPI(CODAL_SPI *spi, DevicePin *cs, DevicePin *busy) : spi(spi), cs(cs), busy(busy) {
+        readyEvent = allocateNotifyEvent();
+        doneEvent = allocateNotifyEvent();
+        transferring = false;
+        busy->getDigitalValue(PullMode::Down);
+        EventModel::defaultEventBus->listen(busy->id, DEVICE_PIN_EVT_FALL, this,
+                                            &NinaSPI::onReady, MESSAGE_BUS_LISTENER_IMMEDIATE);
+        busy->eventOn(DEVICE_PIN_EVENT_ON_EDGE);
+    }
+
+    void onReady(Event) { Event(DEVICE_ID_NOTIFY, readyEvent); }
+
+    static void transferDone(void *p) {
+        auto n = (NinaSPI *)p;
+        n->transferring = false;
+        Event(DEVICE_ID_NOTIFY, n->doneEvent);
+    }
+
+    bool waitForReady() {
+        auto start = current_time_ms();
+        while (busy->getDigitalValue()) {
+            int left = NINA_READY_TIMEOUT - (current_time_ms() - start);
+            if (left <= 0) {
+                LOG("nina: timed out waiting for ready");
+                return false;
+            }
+            // the edge wakes us up; the timer is there in case it came just before we waited
+            system_timer_event_after(min(left, 50), DEVICE_ID_NOTIFY, readyEvent);
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, readyEvent);
+            system_timer_cancel_event(DEVICE_ID_NOTIFY, readyEvent);
+        }
+        return true;
+    }
+
+    void transfer(const uint8_t *tx, uint32_t txSize, uint8_t *rx, uint32_t rxSize) {
+        transferring = true;
+        spi->startTransfer(tx, txSize, rx, rxSize, &NinaSPI::transferDone, this);
+        while (transferring)
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, doneEvent);
+    }
+
+    int readByte() { return spi->write(0xff); }
+
+    bool expect(int desired) {
+        int r = readByte();
+        if (r != desired) {
+            LOG("nina: expected %d but got %d", desired, r);
+            return false;
+        }
+        return true;
+    }
+
+    bool waitForStart() {
+        auto start = current_time_ms();
+        while (current_time_ms() - start < NINA_RESPONSE_TIMEOUT) {
+            int r = readByte();
+            if (r == NINA_START_CMD)
+                return true;
+            if (r == NINA_ERR_CMD) {
+                LOG("nina: error response to command");
+                return false;
+            }
+        }
+        LOG("nina: timed out waiting for response");
+        return false;
+    }
+
+    bool send(int cmd, RefCollection *params, int flags);
+    RefCollection *receive(int cmd, int numResponses, int flags);
+};
+
+static NinaSPI *nina;
+
+bool NinaSPI::send(int cmd, RefCollection *params, int flags) {
+    unsigned numParams = params ? params->length() : 0;
+    unsigned lenSize = flags & NINA_SEND_LEN16 ? 2 : 1;
+    unsigned size = 3 + 1;
+    for (unsigned i = 0; i < numParams; ++i) {
+        auto p = (Buffer)params->getAt(i);
+        size += lenSize + (p ? p->length : 0);
+    }
+    size = (size + 3) & ~3;
+
+    auto frame = (uint8_t *)app_alloc(size);
+    auto dst = frame;
+    *dst++ = NINA_START_CMD;
+    *dst++ = cmd & ~NINA_REPLY_FLAG;
+    *dst++ = numParams;
+    for (unsigned i = 0; i < numParams; ++i) {
+        auto p = (Buffer)params->getAt(i);
+        unsigned len = p ? p->length : 0;
+        if (lenSize == 2)
+            *dst++ = len >> 8;
+        *dst++ = len;
+        if (len)
+            memcpy(dst, p->data, len);
+        dst += len;
+    }
+    *dst++ = NINA_END_CMD;
+    memset(dst, 0xff, frame + size - dst);
+
+    bool ok = waitForReady();
+    if (ok) {
+        cs->setDigitalValue(0);
+        transfer(frame, size, NULL, 0);
+        cs->setDigitalValue(1);
+    }
+    app_free(frame);
+    return ok;
+}
+
+RefCollection *NinaSPI::receive(int cmd, int numResponses, int flags) {
+    if (!waitForReady())
+        return NULL;
+
+    cs->setDigitalValue(0);
+    RefCollection *res = NULL;
+    bool ok = waitForStart() && expect(cmd | NINA_REPLY_FLAG);
+    if (ok && numResponses < 0)
+        numResponses = readByte();
+    else if (ok)
+        ok = expect(numResponses);
+    if (ok) {
+        res = Array_::mk();
+        registerGCObj(res);
+        for (int i = 0; i < numResponses; ++i) {
+            int len = readByte();
+            if (flags & NINA_RECV_LEN16)
+                len = (len << 8) | readByte();
+            auto buf = mkBuffer(NULL, len);
+            registerGCObj(buf);
+            if (len)
+                transfer(NULL, 0, buf->data, len);
+            Array_::push(res, (TValue)buf);
+            unregisterGCObj(buf);
+        }
+        unregisterGCObj(res);
+        if (!expect(NINA_END_CMD))
+            res = NULL;
+    }
+    cs->setDigitalValue(1);
+    return res;
+}
+
+/**
+ * Set up the SPI engine for nina-fw on the given bus and pins.
+ */
+//%
+void ninaSetup(SPI_ spi, DigitalInOutPin cs, DigitalInOutPin busy, int frequency) {
+    auto codalSPI = pxt::getSPI(spi);
+    codalSPI->setFrequency(frequency);
+    if (nina && nina->spi == codalSPI && nina->cs == cs && nina->busy == busy)
+        return;
+    // there is one ESP32; the old one (if any) keeps its listener, but is not used
+    nina = new NinaSPI(codalSPI, cs, busy);
+}
+
+/**
+ * Send a command, and return the parameters of the response; null when it failed.
+ * @param numResponses the number of parameters expected, or -1 for any
+ * @param flags 1 for 16 bit lengths of the parameters sent, 2 of the ones received
+ */
+//%
+RefCollection *ninaCommand(int cmd, RefCollection *params, int numResponses, int flags) {
+    if (!nina)
+        return NULL;
+    if (!nina->send(cmd, params, flags))
+        return NULL;
+    return nina->receive(cmd, numResponses, flags);
+}
+
+} // namespace esp32spi
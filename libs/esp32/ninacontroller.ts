@@ -83,7 +83,8 @@ namespace esp32 {
             private _cs: DigitalInOutPin,
             private _busy: DigitalInOutPin,
             private _reset: DigitalInOutPin,
-            private _gpio0: DigitalInOutPin = null
+            private _gpio0: DigitalInOutPin = null,
+            spiFrequency = 8000000
         ) {
             super();
             // if nothing connected, pretend the device is ready -
@@ -91,7 +92,7 @@ namespace esp32 {
             this._busy.setPull(PinPullMode.PullDown);
             this._busy.digitalRead();
             this._socknum_ll = [buffer1(0)]
-            this._spi.setFrequency(8000000);
+            ninaSetup(this._spi, this._cs, this._busy, spiFrequency);
             this.reset();
             this._locked = false;
         }
@@ -112,141 +113,10 @@ namespace esp32 {
             if (this._gpio0)
                 this._gpio0.digitalRead();
             // make sure SPI gets initialized while the CS is up
-            this.spiTransfer(control.createBuffer(1), null)
+            this._spi.transfer(control.createBuffer(1), null)
             net.log('reseted esp32')
         }
 
-        private readByte(): number {
-            const r = buffer1(0)
-            this.spiTransfer(null, r)
-            return r[0]
-        }
-
-        private checkData(desired: number, msg?: string): boolean {
-            const r = this.readByte()
-            if (r != desired)
-                net.fail(`Expected ${desired} but got ${r}; ` + (msg || ""))
-            return false;
-        }
-
-        /** Read a byte with a time-out, and if we get it, check that its what we expect */
-        private waitSPIChar(desired: number): boolean {
-            let times = control.millis()
-            while (control.millis() - times < 100) {
-                let r = this.readByte()
-                if (r == _ERR_CMD) {
-                    net.log("error response to command")
-                    return false
-                }
-
-                if (r == desired) {
-                    return true
-                }
-                //net.log(`read char ${r}, expected ${desired}`)
-            }
-            net.log("timed out waiting for SPI char")
-            return false;
-        }
-
-        /**
-         * Wait until the ready pin goes low
-         */
-        private waitForReady() {
-            net.debug(`wait for ready ${this._busy.digitalRead()}`);
-            if (this._busy.digitalRead()) {
-                pauseUntil(() => !this._busy.digitalRead(), 10000);
-                net.debug(`busy = ${this._busy.digitalRead()}`);
-                // pause(1000)
-            }
-            if (this._busy.digitalRead()) {
-                net.log("timed out waiting for ready")
-                return false
-            }
-
-            return true
-        }
-
-        private _sendCommand(cmd: number, params?: Buffer[], param_len_16?: boolean) {
-            params = params || [];
-
-            // compute buffer size
-            let n = 3; // START_CMD, cmd, length
-            params.forEach(param => {
-                n += 1 + (param_len_16 ? 1 : 0) + param.length;
-            })
-            n += 1; // END_CMD
-            // padding
-            while (n % 4) n++;
-
-            const packet = control.createBuffer(n);
-            let k = 0;
-            packet[k++] = _START_CMD;
-            packet[k++] = cmd & ~_REPLY_FLAG;
-            packet[k++] = params.length;
-
-            params.forEach(param => {
-                if (param_len_16)
-                    packet[k++] = (param.length >> 8) & 0xFF;
-                packet[k++] = param.length & 0xFF;
-                packet.write(k, param);
-                k += param.length;
-            })
-            packet[k++] = _END_CMD;
-            while (k < n)
-                packet[k++] = 0xff;
-
-            net.debug(`send cmd ${packet.toHex()}`)
-            if (!this.waitForReady())
-                return false
-            this._cs.digitalWrite(false)
-            this.spiTransfer(packet, null)
-            this._cs.digitalWrite(true)
-            net.debug(`send done`);
-            return true
-        }
-
-        private spiTransfer(tx: Buffer, rx: Buffer) {
-            if (!tx) tx = control.createBuffer(rx.length)
-            if (!rx) rx = control.createBuffer(tx.length)
-            this._spi.transfer(tx, rx);
-        }
-
-        private _waitResponseCmd(cmd: number, num_responses?: number, param_len_16?: boolean) {
-            net.debug(`wait response cmd`);
-            if (!this.waitForReady())
-                return null
-
-            this._cs.digitalWrite(false)
-
-            let responses: Buffer[] = []
-            if (!this.waitSPIChar(_START_CMD)) {
-                this._cs.digitalWrite(true)
-                return null
-            }
-            this.checkData(cmd | _REPLY_FLAG)
-            if (num_responses !== undefined)
-                this.checkData(num_responses, cmd + "")
-            else
-                num_responses = this.readByte();
-            for (let num = 0; num < num_responses; ++num) {
-                let param_len = this.readByte()
-                if (param_len_16) {
-                    param_len <<= 8
-                    param_len |= this.readByte()
-                }
-                net.debug(`\tParameter #${num} length is ${param_len}`)
-                const response = control.createBuffer(param_len);
-                this.spiTransfer(null, response)
-                responses.push(response);
-            }
-            this.checkData(_END_CMD);
-
-            this._cs.digitalWrite(true)
-
-            net.debug(`responses ${responses.length}`);
-            return responses;
-        }
-
         private lock() {
             while (this._locked) {
                 pauseUntil(() => !this._locked)
@@ -264,8 +134,8 @@ namespace esp32 {
             reply_params = 1, sent_param_len_16 = false, recv_param_len_16 = false) {
 
             this.lock()
-            this._sendCommand(cmd, params, sent_param_len_16)
-            const resp = this._waitResponseCmd(cmd, reply_params, recv_param_len_16)
+            const resp = ninaCommand(cmd, params || [], reply_params,
+                (sent_param_len_16 ? 1 : 0) | (recv_param_len_16 ? 2 : 0))
             this.unlock();
             return resp
         }
@@ -314,7 +184,7 @@ namespace esp32 {
     'ssid', 'rssi' and 'encryption' entries, one for each AP found
 */
         private getScanNetworks(): net.AccessPoint[] {
-            let names = this.sendCommandGetResponse(_SCAN_NETWORKS, undefined, undefined)
+            let names = this.sendCommandGetResponse(_SCAN_NETWORKS, undefined, -1)
             // print("SSID names:", names)
             // pylint: disable=invalid-name
             let APs = []
@@ -586,7 +456,7 @@ namespace esp32 {
         }
 
         /** Test if a socket is connected to the destination, returns boolean true/false */
-        public socket_connected(socket_num: number): boolean {
+        public socketConnected(socket_num: number): boolean {
             return this.socketStatus(socket_num) == SOCKET_ESTABLISHED
         }
 
@@ -638,7 +508,7 @@ namespace esp32 {
             let times = net.monotonic()
             // wait 3 seconds
             while (net.monotonic() - times < 3) {
-                if (this.socket_connected(socket_num)) {
+                if (this.socketConnected(socket_num)) {
                     return true
                 }
 
@@ -726,6 +596,24 @@ namespace esp32 {
         }
     }
 
+    /**
+     * Set up the native SPI engine for nina-fw on the given bus and pins.
+     */
+    //% shim=esp32spi::ninaSetup
+    function ninaSetup(spi: SPI, cs: DigitalInOutPin, busy: DigitalInOutPin, frequency: number) {
+        return
+    }
+
+    /**
+     * Send a command, and return the parameters of the response; null when it failed.
+     * @param numResponses the number of parameters expected, or -1 for any
+     * @param flags 1 for 16 bit lengths of the parameters sent, 2 of the ones received
+     */
+    //% shim=esp32spi::ninaCommand
+    function ninaCommand(cmd: number, params: Buffer[], numResponses: number, flags: number): Buffer[] {
+        return null
+    }
+
     //% shim=esp32spi::flashDevice
     export function flashDevice() {
         return
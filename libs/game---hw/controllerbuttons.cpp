@@ -12,30 +12,34 @@ class PressureButton : public codal::Button {
     virtual int pressureLevel() { return isPressed() ? 512 : 0; }
 };
 
+// how often the analog buttons are sampled
+#ifndef ANALOG_SCAN_INTERVAL_MS
+#define ANALOG_SCAN_INTERVAL_MS 20
+#endif
+
+// The latest value of an analog pin. All of them are sampled in turn by analogScan(), so that
+// readers, which poll the buttons from the timer, don't wait for the ADC.
 struct AnalogCache {
     AnalogCache *next;
     Pin *pin;
-    uint32_t lastMeasureMS;
-    uint16_t lastMeasure;
+    volatile uint16_t lastMeasure;
     AnalogCache(Pin *pin) : pin(pin) {
         next = NULL;
-        lastMeasureMS = 0;
         lastMeasure = pin->getAnalogValue();
     }
-    uint16_t read();
+    uint16_t read() { return lastMeasure; }
 };
 
-uint16_t AnalogCache::read() {
-    uint32_t now = current_time_ms();
-    if (now - lastMeasureMS < 50)
-        return lastMeasure;
-    lastMeasureMS = now;
-    lastMeasure = pin->getAnalogValue();
-    return lastMeasure;
-}
-
 static AnalogCache *analogCache;
 
+static void analogScan() {
+    for (;;) {
+        for (auto c = analogCache; c; c = c->next)
+            c->lastMeasure = c->pin->getAnalogValue();
+        fiber_sleep(ANALOG_SCAN_INTERVAL_MS);
+    }
+}
+
 class AnalogButton : public PressureButton {
   public:
     AnalogCache *cache;
@@ -50,8 +54,8 @@ class AnalogButton : public PressureButton {
         int v = cache->read() - 512;
         if (threshold < 0)
             v = -v;
-        int vmin = getConfig(CFG_ANALOG_JOYSTICK_MIN, 50);
-        int vmax = getConfig(CFG_ANALOG_JOYSTICK_MAX, 500);
+        int vmin = getConfigCached<CFG_ANALOG_JOYSTICK_MIN>(50);
+        int vmax = getConfigCached<CFG_ANALOG_JOYSTICK_MAX>(500);
         v = (v - vmin) * 512 / (vmax - vmin);
         if (v < 0)
             v = 0;
@@ -85,6 +89,8 @@ AnalogCache *lookupAnalogCache(Pin *pin) {
         if (c->pin == pin)
             return c;
     auto c = new AnalogCache(pin);
+    if (!analogCache)
+        create_fiber(analogScan);
     c->next = analogCache;
     analogCache = c;
     return c;
@@ -104,6 +110,61 @@ int pressureLevelByButtonId(int btnId, int codalId) {
     return btn->pressureLevel();
 }
 
+// The buttons 0 to 31 (button n of player p is n + 7 * (p - 1)) as bits, tracked from the
+// PXT_INTERNAL_KEY_DOWN/UP events wherever they come from, so that the game reads them in one
+// buttonSnapshot() a frame instead of handling each event. Besides the buttons being held, the
+// ones pressed and released since the last snapshot are kept, so short presses are not lost.
+static uint32_t buttonsDown, buttonsPressed, buttonsReleased;
+// buttons set up or seen so far, whose pressure levels are reported
+static uint32_t buttonsKnown;
+
+#define BUTTON_SNAPSHOT_BUTTONS 32
+#define BUTTON_SNAPSHOT_SIZE (3 * sizeof(uint32_t) + BUTTON_SNAPSHOT_BUTTONS * sizeof(uint16_t))
+
+static void trackButton(Event ev) {
+    if (ev.value >= BUTTON_SNAPSHOT_BUTTONS)
+        return;
+    uint32_t bit = 1U << ev.value;
+    buttonsKnown |= bit;
+    if (ev.source == PXT_INTERNAL_KEY_DOWN) {
+        buttonsDown |= bit;
+        buttonsPressed |= bit;
+    } else {
+        buttonsDown &= ~bit;
+        buttonsReleased |= bit;
+    }
+}
+
+/**
+ * The state of all the buttons: the ones held, pressed and released since the last call as
+ * UInt32LE bits, then the pressure level of each, 0-512, as UInt16LE values.
+ */
+//% expose
+Buffer buttonSnapshot() {
+    static bool tracking;
+    if (!tracking) {
+        tracking = true;
+        EventModel::defaultEventBus->listen(PXT_INTERNAL_KEY_DOWN, DEVICE_EVT_ANY, trackButton,
+                                            MESSAGE_BUS_LISTENER_IMMEDIATE);
+        EventModel::defaultEventBus->listen(PXT_INTERNAL_KEY_UP, DEVICE_EVT_ANY, trackButton,
+                                            MESSAGE_BUS_LISTENER_IMMEDIATE);
+    }
+    auto res = mkBuffer(NULL, BUTTON_SNAPSHOT_SIZE);
+    auto words = (uint32_t *)res->data;
+    target_disable_irq();
+    words[0] = buttonsDown;
+    words[1] = buttonsPressed;
+    words[2] = buttonsReleased;
+    buttonsPressed = buttonsReleased = 0;
+    target_enable_irq();
+    auto levels = (uint16_t *)(words + 3);
+    auto known = buttonsKnown;
+    for (int i = 1; i < BUTTON_SNAPSHOT_BUTTONS; ++i)
+        if (known & (1U << i))
+            levels[i] = pressureLevelByButtonId(i, -1);
+    return res;
+}
+
 static void sendBtnDown(Event ev) {
     Event(PXT_INTERNAL_KEY_DOWN, ev.source - DEVICE_ID_FIRST_BUTTON);
 }
@@ -118,6 +179,9 @@ void setupButton(int buttonId, int key) {
     if (pin == -1)
         return;
 
+    if (0 <= buttonId && buttonId < BUTTON_SNAPSHOT_BUTTONS)
+        buttonsKnown |= 1U << buttonId;
+
     unsigned highflags = (unsigned)pin >> 16;
     int flags = BUTTON_ACTIVE_LOW_PULL_UP;
     if (highflags & 0xff)
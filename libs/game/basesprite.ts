@@ -31,7 +31,7 @@ namespace sprites {
         set z(v: number) {
             if (this._z !== v) {
                 this._z = v;
-                game.currentScene().flags |= scene.Flag.NeedsSorting;
+                game.currentScene()._resortSprite(this);
             }
         }
 
@@ -43,6 +43,15 @@ namespace sprites {
 
         __drawCore(camera: scene.Camera) { }
 
+        /**
+         * Add what __draw() would draw to list, for the scene to draw it with other sprites in one
+         * native call, and return true; or return false to be drawn with __draw(). Subclasses
+         * that override __drawCore() of a class that batches its drawing override this too.
+         */
+        __drawBatched(camera: scene.Camera, list: image.DrawList): boolean {
+            return false;
+        }
+
         __update(camera: scene.Camera, dt: number) { }
 
         __serialize(offset: number): Buffer { return undefined }
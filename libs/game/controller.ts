@@ -44,6 +44,45 @@ namespace controller {
     //% shim=pxt::pressureLevelByButtonId
     declare function pressureLevelByButtonId(btnId: number, codalId: number): number;
 
+    //% shim=pxt::buttonSnapshot
+    function buttonSnapshot(): Buffer {
+        return undefined // missing in sim
+    }
+
+    // see buttonSnapshot() in controllerbuttons.cpp
+    const enum ButtonSnapshot {
+        Down = 0,
+        Pressed = 4,
+        Released = 8,
+        Levels = 12,
+        NumButtons = 32
+    }
+
+    // the buttons read from the snapshot of each frame, when there are snapshots; the others
+    // follow their events
+    let _polledButtons: Button[];
+    let _snapshot: Buffer;
+    let _hasSnapshots: boolean;
+
+    function hasSnapshots() {
+        if (_hasSnapshots === undefined)
+            _hasSnapshots = !!buttonSnapshot();
+        return _hasSnapshots;
+    }
+
+    function pollButtons() {
+        if (!_polledButtons) return;
+        _snapshot = buttonSnapshot();
+        if (!_snapshot) return;
+        const down = _snapshot.getNumber(NumberFormat.UInt32LE, ButtonSnapshot.Down);
+        const pressed = _snapshot.getNumber(NumberFormat.UInt32LE, ButtonSnapshot.Pressed);
+        const released = _snapshot.getNumber(NumberFormat.UInt32LE, ButtonSnapshot.Released);
+        // the polled buttons only change with the snapshots, so they are all up already
+        if (!(down | pressed | released)) return;
+        for (const b of _polledButtons)
+            b.__applySnapshot(down, pressed, released);
+    }
+
     //% shim=pxt::setupButton
     function setupButton(buttonId: number, key: number) {
         return // missing in sim
@@ -75,8 +114,13 @@ namespace controller {
                 // this is to deal with the "anyButton" hack, which creates a button that is not visible
                 // in the UI, but used in event-handler to simulate the wildcard ANY for matching. As
                 // this button can't actually be pressed, we don't want it to propagate events
-                control.internalOnEvent(INTERNAL_KEY_UP, this.id, () => this.setPressed(false), 16)
-                control.internalOnEvent(INTERNAL_KEY_DOWN, this.id, () => this.setPressed(true), 16)
+                if (id < ButtonSnapshot.NumButtons && hasSnapshots()) {
+                    if (!_polledButtons) _polledButtons = [];
+                    _polledButtons.push(this);
+                } else {
+                    control.internalOnEvent(INTERNAL_KEY_UP, this.id, () => this.setPressed(false), 16)
+                    control.internalOnEvent(INTERNAL_KEY_DOWN, this.id, () => this.setPressed(true), 16)
+                }
 
                 if (configKey > 0)
                     setupButton(id, configKey)
@@ -141,6 +185,8 @@ namespace controller {
             if (control.deviceDalVersion() == "sim") {
                 return this.isPressed() ? 512 : 0
                 // once implemented in sim, this could be similar to the one below
+            } else if (_snapshot && this.id < ButtonSnapshot.NumButtons) {
+                return _snapshot.getNumber(NumberFormat.UInt16LE, ButtonSnapshot.Levels + 2 * this.id);
             } else {
                 return pressureLevelByButtonId(this.id, -1);
             }
@@ -162,6 +208,20 @@ namespace controller {
             }
         }
 
+        /**
+         * Catch up with the presses and releases of the button in a snapshot of all of them
+         */
+        __applySnapshot(down: number, pressed: number, released: number) {
+            const bit = 1 << this.id;
+            // a release and press since the last frame, or a press and release
+            if (released & bit)
+                this.setPressed(false);
+            if ((pressed | down) & bit)
+                this.setPressed(true);
+            if (!(down & bit))
+                this.setPressed(false);
+        }
+
         __update(dtms: number) {
             if (!this._pressed) return;
             this._pressedElasped += dtms;
@@ -550,6 +610,7 @@ namespace controller {
      */
     export function __update(dt: number) {
         const dtms = (dt * 1000) | 0
+        pollButtons();
         players().forEach(ctrl => ctrl.__update(dtms));
     }
 
@@ -59,6 +59,12 @@ namespace game {
         const width = maxX - minX + 1;
         const height = maxY - minY + 1;
 
+        // the image is drawn mirrored
+        if (s.flags & sprites.Flag.FlipX)
+            minX = i.width - 1 - maxX;
+        if (s.flags & sprites.Flag.FlipY)
+            minY = i.height - 1 - maxY;
+
         return new Hitbox(s, width, height, minX, minY);
     }
 }
\ No newline at end of file
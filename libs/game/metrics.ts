@@ -1,3 +1,118 @@
 namespace performance {
+    //% shim=profiler::_mark
+    declare function _profileMark(stage: number): void;
+    //% shim=profiler::_endFrame
+    declare function _profileEndFrame(): void;
+    //% shim=profiler::_reset
+    declare function _profileReset(): void;
+    //% shim=profiler::_percentiles
+    declare function _profilePercentiles(percentile: number): Buffer;
 
-}
\ No newline at end of file
+    /**
+     * The stages of a frame of a scene; must match FrameStage in profiler.cpp
+     */
+    export const enum FrameStage {
+        Controller,
+        Physics,
+        // update handlers, and any other frame handlers before pre render
+        Update,
+        PreRender,
+        Background,
+        Sprites,
+        // renderables, and anything else drawn along with the sprites
+        Renderables,
+        Diagnostics,
+        Screen,
+        // GC pauses, which are also counted in the other stages
+        GC,
+        Total
+    }
+
+    const stageNames = ["ctrl", "phys", "upd", "pre", "bg", "spr", "rend", "diag", "scr", "gc", "all"];
+
+    /**
+     * Whether frames are profiled; set by startProfiling()
+     */
+    export let _profiling = false;
+    let overlay = false;
+    let overlayLines: string[];
+    let overlayFrames = 0;
+
+    /**
+     * Start timing the stages of each frame of the scenes. The times of the last few dozen
+     * frames are kept; see frameTimes()
+     * @param showOverlay draw the times on the screen with the other diagnostics
+     */
+    export function startProfiling(showOverlay = false) {
+        _profileReset();
+        _profiling = true;
+        overlay = showOverlay;
+        overlayLines = undefined;
+        overlayFrames = 0;
+    }
+
+    export function stopProfiling() {
+        _profiling = false;
+        overlay = false;
+    }
+
+    /**
+     * The time of each stage (see FrameStage), in microseconds, that percentile of the frames
+     * profiled lately take at most; eg. 50 for the median, 100 for the longest
+     */
+    export function frameTimes(percentile: number): number[] {
+        const buf = _profilePercentiles(percentile);
+        const res: number[] = [];
+        for (let i = 0; i < buf.length; i += 4)
+            res.push(buf.getNumber(NumberFormat.Int32LE, i));
+        return res;
+    }
+
+    /**
+     * Write the median, 90th and 99th percentile and longest time of each stage of the frames
+     * profiled lately to the console, in milliseconds
+     */
+    export function dumpProfile() {
+        const p50 = frameTimes(50), p90 = frameTimes(90), p99 = frameTimes(99), max = frameTimes(100);
+        if (!p50.length) return;
+        console.log("stage p50 p90 p99 max (ms)");
+        for (let i = 0; i < p50.length; ++i)
+            console.log(`${stageNames[i]} ${ms(p50[i])} ${ms(p90[i])} ${ms(p99[i])} ${ms(max[i])}`);
+    }
+
+    function ms(us: number) {
+        return `${Math.idiv(us, 1000)}.${Math.idiv(us % 1000, 100)}`;
+    }
+
+    export function _mark(stage: FrameStage) {
+        if (_profiling)
+            _profileMark(stage);
+    }
+
+    export function _endFrame() {
+        if (_profiling)
+            _profileEndFrame();
+    }
+
+    /**
+     * Draw the median and 90th percentile time of each stage in the corner of the screen
+     */
+    export function _drawOverlay() {
+        if (!_profiling || !overlay) return;
+        // the times only change a little from one frame to the next
+        if (!overlayLines || ++overlayFrames >= 16) {
+            overlayFrames = 0;
+            const p50 = frameTimes(50), p90 = frameTimes(90);
+            overlayLines = [];
+            for (let i = 0; i < p50.length; ++i)
+                overlayLines.push(`${stageNames[i]} ${ms(p50[i])} ${ms(p90[i])}`);
+        }
+        const font = image.font5;
+        const color = screen.isMono ? 1 : 5;
+        let y = 2;
+        for (const line of overlayLines) {
+            screen.print(line, screen.width - line.length * font.charWidth - 2, y, color, font);
+            y += font.charHeight + 1;
+        }
+    }
+}
@@ -180,6 +180,10 @@ namespace effects {
             drawParticle(p: particles.Particle, x: Fx8, y: Fx8) {
                 screen.setPixel(Fx.toInt(x), Fx.toInt(y), p.color);
             }
+
+            pixelColor(p: particles.Particle) {
+                return p.color;
+            }
         }
 
         const factory = new FountainFactory();
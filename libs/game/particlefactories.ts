@@ -66,7 +66,7 @@ namespace particles {
          * @param anchor 
          */
         createParticle(anchor: ParticleAnchor): Particle {
-            const p = new Particle();
+            const p = particles._newParticle();
 
             p._x = Fx8(anchor.x);
             p._y = Fx8(anchor.y);
@@ -86,6 +86,16 @@ namespace particles {
         drawParticle(particle: Particle, x: Fx8, y: Fx8) {
             screen.setPixel(Fx.toInt(x), Fx.toInt(y), 1);
         }
+
+        /**
+         * The color of the given particle, if drawParticle() only draws it as that one pixel; then
+         * sources may keep it in a native pool and draw it without calling drawParticle(). -1 for
+         * particles drawn some other way; subclasses that override drawParticle() override this too.
+         * @param particle
+         */
+        pixelColor(particle: Particle): number {
+            return -1;
+        }
     }
 
     /**
@@ -117,6 +127,10 @@ namespace particles {
             screen.setPixel(Fx.toInt(x), Fx.toInt(y), 1);
         }
 
+        pixelColor(particle: Particle) {
+            return 1;
+        }
+
         setSpeed(pixelsPerSecond: number) {
             this.speed = Fx8(pixelsPerSecond);
         }
@@ -162,6 +176,10 @@ namespace particles {
                     5 : 1;
             screen.setPixel(Fx.toInt(x), Fx.toInt(y), col);
         }
+
+        pixelColor(p: Particle) {
+            return -1; // changes with the lifespan
+        }
     }
 
     /**
@@ -197,6 +215,10 @@ namespace particles {
         drawParticle(p: Particle, x: Fx8, y: Fx8) {
             screen.setPixel(Fx.toInt(x), Fx.toInt(y), p.color);
         }
+
+        pixelColor(p: Particle) {
+            return p.color;
+        }
     }
 
     /**
@@ -313,6 +335,10 @@ namespace particles {
                 p.color
             );
         }
+
+        pixelColor(p: Particle) {
+            return p.color;
+        }
     }
 
     export class RadialFactory extends ParticleFactory {
@@ -363,6 +389,10 @@ namespace particles {
             );
         }
 
+        pixelColor(p: Particle) {
+            return p.color;
+        }
+
         setRadius(r: number) {
             this.r = Fx8(r >> 1);
         }
@@ -445,6 +475,10 @@ namespace particles {
         drawParticle(p: Particle, x: Fx8, y: Fx8) {
             screen.setPixel(Fx.toInt(x), Fx.toInt(y), p.color);
         }
+
+        pixelColor(p: Particle) {
+            return p.color;
+        }
     }
 
     export class BubbleFactory extends ParticleFactory {
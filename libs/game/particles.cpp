@@ -0,0 +1,84 @@
+#include "pxt.h"
+
+namespace ImageMethods {
+void setPixel(Image_ img, int x, int y, int c);
+}
+
+namespace particles {
+
+// the pools of _updateParticles() and _drawParticles() start with the values of the source they
+// need, then have the fields of a particle, one particle after another; all are Int32LE values,
+// and positions, velocities and accelerations are Fx8. Must match particles.ts
+enum PoolField {
+    FIXED_DT, // seconds (Fx8) the particles move by in the next update
+    AX,
+    AY,
+    LEFT, // the offset particles are drawn at
+    TOP,
+    NUM_POOL_FIELDS
+};
+enum ParticleField { X, Y, VX, VY, LIFESPAN, COLOR, NUM_PARTICLE_FIELDS };
+
+static inline int fxMul(int a, int b) {
+    return (int32_t)((uint32_t)a * (uint32_t)b) >> 8;
+}
+
+static inline int poolLength(Buffer pool, int n) {
+    int words = pool->length / (int)sizeof(int32_t) - NUM_POOL_FIELDS;
+    return words < 0 ? 0 : min(n, words / (int)NUM_PARTICLE_FIELDS);
+}
+
+/**
+ * Age the first n particles of pool by dt ms, and move them by the acceleration (AX, AY) and
+ * their velocity over FIXED_DT seconds; see PoolField. Particles whose lifespan runs out are
+ * removed, and the others stay in order; returns how many are left.
+ */
+//%
+int _updateParticles(Buffer pool, int n, int dt) {
+    n = poolLength(pool, n);
+    if (n <= 0)
+        return 0;
+    auto header = (int32_t *)pool->data;
+    int fixedDt = header[FIXED_DT], ax = header[AX], ay = header[AY];
+    auto src = header + NUM_POOL_FIELDS;
+    auto dst = src;
+    int left = 0;
+    for (int i = 0; i < n; ++i, src += NUM_PARTICLE_FIELDS) {
+        int lifespan = src[LIFESPAN] - dt;
+        if (lifespan <= 0)
+            continue;
+        int vx = src[VX] + fxMul(ax, fixedDt);
+        int vy = src[VY] + fxMul(ay, fixedDt);
+        dst[X] = src[X] + fxMul(vx, fixedDt);
+        dst[Y] = src[Y] + fxMul(vy, fixedDt);
+        dst[VX] = vx;
+        dst[VY] = vy;
+        dst[LIFESPAN] = lifespan;
+        dst[COLOR] = src[COLOR];
+        dst += NUM_PARTICLE_FIELDS;
+        left++;
+    }
+    return left;
+}
+
+/**
+ * Draw the first n particles of pool as single pixels on target, offset by (LEFT, TOP); the
+ * newest ones are drawn first, like the particles a source keeps in its list.
+ */
+//%
+void _drawParticles(Buffer pool, int n, Image_ target) {
+    n = poolLength(pool, n);
+    if (n <= 0)
+        return;
+    auto header = (int32_t *)pool->data;
+    int left = header[LEFT], top = header[TOP];
+    auto p = header + NUM_POOL_FIELDS + n * NUM_PARTICLE_FIELDS;
+    while (n--) {
+        p -= NUM_PARTICLE_FIELDS;
+        if (p[LIFESPAN] > 0)
+            ImageMethods::setPixel(target, (p[X] - left + 128) >> 8, (p[Y] - top + 128) >> 8,
+                                   p[COLOR]);
+    }
+}
+
+} // namespace particles
@@ -18,6 +18,38 @@ namespace particles {
     })();
     const TIME_PRECISION = 10; // time goes down to down to the 1<<10 seconds
     let lastUpdate: number;
+    // the last particle copied to a pool, for the next one a factory creates
+    let spareParticle: Particle;
+
+    //% shim=particles::_updateParticles
+    export declare function _updateParticles(pool: Buffer, n: number, dt: number): number;
+
+    //% shim=particles::_drawParticles
+    export declare function _drawParticles(pool: Buffer, n: number, target: Image): void;
+
+    // byte offsets of the values of the source at the start of a pool, each an Int32LE value, for
+    // the next _updateParticles() and _drawParticles(); must match PoolField in particles.cpp
+    const enum PoolField {
+        FixedDt = 0,
+        AX = 4,
+        AY = 8,
+        Left = 12,
+        Top = 16,
+        Size = 20
+    }
+
+    // byte offsets of the fields of a particle in a pool, each an Int32LE value; must match
+    // ParticleField in particles.cpp
+    const enum ParticleField {
+        X = 0,
+        Y = 4,
+        VX = 8,
+        VY = 12,
+        Lifespan = 16,
+        Color = 20,
+        Size = 24
+    }
+    const MIN_POOL_SIZE = 8;
 
     /**
      * A single particle
@@ -34,6 +66,20 @@ namespace particles {
         color?: number;
     }
 
+    /**
+     * A particle for a factory to set up; it may be one a source has copied to its pool, reset
+     */
+    export function _newParticle() {
+        const p = spareParticle;
+        if (!p)
+            return new Particle();
+        spareParticle = undefined;
+        p.next = undefined;
+        p.data = undefined;
+        p.color = undefined;
+        return p;
+    }
+
     /**
      * An anchor for a Particle to originate from
      */
@@ -79,6 +125,12 @@ namespace particles {
         protected ax: Fx8;
         protected ay: Fx8;
 
+        // particles drawn as a single pixel are kept in pool instead of the list, and updated and
+        // drawn natively; subclasses that override updateParticle() or drawParticle() turn it off
+        protected pooled: boolean;
+        protected pool: Buffer;
+        protected poolSize: number;
+
         /**
          * @param anchor to emit particles from
          * @param particlesPerSecond rate at which particles are emitted
@@ -98,6 +150,8 @@ namespace particles {
             }
 
             this.pFlags = 0;
+            this.pooled = true;
+            this.poolSize = 0;
             this.setRate(particlesPerSecond);
             this.setAcceleration(0, 0);
             this.setAnchor(anchor);
@@ -114,6 +168,12 @@ namespace particles {
             const left = (this.pFlags & Flag.relativeToCamera) ? Fx.zeroFx8 : Fx8(camera.drawOffsetX);
             const top = (this.pFlags & Flag.relativeToCamera) ? Fx.zeroFx8 : Fx8(camera.drawOffsetY);
 
+            if (this.poolSize) {
+                this.pool.setNumber(NumberFormat.Int32LE, PoolField.Left, left as any as number);
+                this.pool.setNumber(NumberFormat.Int32LE, PoolField.Top, top as any as number);
+                _drawParticles(this.pool, this.poolSize, screen);
+            }
+
             while (current) {
                 if (current.lifespan > 0)
                     this.drawParticle(current, left, top);
@@ -138,37 +198,68 @@ namespace particles {
                 this.timer += this.period;
                 const p = this._factory.createParticle(this.anchor);
                 if (!p) continue; // some factories can decide to not produce a particle
-                p.next = this.head;
-                this.head = p;
+                const color = this.pooled ? this._factory.pixelColor(p) : -1;
+                if (color >= 0) {
+                    this.addToPool(p, color);
+                } else {
+                    p.next = this.head;
+                    this.head = p;
+                }
             }
 
-            if (!this.head) return;
+            if (!this.head && !this.poolSize) return;
 
             let current = this.head;
 
             this._dt += dt;
             let fixedDt = Fx8(this._dt);
+            if (this.poolSize) {
+                const pool = this.pool;
+                pool.setNumber(NumberFormat.Int32LE, PoolField.FixedDt, Fx.rightShift(fixedDt, TIME_PRECISION) as any as number);
+                pool.setNumber(NumberFormat.Int32LE, PoolField.AX, this.ax as any as number);
+                pool.setNumber(NumberFormat.Int32LE, PoolField.AY, this.ay as any as number);
+                this.poolSize = _updateParticles(pool, this.poolSize, dt);
+            }
             if (fixedDt) {
-                do {
+                for (; current; current = current.next) {
                     if (current.lifespan > 0) {
                         current.lifespan -= dt;
                         this.updateParticle(current, fixedDt)
                     }
-                } while (current = current.next);
+                }
                 this._dt = 0;
             } else {
-                do {
+                for (; current; current = current.next)
                     current.lifespan -= dt;
-                } while (current = current.next);
             }
         }
 
+        // copy p to the end of the pool, which grows as needed, and keep p for the next particle
+        protected addToPool(p: Particle, color: number) {
+            const offset = PoolField.Size + this.poolSize * ParticleField.Size;
+            if (!this.pool || offset + ParticleField.Size > this.pool.length) {
+                const pool = Buffer.create(PoolField.Size + Math.max(MIN_POOL_SIZE, this.poolSize << 1) * ParticleField.Size);
+                if (this.pool)
+                    pool.write(0, this.pool);
+                this.pool = pool;
+            }
+            const pool = this.pool;
+            pool.setNumber(NumberFormat.Int32LE, offset + ParticleField.X, p._x as any as number);
+            pool.setNumber(NumberFormat.Int32LE, offset + ParticleField.Y, p._y as any as number);
+            pool.setNumber(NumberFormat.Int32LE, offset + ParticleField.VX, p.vx as any as number);
+            pool.setNumber(NumberFormat.Int32LE, offset + ParticleField.VY, p.vy as any as number);
+            pool.setNumber(NumberFormat.Int32LE, offset + ParticleField.Lifespan, p.lifespan);
+            pool.setNumber(NumberFormat.Int32LE, offset + ParticleField.Color, color);
+            this.poolSize++;
+            spareParticle = p;
+        }
+
         _prune() {
             while (this.head && this.head.lifespan <= 0) {
                 this.head = this.head.next;
             }
 
-            if ((this.pFlags & Flag.destroyed) && !this.head) {
+            if ((this.pFlags & Flag.destroyed) && !this.head && !this.poolSize) {
                 const scene = game.currentScene();
                 if (scene)
                     scene.allSprites.removeElement(this);
@@ -242,6 +333,8 @@ namespace particles {
          */
         clear() {
             this.head = undefined;
+            this.pool = undefined;
+            this.poolSize = 0;
         }
 
         /**
@@ -330,7 +423,7 @@ namespace particles {
     }
 
     function sortSources(sources: ParticleSource[]) {
-        sources.sort((a, b) => (a.priority - b.priority || a.id - b.id));
+        sources.sortStable((a, b) => (a.priority - b.priority || a.id - b.id));
     }
 
     /**
@@ -341,6 +434,7 @@ namespace particles {
 
         constructor(anchor: ParticleAnchor, particlesPerSecond: number, factory?: ParticleFactory) {
             super(anchor, particlesPerSecond, factory);
+            this.pooled = false; // particles follow the next one
             this.galois = new Math.FastRandom();
             this.z = 20;
         }
@@ -366,6 +460,7 @@ namespace particles {
 
         constructor(anchor: ParticleAnchor, particlesPerSecond: number, maxState: number, factory?: ParticleFactory) {
             super(anchor, particlesPerSecond, factory);
+            this.pooled = false; // particles change state and direction
             this.galois = new Math.FastRandom();
             this.maxState = maxState;
             this.stateChangePercentage = 3;
@@ -0,0 +1,85 @@
+#include "pxt.h"
+
+namespace sprites {
+
+// the state of _physicsStep() starts with the limits of the engine, Int32LE Fx8 values, followed
+// by the fields of the sprites, each an Int32LE array of Fx8 values with one element per sprite;
+// must match physics.ts
+enum PhysicsHeader { MAX_VELOCITY, MIN_STEP, MAX_STEP, NUM_PHYSICS_HEADER };
+enum PhysicsField { VX, VY, AX, AY, FX, FY, DX, DY, XSTEP, YSTEP, NUM_PHYSICS_FIELDS };
+
+static inline int fxMul(int a, int b) {
+    return (int32_t)((uint32_t)a * (uint32_t)b) >> 8;
+}
+
+static inline int fxAbs(int a) {
+    return a < 0 ? -a : a;
+}
+
+static inline int constrain(int v, int maxVelocity) {
+    return v > maxVelocity ? maxVelocity : v < -maxVelocity ? -maxVelocity : v;
+}
+
+// new velocity after dt ms of acceleration a or, if there is none, friction f
+static int accelerate(int v, int a, int f, int dt) {
+    if (a)
+        return v + fxMul(a, dt) / 1000;
+    if (!f)
+        return v;
+    f = fxMul(f, dt) / 1000;
+    if (v < f)
+        return min(0, v + f);
+    if (v > f)
+        return max(0, v - f);
+    return 0;
+}
+
+/**
+ * Apply acceleration, friction and the speed limit to the first n sprites in state, over dt ms,
+ * and compute how far they move (the average velocity over dt) and in which steps, no longer
+ * than the max step unless that is below the min step. All values are Fx8; see PhysicsHeader and
+ * PhysicsField.
+ */
+//%
+void _physicsStep(Buffer state, int n, int dt) {
+    if (n <= 0 || state->length < (NUM_PHYSICS_HEADER + n * NUM_PHYSICS_FIELDS) * 4)
+        return;
+    auto header = (int32_t *)state->data;
+    int maxVelocity = header[MAX_VELOCITY], minStep = header[MIN_STEP], maxStep = header[MAX_STEP];
+    auto f = header + NUM_PHYSICS_HEADER;
+    auto vx = f + VX * n, vy = f + VY * n;
+    auto ax = f + AX * n, ay = f + AY * n;
+    auto fx = f + FX * n, fy = f + FY * n;
+    auto dx = f + DX * n, dy = f + DY * n;
+    auto xStep = f + XSTEP * n, yStep = f + YSTEP * n;
+    int dt2 = dt / 2;
+
+    for (int i = 0; i < n; ++i) {
+        int ovx = constrain(vx[i], maxVelocity);
+        int ovy = constrain(vy[i], maxVelocity);
+        vx[i] = constrain(accelerate(vx[i], ax[i], fx[i], dt), maxVelocity);
+        vy[i] = constrain(accelerate(vy[i], ay[i], fy[i], dt), maxVelocity);
+        dx[i] = fxMul(vx[i] + ovx, dt2) / 1000;
+        dy[i] = fxMul(vy[i] + ovy, dt2) / 1000;
+
+        // make step increments smaller until under max step size
+        int xs = dx[i], ys = dy[i];
+        while (fxAbs(xs) > maxStep || fxAbs(ys) > maxStep) {
+            bool halved = false;
+            if (fxAbs(xs) > minStep) {
+                xs /= 2;
+                halved = true;
+            }
+            if (fxAbs(ys) > minStep) {
+                ys /= 2;
+                halved = true;
+            }
+            if (!halved)
+                break;
+        }
+        xStep[i] = xs;
+        yStep[i] = ys;
+    }
+}
+
+} // namespace sprites
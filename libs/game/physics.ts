@@ -23,6 +23,27 @@ class PhysicsEngine {
     overlaps(sprite: Sprite): Sprite[] { return []; }
 }
 
+namespace sprites {
+    //% shim=sprites::_physicsStep
+    export declare function _physicsStep(state: Buffer, n: number, dt: number): void;
+
+}
+
+// ArcadePhysicsEngine.state starts with the limits of the engine, Int32LE Fx8 values, followed by
+// the fields of the sprites, each an array of Int32LE Fx8 values with one element per sprite;
+// must match physics.cpp
+const enum PhysicsHeader {
+    MaxVelocity, MinStep, MaxStep,
+    Count
+}
+
+const enum PhysicsField {
+    Vx, Vy, Ax, Ay, Fx, Fy,
+    // computed by sprites._physicsStep()
+    Dx, Dy, XStep, YStep,
+    Count
+}
+
 const MAX_TIME_STEP = Fx8(100); // milliseconds
 const SPRITE_CANNOT_COLLIDE = SpriteFlag.NoTileCollisions | sprites.Flag.Destroyed | SpriteFlag.RelativeToCamera;
 const SPRITE_CANNOT_OVERLAP = SpriteFlag.NoSpriteOverlaps | sprites.Flag.Destroyed | SpriteFlag.RelativeToCamera;
@@ -53,6 +74,8 @@ class ArcadePhysicsEngine extends PhysicsEngine {
     protected maxNegativeVelocity: Fx8;
     protected minSingleStep: Fx8;
     protected maxSingleStep: Fx8;
+    // velocities and accelerations of the sprites, for sprites._physicsStep()
+    private state: Buffer;
 
     constructor(maxVelocity = 500, minSingleStep = 2, maxSingleStep = 4) {
         super();
@@ -114,13 +137,11 @@ class ArcadePhysicsEngine extends PhysicsEngine {
             MAX_TIME_STEP,
             Fx8(dt * 1000)
         );
-        const dt2 = Fx.idiv(dtf, 2);
 
         const scene = game.currentScene();
 
         const tileMap = scene.tileMap;
-        const movingSprites = this.sprites
-            .map(sprite => this.createMovingSprite(sprite, dtf, dt2));
+        const movingSprites = this.createMovingSprites(dtf);
 
         // clear obstacles if moving on that axis
         this.sprites.forEach(s => {
@@ -128,7 +149,6 @@ class ArcadePhysicsEngine extends PhysicsEngine {
         });
 
         this.map.clear();
-        this.map.resizeBuckets(this.sprites);
 
         const MAX_STEP_COUNT = Fx.toInt(
             Fx.idiv(
@@ -212,115 +232,48 @@ class ArcadePhysicsEngine extends PhysicsEngine {
         }
     }
 
-    private createMovingSprite(sprite: Sprite, dtMs: Fx8, dt2: Fx8): MovingSprite {
-        const ovx = this.constrain(sprite._vx);
-        const ovy = this.constrain(sprite._vy);
-        sprite._lastX = sprite._x;
-        sprite._lastY = sprite._y;
-
-        if (sprite._ax) {
-            sprite._vx = Fx.add(
-                sprite._vx,
-                Fx.idiv(
-                    Fx.mul(
-                        sprite._ax,
-                        dtMs
-                    ),
-                    1000
-                )
-            );
-        } else if (sprite._fx) {
-            const fx = Fx.idiv(
-                Fx.mul(
-                    sprite._fx,
-                    dtMs
-                ),
-                1000
-            );
-            const c = Fx.compare(sprite._vx, fx);
-            if (c < 0) // v < f, v += f
-                sprite._vx = Fx.min(Fx.zeroFx8, Fx.add(sprite._vx, fx));
-            else if (c > 0) // v > f, v -= f
-                sprite._vx = Fx.max(Fx.zeroFx8, Fx.sub(sprite._vx, fx));
-            else
-                sprite._vx = Fx.zeroFx8
+    // apply acceleration, friction and the speed limit to all sprites, natively in one go
+    private createMovingSprites(dtMs: Fx8): MovingSprite[] {
+        const n = this.sprites.length;
+        const size = (PhysicsHeader.Count + n * PhysicsField.Count) * 4;
+        if (!this.state || this.state.length < size)
+            this.state = control.createBuffer(size);
+        const st = this.state;
+        const off = (field: PhysicsField, i: number) => (PhysicsHeader.Count + field * n + i) << 2;
+        st.setNumber(NumberFormat.Int32LE, PhysicsHeader.MaxVelocity << 2, this.maxVelocity as any as number);
+        st.setNumber(NumberFormat.Int32LE, PhysicsHeader.MinStep << 2, this.minSingleStep as any as number);
+        st.setNumber(NumberFormat.Int32LE, PhysicsHeader.MaxStep << 2, this.maxSingleStep as any as number);
+
+        for (let i = 0; i < n; ++i) {
+            const s = this.sprites[i];
+            s._lastX = s._x;
+            s._lastY = s._y;
+            st.setNumber(NumberFormat.Int32LE, off(PhysicsField.Vx, i), s._vx as any as number);
+            st.setNumber(NumberFormat.Int32LE, off(PhysicsField.Vy, i), s._vy as any as number);
+            st.setNumber(NumberFormat.Int32LE, off(PhysicsField.Ax, i), s._ax as any as number);
+            st.setNumber(NumberFormat.Int32LE, off(PhysicsField.Ay, i), s._ay as any as number);
+            st.setNumber(NumberFormat.Int32LE, off(PhysicsField.Fx, i), s._fx as any as number);
+            st.setNumber(NumberFormat.Int32LE, off(PhysicsField.Fy, i), s._fy as any as number);
         }
 
-        if (sprite._ay) {
-            sprite._vy = Fx.add(
-                sprite._vy,
-                Fx.idiv(
-                    Fx.mul(
-                        sprite._ay,
-                        dtMs
-                    ),
-                    1000
-                )
-            );
-        } else if (sprite._fy) {
-            const fy = Fx.idiv(
-                Fx.mul(
-                    sprite._fy,
-                    dtMs
-                ),
-                1000
-            );
-            const c = Fx.compare(sprite._vy, fy);
-            if (c < 0) // v < f, v += f
-                sprite._vy = Fx.min(Fx.zeroFx8, Fx.add(sprite._vy, fy));
-            else if (c > 0) // v > f, v -= f
-                sprite._vy = Fx.min(Fx.zeroFx8, Fx.sub(sprite._vy, fy));
-            else
-                sprite._vy = Fx.zeroFx8
+        sprites._physicsStep(st, n, dtMs as any as number);
+
+        const res: MovingSprite[] = [];
+        for (let i = 0; i < n; ++i) {
+            const s = this.sprites[i];
+            s._vx = st.getNumber(NumberFormat.Int32LE, off(PhysicsField.Vx, i)) as any as Fx8;
+            s._vy = st.getNumber(NumberFormat.Int32LE, off(PhysicsField.Vy, i)) as any as Fx8;
+            res.push(new MovingSprite(
+                s,
+                s._vx,
+                s._vy,
+                st.getNumber(NumberFormat.Int32LE, off(PhysicsField.Dx, i)) as any as Fx8,
+                st.getNumber(NumberFormat.Int32LE, off(PhysicsField.Dy, i)) as any as Fx8,
+                st.getNumber(NumberFormat.Int32LE, off(PhysicsField.XStep, i)) as any as Fx8,
+                st.getNumber(NumberFormat.Int32LE, off(PhysicsField.YStep, i)) as any as Fx8
+            ));
         }
-
-        sprite._vx = this.constrain(sprite._vx);
-        sprite._vy = this.constrain(sprite._vy);
-
-        const dx = Fx.idiv(
-            Fx.mul(
-                Fx.add(
-                    sprite._vx,
-                    ovx
-                ),
-                dt2
-            ),
-            1000
-        );
-
-        const dy = Fx.idiv(
-            Fx.mul(
-                Fx.add(
-                    sprite._vy,
-                    ovy
-                ),
-                dt2
-            ),
-            1000
-        );
-
-        let xStep = dx;
-        let yStep = dy;
-
-        // make step increments smaller until under max step size
-        while (Fx.abs(xStep) > this.maxSingleStep || Fx.abs(yStep) > this.maxSingleStep) {
-            if (Fx.abs(xStep) > this.minSingleStep) {
-                xStep = Fx.idiv(xStep, 2);
-            }
-            if (Fx.abs(yStep) > this.minSingleStep) {
-                yStep = Fx.idiv(yStep, 2);
-            }
-        }
-
-        return new MovingSprite(
-            sprite,
-            sprite._vx,
-            sprite._vy,
-            dx,
-            dy,
-            xStep,
-            yStep
-        );
+        return res;
     }
 
     private spriteCollisions(movedSprites: MovingSprite[], handlers: scene.OverlapHandler[]) {
@@ -395,7 +348,20 @@ class ArcadePhysicsEngine extends PhysicsEngine {
             s._lastY
         );
 
-        const overlappedTiles: tiles.Location[] = [];
+        // the tiles are only needed for tile overlap handlers for the kind of the sprite
+        const overlapHandlers = game.currentScene().tileOverlapHandlers;
+        const overlappedTiles: tiles.Location[] =
+            overlapHandlers && overlapHandlers.some(h => h.spriteKind == s.kind()) ? [] : undefined;
+
+        // nothing to do when there are no walls in the tiles that the probes below look at, in the
+        // box swept by the hitbox since its last position grown by a pixel
+        if (!overlappedTiles && !tm.hasObstacleIn(
+            Fx.toIntShifted(Fx.add(Fx.sub(hbox.left, Fx.oneFx8), Fx.oneHalfFx8), tileScale),
+            Fx.toIntShifted(Fx.add(Fx.sub(Fx.min(hbox.top, Fx.sub(hbox.top, yDiff)), Fx.oneFx8), Fx.oneHalfFx8), tileScale),
+            Fx.toIntShifted(Fx.add(Fx.add(hbox.right, Fx.oneFx8), Fx.oneHalfFx8), tileScale),
+            Fx.toIntShifted(Fx.add(Fx.add(Fx.max(hbox.bottom, Fx.sub(hbox.bottom, yDiff)), Fx.oneFx8), Fx.oneHalfFx8), tileScale)
+        ))
+            return;
 
         if (xDiff !== Fx.zeroFx8) {
             const right = xDiff > Fx.zeroFx8;
@@ -412,34 +378,15 @@ class ArcadePhysicsEngine extends PhysicsEngine {
             const collidedTiles: sprites.StaticObstacle[] = [];
 
             // check collisions with tiles sprite is moving towards horizontally
-            for (
-                let y = Fx.sub(hbox.top, yDiff);
-                y < Fx.iadd(tileSize, Fx.sub(hbox.bottom, yDiff));
-                y = Fx.iadd(tileSize, y)
-            ) {
-                const y0 = Fx.toIntShifted(
-                    Fx.add(
-                        Fx.min(
-                            y,
-                            Fx.sub(
-                                hbox.bottom,
-                                yDiff
-                            )
-                        ),
-                        Fx.oneHalfFx8
-                    ),
-                    tileScale
-                );
-
-                if (tm.isObstacle(x0, y0)) {
-                    const obstacle = tm.getObstacle(x0, y0);
-                    if (!collidedTiles.some(o => o.tileIndex === obstacle.tileIndex)) {
-                        collidedTiles.push(obstacle);
-                    }
-                } else {
-                    overlappedTiles.push(tm.getTile(x0, y0));
-                }
-            }
+            this.probeTiles(
+                tm,
+                x0,
+                Fx.toIntShifted(Fx.add(Fx.sub(hbox.top, yDiff), Fx.oneHalfFx8), tileScale),
+                x0,
+                Fx.toIntShifted(Fx.add(Fx.sub(hbox.bottom, yDiff), Fx.oneHalfFx8), tileScale),
+                collidedTiles,
+                overlappedTiles
+            );
 
             if (collidedTiles.length) {
                 const collisionDirection = right ? CollisionDirection.Right : CollisionDirection.Left;
@@ -494,34 +441,17 @@ class ArcadePhysicsEngine extends PhysicsEngine {
                 tileScale
             );
             const collidedTiles: sprites.StaticObstacle[] = [];
-            const overlappedTiles: tiles.Location[] = [];
 
             // check collisions with tiles sprite is moving towards vertically
-            for (
-                let x = hbox.left;
-                x < Fx.iadd(tileSize, hbox.right);
-                x = Fx.iadd(tileSize, x)
-            ) {
-                const x0 = Fx.toIntShifted(
-                    Fx.add(
-                        Fx.min(
-                            x,
-                            hbox.right
-                        ),
-                        Fx.oneHalfFx8
-                    ),
-                    tileScale
-                );
-
-                if (tm.isObstacle(x0, y0)) {
-                    const obstacle = tm.getObstacle(x0, y0);
-                    if (!collidedTiles.some(o => o.tileIndex === obstacle.tileIndex)) {
-                        collidedTiles.push(obstacle);
-                    }
-                } else {
-                    overlappedTiles.push(tm.getTile(x0, y0));
-                }
-            }
+            this.probeTiles(
+                tm,
+                Fx.toIntShifted(Fx.add(hbox.left, Fx.oneHalfFx8), tileScale),
+                y0,
+                Fx.toIntShifted(Fx.add(hbox.right, Fx.oneHalfFx8), tileScale),
+                y0,
+                collidedTiles,
+                undefined
+            );
 
             if (collidedTiles.length) {
                 const collisionDirection = down ? CollisionDirection.Bottom : CollisionDirection.Top;
@@ -565,45 +495,57 @@ class ArcadePhysicsEngine extends PhysicsEngine {
 
         // Now that we've moved, check all of the tiles underneath the current position
         // for overlaps
-        for (
-            let x = hbox.left;
-            x < Fx.iadd(tileSize, hbox.right);
-            x = Fx.iadd(tileSize, x)
-        ) {
-            const x0 = Fx.toIntShifted(
-                Fx.add(
-                    Fx.min(
-                        x,
-                        hbox.right
-                    ),
-                    Fx.oneHalfFx8
-                ),
-                tileScale
-            );
-            for (
-                let y = hbox.top;
-                y < Fx.iadd(tileSize, hbox.bottom);
-                y = Fx.iadd(tileSize, y)
-            ) {
-                const y0 = Fx.toIntShifted(
-                    Fx.add(
-                        Fx.min(
-                            y,
-                            hbox.bottom
-                        ),
-                        Fx.oneHalfFx8
-                    ),
-                    tileScale
-                );
-
-                if (!tm.isObstacle(x0, y0)) {
-                    overlappedTiles.push(tm.getTile(x0, y0));
-                }
+        if (overlappedTiles) {
+            const top = Fx.toIntShifted(Fx.add(hbox.top, Fx.oneHalfFx8), tileScale);
+            const bottom = Fx.toIntShifted(Fx.add(hbox.bottom, Fx.oneHalfFx8), tileScale);
+            const left = Fx.toIntShifted(Fx.add(hbox.left, Fx.oneHalfFx8), tileScale);
+            const right = Fx.toIntShifted(Fx.add(hbox.right, Fx.oneHalfFx8), tileScale);
+            for (let col = left; col <= right; ++col)
+                this.probeTiles(tm, col, top, col, bottom, undefined, overlappedTiles);
+
+            if (overlappedTiles.length) {
+                this.tilemapOverlaps(s, overlappedTiles);
             }
         }
+    }
 
-        if (overlappedTiles.length) {
-            this.tilemapOverlaps(s, overlappedTiles);
+    /**
+     * Sort the tiles from (col0, row0) to (col1, row1), along a row or a column, into obstacles
+     * (one per tile index) and other tiles; either list can be left out.
+     */
+    private probeTiles(
+        tm: tiles.TileMap,
+        col0: number,
+        row0: number,
+        col1: number,
+        row1: number,
+        collidedTiles: sprites.StaticObstacle[],
+        overlappedTiles: tiles.Location[]
+    ) {
+        const alongRow = row0 === row1;
+        const count = alongRow ? col1 - col0 + 1 : row1 - row0 + 1;
+        // tm.wallMask() looks at up to 32 tiles at a time
+        for (let start = 0; start < count; start += 32) {
+            const n = Math.min(32, count - start);
+            const col = alongRow ? col0 + start : col0;
+            const row = alongRow ? row0 : row0 + start;
+            const walls = tm.wallMask(col, row, alongRow ? col + n - 1 : col, alongRow ? row : row + n - 1);
+            if (!walls && !overlappedTiles)
+                continue;
+            for (let i = 0; i < n; ++i) {
+                const c = alongRow ? col + i : col;
+                const r = alongRow ? row : row + i;
+                if (walls & (1 << i)) {
+                    if (collidedTiles) {
+                        const obstacle = tm.getObstacle(c, r);
+                        if (!collidedTiles.some(o => o.tileIndex === obstacle.tileIndex)) {
+                            collidedTiles.push(obstacle);
+                        }
+                    }
+                } else if (overlappedTiles) {
+                    overlappedTiles.push(tm.getTile(c, r));
+                }
+            }
         }
     }
 
@@ -749,14 +691,4 @@ class ArcadePhysicsEngine extends PhysicsEngine {
         // no trivial adjustment worked; it's going to clip for now
         return false;
     }
-
-    private constrain(v: Fx8) {
-        return Fx.max(
-            Fx.min(
-                this.maxVelocity,
-                v
-            ),
-            this.maxNegativeVelocity
-        );
-    }
 }
@@ -0,0 +1,113 @@
+#include "pxt.h"
+
+// The time spent in each stage of the last PROFILE_FRAMES frames, in us. The scene marks where
+// each stage starts with _mark() from its frame handlers, and the frame ends with _endFrame()
+// after the screen is updated; the time between frames isn't counted.
+#define PROFILE_FRAMES 64
+
+namespace profiler {
+
+// must match FrameStage in metrics.ts
+enum FrameStage {
+    CONTROLLER,
+    PHYSICS,
+    UPDATE,
+    PRE_RENDER,
+    BACKGROUND,
+    SPRITES,
+    RENDERABLES,
+    DIAGNOSTICS,
+    SCREEN,
+    GC,
+    TOTAL,
+    NUM_FRAME_STAGES
+};
+
+// PROFILE_FRAMES frames of NUM_FRAME_STAGES times, a ring; allocated with the first frame
+static uint32_t *frames;
+static uint32_t current[NUM_FRAME_STAGES];
+static uint32_t numFrames;
+static int stage = -1;
+static bool inFrame;
+static uint64_t stageStart, gcAtStart;
+
+/**
+ * Start timing stage of the current frame, and stop timing the previous one.
+ */
+//%
+void _mark(int stage_) {
+    auto now = current_time_us();
+    if (stage >= 0)
+        current[stage] += (uint32_t)(now - stageStart);
+    if (!inFrame) {
+        inFrame = true;
+        gcAtStart = gcPauseTotalUs();
+    }
+    stage = 0 <= stage_ && stage_ < GC ? stage_ : -1;
+    stageStart = now;
+}
+
+/**
+ * End the current frame and keep its times.
+ */
+//%
+void _endFrame() {
+    if (!inFrame)
+        return;
+    _mark(-1);
+    inFrame = false;
+    if (!frames) {
+        frames = (uint32_t *)app_alloc(PROFILE_FRAMES * NUM_FRAME_STAGES * sizeof(uint32_t));
+        if (!frames)
+            return;
+    }
+    // GC pauses happen in the other stages, so they are in the total already
+    current[GC] = (uint32_t)(gcPauseTotalUs() - gcAtStart);
+    uint32_t total = 0;
+    for (int i = 0; i < GC; ++i)
+        total += current[i];
+    current[TOTAL] = total;
+    memcpy(frames + (numFrames % PROFILE_FRAMES) * NUM_FRAME_STAGES, current, sizeof(current));
+    memset(current, 0, sizeof(current));
+    numFrames++;
+}
+
+/**
+ * Forget the frames kept so far.
+ */
+//%
+void _reset() {
+    memset(current, 0, sizeof(current));
+    numFrames = 0;
+    stage = -1;
+    inFrame = false;
+}
+
+/**
+ * The time of each stage, in us, that percentile (0 to 100) of the frames kept take at most, as
+ * Int32LE values; empty when no frame was kept yet.
+ */
+//%
+Buffer _percentiles(int percentile) {
+    int n = min((int)numFrames, PROFILE_FRAMES);
+    if (!frames || n == 0)
+        return mkBuffer(NULL, 0);
+    percentile = max(0, min(100, percentile));
+    auto res = mkBuffer(NULL, NUM_FRAME_STAGES * sizeof(int32_t));
+    auto dst = (int32_t *)res->data;
+    uint32_t times[PROFILE_FRAMES];
+    for (int s = 0; s < NUM_FRAME_STAGES; ++s) {
+        // insertion sort; there are only a few dozen frames
+        for (int i = 0; i < n; ++i) {
+            auto t = frames[i * NUM_FRAME_STAGES + s];
+            int j = i;
+            for (; j > 0 && times[j - 1] > t; --j)
+                times[j] = times[j - 1];
+            times[j] = t;
+        }
+        dst[s] = times[(n - 1) * percentile / 100];
+    }
+    return res;
+}
+
+} // namespace profiler
@@ -78,6 +78,10 @@ namespace scene {
         tileMap: tiles.TileMap;
         allSprites: SpriteLike[];
         private spriteNextId: number;
+        // sprites added or whose z changed since the last frame, to put in their place in allSprites
+        private unsortedSprites: SpriteLike[];
+        // sprites drawn one after another go here, to be drawn at once
+        private spriteBatch: image.DrawList;
         spritesByKind: SparseArray<sprites.SpriteSet>;
         physicsEngine: PhysicsEngine;
         camera: scene.Camera;
@@ -125,9 +129,11 @@ namespace scene {
 
             power.poke(); // keep game alive a little more
             this.allSprites = [];
+            this.unsortedSprites = [];
             this.spriteNextId = 0;
             // update controller state
             this.eventContext.registerFrameHandler(CONTROLLER_PRIORITY, () => {
+                performance._mark(performance.FrameStage.Controller);
                 this._millis += this.eventContext.deltaTimeMillis;
                 control.enablePerfCounter("controller_update")
                 controller.__update(this.eventContext.deltaTime);
@@ -137,15 +143,18 @@ namespace scene {
             // sprite following 14
             // apply physics and collisions 15
             this.eventContext.registerFrameHandler(PHYSICS_PRIORITY, () => {
+                performance._mark(performance.FrameStage.Physics);
                 control.enablePerfCounter("physics and collisions")
                 this.physicsEngine.move(this.eventContext.deltaTime);
             });
+            this.eventContext.registerFrameHandler(PHYSICS_PRIORITY + 1, () => performance._mark(performance.FrameStage.Update));
             // user update interval 19s
 
             // user update 20
 
             // prerender update 55
             this.eventContext.registerFrameHandler(PRE_RENDER_UPDATE_PRIORITY, () => {
+                performance._mark(performance.FrameStage.PreRender);
                 const dt = this.eventContext.deltaTime;
                 this.camera.update();
 
@@ -162,6 +171,7 @@ namespace scene {
             });
             // render diagnostics
             this.eventContext.registerFrameHandler(RENDER_DIAGNOSTICS_PRIORITY, () => {
+                performance._mark(performance.FrameStage.Diagnostics);
                 if (game.stats && control.EventContext.onStats) {
                     control.EventContext.onStats(
                         control.EventContext.lastStats +
@@ -171,11 +181,16 @@ namespace scene {
                 if (game.debug)
                     this.physicsEngine.draw();
                 game.consoleOverlay.draw();
+                performance._drawOverlay();
                 // check for power deep sleep
                 power.checkDeepSleep();
             });
             // update screen
-            this.eventContext.registerFrameHandler(UPDATE_SCREEN_PRIORITY, control.__screen.update);
+            this.eventContext.registerFrameHandler(UPDATE_SCREEN_PRIORITY, () => {
+                performance._mark(performance.FrameStage.Screen);
+                control.__screen.update();
+            });
+            this.eventContext.registerFrameHandler(UPDATE_SCREEN_PRIORITY + 1, performance._endFrame);
             // register additional components
             Scene.initializers.forEach(f => f(this));
         }
@@ -194,6 +209,65 @@ namespace scene {
         addSprite(sprite: SpriteLike) {
             this.allSprites.push(sprite);
             sprite.id = this.spriteNextId++;
+            this._resortSprite(sprite);
+        }
+
+        /**
+         * Put the sprite in its place in the drawing order before the next frame is drawn, eg.
+         * after its z changed. Few such sprites are moved one by one; many make for a full sort.
+         */
+        _resortSprite(sprite: SpriteLike) {
+            const unsorted = this.unsortedSprites;
+            if (!unsorted || (this.flags & Flag.NeedsSorting) || unsorted.indexOf(sprite) >= 0)
+                return;
+            if (unsorted.length >= (this.allSprites.length >> 2)) {
+                this.flags |= Flag.NeedsSorting;
+                unsorted.splice(0, unsorted.length);
+            } else {
+                unsorted.push(sprite);
+            }
+        }
+
+        // index in allSprites of the first sprite drawn after sprite, which isn't in it
+        private sortedIndex(sprite: SpriteLike) {
+            const all = this.allSprites;
+            let lo = 0;
+            let hi = all.length;
+            while (lo < hi) {
+                const mid = (lo + hi) >> 1;
+                const other = all[mid];
+                if ((other.z - sprite.z || other.id - sprite.id) < 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return lo;
+        }
+
+        private drawSpriteBatch() {
+            if (this.spriteBatch.length) {
+                this.spriteBatch.draw(screen);
+                this.spriteBatch.clear();
+            }
+        }
+
+        private sortSprites() {
+            const unsorted = this.unsortedSprites;
+            if (this.flags & Flag.NeedsSorting) {
+                this.allSprites.sortStable(function (a, b) { return a.z - b.z || a.id - b.id; })
+                this.flags &= ~scene.Flag.NeedsSorting;
+            } else if (unsorted.length) {
+                // take them all out first, so that the others are in order; destroyed ones stay out
+                const all = this.allSprites;
+                let n = 0;
+                for (let i = 0; i < unsorted.length; ++i) {
+                    if (all.removeElement(unsorted[i]))
+                        unsorted[n++] = unsorted[i];
+                }
+                for (let i = 0; i < n; ++i)
+                    all.insertAt(this.sortedIndex(unsorted[i]), unsorted[i]);
+            }
+            unsorted.splice(0, unsorted.length);
         }
 
         destroy() {
@@ -201,6 +275,7 @@ namespace scene {
             this.background = undefined;
             this.tileMap = undefined;
             this.allSprites = undefined;
+            this.unsortedSprites = undefined;
             this.spriteNextId = undefined;
             this.spritesByKind = undefined;
             this.physicsEngine = undefined;
@@ -225,6 +300,7 @@ namespace scene {
             this.flags |= scene.Flag.IsRendering;
 
             control.enablePerfCounter("render background")
+            performance._mark(performance.FrameStage.Background);
             if ((this.flags & scene.Flag.SeeThrough) && this.previousScene) {
                 this.previousScene.render();
             } else {
@@ -232,15 +308,24 @@ namespace scene {
             }
 
             control.enablePerfCounter("sprite sort")
-            if (this.flags & Flag.NeedsSorting) {
-                this.allSprites.sort(function (a, b) { return a.z - b.z || a.id - b.id; })
-                this.flags &= ~scene.Flag.NeedsSorting;
-            }
+            performance._mark(performance.FrameStage.Sprites);
+            this.sortSprites();
 
             control.enablePerfCounter("sprite draw")
+            if (!this.spriteBatch)
+                this.spriteBatch = new image.DrawList();
+            const batch = this.spriteBatch;
             for (const s of this.allSprites) {
+                if (s instanceof sprites.BaseSprite && (s as sprites.BaseSprite).__drawBatched(this.camera, batch))
+                    continue;
+                this.drawSpriteBatch();
+                if (performance._profiling)
+                    performance._mark(s instanceof Sprite ? performance.FrameStage.Sprites : performance.FrameStage.Renderables);
                 s.__draw(this.camera);
+                if (performance._profiling)
+                    performance._mark(performance.FrameStage.Sprites);
             }
+            this.drawSpriteBatch();
 
             this.flags &= ~scene.Flag.IsRendering;
         }
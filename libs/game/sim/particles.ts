@@ -0,0 +1,59 @@
+namespace pxsim.particles {
+    // must match PoolField and ParticleField in particles.cpp
+    const FIXED_DT = 0, AX = 1, AY = 2, LEFT = 3, TOP = 4
+    const NUM_POOL_FIELDS = 5
+    const X = 0, Y = 1, VX = 2, VY = 3, LIFESPAN = 4, COLOR = 5
+    const NUM_FIELDS = 6
+
+    function fxMul(a: number, b: number) {
+        return Math.imul(a, b) >> 8
+    }
+
+    function view(pool: RefBuffer) {
+        return new DataView(pool.data.buffer, pool.data.byteOffset, pool.data.length)
+    }
+
+    function poolLength(pool: RefBuffer, n: number) {
+        return Math.max(0, Math.min(n, ((pool.data.length / 4 - NUM_POOL_FIELDS) / NUM_FIELDS) | 0))
+    }
+
+    export function _updateParticles(pool: RefBuffer, n: number, dt: number) {
+        n = poolLength(pool, n)
+        if (n <= 0)
+            return 0
+        const v = view(pool)
+        const fixedDt = v.getInt32(FIXED_DT * 4, true)
+        const ax = v.getInt32(AX * 4, true), ay = v.getInt32(AY * 4, true)
+        const get = (i: number, field: number) => v.getInt32((NUM_POOL_FIELDS + i * NUM_FIELDS + field) * 4, true)
+        const set = (i: number, field: number, val: number) => v.setInt32((NUM_POOL_FIELDS + i * NUM_FIELDS + field) * 4, val | 0, true)
+        let left = 0
+        for (let i = 0; i < n; ++i) {
+            const lifespan = get(i, LIFESPAN) - dt
+            if (lifespan <= 0)
+                continue
+            const vx = get(i, VX) + fxMul(ax, fixedDt)
+            const vy = get(i, VY) + fxMul(ay, fixedDt)
+            set(left, X, get(i, X) + fxMul(vx, fixedDt))
+            set(left, Y, get(i, Y) + fxMul(vy, fixedDt))
+            set(left, VX, vx)
+            set(left, VY, vy)
+            set(left, LIFESPAN, lifespan)
+            set(left, COLOR, get(i, COLOR))
+            left++
+        }
+        return left
+    }
+
+    export function _drawParticles(pool: RefBuffer, n: number, target: RefImage) {
+        n = poolLength(pool, n)
+        if (n <= 0)
+            return
+        const v = view(pool)
+        const left = v.getInt32(LEFT * 4, true), top = v.getInt32(TOP * 4, true)
+        const get = (i: number, field: number) => v.getInt32((NUM_POOL_FIELDS + i * NUM_FIELDS + field) * 4, true)
+        for (let i = n - 1; i >= 0; --i) {
+            if (get(i, LIFESPAN) > 0)
+                ImageMethods.setPixel(target, (get(i, X) - left + 128) >> 8, (get(i, Y) - top + 128) >> 8, get(i, COLOR))
+        }
+    }
+}
@@ -0,0 +1,70 @@
+namespace pxsim.sprites {
+    // must match PhysicsHeader and PhysicsField in physics.cpp
+    const MAX_VELOCITY = 0, MIN_STEP = 1, MAX_STEP = 2
+    const NUM_HEADER = 3
+    const VX = 0, VY = 1, AX = 2, AY = 3, FX = 4, FY = 5, DX = 6, DY = 7, XSTEP = 8, YSTEP = 9
+    const NUM_FIELDS = 10
+
+    function fxMul(a: number, b: number) {
+        return Math.imul(a, b) >> 8
+    }
+
+    function idiv(a: number, b: number) {
+        return (a / b) | 0
+    }
+
+    function accelerate(v: number, a: number, f: number, dt: number) {
+        if (a)
+            return (v + idiv(fxMul(a, dt), 1000)) | 0
+        if (!f)
+            return v
+        f = idiv(fxMul(f, dt), 1000)
+        if (v < f)
+            return Math.min(0, v + f)
+        if (v > f)
+            return Math.max(0, v - f)
+        return 0
+    }
+
+    export function _physicsStep(state: RefBuffer, n: number, dt: number) {
+        if (n <= 0 || state.data.length < (NUM_HEADER + n * NUM_FIELDS) * 4)
+            return
+        const v = new DataView(state.data.buffer, state.data.byteOffset, state.data.length)
+        const maxVelocity = v.getInt32(MAX_VELOCITY * 4, true)
+        const minStep = v.getInt32(MIN_STEP * 4, true)
+        const maxStep = v.getInt32(MAX_STEP * 4, true)
+        const get = (field: number, i: number) => v.getInt32((NUM_HEADER + field * n + i) * 4, true)
+        const set = (field: number, i: number, val: number) => v.setInt32((NUM_HEADER + field * n + i) * 4, val, true)
+        const constrain = (val: number) => Math.max(-maxVelocity, Math.min(maxVelocity, val))
+        const dt2 = idiv(dt, 2)
+
+        for (let i = 0; i < n; ++i) {
+            const ovx = constrain(get(VX, i))
+            const ovy = constrain(get(VY, i))
+            const vx = constrain(accelerate(get(VX, i), get(AX, i), get(FX, i), dt))
+            const vy = constrain(accelerate(get(VY, i), get(AY, i), get(FY, i), dt))
+            const dx = idiv(fxMul(vx + ovx, dt2), 1000)
+            const dy = idiv(fxMul(vy + ovy, dt2), 1000)
+            let xs = dx, ys = dy
+            while (Math.abs(xs) > maxStep || Math.abs(ys) > maxStep) {
+                let halved = false
+                if (Math.abs(xs) > minStep) {
+                    xs = idiv(xs, 2)
+                    halved = true
+                }
+                if (Math.abs(ys) > minStep) {
+                    ys = idiv(ys, 2)
+                    halved = true
+                }
+                if (!halved)
+                    break
+            }
+            set(VX, i, vx)
+            set(VY, i, vy)
+            set(DX, i, dx)
+            set(DY, i, dy)
+            set(XSTEP, i, xs)
+            set(YSTEP, i, ys)
+        }
+    }
+}
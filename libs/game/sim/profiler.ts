@@ -0,0 +1,66 @@
+namespace pxsim.profiler {
+    // see profiler.cpp; must match FrameStage in metrics.ts
+    const GC = 9, TOTAL = 10, NUM_STAGES = 11
+    const FRAMES = 64
+
+    let frames: number[][] = []
+    let current: number[] = []
+    let numFrames = 0
+    let stage = -1
+    let inFrame = false
+    let stageStart = 0
+
+    function now() {
+        return Math.round(performance.now() * 1000)
+    }
+
+    export function _mark(stage_: number) {
+        const t = now()
+        if (stage >= 0)
+            current[stage] = (current[stage] || 0) + t - stageStart
+        inFrame = true
+        stage = 0 <= stage_ && stage_ < GC ? stage_ : -1
+        stageStart = t
+    }
+
+    export function _endFrame() {
+        if (!inFrame)
+            return
+        _mark(-1)
+        inFrame = false
+        // there are no GC pauses to measure in the simulator
+        const times: number[] = []
+        let total = 0
+        for (let i = 0; i < NUM_STAGES; ++i) {
+            times.push(current[i] || 0)
+            if (i < GC)
+                total += times[i]
+        }
+        times[TOTAL] = total
+        frames[numFrames % FRAMES] = times
+        current = []
+        numFrames++
+    }
+
+    export function _reset() {
+        frames = []
+        current = []
+        numFrames = 0
+        stage = -1
+        inFrame = false
+    }
+
+    export function _percentiles(percentile: number) {
+        const n = Math.min(numFrames, FRAMES)
+        if (!n)
+            return new RefBuffer(new Uint8Array(0))
+        percentile = Math.max(0, Math.min(100, percentile))
+        const res = new Uint8Array(NUM_STAGES * 4)
+        const v = new DataView(res.buffer)
+        for (let s = 0; s < NUM_STAGES; ++s) {
+            const times = frames.slice(0, n).map(f => f[s]).sort((a, b) => a - b)
+            v.setInt32(4 * s, times[((n - 1) * percentile / 100) | 0], true)
+        }
+        return new RefBuffer(res)
+    }
+}
@@ -0,0 +1,21 @@
+namespace pxsim.sprites {
+    export function _overlapPairs(boxes: RefBuffer, n: number): RefBuffer {
+        const v = new DataView(boxes.data.buffer, boxes.data.byteOffset, boxes.data.length)
+        n = Math.min(n, Math.floor(boxes.data.length / 12))
+        const pairs: number[] = []
+        for (let i = 0; i < n; ++i)
+            for (let j = i + 1; j < n; ++j) {
+                const a = 12 * i, b = 12 * j
+                if (v.getInt16(b, true) < v.getInt16(a + 4, true) && v.getInt16(a, true) < v.getInt16(b + 4, true)
+                    && v.getInt16(b + 2, true) < v.getInt16(a + 6, true) && v.getInt16(a + 2, true) < v.getInt16(b + 6, true)
+                    && (v.getUint32(a + 8, true) & v.getUint32(b + 8, true)))
+                    pairs.push(i, j)
+            }
+        const r = new Uint8Array(pairs.length * 2)
+        for (let k = 0; k < pairs.length; ++k) {
+            r[2 * k] = pairs[k] & 0xff
+            r[2 * k + 1] = pairs[k] >> 8
+        }
+        return new RefBuffer(r)
+    }
+}
@@ -0,0 +1,226 @@
+namespace pxsim.tiles {
+    // see tilemap.cpp
+    function stride(cols: number) {
+        return (cols + 31) >> 5
+    }
+
+    function isWallBit(bits: RefBuffer, cols: number, rows: number, col: number, row: number) {
+        if (col < 0 || col >= cols || row < 0 || row >= rows)
+            return true
+        const d = bits.data
+        const off = (row * stride(cols) + (col >> 5)) * 4 + ((col & 31) >> 3)
+        return !!((d[off] >> (col & 7)) & 1)
+    }
+
+    function XX(v: number) { return (v << 16) >> 16 }
+    function YY(v: number) { return v >> 16 }
+
+    function validWallBits(bits: RefBuffer, cols: number, rows: number) {
+        return cols > 0 && rows > 0 && bits.data.length >= stride(cols) * rows * 4
+    }
+
+    export function _wallBits(layers: RefImage, cols: number, rows: number, wall: number) {
+        if (cols <= 0 || rows <= 0)
+            return new RefBuffer(new Uint8Array(0))
+        const s = stride(cols)
+        const data = new Uint8Array(s * rows * 4)
+        for (let row = 0; row < rows; ++row)
+            for (let col = 0; col < cols; ++col)
+                if (ImageMethods.getPixel(layers, col, row) == wall)
+                    data[(row * s + (col >> 5)) * 4 + ((col & 31) >> 3)] |= 1 << (col & 7)
+        return new RefBuffer(data)
+    }
+
+    export function _wallMask(bits: RefBuffer, colsRows: number, from: number, to: number) {
+        const cols = XX(colsRows), rows = YY(colsRows)
+        const col0 = XX(from), row0 = YY(from), col1 = XX(to), row1 = YY(to)
+        if (!validWallBits(bits, cols, rows))
+            return 0
+        const dc = Math.sign(col1 - col0), dr = Math.sign(row1 - row0)
+        if (dc && dr)
+            return 0
+        const count = Math.min(32, Math.max(Math.abs(col1 - col0), Math.abs(row1 - row0)) + 1)
+        let mask = 0
+        for (let i = 0; i < count; ++i)
+            if (isWallBit(bits, cols, rows, col0 + i * dc, row0 + i * dr))
+                mask |= 1 << i
+        return mask
+    }
+
+    export function _wallInRect(bits: RefBuffer, colsRows: number, from: number, to: number) {
+        const cols = XX(colsRows), rows = YY(colsRows)
+        const col0 = XX(from), row0 = YY(from), col1 = XX(to), row1 = YY(to)
+        if (!validWallBits(bits, cols, rows) || col1 < col0 || row1 < row0)
+            return false
+        for (let row = row0; row <= row1; ++row)
+            for (let col = col0; col <= col1; ++col)
+                if (isWallBit(bits, cols, rows, col, row))
+                    return true
+        return false
+    }
+
+    // see PathSearch in tilemap.cpp
+    const HEADER = 24, CLOSED = 4, UNSEEN = 0xffff, MAX_TILES = 0xfffe
+    const DCOL = [1, 0, -1, 0], DROW = [0, 1, 0, -1]
+
+    class Path {
+        v: DataView
+        n: number
+        cols: number
+        rows: number
+        constructor(state: RefBuffer) {
+            const d = state.data
+            this.v = new DataView(d.buffer, d.byteOffset, d.length)
+            if (d.length < HEADER) return
+            this.cols = this.v.getInt32(0, true)
+            this.rows = this.v.getInt32(4, true)
+            this.n = this.cols * this.rows
+            if (!(this.n > 0 && this.n <= MAX_TILES && d.length >= HEADER + this.n * 7))
+                this.n = 0
+        }
+        get start() { return this.v.getInt32(8, true) }
+        get goal() { return this.v.getInt32(12, true) }
+        get heapSize() { return this.v.getInt32(16, true) }
+        set heapSize(v: number) { this.v.setInt32(16, v, true) }
+        get status() { return this.v.getInt32(20, true) }
+        set status(v: number) { this.v.setInt32(20, v, true) }
+        g(i: number) { return this.v.getUint16(HEADER + 2 * i, true) }
+        setG(i: number, g: number) { this.v.setUint16(HEADER + 2 * i, g, true) }
+        heapPos(i: number) { return this.v.getUint16(HEADER + 2 * (this.n + i), true) }
+        setHeapPos(i: number, p: number) { this.v.setUint16(HEADER + 2 * (this.n + i), p, true) }
+        heap(pos: number) { return this.v.getUint16(HEADER + 2 * (2 * this.n + pos), true) }
+        from(i: number) { return this.v.getUint8(HEADER + 6 * this.n + i) }
+        setFrom(i: number, f: number) { this.v.setUint8(HEADER + 6 * this.n + i, f) }
+
+        estimate(i: number) {
+            const goal = this.goal
+            return Math.abs(i % this.cols - goal % this.cols) + Math.abs(((i / this.cols) | 0) - ((goal / this.cols) | 0))
+        }
+        before(a: number, b: number) {
+            const ha = this.estimate(a), hb = this.estimate(b)
+            const fa = this.g(a) + ha, fb = this.g(b) + hb
+            return fa < fb || (fa == fb && ha < hb)
+        }
+        heapSet(pos: number, tile: number) {
+            this.v.setUint16(HEADER + 2 * (2 * this.n + pos), tile, true)
+            this.setHeapPos(tile, pos + 1)
+        }
+        siftUp(pos: number) {
+            const tile = this.heap(pos)
+            while (pos > 0) {
+                const parent = (pos - 1) >> 1
+                if (!this.before(tile, this.heap(parent)))
+                    break
+                this.heapSet(pos, this.heap(parent))
+                pos = parent
+            }
+            this.heapSet(pos, tile)
+        }
+        pop() {
+            const top = this.heap(0)
+            this.setHeapPos(top, 0)
+            const n = --this.heapSize
+            if (n <= 0)
+                return top
+            const tile = this.heap(n)
+            let pos = 0
+            for (;;) {
+                let child = 2 * pos + 1
+                if (child >= n)
+                    break
+                if (child + 1 < n && this.before(this.heap(child + 1), this.heap(child)))
+                    child++
+                if (!this.before(this.heap(child), tile))
+                    break
+                this.heapSet(pos, this.heap(child))
+                pos = child
+            }
+            this.heapSet(pos, tile)
+            return top
+        }
+        reach(tile: number, g: number, dir: number) {
+            this.setG(tile, g)
+            this.setFrom(tile, (this.from(tile) & CLOSED) | dir)
+            if (this.heapPos(tile)) {
+                this.siftUp(this.heapPos(tile) - 1)
+            } else {
+                const pos = this.heapSize++
+                this.heapSet(pos, tile)
+                this.siftUp(pos)
+            }
+        }
+    }
+
+    export function _pathStart(colsRows: number, from: number, to: number) {
+        const cols = XX(colsRows), rows = YY(colsRows)
+        const fromCol = XX(from), fromRow = YY(from), toCol = XX(to), toRow = YY(to)
+        const n = cols * rows
+        if (cols <= 0 || rows <= 0 || n > MAX_TILES || fromCol < 0 || fromCol >= cols ||
+            fromRow < 0 || fromRow >= rows || toCol < 0 || toCol >= cols || toRow < 0 || toRow >= rows)
+            return undefined
+        const state = new RefBuffer(new Uint8Array(HEADER + 7 * n))
+        const v = new DataView(state.data.buffer)
+        v.setInt32(0, cols, true)
+        v.setInt32(4, rows, true)
+        v.setInt32(8, fromCol + fromRow * cols, true)
+        v.setInt32(12, toCol + toRow * cols, true)
+        const p = new Path(state)
+        for (let i = 0; i < n; ++i)
+            p.setG(i, UNSEEN)
+        p.reach(p.start, 0, 0)
+        return state
+    }
+
+    export function _pathStep(state: RefBuffer, bits: RefBuffer, budget: number) {
+        const p = new Path(state)
+        if (!p.n)
+            return -1
+        const cols = p.cols, rows = p.rows
+        if (!validWallBits(bits, cols, rows) || isWallBit(bits, cols, rows, p.goal % cols, (p.goal / cols) | 0))
+            p.status = -1
+        while (!p.status && budget-- > 0) {
+            if (!p.heapSize) {
+                p.status = -1
+                break
+            }
+            const tile = p.pop()
+            if (tile == p.goal) {
+                p.status = 1
+                break
+            }
+            p.setFrom(tile, p.from(tile) | CLOSED)
+            const col = tile % cols, row = (tile / cols) | 0
+            for (let dir = 0; dir < 4; ++dir) {
+                const c = col + DCOL[dir], r = row + DROW[dir]
+                if (isWallBit(bits, cols, rows, c, r))
+                    continue
+                const next = c + r * cols
+                if (p.from(next) & CLOSED)
+                    continue
+                const g = p.g(tile) + 1
+                if (p.g(next) == UNSEEN || g < p.g(next))
+                    p.reach(next, g, dir)
+            }
+        }
+        return p.status
+    }
+
+    export function _pathResult(state: RefBuffer) {
+        const p = new Path(state)
+        if (!p.n || p.status != 1)
+            return undefined
+        const cols = p.cols
+        const len = p.g(p.goal) + 1
+        const res = new Uint8Array(4 * len)
+        const v = new DataView(res.buffer)
+        let tile = p.goal
+        for (let i = len - 1; i >= 0; --i) {
+            const col = tile % cols, row = (tile / cols) | 0
+            v.setUint16(4 * i, col, true)
+            v.setUint16(4 * i + 2, row, true)
+            const dir = p.from(tile) & 3
+            tile = (col - DCOL[dir]) + (row - DROW[dir]) * cols
+        }
+        return new RefBuffer(res)
+    }
+}
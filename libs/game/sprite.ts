@@ -19,6 +19,10 @@ enum SpriteFlag {
     NoTileCollisions = sprites.Flag.NoTileCollisions,
     //% block="no sprite overlaps"
     NoSpriteOverlaps = sprites.Flag.NoSpriteOverlaps,
+    //% block="flip x"
+    FlipX = sprites.Flag.FlipX,
+    //% block="flip y"
+    FlipY = sprites.Flag.FlipY,
 }
 
 enum TileDirection {
@@ -644,6 +648,23 @@ class Sprite extends sprites.BaseSprite {
         return this.right - ox < 0 || this.bottom - oy < 0 || this.left - ox > screen.width || this.top - oy > screen.height;
     }
 
+    private flip() {
+        return ((this.flags & sprites.Flag.FlipX) ? image.Flip.X : image.Flip.None)
+            | ((this.flags & sprites.Flag.FlipY) ? image.Flip.Y : image.Flip.None);
+    }
+
+    __drawBatched(camera: scene.Camera, list: image.DrawList) {
+        if ((this.flags & SpriteFlag.ShowPhysics) || game.debug)
+            return false;
+        if (this.__visible()) {
+            const ox = (this.flags & sprites.Flag.RelativeToCamera) ? 0 : camera.drawOffsetX;
+            const oy = (this.flags & sprites.Flag.RelativeToCamera) ? 0 : camera.drawOffsetY;
+            // off-screen sprites are skipped when the list is drawn
+            list.drawFlippedImage(this._image, this.left - ox, this.top - oy, this.flip());
+        }
+        return true;
+    }
+
     __drawCore(camera: scene.Camera) {
         if (this.isOutOfScreen(camera)) return;
 
@@ -653,7 +674,13 @@ class Sprite extends sprites.BaseSprite {
         const l = this.left - ox;
         const t = this.top - oy;
 
-        screen.drawTransparentImage(this._image, l, t)
+        if (this.flags & (sprites.Flag.FlipX | sprites.Flag.FlipY)) {
+            const list = new image.DrawList();
+            list.drawFlippedImage(this._image, l, t, this.flip());
+            list.draw(screen);
+        } else {
+            screen.drawTransparentImage(this._image, l, t)
+        }
 
         if (this.flags & SpriteFlag.ShowPhysics) {
             const font = image.font5;
@@ -734,9 +761,13 @@ class Sprite extends sprites.BaseSprite {
     //% flag.defl=SpriteFlag.StayInScreen
     //% help=sprites/sprite/set-flag
     setFlag(flag: SpriteFlag, on: boolean) {
+        const old = this.flags;
         if (on) this.flags |= flag
         else this.flags = ~(~this.flags | flag);
 
+        if ((old ^ this.flags) & (sprites.Flag.FlipX | sprites.Flag.FlipY))
+            this.setHitbox();
+
         if (flag === SpriteFlag.RelativeToCamera && this.sayBubbleSprite) {
             this.sayBubbleSprite.setFlag(SpriteFlag.RelativeToCamera, on);
         }
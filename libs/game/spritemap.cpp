@@ -0,0 +1,74 @@
+#include "pxt.h"
+
+namespace sprites {
+
+// must match SpriteMap in spritemap.ts; right and bottom are exclusive
+struct SpriteBox {
+    int16_t left, top, right, bottom;
+    uint32_t layer;
+};
+
+static SpriteBox spriteBox(Buffer boxes, int i) {
+    SpriteBox b;
+    memcpy(&b, boxes->data + i * sizeof(SpriteBox), sizeof(b));
+    return b;
+}
+
+// visit the overlapping pairs of order[0..n-1], which is sorted by left, writing them to pairs
+// unless it's NULL; returns the number of pairs
+static int sweepPairs(Buffer boxes, const uint16_t *order, int n, uint16_t *pairs) {
+    int count = 0;
+    for (int i = 0; i < n; ++i) {
+        auto a = spriteBox(boxes, order[i]);
+        for (int j = i + 1; j < n; ++j) {
+            auto b = spriteBox(boxes, order[j]);
+            if (b.left >= a.right)
+                break;
+            if (b.top < a.bottom && a.top < b.bottom && (a.layer & b.layer)) {
+                if (pairs) {
+                    *pairs++ = order[i];
+                    *pairs++ = order[j];
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * Find the pairs of overlapping boxes among the first n in boxes, for broad-phase collision
+ * detection. Boxes are Int16LE left, top, right and bottom (exclusive), followed by UInt32LE layer
+ * bits; only ones with common layers are paired. Returns UInt16LE index pairs.
+ */
+//%
+Buffer _overlapPairs(Buffer boxes, int n) {
+    n = min(n, min((int)(boxes->length / sizeof(SpriteBox)), 0xffff));
+    if (n < 2)
+        return mkBuffer(NULL, 0);
+
+    // sort and sweep: along x, only boxes starting before the current one ends can overlap it
+    auto order = (uint16_t *)xmalloc(n * sizeof(uint16_t));
+    for (int i = 0; i < n; ++i)
+        order[i] = i;
+    // shell sort by left
+    for (int gap = n >> 1; gap > 0; gap >>= 1)
+        for (int i = gap; i < n; ++i) {
+            auto k = order[i];
+            int left = spriteBox(boxes, k).left;
+            int j = i;
+            while (j >= gap && spriteBox(boxes, order[j - gap]).left > left) {
+                order[j] = order[j - gap];
+                j -= gap;
+            }
+            order[j] = k;
+        }
+
+    auto count = sweepPairs(boxes, order, n, NULL);
+    auto r = mkBuffer(NULL, count * 2 * sizeof(uint16_t));
+    sweepPairs(boxes, order, n, (uint16_t *)r->data);
+    xfree(order);
+    return r;
+}
+
+} // namespace sprites
@@ -1,27 +1,37 @@
 namespace sprites {
+    // must match SpriteBox in spritemap.cpp
+    const BOX_SIZE = 12
+
+    //% shim=sprites::_overlapPairs
+    declare function _overlapPairs(boxes: Buffer, n: number): Buffer;
+
     export class SpriteMap {
-        private cellWidth: number;
-        private cellHeight: number;
-        private rowCount: number;
-        private columnCount: number;
-        private buckets: Sprite[][];
+        private sprites: Sprite[];
+        private boxes: Buffer;
+        // neighbors of each of the sprites, or null when they need to be recomputed
+        private candidates: Sprite[][];
 
         constructor() {
-            this.buckets = [];
+            this.sprites = [];
+            this.candidates = null;
         }
 
         /**
          * Returns a potential list of neighbors
          */
         neighbors(sprite: Sprite): Sprite[] {
-            const n: Sprite[] = [];
-            const layer = sprite.layer;
-            this.mergeAtKey(sprite.left, sprite.top, layer, n)
-            this.mergeAtKey(sprite.left, sprite.bottom, layer, n)
-            this.mergeAtKey(sprite.right, sprite.top, layer, n)
-            this.mergeAtKey(sprite.right, sprite.bottom, layer, n)
-            n.removeElement(sprite);
-            return n;
+            const i = this.sprites.indexOf(sprite);
+            if (i < 0) {
+                // not in the map itself, so not found by the broad-phase
+                const n: Sprite[] = [];
+                for (const other of this.sprites)
+                    if ((other.layer & sprite.layer) && SpriteMap.boxesOverlap(sprite, other))
+                        n.push(other);
+                return n;
+            }
+            if (!this.candidates)
+                this.findCandidates();
+            return this.candidates[i] || [];
         }
 
         /**
@@ -35,83 +45,61 @@ namespace sprites {
         }
 
         draw() {
-            for (let x = 0; x < this.columnCount; ++x) {
-                for (let y = 0; y < this.rowCount; ++y) {
-                    const left = x * this.cellWidth;
-                    const top = y * this.cellHeight;
-                    const k = this.key(left, top);
-                    const b = this.buckets[k];
-                    if (b && b.length)
-                        screen.drawRect(left, top, this.cellWidth, this.cellHeight, 5);
-                }
-            }
-        }
-
-        /**
-         * Recompute hashes for all objects
-         */
-        resizeBuckets(sprites: Sprite[]) {
-            // rescale buckets
-            let maxWidth = 0;
-            let maxHeight = 0;
-            for (const sprite of sprites) {
-                if (sprite.width > maxWidth) maxWidth = sprite.width;
-                if (sprite.height > maxHeight) maxHeight = sprite.height;
-            }
-
-            const tMap = game.currentScene().tileMap;
-
-            const areaWidth = tMap ? tMap.areaWidth() : screen.width;
-            const areaHeight = tMap ? tMap.areaHeight() : screen.height;
-
-            this.cellWidth = Math.clamp(8, areaWidth >> 2, maxWidth * 2);
-            this.cellHeight = Math.clamp(8, areaHeight >> 2, maxHeight * 2);
-            this.rowCount = Math.idiv(areaHeight, this.cellHeight);
-            this.columnCount = Math.idiv(areaWidth, this.cellWidth);
+            for (const sprite of this.sprites)
+                screen.drawRect(sprite.left, sprite.top, sprite.width, sprite.height, 5);
         }
 
         clear() {
-            this.buckets = [];
+            this.sprites = [];
+            this.candidates = null;
         }
 
-        private key(x: number, y: number): number {
-            const xi = Math.clamp(0, this.columnCount, Math.idiv(x, this.cellWidth));
-            const yi = Math.clamp(0, this.rowCount, Math.idiv(y, this.cellHeight));
-            return xi + yi * this.columnCount;
+        insertAABB(sprite: Sprite) {
+            if (this.sprites.indexOf(sprite) < 0)
+                this.sprites.push(sprite);
+            // sprites are inserted again whenever they move
+            this.candidates = null;
         }
 
-        private insertAtKey(x: number, y: number, sprite: Sprite) {
-            const k = this.key(x, y);
-            let bucket = this.buckets[k];
-            if (!bucket)
-                bucket = this.buckets[k] = [];
-            if (bucket.indexOf(sprite) < 0)
-                bucket.push(sprite);
+        // box of the pixels the sprite may cover; one larger to the right and bottom, as
+        // overlapsWith() rounds the difference of the positions rather than each of them
+        private static writeBox(boxes: Buffer, off: number, sprite: Sprite) {
+            const left = Math.clamp(-30000, 30000, Math.floor(sprite.left));
+            const top = Math.clamp(-30000, 30000, Math.floor(sprite.top));
+            boxes.setNumber(NumberFormat.Int16LE, off, left);
+            boxes.setNumber(NumberFormat.Int16LE, off + 2, top);
+            boxes.setNumber(NumberFormat.Int16LE, off + 4, Math.min(32767, left + sprite.width + 1));
+            boxes.setNumber(NumberFormat.Int16LE, off + 6, Math.min(32767, top + sprite.height + 1));
+            boxes.setNumber(NumberFormat.UInt32LE, off + 8, sprite.layer);
         }
 
-        insertAABB(sprite: Sprite) {
-            const left = sprite.left;
-            const top = sprite.top;
-            const xn = Math.idiv(sprite.width + this.cellWidth - 1, this.cellWidth);
-            const yn = Math.idiv(sprite.height + this.cellHeight - 1, this.cellHeight);
-            for (let x = 0; x <= xn; x++)
-                for (let y = 0; y <= yn; y++)
-                    this.insertAtKey(left + Math.min(sprite.width, x * this.cellWidth), top + Math.min(sprite.height, y * this.cellHeight), sprite)
+        private static boxesOverlap(a: Sprite, b: Sprite) {
+            return a.left < b.left + b.width + 1 && b.left < a.left + a.width + 1
+                && a.top < b.top + b.height + 1 && b.top < a.top + a.height + 1;
         }
 
-        private mergeAtKey(x: number, y: number, layer: number, n: Sprite[]) {
-            const k = this.key(x, y);
-            const bucket = this.buckets[k];
-            if (bucket) {
-                for (const sprite of bucket)
-                    if ((sprite.layer & layer)
-                        && n.indexOf(sprite) < 0)
-                        n.push(sprite);
+        private findCandidates() {
+            const n = this.sprites.length;
+            if (!this.boxes || this.boxes.length < n * BOX_SIZE)
+                this.boxes = control.createBuffer(Math.max(32, 2 * n) * BOX_SIZE);
+            for (let i = 0; i < n; ++i)
+                SpriteMap.writeBox(this.boxes, i * BOX_SIZE, this.sprites[i]);
+
+            const candidates: Sprite[][] = [];
+            const pairs = _overlapPairs(this.boxes, n);
+            for (let p = 0; p < pairs.length; p += 4) {
+                const i = pairs.getNumber(NumberFormat.UInt16LE, p);
+                const j = pairs.getNumber(NumberFormat.UInt16LE, p + 2);
+                if (!candidates[i]) candidates[i] = [];
+                if (!candidates[j]) candidates[j] = [];
+                candidates[i].push(this.sprites[j]);
+                candidates[j].push(this.sprites[i]);
             }
+            this.candidates = candidates;
         }
 
         toString() {
-            return `${this.buckets.length} buckets, ${this.buckets.filter(b => !!b).length} filled`;
+            return `${this.sprites.length} sprites`;
         }
     }
-}
\ No newline at end of file
+}
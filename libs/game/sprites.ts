@@ -154,6 +154,8 @@ namespace sprites {
         RelativeToCamera = 1 << 9, // draw relative to the camera, not the world (e.g. HUD elements)
         NoTileCollisions = 1 << 10, // No collisions or overlaps with tiles
         NoSpriteOverlaps = 1 << 11, // No overlaps with other sprites
+        FlipX = 1 << 12, // draw the image mirrored horizontally
+        FlipY = 1 << 13, // draw the image mirrored vertically
         Ghost = sprites.Flag.NoSpriteOverlaps | sprites.Flag.NoTileCollisions, // doesn't collide with other sprites or walls
     }
 }
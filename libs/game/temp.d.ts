@@ -9,9 +9,11 @@ declare interface Array<T> {
     pop(): T;
     forEach(cb: (e: T, index: number) => void): void;
     filter(cb: (e: T) => boolean): Array<T>;
-    removeElement(e: T): void;
+    removeElement(e: T): boolean;
+    insertAt(index: number, e: T): void;
     indexOf(e: T): number;
     sort(cb: (a: T, b: T) => number): Array<T>;
+    sortStable(cb?: (a: T, b: T) => number): Array<T>;
     shift(): T;
     some(cb: (a: T) => boolean): boolean;
 }
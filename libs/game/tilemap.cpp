@@ -0,0 +1,314 @@
+#include "pxt.h"
+
+namespace ImageMethods {
+int getPixel(Image_ img, int x, int y);
+}
+
+// The walls of a tile map as bits, one per tile, built from its layers image by _wallBits() and
+// kept up to date by TileMapData.setWall() in tilemap.ts: each row of the map is a run of uint32
+// words, and the tile at col is bit (col & 31) of word (col >> 5). Tiles outside of the map count
+// as walls.
+
+// shims take at most 4 arguments, so the sizes and positions are packed as two int16s, as with
+// the pack() of tilemap.ts
+#define XX(v) (int)(((int16_t)(v)))
+#define YY(v) (int)(((int16_t)(((int32_t)(v)) >> 16)))
+
+namespace tiles {
+
+static inline int wallStride(int cols) {
+    return (cols + 31) >> 5;
+}
+
+static inline bool validWallBits(Buffer bits, int cols, int rows) {
+    return cols > 0 && rows > 0 && bits->length >= wallStride(cols) * rows * 4;
+}
+
+static inline bool isWallBit(Buffer bits, int cols, int rows, int col, int row) {
+    if (col < 0 || col >= cols || row < 0 || row >= rows)
+        return true;
+    auto words = (uint32_t *)bits->data + row * wallStride(cols);
+    return (words[col >> 5] >> (col & 31)) & 1;
+}
+
+// n (at most 32) bits for the tiles from col on in row, a word or two at a time
+static uint32_t rowWallBits(Buffer bits, int cols, int rows, int row, int col, int n) {
+    if (row < 0 || row >= rows)
+        return n >= 32 ? 0xffffffff : (1U << n) - 1;
+    auto words = (uint32_t *)bits->data + row * wallStride(cols);
+    uint32_t r = 0;
+    int i = 0;
+    while (i < n) {
+        int c = col + i;
+        if (c < 0 || c >= cols) {
+            r |= 1U << i;
+            i++;
+            continue;
+        }
+        int b = c & 31;
+        int k = min(min(32 - b, n - i), cols - c);
+        uint32_t w = words[c >> 5] >> b;
+        if (k < 32)
+            w &= (1U << k) - 1;
+        r |= w << i;
+        i += k;
+    }
+    return r;
+}
+
+/**
+ * Bits for the walls of a map of cols by rows tiles, which are the pixels of the wall color in
+ * layers.
+ */
+//%
+Buffer _wallBits(Image_ layers, int cols, int rows, int wall) {
+    if (cols <= 0 || rows <= 0)
+        return mkBuffer(NULL, 0);
+    int stride = wallStride(cols);
+    auto res = mkBuffer(NULL, stride * rows * 4);
+    auto words = (uint32_t *)res->data;
+    for (int row = 0; row < rows; ++row, words += stride)
+        for (int col = 0; col < cols; ++col)
+            if (ImageMethods::getPixel(layers, col, row) == wall)
+                words[col >> 5] |= 1U << (col & 31);
+    return res;
+}
+
+/**
+ * Bits telling which tiles from (col0, row0) to (col1, row1), along one row or column of a map of
+ * cols by rows tiles, are walls or are outside of the map; bit 0 is the first one. At most 32
+ * tiles are looked at.
+ */
+//%
+int _wallMask(Buffer bits, int colsRows, int from, int to) {
+    int cols = XX(colsRows), rows = YY(colsRows);
+    int col0 = XX(from), row0 = YY(from), col1 = XX(to), row1 = YY(to);
+    if (!validWallBits(bits, cols, rows))
+        return 0;
+    int dc = col1 > col0 ? 1 : col1 < col0 ? -1 : 0;
+    int dr = row1 > row0 ? 1 : row1 < row0 ? -1 : 0;
+    if (dc && dr)
+        return 0;
+    int count = min(32, max(abs(col1 - col0), abs(row1 - row0)) + 1);
+    if (dr == 0 && dc >= 0)
+        return (int)rowWallBits(bits, cols, rows, row0, col0, count);
+    uint32_t mask = 0;
+    for (int i = 0; i < count; ++i)
+        if (isWallBit(bits, cols, rows, col0 + i * dc, row0 + i * dr))
+            mask |= 1U << i;
+    return (int)mask;
+}
+
+/**
+ * Whether any tile from (col0, row0) to (col1, row1), corners of a rectangle, is a wall or is
+ * outside of the map; eg. the tiles a sprite sweeps over as it moves.
+ */
+//%
+bool _wallInRect(Buffer bits, int colsRows, int from, int to) {
+    int cols = XX(colsRows), rows = YY(colsRows);
+    int col0 = XX(from), row0 = YY(from), col1 = XX(to), row1 = YY(to);
+    if (!validWallBits(bits, cols, rows) || col1 < col0 || row1 < row0)
+        return false;
+    if (col0 < 0 || row0 < 0 || col1 >= cols || row1 >= rows)
+        return true;
+    for (int row = row0; row <= row1; ++row)
+        for (int col = col0; col <= col1; col += 32)
+            if (rowWallBits(bits, cols, rows, row, col, min(32, col1 - col + 1)))
+                return true;
+    return false;
+}
+
+// A* searches for paths between tiles, moving a tile left, right, up or down at a time and
+// avoiding walls, run a number of nodes at a time with _pathStep(). The state of a search is in
+// one buffer: a PathSearch, then for each of its n tiles the length of the best path to it found
+// so far, its position in the heap (plus one; 0 when it is not in it) and the heap of tiles to
+// look at, as uint16s, and the direction it was reached in with PATH_CLOSED when done with it.
+struct PathSearch {
+    int32_t cols, rows, start, goal, heapSize, status;
+};
+
+#define PATH_CLOSED 4
+#define PATH_UNSEEN 0xffff
+#define PATH_MAX_TILES 0xfffe
+
+struct PathState {
+    PathSearch *s;
+    uint16_t *g, *heapPos, *heap;
+    uint8_t *from;
+};
+
+static const int8_t pathDCol[4] = {1, 0, -1, 0};
+static const int8_t pathDRow[4] = {0, 1, 0, -1};
+
+static inline unsigned pathStateSize(int n) {
+    return sizeof(PathSearch) + n * (3 * sizeof(uint16_t) + 1);
+}
+
+static bool pathState(Buffer state, PathState &p) {
+    if (state->length < (int)sizeof(PathSearch))
+        return false;
+    p.s = (PathSearch *)state->data;
+    int n = p.s->cols * p.s->rows;
+    if (n <= 0 || n > PATH_MAX_TILES || state->length < (int)pathStateSize(n))
+        return false;
+    p.g = (uint16_t *)(p.s + 1);
+    p.heapPos = p.g + n;
+    p.heap = p.heapPos + n;
+    p.from = (uint8_t *)(p.heap + n);
+    return true;
+}
+
+// estimated length of the path from tile i, the first key of the heap
+static inline int pathEstimate(PathState &p, int i) {
+    int cols = p.s->cols;
+    return abs(i % cols - p.s->goal % cols) + abs(i / cols - p.s->goal / cols);
+}
+
+static inline bool pathBefore(PathState &p, int a, int b) {
+    int ha = pathEstimate(p, a), hb = pathEstimate(p, b);
+    int fa = p.g[a] + ha, fb = p.g[b] + hb;
+    return fa < fb || (fa == fb && ha < hb);
+}
+
+static inline void pathHeapSet(PathState &p, int pos, int tile) {
+    p.heap[pos] = tile;
+    p.heapPos[tile] = pos + 1;
+}
+
+static void pathSiftUp(PathState &p, int pos) {
+    int tile = p.heap[pos];
+    while (pos > 0) {
+        int parent = (pos - 1) >> 1;
+        if (!pathBefore(p, tile, p.heap[parent]))
+            break;
+        pathHeapSet(p, pos, p.heap[parent]);
+        pos = parent;
+    }
+    pathHeapSet(p, pos, tile);
+}
+
+static int pathPop(PathState &p) {
+    int top = p.heap[0];
+    p.heapPos[top] = 0;
+    int n = --p.s->heapSize;
+    if (n <= 0)
+        return top;
+    int tile = p.heap[n];
+    int pos = 0;
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && pathBefore(p, p.heap[child + 1], p.heap[child]))
+            child++;
+        if (!pathBefore(p, p.heap[child], tile))
+            break;
+        pathHeapSet(p, pos, p.heap[child]);
+        pos = child;
+    }
+    pathHeapSet(p, pos, tile);
+    return top;
+}
+
+static void pathReach(PathState &p, int tile, int g, int dir) {
+    p.g[tile] = g;
+    p.from[tile] = (p.from[tile] & PATH_CLOSED) | dir;
+    if (p.heapPos[tile]) {
+        pathSiftUp(p, p.heapPos[tile] - 1);
+    } else {
+        int pos = p.s->heapSize++;
+        pathHeapSet(p, pos, tile);
+        pathSiftUp(p, pos);
+    }
+}
+
+/**
+ * Start a search for a path from (fromCol, fromRow) to (toCol, toRow) in a map of cols by rows
+ * tiles; null if the map is too large or either tile is outside of it.
+ */
+//%
+Buffer _pathStart(int colsRows, int from, int to) {
+    int cols = XX(colsRows), rows = YY(colsRows);
+    int fromCol = XX(from), fromRow = YY(from), toCol = XX(to), toRow = YY(to);
+    int n = cols * rows;
+    if (cols <= 0 || rows <= 0 || n > PATH_MAX_TILES || fromCol < 0 || fromCol >= cols ||
+        fromRow < 0 || fromRow >= rows || toCol < 0 || toCol >= cols || toRow < 0 ||
+        toRow >= rows)
+        return NULL;
+    auto state = mkBuffer(NULL, pathStateSize(n));
+    PathState p;
+    pathState(state, p);
+    p.s->cols = cols;
+    p.s->rows = rows;
+    p.s->start = fromCol + fromRow * cols;
+    p.s->goal = toCol + toRow * cols;
+    memset(p.g, 0xff, n * sizeof(uint16_t));
+    pathReach(p, p.s->start, 0, 0);
+    return state;
+}
+
+/**
+ * Look at up to budget more tiles of a search, with the walls in bits (see _wallBits()); returns
+ * 1 once the path is found, -1 if there is none and 0 if the search isn't done.
+ */
+//%
+int _pathStep(Buffer state, Buffer bits, int budget) {
+    PathState p;
+    if (!pathState(state, p))
+        return -1;
+    auto s = p.s;
+    if (!validWallBits(bits, s->cols, s->rows) || isWallBit(bits, s->cols, s->rows,
+                                                             s->goal % s->cols, s->goal / s->cols))
+        s->status = -1;
+    while (!s->status && budget-- > 0) {
+        if (!s->heapSize) {
+            s->status = -1;
+            break;
+        }
+        int tile = pathPop(p);
+        if (tile == s->goal) {
+            s->status = 1;
+            break;
+        }
+        p.from[tile] |= PATH_CLOSED;
+        int col = tile % s->cols, row = tile / s->cols;
+        for (int dir = 0; dir < 4; ++dir) {
+            int c = col + pathDCol[dir], r = row + pathDRow[dir];
+            if (isWallBit(bits, s->cols, s->rows, c, r))
+                continue;
+            int next = c + r * s->cols;
+            if (p.from[next] & PATH_CLOSED)
+                continue;
+            int g = p.g[tile] + 1;
+            if (p.g[next] == PATH_UNSEEN || g < p.g[next])
+                pathReach(p, next, g, dir);
+        }
+    }
+    return s->status;
+}
+
+/**
+ * The path a search found, as (col, row) pairs of uint16s from the start to the goal; null if it
+ * hasn't found one.
+ */
+//%
+Buffer _pathResult(Buffer state) {
+    PathState p;
+    if (!pathState(state, p) || p.s->status != 1)
+        return NULL;
+    int cols = p.s->cols;
+    int len = p.g[p.s->goal] + 1;
+    auto res = mkBuffer(NULL, len * 4);
+    auto dst = (uint16_t *)res->data + 2 * len;
+    int tile = p.s->goal;
+    for (int i = 0; i < len; ++i) {
+        int col = tile % cols, row = tile / cols;
+        *--dst = row;
+        *--dst = col;
+        int dir = p.from[tile] & 3;
+        tile = (col - pathDCol[dir]) + (row - pathDRow[dir]) * cols;
+    }
+    return res;
+}
+
+} // namespace tiles
@@ -107,6 +107,29 @@ namespace tiles {
     const TM_DATA_PREFIX_LENGTH = 4;
     const TM_WALL = 2;
 
+    // two int16s in one number, as shims take at most 4 arguments
+    function pack(x: number, y: number) {
+        return (Math.clamp(-30000, 30000, x | 0) & 0xffff) | (Math.clamp(-30000, 30000, y | 0) << 16)
+    }
+
+    //% shim=tiles::_wallBits
+    export declare function _wallBits(layers: Image, cols: number, rows: number, wall: number): Buffer;
+
+    //% shim=tiles::_wallMask
+    export declare function _wallMask(bits: Buffer, colsRows: number, from: number, to: number): number;
+
+    //% shim=tiles::_wallInRect
+    export declare function _wallInRect(bits: Buffer, colsRows: number, from: number, to: number): boolean;
+
+    //% shim=tiles::_pathStart
+    declare function _pathStart(colsRows: number, from: number, to: number): Buffer;
+
+    //% shim=tiles::_pathStep
+    declare function _pathStep(state: Buffer, bits: Buffer, budget: number): number;
+
+    //% shim=tiles::_pathResult
+    declare function _pathResult(state: Buffer): Buffer;
+
     //% snippet='tilemap` `'
     //% pySnippet='tilemap(""" """)'
     export class TileMapData {
@@ -115,9 +138,13 @@ namespace tiles {
 
         // The metadata layers for the map. Currently only 1 is used for walls
         protected layers: Image;
+        // The walls, one bit per tile (see tilemap.cpp); made from layers when first needed
+        protected wallBits: Buffer;
 
         protected tileset: Image[];
         protected cachedTileView: Image[];
+        // tiles padded to the full tile size, for helpers.imageDrawTiles()
+        protected cachedDrawTiles: Image[];
 
         protected _scale: TileScale;
         protected _width: number;
@@ -148,6 +175,7 @@ namespace tiles {
         set scale(s: TileScale) {
             this._scale = s;
             this.cachedTileView = [];
+            this.cachedDrawTiles = null;
         }
 
         getTile(col: number, row: number) {
@@ -189,14 +217,65 @@ namespace tiles {
             return cachedImage;
         }
 
+        /**
+         * Draw the tiles covering `target`, with the top-left corner of the target at
+         * (offsetX, offsetY) in the map.
+         */
+        drawTiles(target: Image, offsetX: number, offsetY: number) {
+            if (!this.cachedDrawTiles || this.cachedDrawTiles.length != this.tileset.length) {
+                const size = 1 << this.scale;
+                this.cachedDrawTiles = this.tileset.map((t, index) => {
+                    let tile = this.getTileImage(index);
+                    if (tile && (tile.width != size || tile.height != size)) {
+                        const padded = image.create(size, size);
+                        padded.drawImage(tile, 0, 0);
+                        tile = padded;
+                    }
+                    return tile;
+                });
+            }
+            helpers.imageDrawTiles(target, this.cachedDrawTiles, this.data, offsetX, offsetY);
+        }
+
         setWall(col: number, row: number, on: boolean) {
-            return this.layers.setPixel(col, row, on ? TM_WALL : 0);
+            this.layers.setPixel(col, row, on ? TM_WALL : 0);
+            if (this.wallBits && !this.isOutsideMap(col, row)) {
+                const offset = ((row | 0) * ((this._width + 31) >> 5) + ((col | 0) >> 5)) << 2;
+                const bit = 1 << ((col | 0) & 31);
+                const word = this.wallBits.getNumber(NumberFormat.Int32LE, offset);
+                this.wallBits.setNumber(NumberFormat.Int32LE, offset, on ? word | bit : word & ~bit);
+            }
+        }
+
+        /**
+         * The walls, one bit per tile (see tilemap.cpp)
+         */
+        walls() {
+            if (!this.wallBits)
+                this.wallBits = _wallBits(this.layers, this._width, this._height, TM_WALL);
+            return this.wallBits;
         }
 
         isWall(col: number, row: number) {
             return this.layers.getPixel(col, row) === TM_WALL;
         }
 
+        /**
+         * Bits telling which tiles from (col0, row0) to (col1, row1), along a row or a column,
+         * are walls or outside of the map; bit 0 is the first one, and at most 32 are looked at
+         */
+        wallMask(col0: number, row0: number, col1: number, row1: number) {
+            return _wallMask(this.walls(), pack(this._width, this._height), pack(col0, row0), pack(col1, row1));
+        }
+
+        /**
+         * Whether any tile in the rectangle from (col0, row0) to (col1, row1) is a wall or is
+         * outside of the map
+         */
+        hasWallIn(col0: number, row0: number, col1: number, row1: number) {
+            return _wallInRect(this.walls(), pack(this._width, this._height), pack(col0, row0), pack(col1, row1));
+        }
+
         isOutsideMap(col: number, row: number) {
             return col < 0 || col >= this.width || row < 0 || row >= this.height;
         }
@@ -358,19 +437,7 @@ namespace tiles {
             const y0 = Math.max(0, camera.drawOffsetY >> this.scale);
             const yn = Math.min(this._map.height, ((camera.drawOffsetY + target.height) >> this.scale) + 1);
 
-            for (let x = x0; x <= xn; ++x) {
-                for (let y = y0; y <= yn; ++y) {
-                    const index = this._map.getTile(x, y);
-                    const tile = this._map.getTileImage(index);
-                    if (tile) {
-                        target.drawTransparentImage(
-                            tile,
-                            ((x - x0) << this.scale) - offsetX,
-                            ((y - y0) << this.scale) - offsetY
-                        );
-                    }
-                }
-            }
+            this._map.drawTiles(target, camera.drawOffsetX, camera.drawOffsetY);
 
             if (game.debug) {
                 // render debug grid overlay
@@ -409,6 +476,30 @@ namespace tiles {
             return this._map.isWall(col, row);
         }
 
+        /**
+         * Bits telling which tiles from (col0, row0) to (col1, row1), along a row or a column,
+         * are obstacles (see isObstacle()); bit 0 is the first one, and at most 32 are looked at
+         */
+        public wallMask(col0: number, row0: number, col1: number, row1: number) {
+            if (!this.enabled) return 0;
+            return this._map.wallMask(col0, row0, col1, row1);
+        }
+
+        /**
+         * Whether any tile in the rectangle from (col0, row0) to (col1, row1) is an obstacle
+         */
+        public hasObstacleIn(col0: number, row0: number, col1: number, row1: number) {
+            if (!this.enabled) return false;
+            return this._map.hasWallIn(col0, row0, col1, row1);
+        }
+
+        /**
+         * The walls of the map, one bit per tile (see tilemap.cpp); undefined if there is no map
+         */
+        public wallBits() {
+            return this._map ? this._map.walls() : undefined;
+        }
+
         public getObstacle(col: number, row: number) {
             const index = this._map.isOutsideMap(col, row) ? 0 : this._map.getTile(col, row);
             const tile = this._map.getTileImage(index);
@@ -424,20 +515,12 @@ namespace tiles {
         public isOnWall(s: Sprite) {
             const hbox = s._hitbox;
 
-            const left = Fx.toIntShifted(hbox.left, this.scale);
-            const right = Fx.toIntShifted(hbox.right, this.scale);
-            const top = Fx.toIntShifted(hbox.top, this.scale);
-            const bottom = Fx.toIntShifted(hbox.bottom, this.scale);
-
-            for (let col = left; col <= right; ++col) {
-                for (let row = top; row <= bottom; ++row) {
-                    if (this.isObstacle(col, row)) {
-                        return true;
-                    }
-                }
-            }
-
-            return false;
+            return this.hasObstacleIn(
+                Fx.toIntShifted(hbox.left, this.scale),
+                Fx.toIntShifted(hbox.top, this.scale),
+                Fx.toIntShifted(hbox.right, this.scale),
+                Fx.toIntShifted(hbox.bottom, this.scale)
+            );
         }
 
         public getTileImage(index: number) {
@@ -614,4 +697,81 @@ namespace tiles {
         const sample = scene.tileMap.sampleTilesByType(index, 1);
         return sample[0];
     }
+
+    /**
+     * A search, on the current tile map, for a shortest path between two tiles that goes left,
+     * right, up or down a tile at a time and avoids walls. It runs natively, a number of tiles
+     * at a time, so that it can be spread over frames with step().
+     */
+    export class PathSearch {
+        protected state: Buffer;
+        protected status: number;
+        protected _path: Location[];
+
+        constructor(from: Location, to: Location) {
+            const tm = game.currentScene().tileMap;
+            this.status = -1;
+            if (tm && tm.enabled && from && to) {
+                this.state = _pathStart(pack(tm.areaWidth() >> tm.scale, tm.areaHeight() >> tm.scale),
+                    pack(from.col, from.row), pack(to.col, to.row));
+                if (this.state)
+                    this.status = 0;
+            }
+        }
+
+        /**
+         * Whether the search is over, with or without a path
+         */
+        get done() {
+            return this.status != 0;
+        }
+
+        /**
+         * Look at up to `budget` more tiles; returns true once the search is over, and then path
+         * is set if it found one
+         */
+        step(budget = 64) {
+            if (this.status != 0)
+                return true;
+            const tm = game.currentScene().tileMap;
+            const bits = tm && tm.wallBits();
+            this.status = bits ? _pathStep(this.state, bits, budget) : -1;
+            if (this.status == 0)
+                return false;
+            const res = this.status > 0 ? _pathResult(this.state) : undefined;
+            this.state = undefined;
+            if (res) {
+                this._path = [];
+                for (let i = 0; i < res.length; i += 4)
+                    this._path.push(tm.getTile(res.getNumber(NumberFormat.UInt16LE, i),
+                        res.getNumber(NumberFormat.UInt16LE, i + 2)));
+            }
+            return true;
+        }
+
+        /**
+         * The tiles of the path found, from the start to the goal; undefined if there is none, or
+         * until the search is done
+         */
+        get path(): Location[] {
+            return this._path;
+        }
+
+        /**
+         * Run the search to its end at once, and return the path, if any
+         */
+        run(): Location[] {
+            while (!this.step(1024)) { }
+            return this._path;
+        }
+    }
+
+    /**
+     * Find a shortest path from one tile to another that avoids walls, going a tile left, right,
+     * up or down at a time; undefined if there is none. To spread a long search over frames, use
+     * a PathSearch.
+     */
+    export function findPath(from: Location, to: Location): Location[] {
+        return new PathSearch(from, to).run();
+    }
 }
@@ -3,7 +3,42 @@
 
 
 #include "pxt.h"
+#include "hidqueue.h"
+
 namespace gamepad {
+    enum GamepadChange { BUTTON_DOWN, BUTTON_UP, MOVE, THROTTLE };
+
+    // the gamepad reports where the sticks and throttles are, so a move or throttle while a
+    // report goes out replaces the last one queued for the same stick
+    class GamepadQueue : public pxt::HIDQueue {
+      protected:
+        bool merge(pxt::HIDChange &last, const pxt::HIDChange &change) override {
+            if ((change.kind != MOVE && change.kind != THROTTLE) || last.kind != change.kind ||
+                last.arg != change.arg)
+                return false;
+            last = change;
+            return true;
+        }
+
+        void send(const pxt::HIDChange &change) override {
+            switch (change.kind) {
+            case BUTTON_DOWN:
+                pxt::joystick.buttonDown(change.arg);
+                break;
+            case BUTTON_UP:
+                pxt::joystick.buttonUp(change.arg);
+                break;
+            case MOVE:
+                pxt::joystick.move(change.arg, change.a, change.b);
+                break;
+            case THROTTLE:
+                pxt::joystick.setThrottle(change.arg, change.a);
+                break;
+            }
+        }
+    };
+    static GamepadQueue queue;
+
     /** 
     * Set the button state to down
     */
@@ -11,10 +46,7 @@ namespace gamepad {
     //% blockId=joystickSetButton block="gamepad button %index=joystickStandardButton|%down=toggleDownUp"
     //% weight=100
     void setButton(int index, bool down) {
-        if (down)
-            pxt::joystick.buttonDown(index);
-        else
-            pxt::joystick.buttonUp(index);
+        queue.push(down ? BUTTON_DOWN : BUTTON_UP, index);
     }
 
     /**
@@ -25,7 +57,7 @@ namespace gamepad {
     //% index.min=0 index.max=1
     //% blockGap=8
     void move(int index, int x, int y) {
-        pxt::joystick.move(index, x, y);        
+        queue.push(MOVE, index, x, y);
     }
 
     /** 
@@ -38,6 +70,6 @@ namespace gamepad {
     //%help=gamepad/set-throttle
     void setThrottle(int index, int value) {
         value = max(0, min(31, value));
-        pxt::joystick.setThrottle(index, value);
+        queue.push(THROTTLE, index, value);
     }
 }
\ No newline at end of file
@@ -13,78 +13,83 @@ enum class KeyboardKeyEvent {
 };
 
 namespace keyboard {
+    enum KeyboardChange { KEY, MEDIA_KEY, FUNCTION_KEY, MODIFIER_KEY, TYPE, FLUSH };
+
+    template <typename K> static void sendKey(K key, KeyboardKeyEvent event) {
+        switch(event) {
+            case KeyboardKeyEvent::Down:
+                pxt::keyboard.keyDown(key);
+                break;
+            case KeyboardKeyEvent::Up:
+                pxt::keyboard.keyUp(key);
+                break;
+            case KeyboardKeyEvent::Press:
+                pxt::keyboard.press(key);
+                break;
+        }
+    }
+
+    // keys and text are typed in order by the queue's fiber, so that typing a string or a
+    // macro of keys doesn't wait for each of its reports
+    class KeyboardQueue : public pxt::HIDQueue {
+      protected:
+        void send(const pxt::HIDChange &change) override {
+            auto event = (KeyboardKeyEvent)change.arg;
+            auto key = (uint16_t)change.a;
+            switch (change.kind) {
+            case KEY:
+                sendKey(key, event);
+                break;
+            case MEDIA_KEY:
+                sendKey((codal::MediaKey)((int)codal::MediaKey::Mute + (int)key), event);
+                break;
+            case FUNCTION_KEY:
+                sendKey((codal::FunctionKey)key, event);
+                break;
+            case MODIFIER_KEY: {
+                const Key k = { .reg = KEYMAP_KEY_DOWN | KEYMAP_MODIFIER_KEY | (uint8_t)key };
+                sendKey(k, event);
+                break;
+            }
+            case TYPE:
+                pxt::keyboard.type(change.text->getUTF8Data(), change.text->getUTF8Size());
+                break;
+            case FLUSH:
+                pxt::keyboard.flush();
+                break;
+            }
+        }
+    };
+    static KeyboardQueue queue;
+
     //%
     void __flush() {
-        pxt::keyboard.flush();
+        queue.push(FLUSH, 0);
     }
 
     //% 
     void __type(String text) {
         if (NULL != text)
-            pxt::keyboard.type(text->getUTF8Data(), text->getUTF8Size());
+            queue.push(TYPE, 0, 0, 0, text);
     }
 
     //%
     void __key(uint16_t ckey, KeyboardKeyEvent event) {
-       switch(event) {
-            case KeyboardKeyEvent::Down:
-                pxt::keyboard.keyDown(ckey);
-                break;
-            case KeyboardKeyEvent::Up:
-                pxt::keyboard.keyUp(ckey);
-                break;
-            case KeyboardKeyEvent::Press:
-                pxt::keyboard.press(ckey);
-                break;
-        }
+        queue.push(KEY, (int)event, ckey);
     }
 
     //%
     void __mediaKey(uint16_t key, KeyboardKeyEvent event) {
-        codal::MediaKey ckey = (codal::MediaKey)((int)codal::MediaKey::Mute + (int)key);
-        switch(event) {
-            case KeyboardKeyEvent::Down:
-                pxt::keyboard.keyDown(ckey);
-                break;
-            case KeyboardKeyEvent::Up:
-                pxt::keyboard.keyUp(ckey);
-                break;
-            case KeyboardKeyEvent::Press:
-                pxt::keyboard.press(ckey);
-                break;
-        }
+        queue.push(MEDIA_KEY, (int)event, key);
     }
 
     //%
     void __functionKey(uint16_t key, KeyboardKeyEvent event) {
-        codal::FunctionKey ckey = (codal::FunctionKey)key;
-        switch(event) {
-            case KeyboardKeyEvent::Down:
-                pxt::keyboard.keyDown(ckey);
-                break;
-            case KeyboardKeyEvent::Up:
-                pxt::keyboard.keyUp(ckey);
-                break;
-            case KeyboardKeyEvent::Press:
-                pxt::keyboard.press(ckey);
-                break;
-        }
+        queue.push(FUNCTION_KEY, (int)event, key);
     }
 
     //%
     void __modifierKey(uint16_t modifier, KeyboardKeyEvent event) {
-       const Key key = { .reg = KEYMAP_KEY_DOWN | KEYMAP_MODIFIER_KEY | (uint8_t)modifier };
-        // send keys
-        switch(event) {
-            case KeyboardKeyEvent::Down:
-                pxt::keyboard.keyDown(key);
-                break;
-            case KeyboardKeyEvent::Up:
-                pxt::keyboard.keyUp(key);
-                break;
-            case KeyboardKeyEvent::Press:
-                pxt::keyboard.press(key);
-                break;
-        };
+        queue.push(MODIFIER_KEY, (int)event, modifier);
     }
 }
\ No newline at end of file
@@ -49,6 +49,8 @@ namespace lcd {
         _message: string;
         _enable: boolean;
         _rtl: boolean;
+        // the characters shown, columns by lines, in the order of the message
+        protected _cells: Buffer;
 
         // pylint: disable-msg=too-many-arguments
         constructor(rs: DigitalInOutPin, en: DigitalInOutPin,
@@ -64,19 +66,29 @@ namespace lcd {
             this.dl5 = d5;
             this.dl6 = d6;
             this.dl7 = d7;
-            // set all pins as outputs
-            for (const pin of [rs, en, d4, d5, d6, d7]) {
-                pin.digitalWrite(false);
-            }
-            // Initialise the display
-            this._write8(0x33)
-            this._write8(0x32)
+            this._cells = control.createBuffer(columns * lines);
             // Initialise display control
             this.displaycontrol = _LCD_DISPLAYON | _LCD_CURSOROFF | _LCD_BLINKOFF
             // Initialise display function
             this.displayfunction = _LCD_4BITMODE | _LCD_1LINE | _LCD_2LINE | _LCD_5X8DOTS
             // Initialise display mode
             this.displaymode = _LCD_ENTRYLEFT | _LCD_ENTRYSHIFTDECREMENT
+            this._message = ""
+            this._enable = null
+            // without pins, the subclass talks to the display some other way, and calls _begin()
+            if (rs) {
+                // set all pins as outputs
+                for (const pin of [rs, en, d4, d5, d6, d7]) {
+                    pin.digitalWrite(false);
+                }
+                this._begin()
+            }
+        }
+
+        protected _begin() {
+            // Initialise the display
+            this._write8(0x33)
+            this._write8(0x32)
             // Write to displaycontrol
             this._write8(_LCD_DISPLAYCONTROL | this.displaycontrol)
             // Write to displayfunction
@@ -84,8 +96,6 @@ namespace lcd {
             // Set entry mode
             this._write8(_LCD_ENTRYMODESET | this.displaymode)
             this.clear()
-            this._message = ""
-            this._enable = null
         }
 
         /** 
@@ -102,6 +112,7 @@ namespace lcd {
         public clear(): void {
             this._write8(_LCD_CLEARDISPLAY)
             this._message = "";
+            this._cells.fill(32);
             pause(3)
         }
 
@@ -180,44 +191,33 @@ namespace lcd {
             if (message === undefined || message === null) message = "";
             if (this._message === message) return; // nothing to do here
 
-            const oldMessage = this._message;
             this._message = message;
-            //console.log(`'${oldMessage}' => '${message}'`);
 
+            // the cells are compared with what is shown, and each run of changed ones is written
+            // after moving the cursor to it
             const ltr = !!(this.displaymode & _LCD_ENTRYLEFT);
-            const oldLines = oldMessage.split('\n');
-            const lines = this._message.split('\n');
-            const rn = Math.min(this.lines, Math.max(oldLines.length, lines.length));
-
-            let cursorrow = -1;
-            let cursorcol = -1;
-            for (let row = 0; row < rn; ++row) {
-                let oldLine = oldLines[row];
-                if (oldLine === undefined) oldLine = "";
-                let line = lines[row];
-                if (line === undefined) line = "";
-                const cn = Math.min(this.columns, Math.max(oldLine.length, line.length));
-                for (let column = 0; column < cn; ++column) {
-                    const oc = oldLine.charCodeAt(column);
-                    const c = line.charCodeAt(column);
-                    if (oc !== c) {
-                        // letter is already shown, skip
-                        // move cursor if needed
-                        if (row != cursorrow || column != cursorcol) {
-                            //console.log(`set cursor pos ${column}, ${row}`);
-                            this.setCursorPosition(ltr ? column : this.columns - 1 - column, row);
-                            cursorrow = row;
-                            cursorcol = column;
-                        }
-                        //console.log(`write ${String.fromCharCode(c)} (${String.fromCharCode(oc)}) at ${cursorcol}, ${cursorrow}`);
-                        if (column >= line.length)
-                            this._write8(32 /* space */, true);
-                        else
-                            this._write8(c, true);
-                        cursorcol++;
+            const lines = message.split('\n');
+            const addresses: number[] = [];
+            const runs: Buffer[] = [];
+            for (let row = 0; row < this.lines; ++row) {
+                const line = lines[row] || "";
+                const rowStart = row * this.columns;
+                let start = -1;
+                for (let column = 0; column <= this.columns; ++column) {
+                    // past the end of the line, the old letters are cleared
+                    const c = column < line.length ? line.charCodeAt(column) & 0xff : 32;
+                    if (column < this.columns && this._cells[rowStart + column] != c) {
+                        if (start < 0) start = column;
+                        this._cells[rowStart + column] = c;
+                    } else if (start >= 0) {
+                        addresses.push((ltr ? start : this.columns - 1 - start) + _LCD_ROW_OFFSETS[row]);
+                        runs.push(this._cells.slice(rowStart + start, column - start));
+                        start = -1;
                     }
                 }
             }
+            if (runs.length)
+                this._writeRuns(addresses, runs);
         }
 
         /** 
@@ -277,15 +277,40 @@ namespace lcd {
         }
 
 
+        /**
+         * Write runs of characters, each one at a DDRAM address
+         */
+        protected _writeRuns(addresses: number[], runs: Buffer[]): void {
+            for (let i = 0; i < runs.length; ++i) {
+                this._write8(_LCD_SETDDRAMADDR | addresses[i])
+                const run = runs[i];
+                for (let j = 0; j < run.length; ++j) {
+                    __write8(run[j], true);
+                    // a character takes the controller 37us, so there is no need to sleep
+                    control.waitMicros(50)
+                    this._send8(run[j], true)
+                }
+            }
+        }
+
+        // what the simulator shows follows the values written
+        protected _simWrite8(value: number, char_mode: boolean): void {
+            __write8(value, char_mode);
+        }
+
         /**
          * Sends 8b ``value`` in ``char_mode``.
          * @param value bytes
          * @param char_mode character/data mode selector. False (default) for data only, True for character bits.
          */
-        private _write8(value: number, char_mode = false): void {
+        protected _write8(value: number, char_mode = false): void {
             __write8(value, char_mode);
             // one ms delay to prevent writing too quickly.
             pause(1)
+            this._send8(value, char_mode)
+        }
+
+        private _send8(value: number, char_mode: boolean): void {
             // set character/data bit. (charmode = False)
             this.reset.digitalWrite(char_mode)
             // WRITE upper 4 bits
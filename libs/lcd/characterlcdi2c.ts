@@ -0,0 +1,81 @@
+namespace lcd {
+    // the pins of the PCF8574 on common I2C backpacks; D4 to D7 are on the upper 4 bits
+    const _I2C_RS = 0x01
+    const _I2C_ENABLE = 0x04
+    const _I2C_BACKLIGHT = 0x08
+    const _LCD_SETDDRAMADDR = 0x80
+
+    export class CharacterLCDI2C extends CharacterLCD {
+        address: number;
+        bus: I2C;
+        private _backlightBit: number;
+
+        /**
+         * Interfaces with character LCDs through a PCF8574 I2C backpack. Each run of changed
+         * characters goes to the display as one I2C write, and all those of a message in one
+         * transaction.
+         * @param address the 7-bit address of the backpack, eg: 0x27
+         * @param bus the I2C bus, or the default one
+         */
+        constructor(address: number, columns: number, lines: number, bus?: I2C) {
+            super(null, null, null, null, null, null, columns, lines);
+            this.address = address;
+            this.bus = bus || pins.i2c();
+            this._backlightBit = _I2C_BACKLIGHT;
+            this._enable = true;
+            this._begin();
+        }
+
+        /**
+         * Enable or disable backlight. True if backlight is on. False if backlight is off.
+         **/
+        get backlight(): boolean {
+            return this._enable
+        }
+
+        set backlight(enable: boolean) {
+            this._enable = !!enable;
+            this._backlightBit = enable ? _I2C_BACKLIGHT : 0;
+            const b = control.createBuffer(1);
+            b[0] = this._backlightBit;
+            this.bus.writeBuffer(this.address, b);
+        }
+
+        protected _writeRuns(addresses: number[], runs: Buffer[]): void {
+            const t = new pins.I2CTransaction();
+            for (let i = 0; i < runs.length; ++i) {
+                const run = runs[i];
+                // at up to 400kHz, the controller is done with each character (37us) before the
+                // backpack latches the next one, so the whole run goes in one write
+                const data = control.createBuffer(4 * (1 + run.length));
+                this._simWrite8(_LCD_SETDDRAMADDR | addresses[i], false);
+                this._encode(data, 0, _LCD_SETDDRAMADDR | addresses[i], false);
+                for (let j = 0; j < run.length; ++j) {
+                    this._simWrite8(run[j], true);
+                    this._encode(data, 4 * (1 + j), run[j], true);
+                }
+                t.write(this.address, data);
+            }
+            t.run(this.bus);
+        }
+
+        protected _write8(value: number, char_mode = false): void {
+            this._simWrite8(value, char_mode);
+            // one ms delay to prevent writing too quickly.
+            pause(1)
+            const data = control.createBuffer(4);
+            this._encode(data, 0, value, char_mode);
+            this.bus.writeBuffer(this.address, data);
+        }
+
+        // the backpack bytes for value: each half with enable high, and then low to latch it
+        private _encode(data: Buffer, offset: number, value: number, char_mode: boolean) {
+            const flags = this._backlightBit | (char_mode ? _I2C_RS : 0);
+            const hi = (value & 0xf0) | flags, lo = ((value << 4) & 0xf0) | flags;
+            data[offset] = hi | _I2C_ENABLE;
+            data[offset + 1] = hi;
+            data[offset + 2] = lo | _I2C_ENABLE;
+            data[offset + 3] = lo;
+        }
+    }
+}
@@ -31,7 +31,7 @@ namespace sensors {
 
     export class LightSpectrumSensor {
         public id: number;
-        private reading: boolean;
+        protected reading: boolean;
         private _spectrum: LightSpectrum;
         private normalizedLevelDetector: pins.LevelDetector;
 
@@ -43,23 +43,31 @@ namespace sensors {
         protected readSpectrum(): LightSpectrum {
             return new LightSpectrum();
         }
+        // reads the sensor in a background fiber; drivers which know when a sample is ready
+        // override this, and hand each one to setSpectrum()
         protected startReading() {
             if (this.reading) return;
             this.reading = true;
+            this.startLevelDetector();
             control.runInBackground(() => {
-                this.normalizedLevelDetector = new pins.LevelDetector(this.id, 0, 1023, 50, 900);
-                this.normalizedLevelDetector.onHigh = () => control.raiseEvent(this.id, LightSpectrumEvent.VisibleBright);
-                this.normalizedLevelDetector.onLow = () => control.raiseEvent(this.id, LightSpectrumEvent.VisibleDark);
                 while (this.reading) {
-                    let spec = this.readSpectrum();
-                    if (spec.full != -1 && spec.infrared != -1 && spec.visible != -1) {
-                        this._spectrum = spec;
-                        this.normalizedLevelDetector.level = spec.normalized;
-                    }
+                    this.setSpectrum(this.readSpectrum());
                     pause(1);
                 }
             });
         }
+        protected startLevelDetector() {
+            this.normalizedLevelDetector = new pins.LevelDetector(this.id, 0, 1023, 50, 900);
+            this.normalizedLevelDetector.onHigh = () => control.raiseEvent(this.id, LightSpectrumEvent.VisibleBright);
+            this.normalizedLevelDetector.onLow = () => control.raiseEvent(this.id, LightSpectrumEvent.VisibleDark);
+        }
+        protected setSpectrum(spec: LightSpectrum) {
+            if (spec.full != -1 && spec.infrared != -1 && spec.visible != -1) {
+                this._spectrum = spec;
+                if (this.normalizedLevelDetector)
+                    this.normalizedLevelDetector.level = spec.normalized;
+            }
+        }
 
         spectrum(): LightSpectrum {
             if (!this.reading) {
@@ -49,7 +49,7 @@ namespace sensors {
     const TSL2591_REGISTER_NPAIHTL = 0x0A	// No Persist ALS high threshold lower byte
     const TSL2591_REGISTER_NPAIHTH = 0x0B	// No Persist ALS high threshold upper byte
 
-    const TSL2591_REGISTER_PERSIST = 0x0B	// The Interrupt persistence filter sets the number of consecutive out-of-range ALS cycles necessary to generate an interrupt. Out-of-range is determined by comparing C0DATA (0x14 and 0x15) to the interrupt threshold registers (0x04 - 0x07). Note that the no-persist ALS interrupt is not affected by the interrupt persistence filter. Upon power up, the interrupt persistence filter register resets to 0x00.
+    const TSL2591_REGISTER_PERSIST = 0x0C	// The Interrupt persistence filter sets the number of consecutive out-of-range ALS cycles necessary to generate an interrupt. Out-of-range is determined by comparing C0DATA (0x14 and 0x15) to the interrupt threshold registers (0x04 - 0x07). Note that the no-persist ALS interrupt is not affected by the interrupt persistence filter. Upon power up, the interrupt persistence filter register resets to 0x00.
 
 
     /* #region Enums for Modes, etc */
@@ -72,19 +72,33 @@ namespace sensors {
         ATIME_600_MS = 0x05     // 600 ms
     }
 
+    const TSL2591_SAMPLES = 16	// samples kept in TSL2591.samples
+
     export class TSL2591 extends sensors.LightSpectrumSensor {
 
         private TSL2591_I2C_ADDR: number;
         private isConnected: boolean;
         private atimeIntegrationValue: TSL2591_ATIME;
         private gainSensorValue: TSL2591_AGAIN;
-
-        constructor(id: number) {
+        private interruptPin: DigitalInOutPin;
+        /**
+         * The latest samples, oldest first; each is two UInt16LE values: full (channel 0) and
+         * infrared (channel 1)
+         */
+        samples: RingBuffer;
+
+        /**
+         * @param interruptPin the pin the INT output of the sensor is wired to, if it is; without
+         * it, a background fiber checks for new samples every integration cycle
+         */
+        constructor(id: number, interruptPin?: DigitalInOutPin) {
             super(id);
             this.atimeIntegrationValue = TSL2591_ATIME.ATIME_100_MS,
             this.gainSensorValue = TSL2591_AGAIN.AGAIN_HIGH,
             this.TSL2591_I2C_ADDR = TSL2591_I2C_ADDRESS;
             this.isConnected = false;
+            this.interruptPin = interruptPin;
+            this.samples = new RingBuffer(2 * TSL2591_SAMPLES, NumberFormat.UInt16LE);
             this.initSensor();
         }
 
@@ -116,6 +130,11 @@ namespace sensors {
             //Turn sensor on
             this.enableSensor();
 
+            //REGISTER FORMAT:   CMD | TRANSACTION | ADDRESS
+            //REGISTER VALUE:    TSL2591_REGISTER_COMMAND (0x80) | TSL2591_REGISTER_PERSIST (0x0C)
+            //REGISTER WRITE:    0x00, so that every ALS cycle generates an interrupt
+            pins.i2cWriteRegister(this.TSL2591_I2C_ADDR, TSL2591_REGISTER_COMMAND | TSL2591_REGISTER_PERSIST, 0x00);
+
 
             //REGISTER FORMAT:   CMD | TRANSACTION | ADDRESS
             //REGISTER VALUE:    TSL2591_REGISTER_COMMAND (0x80) | TSL2591_REGISTER_CONTROL (0x01)
@@ -125,13 +144,13 @@ namespace sensors {
 
         private enableSensor() {
             //1 - First set the command bit to 1, to let the device be set
-            //2 - Next, turn it on, then enable ALS, enable ALS Interrupt, and enable No Persist Interrupt
+            //2 - Next, turn it on, then enable ALS, and enable ALS Interrupt
 
             if (this.isConnected)
                 //REGISTER FORMAT:   CMD | TRANSACTION | ADDRESS
                 //REGISTER VALUE:    TSL2591_REGISTER_COMMAND (0x80) | TSL2591_REGISTER_COMMAND_NORMAL (0x20) | TSL2591_REGISTER_ENABLE (0x00)
-                //REGISTER WRITE:    TSL2591_REGISTER_PON_ENABLE (0x01) | TSL2591_REGISTER_AEN_ENABLE (0x02) | TSL2591_REGISTER_AIEN_ENABLE (0x10) | TSL2591_REGISTER_NPIEN_ENABLE (0x80)
-                pins.i2cWriteRegister(this.TSL2591_I2C_ADDR, TSL2591_REGISTER_COMMAND | TSL2591_REGISTER_ENABLE, TSL2591_REGISTER_PON_ENABLE | TSL2591_REGISTER_AEN_ENABLE /*| TSL2591_REGISTER_AIEN_ENABLE | TSL2591_REGISTER_NPIEN_ENABLE*/)
+                //REGISTER WRITE:    TSL2591_REGISTER_PON_ENABLE (0x01) | TSL2591_REGISTER_AEN_ENABLE (0x02) | TSL2591_REGISTER_AIEN_ENABLE (0x10)
+                pins.i2cWriteRegister(this.TSL2591_I2C_ADDR, TSL2591_REGISTER_COMMAND | TSL2591_REGISTER_ENABLE, TSL2591_REGISTER_PON_ENABLE | TSL2591_REGISTER_AEN_ENABLE | TSL2591_REGISTER_AIEN_ENABLE)
         }
 
         disableSensor() {
@@ -145,49 +164,87 @@ namespace sensors {
                 pins.i2cWriteRegister(this.TSL2591_I2C_ADDR, TSL2591_REGISTER_COMMAND | TSL2591_REGISTER_ENABLE, TSL2591_REGISTER_POFF_ENABLE)
         }
 
+        // ms an integration cycle takes
+        private integrationTime() {
+            return (this.atimeIntegrationValue + 1) * 100;
+        }
+
+        // the status and both channels, read in one burst; with clearInterrupt, the interrupt is
+        // cleared in the same transaction
+        private readChannels(clearInterrupt: boolean): Buffer {
+            const reg = control.createBuffer(1);
+            reg[0] = TSL2591_REGISTER_COMMAND | TSL2591_REGISTER_STATUS;
+            const t = new pins.I2CTransaction()
+                .write(this.TSL2591_I2C_ADDR, reg, true)
+                .read(this.TSL2591_I2C_ADDR, 5);
+            if (clearInterrupt) {
+                const clear = control.createBuffer(1);
+                clear[0] = TSL2591_REGISTER_COMMAND_CLEAR_ALS_NO_PERS_INT;
+                t.write(this.TSL2591_I2C_ADDR, clear);
+            }
+            return t.run();
+        }
+
+        private toSpectrum(data: Buffer): LightSpectrum {
+            const retVal = new LightSpectrum();
+            const full = data.getNumber(NumberFormat.UInt16LE, 1);
+            const ir = data.getNumber(NumberFormat.UInt16LE, 3);
+            // catch overflow condition when ir and full are equal (max value)
+            const visible = (full != ir) ? full - ir : full;
+            retVal.full = full;
+            retVal.infrared = ir;
+            retVal.visible = visible;
+            retVal.normalized = Math.map(visible, 0, 37888, 0, 1024);
+            return retVal;
+        }
+
+        // when a cycle completed since the last one, pushes both channels to samples and
+        // updates the spectrum
+        private sample() {
+            const data = this.readChannels(true);
+            if (!data || !(data[0] & TSL2591_REGISTER_STATUS_AINT))
+                return;
+            this.samples.pushBuffer(data.slice(1, 4));
+            this.setSpectrum(this.toSpectrum(data));
+        }
+
+        // samples on each falling edge of the interrupt pin, or every cycle in the background
+        protected startReading() {
+            if (this.reading)
+                return;
+            // keep trying to connect, as readSpectrum() does
+            if (!this.isConnected) {
+                super.startReading();
+                return;
+            }
+            this.reading = true;
+            this.startLevelDetector();
+            if (this.interruptPin) {
+                this.interruptPin.setPull(PinPullMode.PullUp);
+                this.interruptPin.onEvent(PinEvent.Fall, () => this.sample());
+                // in case it was already asserted, when no edge will come
+                this.sample();
+            } else {
+                control.runInBackground(() => {
+                    while (this.reading) {
+                        pause(this.integrationTime());
+                        this.sample();
+                    }
+                });
+            }
+        }
+
         protected readSpectrum(): LightSpectrum {
-            let retVal: LightSpectrum = new LightSpectrum();
             if (this.isConnected) {
-                // this.enableSensor();
-                // basic.pause(100);
-
-                //REGISTER FORMAT:   CMD | TRANSACTION | ADDRESS
-                //REGISTER READ:     TSL2591_REGISTER_COMMAND (0x80) | TSL2591_REGISTER_COMMAND_NORMAL (0x20) | TSL2591_REGISTER_C1DATAL (0x16)
-
-                const channel0l = pins.i2cReadRegister(this.TSL2591_I2C_ADDR, TSL2591_REGISTER_COMMAND | TSL2591_REGISTER_C0DATAL);
-                const channel0h = pins.i2cReadRegister(this.TSL2591_I2C_ADDR, TSL2591_REGISTER_COMMAND | TSL2591_REGISTER_C0DATAH);
-                const channel1l = pins.i2cReadRegister(this.TSL2591_I2C_ADDR, TSL2591_REGISTER_COMMAND | TSL2591_REGISTER_C1DATAL);
-                const channel1h = pins.i2cReadRegister(this.TSL2591_I2C_ADDR, TSL2591_REGISTER_COMMAND | TSL2591_REGISTER_C1DATAH);
-                // const channel1 = pins.i2cReadRegister(this.TSL2591_I2C_ADDR, TSL2591_REGISTER_COMMAND | TSL2591_REGISTER_C1DATAL, NumberFormat.UInt16LE);
-
-                if (channel0l !== undefined && channel0h !== undefined && channel1l !== undefined && channel1h !== undefined) {
-                    const full = channel0l | (channel0h << 8);
-                    const ir = channel1l | (channel1h << 8);
-                    // catch overflow condition when ir and full are equal (max value)
-                    let visible = (full != ir) ? full - ir : full;
-                    // control.dmesg("RAW C0:");
-                    // control.dmesg(channel0l.toString());
-                    // control.dmesg(channel0h.toString());
-                    // control.dmesg("RAW C1:");
-                    // control.dmesg(channel1l.toString());
-                    // control.dmesg(channel1h.toString());
-                    // control.dmesg("PROC:");
-                    // control.dmesg(full.toString());
-                    // control.dmesg(ir.toString());
-                    // control.dmesg(visible.toString());
-
-                    retVal.full = full;
-                    retVal.infrared = ir;
-                    retVal.visible = visible;
-                    retVal.normalized = Math.map(visible, 0, 37888, 0, 1024);
-                }
-                else
-                    control.dmesg("LSBAD");
+                const data = this.readChannels(false);
+                if (data)
+                    return this.toSpectrum(data);
+                control.dmesg("LSBAD");
             }
             else
                 this.initSensor();
 
-            return retVal
+            return new LightSpectrum();
         }
     }
-}
\ No newline at end of file
+}
@@ -54,6 +54,22 @@ const enum LightAnimation {
     ColorWipe
 }
 
+/**
+ * Effects rendered natively on a strip, see NeoPixelStrip.startEffect()
+ */
+const enum LightEffect {
+    //% block="color wipe"
+    ColorWipe = 0,
+    //% block="rainbow"
+    Rainbow = 1,
+    //% block="comet"
+    Comet = 2,
+    //% block="sparkle"
+    Sparkle = 3,
+    //% block="gradient"
+    Gradient = 4
+}
+
 /**
  * Functions to operate colored LEDs.
  */
@@ -93,6 +109,8 @@ namespace light {
         _lastAnimation: NeoPixelAnimation;
         _lastAnimationRenderer: () => boolean;
         _transitionPlayer: BrightnessTransitionPlayer;
+        // set on the top-level strip while light.startEffect() renders on it
+        _effectRunning: boolean;
 
         constructor() {
             this._buffered = false;
@@ -338,35 +356,39 @@ namespace light {
         show(): void {
             if (this._parent) this._parent.show();
             else if (this._dataPin) {
-                const b = this.buf;
+                if (this._effectRunning) this.stopEffect();
+                light.sendBuffer(this._dataPin, this._clkPin, this._mode, this._outputBuffer());
+            }
+        }
 
-                // fast path: no processing
-                if (this._brightness == 0xff && !this._brightnessBuf && !this._photonPenColor) {
-                    // no need to process buffer
-                    light.sendBuffer(this._dataPin, this._clkPin, this._mode, b);
-                    return;
-                }
+        /**
+         * The buffer to send, with brightness and photon applied
+         */
+        _outputBuffer(): Buffer {
+            const b = this.buf;
 
-                // bb may be undefined if the brightness
-                // is uniform over the strip and has not been allocated
-                const _bb = this._brightnessBuf;
-                if (!this._sendBuf) this._sendBuf = control.createBuffer(b.length);
-                const sb = this._sendBuf;
-                const stride = this.stride();
-                const strideOffset = this._mode == NeoPixelMode.APA102 ? 1 : 0;
-                // apply brightness
-                for (let i = 0; i < this._length; ++i) {
-                    const offset = (this._start + i) * stride;
-                    for (let j = 0; j < strideOffset; ++j)
-                        sb[offset + j] = 0xff;
-                    for (let j = strideOffset; j < stride; ++j)
-                        sb[offset + j] = (b[offset + j] * (_bb ? _bb[i] : this._brightness)) >> 8;
-                }
-                // apply photon
-                this.drawPhoton(sb, stride);
-                //console.log(`${!!this._dataPin} ${!!this._clkPin} ${this.mode} hex${sb.toHex()}`)
-                light.sendBuffer(this._dataPin, this._clkPin, this._mode, sb);
+            // fast path: no processing
+            if (this._brightness == 0xff && !this._brightnessBuf && !this._photonPenColor)
+                return b;
+
+            // bb may be undefined if the brightness
+            // is uniform over the strip and has not been allocated
+            const _bb = this._brightnessBuf;
+            if (!this._sendBuf) this._sendBuf = control.createBuffer(b.length);
+            const sb = this._sendBuf;
+            const stride = this.stride();
+            const strideOffset = this._mode == NeoPixelMode.APA102 ? 1 : 0;
+            // apply brightness
+            for (let i = 0; i < this._length; ++i) {
+                const offset = (this._start + i) * stride;
+                for (let j = 0; j < strideOffset; ++j)
+                    sb[offset + j] = 0xff;
+                for (let j = strideOffset; j < stride; ++j)
+                    sb[offset + j] = (b[offset + j] * (_bb ? _bb[i] : this._brightness)) >> 8;
             }
+            // apply photon
+            this.drawPhoton(sb, stride);
+            return sb;
         }
 
         protected drawPhoton(sb: Buffer, stride: number) {
@@ -795,6 +817,48 @@ namespace light {
             this._animationQueue.runUntilDone(render);
         }
 
+        /**
+         * Starts an effect that is rendered and shown without running the program, frame after
+         * frame, until stopEffect() is called or the strip is shown otherwise.
+         * There is one effect at a time on a strip, including its ranges.
+         * @param effect the effect to run
+         * @param rgb the color of the effect, or the first color of a gradient, eg: 0xff0000
+         * @param interval the time between frames in milliseconds, eg: 50
+         * @param rgb2 the second color of a gradient, eg: 0x0000ff
+         * @param gamma correct the colors for how the eye sees them
+         */
+        //% blockId=light_start_effect block="%strip|start effect %effect||color %rgb=colorNumberPicker|every %interval ms"
+        //% help="light/neopixelstrip/start-effect"
+        //% weight=84 blockGap=8
+        //% group="More" advanced=true
+        startEffect(effect: LightEffect, rgb: number = 0xff0000, interval: number = 50, rgb2: number = 0x0000ff, gamma: boolean = true) {
+            let top: NeoPixelStrip = this;
+            while (top._parent) top = top._parent;
+            if (!top._dataPin) return;
+            const config = Buffer.pack("<BBBBHHHHII", [
+                effect, top._mode, this._brightness, gamma ? 1 : 0,
+                this._start, this._length, Math.clamp(1, 0xffff, interval | 0), 0,
+                rgb & 0xffffff, rgb2 & 0xffffff
+            ]);
+            light.startEffect(top._dataPin, top._clkPin, top.buf, config);
+            top._effectRunning = true;
+        }
+
+        /**
+         * Stops the effect started with startEffect(), leaving its last frame in the pixels
+         */
+        //% blockId=light_stop_effect block="%strip|stop effect"
+        //% help="light/neopixelstrip/stop-effect"
+        //% weight=83 blockGap=8
+        //% group="More" advanced=true
+        stopEffect() {
+            let top: NeoPixelStrip = this;
+            while (top._parent) top = top._parent;
+            if (!top._effectRunning) return;
+            top._effectRunning = false;
+            light.stopEffect(top._dataPin);
+        }
+
         /**
          * Stop the current animation and any other animations ready to show.
          */
@@ -1174,6 +1238,30 @@ namespace light {
         return strip;
     }
 
+    /**
+     * Show the changes of several strips at once. APA102 strips sharing a clock pin are
+     * sent together, which is much faster than one after another.
+     * @param strips the strips to show
+     */
+    export function showStrips(strips: NeoPixelStrip[]): void {
+        const pending: NeoPixelStrip[] = [];
+        for (let s of strips) {
+            while (s && s._parent) s = s._parent;
+            if (s && s._dataPin && pending.indexOf(s) < 0)
+                pending.push(s);
+        }
+        while (pending.length) {
+            const first = pending[0];
+            const group = pending.filter(s => s._clkPin == first._clkPin && s._mode == first._mode);
+            for (const s of group) {
+                if (s._effectRunning) s.stopEffect();
+                pending.removeElement(s);
+            }
+            light.sendBuffers(group.map(s => s._dataPin), first._clkPin, first._mode,
+                group.map(s => s._outputBuffer()));
+        }
+    }
+
     /**
      * Converts red, green, blue channels into a RGB color
      * @param red value of the red channel between 0 and 255. eg: 255
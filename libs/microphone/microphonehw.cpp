@@ -2,6 +2,7 @@
 #include "LevelDetector.h"
 #include "LevelDetectorSPL.h"
 #include "DataStream.h"
+#include "spectrum.h"
 
 #ifndef MIC_DEVICE
 // STM?
@@ -25,7 +26,8 @@ class PanicPDM {
 #ifndef MIC_INIT
 #define MIC_INIT                                                                                   \
         : microphone(*LOOKUP_PIN(MIC_DATA), *LOOKUP_PIN(MIC_CLOCK)) \
-        , level(microphone.output, 95.0, 75.0, 9, 52, DEVICE_ID_MICROPHONE)
+        , spectrum(microphone.output) \
+        , level(spectrum, 95.0, 75.0, 9, 52, DEVICE_ID_MICROPHONE)
 #endif
 
 #ifndef MIC_ENABLE
@@ -37,6 +39,7 @@ namespace pxt {
 class WMicrophone {
   public:
     MIC_DEVICE microphone;
+    SpectrumAnalyzer spectrum;
     LevelDetectorSPL level;
     WMicrophone() MIC_INIT { MIC_ENABLE; }
 };
@@ -47,4 +50,9 @@ codal::LevelDetectorSPL *getMicrophoneLevel() {
     return wmic ? &(wmic->level) : NULL;
 }
 
+SpectrumAnalyzer *getMicrophoneSpectrum() {
+    auto wmic = getWMicrophone();
+    return wmic ? &(wmic->spectrum) : NULL;
+}
+
 } // namespace pxt
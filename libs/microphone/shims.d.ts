@@ -28,6 +28,30 @@ declare namespace input {
     //% value.min=1 value.max=255
     //% group="More" weight=14 blockGap=8 shim=input::setLoudSoundThreshold
     function setLoudSoundThreshold(value: int32): void;
+
+    /**
+     * Splits the sound heard by the microphone into frequency bands, from low to high notes, which
+     * are read with soundBand(). More samples in a window give a finer spectrum, less often.
+     * @param windowSize the number of samples in each window, a power of 2 from 32 to 512, or 0 to
+     * stop, eg: 256
+     * @param bands how many bands to split it into, up to 16, eg: 8
+     */
+    //% help=input/set-sound-spectrum
+    //% blockId=input_set_sound_spectrum block="set sound spectrum|window %windowSize|bands %bands"
+    //% parts="microphone"
+    //% group="More" weight=13 blockGap=8 shim=input::setSoundSpectrum
+    function setSoundSpectrum(windowSize: int32, bands: int32): void;
+
+    /**
+     * Reads the energy of a frequency band of the sound, from 0 to 255, once setSoundSpectrum() has
+     * been called. It goes up by 8 every time the energy doubles.
+     * @param band the band, from 0 for the lowest notes
+     */
+    //% help=input/sound-band
+    //% blockId=input_sound_band block="sound band %band"
+    //% parts="microphone"
+    //% group="More" weight=12 blockGap=8 shim=input::soundBand
+    function soundBand(band: int32): int32;
 }
 
 // Auto-generated. Do not edit. Really.
@@ -19,4 +19,21 @@ namespace pxsim.input {
         b.setUsed();
         b.setHighThreshold(value);
     }
+
+    // there are no samples in the simulator; every band follows the sound level
+    let spectrumBands = 0;
+
+    export function setSoundSpectrum(windowSize: number, bands: number) {
+        let b = microphoneState();
+        if (!b) return;
+        b.setUsed();
+        spectrumBands = windowSize >= 32 ? Math.max(1, Math.min(16, bands | 0)) : 0;
+    }
+
+    export function soundBand(band: number): number {
+        let b = microphoneState();
+        if (!b || band < 0 || band >= spectrumBands) return 0;
+        b.setUsed();
+        return b.getLevel();
+    }
 }
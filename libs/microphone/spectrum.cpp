@@ -0,0 +1,236 @@
+#include "pxt.h"
+#include "spectrum.h"
+
+#include <math.h>
+
+namespace pxt {
+
+SpectrumAnalyzer::SpectrumAnalyzer(codal::DataSource &upstream) : upstream(upstream) {
+    downstream = NULL;
+    samples = re = im = cosines = sines = hann = NULL;
+    windowSize = filled = 0;
+    log2Size = numBands = 0;
+    windows = 0;
+    memset((void *)levels, 0, sizeof(levels));
+    upstream.connect(*this);
+}
+
+ManagedBuffer SpectrumAnalyzer::pull() {
+    ManagedBuffer b = buffer;
+    buffer = ManagedBuffer();
+    return b;
+}
+
+void SpectrumAnalyzer::connect(codal::DataSink &sink) {
+    downstream = &sink;
+}
+
+void SpectrumAnalyzer::disconnect() {
+    downstream = NULL;
+}
+
+int SpectrumAnalyzer::getFormat() {
+    return upstream.getFormat();
+}
+
+int SpectrumAnalyzer::setFormat(int format) {
+    return upstream.setFormat(format);
+}
+
+int SpectrumAnalyzer::pullRequest() {
+    buffer = upstream.pull();
+    if (windowSize)
+        addSamples(buffer);
+    if (downstream)
+        return downstream->pullRequest();
+    return DEVICE_OK;
+}
+
+void SpectrumAnalyzer::addSamples(ManagedBuffer b) {
+    int format = upstream.getFormat();
+    bool isSigned = format == DATASTREAM_FORMAT_8BIT_SIGNED;
+    if (format == DATASTREAM_FORMAT_16BIT_SIGNED) {
+        analyze((const int16_t *)b.getBytes(), b.length() / 2);
+    } else if (isSigned || format == DATASTREAM_FORMAT_8BIT_UNSIGNED) {
+        const uint8_t *p = b.getBytes();
+        int len = b.length();
+        int16_t tmp[32];
+        while (len > 0) {
+            int n = min(len, (int)(sizeof(tmp) / 2));
+            for (int i = 0; i < n; ++i)
+                tmp[i] = (isSigned ? (int8_t)p[i] : p[i] - 128) << 8;
+            analyze(tmp, n);
+            p += n;
+            len -= n;
+        }
+    }
+}
+
+void SpectrumAnalyzer::analyze(const int16_t *data, int len) {
+    while (len > 0) {
+        int n = min(len, windowSize - filled);
+        memcpy(samples + filled, data, n * 2);
+        filled += n;
+        data += n;
+        len -= n;
+        if (filled == windowSize) {
+            transform();
+            filled = 0;
+        }
+    }
+}
+
+// radix-2, in place, scaled by 1/2 at every stage so that it can't overflow
+static void fft(int16_t *re, int16_t *im, int log2n, const int16_t *cosines, const int16_t *sines) {
+    int n = 1 << log2n;
+
+    for (int i = 1, j = 0; i < n; ++i) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j |= bit;
+        if (i < j) {
+            int16_t t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    for (int half = 1, step = n >> 1; half < n; half <<= 1, step >>= 1) {
+        for (int i = 0; i < n; i += half * 2) {
+            for (int k = 0; k < half; ++k) {
+                int wr = cosines[k * step], wi = -sines[k * step];
+                int a = i + k, b = a + half;
+                int tr = (wr * re[b] - wi * im[b]) >> 15;
+                int ti = (wr * im[b] + wi * re[b]) >> 15;
+                re[b] = (re[a] - tr) >> 1;
+                im[b] = (im[a] - ti) >> 1;
+                re[a] = (re[a] + tr) >> 1;
+                im[a] = (im[a] + ti) >> 1;
+            }
+        }
+    }
+}
+
+void SpectrumAnalyzer::transform() {
+    for (int i = 0; i < windowSize; ++i) {
+        re[i] = (samples[i] * hann[i]) >> 15;
+        im[i] = 0;
+    }
+    fft(re, im, log2Size, cosines, sines);
+
+    for (int b = 0; b < numBands; ++b) {
+        uint64_t e = 0;
+        for (int k = bandEdges[b]; k < bandEdges[b + 1]; ++k)
+            e += (uint32_t)(re[k] * re[k]) + (uint32_t)(im[k] * im[k]);
+        int level = 0;
+        if (e) {
+            int l2 = 63 - __builtin_clzll(e);
+            int frac = l2 >= 3 ? (e >> (l2 - 3)) & 7 : (e << (3 - l2)) & 7;
+            level = min(255, l2 * 8 + frac);
+        }
+        levels[b] = level;
+    }
+    windows++;
+}
+
+void SpectrumAnalyzer::configure(int size, int bands) {
+    int log2n = 0;
+    if (size >= SPECTRUM_MIN_WINDOW) {
+        size = min(size, SPECTRUM_MAX_WINDOW);
+        while ((2 << log2n) <= size)
+            log2n++;
+        size = 1 << log2n;
+    } else {
+        size = 0;
+    }
+    bands = size ? max(1, min(bands, min(SPECTRUM_MAX_BANDS, size / 2 - 1))) : 0;
+
+    int16_t *mem = NULL;
+    if (size) {
+        // samples, re, im, hann and cos/sin of half a circle
+        mem = (int16_t *)xmalloc(size * 5 * sizeof(int16_t));
+        int16_t *p = mem + size * 3;
+        for (int i = 0; i < size; ++i)
+            p[i] = (int16_t)(16383.5f - 16383.5f * cosf(2 * (float)M_PI * i / size));
+        p += size;
+        for (int i = 0; i < size / 2; ++i) {
+            p[i] = (int16_t)(32767 * cosf(2 * (float)M_PI * i / size));
+            p[size / 2 + i] = (int16_t)(32767 * sinf(2 * (float)M_PI * i / size));
+        }
+    }
+
+    target_disable_irq();
+    int16_t *old = samples;
+    samples = mem;
+    if (mem) {
+        re = mem + size;
+        im = mem + size * 2;
+        hann = mem + size * 3;
+        cosines = mem + size * 4;
+        sines = cosines + size / 2;
+    }
+    windowSize = size;
+    log2Size = log2n;
+    filled = 0;
+    numBands = bands;
+    // log spaced from bin 1, without DC, to half the sample rate
+    bandEdges[0] = 1;
+    for (int b = 1; b <= bands; ++b) {
+        int e = (int)(powf(size / 2, (float)b / bands) + 0.5f);
+        bandEdges[b] = max(e, bandEdges[b - 1] + 1);
+    }
+    if (bands)
+        bandEdges[bands] = size / 2;
+    memset((void *)levels, 0, sizeof(levels));
+    target_enable_irq();
+
+    xfree(old);
+}
+
+int SpectrumAnalyzer::bandLevel(int band) {
+    if (band < 0 || band >= numBands)
+        return 0;
+    return levels[band];
+}
+
+} // namespace pxt
+
+namespace input {
+/**
+ * Splits the sound heard by the microphone into frequency bands, from low to high notes, which
+ * are read with soundBand(). More samples in a window give a finer spectrum, less often.
+ * @param windowSize the number of samples in each window, a power of 2 from 32 to 512, or 0 to
+ * stop, eg: 256
+ * @param bands how many bands to split it into, up to 16, eg: 8
+ */
+//% help=input/set-sound-spectrum
+//% blockId=input_set_sound_spectrum block="set sound spectrum|window %windowSize|bands %bands"
+//% parts="microphone"
+//% group="More" weight=13 blockGap=8
+void setSoundSpectrum(int windowSize, int bands) {
+    auto spectrum = pxt::getMicrophoneSpectrum();
+    if (NULL == spectrum)
+        return;
+    spectrum->configure(windowSize, bands);
+}
+
+/**
+ * Reads the energy of a frequency band of the sound, from 0 to 255, once setSoundSpectrum() has
+ * been called. It goes up by 8 every time the energy doubles.
+ * @param band the band, from 0 for the lowest notes
+ */
+//% help=input/sound-band
+//% blockId=input_sound_band block="sound band %band"
+//% parts="microphone"
+//% group="More" weight=12 blockGap=8
+int soundBand(int band) {
+    auto spectrum = pxt::getMicrophoneSpectrum();
+    if (NULL == spectrum)
+        return 0;
+    return spectrum->bandLevel(band);
+}
+} // namespace input
@@ -0,0 +1,62 @@
+#ifndef __PXT_SPECTRUM_H
+#define __PXT_SPECTRUM_H
+
+#include "pxt.h"
+#include "DataStream.h"
+
+#define SPECTRUM_MIN_WINDOW 32
+#define SPECTRUM_MAX_WINDOW 512
+#define SPECTRUM_MAX_BANDS 16
+
+namespace pxt {
+
+// Sits between the microphone and the level detector, passing the samples on as they are. When
+// configured, every window of samples goes through a fixed-point FFT, from the interrupt that
+// brings them, and the energy of a few frequency bands is kept for bandLevel().
+class SpectrumAnalyzer : public codal::DataSink, public codal::DataSource {
+    codal::DataSource &upstream;
+    codal::DataSink *downstream;
+    ManagedBuffer buffer; // being passed on
+
+    // all in one allocation, swapped with the interrupts off
+    int16_t *samples; // the window being filled
+    int16_t *re, *im;
+    int16_t *cosines, *sines; // for the first half of the circle
+    int16_t *hann;
+    uint16_t windowSize, filled;
+    uint8_t log2Size, numBands;
+    uint16_t bandEdges[SPECTRUM_MAX_BANDS + 1]; // in bins
+
+    volatile uint8_t levels[SPECTRUM_MAX_BANDS];
+    volatile uint32_t windows;
+
+    void addSamples(ManagedBuffer b);
+    void transform();
+
+  public:
+    SpectrumAnalyzer(codal::DataSource &upstream);
+
+    virtual ManagedBuffer pull();
+    virtual void connect(codal::DataSink &sink);
+    virtual void disconnect();
+    virtual int getFormat();
+    virtual int setFormat(int format);
+    virtual int pullRequest();
+
+    // windowSize is rounded down to a power of 2; 0 turns it off
+    void configure(int windowSize, int numBands);
+    // 0 to 255, 8 for every time the energy doubles
+    int bandLevel(int band);
+    // windows analyzed so far
+    uint32_t windowCount() { return windows; }
+
+    // the samples of a window, as the interrupt would add them
+    void analyze(const int16_t *data, int len);
+};
+
+// in microphonehw.cpp
+SpectrumAnalyzer *getMicrophoneSpectrum();
+
+} // namespace pxt
+
+#endif
@@ -1,4 +1,21 @@
 #define SAMPLE_RATE 44100
+// at half of the 16 bit range
+#define OUTPUT_SHIFT 3
+
+// Samples rendered ahead by a thread of the runtime, for the host to take without calling in;
+// see pxt_get_audio_ring(). The layout is shared with the host.
+#define AUDIO_RING_SAMPLES 2048 // a power of 2, and a multiple of AUDIO_RING_BLOCK
+#define AUDIO_RING_BLOCK 256    // rendered at a time
+struct AudioRing {
+    uint32_t sampleRate;
+    uint32_t size; // AUDIO_RING_SAMPLES
+    // the samples rendered and taken so far, which wrap around; samples[readPos % size] is the
+    // next one to play, when readPos != writePos. Only the runtime stores writePos, with release
+    // semantics, and only the host stores readPos, in the same way.
+    uint32_t writePos;
+    uint32_t readPos;
+    int16_t samples[AUDIO_RING_SAMPLES];
+};
 
 namespace music {
 class WSynthesizer;
@@ -19,4 +36,4 @@ class SoundOutput {
     void setOutput(int) {}
 };
 
-} // namespace music
\ No newline at end of file
+} // namespace music
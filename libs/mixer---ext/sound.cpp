@@ -2,30 +2,84 @@
 #include "SoundOutput.h"
 #include "melody.h"
 
+#include <pthread.h>
+
 namespace music {
 
 static ExtDAC *dac;
 
-DLLEXPORT void pxt_get_audio_samples(int16_t *buf, unsigned numSamples) {
+static AudioRing ring;
+static bool ringStarted;
+
+static void render(int16_t *buf, unsigned numSamples) {
     if (!dac) {
         memset(buf, 0, numSamples * 2);
         return;
     }
-
-    target_disable_irq();
     dac->src.fillSamples(buf, numSamples);
-    target_enable_irq();
+}
+
+// keeps the ring full; the host taking samples from it is what sets the pace
+static void *fillRing(void *) {
+    uint32_t lastRead = 0;
+    for (;;) {
+        auto read = __atomic_load_n(&ring.readPos, __ATOMIC_ACQUIRE);
+        auto write = ring.writePos;
+        // the host took everything since the last look
+        if (write == read && read != lastRead && dac)
+            dac->src.stats.underruns++;
+        lastRead = read;
+        while (write - read <= AUDIO_RING_SAMPLES - AUDIO_RING_BLOCK) {
+            render(&ring.samples[write % AUDIO_RING_SAMPLES], AUDIO_RING_BLOCK);
+            write += AUDIO_RING_BLOCK;
+            __atomic_store_n(&ring.writePos, write, __ATOMIC_RELEASE);
+        }
+        sleep_core_us((uint64_t)AUDIO_RING_BLOCK * 1000000 / SAMPLE_RATE / 2);
+    }
+    return NULL;
+}
 
-    for (unsigned i = 0; i < numSamples; ++i) {
-        // playing at half-volume
-        buf[i] = buf[i] << 3;
+static pthread_once_t ringOnce = PTHREAD_ONCE_INIT;
+
+static void startRing() {
+    ring.sampleRate = SAMPLE_RATE;
+    ring.size = AUDIO_RING_SAMPLES;
+    pthread_t pt;
+    pthread_create(&pt, NULL, fillRing, NULL);
+    pthread_detach(pt);
+    __atomic_store_n(&ringStarted, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get the ring the runtime renders audio into from now on, mono 16 bit samples at
+ * ring->sampleRate; the host plays the samples between readPos and writePos and then stores
+ * readPos, without any locking. The ring stays at the same address, and is about
+ * AUDIO_RING_SAMPLES ahead of the host.
+ */
+DLLEXPORT AudioRing *pxt_get_audio_ring() {
+    pthread_once(&ringOnce, startRing);
+    return &ring;
+}
+
+DLLEXPORT void pxt_get_audio_samples(int16_t *buf, unsigned numSamples) {
+    if (!__atomic_load_n(&ringStarted, __ATOMIC_ACQUIRE)) {
+        render(buf, numSamples);
+        return;
     }
 
-    //DMESG("samples %d %d %d %d", numSamples, buf[0], buf[20], buf[100]);
+    // the mixer is only ever run by the ring thread, once there is one
+    auto read = ring.readPos;
+    auto avail = __atomic_load_n(&ring.writePos, __ATOMIC_ACQUIRE) - read;
+    if (avail > numSamples)
+        avail = numSamples;
+    for (unsigned i = 0; i < avail; ++i)
+        buf[i] = ring.samples[(read + i) % AUDIO_RING_SAMPLES];
+    memset(buf + avail, 0, (numSamples - avail) * 2);
+    __atomic_store_n(&ring.readPos, read + avail, __ATOMIC_RELEASE);
 }
 
 ExtDAC::ExtDAC(WSynthesizer &data) : src(data) {
     dac = this;
 }
 
-} // namespace music
\ No newline at end of file
+} // namespace music
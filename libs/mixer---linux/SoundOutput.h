@@ -1,11 +1,14 @@
 #define SAMPLE_RATE 44100
+// at half of the 16 bit range
+#define OUTPUT_SHIFT 3
 
 namespace music {
 class WSynthesizer;
 
 class LinuxDAC {
   public:
-    int16_t data[256];
+    int16_t data[1024];
+    int periodFrames, bufferFrames;
     WSynthesizer &src;
     LinuxDAC(WSynthesizer &data);
     static void *play(void *);
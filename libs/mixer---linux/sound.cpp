@@ -14,6 +14,38 @@ static void alsa_check(int pos, int fn) {
     }
 }
 
+// stop the device after this many silent periods, so it doesn't wake us up for nothing
+#define IDLE_PERIODS 500
+
+static void setParams(snd_pcm_t *pcm_handle, snd_pcm_uframes_t *period, snd_pcm_uframes_t *bufsize) {
+    snd_pcm_hw_params_t *hw;
+    snd_pcm_hw_params_alloca(&hw);
+    alsa_check(10, snd_pcm_hw_params_any(pcm_handle, hw));
+    alsa_check(11, snd_pcm_hw_params_set_access(pcm_handle, hw, SND_PCM_ACCESS_RW_INTERLEAVED));
+    alsa_check(12, snd_pcm_hw_params_set_format(pcm_handle, hw, SND_PCM_FORMAT_S16_LE));
+    alsa_check(13, snd_pcm_hw_params_set_channels(pcm_handle, hw, 1));
+    unsigned rate = SAMPLE_RATE;
+    alsa_check(14, snd_pcm_hw_params_set_rate_near(pcm_handle, hw, &rate, 0));
+    alsa_check(15, snd_pcm_hw_params_set_period_size_near(pcm_handle, hw, period, 0));
+    alsa_check(16, snd_pcm_hw_params_set_buffer_size_near(pcm_handle, hw, bufsize));
+    alsa_check(17, snd_pcm_hw_params(pcm_handle, hw));
+
+    snd_pcm_sw_params_t *sw;
+    snd_pcm_sw_params_alloca(&sw);
+    alsa_check(20, snd_pcm_sw_params_current(pcm_handle, sw));
+    // wake up as soon as a period can be written, and start once one is written
+    alsa_check(21, snd_pcm_sw_params_set_avail_min(pcm_handle, sw, *period));
+    alsa_check(22, snd_pcm_sw_params_set_start_threshold(pcm_handle, sw, *period));
+    alsa_check(23, snd_pcm_sw_params(pcm_handle, sw));
+}
+
+// an xrun (-EPIPE) while playing is the device running out of samples
+static int recover(LinuxDAC *dac, snd_pcm_t *pcm_handle, int err, int silent) {
+    if (err == -EPIPE)
+        dac->src.stats.underruns++;
+    return snd_pcm_recover(pcm_handle, err, silent);
+}
+
 void *LinuxDAC::play(void *self) {
     auto dac = (LinuxDAC *)self;
 
@@ -23,28 +55,51 @@ void *LinuxDAC::play(void *self) {
 
     alsa_check(0, snd_pcm_open(&pcm_handle, "default", SND_PCM_STREAM_PLAYBACK, 0));
 
-    alsa_check(1, snd_pcm_set_params(pcm_handle, SND_PCM_FORMAT_S16_LE,
-                                     SND_PCM_ACCESS_RW_INTERLEAVED, 1, SAMPLE_RATE, 1, 30 * 1000));
+    snd_pcm_uframes_t period = dac->periodFrames;
+    snd_pcm_uframes_t bufsize = dac->bufferFrames;
+    setParams(pcm_handle, &period, &bufsize);
+    if (period > sizeof(dac->data) / 2)
+        period = sizeof(dac->data) / 2;
 
-    DMESG("PCM name: '%s'", snd_pcm_name(pcm_handle));
+    DMESG("PCM name: '%s' period=%d buffer=%d", snd_pcm_name(pcm_handle), (int)period,
+          (int)bufsize);
     DMESG("PCM state: %s", snd_pcm_state_name(snd_pcm_state(pcm_handle)));
 
+    int idle = 0;
     for (;;) {
-        target_disable_irq();
-        auto hasData = dac->src.fillSamples(dac->data, sizeof(dac->data) / 2);
-        target_enable_irq();
-        auto len = (int)sizeof(dac->data) / 2;
-        if (!hasData) {
-            sleep_core_us(5000);
-            continue;
-        }
-        for (int i = 0; i < len; ++i) {
-            // playing at half-volume
-            dac->data[i] = dac->data[i] << 3;
+        unsigned len = period;
+        if (idle >= IDLE_PERIODS) {
+            // nothing to play; keep the sample clock going at about the right pace, 1ms at a time,
+            // until there is
+            sleep_core_us(1000);
+            len = SAMPLE_RATE / 1000;
+            if (!dac->src.fillSamples(dac->data, len))
+                continue;
+            idle = 0;
+            snd_pcm_prepare(pcm_handle);
+        } else {
+            int err = snd_pcm_wait(pcm_handle, 1000);
+            if (err < 0)
+                recover(dac, pcm_handle, err, 1);
+            auto avail = snd_pcm_avail_update(pcm_handle);
+            if (avail < 0) {
+                recover(dac, pcm_handle, avail, 1);
+                continue;
+            }
+            if (avail < (snd_pcm_sframes_t)period)
+                continue;
+            // silence keeps the device running, so the next sound starts a period from now
+            if (dac->src.fillSamples(dac->data, period))
+                idle = 0;
+            else if (++idle >= IDLE_PERIODS) {
+                snd_pcm_drop(pcm_handle);
+                continue;
+            }
         }
+
         int frames = snd_pcm_writei(pcm_handle, dac->data, len);
         if (frames < 0)
-            frames = snd_pcm_recover(pcm_handle, frames, 0);
+            frames = recover(dac, pcm_handle, frames, 0);
         if (frames < 0) {
             DMESG("alsa write faield: %s", snd_strerror(frames));
             target_panic(951);
@@ -55,9 +110,13 @@ void *LinuxDAC::play(void *self) {
 }
 
 LinuxDAC::LinuxDAC(WSynthesizer &data) : src(data) {
+    // AUDIO_PERIOD frames are written at a time, with AUDIO_BUFFER frames queued in the device;
+    // together they set the latency
+    periodFrames = getConfigInt("AUDIO_PERIOD", 128);
+    bufferFrames = getConfigInt("AUDIO_BUFFER", 3 * periodFrames);
     pthread_t upd;
     pthread_create(&upd, NULL, LinuxDAC::play, this);
     pthread_detach(upd);
 }
 
-}
\ No newline at end of file
+}
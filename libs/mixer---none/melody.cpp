@@ -9,6 +9,21 @@ void forceOutput(int outp) {}
 void queuePlayInstructions(int when, Buffer buf) {
 }
 
+//%
+int queuePlayPcm(int when, Buffer buf, int sampleRate, int flags) {
+    return 0;
+}
+
+//%
+int pushPcm(int id, Buffer buf) {
+    return -1;
+}
+
+//%
+Buffer audioStats(bool reset) {
+    return mkBuffer(NULL, 16);
+}
+
 //%
 void enableAmp(int enabled) {
 
@@ -20,7 +20,7 @@ SINGLETON(WSynthesizer);
 // the position loops from 1023 back to 0.
 typedef int (*gentone_t)(PlayingSound* sound, uint32_t position, uint8_t cycle);
 
-static int noiseTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
+static inline int noiseTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
     (void)sound;
     (void)position;
     (void)cycle;
@@ -32,64 +32,66 @@ static int noiseTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
     return (x & 0xffff) - 0x7fff;
 }
 
-static int sineTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
+// A quarter of a sine wave, sin(i * pi / 512) * 32767 for i in 0..256; the rest of the 1024
+// positions follow by symmetry.
+static const int16_t sineQuarter[257] = {
+    0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809, 2009, 2210,
+    2410, 2611, 2811, 3012, 3212, 3412, 3612, 3811, 4011, 4210, 4410, 4609,
+    4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195, 6393, 6590, 6786, 6983,
+    7179, 7375, 7571, 7767, 7962, 8157, 8351, 8545, 8739, 8933, 9126, 9319,
+    9512, 9704, 9896, 10087, 10278, 10469, 10659, 10849, 11039, 11228, 11417, 11605,
+    11793, 11980, 12167, 12353, 12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828,
+    14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269, 15446, 15623, 15800, 15976,
+    16151, 16325, 16499, 16673, 16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+    18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357, 19519, 19680, 19841, 20000,
+    20159, 20317, 20475, 20631, 20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856,
+    22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027, 23170, 23311, 23452, 23592,
+    23731, 23870, 24007, 24143, 24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+    25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198, 26319, 26438, 26556, 26674,
+    26790, 26905, 27019, 27133, 27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001,
+    28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803, 28898, 28992, 29085, 29177,
+    29268, 29358, 29447, 29534, 29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+    30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783, 30852, 30919, 30985, 31050,
+    31113, 31176, 31237, 31297, 31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736,
+    31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098, 32137, 32176, 32213, 32250,
+    32285, 32318, 32351, 32382, 32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+    32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717, 32728, 32737, 32745, 32752,
+    32757, 32761, 32765, 32766, 32767};
+
+static inline int sineTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
     (void)sound;
     (void)cycle;
-    int32_t p = position;
-    if (p >= 512) {
-	p -= 512;
-    }
+    int32_t p = position & 511;
     if (p > 256) {
 	p = 512 - p;
     }
-
-    // Approximate sin(x * pi / 2) with the odd polynomial y = cx^5 + bx^3 + ax
-    // using the constraint y(1) = 1 => a = 1 - b - c
-    //   => y = c x^5 + b x^3 + (1 - b - c) * x
-    //
-    // Do a least-squares fit of this to sin(x * pi / 2) in the range 0..1
-    // inclusive, using 21 evenly spaced points. Resulting approximation:
-    //
-    // sin(x*pi/2) ~= 0.0721435357258*x**5 - 0.642443736562*x**3 + 1.57030020084*x
-
-    // Scale the constants by 32767 to match the desired output range.
-    constexpr int32_t c = 0.0721435357258 * 32767;
-    constexpr int32_t b = -0.642443736562 * 32767;
-    constexpr int32_t a = 1.57030020084 * 32767;
-
-    // Calculate using y = ((c * x^2 + b) * x^2 + a) * x
-    //
-    // The position p is x * 256, so after each multiply with p we need to
-    // shift right by 8 bits to keep the decimal point in the same place.  (The
-    // approximation has a negative error near x=1 which helps avoid overflow.)
-    int32_t p2 = p * p;
-    int32_t u = (c * p2 >> 16) + b;
-    int32_t v = (u * p2 >> 16) + a;
-    int32_t w = v * p >> 8;
-
-    // The result is within 7/32767 or 0.02%, signal-to-error ratio about 38 dB.
+    int w = sineQuarter[p];
     return position >= 512 ? -w : w;
 }
 
-static int sawtoothTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
+static inline int sawtoothTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
     (void)sound;
     (void)cycle;
     return (position << 6) - 0x7fff;
 }
 
-static int triangleTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
+static inline int triangleTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
     (void)sound;
     (void)cycle;
     return position < 512 ? (position << 7) - 0x7fff : ((1023 - position) << 7) - 0x7fff;
 }
 
-static int squareWaveTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
-    (void)cycle;
+static inline uint32_t squareWaveDuty(PlayingSound* sound) {
     uint8_t wave = sound->currInstr->soundWave;
-    return position < (102 * (wave - SW_SQUARE_10 + 1)) ? -0x7fff : 0x7fff;
+    return 102 * (wave - SW_SQUARE_10 + 1);
 }
 
-static int tunedNoiseTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
+static inline int squareWaveTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
+    (void)cycle;
+    return position < squareWaveDuty(sound) ? -0x7fff : 0x7fff;
+}
+
+static inline int tunedNoiseTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
     // Generate a square wave filtered by a random bit sequence. Since the generator
     // is called multiple times per wave, use PlayingSound state data to ensure we
     // only generate a random bit once per wave, and then reuse it for future
@@ -127,7 +129,7 @@ static int tunedNoiseTone(PlayingSound* sound, uint32_t position, uint8_t cycle)
 static const uint32_t cycle_bits[] = { 0x2df0eb47, 0xc8165a93 };
 static const uint8_t cycle_mask[] = { 0xf, 0x1f, 0x3f };
 
-static int cycleNoiseTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
+static inline int cycleNoiseTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
     // Generate a square wave filtered by a short-cycle pseudorandom bit sequence.
     // The bit sequence repeats every 16/32/64 waves.
     //
@@ -143,83 +145,310 @@ static int cycleNoiseTone(PlayingSound* sound, uint32_t position, uint8_t cycle)
     return position < 512 ? -0x7fff : 0x7fff;
 }
 
-static int silenceTone(PlayingSound* sound, uint32_t position, uint8_t cycle) {
-    // Generate a square wave filtered by a short-cycle pseudorandom bit sequence.
+// Corrections to the generators above that need the phase below the 10-bit position, or the
+// step of the phase per sample. phase is the position in 10.16 fixed point, range 0..2^26-1; step
+// is in the same units.
+typedef int (*genfine_t)(PlayingSound* sound, uint32_t phase, uint32_t step);
+
+static inline int noFine(PlayingSound* sound, uint32_t phase, uint32_t step) {
     (void)sound;
-    (void)position;
-    (void)cycle;
+    (void)phase;
+    (void)step;
     return 0;
 }
 
-static gentone_t getWaveFn(uint8_t wave) {
+#define PHASE_ONE (1U << 26)
+
+// PolyBLEP residual of a jump from +0x7fff to -0x7fff at phase 0. Subtracting it from a wave
+// rounds off the jump over the sample on each side of it, which removes most of the aliasing
+// of the jump at high frequencies.
+static inline int polyBlep(uint32_t phase, uint32_t step) {
+    uint32_t d;
+    int sign;
+    if (phase < step) {
+        d = phase;
+        sign = -1;
+    } else if (phase > PHASE_ONE - step) {
+        d = PHASE_ONE - phase;
+        sign = 1;
+    } else {
+        return 0;
+    }
+    // x = d / step in 0.15 fixed point; scale both down so the division fits in 32 bits
+    int shift = 16 - __builtin_clz(step);
+    if (shift > 0) {
+        d >>= shift;
+        step >>= shift;
+    }
+    uint32_t x = (d << 15) / step;
+    if (x > 0x8000)
+        x = 0x8000;
+    uint32_t r = 0x8000 - x;
+    return sign * (int)((r * r) >> 15);
+}
+
+static inline int sawtoothFine(PlayingSound* sound, uint32_t phase, uint32_t step) {
+    (void)sound;
+    return -polyBlep(phase, step);
+}
+
+static inline int squareWaveFine(PlayingSound* sound, uint32_t phase, uint32_t step) {
+    uint32_t up = (phase - (squareWaveDuty(sound) << 16)) & (PHASE_ONE - 1);
+    return polyBlep(up, step) - polyBlep(phase, step);
+}
+
+#ifndef CODAL
+// hosted targets have the cycles to interpolate between the table entries
+static inline int sineFine(PlayingSound* sound, uint32_t phase, uint32_t step) {
+    (void)step;
+    uint32_t position = phase >> 16;
+    int next = sineTone(sound, (position + 1) & 1023, 0) - sineTone(sound, position, 0);
+    return (next * (int)(phase & 0xffff)) >> 16;
+}
+#endif
+
+#define CLAMP(lo, v, hi) ((v) = ((v) < (lo) ? (lo) : (v) > (hi) ? (hi) : (v)))
+
+// Envelope and pitch of a voice, in 16.16 fixed point, carried from sample to sample.
+struct ToneState {
+    uint32_t position;
+    uint32_t step;
+    int32_t delta;
+    int32_t volume;
+    int32_t volumeStep;
+};
+
+// Adds n samples of a voice to dst. There is one instance per generator, so the generator, and its
+// correction if any, get inlined into the loop instead of being called through a pointer for every
+// sample.
+typedef void (*genblock_t)(PlayingSound *sound, int16_t *dst, int n, ToneState &ts);
+
+template <gentone_t fn, genfine_t fine = noFine>
+static void genBlock(PlayingSound *sound, int16_t *dst, int n, ToneState &ts) {
+    uint32_t position = ts.position;
+    uint32_t step = ts.step;
+    int32_t delta = ts.delta;
+    int32_t volume = ts.volume;
+    int32_t volumeStep = ts.volumeStep;
+
+    for (int j = 0; j < n; ++j) {
+        int v = fn(sound, (position >> 16) & 1023, position >> 26);
+        v += fine(sound, position & (PHASE_ONE - 1), step);
+        dst[j] += (v * (volume >> 16)) >> (10 + (16 - OUTPUT_BITS));
+        position += step;
+        step += delta;
+        volume += volumeStep;
+    }
+
+    ts.position = position;
+    ts.step = step;
+    ts.volume = volume;
+}
+
+static genblock_t getWaveFn(uint8_t wave) {
     switch (wave) {
     case SW_TRIANGLE:
-        return triangleTone;
+        return genBlock<triangleTone>;
     case SW_SAWTOOTH:
-        return sawtoothTone;
+        return genBlock<sawtoothTone, sawtoothFine>;
     case SW_TUNEDNOISE:
-        return tunedNoiseTone;
+        return genBlock<tunedNoiseTone>;
     case SW_NOISE:
-        return noiseTone;
+        return genBlock<noiseTone>;
     case SW_SINE:
-        return sineTone;
+#ifdef CODAL
+        return genBlock<sineTone>;
+#else
+        return genBlock<sineTone, sineFine>;
+#endif
     default:
         if (SW_SQUARE_10 <= wave && wave <= SW_SQUARE_50)
-            return squareWaveTone;
+            return genBlock<squareWaveTone, squareWaveFine>;
         if (SW_SQUARE_CYCLE_16 <= wave && wave <= SW_SQUARE_CYCLE_64)
-            return cycleNoiseTone;
+            return genBlock<cycleNoiseTone>;
         else
-            return silenceTone;
+            return NULL;
     }
 }
 
-#define CLAMP(lo, v, hi) ((v) = ((v) < (lo) ? (lo) : (v) > (hi) ? (hi) : (v)))
+// Clamps the mixed samples to the output range, and shifts them by OUTPUT_SHIFT.
+static void saturate(int16_t *dst, int numsamples) {
+    const int MAXVAL = (1 << (OUTPUT_BITS - 1)) - 1;
+    int j = 0;
+#if defined(__ARM_FEATURE_SIMD32) && OUTPUT_SHIFT == 0
+    // two samples per instruction; this clamps from below to -MAXVAL-1, which is still in range
+    if ((uintptr_t)dst & 2) {
+        CLAMP(-MAXVAL, dst[0], MAXVAL);
+        j++;
+    }
+    uint32_t *dp = (uint32_t *)(dst + j);
+    for (; j + 1 < numsamples; j += 2) {
+        uint32_t v = *dp;
+        asm("ssat16 %0, %1, %2" : "=r"(v) : "I"(OUTPUT_BITS), "r"(v));
+        *dp++ = v;
+    }
+#endif
+    for (; j < numsamples; ++j) {
+        CLAMP(-MAXVAL, dst[j], MAXVAL);
+#if OUTPUT_SHIFT
+        dst[j] <<= OUTPUT_SHIFT;
+#endif
+    }
+}
+
+// Picks the voice for a new sound: a free one, otherwise the quietest playing one, and of those
+// the one playing longest.
+PlayingSound *WSynthesizer::allocVoice() {
+    PlayingSound *best = NULL;
+    int bestVolume = 0;
+    for (unsigned i = 0; i < MAX_SOUNDS; ++i) {
+        PlayingSound *snd = &playingSounds[i];
+        if (snd->sound == NULL)
+            return snd;
+        // a sound that hasn't played a sample yet is about to be loud
+        int volume = snd->prevVolume == -1 ? 1024 : snd->prevVolume >> 16;
+        if (!best || volume < bestVolume ||
+            (volume == bestVolume &&
+             (int32_t)(snd->startSampleNo - best->startSampleNo) < 0)) {
+            best = snd;
+            bestVolume = volume;
+        }
+    }
+    return best;
+}
+
+// The state of a sound is set by fillSamples(), and read by the main thread to know when it can
+// free the sound.
+static inline SoundState soundState(WaitingSound *p) {
+    return (SoundState)__atomic_load_n((uint8_t *)&p->state, __ATOMIC_ACQUIRE);
+}
+
+static inline void setSoundState(WaitingSound *p, SoundState state) {
+    __atomic_store_n((uint8_t *)&p->state, (uint8_t)state, __ATOMIC_RELEASE);
+}
 
 int WSynthesizer::updateQueues() {
+    // move newly queued sounds to waiting, after the ones starting earlier or at the same time
+    uint32_t head = incomingHead;
+    uint32_t tail = __atomic_load_n(&incomingTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        WaitingSound *p = incoming[head++ % INCOMING_SOUNDS];
+        auto pp = &waiting;
+        while (*pp && (int32_t)((*pp)->startSampleNo - p->startSampleNo) <= 0)
+            pp = &(*pp)->nextWaiting;
+        p->nextWaiting = *pp;
+        *pp = p;
+    }
+    __atomic_store_n(&incomingHead, head, __ATOMIC_RELEASE);
+
     const int maxTime = 0xffffff;
-    while (1) {
-        WaitingSound *p;
-        int minLeft = maxTime;
-        for (p = waiting; p; p = p->next) {
-            int timeLeft =
-                p->state == SoundState::Waiting ? p->startSampleNo - currSample : maxTime;
-            if (timeLeft <= 0) {
-                break;
-            }
-            if (timeLeft < minLeft)
-                minLeft = timeLeft;
-        }
-        if (p) {
-            PlayingSound *snd;
-            int minIdx = -1;
-            for (unsigned i = 0; i < MAX_SOUNDS; ++i) {
-                snd = &playingSounds[i];
-                if (snd->sound == NULL)
-                    break;
-                if (minIdx == -1 ||
-                    playingSounds[minIdx].startSampleNo < playingSounds[i].startSampleNo)
-                    minIdx = i;
-                snd = NULL;
-            }
-            // if we didn't find a free slot, expel the oldest sound
-            if (!snd)
-                snd = &playingSounds[minIdx];
-            if (snd->sound)
-                snd->sound->state = SoundState::Done;
-            snd->sound = p;
-            p->state = SoundState::Playing;
-            snd->startSampleNo = currSample;
+    while (waiting) {
+        WaitingSound *p = waiting;
+        int timeLeft = p->startSampleNo - currSample;
+        if (timeLeft > 0)
+            return timeLeft < maxTime ? timeLeft : maxTime;
+
+        waiting = p->nextWaiting;
+
+        PlayingSound *snd = allocVoice();
+        if (snd->sound)
+            setSoundState(snd->sound, SoundState::Done);
+        snd->sound = p;
+        setSoundState(p, SoundState::Playing);
+        snd->startSampleNo = currSample;
+        snd->prevVolume = -1;
+        if (p->pcm) {
+            snd->tonePosition = 0;
+            snd->prevToneStep = ((uint32_t)p->pcm->sampleRate << 16) / sampleRate;
+        } else {
             snd->currInstr = (SoundInstruction *)p->instructions->data;
             snd->instrEnd = snd->currInstr + p->instructions->length / sizeof(SoundInstruction);
-            snd->prevVolume = -1;
-        } else {
-            // no more sounds to move
-            return minLeft;
         }
     }
+    return maxTime;
+}
+
+static inline int pcmSample(Buffer chunk, int i, bool wide) {
+    return wide ? ((int16_t *)chunk->data)[i] : (chunk->data[i] - 128) << 8;
+}
+
+// Adds numsamples of a PCM stream to dst, resampled by linear interpolation; returns false when
+// the stream has run out of chunks.
+bool WSynthesizer::fillPcm(PlayingSound *snd, int16_t *dst, int numsamples) {
+    PcmStream *pcm = snd->sound->pcm;
+    bool wide = pcm->flags & PCM_16BIT;
+    int volume = pcm->volume;
+    uint32_t position = snd->tonePosition; // in samples of the head chunk, 16.16 fixed point
+    uint32_t step = snd->prevToneStep;
+
+    uint8_t head = pcm->head;
+    uint8_t tail = __atomic_load_n(&pcm->tail, __ATOMIC_ACQUIRE);
+
+    while (numsamples > 0) {
+        if (head == tail) {
+            __atomic_store_n(&pcm->head, head, __ATOMIC_RELEASE);
+            return false;
+        }
+        Buffer chunk = pcm->chunks[head % PCM_CHUNKS];
+        int len = chunk->length >> wide;
+        int i = position >> 16;
+        if (i >= len) {
+            position -= len << 16;
+            head++;
+            continue;
+        }
+
+        int n = numsamples;
+        while (n > 0 && i < len) {
+            int a = pcmSample(chunk, i, wide);
+            int b = a;
+            if (i + 1 < len)
+                b = pcmSample(chunk, i + 1, wide);
+            else if ((uint8_t)(head + 1) != tail)
+                b = pcmSample(pcm->chunks[(head + 1) % PCM_CHUNKS], 0, wide);
+            int v = a + (((b - a) * (int)((position & 0xffff) >> 8)) >> 8);
+            *dst++ += (v * volume) >> (10 + (16 - OUTPUT_BITS));
+            position += step;
+            i = position >> 16;
+            n--;
+        }
+        numsamples = n;
+    }
+
+    __atomic_store_n(&pcm->head, head, __ATOMIC_RELEASE);
+    snd->tonePosition = position;
+    snd->prevVolume = volume << 16;
+    return true;
 }
 
+// Called from the audio thread or interrupt; it never waits for the main thread.
 int WSynthesizer::fillSamples(int16_t *dst, int numsamples) {
+    __atomic_store_n(&filling, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&stopping, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&filling, false, __ATOMIC_RELEASE);
+        memset(dst, 0, numsamples * 2);
+        return 1;
+    }
+
+    if (__atomic_load_n(&resetStats, __ATOMIC_ACQUIRE)) {
+        memset(&stats, 0, sizeof(stats));
+        __atomic_store_n(&resetStats, false, __ATOMIC_RELEASE);
+    }
+    uint64_t start = current_time_us();
+    PXT_TRACE_EVENT(MixerFill, numsamples, 0);
+    int res = mixSamples(dst, numsamples);
+    PXT_TRACE_EVENT(MixerFillEnd, 0, 0);
+    uint32_t us = current_time_us() - start;
+    stats.fills++;
+    stats.samples += numsamples;
+    if (us > stats.maxFillUs)
+        stats.maxFillUs = us;
+
+    __atomic_store_n(&filling, false, __ATOMIC_RELEASE);
+    return res;
+}
+
+int WSynthesizer::mixSamples(int16_t *dst, int numsamples) {
     if (numsamples <= 0)
         return 1;
 
@@ -229,9 +458,9 @@ int WSynthesizer::fillSamples(int16_t *dst, int numsamples) {
     // if there's a pending sound to be started somewhere during numsamples,
     // split the call into two
     if (timeLeft < numsamples) {
-        fillSamples(dst, timeLeft);
+        mixSamples(dst, timeLeft);
         LOG("M split %d", timeLeft);
-        fillSamples(dst + timeLeft, numsamples - timeLeft);
+        mixSamples(dst + timeLeft, numsamples - timeLeft);
         return 1;
     }
 
@@ -239,7 +468,6 @@ int WSynthesizer::fillSamples(int16_t *dst, int numsamples) {
 
     uint32_t samplesPerMS = (sampleRate << 8) / 1000;
     float toneStepMult = (1024.0 * (1 << 16)) / sampleRate;
-    const int MAXVAL = (1 << (OUTPUT_BITS - 1)) - 1;
 
     for (unsigned i = 0; i < MAX_SOUNDS; ++i) {
         PlayingSound *snd = &playingSounds[i];
@@ -248,18 +476,22 @@ int WSynthesizer::fillSamples(int16_t *dst, int numsamples) {
 
         res = 1;
 
+        if (snd->sound->pcm) {
+            if (!fillPcm(snd, dst, numsamples)) {
+                setSoundState(snd->sound, SoundState::Done);
+                snd->sound = NULL;
+            }
+            continue;
+        }
+
         SoundInstruction *instr = NULL;
-        gentone_t fn = NULL;
+        genblock_t fn = NULL;
         snd->currInstr--;
-        uint32_t toneStep = 0;
-        int32_t toneDelta = 0;
-        int32_t volumeStep = 0;
-        uint32_t tonePosition = snd->tonePosition;
+        ToneState ts = {snd->tonePosition, 0, 0, 0, 0};
         uint32_t samplesLeft = 0;
-        uint8_t wave = 0;
-        int32_t volume = 0;
 
-        for (int j = 0; j < numsamples; ++j) {
+        int j = 0;
+        while (j < numsamples) {
             if (samplesLeft == 0) {
                 snd->currInstr++;
                 if (snd->currInstr >= snd->instrEnd) {
@@ -273,71 +505,69 @@ int WSynthesizer::fillSamples(int16_t *dst, int numsamples) {
                 CLAMP(0, instr->endVolume, 1023);
                 CLAMP(1, instr->duration, 60000);
 
-                wave = instr->soundWave;
-                fn = getWaveFn(wave);
+                fn = getWaveFn(instr->soundWave);
 
                 samplesLeft = (uint32_t)(instr->duration * samplesPerMS >> 8);
                 // make sure the division is signed
-                volumeStep =
+                ts.volumeStep =
                     (int)((instr->endVolume - instr->startVolume) << 16) / (int)samplesLeft;
 
                 if (j == 0 && snd->prevVolume != -1) {
                     // restore previous state
                     samplesLeft = snd->samplesLeftInCurr;
-                    volume = snd->prevVolume;
-                    toneStep = snd->prevToneStep;
-                    toneDelta = snd->prevToneDelta;
+                    ts.volume = snd->prevVolume;
+                    ts.step = snd->prevToneStep;
+                    ts.delta = snd->prevToneDelta;
                 } else {
                     LOG("#sampl %d %p", samplesLeft, snd->currInstr);
-                    volume = instr->startVolume << 16;
+                    ts.volume = instr->startVolume << 16;
                     LOG("%d-%dHz %d-%d vol", instr->frequency, instr->endFrequency,
                         instr->startVolume, instr->endVolume);
-                    toneStep = (uint32_t)(toneStepMult * instr->frequency);
+                    ts.step = (uint32_t)(toneStepMult * instr->frequency);
                     if (instr->frequency != instr->endFrequency) {
                         uint32_t endToneStep = (uint32_t)(toneStepMult * instr->endFrequency);
-                        toneDelta = (int32_t)(endToneStep - toneStep) / (int32_t)samplesLeft;
+                        ts.delta = (int32_t)(endToneStep - ts.step) / (int32_t)samplesLeft;
                     } else {
-                        toneDelta = 0;
+                        ts.delta = 0;
                     }
                 }
             }
 
-            int v = fn(snd, (tonePosition >> 16) & 1023, tonePosition >> 26);
-            v = (v * (volume >> 16)) >> (10 + (16 - OUTPUT_BITS));
-
-            // if (v > MAXVAL)
-            //    target_panic(123);
-
-            dst[j] += v;
+            // the rest of the instruction, or of the buffer
+            int n = numsamples - j;
+            if ((uint32_t)n > samplesLeft)
+                n = samplesLeft;
+
+            if (fn) {
+                fn(snd, dst + j, n, ts);
+            } else {
+                // silence; only move the tone and envelope along
+                ts.position += n * ts.step + ts.delta * (uint32_t)(n * (n - 1) / 2);
+                ts.step += n * ts.delta;
+                ts.volume += n * ts.volumeStep;
+            }
 
-            tonePosition += toneStep;
-            toneStep += toneDelta;
-            volume += volumeStep;
-            samplesLeft--;
+            j += n;
+            samplesLeft -= n;
         }
 
         if (snd->currInstr >= snd->instrEnd) {
-            snd->sound->state = SoundState::Done;
+            setSoundState(snd->sound, SoundState::Done);
             snd->sound = NULL;
         } else {
-            snd->tonePosition = tonePosition;
+            snd->tonePosition = ts.position;
             if (samplesLeft == 0)
                 samplesLeft++; // avoid infinite loop in next iteration
             snd->samplesLeftInCurr = samplesLeft;
-            snd->prevVolume = volume;
-            snd->prevToneDelta = toneDelta;
-            snd->prevToneStep = toneStep;
+            snd->prevVolume = ts.volume;
+            snd->prevToneDelta = ts.delta;
+            snd->prevToneStep = ts.step;
         }
     }
 
-    currSample += numsamples;
+    __atomic_store_n(&currSample, currSample + numsamples, __ATOMIC_RELAXED);
 
-    for (int j = 0; j < numsamples; ++j) {
-        if (dst[j] > MAXVAL)
-            dst[j] = MAXVAL;
-        else if (dst[j] < -MAXVAL)
-            dst[j] = -MAXVAL;
-    }
+    saturate(dst, numsamples);
 
     return res;
 }
@@ -361,6 +591,70 @@ void forceOutput(int outp) {
     snd->out.setOutput(outp);
 }
 
+// unregister the chunks fillSamples() is done with, or all of them
+static void releasePcm(PcmStream *pcm, bool all) {
+    uint8_t end = all ? pcm->tail : __atomic_load_n(&pcm->head, __ATOMIC_ACQUIRE);
+    while (pcm->released != end) {
+        auto i = pcm->released++ % PCM_CHUNKS;
+        unregisterGCObj(pcm->chunks[i]);
+        pcm->chunks[i] = NULL;
+    }
+}
+
+static void freeSound(WaitingSound *p) {
+    if (p->pcm) {
+        releasePcm(p->pcm, true);
+        delete p->pcm;
+    } else {
+        unregisterGCObj(p->instructions);
+    }
+    delete p;
+}
+
+// Hands a new sound to fillSamples(), and frees the ones it is done with.
+void WSynthesizer::queue(WaitingSound *p) {
+    uint32_t tail = incomingTail;
+    for (int tries = 0;; ++tries) {
+        uint32_t head = __atomic_load_n(&incomingHead, __ATOMIC_ACQUIRE);
+        if (tail - head < INCOMING_SOUNDS)
+            break;
+        // more sounds than fillSamples() takes in a buffer; let it catch up, unless it doesn't
+        // run at all, eg. when nothing plays the samples
+        if (tries == 10 || (stalled && head == stalledHead)) {
+            DMESG("mixer: sound dropped");
+            stalled = true;
+            stalledHead = head;
+            freeSound(p);
+            return;
+        }
+        poke();
+        sleep_ms(1);
+    }
+    stalled = false;
+    incoming[tail % INCOMING_SOUNDS] = p;
+    __atomic_store_n(&incomingTail, tail + 1, __ATOMIC_RELEASE);
+
+    p->next = sounds;
+    sounds = p;
+    for (auto pp = &p->next; *pp;) {
+        auto q = *pp;
+        if (soundState(q) == SoundState::Done) {
+            *pp = q->next;
+            freeSound(q);
+        } else {
+            if (q->pcm)
+                releasePcm(q->pcm, false);
+            pp = &q->next;
+        }
+    }
+
+    poke();
+}
+
+static uint32_t startSample(WSynthesizer *snd, int when) {
+    return __atomic_load_n(&snd->currSample, __ATOMIC_RELAXED) + when * snd->sampleRate / 1000;
+}
+
 //%
 void queuePlayInstructions(int when, Buffer buf) {
     auto snd = getWSynthesizer();
@@ -370,28 +664,79 @@ void queuePlayInstructions(int when, Buffer buf) {
     auto p = new WaitingSound;
     p->state = SoundState::Waiting;
     p->instructions = buf;
-    p->startSampleNo = snd->currSample + when * snd->sampleRate / 1000;
+    p->pcm = NULL;
+    p->startSampleNo = startSample(snd, when);
 
     LOG("Queue %dms now=%d off=%d %p sampl:%dHz", when, snd->currSample,
         p->startSampleNo - snd->currSample, buf->data, snd->sampleRate);
 
-    target_disable_irq();
-    // add new sound to queue
-    p->next = snd->waiting;
-    snd->waiting = p;
-    // remove sounds that have already been fully played
-    while (p) {
-        while (p->next && p->next->state == SoundState::Done) {
-            auto todel = p->next;
-            p->next = todel->next;
-            unregisterGCObj(todel->instructions);
-            delete todel;
+    snd->queue(p);
+}
+
+/**
+ * Queue PCM samples from buf to play in when milliseconds, at sampleRate samples per second, with
+ * the volume in flags from PCM_VOLUME_SHIFT on. Returns the id of the stream, for pushPcm() to
+ * add more samples.
+ */
+//%
+int queuePlayPcm(int when, Buffer buf, int sampleRate, int flags) {
+    auto snd = getWSynthesizer();
+
+    int volume = flags >> PCM_VOLUME_SHIFT;
+    flags &= (1 << PCM_VOLUME_SHIFT) - 1;
+
+    CLAMP(1, sampleRate, 0xffff);
+    CLAMP(0, volume, 1023);
+
+    auto pcm = new PcmStream;
+    memset(pcm, 0, sizeof(*pcm));
+    pcm->flags = flags;
+    pcm->sampleRate = sampleRate;
+    pcm->volume = volume;
+    pcm->id = ++snd->lastPcmId;
+    if (buf->length >> (flags & PCM_16BIT)) {
+        registerGCObj(buf);
+        pcm->chunks[0] = buf;
+        pcm->tail = 1;
+    }
+
+    auto p = new WaitingSound;
+    p->state = SoundState::Waiting;
+    p->instructions = NULL;
+    p->pcm = pcm;
+    p->startSampleNo = startSample(snd, when);
+
+    int id = pcm->id;
+    snd->queue(p); // might free it
+    return id;
+}
+
+/**
+ * Add a chunk of samples to the end of a PCM stream. Returns the number of chunks the stream has
+ * left to play, 0 when it can't take more yet, or -1 when it has stopped.
+ */
+//%
+int pushPcm(int id, Buffer buf) {
+    auto snd = getWSynthesizer();
+
+    for (auto p = snd->sounds; p; p = p->next) {
+        auto pcm = p->pcm;
+        if (!pcm || pcm->id != id)
+            continue;
+        if (soundState(p) == SoundState::Done)
+            return -1;
+        releasePcm(pcm, false);
+        if ((uint8_t)(pcm->tail - pcm->released) >= PCM_CHUNKS)
+            return 0;
+        if (buf->length >> (pcm->flags & PCM_16BIT)) {
+            registerGCObj(buf);
+            pcm->chunks[pcm->tail % PCM_CHUNKS] = buf;
+            __atomic_store_n(&pcm->tail, (uint8_t)(pcm->tail + 1), __ATOMIC_RELEASE);
         }
-        p = p->next;
+        return (uint8_t)(pcm->tail - __atomic_load_n(&pcm->head, __ATOMIC_ACQUIRE));
     }
-    target_enable_irq();
 
-    snd->poke();
+    return -1;
 }
 
 //%
@@ -400,19 +745,39 @@ void stopPlaying() {
 
     auto snd = getWSynthesizer();
 
-    target_disable_irq();
-    auto p = snd->waiting;
+    // keep fillSamples() out, and wait for the current call, if any, to finish
+    __atomic_store_n(&snd->stopping, true, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&snd->filling, __ATOMIC_SEQ_CST))
+        ;
+
+    auto p = snd->sounds;
+    snd->sounds = NULL;
     snd->waiting = NULL;
+    snd->incomingHead = snd->incomingTail;
     for (unsigned i = 0; i < MAX_SOUNDS; ++i) {
         snd->playingSounds[i].sound = NULL;
     }
     while (p) {
         auto n = p->next;
-        unregisterGCObj(p->instructions);
-        delete p;
+        freeSound(p);
         p = n;
     }
-    target_enable_irq();
+
+    __atomic_store_n(&snd->stopping, false, __ATOMIC_RELEASE);
+}
+
+/**
+ * Statistics of the mixer, as UInt32LE numbers: calls to fill the output, samples filled, the
+ * longest time a call took in microseconds, and the times the output ran out of samples.
+ */
+//%
+Buffer audioStats(bool reset) {
+    auto snd = getWSynthesizer();
+    // torn between fields at worst
+    auto r = mkBuffer((uint8_t *)&snd->stats, sizeof(AudioStats));
+    if (reset)
+        __atomic_store_n(&snd->resetStats, true, __ATOMIC_RELEASE);
+    return r;
 }
 
 WSynthesizer::WSynthesizer() : upstream(NULL), out(*this) {
@@ -421,6 +786,15 @@ WSynthesizer::WSynthesizer() : upstream(NULL), out(*this) {
     sampleRate = out.dac.getSampleRate();
     memset(&playingSounds, 0, sizeof(playingSounds));
     waiting = NULL;
+    incomingHead = incomingTail = 0;
+    sounds = NULL;
+    lastPcmId = 0;
+    filling = stopping = stalled = false;
+    memset(&stats, 0, sizeof(stats));
+    resetStats = false;
+#ifdef CODAL
+    lastPullUs = 0;
+#endif
     PXT_REGISTER_RESET(stopPlaying);
 }
 
@@ -4,6 +4,11 @@
 #define OUTPUT_BITS 10
 #endif
 
+// how far left the clamped samples are shifted, for outputs that take 16 bits
+#ifndef OUTPUT_SHIFT
+#define OUTPUT_SHIFT 0
+#endif
+
 #define SW_TRIANGLE 1
 #define SW_SAWTOOTH 2
 #define SW_SINE 3
@@ -31,7 +36,11 @@ struct SoundInstruction {
 
 namespace music {
 
-#define MAX_SOUNDS 5
+// Number of voices playing at once; when they are all busy, a new sound takes over the quietest,
+// oldest one. Each voice adds up to a full-scale sample, which has to fit in 16 bits.
+#ifndef MAX_SOUNDS
+#define MAX_SOUNDS 8
+#endif
 
 STATIC_ASSERT((1 << (16 - OUTPUT_BITS)) > MAX_SOUNDS);
 
@@ -41,11 +50,37 @@ enum class SoundState : uint8_t {
     Done     //
 };
 
+// Chunks of PCM samples a stream can have queued, including the one playing
+#define PCM_CHUNKS 4
+
+#define PCM_16BIT 0x01 // signed 16-bit little endian samples; otherwise unsigned 8-bit
+// the flags of queuePlayPcm() take the volume (0-1023) from this bit on, as shims take at most 4
+// arguments
+#define PCM_VOLUME_SHIFT 8
+
+// PCM samples played from a queue of buffers, to which pushPcm() adds while it plays. Chunks
+// are added at tail by the main thread and played at head by fillSamples(); those before released
+// are no longer registered with the GC. Only the main thread registers and unregisters them.
+struct PcmStream {
+    Buffer chunks[PCM_CHUNKS];
+    uint8_t head, tail, released;
+    uint8_t flags;
+    uint16_t sampleRate;
+    uint16_t volume; // 0-1023
+    int id;
+};
+
+// Sounds are handed to fillSamples(), which may run on another thread or in an interrupt,
+// through a queue of this many, without locking
+#define INCOMING_SOUNDS 64
+
 struct WaitingSound {
     uint32_t startSampleNo;
-    SoundState state;
-    WaitingSound *next;
+    SoundState state; // only fillSamples() changes it, once queued
+    WaitingSound *next;        // all sounds, for the main thread
+    WaitingSound *nextWaiting; // sounds yet to start, for fillSamples()
     Buffer instructions;
+    PcmStream *pcm; // instead of instructions
 };
 
 struct PlayingSound {
@@ -60,6 +95,14 @@ struct PlayingSound {
     SoundInstruction *currInstr, *instrEnd;
 };
 
+// returned by music::audioStats()
+struct AudioStats {
+    uint32_t fills;     // calls to fillSamples()
+    uint32_t samples;   // samples they produced
+    uint32_t maxFillUs; // the longest call
+    uint32_t underruns; // times the output ran out of samples
+};
+
 class WSynthesizer
 #ifdef CODAL
     : public DataSource
@@ -74,13 +117,36 @@ class WSynthesizer
     uint32_t currSample; // after 25h of playing we might get a glitch
     int32_t sampleRate;  // eg 44100
     PlayingSound playingSounds[MAX_SOUNDS];
+    // sounds yet to start, in order of startSampleNo; only used by fillSamples()
     WaitingSound *waiting;
+    // sounds queued by the main thread and not yet moved to waiting by fillSamples()
+    WaitingSound *incoming[INCOMING_SOUNDS];
+    uint32_t incomingHead, incomingTail;
+    // incoming was full at stalledHead, and nothing took sounds from it for a while
+    bool stalled;
+    uint32_t stalledHead;
+    // all sounds, until they are Done and freed by the main thread
+    WaitingSound *sounds;
+    int lastPcmId;
+    // stopPlaying() clears everything while fillSamples() is kept out
+    bool filling, stopping;
+
+    // only updated by fillSamples() and the audio backend; zeroed by them on resetStats
+    AudioStats stats;
+    bool resetStats;
+#ifdef CODAL
+    uint64_t lastPullUs;
+#endif
     bool active;
 
     SoundOutput out;
 
     int fillSamples(int16_t *dst, int numsamples);
+    int mixSamples(int16_t *dst, int numsamples);
     int updateQueues();
+    void queue(WaitingSound *p);
+    PlayingSound *allocVoice();
+    bool fillPcm(PlayingSound *snd, int16_t *dst, int numsamples);
 
     WSynthesizer();
     virtual ~WSynthesizer() {}
@@ -105,7 +171,13 @@ class WSynthesizer
         ManagedBuffer data(512);
         auto dp = (int16_t *)data.getBytes();
         auto sz = 512 / 2;
+        // the DAC asks for the next buffer as it plays one; asking much later than that takes
+        // means it ran dry
+        uint64_t now = current_time_us();
+        if (lastPullUs && now - lastPullUs > (uint64_t)sz * 1500000 / sampleRate)
+            stats.underruns++;
         int r = fillSamples(dp, sz);
+        lastPullUs = r ? now : 0;
 #if defined(NRF52_SERIES)
         int mul = out.dac.getSampleRange();
 #endif
@@ -22,6 +22,14 @@ namespace music {
     //% shim=music::forceOutput
     export function forceOutput(buf: MusicOutput) { }
 
+    /**
+     * Statistics of the mixer, as UInt32LE numbers: calls to fill the output, samples filled,
+     * the longest time a call took in microseconds, and the times the output ran out of samples.
+     * @param reset start over after reading them
+     */
+    //% shim=music::audioStats
+    export function audioStats(reset?: boolean): Buffer { return null }
+
     let globalVolume: number = null
 
     const BUFFER_SIZE: number = 12;
@@ -329,6 +337,56 @@ namespace music {
     }
 
 
+    // Melodies are parsed once per volume and kept in a few instruction buffers per note, so playing
+    // a sound effect again only queues them. Longer melodies are parsed every time they play.
+    const MAX_COMPILED_MELODIES = 8
+    const MAX_COMPILED_NOTES = 64
+
+    class CompiledMelody {
+        text: string
+        volume: number
+        // instructions of each note, with the times in ms it starts and ends at
+        notes: Buffer[]
+        starts: number[]
+        ends: number[]
+        // including rests at the end
+        length: number
+
+        constructor(text: string, volume: number) {
+            this.text = text
+            this.volume = volume
+            this.notes = []
+            this.starts = []
+            this.ends = []
+            this.length = 0
+        }
+    }
+
+    // most recently played last
+    let compiledMelodies: CompiledMelody[]
+
+    function findCompiledMelody(text: string, volume: number) {
+        if (!compiledMelodies)
+            return null
+        for (let i = 0; i < compiledMelodies.length; ++i) {
+            const c = compiledMelodies[i]
+            if (c.text == text && c.volume == volume) {
+                compiledMelodies.removeAt(i)
+                compiledMelodies.push(c)
+                return c
+            }
+        }
+        return null
+    }
+
+    function addCompiledMelody(c: CompiledMelody) {
+        if (!compiledMelodies)
+            compiledMelodies = []
+        if (compiledMelodies.length >= MAX_COMPILED_MELODIES)
+            compiledMelodies.shift()
+        compiledMelodies.push(c)
+    }
+
     export class MelodyPlayer {
         melody: Melody;
 
@@ -352,6 +410,12 @@ namespace music {
             volume = Math.clamp(0, 255, (volume * music.volume()) >> 8)
 
             let notes = this.melody._text
+            let compiled = findCompiledMelody(notes, volume)
+            if (compiled) {
+                this.playCompiled(compiled)
+                return
+            }
+            compiled = new CompiledMelody(notes, volume)
             let pos = 0;
             let duration = 4; //Default duration (Crotchet)
             let octave = 4; //Middle octave
@@ -473,6 +537,11 @@ namespace music {
                 let currNote = scanNextWord();
                 let prevNote: boolean = false;
                 if (!currNote) {
+                    // not when stopped half way
+                    if (compiled && this.melody) {
+                        compiled.length = timePos
+                        addCompiledMelody(compiled)
+                    }
                     let timeLeft = timePos - now
                     if (timeLeft > 0)
                         pause(timeLeft)
@@ -569,7 +638,17 @@ namespace music {
                     addForm(currMs - (envA + envD), envS, envS, envD + envA)
                     addForm(envR, envS, 0, currMs)
 
-                    this.queuePlayInstructions(timePos - now, sndInstr.slice(0, sndInstrPtr))
+                    const buf = sndInstr.slice(0, sndInstrPtr)
+                    this.queuePlayInstructions(timePos - now, buf)
+                    if (compiled) {
+                        if (compiled.notes.length < MAX_COMPILED_NOTES) {
+                            compiled.notes.push(buf)
+                            compiled.starts.push(timePos)
+                            compiled.ends.push(timePos + currMs)
+                        } else {
+                            compiled = null
+                        }
+                    }
                     endHz = -1;
                     timePos += currMs // don't add envR - it's supposed overlap next sound
                 }
@@ -581,6 +660,32 @@ namespace music {
                 }
             }
         }
+
+        // same pacing as play(): notes are queued about 100ms before they start
+        private playCompiled(c: CompiledMelody) {
+            const startTime = control.millis()
+            let now = 0
+            let timePos = 0
+            let i = 0
+            for (; i < c.notes.length && this.melody; ++i) {
+                const timeLeft = c.starts[i] - now
+                if (timeLeft > 200) {
+                    pause(timeLeft - 100)
+                    now = control.millis() - startTime
+                    if (!this.melody)
+                        break
+                }
+                this.queuePlayInstructions(c.starts[i] - now, c.notes[i])
+                timePos = c.ends[i]
+            }
+            if (i == c.notes.length)
+                timePos = c.length
+            const timeLeft = timePos - now
+            if (timeLeft > 0)
+                pause(timeLeft)
+            if (this.onPlayFinished)
+                this.onPlayFinished();
+        }
     }
 
     //% fixedInstance whenUsed block="ba ding"
@@ -0,0 +1,70 @@
+namespace music {
+    //% shim=music::queuePlayPcm
+    function queuePlayPcm(timeDelta: number, buf: Buffer, sampleRate: number, flags: number): number {
+        return 0
+    }
+
+    //% shim=music::pushPcm
+    function pushPcm(id: number, buf: Buffer): number {
+        return -1
+    }
+
+    const PCM_16BIT = 0x01
+    const PCM_VOLUME_SHIFT = 8 // see melody.h
+
+    function pcmFlags(sixteenBit: boolean) {
+        return sixteenBit ? PCM_16BIT : 0
+    }
+
+    // the flags with the current volume, for queuePlayPcm()
+    function withVolume(flags: number) {
+        return flags | (((255 * volume()) >> 6) << PCM_VOLUME_SHIFT)
+    }
+
+    /**
+     * Play mono PCM samples from a buffer, alongside tones and melodies. A buffer from a hex
+     * literal is played straight from flash.
+     * @param buf unsigned 8-bit samples, or signed 16-bit little endian ones
+     * @param sampleRate samples per second, eg: 11025
+     * @param sixteenBit if the samples are 16-bit
+     */
+    //% parts="headphone"
+    export function playPcm(buf: Buffer, sampleRate: number, sixteenBit = false) {
+        queuePlayPcm(0, buf, sampleRate, withVolume(pcmFlags(sixteenBit)))
+    }
+
+    /**
+     * Play mono PCM samples read a chunk at a time while they play, so a long clip doesn't have
+     * to fit in RAM, eg. from a file with storage.readRange().
+     * @param read returns up to length bytes of samples at offset, or an empty buffer at the end
+     * @param sampleRate samples per second, eg: 11025
+     * @param sixteenBit if the samples are 16-bit
+     * @param chunkSize bytes to read at a time, eg: 1024
+     */
+    //% parts="headphone"
+    export function streamPcm(read: (offset: number, length: number) => Buffer, sampleRate: number,
+        sixteenBit = false, chunkSize = 1024) {
+        const flags = pcmFlags(sixteenBit)
+        chunkSize &= ~flags // whole samples
+        const chunkMs = Math.max(1, Math.idiv(chunkSize * 1000, sampleRate << flags))
+        control.runInParallel(() => {
+            let chunk = read(0, chunkSize)
+            if (!chunk || !chunk.length)
+                return
+            let offset = chunk.length
+            const id = queuePlayPcm(0, chunk, sampleRate, withVolume(flags))
+            while (true) {
+                chunk = read(offset, chunkSize)
+                if (!chunk || !chunk.length)
+                    return
+                offset += chunk.length
+                let queued: number
+                // wait for a chunk to finish playing when the stream is full
+                while ((queued = pushPcm(id, chunk)) == 0)
+                    pause(chunkMs >> 1)
+                if (queued < 0)
+                    return // stopped
+            }
+        })
+    }
+}
@@ -9,7 +9,96 @@ namespace pxsim.music {
 
     export function stopPlaying() {
         AudioContextManager.muteAllChannels()
+        stopPcm()
     }
 
     export function forceOutput(mode: number) { }
-}
\ No newline at end of file
+
+    export function audioStats(reset: boolean): RefBuffer {
+        return new RefBuffer(new Uint8Array(16))
+    }
+
+    // PCM streams, with chunks scheduled back to back on their own audio context
+    const PCM_CHUNKS = 4
+    const PCM_16BIT = 0x01
+    const PCM_VOLUME_SHIFT = 8
+
+    interface PcmStream {
+        sampleRate: number;
+        flags: number;
+        gain: GainNode;
+        nextTime: number;
+        ends: number[];
+    }
+
+    let pcmContext: AudioContext
+    let pcmStreams: pxsim.Map<PcmStream> = {}
+    let pcmSources: AudioBufferSourceNode[] = []
+    let lastPcmId = 0
+
+    function stopPcm() {
+        pcmSources.forEach(s => s.stop())
+        pcmSources = []
+        pcmStreams = {}
+    }
+
+    function schedulePcm(s: PcmStream, b: RefBuffer) {
+        const wide = s.flags & PCM_16BIT
+        const len = b.data.length >> wide
+        if (!len) return
+        const abuf = pcmContext.createBuffer(1, len, s.sampleRate)
+        const samples = abuf.getChannelData(0)
+        for (let i = 0; i < len; ++i)
+            samples[i] = wide
+                ? ((b.data[2 * i] | (b.data[2 * i + 1] << 8)) << 16 >> 16) / 32768
+                : (b.data[i] - 128) / 128
+        const src = pcmContext.createBufferSource()
+        src.buffer = abuf
+        src.connect(s.gain)
+        s.nextTime = Math.max(s.nextTime, pcmContext.currentTime)
+        src.start(s.nextTime)
+        s.nextTime += abuf.duration
+        s.ends.push(s.nextTime)
+        pcmSources.push(src)
+        src.onended = () => pcmSources = pcmSources.filter(x => x != src)
+    }
+
+    export function queuePlayPcm(when: number, b: RefBuffer, sampleRate: number, flags: number): number {
+        const volume = flags >> PCM_VOLUME_SHIFT
+        flags &= (1 << PCM_VOLUME_SHIFT) - 1
+        if (!pcmContext) {
+            const ctx = (window as any).AudioContext || (window as any).webkitAudioContext
+            if (!ctx) return 0
+            pcmContext = new ctx()
+        }
+        const gain = pcmContext.createGain()
+        gain.gain.value = Math.max(0, Math.min(1023, volume)) / 1024
+        gain.connect(pcmContext.destination)
+        const s: PcmStream = {
+            sampleRate: Math.max(3000, Math.min(0xffff, sampleRate)),
+            flags,
+            gain,
+            nextTime: pcmContext.currentTime + when / 1000,
+            ends: []
+        }
+        const id = ++lastPcmId
+        pcmStreams[id] = s
+        schedulePcm(s, b)
+        return id
+    }
+
+    export function pushPcm(id: number, b: RefBuffer): number {
+        const s = pcmStreams[id]
+        if (!s) return -1
+        const now = pcmContext.currentTime
+        s.ends = s.ends.filter(t => t > now)
+        if (!s.ends.length && s.nextTime < now) {
+            // ran out of samples
+            delete pcmStreams[id]
+            return -1
+        }
+        if (s.ends.length >= PCM_CHUNKS) return 0
+        schedulePcm(s, b)
+        return s.ends.length
+    }
+}
@@ -1,6 +1,7 @@
 // https://github.com/lancaster-university/codal-core/blob/master/source/drivers/HIDMouse.cpp
 
 #include "pxt.h"
+#include "hidqueue.h"
 
 enum class MouseButton {
     //% block="left" enumval=1
@@ -12,16 +13,61 @@ enum class MouseButton {
 };
 
 namespace mouse {
+    enum MouseChange { BUTTON_DOWN, BUTTON_UP, MOVE, WHEEL };
+
+    static inline bool addMove(int16_t &v, int d) {
+        if (v + d < -128 || v + d > 127)
+            return false;
+        v += d;
+        return true;
+    }
+
+    // moves of the mouse and turns of its wheel while a report goes out add up, as far as they
+    // fit in one report
+    class MouseQueue : public pxt::HIDQueue {
+      protected:
+        bool merge(pxt::HIDChange &last, const pxt::HIDChange &change) override {
+            if (last.kind != change.kind)
+                return false;
+            if (change.kind == MOVE) {
+                int16_t x = last.a, y = last.b;
+                if (!addMove(x, change.a) || !addMove(y, change.b))
+                    return false;
+                last.a = x;
+                last.b = y;
+                return true;
+            }
+            if (change.kind == WHEEL)
+                return addMove(last.a, change.a);
+            return false;
+        }
+
+        void send(const pxt::HIDChange &change) override {
+            switch (change.kind) {
+            case BUTTON_DOWN:
+                pxt::mouse.buttonDown((codal::USBHIDMouseButton)change.arg);
+                break;
+            case BUTTON_UP:
+                pxt::mouse.buttonUp((codal::USBHIDMouseButton)change.arg);
+                break;
+            case MOVE:
+                pxt::mouse.move(change.a, change.b);
+                break;
+            case WHEEL:
+                pxt::mouse.moveWheel(change.a);
+                break;
+            }
+        }
+    };
+    static MouseQueue queue;
+
     /** 
     * Set the mouse button state to up or down
     */
     //% help=mouse/set-button
     //% blockId=mouseSetButton block="mouse button %index|%down=toggleDownUp"
     void setButton(MouseButton button, bool down) {
-        if (down)
-            pxt::mouse.buttonDown((codal::USBHIDMouseButton)button);
-        else
-            pxt::mouse.buttonUp((codal::USBHIDMouseButton)button);
+        queue.push(down ? BUTTON_DOWN : BUTTON_UP, (int)button);
     }
 
     /**
@@ -32,7 +78,7 @@ namespace mouse {
     //% x.min=-128 x.max=127
     //% y.min=-128 y.max=127
     void move(int x, int y) {
-        pxt::mouse.move(x, y);
+        queue.push(MOVE, 0, max(-128, min(127, x)), max(-128, min(127, y)));
     }
 
     /**
@@ -42,6 +88,6 @@ namespace mouse {
     //% blockId=mouseWheel block="mouse turn wheel %w"
     //% w.min=-128 w.max=127
     void turnWheel(int w) {
-        pxt::mouse.moveWheel(w);
+        queue.push(WHEEL, 0, max(-128, min(127, w)));
     }
 }
\ No newline at end of file
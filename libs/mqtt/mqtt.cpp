@@ -0,0 +1,100 @@
+#include "pxt.h"
+
+// Encoding of MQTT control packets, used by the Protocol module in mqtt.ts. A packet is the
+// header byte, the remaining length as a variable length integer of up to 4 bytes, and the parts
+// of the packet one after another, in one buffer allocated once.
+// http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718020
+
+#define MQTT_MAX_REMAINING_LENGTH 268435455
+
+namespace mqtt {
+
+static bool isBuffer(TValue v) {
+    auto vt = getAnyVTable(v);
+    return vt && vt->classNo == BuiltInType::BoxedBuffer;
+}
+
+static uint8_t *put16(uint8_t *dst, int v) {
+    *dst++ = v >> 8;
+    *dst++ = v;
+    return dst;
+}
+
+/**
+ * Encode a control packet; null if it is too large. Strings in parts are UTF-8 encoded strings
+ * with their 16 bit length, numbers are 16 bit integers and buffers are copied as they are.
+ */
+//%
+Buffer _packet(int header, RefCollection *parts) {
+    unsigned numParts = parts->length();
+    unsigned remaining = 0;
+    for (unsigned i = 0; i < numParts; ++i) {
+        auto p = parts->getAt(i);
+        if (isBuffer(p))
+            remaining += ((Buffer)p)->length;
+        else if (valType(p) == ValType::String) {
+            auto s = (String)p;
+            remaining += 2 + PXT_STRING_DATA_LENGTH(s);
+        } else if (valType(p) == ValType::Number)
+            remaining += 2;
+    }
+    if (remaining > MQTT_MAX_REMAINING_LENGTH)
+        return NULL;
+
+    unsigned lenSize = 1;
+    for (unsigned l = remaining; l >= 128; l >>= 7)
+        lenSize++;
+
+    auto res = mkBuffer(NULL, 1 + lenSize + remaining);
+    registerGCObj(res);
+    auto dst = res->data;
+    *dst++ = header;
+    unsigned l = remaining;
+    do {
+        *dst++ = (l & 127) | (l >= 128 ? 128 : 0);
+        l >>= 7;
+    } while (l);
+    for (unsigned i = 0; i < numParts; ++i) {
+        auto p = parts->getAt(i);
+        if (isBuffer(p)) {
+            auto b = (Buffer)p;
+            memcpy(dst, b->data, b->length);
+            dst += b->length;
+        } else if (valType(p) == ValType::String) {
+            auto s = (String)p;
+            unsigned len = PXT_STRING_DATA_LENGTH(s);
+            dst = put16(dst, len);
+            memcpy(dst, PXT_STRING_DATA(s), len);
+            dst += len;
+        } else if (valType(p) == ValType::Number) {
+            dst = put16(dst, toInt(p));
+        }
+    }
+    unregisterGCObj(res);
+    return res;
+}
+
+/**
+ * Size of the packet starting at offset, with its fixed header; 0 if it is not all in the
+ * buffer yet, and -1 if its remaining length is malformed.
+ */
+//%
+int _packetSize(Buffer buf, int offset) {
+    if (offset < 0)
+        return -1;
+    int len = 0;
+    for (int i = 0; i < 4; ++i) {
+        int p = offset + 1 + i;
+        if (p >= buf->length)
+            return 0;
+        int b = buf->data[p];
+        len |= (b & 127) << (7 * i);
+        if (!(b & 128)) {
+            int size = 2 + i + len;
+            return offset + size <= buf->length ? size : 0;
+        }
+    }
+    return -1;
+}
+
+} // namespace mqtt
@@ -68,7 +68,9 @@ namespace mqtt {
         DefaultQos = 0,
         Uninitialized = -123,
         FixedPackedId = 1,
-        KeepAlive = 60
+        KeepAlive = 60,
+        InflightWindow = 4,
+        MaxBatchSize = 1024
     }
 
     /**
@@ -81,6 +83,10 @@ namespace mqtt {
         password?: string;
         clientId: string;
         will?: IConnectionOptionsWill;
+        /**
+         * Most QoS 1 messages sent and not acknowledged yet; 4 if not given
+         */
+        inflightWindow?: number;
     }
 
     export interface IConnectionOptionsWill {
@@ -94,28 +100,25 @@ namespace mqtt {
      * The specifics of the MQTT protocol.
      */
     export module Protocol {
-        function strChr(codes: number[]): Buffer {
-            return pins.createBufferFromArray(codes)
+        /**
+         * Structure of an MQTT Control Packet, encoded natively in one buffer: strings in parts
+         * are UTF-8 encoded strings with their 16 bit length, numbers are 16 bit integers and
+         * buffers are copied as they are.
+         * http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc384800392
+         */
+        //% shim=mqtt::_packet
+        function createPacket(byte1: number, parts: (string | number | Buffer)[]): Buffer {
+            return null
         }
 
         /**
-         * Encode remaining length
+         * Size of the packet at offset in buf, with its fixed header; 0 if it is not all there
+         * yet, -1 if its remaining length is malformed.
          * http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718023
          */
-        function encodeRemainingLength(remainingLength: number): number[] {
-            let length: number = remainingLength;
-            const encBytes: number[] = [];
-            do {
-                let encByte: number = length & 127;
-                length = length >> 7;
-                // if there are more data to encode, set the top bit of this byte
-                if (length > 0) {
-                    encByte += 128;
-                }
-                encBytes.push(encByte);
-            } while (length > 0);
-
-            return encBytes;
+        //% shim=mqtt::_packetSize
+        export function packetSize(buf: Buffer, offset: number): number {
+            return 0
         }
 
         /**
@@ -137,33 +140,6 @@ namespace mqtt {
             return flags;
         }
 
-        // Returns the MSB and LSB.
-        function getBytes(int16: number): number[] {
-            return [int16 >> 8, int16 & 255];
-        }
-
-        /**
-         * Structure of UTF-8 encoded strings
-         * http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Figure_1.1_Structure
-         */
-        function pack(s: string): Buffer {
-            const buf = control.createBufferFromUTF8(s);
-            return strChr(getBytes(buf.length)).concat(buf);
-        }
-
-        /**
-         * Structure of an MQTT Control Packet
-         * http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc384800392
-         */
-        function createPacket(byte1: number, variable: Buffer, payload?: Buffer): Buffer {
-            if (payload == null) payload = control.createBuffer(0);
-            const byte2: number[] = encodeRemainingLength(variable.length + payload.length);
-            return strChr([byte1])
-                .concat(strChr(byte2))
-                .concat(variable)
-                .concat(payload)
-        }
-
         /**
          * CONNECT - Client requests a connection to a Server
          * http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718028
@@ -171,54 +147,54 @@ namespace mqtt {
         export function createConnect(options: IConnectionOptions): Buffer {
             const byte1: number = ControlPacketType.Connect << 4;
 
-            const protocolName = pack('MQTT');
-            const nums = control.createBuffer(4)
-            nums[0] = 4; // protocol level
-            nums[1] = createConnectFlags(options)
-            nums[2] = 0
-            nums[3] = Constants.KeepAlive
-
-            let payload = pack(options.clientId);
+            // protocol name, protocol level 4 and the flags, keep alive
+            const parts: (string | number | Buffer)[] = [
+                'MQTT',
+                (4 << 8) | createConnectFlags(options),
+                Constants.KeepAlive,
+                options.clientId
+            ];
 
             if (options.will) {
-                payload = payload
-                    .concat(pack(options.will.topic)
-                        .concat(pack(options.will.message)));
+                parts.push(options.will.topic);
+                parts.push(options.will.message);
             }
 
             if (options.username) {
-                payload = payload.concat(pack(options.username));
-                if (options.password) {
-                    payload = payload.concat(pack(options.password));
-                }
+                parts.push(options.username);
+                if (options.password)
+                    parts.push(options.password);
             }
 
-            return createPacket(
-                byte1,
-                protocolName.concat(nums),
-                payload
-            );
+            return createPacket(byte1, parts);
         }
 
         /** PINGREQ - PING request
          * http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc384800454
          */
         export function createPingReq() {
-            return strChr([ControlPacketType.PingReq << 4, 0]);
+            return createPacket(ControlPacketType.PingReq << 4, []);
         }
 
         /**
          * PUBLISH - Publish message
          * http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc384800410
          */
-        export function createPublish(topic: string, message: Buffer, qos: number, retained: boolean) {
+        export function createPublish(topic: string, message: Buffer, qos: number, retained: boolean, pid = Constants.FixedPackedId) {
             let byte1: number = ControlPacketType.Publish << 4 | (qos << 1);
             byte1 |= (retained) ? 1 : 0;
 
-            const pid = strChr(getBytes(Constants.FixedPackedId));
-            const variable = (qos === 0) ? pack(topic) : pack(topic).concat(pid);
+            if (qos === 0)
+                return createPacket(byte1, [topic, message]);
+            return createPacket(byte1, [topic, pid, message]);
+        }
 
-            return createPacket(byte1, variable, message);
+        /**
+         * Mark a PUBLISH packet made by createPublish() as a re-delivery
+         * http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038
+         */
+        export function setDuplicate(packet: Buffer) {
+            packet[0] |= 8;
         }
 
         export function parsePublish(cmd: number, payload: Buffer): IMessage {
@@ -231,7 +207,7 @@ namespace mqtt {
             }
 
             const message: IMessage = {
-                topic: payload.slice(2, topicLength).toString(),
+                topic: payload.sliceToString(2, topicLength),
                 content: payload.slice(variableLength),
                 qos: qos,
                 retain: cmd & 1
@@ -250,20 +226,17 @@ namespace mqtt {
         export function createPubAck(pid: number) {
             const byte1: number = ControlPacketType.PubAck << 4;
 
-            return createPacket(byte1, strChr(getBytes(pid)));
+            return createPacket(byte1, [pid]);
         }
 
         /**
          * SUBSCRIBE - Subscribe to topics
          * http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc384800436
          */
-        export function createSubscribe(topic: string, qos: number): Buffer {
+        export function createSubscribe(topic: string, qos: number, pid = Constants.FixedPackedId): Buffer {
             const byte1: number = ControlPacketType.Subscribe << 4 | 2;
-            const pid = strChr(getBytes(Constants.FixedPackedId));
 
-            return createPacket(byte1,
-                pid,
-                pack(topic).concat(strChr([qos])))
+            return createPacket(byte1, [pid, topic, Buffer.fromArray([qos])])
         }
     }
 
@@ -300,6 +273,14 @@ namespace mqtt {
         ) { }
     }
 
+    // a QoS 1 PUBLISH packet, kept until it is acknowledged
+    class Publication {
+        constructor(
+            public pid: number,
+            public packet: Buffer
+        ) { }
+    }
+
     export class Client extends EventEmitter {
         public logPriority : ConsolePriority;
         private log(msg: string) {
@@ -320,6 +301,15 @@ namespace mqtt {
 
         private mqttHandlers: MQTTHandler[];
 
+        // packets to write, coalesced into as few socket writes as possible
+        private outbox: Buffer[];
+        private flushing: boolean;
+
+        // QoS 1 publications sent and not acknowledged yet, and the ones waiting for room
+        private inflight: Publication[];
+        private pending: Publication[];
+        private lastPid: number;
+
         constructor(opt: IConnectionOptions) {
             super();
 
@@ -327,8 +317,14 @@ namespace mqtt {
             this.piId = Constants.Uninitialized;
             this.logPriority = ConsolePriority.Silent;
             this.connected = false;
+            this.outbox = [];
+            this.flushing = false;
+            this.inflight = [];
+            this.pending = [];
+            this.lastPid = 0;
             opt.port = opt.port || 8883;
             opt.clientId = opt.clientId;
+            opt.inflightWindow = Math.max(1, opt.inflightWindow || Constants.InflightWindow);
 
             if (opt.will) {
                 opt.will.qos = opt.will.qos || Constants.DefaultQos;
@@ -375,6 +371,9 @@ namespace mqtt {
                 this.piId = Constants.Uninitialized;
             }
 
+            // QoS 1 publications stay, and are sent again after connecting
+            this.outbox = [];
+
             if (this.sct) {
                 //this.sct.removeAllListeners('connect');
                 //this.sct.removeAllListeners('data');
@@ -400,6 +399,8 @@ namespace mqtt {
             this.sct.onOpen(() => {
                 this.log('Network connection established.');
                 this.emit('connect');
+                // CONNECT has to be the first packet
+                this.outbox = [];
                 this.send(Protocol.createConnect(this.opt));
             });
             this.sct.onMessage((msg: Buffer) => {
@@ -418,15 +419,22 @@ namespace mqtt {
             this.sct.connect();
         }
 
-        // Publish a message
+        // Publish a message; at most opt.inflightWindow QoS 1 messages are sent and not
+        // acknowledged at any time, the others are queued.
         public publish(topic: string, message?: string | Buffer, qos: number = Constants.DefaultQos, retained: boolean = false): void {
             const buf = typeof message == "string" ? control.createBufferFromUTF8(message) : message
-            this.send(Protocol.createPublish(topic, buf, qos, retained));
+            if (qos != 1) {
+                this.send(Protocol.createPublish(topic, buf, qos, retained));
+                return;
+            }
+            const pid = this.nextPid();
+            this.pending.push(new Publication(pid, Protocol.createPublish(topic, buf, qos, retained, pid)));
+            this.sendPending();
         }
 
         // Subscribe to topic
         public subscribe(topic: string, handler?: (msg: IMessage) => void, qos: number = Constants.DefaultQos): void {
-            this.send(Protocol.createSubscribe(topic, qos));
+            this.send(Protocol.createSubscribe(topic, qos, this.nextPid()));
             if (handler) {
                 if (topic[topic.length - 1] == "#")
                     topic = topic.slice(0, topic.length - 1)
@@ -435,44 +443,82 @@ namespace mqtt {
             }
         }
 
+        private nextPid() {
+            this.lastPid = this.lastPid >= 0xffff ? 1 : this.lastPid + 1;
+            return this.lastPid;
+        }
+
+        private sendPending() {
+            if (!this.connected)
+                return;
+            while (this.pending.length && this.inflight.length < this.opt.inflightWindow) {
+                const p = this.pending.shift();
+                this.inflight.push(p);
+                this.send(p.packet);
+            }
+        }
+
+        private acknowledge(pid: number) {
+            for (let i = 0; i < this.inflight.length; ++i) {
+                if (this.inflight[i].pid == pid) {
+                    this.inflight.removeAt(i);
+                    break;
+                }
+            }
+            this.sendPending();
+        }
+
+        // Queue a packet; all packets queued until the writer gets to run go out in one write.
         private send(data: Buffer): void {
-            if (this.sct) {
-                //this.log("send: " + data[0] + " / " + data.length + " bytes")
-                this.log("send: " + data[0] + " / " + data.length + " bytes: " + data.toString())
-                this.sct.send(data);
+            this.outbox.push(data);
+            if (!this.flushing) {
+                this.flushing = true;
+                control.runInParallel(() => this.flush());
             }
         }
 
+        private flush() {
+            while (this.outbox.length) {
+                let n = 1;
+                let size = this.outbox[0].length;
+                while (n < this.outbox.length && size + this.outbox[n].length <= Constants.MaxBatchSize)
+                    size += this.outbox[n++].length;
+                const batch = this.outbox.splice(0, n);
+                if (this.sct) {
+                    this.log("send: " + n + " packets / " + size + " bytes")
+                    this.sct.send(n == 1 ? batch[0] : Buffer.concat(batch));
+                }
+            }
+            this.flushing = false;
+        }
+
         private handleMessage(data: Buffer) {
             if (this.buf) {
                 data = this.buf.concat(data)
                 this.buf = null
             }
-            if (data.length < 2)
-                return
-            let len = data[1]
-            let payloadOff = 2
-            if (len & 0x80) {
-                if (data.length < 3)
-                    return
-                if (data[2] & 0x80) {
-                    this.emit('error', `too large packet.`);
-                    this.buf = null
+            let off = 0
+            while (off < data.length) {
+                const size = Protocol.packetSize(data, off)
+                if (size < 0) {
+                    this.emit('error', `malformed packet.`);
                     return
                 }
-                len = (data[2] << 7) | (len & 0x7f)
-                payloadOff++
+                if (size == 0)
+                    break // wait for the rest of data
+                let payloadOff = off + 2
+                while (data[payloadOff - 1] & 0x80)
+                    payloadOff++
+                this.handlePacket(data[off], data.slice(payloadOff, off + size - payloadOff))
+                off += size
             }
+            if (off < data.length)
+                this.buf = data.slice(off)
+        }
 
-            const payloadEnd = payloadOff + len
-            if (data.length < payloadEnd)
-                return // wait for the rest of data
-
-            const cmd = data[0]
+        private handlePacket(cmd: number, payload: Buffer) {
             const controlPacketType: ControlPacketType = cmd >> 4;
-            // this.emit('debug', `Rcvd: ${controlPacketType}: '${data}'.`);
-
-            const payload = data.slice(payloadOff, payloadEnd - payloadOff)
+            // this.emit('debug', `Rcvd: ${controlPacketType}: '${payload}'.`);
 
             switch (controlPacketType) {
                 case ControlPacketType.ConnAck:
@@ -482,6 +528,12 @@ namespace mqtt {
                         this.emit('connected');
                         this.connected = true;
                         this.piId = setInterval(() => this.ping(), Constants.PingInterval * 1000);
+                        // publications not acknowledged on the last connection go out again
+                        for (const p of this.inflight) {
+                            Protocol.setDuplicate(p.packet);
+                            this.send(p.packet);
+                        }
+                        this.sendPending();
                     } else {
                         const connectionError: string = Client.describe(returnCode);
                         this.emit('error', connectionError);
@@ -498,22 +550,18 @@ namespace mqtt {
                             }
                     if (!handled)
                         this.emit('receive', message);
-                    if (message.qos > 0) {
-                        setTimeout(() => {
-                            this.send(Protocol.createPubAck(message.pid || 0));
-                        }, 0);
-                    }
+                    if (message.qos > 0)
+                        this.send(Protocol.createPubAck(message.pid || 0));
                     break;
-                case ControlPacketType.PingResp:
                 case ControlPacketType.PubAck:
+                    this.acknowledge(payload.getNumber(NumberFormat.UInt16BE, 0));
+                    break;
+                case ControlPacketType.PingResp:
                 case ControlPacketType.SubAck:
                     break;
                 default:
                     this.emit('error', `MQTT unexpected packet type: ${controlPacketType}.`);
             }
-
-            if (data.length > payloadEnd)
-                this.handleMessage(data.slice(payloadEnd))
         }
 
         private ping() {
@@ -521,4 +569,4 @@ namespace mqtt {
             this.emit('debug', 'Sent: Ping request.');
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,61 @@
+namespace pxsim.mqtt {
+    export function _packet(header: number, parts: RefCollection): RefBuffer {
+        const chunks: Uint8Array[] = []
+        let remaining = 0
+        for (let i = 0; i < parts.getLength(); ++i) {
+            const p = parts.getAt(i)
+            let chunk: Uint8Array
+            if (p instanceof RefBuffer) {
+                chunk = p.data
+            } else if (typeof p == "string") {
+                const s = U.stringToUint8Array(U.toUTF8(p))
+                chunk = new Uint8Array(2 + s.length)
+                chunk[0] = s.length >> 8
+                chunk[1] = s.length & 0xff
+                chunk.set(s, 2)
+            } else if (typeof p == "number") {
+                chunk = new Uint8Array([(p >> 8) & 0xff, p & 0xff])
+            } else {
+                continue
+            }
+            chunks.push(chunk)
+            remaining += chunk.length
+        }
+        if (remaining > 268435455)
+            return null
+        const len: number[] = []
+        let l = remaining
+        do {
+            len.push((l & 127) | (l >= 128 ? 128 : 0))
+            l >>= 7
+        } while (l)
+        const data = new Uint8Array(1 + len.length + remaining)
+        data[0] = header & 0xff
+        data.set(len, 1)
+        let off = 1 + len.length
+        for (const c of chunks) {
+            data.set(c, off)
+            off += c.length
+        }
+        return new RefBuffer(data)
+    }
+
+    export function _packetSize(buf: RefBuffer, offset: number): number {
+        if (offset < 0)
+            return -1
+        const data = buf.data
+        let len = 0
+        for (let i = 0; i < 4; ++i) {
+            const p = offset + 1 + i
+            if (p >= data.length)
+                return 0
+            const b = data[p]
+            len |= (b & 127) << (7 * i)
+            if (!(b & 128)) {
+                const size = 2 + i + len
+                return offset + size <= data.length ? size : 0
+            }
+        }
+        return -1
+    }
+}
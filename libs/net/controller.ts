@@ -25,6 +25,10 @@ namespace net {
             return undefined;
         }
 
+        public socketConnected(socket_num: number): boolean {
+            return false;
+        }
+
         public socketClose(socket_num: number): void {
         }
 
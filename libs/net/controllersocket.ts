@@ -8,7 +8,8 @@ namespace net {
     export const TLS_MODE = 2
 
     export class ControllerSocket implements net.Socket {
-        _buffer: Buffer;
+        // what was fetched from the controller but not read yet
+        _ring: RingBuffer;
         _socknum: number;
         _timeout: number;
         _closed: boolean;
@@ -24,7 +25,7 @@ namespace net {
             if (this.conntype === null) {
                 this.conntype = net.TCP_MODE
             }
-            this._buffer = hex``
+            this._ring = new RingBuffer(MAX_PACKET)
             this._socknum = this.controller.socket()
             this.setTimeout(0)
         }
@@ -39,7 +40,7 @@ namespace net {
                 return;
             }
 
-            this._buffer = hex``
+            this._ring.clear()
 
             if (this._openHandler)
                 this._openHandler();
@@ -82,15 +83,49 @@ namespace net {
             this._messageHandler = handler || null;
         }
 
+        /**
+         * Move what the controller has for this socket into the ring, in one read, as much as
+         * fits; returns false when there was nothing.
+         */
+        private fill(): boolean {
+            const free = this._ring.capacity - this._ring.length
+            if (free <= 0)
+                return false
+            const avail = Math.min(this.controller.socketAvailable(this._socknum), free)
+            if (avail <= 0)
+                return false
+            const data = this.controller.socketRead(this._socknum, avail)
+            if (!data || !data.length)
+                return false
+            this._ring.pushBuffer(data)
+            return true
+        }
+
         /** Attempt to return as many bytes as we can up to but not including '\r\n' */
         public readLine(): string {
             // print("Socket readline")
             let stamp = monotonic()
-            while (this._buffer.indexOf(hex`0d0a`) < 0) {
+            let from = 0
+            for (; ;) {
+                const pos = this._ring.indexOf(0x0a, from)
+                if (pos > 0 && this._ring.get(pos - 1) == 0x0d) {
+                    const line = this._ring.shiftString(pos - 1)
+                    this._ring.discard(2)
+                    return line
+                }
+                if (pos >= 0) {
+                    // a \n on its own
+                    from = pos + 1
+                    continue
+                }
+                from = this._ring.length
+                if (from == this._ring.capacity) {
+                    // longer than the ring; give it out in pieces
+                    return this._ring.shiftString(from)
+                }
                 // there's no line already in there, read some more
-                let avail = Math.min(this.controller.socketAvailable(this._socknum), MAX_PACKET)
-                if (avail) {
-                    this._buffer = this._buffer.concat(this.controller.socketRead(this._socknum, avail))
+                if (this.fill()) {
+                    // found nothing in there yet
                 } else if (this._timeout > 0 && monotonic() - stamp > this._timeout) {
                     // Make sure to close socket so that we don't exhaust sockets.
                     this.close()
@@ -99,38 +134,46 @@ namespace net {
                     pause(20)
                 }
             }
-            const pos = this._buffer.indexOf(hex`0d0a`)
-            const pref = this._buffer.slice(0, pos)
-            this._buffer = this._buffer.slice(pos + 2)
-            // print("rd: " + this._buffer.length + " / " + pref.length + " :" + pref.toString())
-            return pref.toString()
+        }
+
+        /**
+         * Move bytes that were received to `buf` from `offset` on, as many as fit; returns how
+         * many. Waits for some only when nothing was received yet and there is a timeout.
+         */
+        public readInto(buf: Buffer, offset = 0): number {
+            let stamp = monotonic()
+            while (!this._ring.length && !this.fill()) {
+                if (this._timeout <= 0 || monotonic() - stamp > this._timeout)
+                    return 0
+                pause(20)
+            }
+            return this._ring.shiftInto(buf, offset)
         }
 
         /** Read up to 'size' bytes from the socket, this may be buffered internally! If 'size' isnt specified, return everything in the buffer. */
         public read(size: number = 0): Buffer {
             // print("Socket read", size)
             if (size == 0) {
-                if (this._buffer.length == 0) {
-                    let avail = Math.min(this.controller.socketAvailable(this._socknum), MAX_PACKET)
-                    if (avail)
-                        this._buffer = this._buffer.concat(this.controller.socketRead(this._socknum, avail))
-                }
-                let ret = this._buffer
-                this._buffer = hex``
-                return ret
+                if (!this._ring.length)
+                    this.fill()
+                return this._ring.shiftBuffer(this._ring.length)
             }
 
+            if (size <= this._ring.length)
+                return this._ring.shiftBuffer(size)
+
+            // what's in the ring first, then straight from the controller into the result
+            const res = control.createBuffer(size)
+            let got = this._ring.shiftInto(res)
             let stamp = monotonic()
-            let to_read = size - this._buffer.length
-            let received = []
-            while (to_read > 0) {
-                // print("Bytes to read:", to_read)
-                let avail = Math.min(this.controller.socketAvailable(this._socknum), MAX_PACKET)
-                if (avail) {
+            while (got < size) {
+                // print("Bytes to read:", size - got)
+                let avail = Math.min(Math.min(this.controller.socketAvailable(this._socknum), MAX_PACKET), size - got)
+                if (avail > 0) {
                     stamp = monotonic()
-                    let recv = this.controller.socketRead(this._socknum, Math.min(to_read, avail))
-                    received.push(recv)
-                    to_read -= recv.length
+                    const recv = this.controller.socketRead(this._socknum, avail)
+                    res.write(got, recv)
+                    got += recv.length
                 } else {
                     pause(20)
                 }
@@ -138,21 +181,13 @@ namespace net {
                 if (this._timeout > 0 && monotonic() - stamp > this._timeout) {
                     break
                 }
-
-            }
-            // print(received)
-            received.unshift(this._buffer)
-            this._buffer = pins.concatBuffers(received)
-            let ret = null
-            if (this._buffer.length == size) {
-                ret = this._buffer
-                this._buffer = hex``
-            } else {
-                ret = this._buffer.slice(0, size)
-                this._buffer = this._buffer.slice(size)
             }
+            return got == size ? res : res.slice(0, got)
+        }
 
-            return ret
+        /** Whether it is open, and the other side hasn't closed it either */
+        public isConnected(): boolean {
+            return !this._closed && this.controller.socketConnected(this._socknum)
         }
 
         /** Set the read timeout for sockets, if value is 0 it will block */
@@ -42,6 +42,8 @@ namespace net {
         onMessage(handler: (data: Buffer) => void): void;
         setTimeout(millis: number): void;
         readLine(): string;
+        readInto(buf: Buffer, offset?: number): number;
+        isConnected(): boolean;
     }
 
     export class Net {
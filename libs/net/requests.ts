@@ -18,12 +18,53 @@ namespace net {
         }
     }
 
+    // Idle keep-alive connections, oldest first. The ESP32 has few sockets (and fewer for TLS), so
+    // only a couple are kept; they are given up after a while, or when the server says.
+    interface PooledSocket {
+        key: string;
+        socket: Socket;
+        expires: number;
+    }
+    let _pool: PooledSocket[] = []
+    const POOL_SIZE = 2
+    const POOL_IDLE_TIME = 20000
+
+    function takeSocket(key: string): Socket {
+        const now = control.millis()
+        let r: Socket = null
+        _pool = _pool.filter(p => {
+            if (!r && p.key == key && p.expires > now && p.socket.isConnected()) {
+                r = p.socket
+                return false
+            }
+            if (p.expires <= now || p.key == key) {
+                p.socket.close()
+                return false
+            }
+            return true
+        })
+        return r
+    }
+
+    function releaseSocket(key: string, socket: Socket, idleTime: number) {
+        _pool.push({ key: key, socket: socket, expires: control.millis() + idleTime })
+        while (_pool.length > POOL_SIZE)
+            _pool.shift().socket.close()
+    }
+
     export class Response {
         _cached: Buffer
         status_code: number
         reason: string
         _read_so_far: number
         headers: StringMap;
+        // the connection goes back to the pool under _key once the body is read, unless _keepAlive
+        // is cleared; _left is what is left of the body, or of the current chunk when it is chunked
+        _key: string
+        _keepAlive: boolean
+        _chunked: boolean
+        _left: number
+        _done: boolean
 
         /** 
          * The response from a request, contains all the headers/content 
@@ -34,17 +75,88 @@ namespace net {
             this.reason = null
             this._read_so_far = 0
             this.headers = {}
+            this._key = null
+            this._keepAlive = false
+            this._chunked = false
+            this._left = 0
+            this._done = true
         }
 
         /** 
          * Close, delete and collect the response data 
          */
         public close() {
+            this.releaseSocket()
+            this._cached = null
+        }
+
+        private releaseSocket() {
             if (this.socket) {
-                this.socket.close()
+                if (this._done && this._left == 0 && this._keepAlive && this._key) {
+                    releaseSocket(this._key, this.socket, this.idleTime())
+                } else {
+                    this.socket.close()
+                }
                 this.socket = null
             }
-            this._cached = null
+        }
+
+        // how long the server keeps the connection, from "keep-alive: timeout=5, max=100"; a second
+        // less than it says, in case the clocks don't agree
+        private idleTime() {
+            const ka = this.headers["keep-alive"] || ""
+            const i = ka.indexOf("timeout=")
+            if (i < 0)
+                return POOL_IDLE_TIME
+            let j = i + 8
+            while (j < ka.length && ka.charCodeAt(j) >= 0x30 && ka.charCodeAt(j) <= 0x39)
+                j++
+            const t = parseInt(ka.slice(i + 8, j))
+            return t > 1 ? Math.min(POOL_IDLE_TIME, (t - 1) * 1000) : POOL_IDLE_TIME
+        }
+
+        /**
+         * Read the next piece of the body, for streaming it; null once all of it has been read.
+         * Chunked bodies come without the chunk framing.
+         */
+        public readChunk(): Buffer {
+            if (!this.socket || this._done)
+                return null
+            if (this._chunked && this._left == 0) {
+                // the size in hex, maybe with extensions after a ;
+                const size = JSON.parseIntRadix(this.socket.readLine().split(";")[0], 16)
+                if (!size) {
+                    // the last chunk, and the trailers
+                    while (this.socket.readLine()) { }
+                    this._done = true
+                    return null
+                }
+                this._left = size
+            }
+            if (this._left == 0) {
+                // no length: whatever came, and then the connection can't be used again
+                this._done = true
+                this._keepAlive = false
+                const b = this.socket.read()
+                return b.length ? b : null
+            }
+
+            const b = this.socket.read(Math.min(this._left, MAX_PACKET))
+            this._read_so_far += b.length
+            this._left -= b.length
+            if (!b.length) {
+                // timed out
+                this._done = true
+                this._keepAlive = false
+                return null
+            }
+            if (this._left == 0) {
+                if (this._chunked)
+                    this.socket.readLine()
+                else
+                    this._done = true
+            }
+            return b
         }
 
         /** 
@@ -53,10 +165,12 @@ namespace net {
         get content() {
             // print("Content length:", content_length)
             if (this._cached === null && this.socket) {
-                const content_length = parseInt(this.headers["content-length"]) || 0
-                this._cached = this.socket.read(content_length)
-                this.socket.close()
-                this.socket = null
+                const parts: Buffer[] = []
+                let b: Buffer
+                while (b = this.readChunk())
+                    parts.push(b)
+                this._cached = parts.length == 1 ? parts[0] : pins.concatBuffers(parts)
+                this.releaseSocket()
             }
 
             // print("Buffer length:", len(self._cached))
@@ -167,49 +281,78 @@ read only when requested
             port = parseInt(tmp[1])
         }
 
-        let ipaddr = net.instance().hostByName(host)
-
-        let sock: Socket;
-        if (proto == "https:") {
-            // for SSL we need to know the host name
-            sock = net.instance().createSocket(host, port, true)
-        } else {
-            sock = net.instance().createSocket(ipaddr, port, false)
-        }
-        // our response
-        let resp = new Response(sock)
-        // socket read timeout
-        sock.setTimeout(options.timeout)
-
-        sock.connect();
-        sock.send(`${method} /${path} HTTP/1.0\r\n`)
+        // the request goes out in one write
+        let req = `${method} /${path} HTTP/1.1\r\n`
 
         if (!options.headers["Host"])
-            sock.send(`Host: ${host}\r\n`)
+            req += `Host: ${host}\r\n`
 
         if (!options.headers["User-Agent"])
-            sock.send("User-Agent: MakeCode ESP32\r\n")
+            req += "User-Agent: MakeCode ESP32\r\n"
 
         // Iterate over keys to avoid tuple alloc
         for (let k of Object.keys(options.headers))
-            sock.send(`${k}: ${options.headers[k]}\r\n`)
+            req += `${k}: ${options.headers[k]}\r\n`
 
         if (options.json != null) {
             control.assert(options.data == null, 100)
             options.data = JSON.stringify(options.json)
-            sock.send("Content-Type: application/json\r\n")
+            req += "Content-Type: application/json\r\n"
         }
 
         let dataBuf = dataAsBuffer(options.data)
 
         if (dataBuf)
-            sock.send(`Content-Length: ${dataBuf.length}\r\n`)
+            req += `Content-Length: ${dataBuf.length}\r\n`
 
-        sock.send("\r\n")
+        req += "\r\n"
+        let reqBuf = control.createBufferFromUTF8(req)
         if (dataBuf)
-            sock.send(dataBuf)
+            reqBuf = reqBuf.concat(dataBuf)
+
+        // a connection kept from before may have been closed by the server since; then it is done
+        // again on a new one
+        const key = `${proto}//${host}:${port}`
+        let sock = takeSocket(key)
+        let line: string
+        for (; ;) {
+            const reused = !!sock
+            if (!sock) {
+                if (proto == "https:") {
+                    // for SSL we need to know the host name
+                    sock = net.instance().createSocket(host, port, true)
+                } else {
+                    sock = net.instance().createSocket(net.instance().hostByName(host), port, false)
+                }
+                // socket read timeout
+                sock.setTimeout(options.timeout)
+                sock.connect();
+            } else {
+                // don't wait forever on one that is gone
+                sock.setTimeout(options.timeout || 10)
+            }
 
-        let line = sock.readLine()
+            if (!reused) {
+                sock.send(reqBuf)
+                line = sock.readLine()
+                break
+            }
+            try {
+                sock.send(reqBuf)
+                line = sock.readLine()
+            } catch (e) {
+                line = null
+            }
+            if (line)
+                break
+            net.debug(`kept connection to ${key} is gone`)
+            sock.close()
+            sock = null
+        }
+        sock.setTimeout(options.timeout)
+
+        // our response
+        let resp = new Response(sock)
         // print(line)
         let line2 = pysplit(line, " ", 2)
         let status = parseInt(line2[1])
@@ -239,11 +382,21 @@ read only when requested
     raise NotImplementedError("Redirects not yet supported")
     */
 
-        if ((resp.headers["transfer-encoding"] || "").indexOf("chunked") >= 0)
-            control.fail("not supported chunked encoding")
-
         resp.status_code = status
         resp.reason = reason
+        resp._key = key
+        resp._keepAlive = line2[0] == "HTTP/1.1" && (resp.headers["connection"] || "").indexOf("close") < 0
+        if (method == "HEAD" || status == 204 || status == 304 || (100 <= status && status < 200)) {
+            // no body
+        } else if ((resp.headers["transfer-encoding"] || "").indexOf("chunked") >= 0) {
+            resp._chunked = true
+            resp._done = false
+        } else {
+            const content_length = parseInt(resp.headers["content-length"])
+            resp._left = content_length > 0 ? content_length : 0
+            // with no length, the body is up to when the server closes the connection
+            resp._done = content_length === 0
+        }
         return resp
     }
 
@@ -43,6 +43,24 @@ namespace palette {
         return userPalette;
     }
 
+    let fadeColors: color.ColorBuffer;
+
+    /**
+     * Set the palette to one in between two others, for fading from one to the other over
+     * a few frames
+     *
+     * @param from The palette at 0
+     * @param to The palette at 255, with the same layout
+     * @param alpha How far along the fade is, from 0 to 255
+     */
+    export function fade(from: color.ColorBuffer, to: color.ColorBuffer, alpha: number) {
+        const n = Math.min(from.length, to.length);
+        if (!fadeColors || fadeColors.length != n || fadeColors.layout != from.layout)
+            fadeColors = new color.ColorBuffer(n, from.layout);
+        fadeColors.lerp(from, to, alpha);
+        setColors(fadeColors);
+    }
+
     function scenePush(scene: scene.Scene) {
         if (scene.data[FIELD]) {
             const userPalette = scene.data[FIELD] as color.ColorBuffer;
@@ -55,6 +55,18 @@ namespace power {
     export function deepSleep() {
     }
 
+    /**
+     * Poll buttons and sensors less often, so that the device wakes up less while it has nothing
+     * to do; they then react up to 50ms later.
+     * @param enabled true to save power, false to poll at the normal rate
+     */
+    //% blockId=powersetlowpoweridle block="power set low power idle %enabled"
+    //% enabled.shadow=toggleOnOff
+    //% shim=pxt::setLowPowerIdle
+    //% help=/power/set-low-power-idle
+    export function setLowPowerIdle(enabled: boolean) {
+    }
+
     function init() {
         if (_timeout !== undefined) return;
 
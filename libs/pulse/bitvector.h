@@ -57,6 +57,20 @@ class BitVector {
         setLength(len + 1);
         set(len - 1, v);
     }
+    // appends the num (up to 32) low bits of v, the lowest first
+    void pushBits(uint32_t v, int num) {
+        if (num <= 0)
+            return;
+        if (num < 32)
+            v &= (1U << num) - 1;
+        int pos = len;
+        int off = pos & 31;
+        setLength(len + num);
+        uint32_t curr = off ? get32(pos) & ((1U << off) - 1) : 0;
+        data.set(pos >> 5, (TValue)(curr | (v << off)));
+        if (off + num > 32)
+            data.set((pos >> 5) + 1, (TValue)(v >> (32 - off)));
+    }
 };
 
 #endif
\ No newline at end of file
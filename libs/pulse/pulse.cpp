@@ -1,5 +1,6 @@
 #include "pxt.h"
 #include "pulse.h"
+#include "pulsecodec.h"
 
 #define IR_TIMER_CHANNEL 0
 
@@ -19,80 +20,6 @@ void setTCC0(int enabled) {
 
 namespace network {
 
-static const uint8_t hamming[16] = {
-    0b0000000, 0b1110000, 0b1001100, 0b0111100, 0b0101010, 0b1011010, 0b1100110, 0b0010110,
-    0b1101001, 0b0011001, 0b0100101, 0b1010101, 0b1000011, 0b0110011, 0b0001111, 0b1111111,
-};
-
-static const uint8_t invHamming[64] = {
-    0x00, 0x0c, 0x0a, 0x7e, 0x09, 0x4e, 0x2e, 0xee, 0x09, 0x7d, 0x7b, 0x77, 0x99, 0x59, 0x39, 0x7e,
-    0x0a, 0x4d, 0xaa, 0x6a, 0x48, 0x44, 0x3a, 0x4e, 0x1d, 0xdd, 0x3a, 0x7d, 0x39, 0x4d, 0x33, 0x3f,
-    0x0c, 0xcc, 0x2b, 0x6c, 0x28, 0x5c, 0x22, 0x2e, 0x1b, 0x5c, 0xbb, 0x7b, 0x59, 0x55, 0x2b, 0x5f,
-    0x18, 0x6c, 0x6a, 0x66, 0x88, 0x48, 0x28, 0x6f, 0x11, 0x1d, 0x1b, 0x6f, 0x18, 0x5f, 0x3f, 0xff};
-
-static const uint8_t bitsToGap[4] = {1, 2, 4, 3};
-static const uint8_t gapToBits[5] = {0b00, 0b00, 0b01, 0b11, 0b10};
-
-static int lookupInvHaming(int v) {
-    int k = invHamming[v >> 1];
-    if (v & 1)
-        return (k & 0xf);
-    else
-        return (k >> 4);
-}
-
-static void decodeHamming(uint32_t r, uint8_t *dst) {
-    int a0 = 0;
-    int a1 = 0;
-    int b0 = 0;
-    int b1 = 0;
-    int p = 0;
-
-    for (int i = 0; i < 7; ++i) {
-        a0 |= ((r >> p++) & 1) << i;
-        b0 |= ((r >> p++) & 1) << i;
-        a1 |= ((r >> p++) & 1) << i;
-        b1 |= ((r >> p++) & 1) << i;
-    }
-
-    dst[0] = (lookupInvHaming(a0) << 4) | lookupInvHaming(a1);
-    dst[1] = (lookupInvHaming(b0) << 4) | lookupInvHaming(b1);
-}
-
-static void pushTwo(BitVector &bv, uint8_t a, uint8_t b) {
-    int gap = bitsToGap[b * 2 + a];
-    bv.push(1);
-    while (gap--)
-        bv.push(0);
-}
-
-static void encodeHamming(BitVector &bv, uint8_t a, uint8_t b) {
-    int a0 = hamming[a >> 4];
-    int a1 = hamming[a & 0xf];
-    int b0 = hamming[b >> 4];
-    int b1 = hamming[b & 0xf];
-    for (int i = 0; i < 7; ++i) {
-        pushTwo(bv, (a0 >> i) & 1, (b0 >> i) & 1);
-        pushTwo(bv, (a1 >> i) & 1, (b1 >> i) & 1);
-    }
-}
-
-uint16_t crc16ccit(uint8_t *data, uint32_t len) {
-    uint16_t crc = 0xffff;
-
-    while (len--) {
-        crc ^= (*data++ << 8);
-        for (int i = 0; i < 8; ++i) {
-            if (crc & 0x8000)
-                crc = crc << 1 ^ 0x1021;
-            else
-                crc = crc << 1;
-        }
-    }
-
-    return crc;
-}
-
 static PulseBase* instance = NULL;
 
 static void timer_irq(uint16_t channels)
@@ -110,6 +37,9 @@ PulseBase::PulseBase(uint16_t id, int pinOut, int pinIn, LowLevelTimer* t) {
     recvState = PULSE_RECV_ERROR;
     sending = false;
     outBuffer = NULL;
+    edgeHead = edgeTail = 0;
+    edgesQueued = false;
+    edgesLost = false;
     pin = lookupPin(pinOut);
     if (pin) {
         pin->setDigitalValue(0);
@@ -117,6 +47,7 @@ PulseBase::PulseBase(uint16_t id, int pinOut, int pinIn, LowLevelTimer* t) {
         inpin = lookupPin(pinIn);
 
         devMessageBus.listen(id, PULSE_PACKET_END_EVENT, this, &PulseBase::packetEnd);
+        devMessageBus.listen(id, PULSE_EDGES_EVENT, this, &PulseBase::processEdges);
     }
 
     timer->setIRQPriority(0);
@@ -162,11 +93,8 @@ void PulseBase::send(Buffer d) {
         return; // error code?
 
     encodedMsg.setLength(0);
-    for (int i = 0; i < 25; ++i)
-        encodedMsg.push(1);
-
-    for (int i = 0; i < 8; ++i)
-        encodedMsg.push(0);
+    encodedMsg.pushBits(0x1ffffff, 25);
+    encodedMsg.pushBits(0, 8);
 
     for (int i = 0; i < d->length; i += 2) {
         encodeHamming(encodedMsg, d->data[i], d->data[i + 1]);
@@ -175,8 +103,7 @@ void PulseBase::send(Buffer d) {
     uint16_t crc = crc16ccit(d->data, d->length);
     encodeHamming(encodedMsg, crc & 0xff, crc >> 8);
 
-    for (int i = 0; i < 15; ++i)
-        encodedMsg.push(1);
+    encodedMsg.pushBits(0x7fff, 15);
 
     auto gap = system_timer_current_time_us() - lastSendTime;
 
@@ -242,18 +169,69 @@ int PulseBase::adjustShift() {
     return pulseLen;
 }
 
+// in the pin interrupt; the edges are decoded by processEdges()
+void PulseBase::queueEdge(uint16_t edge) {
+    uint16_t head = edgeHead;
+    uint16_t next = (head + 1) & (PULSE_EDGE_RING_SIZE - 1);
+    if (next == edgeTail) {
+        edgesLost = true;
+    } else {
+        edges[head] = edge;
+        edgeHead = next;
+    }
+    if (!edgesQueued) {
+        edgesQueued = true;
+        Event evt(id, PULSE_EDGES_EVENT);
+    }
+}
+
+void PulseBase::processEdges(Event) {
+    for (;;) {
+        while (edgeTail != edgeHead) {
+            uint16_t edge = edges[edgeTail];
+            edgeTail = (edgeTail + 1) & (PULSE_EDGE_RING_SIZE - 1);
+            int tm = edge & ~PULSE_EDGE_MARK;
+            if (edge & PULSE_EDGE_MARK)
+                mark(tm);
+            else
+                gap(tm);
+        }
+        if (edgesLost) {
+            edgesLost = false;
+            finish(3);
+        }
+        edgesQueued = false;
+        // anything queued since the ring was last seen empty didn't raise an event
+        if (edgeTail == edgeHead)
+            break;
+        edgesQueued = true;
+    }
+}
+
+static uint16_t edgeLength(Event &ev) {
+    return ev.timestamp > 10000 ? PULSE_EDGE_BREAK : (uint16_t)ev.timestamp;
+}
+
 void PulseBase::pulseGap(Event ev) {
     if (sending)
         return;
+    queueEdge(edgeLength(ev));
+}
 
-    if (ev.timestamp > 10000) {
+void PulseBase::pulseMark(Event ev) {
+    if (sending)
+        return;
+    lastMarkTime = system_timer_current_time_us();
+    queueEdge(PULSE_EDGE_MARK | edgeLength(ev));
+}
+
+void PulseBase::gap(int tm) {
+    if (tm == PULSE_EDGE_BREAK) {
         dbg.put(" BRK ");
         finish(11);
         return;
     }
 
-    int tm = (int)ev.timestamp;
-
     dbg.putNum(tm);
 
     if (recvState == PULSE_WAIT_START_GAP) {
@@ -324,22 +302,15 @@ void PulseBase::packetEnd(Event) {
     Event evt(id, crc == pktCrc ? PULSE_PACKET_EVENT : PULSE_PACKET_ERROR_EVENT);
 }
 
-void PulseBase::pulseMark(Event ev) {
-    if (sending)
-        return;
-
-    if (ev.timestamp > 10000) {
+void PulseBase::mark(int tm) {
+    if (tm == PULSE_EDGE_BREAK) {
         dbg.put(" -BRK ");
         finish(10);
         return;
     }
 
-    int tm = (int)ev.timestamp;
-
     dbg.putNum(-tm);
 
-    lastMarkTime = system_timer_current_time_us();
-
     if (tm >= 20 * PULSE_PULSE_LEN) {
         recvState = PULSE_WAIT_START_GAP;
         return;
@@ -9,9 +9,17 @@
 #define PULSE_PACKET_END_EVENT 0x1
 #define PULSE_PACKET_EVENT 0x2
 #define PULSE_PACKET_ERROR_EVENT 0x3
+#define PULSE_EDGES_EVENT 0x4
 #define PULSE_MAX_PULSES (PULSE_MAX_MSG_SIZE * 14 + 10)
 #define PULSE_PULSE_LEN 250
 
+// edges are queued here by the pin interrupts, and decoded by a fiber; a power of 2
+#ifndef PULSE_EDGE_RING_SIZE
+#define PULSE_EDGE_RING_SIZE 256
+#endif
+#define PULSE_EDGE_MARK 0x8000
+#define PULSE_EDGE_BREAK 0x7fff
+
 #define PULSE_IR_COMPONENT_ID 0x2042
 #define PULSE_CABLE_COMPONENT_ID 0x2043
 
@@ -96,6 +104,12 @@ class PulseBase {
     PulseRecvState recvState;
     Buffer outBuffer;
 
+    // lengths of gaps and marks (with PULSE_EDGE_MARK), in us
+    uint16_t edges[PULSE_EDGE_RING_SIZE];
+    volatile uint16_t edgeHead, edgeTail;
+    volatile bool edgesQueued; // PULSE_EDGES_EVENT raised, and not handled yet
+    volatile bool edgesLost;
+
     DbgBuffer dbg;
 
   public:
@@ -110,6 +124,10 @@ class PulseBase {
     void addPulse(int v);
     int adjustShift();
     void pulseGap(Event ev);
+    void queueEdge(uint16_t edge);
+    void processEdges(Event);
+    void gap(int tm);
+    void mark(int tm);
     int errorRate(int start, BitVector &bits);
     void packetEnd(Event);
     void pulseMark(Event ev);
@@ -0,0 +1,161 @@
+#include "pulsecodec.h"
+
+namespace network {
+
+// the Hamming code of each nibble, with its 7 bits spread to a nibble each, the way they are
+// interleaved in the bits sent
+static const uint32_t hammingSpread[16] = {
+    0x0000000, 0x1110000, 0x1001100, 0x0111100, 0x0101010, 0x1011010, 0x1100110, 0x0010110,
+    0x1101001, 0x0011001, 0x0100101, 0x1010101, 0x1000011, 0x0110011, 0x0001111, 0x1111111,
+};
+
+// the nibble of each 7-bit code, corrected
+static const uint8_t invHamming[128] = {
+    0x0, 0x0, 0x0, 0xc, 0x0, 0xa, 0x7, 0xe, 0x0, 0x9, 0x4, 0xe, 0x2, 0xe, 0xe, 0xe,
+    0x0, 0x9, 0x7, 0xd, 0x7, 0xb, 0x7, 0x7, 0x9, 0x9, 0x5, 0x9, 0x3, 0x9, 0x7, 0xe,
+    0x0, 0xa, 0x4, 0xd, 0xa, 0xa, 0x6, 0xa, 0x4, 0x8, 0x4, 0x4, 0x3, 0xa, 0x4, 0xe,
+    0x1, 0xd, 0xd, 0xd, 0x3, 0xa, 0x7, 0xd, 0x3, 0x9, 0x4, 0xd, 0x3, 0x3, 0x3, 0xf,
+    0x0, 0xc, 0xc, 0xc, 0x2, 0xb, 0x6, 0xc, 0x2, 0x8, 0x5, 0xc, 0x2, 0x2, 0x2, 0xe,
+    0x1, 0xb, 0x5, 0xc, 0xb, 0xb, 0x7, 0xb, 0x5, 0x9, 0x5, 0x5, 0x2, 0xb, 0x5, 0xf,
+    0x1, 0x8, 0x6, 0xc, 0x6, 0xa, 0x6, 0x6, 0x8, 0x8, 0x4, 0x8, 0x2, 0x8, 0x6, 0xf,
+    0x1, 0x1, 0x1, 0xd, 0x1, 0xb, 0x6, 0xf, 0x1, 0x8, 0x5, 0xf, 0x3, 0xf, 0xf, 0xf,
+};
+
+// 8 interleaved bits (two of each code) split into the bytes of the four codes
+static const uint32_t deinterleave[256] = {
+    0x00000000, 0x00000001, 0x00000100, 0x00000101, 0x00010000, 0x00010001, 0x00010100, 0x00010101,
+    0x01000000, 0x01000001, 0x01000100, 0x01000101, 0x01010000, 0x01010001, 0x01010100, 0x01010101,
+    0x00000002, 0x00000003, 0x00000102, 0x00000103, 0x00010002, 0x00010003, 0x00010102, 0x00010103,
+    0x01000002, 0x01000003, 0x01000102, 0x01000103, 0x01010002, 0x01010003, 0x01010102, 0x01010103,
+    0x00000200, 0x00000201, 0x00000300, 0x00000301, 0x00010200, 0x00010201, 0x00010300, 0x00010301,
+    0x01000200, 0x01000201, 0x01000300, 0x01000301, 0x01010200, 0x01010201, 0x01010300, 0x01010301,
+    0x00000202, 0x00000203, 0x00000302, 0x00000303, 0x00010202, 0x00010203, 0x00010302, 0x00010303,
+    0x01000202, 0x01000203, 0x01000302, 0x01000303, 0x01010202, 0x01010203, 0x01010302, 0x01010303,
+    0x00020000, 0x00020001, 0x00020100, 0x00020101, 0x00030000, 0x00030001, 0x00030100, 0x00030101,
+    0x01020000, 0x01020001, 0x01020100, 0x01020101, 0x01030000, 0x01030001, 0x01030100, 0x01030101,
+    0x00020002, 0x00020003, 0x00020102, 0x00020103, 0x00030002, 0x00030003, 0x00030102, 0x00030103,
+    0x01020002, 0x01020003, 0x01020102, 0x01020103, 0x01030002, 0x01030003, 0x01030102, 0x01030103,
+    0x00020200, 0x00020201, 0x00020300, 0x00020301, 0x00030200, 0x00030201, 0x00030300, 0x00030301,
+    0x01020200, 0x01020201, 0x01020300, 0x01020301, 0x01030200, 0x01030201, 0x01030300, 0x01030301,
+    0x00020202, 0x00020203, 0x00020302, 0x00020303, 0x00030202, 0x00030203, 0x00030302, 0x00030303,
+    0x01020202, 0x01020203, 0x01020302, 0x01020303, 0x01030202, 0x01030203, 0x01030302, 0x01030303,
+    0x02000000, 0x02000001, 0x02000100, 0x02000101, 0x02010000, 0x02010001, 0x02010100, 0x02010101,
+    0x03000000, 0x03000001, 0x03000100, 0x03000101, 0x03010000, 0x03010001, 0x03010100, 0x03010101,
+    0x02000002, 0x02000003, 0x02000102, 0x02000103, 0x02010002, 0x02010003, 0x02010102, 0x02010103,
+    0x03000002, 0x03000003, 0x03000102, 0x03000103, 0x03010002, 0x03010003, 0x03010102, 0x03010103,
+    0x02000200, 0x02000201, 0x02000300, 0x02000301, 0x02010200, 0x02010201, 0x02010300, 0x02010301,
+    0x03000200, 0x03000201, 0x03000300, 0x03000301, 0x03010200, 0x03010201, 0x03010300, 0x03010301,
+    0x02000202, 0x02000203, 0x02000302, 0x02000303, 0x02010202, 0x02010203, 0x02010302, 0x02010303,
+    0x03000202, 0x03000203, 0x03000302, 0x03000303, 0x03010202, 0x03010203, 0x03010302, 0x03010303,
+    0x02020000, 0x02020001, 0x02020100, 0x02020101, 0x02030000, 0x02030001, 0x02030100, 0x02030101,
+    0x03020000, 0x03020001, 0x03020100, 0x03020101, 0x03030000, 0x03030001, 0x03030100, 0x03030101,
+    0x02020002, 0x02020003, 0x02020102, 0x02020103, 0x02030002, 0x02030003, 0x02030102, 0x02030103,
+    0x03020002, 0x03020003, 0x03020102, 0x03020103, 0x03030002, 0x03030003, 0x03030102, 0x03030103,
+    0x02020200, 0x02020201, 0x02020300, 0x02020301, 0x02030200, 0x02030201, 0x02030300, 0x02030301,
+    0x03020200, 0x03020201, 0x03020300, 0x03020301, 0x03030200, 0x03030201, 0x03030300, 0x03030301,
+    0x02020202, 0x02020203, 0x02020302, 0x02020303, 0x02030202, 0x02030203, 0x02030302, 0x02030303,
+    0x03020202, 0x03020203, 0x03020302, 0x03020303, 0x03030202, 0x03030203, 0x03030302, 0x03030303,
+};
+
+static const uint8_t bitsToGap[4] = {1, 2, 4, 3};
+const uint8_t gapToBits[5] = {0b00, 0b00, 0b01, 0b11, 0b10};
+
+// the pulses of 8 interleaved bits, and how many (in the top byte); 20 at most
+static const uint32_t pulsesOfByte[256] = {
+    0x08000055, 0x090000a9, 0x0b0002a1, 0x0a000151, 0x090000a5, 0x0a000149, 0x0c000521, 0x0b000291,
+    0x0b000285, 0x0c000509, 0x0e001421, 0x0d000a11, 0x0a000145, 0x0b000289, 0x0d000a21, 0x0c000511,
+    0x09000095, 0x0a000129, 0x0c0004a1, 0x0b000251, 0x0a000125, 0x0b000249, 0x0d000921, 0x0c000491,
+    0x0c000485, 0x0d000909, 0x0f002421, 0x0e001211, 0x0b000245, 0x0c000489, 0x0e001221, 0x0d000911,
+    0x0b000215, 0x0c000429, 0x0e0010a1, 0x0d000851, 0x0c000425, 0x0d000849, 0x0f002121, 0x0e001091,
+    0x0e001085, 0x0f002109, 0x11008421, 0x10004211, 0x0d000845, 0x0e001089, 0x10004221, 0x0f002111,
+    0x0a000115, 0x0b000229, 0x0d0008a1, 0x0c000451, 0x0b000225, 0x0c000449, 0x0e001121, 0x0d000891,
+    0x0d000885, 0x0e001109, 0x10004421, 0x0f002211, 0x0c000445, 0x0d000889, 0x0f002221, 0x0e001111,
+    0x09000055, 0x0a0000a9, 0x0c0002a1, 0x0b000151, 0x0a0000a5, 0x0b000149, 0x0d000521, 0x0c000291,
+    0x0c000285, 0x0d000509, 0x0f001421, 0x0e000a11, 0x0b000145, 0x0c000289, 0x0e000a21, 0x0d000511,
+    0x0a000095, 0x0b000129, 0x0d0004a1, 0x0c000251, 0x0b000125, 0x0c000249, 0x0e000921, 0x0d000491,
+    0x0d000485, 0x0e000909, 0x10002421, 0x0f001211, 0x0c000245, 0x0d000489, 0x0f001221, 0x0e000911,
+    0x0c000215, 0x0d000429, 0x0f0010a1, 0x0e000851, 0x0d000425, 0x0e000849, 0x10002121, 0x0f001091,
+    0x0f001085, 0x10002109, 0x12008421, 0x11004211, 0x0e000845, 0x0f001089, 0x11004221, 0x10002111,
+    0x0b000115, 0x0c000229, 0x0e0008a1, 0x0d000451, 0x0c000225, 0x0d000449, 0x0f001121, 0x0e000891,
+    0x0e000885, 0x0f001109, 0x11004421, 0x10002211, 0x0d000445, 0x0e000889, 0x10002221, 0x0f001111,
+    0x0b000055, 0x0c0000a9, 0x0e0002a1, 0x0d000151, 0x0c0000a5, 0x0d000149, 0x0f000521, 0x0e000291,
+    0x0e000285, 0x0f000509, 0x11001421, 0x10000a11, 0x0d000145, 0x0e000289, 0x10000a21, 0x0f000511,
+    0x0c000095, 0x0d000129, 0x0f0004a1, 0x0e000251, 0x0d000125, 0x0e000249, 0x10000921, 0x0f000491,
+    0x0f000485, 0x10000909, 0x12002421, 0x11001211, 0x0e000245, 0x0f000489, 0x11001221, 0x10000911,
+    0x0e000215, 0x0f000429, 0x110010a1, 0x10000851, 0x0f000425, 0x10000849, 0x12002121, 0x11001091,
+    0x11001085, 0x12002109, 0x14008421, 0x13004211, 0x10000845, 0x11001089, 0x13004221, 0x12002111,
+    0x0d000115, 0x0e000229, 0x100008a1, 0x0f000451, 0x0e000225, 0x0f000449, 0x11001121, 0x10000891,
+    0x10000885, 0x11001109, 0x13004421, 0x12002211, 0x0f000445, 0x10000889, 0x12002221, 0x11001111,
+    0x0a000055, 0x0b0000a9, 0x0d0002a1, 0x0c000151, 0x0b0000a5, 0x0c000149, 0x0e000521, 0x0d000291,
+    0x0d000285, 0x0e000509, 0x10001421, 0x0f000a11, 0x0c000145, 0x0d000289, 0x0f000a21, 0x0e000511,
+    0x0b000095, 0x0c000129, 0x0e0004a1, 0x0d000251, 0x0c000125, 0x0d000249, 0x0f000921, 0x0e000491,
+    0x0e000485, 0x0f000909, 0x11002421, 0x10001211, 0x0d000245, 0x0e000489, 0x10001221, 0x0f000911,
+    0x0d000215, 0x0e000429, 0x100010a1, 0x0f000851, 0x0e000425, 0x0f000849, 0x11002121, 0x10001091,
+    0x10001085, 0x11002109, 0x13008421, 0x12004211, 0x0f000845, 0x10001089, 0x12004221, 0x11002111,
+    0x0c000115, 0x0d000229, 0x0f0008a1, 0x0e000451, 0x0d000225, 0x0e000449, 0x10001121, 0x0f000891,
+    0x0f000885, 0x10001109, 0x12004421, 0x11002211, 0x0e000445, 0x0f000889, 0x11002221, 0x10001111,
+};
+
+static const uint16_t crcTable[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+};
+
+void decodeHamming(uint32_t r, uint8_t *dst) {
+    uint32_t codes = deinterleave[r & 0xff] | deinterleave[(r >> 8) & 0xff] << 2 |
+                     deinterleave[(r >> 16) & 0xff] << 4 | deinterleave[(r >> 24) & 0xff] << 6;
+
+    dst[0] = (invHamming[codes & 0x7f] << 4) | invHamming[(codes >> 16) & 0x7f];
+    dst[1] = (invHamming[(codes >> 8) & 0x7f] << 4) | invHamming[(codes >> 24) & 0x7f];
+}
+
+void encodeHamming(BitVector &bv, uint8_t a, uint8_t b) {
+    uint32_t r = hammingSpread[a >> 4] | hammingSpread[b >> 4] << 1 |
+                 hammingSpread[a & 0xf] << 2 | hammingSpread[b & 0xf] << 3;
+    for (int i = 0; i < 24; i += 8) {
+        uint32_t p = pulsesOfByte[(r >> i) & 0xff];
+        bv.pushBits(p & 0xffffff, p >> 24);
+    }
+    // the last 4 bits; the two pulses for the zeros above them take 2 bits each
+    uint32_t p = pulsesOfByte[r >> 24];
+    bv.pushBits(p & 0xffffff, (p >> 24) - 4);
+}
+
+uint16_t crc16ccit(const uint8_t *data, uint32_t len) {
+    uint16_t crc = 0xffff;
+    while (len--)
+        crc = (crc << 8) ^ crcTable[(crc >> 8) ^ *data++];
+    return crc;
+}
+
+} // namespace network
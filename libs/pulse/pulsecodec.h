@@ -0,0 +1,24 @@
+#ifndef CABLE_PULSECODEC_H
+#define CABLE_PULSECODEC_H
+
+#include "pxt.h"
+#include "bitvector.h"
+
+// Packets are sent as pairs of bytes, each byte as two Hamming(7,4) codes. The bits of the four
+// codes of a pair are interleaved, and every two bits are sent as a pulse followed by a gap of
+// 1 to 4 pulse lengths.
+
+namespace network {
+
+// bits of a gap, by its length in pulses
+extern const uint8_t gapToBits[5];
+
+uint16_t crc16ccit(const uint8_t *data, uint32_t len);
+// appends the pulses of a pair of bytes
+void encodeHamming(BitVector &bv, uint8_t a, uint8_t b);
+// r is the 28 bits of the gaps of a pair of bytes, the first in the lowest bits
+void decodeHamming(uint32_t r, uint8_t *dst);
+
+} // namespace network
+
+#endif
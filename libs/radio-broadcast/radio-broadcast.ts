@@ -13,7 +13,7 @@ namespace radio {
     }
 
     /**
-     * Broadcasts a message over radio
+     * Broadcasts a message over radio; messages sent before the program yields share a packet
      * @param msg 
      */
     //% blockId=radioBroadcastMessage block="radio send $msg"
@@ -23,7 +23,7 @@ namespace radio {
     //% help=radio/send-message
     export function sendMessage(msg: number): void {
         // 0 is MICROBIT_EVT_ANY, shifting by 1
-        radio.raiseEvent(BROADCAST_GENERAL_ID, msg + 1);
+        radio._queueEvent(BROADCAST_GENERAL_ID, msg + 1);
     }
 
     /**
@@ -36,6 +36,7 @@ namespace radio {
     //% weight=199
     //% help=radio/on-received-message
     export function onReceivedMessage(msg: number, handler: () => void) {
+        radio._receiveEvents();
         control.onEvent(BROADCAST_GENERAL_ID, msg + 1, handler);
     }
 }
\ No newline at end of file
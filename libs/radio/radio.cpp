@@ -72,6 +72,88 @@ CODAL_RADIO* getRadio() {
 }
 #endif // #else
 
+    // Packets are moved from the radio's own queue, which holds a few of them, into this one as
+    // soon as they come in. A record is the bytes of the packet padded to the maximum size, the
+    // receive time in ms and the RSSI (as Int32LE, so that it is last).
+#ifndef RADIO_RX_QUEUE_SIZE
+#define RADIO_RX_QUEUE_SIZE 8
+#endif
+#define RADIO_RECORD_SIZE (DEVICE_RADIO_MAX_PACKET_SIZE + 8)
+
+    static uint8_t *rxQueue;
+    static int rxCapacity = RADIO_RX_QUEUE_SIZE;
+    static int rxStart, rxCount;
+    static uint32_t rxDropped;
+
+    // Hashes of the packets received last, with their receive times, to drop copies of a packet
+    // (the time and serial number in it tell packets apart) that come in again within the window.
+#define RADIO_DEDUP_SIZE 16
+    static uint32_t dedupHash[RADIO_DEDUP_SIZE];
+    static uint32_t dedupTime[RADIO_DEDUP_SIZE];
+    static int dedupNext;
+    static int dedupWindow;
+
+#ifdef CODAL_RADIO
+    // takes the next packet from the radio, if any, into rec
+    static bool recvRecord(uint8_t *rec) {
+        auto p = getRadio()->datagram.recv();
+#if CODAL_RADIO_MICROBIT_DAL
+        if (p == PacketBuffer::EmptyPacket)
+            return false;
+        int rssi = p.getRSSI();
+#else
+        // TODO: RSSI support
+        int rssi = -73;
+        if (p.length() == 0)
+            return false;
+#endif
+        int length = min(p.length(), DEVICE_RADIO_MAX_PACKET_SIZE);
+        uint32_t now = current_time_ms();
+        memset(rec, 0, DEVICE_RADIO_MAX_PACKET_SIZE);
+        memcpy(rec, p.getBytes(), length);
+        memcpy(rec + DEVICE_RADIO_MAX_PACKET_SIZE, &now, 4);
+        memcpy(rec + DEVICE_RADIO_MAX_PACKET_SIZE + 4, &rssi, 4); // assumes Int32LE layout
+        return true;
+    }
+
+    static bool isDuplicate(const uint8_t *rec) {
+        if (!dedupWindow)
+            return false;
+        uint32_t now;
+        memcpy(&now, rec + DEVICE_RADIO_MAX_PACKET_SIZE, 4);
+        uint32_t h = hash_fnv1(rec, DEVICE_RADIO_MAX_PACKET_SIZE) | 1; // 0 is a free slot
+        for (int i = 0; i < RADIO_DEDUP_SIZE; ++i)
+            if (dedupHash[i] == h && now - dedupTime[i] < (uint32_t)dedupWindow)
+                return true;
+        dedupHash[dedupNext] = h;
+        dedupTime[dedupNext] = now;
+        dedupNext = (dedupNext + 1) % RADIO_DEDUP_SIZE;
+        return false;
+    }
+
+    static void drainRadio() {
+        uint8_t tmp[RADIO_RECORD_SIZE];
+        while (recvRecord(tmp)) {
+            if (isDuplicate(tmp))
+                continue;
+            if (rxCount == rxCapacity) {
+                // keep the newest ones
+                rxStart = (rxStart + 1) % rxCapacity;
+                rxCount--;
+                rxDropped++;
+            }
+            memcpy(rxQueue + ((rxStart + rxCount) % rxCapacity) * RADIO_RECORD_SIZE, tmp,
+                   RADIO_RECORD_SIZE);
+            rxCount++;
+        }
+    }
+
+    // runs ahead of the handlers of the program, in the context the radio raises the event from
+    static void onDatagram(CODAL_EVENT) {
+        drainRadio();
+    }
+#endif
+
     bool radioEnabled = false;
     int radioEnable() {
 #ifdef CODAL_RADIO
@@ -87,6 +169,9 @@ CODAL_RADIO* getRadio() {
         if (!radioEnabled) {
             getRadio()->setGroup(pxt::programHash());
             getRadio()->setTransmitPower(6); // start with high power by default
+            rxQueue = (uint8_t *)app_alloc(rxCapacity * RADIO_RECORD_SIZE);
+            EventModel::defaultEventBus->listen(DEVICE_ID_RADIO, DEVICE_RADIO_EVT_DATAGRAM, onDatagram,
+                                                MESSAGE_BUS_LISTENER_IMMEDIATE);
             radioEnabled = true;
         }
         return r;
@@ -111,8 +196,26 @@ CODAL_RADIO* getRadio() {
 #endif        
     }
 
+#ifdef CODAL_RADIO
+    static Buffer shiftRecords(int count) {
+        if (count > rxCount)
+            count = rxCount;
+        if (count == 0)
+            return NULL;
+        auto res = mkBuffer(NULL, count * RADIO_RECORD_SIZE);
+        for (int i = 0; i < count; ++i) {
+            memcpy(res->data + i * RADIO_RECORD_SIZE, rxQueue + rxStart * RADIO_RECORD_SIZE,
+                   RADIO_RECORD_SIZE);
+            rxStart = (rxStart + 1) % rxCapacity;
+            rxCount--;
+        }
+        return res;
+    }
+#endif
+
     /**
-     * Internal use only. Takes the next packet from the radio queue and returns its contents + RSSI in a Buffer.
+     * Internal use only. Takes the next packet from the radio queue and returns its contents,
+     * receive time and RSSI in a Buffer.
      * @returns NULL if no packet available
      */
     //%
@@ -120,30 +223,68 @@ CODAL_RADIO* getRadio() {
 #ifdef CODAL_RADIO        
         if (radioEnable() != DEVICE_OK) return NULL;
 
-        auto p = getRadio()->datagram.recv();
-#if CODAL_RADIO_MICROBIT_DAL
-        if (p == PacketBuffer::EmptyPacket)
-            return NULL;
-        int rssi = p.getRSSI();
-        auto length = p.length();
-        auto bytes = p.getBytes();
+        drainRadio();
+        return shiftRecords(1);
 #else
-        // TODO: RSSI support
-        int rssi = -73;        
-        auto length = p.length();
-        auto bytes = p.getBytes();
-        if (length == 0)
-            return NULL;
-#endif
+        return NULL;
+#endif        
+    }
 
-        uint8_t buf[DEVICE_RADIO_MAX_PACKET_SIZE + sizeof(int)]; // packet length + rssi
-        memset(buf, 0, sizeof(buf));
-        memcpy(buf, bytes, length); // data
-        memcpy(buf + DEVICE_RADIO_MAX_PACKET_SIZE, &rssi, sizeof(int)); // RSSi - assumes Int32LE layout
-        return mkBuffer(buf, sizeof(buf));
+    /**
+     * Internal use only. Takes all packets from the radio queue and returns them one after
+     * another in a Buffer, in the format of readRawPacket().
+     * @returns NULL if no packet available
+     */
+    //%
+    Buffer readAll() {
+#ifdef CODAL_RADIO
+        if (radioEnable() != DEVICE_OK) return NULL;
+
+        drainRadio();
+        return shiftRecords(rxCount);
 #else
         return NULL;
-#endif        
+#endif
+    }
+
+    /**
+     * Set how many received packets are kept until the program reads them; the oldest ones are
+     * dropped when more come in. Packets already received are discarded.
+     * @param size the number of packets, eg: 8
+     */
+    //% help=radio/set-receive-queue-size
+    //% advanced=true
+    void setReceiveQueueSize(int size) {
+#ifdef CODAL_RADIO
+        if (size < 1 || radioEnable() != DEVICE_OK) return;
+
+        app_free(rxQueue);
+        rxQueue = (uint8_t *)app_alloc(size * RADIO_RECORD_SIZE);
+        rxCapacity = size;
+        rxStart = 0;
+        rxCount = 0;
+#endif
+    }
+
+    /**
+     * Drop packets identical to one received less than the given time ago, eg. the same packet
+     * relayed by several devices. Off (0) by default.
+     * @param window the time in ms, or 0 to keep all packets, eg: 1000
+     */
+    //% help=radio/set-duplicate-filter
+    //% advanced=true
+    void setDuplicateFilter(int window) {
+        dedupWindow = window < 0 ? 0 : window;
+        memset(dedupHash, 0, sizeof(dedupHash));
+    }
+
+    /**
+     * Number of received packets dropped because the receive queue was full.
+     */
+    //% help=radio/dropped-packets
+    //% advanced=true
+    int droppedPackets() {
+        return rxDropped;
     }
 
     /**
@@ -155,7 +296,7 @@ CODAL_RADIO* getRadio() {
         if (radioEnable() != DEVICE_OK || NULL == msg) return;
 
         // don't send RSSI data; and make sure no buffer underflow
-        int len = msg->length - sizeof(int);
+        int len = min(msg->length - (int)sizeof(int), DEVICE_RADIO_MAX_PACKET_SIZE);
         if (len > 0)
             getRadio()->datagram.send(msg->data, len);
 #endif            
@@ -173,7 +314,7 @@ CODAL_RADIO* getRadio() {
         if (radioEnable() != DEVICE_OK) return;
 
         registerWithDal(DEVICE_ID_RADIO, DEVICE_RADIO_EVT_DATAGRAM, body);
-        getRadio()->datagram.recv(); // wake up read code
+        drainRadio(); // wake up read code
 #endif       
     }
 
@@ -24,6 +24,8 @@ namespace radio {
     const PACKET_PREFIX_LENGTH = 9;
     const VALUE_PACKET_NAME_LEN_OFFSET = 13;
     const DOUBLE_VALUE_PACKET_NAME_LEN_OFFSET = 17;
+    // received packets: the packet, receive time, RSSI
+    const RADIO_RECORD_SIZE = RADIO_MAX_PACKET_SIZE + 8;
 
     // Packet Spec:
     // | 0              | 1 ... 4       | 5 ... 8           | 9 ... 28
@@ -44,6 +46,9 @@ namespace radio {
     export const PACKET_TYPE_DOUBLE = 4;
     // payload: number (9 ... 16), name length (17), name (18 ... 26)
     export const PACKET_TYPE_DOUBLE_VALUE = 5;
+    // payload: number of events (9), source and value of each event as UInt16LE (10 ... 29)
+    export const PACKET_TYPE_EVENTS = 6;
+    const MAX_EVENTS_PER_PACKET = 5;
 
     let transmittingSerial: boolean;
     let initialized = false;
@@ -53,6 +58,7 @@ namespace radio {
     let onReceivedValueHandler: (name: string, value: number) => void;
     let onReceivedStringHandler: (receivedString: string) => void;
     let onReceivedBufferHandler: (receivedBuffer: Buffer) => void;
+    let queuedEvents: number[];
 
     function init() {
         if (initialized) return;
@@ -61,31 +67,81 @@ namespace radio {
     }
 
     function handleDataReceived() {
-        let buffer: Buffer = readRawPacket();
-        while (buffer) {
-            lastPacket = RadioPacket.getPacket(buffer);
-            switch (lastPacket.packetType) {
-                case PACKET_TYPE_NUMBER:
-                case PACKET_TYPE_DOUBLE:
-                    if (onReceivedNumberHandler)
-                        onReceivedNumberHandler(lastPacket.numberPayload);
-                    break;
-                case PACKET_TYPE_VALUE:
-                case PACKET_TYPE_DOUBLE_VALUE:
-                    if (onReceivedValueHandler)
-                        onReceivedValueHandler(lastPacket.stringPayload, lastPacket.numberPayload);
-                    break;
-                case PACKET_TYPE_BUFFER:
-                    if (onReceivedBufferHandler)
-                        onReceivedBufferHandler(lastPacket.bufferPayload);
-                    break;
-                case PACKET_TYPE_STRING:
-                    if (onReceivedStringHandler)
-                        onReceivedStringHandler(lastPacket.stringPayload);
-                    break;
-            }
-            // read next packet if any
-            buffer = readRawPacket();
+        let records = readAll();
+        while (records) {
+            for (let off = 0; off + RADIO_RECORD_SIZE <= records.length; off += RADIO_RECORD_SIZE)
+                handlePacket(RadioPacket.getPacket(records.slice(off, RADIO_RECORD_SIZE)));
+            // read the packets that came in meanwhile, if any
+            records = readAll();
+        }
+    }
+
+    function handlePacket(packet: RadioPacket) {
+        lastPacket = packet;
+        switch (lastPacket.packetType) {
+            case PACKET_TYPE_NUMBER:
+            case PACKET_TYPE_DOUBLE:
+                if (onReceivedNumberHandler)
+                    onReceivedNumberHandler(lastPacket.numberPayload);
+                break;
+            case PACKET_TYPE_VALUE:
+            case PACKET_TYPE_DOUBLE_VALUE:
+                if (onReceivedValueHandler)
+                    onReceivedValueHandler(lastPacket.stringPayload, lastPacket.numberPayload);
+                break;
+            case PACKET_TYPE_BUFFER:
+                if (onReceivedBufferHandler)
+                    onReceivedBufferHandler(lastPacket.bufferPayload);
+                break;
+            case PACKET_TYPE_STRING:
+                if (onReceivedStringHandler)
+                    onReceivedStringHandler(lastPacket.stringPayload);
+                break;
+            case PACKET_TYPE_EVENTS:
+                const n = Math.min(lastPacket.data[PACKET_PREFIX_LENGTH], MAX_EVENTS_PER_PACKET);
+                for (let i = 0; i < n; ++i) {
+                    const off = PACKET_PREFIX_LENGTH + 1 + i * 4;
+                    control.raiseEvent(lastPacket.data.getNumber(NumberFormat.UInt16LE, off),
+                        lastPacket.data.getNumber(NumberFormat.UInt16LE, off + 2));
+                }
+                break;
+        }
+    }
+
+    /**
+     * Internal use only. Raises the events sent with _queueEvent() by other devices.
+     */
+    export function _receiveEvents() {
+        init();
+    }
+
+    /**
+     * Internal use only. Sends an event over radio to neighboring devices, in one packet with the
+     * other events queued until the program yields; a single event goes out with raiseEvent().
+     */
+    export function _queueEvent(src: number, value: number) {
+        if (!queuedEvents) {
+            queuedEvents = [];
+            control.runInParallel(sendQueuedEvents);
+        }
+        queuedEvents.push(src);
+        queuedEvents.push(value);
+    }
+
+    function sendQueuedEvents() {
+        const events = queuedEvents;
+        queuedEvents = undefined;
+        if (events.length == 2) {
+            raiseEvent(events[0], events[1]);
+            return;
+        }
+        for (let start = 0; start < events.length; start += MAX_EVENTS_PER_PACKET * 2) {
+            const packet = RadioPacket.mkPacket(PACKET_TYPE_EVENTS);
+            const n = Math.min(events.length - start, MAX_EVENTS_PER_PACKET * 2) >> 1;
+            packet.data[PACKET_PREFIX_LENGTH] = n;
+            for (let i = 0; i < n * 2; ++i)
+                packet.data.setNumber(NumberFormat.UInt16LE, PACKET_PREFIX_LENGTH + 1 + i * 2, events[start + i]);
+            sendPacket(packet);
         }
     }
 
@@ -182,6 +238,15 @@ namespace radio {
             return this.data.getNumber(NumberFormat.Int32LE, this.data.length - 4);
         }
 
+        /**
+         * The time in ms (as in control.millis()) the packet came in; undefined for packets
+         * made to be sent
+         */
+        get receivedTime() {
+            if (this.data.length < RADIO_RECORD_SIZE) return undefined;
+            return this.data.getNumber(NumberFormat.UInt32LE, this.data.length - 8);
+        }
+
         get packetType() {
             return this.data[0];
         }
@@ -204,7 +269,7 @@ namespace radio {
 
         get stringPayload() {
             const offset = getStringOffset(this.packetType) as number;
-            return offset ? this.data.slice(offset + 1, this.data[offset]).toString() : undefined;
+            return offset ? this.data.sliceToString(offset + 1, this.data[offset]) : undefined;
         }
 
         set stringPayload(val: string) {
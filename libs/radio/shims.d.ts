@@ -16,12 +16,46 @@ declare namespace radio {
     function raiseEvent(src: int32, value: int32): void;
 
     /**
-     * Internal use only. Takes the next packet from the radio queue and returns its contents + RSSI in a Buffer.
+     * Internal use only. Takes the next packet from the radio queue and returns its contents,
+     * receive time and RSSI in a Buffer.
      * @returns NULL if no packet available
      */
     //% shim=radio::readRawPacket
     function readRawPacket(): Buffer;
 
+    /**
+     * Internal use only. Takes all packets from the radio queue and returns them one after
+     * another in a Buffer, in the format of readRawPacket().
+     * @returns NULL if no packet available
+     */
+    //% shim=radio::readAll
+    function readAll(): Buffer;
+
+    /**
+     * Set how many received packets are kept until the program reads them; the oldest ones are
+     * dropped when more come in. Packets already received are discarded.
+     * @param size the number of packets, eg: 8
+     */
+    //% help=radio/set-receive-queue-size
+    //% advanced=true shim=radio::setReceiveQueueSize
+    function setReceiveQueueSize(size: int32): void;
+
+    /**
+     * Drop packets identical to one received less than the given time ago, eg. the same packet
+     * relayed by several devices. Off (0) by default.
+     * @param window the time in ms, or 0 to keep all packets, eg: 1000
+     */
+    //% help=radio/set-duplicate-filter
+    //% advanced=true shim=radio::setDuplicateFilter
+    function setDuplicateFilter(window: int32): void;
+
+    /**
+     * Number of received packets dropped because the receive queue was full.
+     */
+    //% help=radio/dropped-packets
+    //% advanced=true shim=radio::droppedPackets
+    function droppedPackets(): int32;
+
     /**
      * Internal use only. Sends a raw packet through the radio (assumes RSSI appened to packet)
      */
@@ -30,22 +30,62 @@ namespace pxsim.radio {
         setTimeout(cb, 1);
     }
 
+    const MAX_PACKET_SIZE = 32;
+    const RECORD_SIZE = MAX_PACKET_SIZE + 8;
+
+    // the packet padded to the maximum size, receive time, RSSI
+    function writeRecord(data: Uint8Array, off: number, packet: PacketBuffer) {
+        const buf = packet.payload.bufferData;
+        data.set(buf.length > MAX_PACKET_SIZE ? buf.subarray(0, MAX_PACKET_SIZE) : buf, off);
+        const view = new DataView(data.buffer, data.byteOffset + off);
+        view.setUint32(MAX_PACKET_SIZE, packet.receivedTime || 0, true);
+        view.setInt32(MAX_PACKET_SIZE + 4, packet.rssi, true);
+    }
+
     export function readRawPacket() {
         const state = pxsim.getRadioState();
         const packet = state.datagram.recv();
-        const buf = packet.payload.bufferData;
-        const n = buf.length;
-        if (!n)
+        if (!packet.payload.bufferData.length)
             return undefined;
 
-        const rbuf = BufferMethods.createBuffer(n + 4);
-        for(let i = 0; i < buf.length; ++i)
-            rbuf.data[i] = buf[i];
-        // append RSSI
-        BufferMethods.setNumber(rbuf, BufferMethods.NumberFormat.Int32LE, n, packet.rssi)
+        const rbuf = BufferMethods.createBuffer(RECORD_SIZE);
+        writeRecord(rbuf.data, 0, packet);
         return rbuf;
     }
 
+    export function readAll() {
+        const state = pxsim.getRadioState();
+        const packets: PacketBuffer[] = [];
+        for (;;) {
+            const packet = state.datagram.recv();
+            if (!packet.payload.bufferData.length)
+                break;
+            packets.push(packet);
+        }
+        if (!packets.length)
+            return undefined;
+
+        const rbuf = BufferMethods.createBuffer(packets.length * RECORD_SIZE);
+        packets.forEach((p, i) => writeRecord(rbuf.data, i * RECORD_SIZE, p));
+        return rbuf;
+    }
+
+    export function setReceiveQueueSize(size: number) {
+        if (size < 1) return;
+        const state = pxsim.getRadioState();
+        state.datagram.capacity = size | 0;
+        state.datagram.datagram = [];
+    }
+
+    export function setDuplicateFilter(window: number) {
+        const state = pxsim.getRadioState();
+        state.datagram.dedupWindow = Math.max(0, window | 0);
+    }
+
+    export function droppedPackets() {
+        return pxsim.getRadioState().datagram.dropped;
+    }
+
     export function onDataReceived(handler: RefAction): void {
         const state = pxsim.getRadioState();
         state.datagram.onReceived(handler);
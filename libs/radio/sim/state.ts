@@ -12,6 +12,7 @@ namespace pxsim {
         rssi: number;
         serial: number;
         time: number;
+        receivedTime?: number;
     }
 
     // Extends interface in pxt-core
@@ -27,6 +28,10 @@ namespace pxsim {
     export class RadioDatagram {
         datagram: PacketBuffer[] = [];
         lastReceived: PacketBuffer = RadioDatagram.defaultPacket();
+        capacity = 8;
+        dropped = 0;
+        dedupWindow = 0;
+        private recent: { key: string; time: number }[] = [];
         // this value is unset until the user decide to set the RSSI via the simulator UI
         private _rssi: number;
 
@@ -43,11 +48,33 @@ namespace pxsim {
         }
 
         queue(packet: PacketBuffer) {
-            if (this.datagram.length < 4)
-                this.datagram.push(packet);
+            const now = runtime.runningTime();
+            if (this.isDuplicate(packet, now))
+                return;
+            if (this.datagram.length >= this.capacity) {
+                // keep the newest ones
+                this.datagram.shift();
+                this.dropped++;
+            }
+            this.datagram.push(packet);
+            packet.receivedTime = now;
             (<EventBusBoard>runtime.board).bus.queue(this.dal.ID_RADIO, this.dal.RADIO_EVT_DATAGRAM);
         }
 
+        private isDuplicate(packet: PacketBuffer, now: number) {
+            if (!this.dedupWindow)
+                return false;
+            const data = packet.payload.bufferData || new Uint8Array(0);
+            const key = Array.prototype.join.call(data.subarray(0, 32), ",");
+            this.recent = this.recent.filter(r => now - r.time < this.dedupWindow);
+            if (this.recent.some(r => r.key == key))
+                return true;
+            this.recent.push({ key, time: now });
+            if (this.recent.length > 16)
+                this.recent.shift();
+            return false;
+        }
+
         send(payload: SimulatorRadioPacketPayload) {
             const state = getRadioState();
             Runtime.postMessage(<SimulatorRadioPacketMessage>{
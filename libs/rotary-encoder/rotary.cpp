@@ -4,16 +4,28 @@
 #define ROT_EV_TIMER 0x1233
 #define ROT_EV_CHANGED 0x2233
 
+// changes are raised at most this often; the position is read when the handler runs anyway
+#define ROT_EVENT_MIN_US 10000
+
 const static int8_t posMap[] = {0, +1, -1, +2, -1, 0, -2, +1, +1, -2, 0, -1, +2, -1, +1, 0};
 
+#ifdef NRF52_SERIES
+// there is a single hardware decoder, which the first encoder gets
+static bool qdecUsed;
+#endif
+
 class RotaryEncoder_ {
   public:
     uint16_t id;
     uint16_t state;
+    // in quarter steps
     int position;
+    int reportedPosition;
+    uint64_t lastReport;
+    bool hardware;
     Pin &pinA, &pinB;
 
-    void process(Event) {
+    void decode() {
         // based on comments in https://github.com/PaulStoffregen/Encoder/blob/master/Encoder.h
         uint16_t s = state & 3;
         if (pinA.getDigitalValue())
@@ -22,22 +34,63 @@ class RotaryEncoder_ {
             s |= 8;
 
         state = (s >> 2);
-        if (posMap[s]) {
-            int lastPosition = position;
-            position += posMap[s];
-            if ((lastPosition >> 2) != (position >> 2)) {
+        position += posMap[s];
+    }
+
+    void process(Event) {
+#ifdef NRF52_SERIES
+        if (hardware) {
+            // the decoder counts every transition, at 8 times the rate we poll at
+            NRF_QDEC->TASKS_READCLRACC = 1;
+            position += (int32_t)NRF_QDEC->ACCREAD;
+        } else
+#endif
+            decode();
+
+        if ((reportedPosition >> 2) != (position >> 2)) {
+            auto now = system_timer_current_time_us();
+            if (now - lastReport >= ROT_EVENT_MIN_US) {
+                reportedPosition = position;
+                lastReport = now;
                 Event ev(id, ROT_EV_CHANGED);
             }
         }
     }
 
+    bool startHardware() {
+#ifdef NRF52_SERIES
+        if (qdecUsed)
+            return false;
+        qdecUsed = true;
+        NRF_QDEC->ENABLE = 0;
+        NRF_QDEC->PSEL.A = pinA.name;
+        NRF_QDEC->PSEL.B = pinB.name;
+        NRF_QDEC->PSEL.LED = 0xFFFFFFFF; // disconnected
+        NRF_QDEC->SAMPLEPER = QDEC_SAMPLEPER_SAMPLEPER_128us;
+        NRF_QDEC->DBFEN = 1;
+        NRF_QDEC->SHORTS = 0;
+        NRF_QDEC->INTENCLR = 0xFFFFFFFF;
+        NRF_QDEC->ENABLE = 1;
+        NRF_QDEC->TASKS_START = 1;
+        return true;
+#else
+        // the PDEC of the SAMD51 and the encoder mode of the STM32 timers only work on a few
+        // pins each
+        return false;
+#endif
+    }
+
     RotaryEncoder_(Pin &pinA, Pin &pinB) : pinA(pinA), pinB(pinB) {
         position = 0;
+        reportedPosition = 0;
+        lastReport = 0;
         id = pinA.id;
 
         pinA.setPull(codal::PullMode::Up);
         pinB.setPull(codal::PullMode::Up);
 
+        hardware = startHardware();
+
         // don't do exactly 1000us, so that it doesn't occur exactly at scheduler ticks
         system_timer_event_every_us(973, id, ROT_EV_TIMER);
         EventModel::defaultEventBus->listen(id, ROT_EV_TIMER, this, &RotaryEncoder_::process,
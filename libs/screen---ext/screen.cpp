@@ -1,6 +1,20 @@
 #include "pxt.h"
 
+#include <atomic>
+
 namespace pxt {
+
+// A frame as handed over by pxt_screen_get_frame()
+struct FrameSlot {
+    uint32_t seq;
+    uint32_t palette[16];
+    uint8_t *pixels;
+};
+
+// Triple buffer: update() fills slots[back] and swaps it with the middle one, the reader swaps
+// the middle one with slots[front] when it holds a new frame; the pairs never share a slot.
+#define FRAME_FRESH 4 // in middle, when the slot it points to has not been taken yet
+
 class WDisplay {
   public:
     uint32_t currPalette[16];
@@ -9,9 +23,15 @@ class WDisplay {
 
     int width, height;
 
+    FrameSlot slots[3];
+    int back, front;
+    std::atomic<uint32_t> middle;
+    uint32_t frameSeq;
+
     WDisplay();
     void updateLoop();
     void update(Image_ img);
+    void publish(Image_ img);
 };
 
 SINGLETON(WDisplay);
@@ -22,6 +42,17 @@ WDisplay::WDisplay() {
     DMESG("init display: %dx%d", width, height);
     screenBuf = new uint8_t[width * height / 2 + 20];
     newPalette = false;
+    memset(currPalette, 0, sizeof(currPalette));
+
+    for (int i = 0; i < 3; ++i) {
+        slots[i].seq = 0;
+        memset(slots[i].palette, 0, sizeof(slots[i].palette));
+        slots[i].pixels = new uint8_t[width * (((height * 4 + 31) >> 5) << 2)];
+    }
+    back = 0;
+    middle = 1;
+    front = 2;
+    frameSeq = 0;
 }
 
 //% expose
@@ -43,9 +74,12 @@ void setPalette(Buffer buf) {
         uint8_t r = buf->data[i * 3];
         uint8_t g = buf->data[i * 3 + 1];
         uint8_t b = buf->data[i * 3 + 2];
-        display->currPalette[i] = (0xff << 24) | (r << 16) | (g << 8) | (b << 0);
+        uint32_t c = (0xff << 24) | (r << 16) | (g << 8) | (b << 0);
+        if (display->currPalette[i] != c) {
+            display->currPalette[i] = c;
+            display->newPalette = true;
+        }
     }
-    display->newPalette = true;
 }
 
 static pthread_mutex_t screenMutex;
@@ -97,6 +131,42 @@ DLLEXPORT void pxt_screen_get_pixels(int width, int height, uint32_t *screen) {
     pthread_mutex_unlock(&screenMutex);
 }
 
+/**
+ * Get the last frame drawn, without converting it or waiting for it. Pixels are 4bpp, column by
+ * column from the top-left corner, with columns of ((height * 4 + 31) / 32) * 4 bytes and the
+ * first pixel in the low nibble, as in Image; the palette has 16 0xAARRGGBB colors.
+ * The pointers stay valid until the next call, from any single thread at a time; returns the
+ * sequence number of the frame, starting at 1, or 0 when nothing was drawn yet.
+ */
+DLLEXPORT uint32_t pxt_screen_get_frame(int *width, int *height, const uint8_t **pixels,
+                                        const uint32_t **palette) {
+    auto disp = instWDisplay;
+    if (!disp) {
+        *width = *height = 0;
+        *pixels = NULL;
+        *palette = NULL;
+        return 0;
+    }
+
+    if (disp->middle.load(std::memory_order_relaxed) & FRAME_FRESH)
+        disp->front = disp->middle.exchange(disp->front, std::memory_order_acq_rel) & 3;
+
+    auto slot = &disp->slots[disp->front];
+    *width = disp->width;
+    *height = disp->height;
+    *pixels = slot->pixels;
+    *palette = slot->palette;
+    return slot->seq;
+}
+
+void WDisplay::publish(Image_ img) {
+    auto slot = &slots[back];
+    memcpy(slot->pixels, img->pix(), img->pixLength());
+    memcpy(slot->palette, currPalette, sizeof(slot->palette));
+    slot->seq = ++frameSeq;
+    back = middle.exchange(back | FRAME_FRESH, std::memory_order_acq_rel) & 3;
+}
+
 void WDisplay::update(Image_ img) {
     if (!img)
         return;
@@ -104,6 +174,8 @@ void WDisplay::update(Image_ img) {
     if (img->bpp() != 4 || img->width() != width || img->height() != height)
         target_panic(PANIC_SCREEN_ERROR);
 
+    publish(img);
+
     pthread_mutex_lock(&screenMutex);
     // if the data have not been picked up, but it had been in the past, wait
     if (dataWaiting && numGetPixels)
@@ -11,10 +11,49 @@
 #include <sys/ioctl.h>
 #include <pthread.h>
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
 namespace pxt {
+// frame time histograms, in 1ms buckets with the last one for anything longer; the layout of the
+// buffer returned by frameStats()
+#define FRAME_HIST_BUCKETS 32
+struct FrameStats {
+    uint32_t frames;
+    // frames presented without waiting for vsync, because they were a frame period late
+    uint32_t missed;
+    // between two updates of the screen: the program drawing the frame
+    uint32_t render[FRAME_HIST_BUCKETS];
+    // copying and converting the screen into the framebuffer
+    uint32_t copy[FRAME_HIST_BUCKETS];
+    // from the update to the frame being shown
+    uint32_t present[FRAME_HIST_BUCKETS];
+};
+
+static void addSample(uint32_t *hist, uint64_t us) {
+    hist[min((int)(us / 1000), FRAME_HIST_BUCKETS - 1)]++;
+}
+
+// first bucket with pct percent of the samples up to it
+static int percentile(const uint32_t *hist, uint32_t total, int pct) {
+    uint32_t sum = 0;
+    for (int i = 0; i < FRAME_HIST_BUCKETS; ++i) {
+        sum += hist[i];
+        if (sum * 100 >= total * pct)
+            return i;
+    }
+    return FRAME_HIST_BUCKETS - 1;
+}
+
 class WDisplay {
   public:
-    uint32_t currPalette[16];
+    // 16 entries for 4bpp screens, 256 for 8bpp ones; unused for 16bpp ones
+    uint32_t currPalette[256];
+    // byte k of each of the first 16 entries in palBytes[k], for table lookups
+    uint8_t palBytes[4][16];
     bool newPalette;
     volatile bool painted;
     volatile bool dirty;
@@ -22,7 +61,17 @@ class WDisplay {
     uint8_t *screenBuf;
     Image_ lastImg;
 
-    int width, height;
+    int width, height, bpp;
+    // bytes per column of a 4bpp screen
+    int colBytes;
+
+    // the screen as last painted, the columns of screenBuf written since, and per tile of 8
+    // columns whether each framebuffer page is out of date
+    uint8_t *lastBuf;
+    int changedX0, changedX1;
+    int numTiles;
+    uint8_t *damage[2];
+    bool repaintAll;
 
     int fb_fd;
     uint32_t *fbuf;
@@ -34,9 +83,20 @@ class WDisplay {
     int is32Bit;
 
     pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    FrameStats stats;
+    // end of the previous update(), the last one signalled and the copy time it took
+    uint64_t lastUpdateEnd, updateTime;
+    uint32_t updateCopy;
 
     WDisplay();
     void updateLoop();
+    void expandRow(const uint8_t *idx, int n, int scale, uint8_t *dst);
+    void paint(uint8_t *page, int offx, int offy, int scale, int x0, int x1);
+    void paintWide(uint8_t *page, int offx, int offy, int scale, int x0, int x1);
+    bool takeChanges();
+    void logStats();
     void update(Image_ img);
 };
 
@@ -76,7 +136,14 @@ void WDisplay::updateLoop() {
     }
 
     int screensize = finfo.line_length * vinfo.yres;
-    uint32_t skip = offx;
+
+    // SCREEN_FPS paces presenting; SCREEN_STATS_LOG logs frame statistics every that many seconds
+    int fps = getConfigInt("SCREEN_FPS", 30);
+    if (fps < 1)
+        fps = 1;
+    uint64_t period = 1000000 / fps;
+    uint64_t nextPresent = 0;
+    int logFrames = getConfigInt("SCREEN_STATS_LOG", 0) * fps;
 
     if (sx > 1)
         offx &= ~1;
@@ -88,106 +155,342 @@ void WDisplay::updateLoop() {
     if (numPages == 1)
         cur_page = 0;
 
+    pthread_mutex_lock(&mutex);
     dirty = true;
+    pthread_mutex_unlock(&mutex);
 
     DMESG("loop");
 
     for (;;) {
-        auto start0 = current_time_us();
-
+        pthread_mutex_lock(&mutex);
         while (!dirty)
-            sleep_core_us(2000);
+            pthread_cond_wait(&cond, &mutex);
 
-        // auto start = current_time_us();
-        // DMESG("update");
+        auto start = current_time_us();
+        auto updated = updateTime;
+        uint64_t copy = updateCopy;
+        updateCopy = 0;
 
-        pthread_mutex_lock(&mutex);
         dirty = false;
 
-        if (!is32Bit) {
-            uint16_t *dst =
-                (uint16_t *)fbuf + cur_page * screensize / 2 + offx + offy * finfo.line_length / 2;
-            if (sx == 1 && sy == 1) {
-                skip = vinfo.xres - width * sx;
-                for (int yy = 0; yy < height; yy++) {
-                    auto shift = yy & 1 ? 4 : 0;
-                    auto src = screenBuf + yy / 2;
-                    for (int xx = 0; xx < width; ++xx) {
-                        int c = this->currPalette[(*src >> shift) & 0xf];
-                        src += height / 2;
-                        *dst++ = c;
-                    }
-                    dst += skip;
-                }
-            } else {
-                uint32_t *d2 = (uint32_t *)dst;
-                for (int yy = 0; yy < height; yy++) {
-                    auto shift = yy & 1 ? 4 : 0;
-                    for (int i = 0; i < sy; ++i) {
-                        auto src = screenBuf + yy / 2;
-                        for (int xx = 0; xx < width; ++xx) {
-                            int c = this->currPalette[(*src >> shift) & 0xf];
-                            src += height / 2;
-                            for (int j = 0; j < sx / 2; ++j)
-                                *d2++ = c;
-                        }
-                        d2 += skip;
-                    }
-                }
-            }
-        } else {
-            uint32_t *d2 =
-                (uint32_t *)fbuf + cur_page * screensize / 4 + offx + offy * finfo.line_length / 4;
-            skip = vinfo.xres - width * sx;
-            for (int yy = 0; yy < height; yy++) {
-                auto shift = yy & 1 ? 4 : 0;
-                for (int i = 0; i < sy; ++i) {
-                    auto src = screenBuf + yy / 2;
-                    for (int xx = 0; xx < width; ++xx) {
-                        int c = this->currPalette[(*src >> shift) & 0xf];
-                        src += height / 2;
-                        for (int j = 0; j < sx; ++j)
-                            *d2++ = c;
-                    }
-                    d2 += skip;
+        bool changed = takeChanges();
+        if (repaintAll) {
+            repaintAll = false;
+            memset(damage[0], 1, numTiles);
+            memset(damage[1], 1, numTiles);
+            changed = true;
+        }
+
+        // bring the back page up to date, in runs of damaged tiles
+        if (changed) {
+            auto page = (uint8_t *)fbuf + cur_page * screensize;
+            auto dmg = damage[cur_page];
+            for (int t = 0; t < numTiles;) {
+                if (!dmg[t]) {
+                    t++;
+                    continue;
                 }
+                int x0 = t * 8;
+                while (t < numTiles && dmg[t])
+                    dmg[t++] = 0;
+                int x1 = min(width, t * 8);
+                if (bpp != 4)
+                    paintWide(page, offx, offy, sx, x0, x1);
+                else
+                    paint(page, offx, offy, sx, x0, x1);
             }
         }
 
         pthread_mutex_unlock(&mutex);
 
-        // auto len = current_time_us() - start;
-
         painted = true;
         raiseEvent(DEVICE_ID_NOTIFY_ONE, eventId);
 
+        // same pixels as on the displayed page
+        if (!changed)
+            continue;
+
+        copy += current_time_us() - start;
+
+        // present at most every period; adaptive vsync: a frame a whole period late is shown at
+        // once instead of waiting for the next vsync
+        auto now = current_time_us();
+        if (now < nextPresent)
+            sleep_core_us(nextPresent - now);
+        bool late = nextPresent && now >= nextPresent + period;
+
         vinfo.yoffset = cur_page * vinfo.yres;
         ioctl(fb_fd, FBIOPAN_DISPLAY, &vinfo);
-        ioctl(fb_fd, FBIO_WAITFORVSYNC, 0);
+        if (!late)
+            ioctl(fb_fd, FBIO_WAITFORVSYNC, 0);
         if (numPages > 1)
             cur_page = !cur_page;
         frameNo++;
 
-        auto fulllen = current_time_us() - start0;
-        // throttle it to 40fps (really 30fps)
-        if (fulllen < 25000) {
-            ioctl(fb_fd, FBIO_WAITFORVSYNC, 0);
+        now = current_time_us();
+        nextPresent = late || !nextPresent ? now + period : nextPresent + period;
+
+        pthread_mutex_lock(&mutex);
+        stats.frames++;
+        if (late)
+            stats.missed++;
+        addSample(stats.copy, copy);
+        addSample(stats.present, now - updated);
+        pthread_mutex_unlock(&mutex);
+
+        if (logFrames && frameNo % logFrames == 0)
+            logStats();
+    }
+}
+
+void WDisplay::logStats() {
+    auto n = stats.frames;
+    if (!n)
+        return;
+    DMESG("frames:%d missed:%d render:%d/%dms copy:%d/%dms present:%d/%dms (median/95%%)", n,
+          stats.missed, percentile(stats.render, n, 50), percentile(stats.render, n, 95),
+          percentile(stats.copy, n, 50), percentile(stats.copy, n, 95),
+          percentile(stats.present, n, 50), percentile(stats.present, n, 95));
+}
+
+#if defined(__ARM_NEON)
+// tab[v[i]] for 16 indices below 16
+static inline uint8x16_t lookup16(const uint8_t *tab, uint8x16_t v) {
+#ifdef __aarch64__
+    return vqtbl1q_u8(vld1q_u8(tab), v);
+#else
+    uint8x8x2_t t = {{vld1_u8(tab), vld1_u8(tab + 8)}};
+    return vcombine_u8(vtbl2_u8(t, vget_low_u8(v)), vtbl2_u8(t, vget_high_u8(v)));
+#endif
+}
+#endif
+
+// the framebuffer pixels of n palette indices, each repeated scale times; 16 pixels at a time with
+// table lookups when NEON or SSSE3 is available, for scale 1 and 2
+void WDisplay::expandRow(const uint8_t *idx, int n, int scale, uint8_t *dst) {
+    int i = 0;
+#if defined(__ARM_NEON)
+    if (scale <= 2) {
+        for (; i + 16 <= n; i += 16) {
+            auto v = vld1q_u8(idx + i);
+            auto b0 = lookup16(palBytes[0], v);
+            auto b1 = lookup16(palBytes[1], v);
+            if (!is32Bit) {
+                if (scale == 1) {
+                    uint8x16x2_t px = {{b0, b1}};
+                    vst2q_u8(dst, px);
+                    dst += 32;
+                } else {
+                    uint8x16x4_t px = {{b0, b1, b0, b1}};
+                    vst4q_u8(dst, px);
+                    dst += 64;
+                }
+                continue;
+            }
+            auto b2 = lookup16(palBytes[2], v);
+            auto b3 = lookup16(palBytes[3], v);
+            if (scale == 1) {
+                uint8x16x4_t px = {{b0, b1, b2, b3}};
+                vst4q_u8(dst, px);
+                dst += 64;
+            } else {
+                auto d0 = vzipq_u8(b0, b0), d1 = vzipq_u8(b1, b1);
+                auto d2 = vzipq_u8(b2, b2), d3 = vzipq_u8(b3, b3);
+                uint8x16x4_t lo = {{d0.val[0], d1.val[0], d2.val[0], d3.val[0]}};
+                uint8x16x4_t hi = {{d0.val[1], d1.val[1], d2.val[1], d3.val[1]}};
+                vst4q_u8(dst, lo);
+                vst4q_u8(dst + 64, hi);
+                dst += 128;
+            }
         }
+    }
+#elif defined(__SSSE3__)
+    if (scale <= 2) {
+        auto t0 = _mm_loadu_si128((const __m128i *)palBytes[0]);
+        auto t1 = _mm_loadu_si128((const __m128i *)palBytes[1]);
+        auto t2 = _mm_loadu_si128((const __m128i *)palBytes[2]);
+        auto t3 = _mm_loadu_si128((const __m128i *)palBytes[3]);
+        for (; i + 16 <= n; i += 16) {
+            auto v = _mm_loadu_si128((const __m128i *)(idx + i));
+            auto b0 = _mm_shuffle_epi8(t0, v);
+            auto b1 = _mm_shuffle_epi8(t1, v);
+            // pixels 0-7 and 8-15, 16 bits each
+            __m128i px[4] = {_mm_unpacklo_epi8(b0, b1), _mm_unpackhi_epi8(b0, b1)};
+            int cnt = 2;
+            if (is32Bit) {
+                auto b2 = _mm_shuffle_epi8(t2, v);
+                auto b3 = _mm_shuffle_epi8(t3, v);
+                auto lo = _mm_unpacklo_epi8(b2, b3), hi = _mm_unpackhi_epi8(b2, b3);
+                px[3] = _mm_unpackhi_epi16(px[1], hi);
+                px[2] = _mm_unpacklo_epi16(px[1], hi);
+                px[1] = _mm_unpackhi_epi16(px[0], lo);
+                px[0] = _mm_unpacklo_epi16(px[0], lo);
+                cnt = 4;
+            }
+            for (int k = 0; k < cnt; ++k) {
+                if (scale == 1) {
+                    _mm_storeu_si128((__m128i *)dst, px[k]);
+                    dst += 16;
+                    continue;
+                }
+                auto a = is32Bit ? _mm_unpacklo_epi32(px[k], px[k])
+                                 : _mm_unpacklo_epi16(px[k], px[k]);
+                auto b = is32Bit ? _mm_unpackhi_epi32(px[k], px[k])
+                                 : _mm_unpackhi_epi16(px[k], px[k]);
+                _mm_storeu_si128((__m128i *)dst, a);
+                _mm_storeu_si128((__m128i *)(dst + 16), b);
+                dst += 32;
+            }
+        }
+    }
+#endif
+
+    if (is32Bit) {
+        auto d = (uint32_t *)dst;
+        for (; i < n; ++i)
+            for (int j = 0; j < scale; ++j)
+                *d++ = currPalette[idx[i]];
+    } else {
+        auto d = (uint16_t *)dst;
+        for (; i < n; ++i)
+            for (int j = 0; j < scale; ++j)
+                *d++ = currPalette[idx[i]];
+    }
+}
+
+// 4bpp screens are column-major, with 8 rows in every word; each band of 8 rows of columns x0..x1
+// is transposed into rows of palette indices, reading every column once, then the rows are
+// expanded, horizontally into the framebuffer and vertically by copying
+void WDisplay::paint(uint8_t *page, int offx, int offy, int scale, int x0, int x1) {
+    int pixBytes = is32Bit ? 4 : 2;
+    int n = x1 - x0;
+    uint8_t idx[8][n];
+
+    for (int y0 = 0; y0 < height; y0 += 8) {
+        int rows = min(8, height - y0);
+        auto src = screenBuf + x0 * colBytes + (y0 >> 1);
+        for (int xx = 0; xx < n; ++xx, src += colBytes) {
+            uint32_t v;
+            memcpy(&v, src, 4);
+            for (int r = 0; r < rows; ++r, v >>= 4)
+                idx[r][xx] = v & 0xf;
+        }
+
+        for (int r = 0; r < rows; ++r) {
+            auto dst = page + (offy + (y0 + r) * scale) * finfo.line_length +
+                       (offx + x0 * scale) * pixBytes;
+            expandRow(idx[r], n, scale, dst);
+            for (int i = 1; i < scale; ++i)
+                memcpy(dst + i * finfo.line_length, dst, n * scale * pixBytes);
+        }
+    }
+}
+
+// 8bpp and 16bpp screens are row-major, so every row is converted in one go; a 16bpp screen on a
+// 16 bit framebuffer is copied as is
+void WDisplay::paintWide(uint8_t *page, int offx, int offy, int scale, int x0, int x1) {
+    int pixBytes = is32Bit ? 4 : 2;
+    int ps = bpp >> 3;
+    int n = x1 - x0;
+    uint32_t line[n];
+
+    for (int yy = 0; yy < height; yy++) {
+        auto src = screenBuf + (yy * width + x0) * ps;
+        auto dst = page + (offy + yy * scale) * finfo.line_length + (offx + x0 * scale) * pixBytes;
+
+        if (bpp == 16 && !is32Bit && scale == 1) {
+            memcpy(dst, src, n * 2);
+            continue;
+        }
+
+        for (int xx = 0; xx < n; ++xx) {
+            if (bpp == 8) {
+                line[xx] = currPalette[src[xx]];
+            } else {
+                uint32_t c = ((uint16_t *)src)[xx];
+                if (is32Bit)
+                    c = ((c & 0xf800) << 8) | ((c & 0x07e0) << 5) | ((c & 0x001f) << 3);
+                line[xx] = c;
+            }
+        }
+
+        if (is32Bit) {
+            auto d = (uint32_t *)dst;
+            for (int xx = 0; xx < n; ++xx)
+                for (int j = 0; j < scale; ++j)
+                    *d++ = line[xx];
+        } else {
+            auto d = (uint16_t *)dst;
+            for (int xx = 0; xx < n; ++xx)
+                for (int j = 0; j < scale; ++j)
+                    *d++ = line[xx];
+        }
+        for (int i = 1; i < scale; ++i)
+            memcpy(dst + i * finfo.line_length, dst, n * scale * pixBytes);
+    }
+}
 
-        // auto tot = current_time_us() - start;
-        // if (frameNo % 37 == 0)
-        //    DMESG("copy %d us, tot %d us delay %d us",  (int)len, (int)tot, (int)(start-start0));
+// compare the tiles of 8 columns changed by update() against the last presented screen, marking
+// the ones that differ as damaged on both pages; returns true if any did
+bool WDisplay::takeChanges() {
+    bool any = false;
+    int ps = bpp >> 3;
+    for (int t = changedX0 >> 3; t < numTiles && t * 8 < changedX1; ++t) {
+        int x0 = t * 8, n = min(8, width - x0);
+        bool changed = false;
+        if (bpp == 4) {
+            int off = x0 * colBytes;
+            if (memcmp(lastBuf + off, screenBuf + off, n * colBytes)) {
+                memcpy(lastBuf + off, screenBuf + off, n * colBytes);
+                changed = true;
+            }
+        } else {
+            for (int yy = 0; yy < height; ++yy) {
+                int off = (yy * width + x0) * ps;
+                if (memcmp(lastBuf + off, screenBuf + off, n * ps)) {
+                    memcpy(lastBuf + off, screenBuf + off, n * ps);
+                    changed = true;
+                }
+            }
+        }
+        if (changed) {
+            damage[0][t] = damage[1][t] = 1;
+            any = true;
+        }
     }
+    changedX0 = width;
+    changedX1 = 0;
+    return any;
 }
 
 WDisplay::WDisplay() {
     pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+    memset(&stats, 0, sizeof(stats));
+    lastUpdateEnd = updateTime = 0;
+    updateCopy = 0;
 
     width = getConfig(CFG_DISPLAY_WIDTH, 160);
     height = getConfig(CFG_DISPLAY_HEIGHT, 128);
-    screenBuf = new uint8_t[width * height / 2 + 20];
+    bpp = getConfigInt("SCREEN_BPP", 4);
+    if (bpp != 8 && bpp != 16)
+        bpp = 4;
+    // whole words per column, as in the image
+    colBytes = ((height * 4 + 31) >> 5) << 2;
+    int bufSize = (bpp == 4 ? width * colBytes : width * height * bpp / 8) + 20;
+    screenBuf = (uint8_t *)xmalloc_tagged(bufSize, MallocTag::Screen);
+    lastBuf = (uint8_t *)xmalloc_tagged(bufSize, MallocTag::Screen);
+    memset(lastBuf, 0, bufSize);
+    changedX0 = width;
+    changedX1 = 0;
+    numTiles = (width + 7) >> 3;
+    damage[0] = (uint8_t *)xmalloc_tagged(numTiles, MallocTag::Screen);
+    damage[1] = (uint8_t *)xmalloc_tagged(numTiles, MallocTag::Screen);
+    repaintAll = true;
     lastImg = NULL;
     newPalette = false;
+    memset(currPalette, 0, sizeof(currPalette));
+    memset(palBytes, 0, sizeof(palBytes));
 
     registerGC((TValue *)&lastImg);
 
@@ -245,23 +548,33 @@ void setScreenBrightness(int level) {
 //%
 void setPalette(Buffer buf) {
     auto display = getWDisplay();
-    if (48 != buf->length)
+    if (48 != buf->length && 768 != buf->length)
         target_panic(PANIC_SCREEN_ERROR);
-    for (int i = 0; i < 16; ++i) {
+    // 4bpp images drawn on a 16bpp screen get the first 16 colors
+    setImagePalette(buf->data, 16);
+    for (int i = 0; i < (int)buf->length / 3; ++i) {
         uint8_t r = buf->data[i * 3];
         uint8_t g = buf->data[i * 3 + 1];
         uint8_t b = buf->data[i * 3 + 2];
+        uint32_t c;
         if (display->is32Bit) {
-            display->currPalette[i] = (r << 16) | (g << 8) | (b << 0);
+            c = (r << 16) | (g << 8) | (b << 0);
         } else {
             r >>= 3;
             g >>= 2;
             b >>= 3;
             uint16_t cc = (r << 11) | (g << 5) | (b << 0);
-            display->currPalette[i] = (cc << 16) | cc;
+            c = (cc << 16) | cc;
         }
+        // games tend to set the same palette again and again; that shouldn't repaint everything
+        if (display->currPalette[i] == c)
+            continue;
+        display->currPalette[i] = c;
+        if (i < 16)
+            for (int k = 0; k < 4; ++k)
+                display->palBytes[k][i] = c >> (8 * k);
+        display->newPalette = true;
     }
-    display->newPalette = true;
 }
 
 void WDisplay::update(Image_ img) {
@@ -271,9 +584,16 @@ void WDisplay::update(Image_ img) {
     img = lastImg;
 
     if (img) {
-        if (img->bpp() != 4 || img->width() != width || img->height() != height)
+        if (img->bpp() != bpp || img->width() != width || img->height() != height)
             target_panic(PANIC_SCREEN_ERROR);
 
+        // only copy the columns that changed, and skip conversion when nothing did
+        int x, y, w, h;
+        if (!takeDirtyRect(img, &x, &y, &w, &h) && !newPalette)
+            return;
+
+        auto start = current_time_us();
+
         if (!painted) {
             // race is possible (though very unlikely), but in such case we just
             // wait for next frame paint
@@ -282,20 +602,56 @@ void WDisplay::update(Image_ img) {
         painted = false;
 
         pthread_mutex_lock(&mutex);
+        if (lastUpdateEnd)
+            addSample(stats.render, start - lastUpdateEnd);
         dirty = true;
         if (newPalette) {
             newPalette = false;
+            repaintAll = true;
+        }
+        changedX0 = min(changedX0, x);
+        changedX1 = max(changedX1, x + w);
+        if (bpp != 4) {
+            // rows of a row-major image
+            auto rb = img->rowBytes();
+            memcpy(screenBuf + y * rb, img->pix(0, y), h * rb);
+        } else {
+            auto bh = img->byteHeight();
+            memcpy(screenBuf + x * bh, img->pix(x, 0), w * bh);
         }
-        memcpy(screenBuf, img->pix(), img->pixLength());
+        lastUpdateEnd = current_time_us();
+        updateCopy += lastUpdateEnd - start;
+        updateTime = start;
+        pthread_cond_signal(&cond);
         pthread_mutex_unlock(&mutex);
     }
 }
 
+//%
+int screenBpp() {
+    return getWDisplay()->bpp;
+}
+
 //%
 void updateScreen(Image_ img) {
+    PXT_TRACE_SPAN(ScreenUpdate, img ? img->width() : 0, img ? img->height() : 0);
     getWDisplay()->update(img);
 }
 
+/**
+ * Frame statistics of the screen (see FrameStats); with reset they start over
+ */
+//%
+Buffer frameStats(bool reset) {
+    auto display = getWDisplay();
+    pthread_mutex_lock(&display->mutex);
+    auto r = mkBuffer((uint8_t *)&display->stats, sizeof(FrameStats));
+    if (reset)
+        memset(&display->stats, 0, sizeof(FrameStats));
+    pthread_mutex_unlock(&display->mutex);
+    return r;
+}
+
 //%
 void updateStats(String msg) {
     // DMESG("render: %s", msg->data);
@@ -125,6 +125,13 @@ declare namespace image {
     //% shim=image::create
     function create(width: int32, height: int32): Image;
 
+    /**
+     * Create new empty image with given bits per pixel: 1, 4, or on hosted targets 8 (256 color
+     * palette) and 16 (RGB565); returns null for other values.
+     */
+    //% shim=image::createWithBpp
+    function createWithBpp(width: int32, height: int32, bpp: int32): Image;
+
     /**
      * Create new image with given content
      */
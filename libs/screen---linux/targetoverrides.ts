@@ -20,12 +20,16 @@ namespace _screen_internal {
     function updateScreen(img: Image): void { }
     //% shim=pxt::updateStats
     function updateStats(msg: string): void { }
+    //% shim=pxt::screenBpp
+    function screenBpp(): number { return 4 }
 
     //% parts="screen"
     export function createScreen() {
-        const img = image.create(
+        // SCREEN_BPP=8 or 16 in the settings selects a 256 color or an RGB565 screen
+        const img = image.createWithBpp(
             control.getConfigValue(DAL.CFG_DISPLAY_WIDTH, 160),
-            control.getConfigValue(DAL.CFG_DISPLAY_HEIGHT, 128))
+            control.getConfigValue(DAL.CFG_DISPLAY_HEIGHT, 128),
+            screenBpp())
 
         control.__screen.setupUpdate(() => updateScreen(img))
         control.EventContext.onStats = function (msg: string) {
@@ -34,4 +38,15 @@ namespace _screen_internal {
 
         return img as ScreenImage;
     }
-}
\ No newline at end of file
+}
+namespace control {
+    /**
+     * Frame statistics of the screen, as UInt32LE numbers: frames shown, frames shown at once
+     * because they were late, then histograms of 32 buckets of 1ms (the last one for anything
+     * longer) of the time between screen updates, copying into the framebuffer, and from
+     * updating the screen to showing it.
+     * @param reset start over after reading them
+     */
+    //% shim=pxt::frameStats
+    export function frameStats(reset?: boolean): Buffer { return null }
+}
@@ -14,6 +14,8 @@ extern "C" {
 #define JD_DISPLAY_FLAGS_ROW_MAJOR 0x01    // this is what's typical on desktop
 // the actual resolution is 2x higher than reported; images will be up-scaled
 #define JD_DISPLAY_FLAGS_RETINA 0x02
+// JD_DISPLAY_CMD_PIXELS_DELTA is supported, and the palette is kept between frames
+#define JD_DISPLAY_FLAGS_DELTA 0x04
 
 typedef struct {
     uint8_t flags;
@@ -27,6 +29,7 @@ typedef struct {
 #define JD_DISPLAY_CMD_PALETTE 0x82
 #define JD_DISPLAY_CMD_PIXELS 0x83
 #define JD_DISPLAY_CMD_SET_BRIGHTNESS 0x84
+#define JD_DISPLAY_CMD_PIXELS_DELTA 0x85
 
 typedef struct {
     uint16_t x;
@@ -43,6 +46,13 @@ typedef struct {
     uint32_t pixels[0];
 } jd_display_pixels_t;
 
+// like JD_DISPLAY_CMD_PIXELS, after leaving the next `skip` columns of the window unchanged
+typedef struct {
+    uint16_t skip;
+    uint16_t reserved;
+    uint32_t pixels[0];
+} jd_display_pixels_delta_t;
+
 #define JD_SERVICE_CLASS_ARCADE_CONTROLS 0x21c35d83
 
 #define JD_ARCADE_CONTROLS_BUTTON_LEFT 0x0001
@@ -79,6 +79,15 @@ JDDisplay::JDDisplay(SPI *spi, Pin *cs, Pin *flow) : spi(spi), cs(cs), flow(flow
     controlsServiceNum = 0;
     buttonState = 0;
     brightness = 100;
+    palette = NULL;
+    dataLeft = 0;
+    displayAdValid = false;
+    shadow = NULL;
+    shadowSize = 0;
+    frameStart = false;
+    shadowPtr = NULL;
+    memset(&shadowAddr, 0, sizeof(shadowAddr));
+    invalidateDisplayState();
     EventModel::defaultEventBus->listen(DEVICE_ID_DISPLAY, 4243, this, &JDDisplay::sendDone);
 
     flow->getDigitalValue(PullMode::Down);
@@ -97,6 +106,13 @@ void JDDisplay::sendDone(Event) {
     Event(DEVICE_ID_DISPLAY, 4242);
 }
 
+// forget what the display shows, so that the next frame is sent in full, with the palette
+void JDDisplay::invalidateDisplayState() {
+    shadowValid = false;
+    paletteValid = false;
+    sentBrightness = 0xff;
+}
+
 void *JDDisplay::queuePkt(uint32_t service_num, uint32_t service_cmd, uint32_t size) {
     void *res = jd_push_in_frame(&sendFrame, service_num, service_cmd, size);
     if (res == NULL)
@@ -127,6 +143,8 @@ void JDDisplay::handleIncoming(jd_packet_t *pkt) {
         pkt->service_command == JD_CMD_ADVERTISEMENT_DATA) {
         uint32_t *servptr = (uint32_t *)pkt->data;
         int numServ = pkt->service_size >> 2;
+        // the display may have been reset, and lost its screen and palette
+        invalidateDisplayState();
         for (uint8_t servIdx = 1; servIdx < numServ; ++servIdx) {
             uint32_t service_class = servptr[servIdx];
             if (service_class == JD_SERVICE_CLASS_DISPLAY) {
@@ -139,6 +157,14 @@ void JDDisplay::handleIncoming(jd_packet_t *pkt) {
                 VLOG("JDA: unknown service: %x", service_class);
             }
         }
+    } else if (pkt->service_number == displayServiceNum && displayServiceNum &&
+               pkt->service_command == JD_CMD_ADVERTISEMENT_DATA) {
+        if (pkt->service_size >= sizeof(displayAd)) {
+            memcpy(&displayAd, pkt->data, sizeof(displayAd));
+            displayAdValid = true;
+            invalidateDisplayState();
+            VLOG("JDA: screen %dx%d flags=%x", displayAd.width, displayAd.height, displayAd.flags);
+        }
     } else if (pkt->service_number == JD_SERVICE_NUMBER_CTRL &&
                pkt->service_command == JD_CMD_CTRL_NOOP) {
         // do nothing
@@ -225,8 +251,9 @@ void JDDisplay::step() {
         return;
     }
 
-    if (palette) {
-        {
+    if (frameStart) {
+        frameStart = false;
+        if (palette) {
             auto cmd = (jd_display_palette_t *)queuePkt(displayServiceNum, JD_DISPLAY_CMD_PALETTE,
                                                         sizeof(jd_display_palette_t));
             memcpy(cmd->palette, palette, sizeof(jd_display_palette_t));
@@ -237,28 +264,65 @@ void JDDisplay::step() {
                 displayServiceNum, JD_DISPLAY_CMD_SET_WINDOW, sizeof(jd_display_set_window_t));
             *cmd = this->addr;
         }
-        {
+        uint8_t level = this->brightness * 0xff / 100;
+        if (level != sentBrightness) {
             auto cmd = (uint8_t *)queuePkt(displayServiceNum, JD_DISPLAY_CMD_SET_BRIGHTNESS, 1);
-            *cmd = this->brightness * 0xff / 100;
+            *cmd = level;
+            if (deltaSupported())
+                sentBrightness = level;
         }
+        if (!displayAdValid)
+            // ask for the size and flags of the display
+            queuePkt(displayServiceNum, JD_CMD_ADVERTISEMENT_DATA, 0);
         flushSend();
         return;
     }
 
-    if (dataLeft > 0) {
-        uint32_t transfer = bytesPerTransfer;
-        if (dataLeft < transfer)
-            transfer = dataLeft;
-        auto pixels = queuePkt(displayServiceNum, JD_DISPLAY_CMD_PIXELS, transfer);
-        memcpy(pixels, dataPtr, transfer);
-        dataPtr += transfer;
-        dataLeft -= transfer;
-        flushSend();
-    } else {
+    sendPixels();
+}
+
+void JDDisplay::sendPixels() {
+    uint32_t transfer = bytesPerTransfer;
+    int skip = 0;
+    if (compareShadow) {
+        // skip the groups of columns the display already shows
+        while (dataLeft > 0) {
+            if (dataLeft < transfer)
+                transfer = dataLeft;
+            if (memcmp(dataPtr, shadowPtr, transfer))
+                break;
+            dataPtr += transfer;
+            shadowPtr += transfer;
+            dataLeft -= transfer;
+            skip += transfer / bytesPerColumn;
+        }
+    }
+
+    if (dataLeft == 0) {
         // trigger sendDone(), which executes outside of IRQ context, so there
         // is no race with waitForSendDone
         Event(DEVICE_ID_DISPLAY, 4243);
+        return;
+    }
+
+    if (dataLeft < transfer)
+        transfer = dataLeft;
+    if (shadowPtr) {
+        auto size = sizeof(jd_display_pixels_delta_t) + transfer;
+        auto cmd = (jd_display_pixels_delta_t *)queuePkt(displayServiceNum,
+                                                         JD_DISPLAY_CMD_PIXELS_DELTA, size);
+        cmd->skip = skip;
+        cmd->reserved = 0;
+        memcpy(cmd->pixels, dataPtr, transfer);
+        memcpy(shadowPtr, dataPtr, transfer);
+        shadowPtr += transfer;
+    } else {
+        auto pixels = queuePkt(displayServiceNum, JD_DISPLAY_CMD_PIXELS, transfer);
+        memcpy(pixels, dataPtr, transfer);
     }
+    dataPtr += transfer;
+    dataLeft -= transfer;
+    flushSend();
 }
 
 int JDDisplay::sendIndexedImage(const uint8_t *src, unsigned width, unsigned height,
@@ -275,13 +339,45 @@ int JDDisplay::sendIndexedImage(const uint8_t *src, unsigned width, unsigned hei
 
     inProgress = true;
 
-    int numcols = JD_SERIAL_PAYLOAD_SIZE / (height / 2);
-
-    bytesPerTransfer = numcols * (height / 2);
-    dataLeft = (height / 2) * width;
+    bytesPerColumn = height / 2;
+    dataLeft = bytesPerColumn * width;
     dataPtr = src;
+    shadowPtr = NULL;
+    compareShadow = false;
+
+    if (deltaSupported()) {
+        if (palette && paletteValid && !memcmp(&sentPalette, palette, sizeof(sentPalette)))
+            palette = NULL;
+        else if (palette) {
+            memcpy(&sentPalette, palette, sizeof(sentPalette));
+            paletteValid = true;
+        }
+
+        bool sameWindow = !memcmp(&shadowAddr, &addr, sizeof(addr));
+        if (sameWindow || !shadowValid || dataLeft > shadowAddr.width * shadowAddr.height / 2U) {
+            // track the window: the main one, rather than the status bar
+            if (dataLeft > shadowSize) {
+                if (shadow)
+                    app_free(shadow);
+                shadow = (uint8_t *)app_alloc(dataLeft);
+                shadowSize = dataLeft;
+            }
+            compareShadow = sameWindow && shadowValid;
+            shadowAddr = addr;
+            shadowValid = true;
+            shadowPtr = shadow;
+        }
+    }
+
+    int numcols;
+    if (shadowPtr)
+        numcols = (JD_SERIAL_PAYLOAD_SIZE - sizeof(jd_display_pixels_delta_t)) / bytesPerColumn;
+    else
+        numcols = JD_SERIAL_PAYLOAD_SIZE / bytesPerColumn;
+    bytesPerTransfer = numcols * bytesPerColumn;
 
     this->palette = palette;
+    frameStart = true;
 
     memset(&sendFrame, 0, sizeof(sendFrame));
 
@@ -24,11 +24,31 @@ class JDDisplay {
     uint8_t controlsServiceNum;
     uint32_t buttonState;
     jd_display_advertisement_data_t displayAd;
+    bool displayAdValid;
+
+    // what the display is known to show, when it supports JD_DISPLAY_FLAGS_DELTA: the pixels of
+    // the largest window sent (shadowAddr), the palette and the brightness
+    uint8_t *shadow;
+    uint32_t shadowSize;
+    jd_display_set_window_t shadowAddr;
+    bool shadowValid;
+    jd_display_palette_t sentPalette;
+    bool paletteValid;
+    uint8_t sentBrightness;
+    // state of the frame being sent
+    bool frameStart;
+    bool compareShadow;
+    uint8_t *shadowPtr;
+    uint16_t bytesPerColumn;
+
+    void invalidateDisplayState();
+    bool deltaSupported() { return displayAdValid && (displayAd.flags & JD_DISPLAY_FLAGS_DELTA); }
 
     void *queuePkt(uint32_t service_num, uint32_t service_cmd, uint32_t size);
     void flushSend();
     void step();
     void sendDone(Event);
+    void sendPixels();
     static void stepStatic(void *);
     void onFlowHi(Event);
     void handleIncoming(jd_packet_t *pkt);
@@ -11,6 +11,55 @@
 
 namespace pxt {
 
+// runs of changed columns of a frame, each sent to its own address window, one after another
+#define MAX_COLUMN_RUNS 8
+struct ColumnRuns {
+    int n;
+    int x[MAX_COLUMN_RUNS], w[MAX_COLUMN_RUNS];
+};
+
+// the changed columns from x to x + w, as runs of the dirty bands of img (see takeDirtyRect())
+static void columnRuns(Image_ img, int x, int w, uint32_t bands, ColumnRuns *runs) {
+    int bw = dirtyBandWidth(img);
+    runs->n = 0;
+    for (int b = 0; b < 32; ++b) {
+        if (!((bands >> b) & 1))
+            continue;
+        int b1 = b;
+        while (b1 < 31 && ((bands >> (b1 + 1)) & 1))
+            b1++;
+        int x0 = max(x, b * bw), x1 = min(x + w, (b1 + 1) * bw);
+        b = b1;
+        if (x0 >= x1)
+            continue;
+        if (runs->n == MAX_COLUMN_RUNS) {
+            // too many; the last one takes the rest
+            runs->w[runs->n - 1] = x1 - runs->x[runs->n - 1];
+        } else {
+            runs->x[runs->n] = x0;
+            runs->w[runs->n] = x1 - x0;
+            runs->n++;
+        }
+    }
+    if (!runs->n && w > 0) {
+        runs->n = 1;
+        runs->x[0] = x;
+        runs->w[0] = w;
+    }
+}
+
+// the columns of the runs, one after another
+static void copyRuns(Image_ img, uint8_t *dst, const ColumnRuns *runs) {
+    auto bh = img->byteHeight();
+    for (int i = 0; i < runs->n; ++i) {
+        memcpy(dst, img->pix(runs->x[i], 0), runs->w[i] * bh);
+        dst += runs->w[i] * bh;
+    }
+}
+
+class WDisplay;
+static void sendLoop(void *display);
+
 class WDisplay {
   public:
     ScreenIO *io;
@@ -18,16 +67,32 @@ class WDisplay {
     JDDisplay *smart;
 
     uint32_t currPalette[16];
-    bool newPalette;
+    bool newPalette;         // the display is yet to get any palette
+    uint16_t paletteChanges; // entries of currPalette it is yet to get, as a bit mask
     bool inUpdate;
 
     uint8_t *screenBuf;
     Image_ lastStatus;
 
+    // Unless disabled with bit 0 of CFG_DISPLAY_CFG3, frames are double-buffered: updateScreen()
+    // copies a frame into backBuf and returns, while sendLoop() sends screenBuf, swapping the two
+    // when the previous transfer is done. With bit 1 set, a frame still waiting when the next one
+    // comes is dropped instead of blocking.
+    uint8_t *backBuf;
+    bool dropFrames;
+    bool pending, sending;
+    bool pendingFull;    // whole screen, with the palette
+    bool pendingPalette; // the runs, with the palette
+    int pendingX, pendingW;
+    uint32_t pendingBands;
+    ColumnRuns pendingRuns;
+    int frameEvent, doneEvent;
+
     uint16_t width, height;
     uint16_t displayHeight;
     uint8_t offX, offY;
     bool doubleSize;
+    bool partialWindow; // address window set by setAddrColumns()
     uint32_t palXOR;
 
     WDisplay() {
@@ -127,6 +192,20 @@ class WDisplay {
         lastStatus = NULL;
         registerGC((TValue *)&lastStatus);
         inUpdate = false;
+        newPalette = true;
+        paletteChanges = 0;
+        memset(currPalette, 0, sizeof(currPalette));
+
+        uint32_t cfg3 = getConfig(CFG_DISPLAY_CFG3, 0);
+        backBuf = NULL;
+        pending = sending = false;
+        dropFrames = (cfg3 & 2) != 0;
+        if (!(cfg3 & 1)) {
+            backBuf = (uint8_t *)app_alloc(sz / 2 + 20);
+            frameEvent = codal::allocateNotifyEvent();
+            doneEvent = codal::allocateNotifyEvent();
+            create_fiber(sendLoop, this);
+        }
     }
 
     uint32_t smartConfigure(uint32_t *cfg0, uint32_t *cfg1, uint32_t *cfg2) {
@@ -200,11 +279,17 @@ class WDisplay {
             smart->setAddrWindow(offX, offY + displayHeight, width, height - displayHeight);
     }
     void setAddrMain() {
+        partialWindow = false;
         if (lcd)
             lcd->setAddrWindow(offX, offY, width, displayHeight);
         else
             smart->setAddrWindow(offX, offY, width, displayHeight);
     }
+    // part of the main area; only used with lcd
+    void setAddrColumns(int x, int w) {
+        partialWindow = true;
+        lcd->setAddrWindow(offX + x, offY, w, displayHeight);
+    }
     void waitForSendDone() {
         if (lcd)
             lcd->waitForSendDone();
@@ -217,8 +302,141 @@ class WDisplay {
         else
             return smart->sendIndexedImage(src, width, height, palette);
     }
+    // send the runs of columns of an image of imgW x imgH held in screenBuf, the first one with the
+    // palette when withPalette, or all of it with the palette when full; returns with the last
+    // transfer in progress
+    void sendRuns(const ColumnRuns *runs, int imgW, int imgH, bool full, bool withPalette) {
+        auto mult = doubleSize ? 2 : 1;
+        if (full) {
+            if (partialWindow)
+                setAddrMain();
+            sendIndexedImage(screenBuf, imgW, imgH, currPalette);
+            return;
+        }
+        auto src = screenBuf;
+        auto bh = ((imgH * 4 + 31) >> 5) << 2;
+        for (int i = 0; i < runs->n; ++i) {
+            if (i)
+                waitForSendDone();
+            if (runs->w[i] != imgW)
+                setAddrColumns(runs->x[i] * mult, runs->w[i] * mult);
+            else if (partialWindow)
+                setAddrMain();
+            sendIndexedImage(src, runs->w[i], imgH, withPalette && !i ? currPalette : NULL);
+            src += runs->w[i] * bh;
+        }
+    }
 };
 
+// the sending side of double-buffering, in its own fiber
+static void sendLoop(void *p) {
+    auto display = (WDisplay *)p;
+    auto mult = display->doubleSize ? 2 : 1;
+    int imgW = display->width / mult;
+    for (;;) {
+        while (!display->pending)
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, display->frameEvent);
+
+        auto buf = display->screenBuf;
+        display->screenBuf = display->backBuf;
+        display->backBuf = buf;
+        display->pending = false;
+        display->sending = true;
+        Event(DEVICE_ID_NOTIFY_ONE, display->doneEvent);
+
+        display->sendRuns(&display->pendingRuns, imgW, display->displayHeight / mult,
+                          display->pendingFull, display->pendingPalette);
+        display->waitForSendDone();
+        display->sending = false;
+        Event(DEVICE_ID_NOTIFY_ONE, display->doneEvent);
+    }
+}
+
+// With some entries of the palette changed, add the columns of img showing any of them to the
+// changed ones from takeDirtyRect() (when changed), so that only these are sent, along with the
+// palette. Returns whether there are any; when there are none, the changes wait for a frame
+// which shows them.
+static bool paletteColumns(WDisplay *display, Image_ img, bool changed, int *x, int *w,
+                           uint32_t *bands) {
+    uint32_t mask = display->paletteChanges;
+    if (!mask)
+        return false;
+    int bw = dirtyBandWidth(img);
+    int bh = img->byteHeight();
+    int x0 = changed ? *x : img->width(), x1 = changed ? *x + *w : 0;
+    uint32_t b = changed ? *bands : 0;
+    for (int cx = 0; cx < img->width(); ++cx) {
+        uint32_t bit = 1 << (cx / bw);
+        if ((b & bit) && x0 <= cx && cx < x1)
+            continue; // sent anyway
+        auto p = img->pix(cx, 0);
+        for (int i = 0; i < bh; ++i) {
+            if (((mask >> (p[i] & 0xf)) | (mask >> (p[i] >> 4))) & 1) {
+                x0 = min(x0, cx);
+                x1 = max(x1, cx + 1);
+                b |= bit;
+                break;
+            }
+        }
+    }
+    if (x0 >= x1)
+        return false;
+    display->paletteChanges = 0;
+    *x = x0;
+    *w = x1 - x0;
+    *bands = b;
+    return true;
+}
+
+// hand the changed columns of img over to sendLoop()
+static void queueFrame(WDisplay *display, Image_ img) {
+    int x, y, w, h;
+    uint32_t bands;
+    bool changed = takeDirtyRect(img, &x, &y, &w, &h, &bands);
+    bool full = display->smart || display->newPalette;
+    bool withPalette = !full && paletteColumns(display, img, changed, &x, &w, &bands);
+    changed = changed || withPalette;
+    if (!changed && !full)
+        return;
+    display->newPalette = false;
+    if (full)
+        display->paletteChanges = 0;
+
+    if (display->pending) {
+        if (display->dropFrames) {
+            // the display fell behind; replace the waiting frame, with its changes
+            full = full || display->pendingFull;
+            withPalette = withPalette || display->pendingPalette;
+            if (!changed) {
+                x = display->pendingX;
+                w = display->pendingW;
+            } else {
+                int x1 = max(x + w, display->pendingX + display->pendingW);
+                x = min(x, display->pendingX);
+                w = x1 - x;
+            }
+            bands |= display->pendingBands;
+        } else {
+            while (display->pending)
+                fiber_wait_for_event(DEVICE_ID_NOTIFY, display->doneEvent);
+        }
+    }
+
+    if (full) {
+        memcpy(display->backBuf, img->pix(), img->pixLength());
+    } else {
+        columnRuns(img, x, w, bands, &display->pendingRuns);
+        copyRuns(img, display->backBuf, &display->pendingRuns);
+    }
+    display->pendingX = x;
+    display->pendingW = w;
+    display->pendingBands = bands;
+    display->pendingFull = full;
+    display->pendingPalette = withPalette;
+    display->pending = true;
+    Event(DEVICE_ID_NOTIFY_ONE, display->frameEvent);
+}
+
 SINGLETON_IF_PIN(WDisplay, DISPLAY_MOSI);
 
 //%
@@ -279,12 +497,17 @@ void setPalette(Buffer buf) {
 
     if (48 != buf->length)
         target_panic(PANIC_SCREEN_ERROR);
+    // the same palette is often set again, and a fade only changes some of it; only the columns
+    // showing changed entries are sent again (see paletteColumns())
     for (int i = 0; i < 16; ++i) {
-        display->currPalette[i] =
+        uint32_t c =
             (buf->data[i * 3] << 16) | (buf->data[i * 3 + 1] << 8) | (buf->data[i * 3 + 2] << 0);
-        display->currPalette[i] ^= display->palXOR;
+        c ^= display->palXOR;
+        if (display->currPalette[i] != c) {
+            display->currPalette[i] = c;
+            display->paletteChanges |= 1 << i;
+        }
     }
-    display->newPalette = true;
 }
 
 //%
@@ -318,32 +541,71 @@ void updateScreen(Image_ img) {
     if (display->inUpdate)
         return;
 
+    PXT_TRACE_SPAN(ScreenUpdate, img ? img->width() : 0, img ? img->height() : 0);
     display->inUpdate = true;
 
     auto mult = display->doubleSize ? 2 : 1;
 
-    if (img) {
-        if (img->bpp() != 4 || img->width() * mult != display->width ||
-            img->height() * mult != display->displayHeight)
-            target_panic(PANIC_SCREEN_ERROR);
+    if (img && (img->bpp() != 4 || img->width() * mult != display->width ||
+                img->height() * mult != display->displayHeight))
+        target_panic(PANIC_SCREEN_ERROR);
+
+    if (img && logScreenFrame)
+        logScreenFrame(img->pix(), img->width(), img->height(), img->pixLength());
+
+    if (display->backBuf) {
+        // the status bar is sent directly, once the previous frames are out
+        if (display->lastStatus && !display->doubleSize) {
+            while (display->pending || display->sending)
+                fiber_wait_for_event(DEVICE_ID_NOTIFY, display->doneEvent);
+            auto status = display->lastStatus;
+            auto barHeight = display->height - display->displayHeight;
+            if (status->bpp() != 4 || barHeight != status->height() ||
+                status->width() != display->width)
+                target_panic(PANIC_SCREEN_ERROR);
+            memcpy(display->screenBuf, status->pix(), status->pixLength());
+            display->setAddrStatus();
+            display->sendIndexedImage(display->screenBuf, status->width(), status->height(),
+                                      NULL);
+            display->waitForSendDone();
+            display->setAddrMain();
+            display->lastStatus = NULL;
+        }
+        if (img)
+            queueFrame(display, img);
+        display->inUpdate = false;
+        return;
+    }
 
+    if (img) {
         // DMESG("wait for done");
         display->waitForSendDone();
 
-        auto palette = display->currPalette;
-
-        if (display->newPalette) {
-            display->newPalette = false;
-        } else {
-            // smart mode always sends palette
-            if (!display->smart)
-                palette = NULL;
+        // smart mode always sends palette, and skips it when it's the same
+        bool full = display->smart || display->newPalette;
+        display->newPalette = false;
+
+        int x, y, w, h;
+        uint32_t bands;
+        bool changed = takeDirtyRect(img, &x, &y, &w, &h, &bands);
+        bool withPalette = !full && paletteColumns(display, img, changed, &x, &w, &bands);
+        changed = changed || withPalette;
+
+        if (full) {
+            display->paletteChanges = 0;
+            if (display->partialWindow)
+                display->setAddrMain();
+            memcpy(display->screenBuf, img->pix(), img->pixLength());
+            // DMESG("send");
+            display->sendIndexedImage(display->screenBuf, img->width(), img->height(),
+                                      display->currPalette);
+        } else if (changed) {
+            // pixels are stored column by column, so send the changed bands of columns in all rows
+            ColumnRuns runs;
+            columnRuns(img, x, w, bands, &runs);
+            copyRuns(img, display->screenBuf, &runs);
+            display->sendRuns(&runs, img->width(), img->height(), false, withPalette);
         }
-
-        memcpy(display->screenBuf, img->pix(), img->pixLength());
-
-        // DMESG("send");
-        display->sendIndexedImage(display->screenBuf, img->width(), img->height(), palette);
     }
 
     if (display->lastStatus && !display->doubleSize) {
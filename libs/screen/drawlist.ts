@@ -0,0 +1,127 @@
+namespace image {
+    const enum DrawOp {
+        SetPixel = 1,
+        FillRect = 2,
+        DrawLine = 3,
+        FillCircle = 4,
+        DrawImage = 5,
+        DrawTransparentImage = 6,
+        DrawFlippedImage = 7,
+    }
+
+    // must match DrawRecord in image.cpp
+    const HEADER_SIZE = 4
+    const RECORD_SIZE = 12
+
+    //% shim=ImageMethods::_drawListPush
+    declare function _drawListPush(ops: Buffer, opz: number, xy: number, ab: number): boolean;
+
+    //% shim=ImageMethods::_drawList
+    declare function _drawList(img: Image, ops: Buffer, images: Image[]): void;
+
+    export const enum Flip {
+        None = 0,
+        X = 1,
+        Y = 2,
+    }
+
+    function pack(x: number, y: number) {
+        return (Math.clamp(-30000, 30000, x | 0) & 0xffff) | (Math.clamp(-30000, 30000, y | 0) << 16)
+    }
+
+    /**
+     * A list of drawing operations, recorded in a buffer and run at once with draw().
+     * Operations are drawn by increasing z, and in the order they were added for the same z;
+     * the ones outside of the target image are skipped.
+     */
+    export class DrawList {
+        protected ops: Buffer
+        protected images: Image[]
+
+        /**
+         * The z of operations added from now on, between -32768 and 32767
+         */
+        z: number
+
+        constructor() {
+            this.ops = control.createBuffer(HEADER_SIZE + 32 * RECORD_SIZE)
+            this.images = []
+            this.z = 0
+        }
+
+        /**
+         * Number of operations in the list
+         */
+        get length() {
+            return this.ops.getNumber(NumberFormat.UInt32LE, 0)
+        }
+
+        /**
+         * Remove all operations
+         */
+        clear() {
+            this.ops.setNumber(NumberFormat.UInt32LE, 0, 0)
+            this.images = []
+            this.z = 0
+        }
+
+        protected add(op: DrawOp, c: color, xy: number, ab: number) {
+            const opz = op | ((c & 0xff) << 8) | (Math.clamp(-32768, 32767, this.z | 0) << 16)
+            if (_drawListPush(this.ops, opz, xy, ab))
+                return
+            const ops = control.createBuffer(HEADER_SIZE + 2 * (this.ops.length - HEADER_SIZE))
+            ops.write(0, this.ops)
+            this.ops = ops
+            _drawListPush(ops, opz, xy, ab)
+        }
+
+        protected addImage(op: DrawOp, from: Image, x: number, y: number, c = 0) {
+            if (!from) return
+            this.images.push(from)
+            this.add(op, c, pack(x, y), this.images.length - 1)
+        }
+
+        setPixel(x: number, y: number, c: color) {
+            this.add(DrawOp.SetPixel, c, pack(x, y), 0)
+        }
+
+        fillRect(x: number, y: number, w: number, h: number, c: color) {
+            this.add(DrawOp.FillRect, c, pack(x, y), pack(w, h))
+        }
+
+        drawLine(x0: number, y0: number, x1: number, y1: number, c: color) {
+            this.add(DrawOp.DrawLine, c, pack(x0, y0), pack(x1, y1))
+        }
+
+        fillCircle(cx: number, cy: number, r: number, c: color) {
+            this.add(DrawOp.FillCircle, c, pack(cx, cy), Math.clamp(0, 30000, r | 0))
+        }
+
+        drawImage(from: Image, x: number, y: number) {
+            this.addImage(DrawOp.DrawImage, from, x, y)
+        }
+
+        drawTransparentImage(from: Image, x: number, y: number) {
+            this.addImage(DrawOp.DrawTransparentImage, from, x, y)
+        }
+
+        /**
+         * Like drawTransparentImage(), but mirrored horizontally and/or vertically; no flipped
+         * copy of the image is made.
+         * @param flip Flip.X, Flip.Y or both
+         */
+        drawFlippedImage(from: Image, x: number, y: number, flip: Flip) {
+            if (flip & (Flip.X | Flip.Y))
+                this.addImage(DrawOp.DrawFlippedImage, from, x, y, flip & (Flip.X | Flip.Y))
+            else
+                this.addImage(DrawOp.DrawTransparentImage, from, x, y)
+        }
+
+        /**
+         * Run the operations on `target`; the list is kept, so it can be drawn again.
+         */
+        draw(target: Image) {
+            _drawList(target, this.ops, this.images)
+        }
+    }
+}
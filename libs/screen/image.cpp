@@ -1,4 +1,5 @@
 #include "pxt.h"
+#include <limits.h>
 
 #if IMAGE_BITS == 1
 // OK
@@ -8,6 +9,19 @@
 #error "Invalid IMAGE_BITS"
 #endif
 
+#ifndef PXT_POLYGON_MAX_POINTS
+#define PXT_POLYGON_MAX_POINTS 8
+#endif
+
+// 8 and 16 bpp images, for hosted targets with larger screens
+#ifndef IMAGE_WIDE_BPP
+#ifdef __linux__
+#define IMAGE_WIDE_BPP 1
+#else
+#define IMAGE_WIDE_BPP 0
+#endif
+#endif
+
 #define XX(v) (int)(((int16_t)(v)))
 #define YY(v) (int)(((int16_t)(((int32_t)(v)) >> 16)))
 
@@ -22,19 +36,102 @@ void RefImage::print(RefImage *t) {
 }
 
 int RefImage::wordHeight() {
-    if (bpp() == 1)
+    if (bpp() != 4)
         oops(20);
     return ((height() * 4 + 31) >> 5);
 }
 
+// Changes to the image last passed to takeDirtyRect() (normally the screen) are accumulated in a
+// bounding box, so the display driver only has to send the part that changed since the last frame.
+// For any other image, tracking costs a pointer comparison.
+static PXT_TLS Image_ dirtyImage;
+static PXT_TLS bool dirtyImageRegistered;
+static PXT_TLS int dirtyX0, dirtyY0, dirtyX1, dirtyY1; // empty when dirtyX0 >= dirtyX1
+// the bands of columns changed within that box, so that separate changes (say two sprites at the
+// opposite ends of the screen) can be sent separately
+static PXT_TLS uint32_t dirtyBands;
+
+// columns of the 32 bands, a multiple of 8
+int dirtyBandWidth(Image_ img) {
+    return (((img->width() + 31) >> 5) + 7) & ~7;
+}
+
+// bits a..b
+static inline uint32_t bandMask(int a, int b) {
+    return ((2u << b) - 1) & ~((1u << a) - 1);
+}
+
 void RefImage::makeWritable() {
+    makeWritable(0, 0, width(), height());
+}
+
+void RefImage::makeWritable(int x, int y, int w, int h) {
+    // the caller is about to modify the pixels
+    spans = NULL;
     if (buffer->isReadOnly()) {
         buffer = mkBuffer(data(), length());
+        gcRememberObject(this);
+    }
+
+    if (this != dirtyImage || w <= 0 || h <= 0)
+        return;
+    int x1 = min(x + w, width());
+    int y1 = min(y + h, height());
+    x = max(x, 0);
+    y = max(y, 0);
+    if (x >= x1 || y >= y1)
+        return;
+    auto bw = dirtyBandWidth(this);
+    dirtyBands |= bandMask(x / bw, (x1 - 1) / bw);
+    if (dirtyX0 >= dirtyX1) {
+        dirtyX0 = x;
+        dirtyY0 = y;
+        dirtyX1 = x1;
+        dirtyY1 = y1;
+    } else {
+        dirtyX0 = min(dirtyX0, x);
+        dirtyY0 = min(dirtyY0, y);
+        dirtyX1 = max(dirtyX1, x1);
+        dirtyY1 = max(dirtyY1, y1);
+    }
+}
+
+/**
+ * Get the area of `img` changed since the previous call and start over; returns false when nothing
+ * changed. When `img` is different than in the previous call, the whole image is reported.
+ * With `bands`, bit i is set there when some column from i * dirtyBandWidth(img) to the next band
+ * changed.
+ */
+bool takeDirtyRect(Image_ img, int *x, int *y, int *w, int *h, uint32_t *bands) {
+    if (!dirtyImageRegistered) {
+        dirtyImageRegistered = true;
+        registerGC((TValue *)&dirtyImage);
+    }
+
+    if (img != dirtyImage) {
+        dirtyImage = img;
+        dirtyX0 = dirtyY0 = 0;
+        dirtyX1 = img ? img->width() : 0;
+        dirtyY1 = img ? img->height() : 0;
+        dirtyBands = 0xffffffff;
     }
+
+    bool changed = dirtyX0 < dirtyX1 && dirtyY0 < dirtyY1;
+    *x = dirtyX0;
+    *y = dirtyY0;
+    *w = changed ? dirtyX1 - dirtyX0 : 0;
+    *h = changed ? dirtyY1 - dirtyY0 : 0;
+    if (bands)
+        *bands = changed ? dirtyBands : 0;
+    dirtyX0 = dirtyY0 = dirtyX1 = dirtyY1 = 0;
+    dirtyBands = 0;
+    return changed;
 }
 
 uint8_t RefImage::fillMask(color c) {
-    return this->bpp() == 1 ? (c & 1) * 0xff : 0x11 * (c & 0xf);
+    if (this->bpp() == 1)
+        return (c & 1) * 0xff;
+    return this->bpp() == 4 ? 0x11 * (c & 0xf) : c;
 }
 
 bool RefImage::inRange(int x, int y) {
@@ -46,13 +143,19 @@ void RefImage::clamp(int *x, int *y) {
     *y = min(max(*y, 0), height() - 1);
 }
 
-RefImage::RefImage(BoxedBuffer *buf) : PXT_VTABLE_INIT(RefImage), buffer(buf) {
+RefImage::RefImage(BoxedBuffer *buf) : PXT_VTABLE_INIT(RefImage), buffer(buf), spans(NULL) {
     if (!buf)
         oops(21);
 }
 
+static inline bool validBpp(int bpp) {
+    return bpp == 1 || bpp == 4 || (IMAGE_WIDE_BPP && (bpp == 8 || bpp == 16));
+}
+
 static inline int byteSize(int w, int h, int bpp) {
-    if (bpp == 1)
+    if (bpp >= 8)
+        return sizeof(ImageHeader) + w * h * (bpp >> 3);
+    else if (bpp == 1)
         return sizeof(ImageHeader) + ((h + 7) >> 3) * w;
     else
         return sizeof(ImageHeader) + (((h * 4 + 31) / 32) * 4) * w;
@@ -69,7 +172,7 @@ Image_ allocImage(const uint8_t *data, uint32_t sz) {
 Image_ mkImage(int width, int height, int bpp) {
     if (width < 0 || height < 0 || width > 2000 || height > 2000)
         return NULL;
-    if (bpp != 1 && bpp != 4)
+    if (!validBpp(bpp))
         return NULL;
     uint32_t sz = byteSize(width, height, bpp);
     Image_ r = allocImage(NULL, sz);
@@ -88,7 +191,7 @@ bool isValidImage(Buffer buf) {
         return false;
 
     auto hd = (ImageHeader *)(buf->data);
-    if (hd->magic != IMAGE_HEADER_MAGIC || (hd->bpp != 1 && hd->bpp != 4))
+    if (hd->magic != IMAGE_HEADER_MAGIC || !validBpp(hd->bpp))
         return false;
 
     int sz = byteSize(hd->width, hd->height, hd->bpp);
@@ -112,6 +215,107 @@ bool isLegacyImage(Buffer buf) {
     return true;
 }
 
+// Compressed images hold the columns one after another, each as runs exactly covering its height:
+//   LC        (L = 1..15) L pixels of color C
+//   0N data   N + 1 (1..16) pixels of data, two per byte, low nibble first
+
+bool isCompressedImage(Buffer buf) {
+    return buf && buf->length >= (int)sizeof(ImageHeader) && buf->data[0] == IMAGE_RLE_MAGIC &&
+           buf->data[1] == 4;
+}
+
+// pixel y of a 4bpp column
+static inline int nibbleAt(const uint8_t *col, int y) {
+    return (col[y >> 1] >> ((y & 1) << 2)) & 0xf;
+}
+
+// called with n > 0 for n pixels of color c starting at (x, y), and with n < 0 for -n pixels of
+// 4bpp data
+typedef void (*CompressedRunFn)(void *ctx, int x, int y, int n, int c, const uint8_t *data);
+
+// walk the runs of columns up to x1, calling f for the ones from x0 on; returns false if the
+// encoding is broken
+static bool forCompressedRuns(Buffer buf, int x0, int x1, CompressedRunFn f, void *ctx) {
+    auto hd = (ImageHeader *)buf->data;
+    auto p = hd->pixels;
+    auto end = buf->data + buf->length;
+    int h = hd->height;
+    x1 = min(x1, (int)hd->width - 1);
+    for (int x = 0; x <= x1; ++x) {
+        int y = 0;
+        while (y < h) {
+            if (p >= end)
+                return false;
+            int b = *p++;
+            int n = b >> 4;
+            if (n) {
+                if (y + n > h)
+                    return false;
+                if (x >= x0)
+                    f(ctx, x, y, n, b & 0xf, NULL);
+            } else {
+                n = (b & 0xf) + 1;
+                if (y + n > h || end - p < (n + 1) >> 1)
+                    return false;
+                if (x >= x0)
+                    f(ctx, x, y, -n, 0, p);
+                p += (n + 1) >> 1;
+            }
+            y += n;
+        }
+    }
+    return true;
+}
+
+// size of the compressed encoding of a 4bpp img, written to dst unless it's NULL
+static int compressImage(Image_ img, uint8_t *dst) {
+    int w = img->width(), h = img->height();
+    int sz = sizeof(ImageHeader);
+    for (int x = 0; x < w; ++x) {
+        auto col = img->pix(x, 0);
+        int y = 0;
+        while (y < h) {
+            // runs of 3 or more pay off, shorter ones go to literals
+            int lit = 0, n = 0;
+            while (y + lit < h && lit < 16) {
+                int c = nibbleAt(col, y + lit);
+                n = 1;
+                while (n < 15 && y + lit + n < h && nibbleAt(col, y + lit + n) == c)
+                    n++;
+                if (n >= 3)
+                    break;
+                lit += n;
+                n = 0;
+            }
+            lit = min(lit, 16);
+            if (lit) {
+                if (dst) {
+                    dst[sz] = lit - 1;
+                    memset(dst + sz + 1, 0, (lit + 1) >> 1);
+                    for (int k = 0; k < lit; ++k)
+                        dst[sz + 1 + (k >> 1)] |= nibbleAt(col, y + k) << ((k & 1) << 2);
+                }
+                sz += 1 + ((lit + 1) >> 1);
+                y += lit;
+            } else {
+                if (dst)
+                    dst[sz] = (n << 4) | nibbleAt(col, y);
+                sz++;
+                y += n;
+            }
+        }
+    }
+    return sz;
+}
+
+// colors of 1 and 4bpp images drawn on 16bpp ones, set by the display driver with its palette
+static PXT_TLS uint16_t palette565[16];
+
+void setImagePalette(const uint8_t *rgb, int n) {
+    for (int i = 0; i < n && i < 16; ++i, rgb += 3)
+        palette565[i] = ((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3);
+}
+
 } // namespace pxt
 
 namespace ImageMethods {
@@ -145,6 +349,34 @@ bool isStatic(Image_ img) {
     return img->buffer->isReadOnly();
 }
 
+#ifdef PXT_DMA_MEMOPS
+// below this, setting up the DMA costs about as much as it saves
+#define DMA_MIN_BYTES 512
+#endif
+
+// memcpy() from src, or memset() to v without src, of pixels; large ones are split between the
+// DMA, which does the first half, and the CPU doing the second half meanwhile
+static void pixelsCopyOrFill(uint8_t *dst, const uint8_t *src, uint8_t v, int len) {
+#ifdef PXT_DMA_MEMOPS
+    if (len >= DMA_MIN_BYTES) {
+        int dmaLen = (len >> 1) & ~3;
+        if (src ? dmaCopyStart(dst, src, dmaLen) : dmaFillStart(dst, v, dmaLen)) {
+            if (src)
+                memcpy(dst + dmaLen, src + dmaLen, len - dmaLen);
+            else
+                memset(dst + dmaLen, v, len - dmaLen);
+            if (dmaWait())
+                return;
+            // redo it all on the CPU
+        }
+    }
+#endif
+    if (src)
+        memcpy(dst, src, len);
+    else
+        memset(dst, v, len);
+}
+
 /**
  * Sets all pixels in the current image from the other image, which has to be of the same size and
  * bpp.
@@ -155,7 +387,7 @@ void copyFrom(Image_ img, Image_ from) {
         img->bpp() != from->bpp())
         return;
     img->makeWritable();
-    memcpy(img->pix(), from->pix(), from->pixLength());
+    pixelsCopyOrFill(img->pix(), from->pix(), 0, from->pixLength());
 }
 
 static void setCore(Image_ img, int x, int y, int c) {
@@ -171,6 +403,10 @@ static void setCore(Image_ img, int x, int y, int c) {
             *ptr |= mask;
         else
             *ptr &= ~mask;
+    } else if (img->bpp() == 8) {
+        *ptr = c;
+    } else if (img->bpp() == 16) {
+        *(uint16_t *)ptr = c;
     }
 }
 
@@ -184,6 +420,10 @@ static int getCore(Image_ img, int x, int y) {
     } else if (img->bpp() == 1) {
         uint8_t mask = 0x01 << (y & 7);
         return (*ptr & mask) ? 1 : 0;
+    } else if (img->bpp() == 8) {
+        return *ptr;
+    } else if (img->bpp() == 16) {
+        return *(uint16_t *)ptr;
     }
     return 0;
 }
@@ -195,7 +435,7 @@ static int getCore(Image_ img, int x, int y) {
 void setPixel(Image_ img, int x, int y, int c) {
     if (!img->inRange(x, y))
         return;
-    img->makeWritable();
+    img->makeWritable(x, y, 1, 1);
     setCore(img, x, y, c);
 }
 
@@ -216,12 +456,12 @@ void fillRect(Image_ img, int x, int y, int w, int h, int c);
  */
 //%
 void fill(Image_ img, int c) {
-    if (c && img->hasPadding()) {
+    if ((c && img->hasPadding()) || img->bpp() == 16) {
         fillRect(img, 0, 0, img->width(), img->height(), c);
         return;
     }
     img->makeWritable();
-    memset(img->pix(), img->fillMask(c), img->pixLength());
+    pixelsCopyOrFill(img->pix(), NULL, img->fillMask(c), img->pixLength());
 }
 
 /**
@@ -261,7 +501,7 @@ void setRows(Image_ img, int x, Buffer src) {
     if (x >= w || x < 0)
         return;
 
-    img->makeWritable();
+    img->makeWritable(x, 0, w - x, h);
 
     uint8_t *dp = img->pix(x, 0);
     uint8_t *sp = src->data;
@@ -273,6 +513,79 @@ void setRows(Image_ img, int x, Buffer src) {
     }
 }
 
+// set h > 0 pixels of a column starting at p = img->pix(x, y); f is img->fillMask(c)
+static void fillColumn(Image_ img, uint8_t *p, int y, int h, uint8_t f, int c) {
+    if (img->bpp() == 1) {
+        unsigned mask = 0x01 << (y & 7);
+
+        for (int i = 0; i < h; ++i) {
+            if (mask == 0x100) {
+                if (h - i >= 8) {
+                    *++p = f;
+                    i += 7;
+                    continue;
+                } else {
+                    mask = 0x01;
+                    ++p;
+                }
+            }
+            if (c)
+                *p |= mask;
+            else
+                *p &= ~mask;
+            mask <<= 1;
+        }
+    } else if (img->bpp() == 4) {
+        if (y & 1) {
+            *p = (*p & 0x0f) | (f & 0xf0);
+            p++;
+            h--;
+        }
+        if (h >= 2) {
+            memset(p, f, h >> 1);
+            p += h >> 1;
+        }
+        if (h & 1)
+            *p = (*p & 0xf0) | (f & 0x0f);
+    } else if (img->isWide()) {
+        auto stride = img->rowBytes();
+        for (; h > 0; --h, p += stride) {
+            if (img->bpp() == 8)
+                *p = c;
+            else
+                *(uint16_t *)p = c;
+        }
+    }
+}
+
+// fill a rectangle of a row-major image, already clipped
+static void fillRows(Image_ img, int x, int y, int w, int h, int c) {
+    auto stride = img->rowBytes();
+    auto p = img->pix(x, y);
+    if (img->bpp() == 8) {
+        for (; h > 0; --h, p += stride)
+            memset(p, c, w);
+        return;
+    }
+    // fill the first row and copy it to the others
+    auto row = (uint16_t *)p;
+    for (int i = 0; i < w; ++i)
+        row[i] = c;
+    for (int i = 1; i < h; ++i)
+        memcpy(p + i * stride, p, w * 2);
+}
+
+// fill pixels y0..y1 of column x, clipped to the image; the caller makes it writable
+static void fillSpan(Image_ img, int x, int y0, int y1, int c) {
+    if (x < 0 || x >= img->width())
+        return;
+    y0 = max(y0, 0);
+    y1 = min(y1, img->height() - 1);
+    if (y0 > y1)
+        return;
+    fillColumn(img, img->pix(x, y0), y0, y1 - y0 + 1, img->fillMask(c), c);
+}
+
 void fillRect(Image_ img, int x, int y, int w, int h, int c) {
     if (w == 0 || h == 0 || x >= img->width() || y >= img->height())
         return;
@@ -288,61 +601,30 @@ void fillRect(Image_ img, int x, int y, int w, int h, int c) {
     w = x2 - x + 1;
     h = y2 - y + 1;
 
+    if (img->isWide()) {
+        img->makeWritable(x, y, w, h);
+        fillRows(img, x, y, w, h, c);
+        return;
+    }
+
     if (!img->hasPadding() && x == 0 && y == 0 && w == img->width() && h == img->height()) {
         fill(img, c);
         return;
     }
 
-    img->makeWritable();
+    img->makeWritable(x, y, w, h);
 
     auto bh = img->byteHeight();
     uint8_t f = img->fillMask(c);
 
     uint8_t *p = img->pix(x, y);
+    if (!img->hasPadding() && y == 0 && h == img->height()) {
+        // whole columns are contiguous
+        pixelsCopyOrFill(p, NULL, f, w * bh);
+        return;
+    }
     while (w-- > 0) {
-        if (img->bpp() == 1) {
-            auto ptr = p;
-            unsigned mask = 0x01 << (y & 7);
-
-            for (int i = 0; i < h; ++i) {
-                if (mask == 0x100) {
-                    if (h - i >= 8) {
-                        *++ptr = f;
-                        i += 7;
-                        continue;
-                    } else {
-                        mask = 0x01;
-                        ++ptr;
-                    }
-                }
-                if (c)
-                    *ptr |= mask;
-                else
-                    *ptr &= ~mask;
-                mask <<= 1;
-            }
-
-        } else if (img->bpp() == 4) {
-            auto ptr = p;
-            unsigned mask = 0x0f;
-            if (y & 1)
-                mask <<= 4;
-
-            for (int i = 0; i < h; ++i) {
-                if (mask == 0xf00) {
-                    if (h - i >= 2) {
-                        *++ptr = f;
-                        i++;
-                        continue;
-                    } else {
-                        mask = 0x0f;
-                        ptr++;
-                    }
-                }
-                *ptr = (*ptr & ~mask) | (f & mask);
-                mask <<= 4;
-            }
-        }
+        fillColumn(img, p, y, h, f, c);
         p += bh;
     }
 }
@@ -352,6 +634,13 @@ void _fillRect(Image_ img, int xy, int wh, int c) {
     fillRect(img, XX(xy), YY(xy), XX(wh), YY(wh), c);
 }
 
+// lut[b] is byte b of 4bpp pixels with both of its pixels mapped through the 16 entry map
+static void buildByteMap(const uint8_t *map, uint8_t *lut) {
+    for (int hi = 0; hi < 16; ++hi)
+        for (int lo = 0; lo < 16; ++lo)
+            *lut++ = ((map[hi] & 0xf) << 4) | (map[lo] & 0xf);
+}
+
 void mapRect(Image_ img, int x, int y, int w, int h, Buffer map) {
     if (w == 0 || h == 0 || x >= img->width() || y >= img->height())
         return;
@@ -370,24 +659,26 @@ void mapRect(Image_ img, int x, int y, int w, int h, Buffer map) {
     w = x2 - x + 1;
     h = y2 - y + 1;
 
-    img->makeWritable();
+    img->makeWritable(x, y, w, h);
+
+    // two pixels per lookup
+    uint8_t lut[256];
+    buildByteMap(map->data, lut);
 
     auto bh = img->byteHeight();
-    auto m = map->data;
     uint8_t *p = img->pix(x, y);
     while (w-- > 0) {
         auto ptr = p;
-        unsigned shift = y & 1;
-        for (int i = 0; i < h; i++) {
-            if (shift) {
-                *ptr = (m[*ptr >> 4] << 4) | (*ptr & 0x0f);
-                ptr++;
-                shift = 0;
-            } else {
-                *ptr = (m[*ptr & 0xf] & 0xf) | (*ptr & 0xf0);
-                shift = 1;
-            }
+        int n = h;
+        if (y & 1) {
+            *ptr = (lut[*ptr] & 0xf0) | (*ptr & 0x0f);
+            ptr++;
+            n--;
         }
+        for (; n >= 2; n -= 2, ptr++)
+            *ptr = lut[*ptr];
+        if (n)
+            *ptr = (lut[*ptr] & 0x0f) | (*ptr & 0xf0);
         p += bh;
     }
 }
@@ -426,6 +717,21 @@ Image_ clone(Image_ img) {
 void flipX(Image_ img) {
     img->makeWritable();
 
+    if (img->isWide()) {
+        int ps = img->bpp() >> 3;
+        uint8_t tmp[2];
+        for (int y = 0; y < img->height(); ++y) {
+            auto a = img->pix(0, y);
+            auto b = img->pix(img->width() - 1, y);
+            for (; a < b; a += ps, b -= ps) {
+                memcpy(tmp, a, ps);
+                memcpy(a, b, ps);
+                memcpy(b, tmp, ps);
+            }
+        }
+        return;
+    }
+
     int bh = img->byteHeight();
     auto a = img->pix();
     auto b = img->pix(img->width() - 1, 0);
@@ -448,6 +754,41 @@ void flipX(Image_ img) {
 void flipY(Image_ img) {
     img->makeWritable();
 
+    int h = img->height();
+    if (img->isWide()) {
+        // swap whole rows
+        int n = img->rowBytes();
+        uint8_t tmp[n];
+        for (int a = 0, b = h - 1; a < b; ++a, --b) {
+            memcpy(tmp, img->pix(0, a), n);
+            memcpy(img->pix(0, a), img->pix(0, b), n);
+            memcpy(img->pix(0, b), tmp, n);
+        }
+        return;
+    }
+
+    if (img->bpp() == 4 && h > 1) {
+        // reverse the bytes of each column swapping their nibbles; with an odd height the result
+        // starts at the high nibble of the first byte, so it then shifts down by one pixel
+        int n = (h + 1) >> 1;
+        uint8_t tmp[n];
+        for (int i = 0; i < img->width(); ++i) {
+            auto col = img->pix(i, 0);
+            for (int k = 0; k < n; ++k) {
+                auto b = col[n - 1 - k];
+                tmp[k] = (b >> 4) | (b << 4);
+            }
+            if (h & 1) {
+                for (int k = 0; k < n - 1; ++k)
+                    col[k] = (tmp[k] >> 4) | (tmp[k + 1] << 4);
+                col[n - 1] = (col[n - 1] & 0xf0) | (tmp[n - 1] >> 4);
+            } else {
+                memcpy(col, tmp, n);
+            }
+        }
+        return;
+    }
+
     // this is quite slow - for small 16x16 sprite it will take in the order of 1ms
     // something faster requires quite a bit of bit tweaking, especially for mono images
     for (int i = 0; i < img->width(); ++i) {
@@ -464,23 +805,61 @@ void flipY(Image_ img) {
 }
 
 /**
- * Returns a transposed image (with X/Y swapped)
+ * Sets the pixels of dst to the transposed current image (with X/Y swapped); dst has to be another
+ * image, as high as the current one is wide and the other way round, of the same bpp.
+ * Returns false, leaving dst unchanged, if it is not.
  */
 //%
-Image_ transposed(Image_ img) {
-    Image_ r = mkImage(img->height(), img->width(), img->bpp());
+bool transposedInto(Image_ img, Image_ dst) {
+    if (dst == img || dst->width() != img->height() || dst->height() != img->width() ||
+        dst->bpp() != img->bpp())
+        return false;
+    dst->makeWritable();
 
     // this is quite slow
     for (int i = 0; i < img->width(); ++i) {
-        for (int j = 0; j < img->height(); ++i) {
-            setCore(r, j, i, getCore(img, i, j));
+        for (int j = 0; j < img->height(); ++j) {
+            setCore(dst, j, i, getCore(img, i, j));
         }
     }
 
+    return true;
+}
+
+/**
+ * Returns a transposed image (with X/Y swapped)
+ */
+//%
+Image_ transposed(Image_ img) {
+    Image_ r = mkImage(img->height(), img->width(), img->bpp());
+    transposedInto(img, r);
     return r;
 }
 
-void drawImage(Image_ img, Image_ from, int x, int y);
+// scroll() of a row-major image: every row is moved from its source one, going against dy so that
+// the source is always still unchanged
+static void scrollRows(Image_ img, int dx, int dy) {
+    int w = img->width(), h = img->height();
+    int ps = img->bpp() >> 3, stride = img->rowBytes();
+    int n = w - (dx < 0 ? -dx : dx);
+    for (int k = 0; k < h; ++k) {
+        int y = dy > 0 ? h - 1 - k : k;
+        int sy = y - dy;
+        auto row = img->pix(0, y);
+        if (sy < 0 || sy >= h || n <= 0) {
+            memset(row, 0, stride);
+            continue;
+        }
+        auto src = img->pix(0, sy);
+        if (dx >= 0) {
+            memmove(row + dx * ps, src, n * ps);
+            memset(row, 0, dx * ps);
+        } else {
+            memmove(row, src - dx * ps, n * ps);
+            memset(row + n * ps, 0, -dx * ps);
+        }
+    }
+}
 
 /**
  * Every pixel in image is moved by (dx,dy)
@@ -488,13 +867,35 @@ void drawImage(Image_ img, Image_ from, int x, int y);
 //%
 void scroll(Image_ img, int dx, int dy) {
     img->makeWritable();
+    if (img->isWide()) {
+        scrollRows(img, dx, dy);
+        return;
+    }
     auto bh = img->byteHeight();
     auto w = img->width();
     if (dy != 0) {
-        // TODO one day we may want a more memory-efficient implementation
-        auto img2 = clone(img);
-        fill(img, 0);
-        drawImage(img, img2, dx, dy);
+        // move one column at a time through a copy of it; going against dx, the source column is
+        // always still unchanged
+        int h = img->height();
+        uint8_t tmp[bh];
+        for (int k = 0; k < w; ++k) {
+            int x = dx > 0 ? w - 1 - k : k;
+            int sx = x - dx;
+            auto col = img->pix(x, 0);
+            if (sx < 0 || sx >= w) {
+                memset(col, 0, bh);
+                continue;
+            }
+            memcpy(tmp, img->pix(sx, 0), bh);
+            memset(col, 0, bh);
+            for (int y = max(dy, 0); y < min(h, h + dy); ++y) {
+                int sy = y - dy;
+                int c = img->bpp() == 4 ? (tmp[sy >> 1] >> ((sy & 1) << 2)) & 0xf
+                                        : (tmp[sy >> 3] >> (sy & 7)) & 1;
+                if (c)
+                    setCore(img, x, y, c);
+            }
+        }
     } else if (dx < 0) {
         dx = -dx;
         if (dx < w)
@@ -516,60 +917,114 @@ const uint8_t bitdouble[] = {0x00, 0x03, 0x0c, 0x0f, 0x30, 0x33, 0x3c, 0x3f,
 const uint8_t nibdouble[] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
                              0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
 
+static bool sizedAs(Image_ dst, Image_ img, int w, int h) {
+    return !img->isWide() && dst->width() == w && dst->height() == h && dst->bpp() == img->bpp();
+}
+
 /**
- * Stretches the image horizontally by 100%
+ * Sets the pixels of dst to the current image stretched horizontally by 100%; dst has to be twice
+ * as wide, of the same height and bpp. Returns false, leaving dst unchanged, if it is not.
  */
 //%
-Image_ doubledX(Image_ img) {
-    if (img->width() > 126)
-        return NULL;
+bool doubledXInto(Image_ img, Image_ dst) {
+    if (!sizedAs(dst, img, img->width() * 2, img->height()))
+        return false;
+    dst->makeWritable();
 
-    Image_ r = mkImage(img->width() * 2, img->height(), img->bpp());
     auto src = img->pix();
-    auto dst = r->pix();
+    auto d = dst->pix();
     auto w = img->width();
     auto bh = img->byteHeight();
 
     for (int i = 0; i < w; ++i) {
-        memcpy(dst, src, bh);
-        dst += bh;
-        memcpy(dst, src, bh);
-        dst += bh;
+        memcpy(d, src, bh);
+        d += bh;
+        memcpy(d, src, bh);
+        d += bh;
 
         src += bh;
     }
 
+    return true;
+}
+
+/**
+ * Stretches the image horizontally by 100%
+ */
+//%
+Image_ doubledX(Image_ img) {
+    if (img->isWide() || img->width() > 126)
+        return NULL;
+
+    Image_ r = mkImage(img->width() * 2, img->height(), img->bpp());
+    doubledXInto(img, r);
     return r;
 }
 
+// the bh bytes of a column twice as high as the src one
+static void doubleColumnY(uint8_t *dst, const uint8_t *src, int bh, const uint8_t *dbl) {
+    for (int j = 0; j < bh; j += 2) {
+        *dst++ = dbl[*src & 0xf];
+        if (j != bh - 1)
+            *dst++ = dbl[*src >> 4];
+        src++;
+    }
+}
+
+/**
+ * Sets the pixels of dst to the current image stretched vertically by 100%; dst has to be twice
+ * as high, of the same width and bpp. Returns false, leaving dst unchanged, if it is not.
+ */
+//%
+bool doubledYInto(Image_ img, Image_ dst) {
+    if (!sizedAs(dst, img, img->width(), img->height() * 2))
+        return false;
+    dst->makeWritable();
+
+    auto w = img->width();
+    auto bh = dst->byteHeight();
+    auto dbl = img->bpp() == 1 ? bitdouble : nibdouble;
+
+    for (int i = 0; i < w; ++i)
+        doubleColumnY(dst->pix(i, 0), img->pix(i, 0), bh, dbl);
+
+    return true;
+}
+
 /**
  * Stretches the image vertically by 100%
  */
 //%
 Image_ doubledY(Image_ img) {
-    if (img->height() > 126)
+    if (img->isWide() || img->height() > 126)
         return NULL;
 
     Image_ r = mkImage(img->width(), img->height() * 2, img->bpp());
-    auto src0 = img->pix();
-    auto dst = r->pix();
+    doubledYInto(img, r);
+    return r;
+}
+
+/**
+ * Sets the pixels of dst to the current image stretched in both directions by 100%; dst has to be
+ * twice as wide and high, of the same bpp. Returns false, leaving dst unchanged, if it is not.
+ */
+//%
+bool doubledInto(Image_ img, Image_ dst) {
+    if (!sizedAs(dst, img, img->width() * 2, img->height() * 2))
+        return false;
+    dst->makeWritable();
 
     auto w = img->width();
-    auto sbh = img->byteHeight();
-    auto bh = r->byteHeight();
+    auto bh = dst->byteHeight();
     auto dbl = img->bpp() == 1 ? bitdouble : nibdouble;
 
     for (int i = 0; i < w; ++i) {
-        auto src = src0 + i * sbh;
-        for (int j = 0; j < bh; j += 2) {
-            *dst++ = dbl[*src & 0xf];
-            if (j != bh - 1)
-                *dst++ = dbl[*src >> 4];
-            src++;
-        }
+        auto d = dst->pix(2 * i, 0);
+        doubleColumnY(d, img->pix(i, 0), bh, dbl);
+        memcpy(d + bh, d, bh);
     }
 
-    return r;
+    return true;
 }
 
 /**
@@ -594,15 +1049,16 @@ void replace(Image_ img, int from, int to) {
         return;
     }
 
+    uint8_t map[16], lut[256];
+    for (int i = 0; i < 16; ++i)
+        map[i] = i == from ? to : i;
+    buildByteMap(map, lut);
+
     auto ptr = img->pix();
     auto len = img->pixLength();
     while (len--) {
-        auto b = *ptr;
-        if ((b & 0xf) == from)
-            b = (b & 0xf0) | to;
-        if ((b >> 4) == from)
-            b = (to << 4) | (b & 0xf);
-        *ptr++ = b;
+        *ptr = lut[*ptr];
+        ptr++;
     }
 }
 
@@ -611,13 +1067,223 @@ void replace(Image_ img, int from, int to) {
  */
 //%
 Image_ doubled(Image_ img) {
-    Image_ tmp = doubledX(img);
-    registerGCObj(tmp);
-    Image_ r = doubledY(tmp);
-    unregisterGCObj(tmp);
+    if (img->isWide() || img->width() > 126 || img->height() > 126)
+        return NULL;
+
+    Image_ r = mkImage(img->width() * 2, img->height() * 2, img->bpp());
+    doubledInto(img, r);
+    return r;
+}
+
+// bit 0 of every nibble of v that is non-zero
+static inline uint32_t nonZeroNibbles(uint32_t v) {
+    v |= v >> 1;
+    v |= v >> 2;
+    return v & 0x11111111;
+}
+
+static inline void setNibble(uint8_t *col, int y, uint32_t c) {
+    auto p = col + (y >> 1);
+    if (y & 1)
+        *p = (*p & 0x0f) | (c << 4);
+    else
+        *p = (*p & 0xf0) | c;
+}
+
+// Draw one 4bpp column of [cnt] words at row [y] of the target column [col], skipping
+// transparent pixels. Words that land completely inside [0, sh) are merged 8 pixels at a time
+// under a mask of their non-zero nibbles; only the clipped ones at the ends go pixel by pixel,
+// and are also cut at [bot]. For odd [y] the source is shifted by a nibble, and the top pixel of
+// every word is carried over to the next one.
+static void drawTransparentColumn(uint8_t *col, const uint32_t *fdata, int cnt, int y, int sh,
+                                  int bot) {
+    bool odd = y & 1;
+    uint32_t carry = 0;
+    while (cnt--) {
+        auto v = *fdata++;
+        if (y - odd >= 0 && y + 7 - odd < sh) {
+            auto s = odd ? (v << 4) | carry : v;
+            carry = v >> 28;
+            auto m = nonZeroNibbles(s) * 0xf;
+            if (m) {
+                auto p = col + (y >> 1);
+                uint32_t d;
+                memcpy(&d, p, 4);
+                d = (d & ~m) | (s & m);
+                memcpy(p, &d, 4);
+            }
+        } else {
+            if (carry && y - 1 >= 0 && y - 1 < bot)
+                setNibble(col, y - 1, carry);
+            carry = 0;
+            for (int k = 0; k < 8; ++k) {
+                auto c = (v >> (4 * k)) & 0xf;
+                if (c && 0 <= y + k && y + k < bot)
+                    setNibble(col, y + k, c);
+            }
+        }
+        y += 8;
+    }
+    if (carry && y - 1 < bot)
+        setNibble(col, y - 1, carry);
+}
+
+static inline int getNibble(const uint8_t *col, int y) {
+    auto b = col[y >> 1];
+    return y & 1 ? b >> 4 : b & 0xf;
+}
+
+// Opaque spans of 4bpp images, used instead of the pixels by transparent draws and overlap
+// tests. RefImage::spans holds uint16_t colStart[width + 1], indexing the {top, len} uint16_t
+// pairs which follow. Images where the spans would take more space than the pixels get an
+// empty buffer, and are drawn the usual way. makeWritable() drops the spans.
+static Buffer compileSpans(Image_ img) {
+    auto w = img->width();
+    auto h = img->height();
+    auto byteH = img->byteHeight();
+    auto pix = img->pix();
+
+    int numSpans = 0;
+    for (int x = 0; x < w; ++x) {
+        auto col = pix + byteH * x;
+        bool prev = false;
+        for (int y = 0; y < h; ++y) {
+            bool curr = getNibble(col, y) != 0;
+            if (curr && !prev)
+                numSpans++;
+            prev = curr;
+        }
+    }
+
+    int size = (w + 1 + 2 * numSpans) * sizeof(uint16_t);
+    if (size > img->pixLength())
+        return mkBuffer(NULL, 0);
+
+    auto r = mkBuffer(NULL, size);
+    auto colStart = (uint16_t *)r->data;
+    auto spans = colStart + w + 1;
+    int idx = 0;
+    for (int x = 0; x < w; ++x) {
+        auto col = pix + byteH * x;
+        colStart[x] = idx;
+        int top = -1;
+        for (int y = 0; y <= h; ++y) {
+            bool curr = y < h && getNibble(col, y) != 0;
+            if (curr && top < 0)
+                top = y;
+            else if (!curr && top >= 0) {
+                spans[2 * idx] = top;
+                spans[2 * idx + 1] = y - top;
+                idx++;
+                top = -1;
+            }
+        }
+    }
+    colStart[w] = idx;
     return r;
 }
 
+// copy [n] pixels from row [sy] of 4bpp column [src] to row [dy] of column [dst]
+static void copyNibbles(uint8_t *dst, int dy, const uint8_t *src, int sy, int n) {
+    if ((dy ^ sy) & 1) {
+        while (n--)
+            setNibble(dst, dy++, getNibble(src, sy++));
+        return;
+    }
+    if (dy & 1) {
+        setNibble(dst, dy++, getNibble(src, sy++));
+        n--;
+    }
+    if (n <= 0)
+        return;
+    memcpy(dst + (dy >> 1), src + (sy >> 1), n >> 1);
+    if (n & 1)
+        setNibble(dst, dy + n - 1, getNibble(src, sy + n - 1));
+}
+
+// check if any of [n] pixels from row [y] of 4bpp column [col] is set
+static bool anyNibble(const uint8_t *col, int y, int n) {
+    if (y & 1) {
+        if (getNibble(col, y++))
+            return true;
+        n--;
+    }
+    if (n <= 0)
+        return false;
+    auto p = col + (y >> 1);
+    for (int i = 0; i < n >> 1; ++i)
+        if (p[i])
+            return true;
+    return (n & 1) && getNibble(col, y + n - 1);
+}
+
+// transparent draw (color >= 0) or overlap test (color == -1) of [from] via its spans
+static bool drawSpans(Image_ img, Image_ from, Buffer spans, int x, int y, int color) {
+    auto w = from->width();
+    auto sh = img->height();
+    auto sw = img->width();
+    auto colStart = (uint16_t *)spans->data;
+    auto span = colStart + w + 1;
+    auto fromH = from->byteHeight();
+    auto imgH = img->byteHeight();
+    // source rows visible in the target
+    int minY = max(0, -y), maxY = min((int)from->height(), sh - y);
+
+    for (int xx = max(0, -x); xx < w && x + xx < sw; ++xx) {
+        auto src = from->pix() + fromH * xx;
+        auto dst = img->pix() + imgH * (x + xx);
+        for (int i = colStart[xx]; i < colStart[xx + 1]; ++i) {
+            int top = max((int)span[2 * i], minY);
+            int bot = min(span[2 * i] + span[2 * i + 1], maxY);
+            if (top >= bot)
+                continue;
+            if (color == -1) {
+                if (anyNibble(dst, y + top, bot - top))
+                    return true;
+            } else {
+                copyNibbles(dst, y + top, src, top, bot - top);
+            }
+        }
+    }
+    return false;
+}
+
+// drawImageCore() with an 8 or 16bpp image on either side, a row at a time; 1 and 4bpp images are
+// drawn on 8bpp ones with the same color indices, and on 16bpp ones through palette565
+static bool drawWideImage(Image_ img, Image_ from, int x, int y, int color) {
+    int x0 = max(x, 0), x1 = min(x + from->width(), img->width());
+    int y0 = max(y, 0), y1 = min(y + from->height(), img->height());
+    auto tbp = img->bpp();
+    auto fbp = from->bpp();
+    if (fbp > tbp)
+        return false;
+
+    if (tbp == fbp && color == -2) {
+        int n = (x1 - x0) * (tbp >> 3);
+        for (int yy = y0; yy < y1; ++yy)
+            memcpy(img->pix(x0, yy), from->pix(x0 - x, yy - y), n);
+        return false;
+    }
+
+    for (int yy = y0; yy < y1; ++yy)
+        for (int xx = x0; xx < x1; ++xx) {
+            int c = getCore(from, xx - x, yy - y);
+            if (color == -1) {
+                if (c && getCore(img, xx, yy))
+                    return true;
+                continue;
+            }
+            if (!c && color != -2)
+                continue;
+            if (fbp == 1 && color > 0)
+                c = color;
+            else if (tbp == 16 && fbp <= 4)
+                c = palette565[c];
+            setCore(img, xx, yy, c);
+        }
+    return false;
+}
+
 bool drawImageCore(Image_ img, Image_ from, int x, int y, int color) {
     auto w = from->width();
     auto h = from->height();
@@ -643,9 +1309,19 @@ bool drawImageCore(Image_ img, Image_ from, int x, int y, int color) {
         return false;
     }
 
+    if (tbp >= 8 || fbp >= 8)
+        return drawWideImage(img, from, x, y, color);
+
     // DMESG("drawIMG(%d,%d) at (%d,%d) w=%d bh=%d len=%d",
     //    w,h,x, y, img->width(), img->byteHeight(), len );
 
+    if (tbp == 4 && fbp == 4 && color != -2 && !from->isReadOnly()) {
+        if (!from->spans)
+            from->spans = compileSpans(from);
+        if (from->spans->length)
+            return drawSpans(img, from, from->spans, x, y, color);
+    }
+
     auto fromH = from->byteHeight();
     auto imgH = img->byteHeight();
     auto fromBase = from->pix();
@@ -719,7 +1395,7 @@ bool drawImageCore(Image_ img, Image_ from, int x, int y, int color) {
             if (color >= 0) {
 #define SETHIGH(s) *tdata = (*tdata & 0x0f) | ((COLS(s)) << 4)
 #define SETLOW(s) *tdata = (*tdata & 0xf0) | COLS(s)
-                LOOPS(sh)
+                drawTransparentColumn(img->pix() + imgH * x, fdata, cnt, y, sh, bot);
             } else if (color == -2) {
 #undef COL
 #define COL(s) 1
@@ -828,8 +1504,8 @@ bool drawImageCore(Image_ img, Image_ from, int x, int y, int color) {
  */
 //%
 void drawImage(Image_ img, Image_ from, int x, int y) {
-    img->makeWritable();
-    if (img->bpp() == 4 && from->bpp() == 4) {
+    img->makeWritable(x, y, from->width(), from->height());
+    if (img->bpp() == from->bpp() && img->bpp() != 1) {
         drawImageCore(img, from, x, y, -2);
     } else {
         fillRect(img, x, y, from->width(), from->height(), 0);
@@ -842,10 +1518,68 @@ void drawImage(Image_ img, Image_ from, int x, int y) {
  */
 //%
 void drawTransparentImage(Image_ img, Image_ from, int x, int y) {
-    img->makeWritable();
+    img->makeWritable(x, y, from->width(), from->height());
     drawImageCore(img, from, x, y, 0);
 }
 
+// draw h pixels of a 4bpp column starting at pixel dy of the byte at d, from pixel sy of the byte
+// at s, mapped through lut (see buildByteMap()); transparent source pixels are skipped
+static void drawMappedColumn(uint8_t *d, int dy, const uint8_t *s, int sy, int h,
+                             const uint8_t *lut) {
+    dy &= 1;
+    sy &= 1;
+    if (dy != sy) {
+        for (int i = 0; i < h; ++i, ++dy, ++sy) {
+            auto sp = s + (sy >> 1);
+            int c = sy & 1 ? *sp >> 4 : *sp & 0xf;
+            if (!c)
+                continue;
+            c = lut[c] & 0xf;
+            auto dp = d + (dy >> 1);
+            *dp = dy & 1 ? (*dp & 0x0f) | (c << 4) : (*dp & 0xf0) | c;
+        }
+        return;
+    }
+
+    if (dy) {
+        if (*s & 0xf0)
+            *d = (*d & 0x0f) | (lut[*s] & 0xf0);
+        s++;
+        d++;
+        h--;
+    }
+    for (; h >= 2; h -= 2, s++, d++) {
+        auto v = *s;
+        if (!v)
+            continue;
+        uint8_t mask = ((v & 0x0f) ? 0x0f : 0) | ((v & 0xf0) ? 0xf0 : 0);
+        *d = (*d & ~mask) | (lut[v] & mask);
+    }
+    if (h && (*s & 0x0f))
+        *d = (*d & 0xf0) | (lut[*s] & 0x0f);
+}
+
+/**
+ * Draw an image with transparent background, with each of its colors replaced by the
+ * corresponding entry of the 16 byte map; both images have to be 4 bit per pixel.
+ */
+//%
+void _drawImageMapped(Image_ img, Image_ from, int xy, Buffer map) {
+    if (img->bpp() != 4 || from->bpp() != 4 || map->length < 16)
+        return;
+    int x = XX(xy), y = YY(xy);
+    int x0 = max(x, 0), x1 = min(x + from->width(), img->width());
+    int y0 = max(y, 0), y1 = min(y + from->height(), img->height());
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    img->makeWritable(x0, y0, x1 - x0, y1 - y0);
+    uint8_t lut[256];
+    buildByteMap(map->data, lut);
+    for (int dx = x0; dx < x1; ++dx)
+        drawMappedColumn(img->pix(dx, y0), y0, from->pix(dx - x, y0 - y), y0 - y, y1 - y0, lut);
+}
+
 /**
  * Check if the current image "collides" with another
  */
@@ -854,6 +1588,159 @@ bool overlapsWith(Image_ img, Image_ other, int x, int y) {
     return drawImageCore(img, other, x, y, -1);
 }
 
+// Tile maps, as used by game/tilemap.ts and color-coded-tilemap/tilemap.ts. Every cell of the map
+// is an index into an array of tiles, which are all square and of the same power-of-two size.
+
+// u16 width, u16 height, then a byte per cell, row by row
+struct BufferTileMap {
+    uint8_t *cells;
+    int width, height;
+
+    BufferTileMap(Buffer map) : cells(map->data + 4), width(0), height(0) {
+        if (map->length >= 4) {
+            width = map->data[0] | (map->data[1] << 8);
+            height = map->data[2] | (map->data[3] << 8);
+            if (4 + width * height > map->length)
+                width = height = 0;
+        }
+    }
+    int get(int x, int y) { return cells[x + y * width]; }
+};
+
+// color of a pixel is the index
+struct ImageTileMap {
+    Image_ map;
+    int width, height;
+
+    ImageTileMap(Image_ map) : map(map), width(map->width()), height(map->height()) {}
+    int get(int x, int y) { return getCore(map, x, y); }
+};
+
+static Image_ tileAt(RefCollection *tiles, int idx) {
+    if (idx >= (int)tiles->length())
+        return NULL;
+    auto t = tiles->getAt(idx);
+    if (getAnyVTable(t) != &RefImage_vtable)
+        return NULL;
+    return (Image_)t;
+}
+
+// log2 of the size of the tiles, or -1 if there are none
+static int tileScale(RefCollection *tiles) {
+    for (unsigned i = 0; i < tiles->length(); ++i) {
+        auto t = tileAt(tiles, i);
+        if (!t)
+            continue;
+        for (int scale = 0; scale < 8; ++scale)
+            if (t->width() == (1 << scale))
+                return scale;
+        return -1;
+    }
+    return -1;
+}
+
+// Draws the tiles covering img, when it shows the map starting at (offX, offY), the way
+// TileMap.draw() does. Cells outside of the map use tile 0.
+template <typename TileMap>
+static void drawTilesCore(Image_ img, RefCollection *tiles, TileMap &map, int offX, int offY) {
+    int scale = tileScale(tiles);
+    if (scale < 0)
+        return;
+
+    int mask = (1 << scale) - 1;
+    int x0 = max(0, offX >> scale);
+    int xn = min(map.width, ((offX + img->width()) >> scale) + 1);
+    int y0 = max(0, offY >> scale);
+    int yn = min(map.height, ((offY + img->height()) >> scale) + 1);
+    offX &= mask;
+    offY &= mask;
+
+    img->makeWritable();
+
+    for (int x = x0; x <= xn; ++x) {
+        auto px = ((x - x0) << scale) - offX;
+        for (int y = y0; y <= yn; ++y) {
+            int idx = x < map.width && y < map.height ? map.get(x, y) : 0;
+            auto tile = tileAt(tiles, idx);
+            if (tile)
+                drawImageCore(img, tile, px, ((y - y0) << scale) - offY, 0);
+        }
+    }
+}
+
+//%
+void _drawTiles(Image_ img, RefCollection *tiles, Buffer map, int xy) {
+    BufferTileMap m(map);
+    drawTilesCore(img, tiles, m, XX(xy), YY(xy));
+}
+
+//%
+void _drawColorTiles(Image_ img, RefCollection *tiles, Image_ map, int xy) {
+    ImageTileMap m(map);
+    drawTilesCore(img, tiles, m, XX(xy), YY(xy));
+}
+
+struct CompressedDraw {
+    Image_ img;
+    int x, y;
+    bool transparent;
+};
+
+static void drawCompressedRun(void *ctx, int x, int y, int n, int c, const uint8_t *data) {
+    auto d = (CompressedDraw *)ctx;
+    x += d->x;
+    y += d->y;
+    if (n > 0) {
+        if (c || !d->transparent)
+            fillSpan(d->img, x, y, y + n - 1, c);
+        return;
+    }
+    for (int k = 0; k < -n; ++k) {
+        c = nibbleAt(data, k);
+        if ((c || !d->transparent) && 0 <= y + k && y + k < d->img->height())
+            setCore(d->img, x, y + k, c);
+    }
+}
+
+// draw a compressed image straight from its buffer
+static void drawCompressed(Image_ img, Buffer buf, int x, int y, bool transparent) {
+    auto hd = (ImageHeader *)buf->data;
+    if (x >= img->width() || y >= img->height() || x + hd->width <= 0 || y + hd->height <= 0)
+        return;
+    img->makeWritable(x, y, hd->width, hd->height);
+    CompressedDraw d = {img, x, y, transparent};
+    forCompressedRuns(buf, -x, img->width() - 1 - x, drawCompressedRun, &d);
+}
+
+/**
+ * Draw an image compressed with compressed() straight from its buffer, without decompressing it
+ * first; with transparent set, color 0 is not drawn.
+ */
+//%
+void _drawCompressed(Image_ img, Buffer data, int xy, bool transparent) {
+    if (isCompressedImage(data))
+        drawCompressed(img, data, XX(xy), YY(xy), transparent);
+}
+
+/**
+ * Returns the image run-length encoded for drawCompressed() and image.ofBuffer(), or null if it is
+ * not 4 bit per pixel.
+ */
+//%
+Buffer compressed(Image_ img) {
+    if (img->bpp() != 4)
+        return NULL;
+    auto r = mkBuffer(NULL, compressImage(img, NULL));
+    compressImage(img, r->data);
+    auto hd = (ImageHeader *)r->data;
+    hd->magic = IMAGE_RLE_MAGIC;
+    hd->bpp = 4;
+    hd->width = img->width();
+    hd->height = img->height();
+    hd->padding = 0;
+    return r;
+}
+
 // Image_ format (legacy)
 //  byte 0: magic 0xe4 - 4 bit color; 0xe1 is monochromatic
 //  byte 1: width in pixels
@@ -866,6 +1753,16 @@ Image_ convertAndWrap(Buffer buf) {
     if (isValidImage(buf))
         return NEW_GC(RefImage, buf);
 
+    if (isCompressedImage(buf)) {
+        auto hd = (ImageHeader *)buf->data;
+        auto r = mkImage(hd->width, hd->height, 4);
+        if (r) {
+            memset(r->pix(), 0, r->pixLength());
+            drawCompressed(r, buf, 0, 0, false);
+        }
+        return r;
+    }
+
     // What follows in this function is mostly dead code, except if people construct image buffers
     // by hand. Probably safe to remove in a year (middle of 2020) or so. When removing, also remove
     // from sim.
@@ -890,12 +1787,12 @@ Image_ convertAndWrap(Buffer buf) {
 
 //%
 void _drawIcon(Image_ img, Buffer icon, int xy, int c) {
-    img->makeWritable();
-
     auto iconImg = convertAndWrap(icon);
     if (!iconImg || iconImg->bpp() != 1)
         return;
 
+    img->makeWritable(XX(xy), YY(xy), iconImg->width(), iconImg->height());
+
     drawImageCore(img, iconImg, XX(xy), YY(xy), c);
 }
 
@@ -911,6 +1808,21 @@ static void drawLineLow(Image_ img, int x0, int y0, int x1, int y1, int c) {
     dx <<= 1;
     dy <<= 1;
     int y = y0;
+    if (img->bpp() == 4) {
+        // one pixel per column; walk the buffer instead of computing every address
+        auto bh = img->byteHeight();
+        auto p = img->pix(x0, 0);
+        c &= 0xf;
+        for (int x = x0; x <= x1; ++x, p += bh) {
+            setNibble(p, y, c);
+            if (D > 0) {
+                y += yi;
+                D -= dx;
+            }
+            D += dy;
+        }
+        return;
+    }
     for (int x = x0; x <= x1; ++x) {
         setCore(img, x, y, c);
         if (D > 0) {
@@ -933,11 +1845,16 @@ static void drawLineHigh(Image_ img, int x0, int y0, int x1, int y1, int c) {
     dx <<= 1;
     dy <<= 1;
     int x = x0;
+    // fill the run of pixels in a column at once
+    int runStart = y0;
+    auto f = img->fillMask(c);
     for (int y = y0; y <= y1; ++y) {
-        setCore(img, x, y, c);
+        if (D > 0 || y == y1)
+            fillColumn(img, img->pix(x, runStart), runStart, y - runStart + 1, f, c);
         if (D > 0) {
             x += xi;
             D -= dy;
+            runStart = y + 1;
         }
         D += dx;
     }
@@ -1005,7 +1922,7 @@ void drawLine(Image_ img, int x0, int y0, int x1, int y1, int c) {
         }
     }
 
-    img->makeWritable();
+    img->makeWritable(x0, min(y0, y1), x1 - x0 + 1, abs(y1 - y0) + 1);
 
     if (h < 0) {
         h = -h;
@@ -1043,24 +1960,32 @@ void blitRow(Image_ img, int x, int y, Image_ from, int fromX, int fromH) {
         y = 0;
     }
 
+    img->makeWritable(x, y, 1, endY - y);
+
     auto dp = img->pix(x, y);
     auto sp = from->pix(fromX, 0);
+    int n = endY - y;
+    if (n <= 0)
+        return;
 
-    while (y < endY) {
-        int p = fy >> 16, c;
-        if (p & 1)
-            c = sp[p >> 1] >> 4;
-        else
-            c = sp[p >> 1] & 0xf;
-        if (y & 1) {
-            *dp = (*dp & 0x0f) | (c << 4);
-            dp++;
-        } else {
-            *dp = (*dp & 0xf0) | (c & 0xf);
-        }
-        y++;
+    // texel at 16.16 fixed point row fy
+#define TEXEL(fy) ((sp[(fy) >> 17] >> (((fy) >> 14) & 4)) & 0xf)
+    if (y & 1) {
+        *dp = (*dp & 0x0f) | (TEXEL(fy) << 4);
+        dp++;
+        fy += stepFY;
+        n--;
+    }
+    // two pixels per byte
+    for (; n >= 2; n -= 2) {
+        int c0 = TEXEL(fy);
+        fy += stepFY;
+        *dp++ = c0 | (TEXEL(fy) << 4);
         fy += stepFY;
     }
+    if (n)
+        *dp = (*dp & 0xf0) | TEXEL(fy);
+#undef TEXEL
 }
 
 //%
@@ -1068,18 +1993,174 @@ void _blitRow(Image_ img, int xy, Image_ from, int xh) {
     blitRow(img, XX(xy), YY(xy), from, XX(xh), YY(xh));
 }
 
+/**
+ * Scale and copy columns of pixels from a texture, as blitRow() does, for a whole frame at once.
+ * columns holds Int16LE triples of destination x, texture x and height; every column is centered
+ * vertically in the current image.
+ */
+//%
+void blitColumns(Image_ img, Image_ from, Buffer columns) {
+    auto p = columns->data;
+    int h = img->height();
+    for (int i = 0; i + 6 <= (int)columns->length; i += 6) {
+        int16_t v[3];
+        memcpy(v, p + i, sizeof(v));
+        blitRow(img, v[0], (h - v[2]) >> 1, from, v[1], v[2]);
+    }
+}
+
+static inline int64_t floorDiv(int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// narrow [*lo, *hi) to t where 0 <= s + t * d < len
+static void clipSpan(int64_t s, int64_t d, int64_t len, int *lo, int *hi) {
+    int64_t a, b;
+    if (d == 0) {
+        if (s < 0 || s >= len)
+            *hi = *lo;
+        return;
+    }
+    if (d > 0) {
+        a = -floorDiv(s, d);
+        b = floorDiv(len - 1 - s, d) + 1;
+    } else {
+        a = -floorDiv(len - 1 - s, -d);
+        b = floorDiv(s, -d) + 1;
+    }
+    if (a > *lo)
+        *lo = a > *hi ? *hi : (int)a;
+    if (b < *hi)
+        *hi = b < *lo ? *lo : (int)b;
+}
+
+#define FX_ONE (1 << 16)
+
+/**
+ * Draw `from` transparently, mapping its pixels by the 16.16 fixed point matrix m (m00, m01, m10,
+ * m11) around its center, which ends up at (x, y). Both images have to be 4bpp.
+ */
+void drawTransformed(Image_ img, Image_ from, int x, int y, const int32_t *m) {
+    if (img->bpp() != 4 || from->bpp() != 4)
+        return;
+
+    for (int i = 0; i < 4; ++i)
+        if (m[i] >= 128 * FX_ONE || m[i] <= -128 * FX_ONE)
+            return;
+
+    // destination to source
+    int64_t det = (int64_t)m[0] * m[3] - (int64_t)m[1] * m[2];
+    if (det == 0)
+        return;
+    int64_t inv[4] = {((int64_t)m[3] << 32) / det, -((int64_t)m[1] << 32) / det,
+                      -((int64_t)m[2] << 32) / det, ((int64_t)m[0] << 32) / det};
+    for (int i = 0; i < 4; ++i)
+        if (inv[i] >= (1 << 30) || inv[i] <= -(1 << 30))
+            return;
+    int32_t i00 = inv[0], i01 = inv[1], i10 = inv[2], i11 = inv[3];
+
+    int w = from->width(), h = from->height();
+    int sw = img->width(), sh = img->height();
+
+    // bounding box of the corners
+    int64_t cx = (int64_t)w << 15, cy = (int64_t)h << 15;
+    int64_t ex = (abs(m[0]) * cx + abs(m[1]) * cy) >> 16;
+    int64_t ey = (abs(m[2]) * cx + abs(m[3]) * cy) >> 16;
+    int x0 = max(((((int64_t)x << 16) - ex) >> 16), (int64_t)0);
+    int x1 = min(((((int64_t)x << 16) + ex) >> 16) + 1, (int64_t)sw);
+    int y0 = max(((((int64_t)y << 16) - ey) >> 16), (int64_t)0);
+    int y1 = min(((((int64_t)y << 16) + ey) >> 16) + 1, (int64_t)sh);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    img->makeWritable(x0, y0, x1 - x0, y1 - y0);
+
+    auto dbh = img->byteHeight();
+    auto sbh = from->byteHeight();
+    auto src = from->pix();
+    // steps down a column of the destination
+    bool fixedColumn = i01 == 0 && (i11 == FX_ONE || i11 == -FX_ONE);
+    bool fixedRow = i11 == 0 && (i01 == FX_ONE || i01 == -FX_ONE);
+
+    int64_t ry = (((int64_t)(y0 - y)) << 16) + (FX_ONE >> 1);
+    for (int dx = x0; dx < x1; ++dx) {
+        // source position of the center of the top pixel
+        int64_t rx = (((int64_t)(dx - x)) << 16) + (FX_ONE >> 1);
+        int64_t sx = ((i00 * rx + i01 * ry) >> 16) + cx;
+        int64_t sy = ((i10 * rx + i11 * ry) >> 16) + cy;
+
+        int lo = 0, hi = y1 - y0;
+        clipSpan(sx, i01, (int64_t)w << 16, &lo, &hi);
+        clipSpan(sy, i11, (int64_t)h << 16, &lo, &hi);
+        if (lo >= hi)
+            continue;
+
+        int32_t px = sx + (int64_t)lo * i01;
+        int32_t py = sy + (int64_t)lo * i11;
+        auto dst = img->pix() + dbh * dx;
+        int dy = y0 + lo, end = y0 + hi;
+
+        if (fixedColumn) {
+            // 0 and 180 degrees, flips
+            auto col = src + sbh * (px >> 16);
+            int row = py >> 16, step = i11 >> 16;
+            for (; dy < end; ++dy, row += step) {
+                auto c = getNibble(col, row);
+                if (c)
+                    setNibble(dst, dy, c);
+            }
+        } else if (fixedRow) {
+            // 90 and 270 degrees
+            int row = py >> 16;
+            auto sp = src + sbh * (px >> 16) + (row >> 1);
+            int shift = (row & 1) * 4, step = (i01 >> 16) * sbh;
+            for (; dy < end; ++dy, sp += step) {
+                auto c = (*sp >> shift) & 0xf;
+                if (c)
+                    setNibble(dst, dy, c);
+            }
+        } else {
+            for (; dy < end; ++dy, px += i01, py += i11) {
+                auto c = getNibble(src + sbh * (px >> 16), py >> 16);
+                if (c)
+                    setNibble(dst, dy, c);
+            }
+        }
+    }
+}
+
+//%
+void _drawTransformed(Image_ img, Image_ from, int xy, Buffer matrix) {
+    int32_t m[4];
+    if (matrix->length < (int)sizeof(m))
+        return;
+    memcpy(m, matrix->data, sizeof(m));
+    drawTransformed(img, from, XX(xy), YY(xy), m);
+}
+
 void fillCircle(Image_ img, int cx, int cy, int r, int c) {
+    if (r <= 0)
+        return;
+
     int x = r - 1;
     int y = 0;
     int dx = 1;
     int dy = 1;
     int err = dx - (r << 1);
+    int lastY = -1;
 
+    img->makeWritable(cx - r, cy - r, 2 * r + 1, 2 * r + 1);
+
+    // Each column is filled once, with its tallest span: columns cx +/- y the first time y is
+    // seen, and columns cx +/- x just before x changes.
     while (x >= y) {
-        fillRect(img, cx + x, cy - y, 1, 1 + (y << 1), c);
-        fillRect(img, cx + y, cy - x, 1, 1 + (x << 1), c);
-        fillRect(img, cx - x, cy - y, 1, 1 + (y << 1), c);
-        fillRect(img, cx - y, cy - x, 1, 1 + (x << 1), c);
+        if (y != lastY) {
+            fillSpan(img, cx + y, cy - x, cy + x, c);
+            if (y)
+                fillSpan(img, cx - y, cy - x, cy + x, c);
+            lastY = y;
+        }
+        int px = x, py = y;
         if (err <= 0) {
             ++y;
             err += dy;
@@ -1089,6 +2170,11 @@ void fillCircle(Image_ img, int cx, int cy, int r, int c) {
             dx += 2;
             err += dx - (r << 1);
         }
+        if (x != px || x < y) {
+            fillSpan(img, cx + px, cy - py, cy + py, c);
+            if (px)
+                fillSpan(img, cx - px, cy - py, cy + py, c);
+        }
     }
 }
 
@@ -1097,6 +2183,504 @@ void _fillCircle(Image_ img, int cxy, int r, int c) {
     fillCircle(img, XX(cxy), YY(cxy), r, c);
 }
 
+// y where the segment crosses the left and right edge of column x, widened by the end points
+static void edgeSpan(int ax, int ay, int bx, int by, int x, int *top, int *bot) {
+    if (ax > bx) {
+        swap(ax, bx);
+        swap(ay, by);
+    }
+    if (x < ax || x > bx)
+        return;
+    if (ax == bx) {
+        *top = min(*top, min(ay, by));
+        *bot = max(*bot, max(ay, by));
+        return;
+    }
+    // at x - 1/2 and x + 1/2 (in half pixels), rounded to nearest
+    int64_t den = 2 * (int64_t)(bx - ax);
+    int ends[2] = {max(2 * ax, 2 * x - 1), min(2 * bx, 2 * x + 1)};
+    for (int x2 : ends) {
+        int64_t num = (int64_t)(by - ay) * (x2 - 2 * ax);
+        int y = ay + (int)floorDiv(2 * num + den, 2 * den);
+        *top = min(*top, y);
+        *bot = max(*bot, y);
+    }
+}
+
+/**
+ * Fill a convex polygon with n vertices (x, y pairs in pts), column by column.
+ */
+void fillPolygon(Image_ img, const int32_t *pts, int n, int c) {
+    if (n < 1)
+        return;
+
+    int x0 = pts[0], x1 = pts[0], y0 = pts[1], y1 = pts[1];
+    for (int i = 1; i < n; ++i) {
+        x0 = min(x0, (int)pts[2 * i]);
+        x1 = max(x1, (int)pts[2 * i]);
+        y0 = min(y0, (int)pts[2 * i + 1]);
+        y1 = max(y1, (int)pts[2 * i + 1]);
+    }
+    x0 = max(x0, 0);
+    x1 = min(x1, img->width() - 1);
+    if (x0 > x1 || y1 < 0 || y0 >= img->height())
+        return;
+
+    img->makeWritable(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+
+    for (int x = x0; x <= x1; ++x) {
+        int top = INT_MAX, bot = INT_MIN;
+        for (int i = 0; i < n; ++i) {
+            int j = i + 1 == n ? 0 : i + 1;
+            edgeSpan(pts[2 * i], pts[2 * i + 1], pts[2 * j], pts[2 * j + 1], x, &top, &bot);
+        }
+        if (top <= bot)
+            fillSpan(img, x, top, bot, c);
+    }
+}
+
+//%
+void _fillPolygon(Image_ img, Buffer points, int n, int c) {
+    int32_t pts[2 * PXT_POLYGON_MAX_POINTS];
+    n = min(n, PXT_POLYGON_MAX_POINTS);
+    if (n <= 0 || points->length < 8 * n)
+        return;
+    memcpy(pts, points->data, 8 * n);
+    fillPolygon(img, pts, n, c);
+}
+
+// drawTransparentImage() mirrored horizontally (flip & 1) and/or vertically (flip & 2), reading
+// from in reverse rather than making a flipped copy of it
+static void drawFlippedImage(Image_ img, Image_ from, int x, int y, int flip) {
+    int w = from->width(), h = from->height();
+    int x0 = max(x, 0), x1 = min(x + w, img->width());
+    int y0 = max(y, 0), y1 = min(y + h, img->height());
+    if (x0 >= x1 || y0 >= y1 || from->bpp() > img->bpp())
+        return;
+    img->makeWritable(x, y, w, h);
+    bool remap = img->bpp() == 16 && from->bpp() <= 4;
+    for (int yy = y0; yy < y1; ++yy) {
+        int sy = (flip & 2) ? y + h - 1 - yy : yy - y;
+        for (int xx = x0; xx < x1; ++xx) {
+            int c = getCore(from, (flip & 1) ? x + w - 1 - xx : xx - x, sy);
+            if (c)
+                setCore(img, xx, yy, remap ? palette565[c] : c);
+        }
+    }
+}
+
+// Draw lists (image.DrawList in image.ts): a buffer starting with the number of records as a
+// uint32, followed by the records. Image operations refer to an array of images by index.
+enum class DrawOp : uint8_t {
+    SetPixel = 1,       // x, y
+    FillRect = 2,       // x, y, a = width, b = height
+    DrawLine = 3,       // x, y to a, b
+    FillCircle = 4,     // center x, y, radius a
+    DrawImage = 5,      // images[a] at x, y
+    DrawTransparentImage = 6,
+    DrawFlippedImage = 7, // images[a] at x, y, transparent and mirrored as color says, see above
+};
+
+struct DrawRecord {
+    DrawOp op;
+    uint8_t color;
+    int16_t z;
+    int16_t x, y, a, b;
+};
+
+#define DRAW_LIST_HEADER 4
+
+static inline uint32_t drawListLength(Buffer ops) {
+    uint32_t n;
+    if (ops->length < DRAW_LIST_HEADER)
+        return 0;
+    memcpy(&n, ops->data, 4);
+    return min(n, (uint32_t)((ops->length - DRAW_LIST_HEADER) / sizeof(DrawRecord)));
+}
+
+/**
+ * Append a record to a draw list; returns false when the buffer is full.
+ */
+//%
+bool _drawListPush(Buffer ops, int opz, int xy, int ab) {
+    if (ops->length < DRAW_LIST_HEADER)
+        return false;
+    uint32_t n;
+    memcpy(&n, ops->data, 4);
+    if (DRAW_LIST_HEADER + (n + 1) * sizeof(DrawRecord) > (unsigned)ops->length)
+        return false;
+    DrawRecord r = {(DrawOp)(opz & 0xff), (uint8_t)(opz >> 8), (int16_t)(opz >> 16),
+                    (int16_t)XX(xy),      (int16_t)YY(xy),    (int16_t)XX(ab),
+                    (int16_t)YY(ab)};
+    memcpy(ops->data + DRAW_LIST_HEADER + n * sizeof(DrawRecord), &r, sizeof(r));
+    n++;
+    memcpy(ops->data, &n, 4);
+    return true;
+}
+
+static inline int drawRecordZ(const uint8_t *recs, uint32_t i) {
+    int16_t z;
+    memcpy(&z, recs + i * sizeof(DrawRecord) + 2, 2); // DrawRecord::z
+    return z;
+}
+
+static Image_ drawListImage(RefCollection *images, int idx) {
+    return tileAt(images, (uint16_t)idx);
+}
+
+// bounding box test against the target
+static bool drawRecordVisible(Image_ img, RefCollection *images, DrawRecord &r) {
+    int x0 = r.x, y0 = r.y, x1 = r.x, y1 = r.y;
+    switch (r.op) {
+    case DrawOp::SetPixel:
+        break;
+    case DrawOp::FillRect:
+        x1 += r.a - 1;
+        y1 += r.b - 1;
+        break;
+    case DrawOp::DrawLine:
+        x0 = min(r.x, r.a);
+        x1 = max(r.x, r.a);
+        y0 = min(r.y, r.b);
+        y1 = max(r.y, r.b);
+        break;
+    case DrawOp::FillCircle:
+        x0 -= r.a;
+        y0 -= r.a;
+        x1 += r.a;
+        y1 += r.a;
+        break;
+    case DrawOp::DrawImage:
+    case DrawOp::DrawTransparentImage:
+    case DrawOp::DrawFlippedImage: {
+        auto from = drawListImage(images, r.a);
+        if (!from)
+            return false;
+        x1 += from->width() - 1;
+        y1 += from->height() - 1;
+        break;
+    }
+    default:
+        return false;
+    }
+    return x0 <= x1 && y0 <= y1 && x1 >= 0 && y1 >= 0 && x0 < img->width() && y0 < img->height();
+}
+
+/**
+ * Run the operations of a draw list on img, ordered by z; records with equal z keep their order.
+ * Operations entirely outside of img are skipped.
+ */
+//%
+void _drawList(Image_ img, Buffer ops, RefCollection *images) {
+    auto n = drawListLength(ops);
+    if (!n)
+        return;
+
+    auto recs = ops->data + DRAW_LIST_HEADER;
+
+    // usually the records come in order already
+    uint16_t *order = NULL;
+    for (uint32_t i = 1; i < n; ++i)
+        if (drawRecordZ(recs, i) < drawRecordZ(recs, i - 1)) {
+            n = min(n, (uint32_t)0xffff);
+            order = (uint16_t *)xmalloc(n * sizeof(uint16_t));
+            for (uint32_t j = 0; j < n; ++j) {
+                // stable insertion
+                auto z = drawRecordZ(recs, j);
+                uint32_t k = j;
+                while (k > 0 && drawRecordZ(recs, order[k - 1]) > z) {
+                    order[k] = order[k - 1];
+                    k--;
+                }
+                order[k] = j;
+            }
+            break;
+        }
+
+    for (uint32_t i = 0; i < n; ++i) {
+        DrawRecord r;
+        memcpy(&r, recs + (order ? order[i] : i) * sizeof(DrawRecord), sizeof(r));
+        if (!drawRecordVisible(img, images, r))
+            continue;
+        switch (r.op) {
+        case DrawOp::SetPixel:
+            setPixel(img, r.x, r.y, r.color);
+            break;
+        case DrawOp::FillRect:
+            fillRect(img, r.x, r.y, r.a, r.b, r.color);
+            break;
+        case DrawOp::DrawLine:
+            drawLine(img, r.x, r.y, r.a, r.b, r.color);
+            break;
+        case DrawOp::FillCircle:
+            fillCircle(img, r.x, r.y, r.a, r.color);
+            break;
+        case DrawOp::DrawImage:
+            drawImage(img, drawListImage(images, r.a), r.x, r.y);
+            break;
+        case DrawOp::DrawTransparentImage:
+            drawTransparentImage(img, drawListImage(images, r.a), r.x, r.y);
+            break;
+        case DrawOp::DrawFlippedImage:
+            drawFlippedImage(img, drawListImage(images, r.a), r.x, r.y, r.color);
+            break;
+        }
+    }
+
+    if (order)
+        xfree(order);
+}
+
+// must match imagePrint() in text.ts
+#define TEXT_ARGS_SIZE 10
+
+static int readInt16(const uint8_t *p) {
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+// next character code of UTF-8 data, advancing p
+static int nextCharCode(const uint8_t *&p, const uint8_t *end) {
+    int c = *p++;
+    int extra = (c & 0xe0) == 0xc0 ? 1 : (c & 0xf0) == 0xe0 ? 2 : (c & 0xf8) == 0xf0 ? 3 : 0;
+    if (extra) {
+        if (end - p < extra)
+            return c; // truncated
+        c &= 0x3f >> extra;
+        while (extra--)
+            c = (c << 6) | (*p++ & 0x3f);
+    }
+    return c;
+}
+
+// the glyph data for character code ch; the font is sorted by code, and usually starts at space
+// with no gaps; missing characters use the first glyph
+static const uint8_t *fontGlyph(Buffer font, int glyphSize, int ch) {
+    int n = font->length / glyphSize;
+    auto data = font->data;
+    int guess = (ch - 32) * glyphSize;
+    if (0 <= guess && guess + glyphSize <= font->length && (data[guess] | data[guess + 1] << 8) == ch)
+        return data + guess + 2;
+    int l = 0, r = n - 1;
+    while (l <= r) {
+        int m = l + ((r - l) >> 1);
+        int v = data[m * glyphSize] | data[m * glyphSize + 1] << 8;
+        if (v == ch)
+            return data + m * glyphSize + 2;
+        if (v < ch)
+            l = m + 1;
+        else
+            r = m - 1;
+    }
+    return data + 2;
+}
+
+// draw 1bpp glyph columns (bit 0 at the top), each pixel as a mult x mult square
+static void drawGlyph(Image_ img, const uint8_t *glyph, int x, int y, int dataW, int dataH,
+                      int mult, int c) {
+    int byteHeight = (dataH + 7) >> 3;
+    img->makeWritable(x, y, dataW * mult, dataH * mult);
+    for (int i = 0; i < dataW; ++i, glyph += byteHeight) {
+        int j = 0;
+        while (j < dataH) {
+            int n = 0;
+            while (j + n < dataH && (glyph[(j + n) >> 3] & (1 << ((j + n) & 7))))
+                n++;
+            if (!n) {
+                j++;
+                continue;
+            }
+            for (int k = 0; k < mult; ++k)
+                fillSpan(img, x + i * mult + k, y + j * mult, y + (j + n) * mult - 1, c);
+            j += n;
+        }
+    }
+}
+
+// Fonts from `font-compiler.js --native`, with the glyphs laid out for drawing: a header of
+// UInt16LE magic, bytes glyph width and height, and UInt16LE number of glyphs and of kerning
+// pairs; the sorted UInt16LE character codes of the glyphs; a byte advance for each, padded to a
+// word; the kerning pairs, each UInt16LE left and right code, Int16LE adjustment and padding,
+// sorted by code; and the glyphs, as the pixels of 4bpp images with 1 where there is ink.
+#define NATIVE_FONT_MAGIC 0xdf4e // a low surrogate, which an old font can't start with
+#define NATIVE_FONT_HEADER 8
+#define NATIVE_FONT_PAIR 8
+
+struct NativeFont {
+    const uint8_t *codes, *advances, *pairs, *glyphs;
+    int numGlyphs, numPairs;
+    int width, height, columnBytes;
+};
+
+static inline int readUInt16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static bool readNativeFont(Buffer font, NativeFont *f) {
+    auto d = font->data;
+    if (font->length < NATIVE_FONT_HEADER || readUInt16(d) != NATIVE_FONT_MAGIC)
+        return false;
+    f->width = d[2];
+    f->height = d[3];
+    f->numGlyphs = readUInt16(d + 4);
+    f->numPairs = readUInt16(d + 6);
+    f->columnBytes = ((f->height * 4 + 31) >> 5) << 2;
+    int off = NATIVE_FONT_HEADER;
+    f->codes = d + off;
+    off += 2 * f->numGlyphs;
+    f->advances = d + off;
+    off = (off + f->numGlyphs + 3) & ~3;
+    f->pairs = d + off;
+    off += NATIVE_FONT_PAIR * f->numPairs;
+    f->glyphs = d + off;
+    off += f->numGlyphs * f->width * f->columnBytes;
+    return f->numGlyphs > 0 && off <= (int)font->length;
+}
+
+// the index of the glyph for ch, like fontGlyph()
+static int nativeGlyph(const NativeFont *f, int ch) {
+    int guess = ch - 32;
+    if (0 <= guess && guess < f->numGlyphs && readUInt16(f->codes + 2 * guess) == ch)
+        return guess;
+    int l = 0, r = f->numGlyphs - 1;
+    while (l <= r) {
+        int m = l + ((r - l) >> 1);
+        int v = readUInt16(f->codes + 2 * m);
+        if (v == ch)
+            return m;
+        if (v < ch)
+            l = m + 1;
+        else
+            r = m - 1;
+    }
+    return 0;
+}
+
+// how much closer (when negative) right is to be drawn after left
+static int nativeKerning(const NativeFont *f, int left, int right) {
+    if (left > 0xffff || right > 0xffff)
+        return 0;
+    uint32_t key = ((uint32_t)left << 16) | right;
+    int l = 0, r = f->numPairs - 1;
+    while (l <= r) {
+        int m = l + ((r - l) >> 1);
+        auto p = f->pairs + m * NATIVE_FONT_PAIR;
+        uint32_t v = ((uint32_t)readUInt16(p) << 16) | readUInt16(p + 2);
+        if (v == key)
+            return readInt16(p + 4);
+        if (v < key)
+            l = m + 1;
+        else
+            r = m - 1;
+    }
+    return 0;
+}
+
+// draw glyph g, each pixel as a mult x mult square; unscaled on a 4bpp image, the columns are
+// merged a word (8 pixels) at a time
+static void drawNativeGlyph(Image_ img, const NativeFont *f, int g, int x, int y, int mult, int c) {
+    auto glyph = f->glyphs + g * f->width * f->columnBytes;
+    img->makeWritable(x, y, f->width * mult, f->height * mult);
+    if (mult == 1 && img->bpp() == 4) {
+        uint32_t col[32]; // columnBytes is at most 128
+        int cnt = f->columnBytes >> 2;
+        int sh = img->height(), bot = min(sh, y + f->height);
+        for (int i = 0; i < f->width; ++i, glyph += f->columnBytes) {
+            if (x + i < 0 || x + i >= img->width())
+                continue;
+            memcpy(col, glyph, f->columnBytes);
+            // the nibbles are 0 or 1
+            for (int k = 0; k < cnt; ++k)
+                col[k] *= c;
+            drawTransparentColumn(img->pix(x + i, 0), col, cnt, y, sh, bot);
+        }
+        return;
+    }
+    for (int i = 0; i < f->width; ++i, glyph += f->columnBytes) {
+        int j = 0;
+        while (j < f->height) {
+            int n = 0;
+            while (j + n < f->height && getNibble(glyph, j + n))
+                n++;
+            if (!n) {
+                j++;
+                continue;
+            }
+            for (int k = 0; k < mult; ++k)
+                fillSpan(img, x + i * mult + k, y + j * mult, y + (j + n) * mult - 1, c);
+            j += n;
+        }
+    }
+}
+
+static void drawNativeText(Image_ img, String text, const NativeFont *f, int x, int y,
+                           int lineHeight, int mult, int c) {
+    int x0 = x, prev = -1;
+    auto p = (const uint8_t *)text->getUTF8Data();
+    auto end = p + text->getUTF8Size();
+    while (p < end) {
+        int ch = nextCharCode(p, end);
+        if (ch == 10) {
+            y += lineHeight;
+            x = x0;
+            prev = -1;
+        }
+        if (ch < 32)
+            continue; // skip control chars
+        if (prev >= 0 && f->numPairs)
+            x += nativeKerning(f, prev, ch) * mult;
+        int g = nativeGlyph(f, ch);
+        if (x < img->width() && x + f->width * mult > 0 && y < img->height() &&
+            y + f->height * mult > 0)
+            drawNativeGlyph(img, f, g, x, y, mult, c);
+        x += f->advances[g] * mult;
+        prev = ch;
+    }
+}
+
+/**
+ * Draw text with a bitmap font, in one pass over its characters. args holds Int16LE x, y and
+ * line height, followed by bytes color, glyph width, glyph height and scale; fonts in the native
+ * layout (see NativeFont) have their own glyph width and height.
+ */
+//%
+void _drawText(Image_ img, String text, Buffer font, Buffer args) {
+    if (!text || args->length < TEXT_ARGS_SIZE)
+        return;
+    int x = readInt16(args->data);
+    int y = readInt16(args->data + 2);
+    int lineHeight = readInt16(args->data + 4);
+    int c = args->data[6];
+    int dataW = args->data[7];
+    int dataH = args->data[8];
+    int mult = max((int)args->data[9], 1);
+
+    NativeFont nf;
+    if (readNativeFont(font, &nf)) {
+        drawNativeText(img, text, &nf, x, y, lineHeight, mult, c & 0xf);
+        return;
+    }
+
+    int glyphSize = 2 + ((dataH + 7) >> 3) * dataW;
+    if (font->length < glyphSize)
+        return;
+
+    int x0 = x;
+    auto p = (const uint8_t *)text->getUTF8Data();
+    auto end = p + text->getUTF8Size();
+    while (p < end) {
+        int ch = nextCharCode(p, end);
+        if (ch == 10) {
+            y += lineHeight;
+            x = x0;
+        }
+        if (ch < 32)
+            continue; // skip control chars
+        if (x < img->width() && x + dataW * mult > 0 && y < img->height() && y + dataH * mult > 0)
+            drawGlyph(img, fontGlyph(font, glyphSize, ch), x, y, dataW, dataH, mult, c);
+        x += dataW * mult;
+    }
+}
+
 } // namespace ImageMethods
 
 namespace image {
@@ -1113,6 +2697,18 @@ Image_ create(int width, int height) {
     return r;
 }
 
+/**
+ * Create new empty image with given bits per pixel: 1, 4, or on hosted targets 8 (256 color
+ * palette) and 16 (RGB565); returns null for other values.
+ */
+//%
+Image_ createWithBpp(int width, int height, int bpp) {
+    Image_ r = mkImage(width, height, bpp);
+    if (r)
+        memset(r->pix(), 0, r->pixLength());
+    return r;
+}
+
 /**
  * Create new image with given content
  */
@@ -67,6 +67,34 @@ interface Image {
     //% helper=imageFillCircle
     fillCircle(cx: number, cy: number, r: number, c: color): void;
 
+    /**
+     * Fills a triangle
+     */
+    //% helper=imageFillTriangle
+    fillTriangle(x0: number, y0: number, x1: number, y1: number, x2: number, y2: number, c: color): void;
+
+    /**
+     * Fills a convex quadrilateral, with the corners given in order
+     */
+    //% helper=imageFillPolygon4
+    fillPolygon4(x0: number, y0: number, x1: number, y1: number, x2: number, y2: number, x3: number, y3: number, c: color): void;
+
+    /**
+     * Draw an image with transparent background, with each of its colors replaced by the
+     * corresponding entry of the 16 byte `map`, eg. for fades or flashes without recolored copies.
+     * Both images have to be 4 bit per pixel.
+     */
+    //% helper=imageDrawImageMapped
+    drawImageMapped(from: Image, x: number, y: number, map: Buffer): void;
+
+    /**
+     * Draw an image compressed with compressed() straight from its buffer, without decompressing
+     * it first; with `transparent` set, color 0 is not drawn. For art with areas of flat color, the
+     * compressed data is a fraction of the size of the image, eg. when kept in flash.
+     */
+    //% helper=imageDrawCompressed
+    drawCompressed(data: Buffer, x: number, y: number, transparent?: boolean): void;
+
     /**
      * Returns an image rotated by -90, 0, 90, 180, 270 deg clockwise
      */
@@ -78,6 +106,21 @@ interface Image {
      */
     //% helper=imageBlitRow
     blitRow(dstX: number, dstY: number, from: Image, fromX: number, fromH: number): void;
+
+    /**
+     * Draw an image with transparent background, with its center at (x, y) and its pixels mapped
+     * by the matrix [m00 m01; m10 m11] (eg. m01 is how much the x coordinate changes per row of
+     * the source). Both images have to be 4 bit per pixel.
+     */
+    //% helper=imageDrawTransformed
+    drawTransformed(from: Image, x: number, y: number, m00: number, m01: number, m10: number, m11: number): void;
+
+    /**
+     * Draw an image with transparent background, rotated clockwise by `deg` degrees and scaled
+     * around its center, which ends up at (x, y).
+     */
+    //% helper=imageDrawRotated
+    drawRotated(from: Image, x: number, y: number, deg: number, scale?: number): void;
 }
 
 interface ScreenImage extends Image {
@@ -97,6 +140,9 @@ interface ScreenImage extends Image {
 // pxt compiler currently crashes on non-functions in helpers namespace; will fix
 namespace _helpers_workaround {
     export let brightness = 100
+    export let transformMatrix: Buffer
+    export let polygonPoints: Buffer
+    export let textArgs: Buffer
 }
 
 namespace helpers {
@@ -118,6 +164,24 @@ namespace helpers {
     //% shim=ImageMethods::_blitRow
     declare function _blitRow(img: Image, xy: number, from: Image, xh: number): void;
 
+    //% shim=ImageMethods::_drawTransformed
+    declare function _drawTransformed(img: Image, from: Image, xy: number, matrix: Buffer): void;
+
+    //% shim=ImageMethods::_drawImageMapped
+    declare function _drawImageMapped(img: Image, from: Image, xy: number, map: Buffer): void;
+
+    //% shim=ImageMethods::_drawCompressed
+    declare function _drawCompressed(img: Image, data: Buffer, xy: number, transparent: boolean): void;
+
+    //% shim=ImageMethods::_fillPolygon
+    declare function _fillPolygon(img: Image, points: Buffer, n: number, c: color): void;
+
+    //% shim=ImageMethods::_drawTiles
+    declare function _drawTiles(img: Image, tiles: Image[], map: Buffer, xy: number): void;
+
+    //% shim=ImageMethods::_drawColorTiles
+    declare function _drawColorTiles(img: Image, tiles: Image[], map: Image, xy: number): void;
+
     function pack(x: number, y: number) {
         return (Math.clamp(-30000, 30000, x | 0) & 0xffff) | (Math.clamp(-30000, 30000, y | 0) << 16)
     }
@@ -126,6 +190,50 @@ namespace helpers {
         _blitRow(img, pack(dstX, dstY), from, pack(fromX, fromH))
     }
 
+    export function imageDrawTransformed(img: Image, from: Image, x: number, y: number, m00: number, m01: number, m10: number, m11: number): void {
+        let m = _helpers_workaround.transformMatrix
+        if (!m)
+            m = _helpers_workaround.transformMatrix = control.createBuffer(16)
+        m.setNumber(NumberFormat.Int32LE, 0, Math.round(m00 * 65536))
+        m.setNumber(NumberFormat.Int32LE, 4, Math.round(m01 * 65536))
+        m.setNumber(NumberFormat.Int32LE, 8, Math.round(m10 * 65536))
+        m.setNumber(NumberFormat.Int32LE, 12, Math.round(m11 * 65536))
+        _drawTransformed(img, from, pack(x, y), m)
+    }
+
+    export function imageDrawRotated(img: Image, from: Image, x: number, y: number, deg: number, scale?: number): void {
+        if (scale == null) scale = 1
+        deg = ((deg % 360) + 360) % 360
+        let c: number, s: number
+        // keep right angles exact, so they take the fast path
+        if (deg == 0) { c = 1; s = 0 }
+        else if (deg == 90) { c = 0; s = 1 }
+        else if (deg == 180) { c = -1; s = 0 }
+        else if (deg == 270) { c = 0; s = -1 }
+        else {
+            const a = deg * Math.PI / 180
+            c = Math.cos(a)
+            s = Math.sin(a)
+        }
+        imageDrawTransformed(img, from, x, y, c * scale, -s * scale, s * scale, c * scale)
+    }
+
+    /**
+     * Draw the tiles of a map covering the image, scrolled by (offsetX, offsetY). The map holds the
+     * width and height as UInt16LE followed by a tile index byte per cell, row by row. All tiles
+     * have to be square, of the same power-of-two size; cells outside of the map use tile 0.
+     */
+    export function imageDrawTiles(img: Image, tiles: Image[], map: Buffer, offsetX: number, offsetY: number): void {
+        _drawTiles(img, tiles, map, pack(offsetX, offsetY))
+    }
+
+    /**
+     * Like imageDrawTiles(), with the color of each pixel of `map` being the tile index.
+     */
+    export function imageDrawColorTiles(img: Image, tiles: Image[], map: Image, offsetX: number, offsetY: number): void {
+        _drawColorTiles(img, tiles, map, pack(offsetX, offsetY))
+    }
+
     export function imageDrawIcon(img: Image, icon: Buffer, x: number, y: number, c: color): void {
         _drawIcon(img, icon, pack(x, y), c)
     }
@@ -135,6 +243,12 @@ namespace helpers {
     export function imageMapRect(img: Image, x: number, y: number, w: number, h: number, m: Buffer): void {
         _mapRect(img, pack(x, y), pack(w, h), m)
     }
+    export function imageDrawImageMapped(img: Image, from: Image, x: number, y: number, map: Buffer): void {
+        _drawImageMapped(img, from, pack(x, y), map)
+    }
+    export function imageDrawCompressed(img: Image, data: Buffer, x: number, y: number, transparent?: boolean): void {
+        _drawCompressed(img, data, pack(x, y), !!transparent)
+    }
     export function imageDrawLine(img: Image, x: number, y: number, w: number, h: number, c: color): void {
         _drawLine(img, pack(x, y), pack(w, h), c)
     }
@@ -184,6 +298,28 @@ namespace helpers {
         _fillCircle(img, pack(cx, cy), r, col);
     }
 
+    function polygonPoint(i: number, x: number, y: number) {
+        let p = _helpers_workaround.polygonPoints
+        if (!p)
+            p = _helpers_workaround.polygonPoints = control.createBuffer(32)
+        p.setNumber(NumberFormat.Int32LE, i << 3, x | 0)
+        p.setNumber(NumberFormat.Int32LE, (i << 3) + 4, y | 0)
+        return p
+    }
+
+    export function imageFillTriangle(img: Image, x0: number, y0: number, x1: number, y1: number, x2: number, y2: number, col: number) {
+        polygonPoint(0, x0, y0)
+        polygonPoint(1, x1, y1)
+        _fillPolygon(img, polygonPoint(2, x2, y2), 3, col)
+    }
+
+    export function imageFillPolygon4(img: Image, x0: number, y0: number, x1: number, y1: number, x2: number, y2: number, x3: number, y3: number, col: number) {
+        polygonPoint(0, x0, y0)
+        polygonPoint(1, x1, y1)
+        polygonPoint(2, x2, y2)
+        _fillPolygon(img, polygonPoint(3, x3, y3), 4, col)
+    }
+
     /**
      * Returns an image rotated by 90, 180, 270 deg clockwise
      */
@@ -81,6 +81,14 @@ declare interface Image {
     //% shim=ImageMethods::transposed
     transposed(): Image;
 
+    /**
+     * Sets the pixels of dst to the transposed current image (with X/Y swapped); dst has to be another
+     * image, as high as the current one is wide and the other way round, of the same bpp.
+     * Returns false, leaving dst unchanged, if it is not.
+     */
+    //% shim=ImageMethods::transposedInto
+    transposedInto(dst: Image): boolean;
+
     /**
      * Every pixel in image is moved by (dx,dy)
      */
@@ -93,6 +101,20 @@ declare interface Image {
     //% shim=ImageMethods::doubledX
     doubledX(): Image;
 
+    /**
+     * Sets the pixels of dst to the current image stretched horizontally by 100%; dst has to be twice
+     * as wide, of the same height and bpp. Returns false, leaving dst unchanged, if it is not.
+     */
+    //% shim=ImageMethods::doubledXInto
+    doubledXInto(dst: Image): boolean;
+
+    /**
+     * Sets the pixels of dst to the current image stretched vertically by 100%; dst has to be twice
+     * as high, of the same width and bpp. Returns false, leaving dst unchanged, if it is not.
+     */
+    //% shim=ImageMethods::doubledYInto
+    doubledYInto(dst: Image): boolean;
+
     /**
      * Stretches the image vertically by 100%
      */
@@ -111,6 +133,28 @@ declare interface Image {
     //% shim=ImageMethods::doubled
     doubled(): Image;
 
+    /**
+     * Sets the pixels of dst to the current image stretched in both directions by 100%; dst has to be
+     * twice as wide and high, of the same bpp. Returns false, leaving dst unchanged, if it is not.
+     */
+    //% shim=ImageMethods::doubledInto
+    doubledInto(dst: Image): boolean;
+
+    /**
+     * Returns the image run-length encoded for drawCompressed() and image.ofBuffer(), or null if it is
+     * not 4 bit per pixel.
+     */
+    //% shim=ImageMethods::compressed
+    compressed(): Buffer;
+
+    /**
+     * Scale and copy columns of pixels from a texture, as blitRow() does, for a whole frame at once.
+     * columns holds Int16LE triples of destination x, texture x and height; every column is centered
+     * vertically in the current image.
+     */
+    //% shim=ImageMethods::blitColumns
+    blitColumns(from: Image, columns: Buffer): void;
+
     /**
      * Draw given image on the current image
      */
@@ -137,6 +181,13 @@ declare namespace image {
     //% shim=image::create
     function create(width: int32, height: int32): Image;
 
+    /**
+     * Create new empty image with given bits per pixel: 1, 4, or on hosted targets 8 (256 color
+     * palette) and 16 (RGB565); returns null for other values.
+     */
+    //% shim=image::createWithBpp
+    function createWithBpp(width: int32, height: int32, bpp: int32): Image;
+
     /**
      * Create new image with given content
      */
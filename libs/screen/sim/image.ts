@@ -320,6 +320,30 @@ namespace pxsim.ImageMethods {
         return doubledX(doubledY(img))
     }
 
+    function setFrom(dst: RefImage, r: RefImage) {
+        if (dst == r || dst._width != r._width || dst._height != r._height || dst._bpp != r._bpp)
+            return false
+        dst.makeWritable()
+        dst.data.set(r.data)
+        return true
+    }
+
+    export function transposedInto(img: RefImage, dst: RefImage) {
+        return dst != img && setFrom(dst, transposed(img))
+    }
+
+    export function doubledXInto(img: RefImage, dst: RefImage) {
+        return setFrom(dst, doubledX(img))
+    }
+
+    export function doubledYInto(img: RefImage, dst: RefImage) {
+        return setFrom(dst, doubledY(img))
+    }
+
+    export function doubledInto(img: RefImage, dst: RefImage) {
+        return setFrom(dst, doubled(img))
+    }
+
     function drawImageCore(img: RefImage, from: RefImage, x: number, y: number, clear: boolean, check: boolean) {
         x |= 0
         y |= 0
@@ -377,10 +401,88 @@ namespace pxsim.ImageMethods {
         drawImageCore(img, from, x, y, false, false)
     }
 
+    export function _drawImageMapped(img: RefImage, from: RefImage, xy: number, map: RefBuffer) {
+        if (img._bpp != 4 || from._bpp != 4 || map.data.length < 16)
+            return
+        const x = XX(xy), y = YY(xy)
+        img.makeWritable()
+        for (let fy = 0; fy < from._height; ++fy)
+            for (let fx = 0; fx < from._width; ++fx) {
+                const c = from.data[from.pix(fx, fy)]
+                if (c && img.inRange(x + fx, y + fy))
+                    img.data[img.pix(x + fx, y + fy)] = map.data[c] & 0xf
+            }
+    }
+
+    export function _drawCompressed(img: RefImage, data: RefBuffer, xy: number, transparent: boolean) {
+        if (!image.isCompressedImage(data))
+            return
+        const x = XX(xy), y = YY(xy)
+        img.makeWritable()
+        image.forCompressedPixels(data, (fx, fy, c) => {
+            if ((c || !transparent) && img.inRange(x + fx, y + fy))
+                img.data[img.pix(x + fx, y + fy)] = c
+        })
+    }
+
+    export function compressed(img: RefImage) {
+        return img._bpp == 4 ? image.compress(img) : null
+    }
+
     export function overlapsWith(img: RefImage, other: RefImage, x: number, y: number) {
         return drawImageCore(img, other, x, y, false, true)
     }
 
+    function drawTilesCore(img: RefImage, tiles: RefCollection, width: number, height: number,
+        getTile: (x: number, y: number) => number, xy: number) {
+        const tileImages = tiles.toArray() as RefImage[]
+        let scale = -1
+        for (const t of tileImages) {
+            if (!(t instanceof RefImage))
+                continue
+            for (let s = 0; s < 8; ++s)
+                if (t._width == 1 << s)
+                    scale = s
+            break
+        }
+        if (scale < 0)
+            return
+
+        let offX = XX(xy)
+        let offY = YY(xy)
+        const mask = (1 << scale) - 1
+        const x0 = Math.max(0, offX >> scale)
+        const xn = Math.min(width, ((offX + img._width) >> scale) + 1)
+        const y0 = Math.max(0, offY >> scale)
+        const yn = Math.min(height, ((offY + img._height) >> scale) + 1)
+        offX &= mask
+        offY &= mask
+
+        for (let x = x0; x <= xn; ++x) {
+            for (let y = y0; y <= yn; ++y) {
+                const tile = tileImages[x < width && y < height ? getTile(x, y) : 0]
+                if (tile instanceof RefImage)
+                    drawImageCore(img, tile, ((x - x0) << scale) - offX, ((y - y0) << scale) - offY, false, false)
+            }
+        }
+    }
+
+    export function _drawTiles(img: RefImage, tiles: RefCollection, map: RefBuffer, xy: number) {
+        const d = map.data
+        let width = 0, height = 0
+        if (d.length >= 4) {
+            width = d[0] | (d[1] << 8)
+            height = d[2] | (d[3] << 8)
+            if (4 + width * height > d.length)
+                width = height = 0
+        }
+        drawTilesCore(img, tiles, width, height, (x, y) => d[4 + x + y * width], xy)
+    }
+
+    export function _drawColorTiles(img: RefImage, tiles: RefCollection, map: RefImage, xy: number) {
+        drawTilesCore(img, tiles, map._width, map._height, (x, y) => getPixel(map, x, y), xy)
+    }
+
     function drawLineLow(img: RefImage, x0: number, y0: number, x1: number, y1: number, c: number) {
         let dx = x1 - x0;
         let dy = y1 - y0;
@@ -605,10 +707,270 @@ namespace pxsim.ImageMethods {
         fillCircle(img, XX(cxy), YY(cxy), r, c);
     }
 
+    export function _drawListPush(ops: RefBuffer, opz: number, xy: number, ab: number) {
+        const d = ops.data
+        if (d.length < 4)
+            return false
+        const v = new DataView(d.buffer, d.byteOffset, d.length)
+        const n = v.getUint32(0, true)
+        const p = 4 + n * 12
+        if (p + 12 > d.length)
+            return false
+        v.setUint8(p, opz & 0xff)
+        v.setUint8(p + 1, (opz >> 8) & 0xff)
+        v.setInt16(p + 2, opz >> 16, true)
+        v.setInt16(p + 4, XX(xy), true)
+        v.setInt16(p + 6, YY(xy), true)
+        v.setInt16(p + 8, XX(ab), true)
+        v.setInt16(p + 10, YY(ab), true)
+        v.setUint32(0, n + 1, true)
+        return true
+    }
+
+    function drawFlippedImage(img: RefImage, from: RefImage, x: number, y: number, flip: number) {
+        const w = from._width, h = from._height
+        const x0 = Math.max(x, 0), x1 = Math.min(x + w, img._width)
+        const y0 = Math.max(y, 0), y1 = Math.min(y + h, img._height)
+        if (x0 >= x1 || y0 >= y1)
+            return
+        img.makeWritable()
+        for (let yy = y0; yy < y1; ++yy) {
+            const sy = (flip & 2) ? y + h - 1 - yy : yy - y
+            for (let xx = x0; xx < x1; ++xx) {
+                const c = from.data[from.pix((flip & 1) ? x + w - 1 - xx : xx - x, sy)]
+                if (c)
+                    img.data[img.pix(xx, yy)] = img.color(c)
+            }
+        }
+    }
+
+    export function _drawList(img: RefImage, ops: RefBuffer, images: RefCollection) {
+        const d = ops.data
+        if (d.length < 4)
+            return
+        const v = new DataView(d.buffer, d.byteOffset, d.length)
+        const n = Math.min(v.getUint32(0, true), Math.floor((d.length - 4) / 12))
+        const order: number[] = []
+        for (let i = 0; i < n; ++i)
+            order.push(i)
+        const z = (i: number) => v.getInt16(4 + i * 12 + 2, true)
+        // keep it stable
+        order.sort((a, b) => z(a) - z(b) || a - b)
+        const imgs = images.toArray() as RefImage[]
+        for (const i of order) {
+            const p = 4 + i * 12
+            const c = v.getUint8(p + 1)
+            const x = v.getInt16(p + 4, true), y = v.getInt16(p + 6, true)
+            const a = v.getInt16(p + 8, true), b = v.getInt16(p + 10, true)
+            const from = imgs[a & 0xffff]
+            switch (v.getUint8(p)) {
+                case 1: setPixel(img, x, y, c); break
+                case 2: fillRect(img, x, y, a, b, c); break
+                case 3: drawLine(img, x, y, a, b, c); break
+                case 4: fillCircle(img, x, y, a, c); break
+                case 5: if (from instanceof RefImage) drawImage(img, from, x, y); break
+                case 6: if (from instanceof RefImage) drawTransparentImage(img, from, x, y); break
+                case 7: if (from instanceof RefImage) drawFlippedImage(img, from, x, y, c); break
+            }
+        }
+    }
+
+    export function _fillPolygon(img: RefImage, points: RefBuffer, n: number, c: number) {
+        n = Math.min(n | 0, 8)
+        if (n <= 0 || points.data.length < 8 * n)
+            return
+        const v = new DataView(points.data.buffer, points.data.byteOffset, 8 * n)
+        const xs: number[] = [], ys: number[] = []
+        for (let i = 0; i < n; ++i) {
+            xs.push(v.getInt32(8 * i, true))
+            ys.push(v.getInt32(8 * i + 4, true))
+        }
+        const x0 = Math.max(0, Math.min.apply(null, xs))
+        const x1 = Math.min(img._width - 1, Math.max.apply(null, xs))
+        for (let x = x0; x <= x1; ++x) {
+            let top = Infinity, bot = -Infinity
+            for (let i = 0; i < n; ++i) {
+                const j = (i + 1) % n
+                let ax = xs[i], ay = ys[i], bx = xs[j], by = ys[j]
+                if (ax > bx) {
+                    ax = xs[j]; ay = ys[j]; bx = xs[i]; by = ys[i]
+                }
+                if (x < ax || x > bx)
+                    continue
+                if (ax == bx) {
+                    top = Math.min(top, ay, by)
+                    bot = Math.max(bot, ay, by)
+                    continue
+                }
+                // where the edge crosses x - 1/2 and x + 1/2, rounded
+                for (const xe of [Math.max(ax, x - 0.5), Math.min(bx, x + 0.5)]) {
+                    const y = ay + Math.floor((by - ay) * (xe - ax) / (bx - ax) + 0.5)
+                    top = Math.min(top, y)
+                    bot = Math.max(bot, y)
+                }
+            }
+            if (top <= bot)
+                fillRect(img, x, top, 1, bot - top + 1, c)
+        }
+    }
+
+    // see NativeFont in image.cpp
+    function drawNativeText(img: RefImage, text: string, font: RefBuffer, x: number, y: number, lineHeight: number, mult: number, c: number) {
+        const d = font.data
+        const u16 = (off: number) => d[off] | (d[off + 1] << 8)
+        const w = d[2], h = d[3], n = u16(4), numPairs = u16(6)
+        const columnBytes = ((h * 4 + 31) >> 5) << 2
+        const codes = 8, advances = codes + 2 * n
+        const pairs = (advances + n + 3) & ~3
+        const glyphs = pairs + 8 * numPairs
+        if (!n || glyphs + n * w * columnBytes > d.length)
+            return
+        const find = (ch: number) => {
+            if (ch - 32 >= 0 && ch - 32 < n && u16(codes + 2 * (ch - 32)) == ch)
+                return ch - 32
+            let l = 0, r = n - 1
+            while (l <= r) {
+                const m = l + ((r - l) >> 1)
+                const v = u16(codes + 2 * m)
+                if (v == ch) return m
+                if (v < ch) l = m + 1
+                else r = m - 1
+            }
+            return 0
+        }
+        const kerning = (left: number, right: number) => {
+            for (let i = 0; i < numPairs; ++i) {
+                const p = pairs + 8 * i
+                if (u16(p) == left && u16(p + 2) == right)
+                    return (u16(p + 4) << 16) >> 16
+            }
+            return 0
+        }
+        const x0 = x
+        let prev = -1
+        for (let cp = 0; cp < text.length; ++cp) {
+            const ch = text.charCodeAt(cp)
+            if (ch == 10) {
+                y += lineHeight
+                x = x0
+                prev = -1
+            }
+            if (ch < 32)
+                continue // skip control chars
+            if (prev >= 0)
+                x += kerning(prev, ch) * mult
+            const g = find(ch)
+            const off = glyphs + g * w * columnBytes
+            for (let i = 0; i < w; ++i)
+                for (let j = 0; j < h; ++j)
+                    if ((d[off + i * columnBytes + (j >> 1)] >> (4 * (j & 1))) & 0xf)
+                        fillRect(img, x + i * mult, y + j * mult, mult, mult, c)
+            x += d[advances + g] * mult
+            prev = ch
+        }
+    }
+
+    export function _drawText(img: RefImage, text: string, font: RefBuffer, args: RefBuffer) {
+        if (!text || args.data.length < 10)
+            return
+        const v = new DataView(args.data.buffer, args.data.byteOffset, 10)
+        let x = v.getInt16(0, true), y = v.getInt16(2, true)
+        const lineHeight = v.getInt16(4, true)
+        const c = args.data[6], dataW = args.data[7], dataH = args.data[8]
+        const mult = Math.max(args.data[9], 1)
+        // NATIVE_FONT_MAGIC
+        if (font.data.length >= 8 && (font.data[0] | (font.data[1] << 8)) == 0xdf4e) {
+            drawNativeText(img, text, font, x, y, lineHeight, mult, c & 0xf)
+            return
+        }
+        const byteHeight = (dataH + 7) >> 3
+        const glyphSize = 2 + byteHeight * dataW
+        const data = font.data
+        const n = Math.floor(data.length / glyphSize)
+        if (!n)
+            return
+        const code = (i: number) => data[i * glyphSize] | (data[i * glyphSize + 1] << 8)
+        const x0 = x
+        for (let cp = 0; cp < text.length; ++cp) {
+            const ch = text.charCodeAt(cp)
+            if (ch == 10) {
+                y += lineHeight
+                x = x0
+            }
+            if (ch < 32)
+                continue // skip control chars
+            let g = 0
+            if (ch - 32 < n && code(ch - 32) == ch)
+                g = ch - 32
+            else {
+                let l = 0, r = n - 1
+                while (l <= r) {
+                    const m = l + ((r - l) >> 1)
+                    if (code(m) == ch) {
+                        g = m
+                        break
+                    }
+                    if (code(m) < ch) l = m + 1
+                    else r = m - 1
+                }
+            }
+            const off = g * glyphSize + 2
+            for (let i = 0; i < dataW; ++i)
+                for (let j = 0; j < dataH; ++j)
+                    if (data[off + i * byteHeight + (j >> 3)] & (1 << (j & 7)))
+                        fillRect(img, x + i * mult, y + j * mult, mult, mult, c)
+            x += dataW * mult
+        }
+    }
+
+    export function blitColumns(img: RefImage, from: RefImage, columns: RefBuffer) {
+        const d = columns.data
+        const v = new DataView(d.buffer, d.byteOffset, d.length)
+        for (let i = 0; i + 6 <= d.length; i += 6) {
+            const h = v.getInt16(i + 4, true)
+            blitRow(img, v.getInt16(i, true), (img._height - h) >> 1, from, v.getInt16(i + 2, true), h)
+        }
+    }
+
     export function _blitRow(img: RefImage, xy: number, from: RefImage, xh: number) {
         blitRow(img, XX(xy), YY(xy), from, XX(xh), YY(xh))
     }
 
+    export function _drawTransformed(img: RefImage, from: RefImage, xy: number, matrix: RefBuffer) {
+        if (img._bpp != 4 || from._bpp != 4 || matrix.data.length < 16)
+            return
+        const v = new DataView(matrix.data.buffer, matrix.data.byteOffset, 16)
+        const m00 = v.getInt32(0, true) / 65536, m01 = v.getInt32(4, true) / 65536
+        const m10 = v.getInt32(8, true) / 65536, m11 = v.getInt32(12, true) / 65536
+        const det = m00 * m11 - m01 * m10
+        if (!det)
+            return
+        const i00 = m11 / det, i01 = -m01 / det, i10 = -m10 / det, i11 = m00 / det
+
+        const x = XX(xy), y = YY(xy)
+        const w = from._width, h = from._height
+        const ex = (Math.abs(m00) * w + Math.abs(m01) * h) / 2
+        const ey = (Math.abs(m10) * w + Math.abs(m11) * h) / 2
+        const x0 = Math.max(0, Math.floor(x - ex)), x1 = Math.min(img._width, Math.floor(x + ex) + 1)
+        const y0 = Math.max(0, Math.floor(y - ey)), y1 = Math.min(img._height, Math.floor(y + ey) + 1)
+        if (x0 >= x1 || y0 >= y1)
+            return
+
+        img.makeWritable()
+        for (let dx = x0; dx < x1; ++dx) {
+            for (let dy = y0; dy < y1; ++dy) {
+                const rx = dx - x + 0.5, ry = dy - y + 0.5
+                const sx = Math.floor(i00 * rx + i01 * ry + w / 2)
+                const sy = Math.floor(i10 * rx + i11 * ry + h / 2)
+                if (from.inRange(sx, sy)) {
+                    const c = from.data[from.pix(sx, sy)]
+                    if (c)
+                        img.data[img.pix(dx, dy)] = c
+                }
+            }
+        }
+    }
+
     export function blitRow(img: RefImage, x: number, y: number, from: RefImage, fromX: number, fromH: number) {
         x |= 0
         y |= 0
@@ -688,9 +1050,88 @@ namespace pxsim.image {
         return new RefImage(w, h, getScreenState().bpp())
     }
 
+    // 8 and 16 bpp images are only available on hosted targets
+    export function createWithBpp(w: number, h: number, bpp: number) {
+        return bpp == 1 || bpp == 4 ? new RefImage(w, h, bpp) : null
+    }
+
+    export function isCompressedImage(buf: RefBuffer) {
+        return buf && buf.data.length >= 8 && buf.data[0] == 0x88 && buf.data[1] == 4
+    }
+
+    // calls f for every pixel of a compressed image; see image.cpp for the format
+    export function forCompressedPixels(buf: RefBuffer, f: (x: number, y: number, c: number) => void) {
+        const d = buf.data
+        const w = bufW(d), h = bufH(d)
+        let p = 8
+        for (let x = 0; x < w; ++x) {
+            let y = 0
+            while (y < h) {
+                if (p >= d.length)
+                    return false
+                const b = d[p++]
+                let n = b >> 4
+                if (n) {
+                    if (y + n > h)
+                        return false
+                    for (let k = 0; k < n; ++k)
+                        f(x, y + k, b & 0xf)
+                } else {
+                    n = (b & 0xf) + 1
+                    if (y + n > h || p + ((n + 1) >> 1) > d.length)
+                        return false
+                    for (let k = 0; k < n; ++k)
+                        f(x, y + k, (d[p + (k >> 1)] >> ((k & 1) << 2)) & 0xf)
+                    p += (n + 1) >> 1
+                }
+                y += n
+            }
+        }
+        return true
+    }
+
+    export function compress(img: RefImage): RefBuffer {
+        const w = img._width, h = img._height
+        const r: number[] = [0x88, 4, w & 0xff, w >> 8, h & 0xff, h >> 8, 0, 0]
+        for (let x = 0; x < w; ++x) {
+            const at = (y: number) => img.data[img.pix(x, y)] & 0xf
+            let y = 0
+            while (y < h) {
+                // runs of 3 or more pay off, shorter ones go to literals
+                let lit = 0, n = 0
+                while (y + lit < h && lit < 16) {
+                    n = 1
+                    while (n < 15 && y + lit + n < h && at(y + lit + n) == at(y + lit))
+                        n++
+                    if (n >= 3)
+                        break
+                    lit += n
+                    n = 0
+                }
+                lit = Math.min(lit, 16)
+                if (lit) {
+                    r.push(lit - 1)
+                    for (let k = 0; k < lit; k += 2)
+                        r.push(at(y + k) | (k + 1 < lit ? at(y + k + 1) << 4 : 0))
+                    y += lit
+                } else {
+                    r.push((n << 4) | at(y))
+                    y += n
+                }
+            }
+        }
+        return new RefBuffer(new Uint8Array(r))
+    }
+
     export function ofBuffer(buf: RefBuffer): RefImage {
         const src: Uint8Array = buf.data
 
+        if (isCompressedImage(buf)) {
+            const img = new RefImage(bufW(src), bufH(src), 4)
+            forCompressedPixels(buf, (x, y, c) => img.data[img.pix(x, y)] = c)
+            return img
+        }
+
         let srcP = 4
         let w = 0, h = 0, bpp = 0
 
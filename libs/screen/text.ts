@@ -5,6 +5,9 @@ namespace image {
         charHeight: number;
         data: Buffer;
         multiplier?: number;
+        // the same glyphs laid out for drawing, from `font-compiler.js --native`; print() uses
+        // them when there are no text effects
+        glyphs?: Buffer;
     }
 
     //% whenUsed
@@ -156,7 +159,8 @@ a420a8fcaa828400 a720087e2a1c0800 ab200098a4a6bf02 ac20183c5a5a4200 af20627f2244
             charWidth: f.charWidth * size,
             charHeight: f.charHeight * size,
             data: f.data,
-            multiplier: f.multiplier ? size * f.multiplier : size
+            multiplier: f.multiplier ? size * f.multiplier : size,
+            glyphs: f.glyphs
         }
     }
 
@@ -204,6 +208,9 @@ interface Image {
 }
 
 namespace helpers {
+    //% shim=ImageMethods::_drawText
+    declare function _drawText(img: Image, text: string, font: Buffer, args: Buffer): void;
+
     export function imagePrintCenter(img: Image, text: string, y: number, color?: number, font?: image.Font) {
         if (!font) font = image.getFontForText(text)
         let w = text.length * font.charWidth
@@ -227,6 +234,21 @@ namespace helpers {
         let dataSize = 2 + charSize
         let fontdata = font.data
         let lastchar = Math.idiv(fontdata.length, dataSize) - 1
+        if (!offsets) {
+            // see _drawText() in image.cpp
+            let args = _helpers_workaround.textArgs
+            if (!args)
+                args = _helpers_workaround.textArgs = control.createBuffer(10)
+            args.setNumber(NumberFormat.Int16LE, 0, Math.clamp(-30000, 30000, x))
+            args.setNumber(NumberFormat.Int16LE, 2, Math.clamp(-30000, 30000, y))
+            args.setNumber(NumberFormat.Int16LE, 4, font.charHeight + 2)
+            args[6] = color
+            args[7] = dataW
+            args[8] = dataH
+            args[9] = mult
+            _drawText(img, text, font.glyphs || fontdata, args)
+            return
+        }
         let imgBuf: Buffer
         if (mult == 1) {
             imgBuf = control.createBuffer(8 + charSize)
@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #include <termios.h>
 #include <errno.h>
+#include <poll.h>
 
 #ifndef SERIAL_DEVICE
 #define SERIAL_DEVICE "/dev/ttyS0"
@@ -22,6 +23,20 @@ namespace serial {
 SerialDevice internalCreateSerialDevice(int id) {
     return new LinuxSerialDevice(id);
 }
+} // namespace serial
+
+namespace SerialDeviceMethods {
+/**
+ * Read the received data up to the first `delimiter`, which is dropped, without the rest; null
+ * if there is no delimiter yet
+ */
+//%
+Buffer readUntil(SerialDevice device, Delimiters delimiter) {
+    return device->readUntil((int)delimiter);
+}
+} // namespace SerialDeviceMethods
+
+namespace serial {
 
 struct SerialSpeed {
     int code;
@@ -68,7 +83,7 @@ void LinuxSerialDevice::init() {
     if (fd < 0)
         target_panic(PANIC_CODAL_HARDWARE_CONFIGURATION_ERROR);
 
-    setRxBufferSize(128);
+    setRxBufferSize(SERIAL_RX_BUFFER_SIZE);
     setBaudRate(115200);
 
     pthread_t pid;
@@ -81,22 +96,58 @@ void *LinuxSerialDevice::readLoop(void *th) {
     return NULL;
 }
 
+static int countByte(const uint8_t *p, int len, int c) {
+    int n = 0;
+    while (len > 0) {
+        auto q = (const uint8_t *)memchr(p, c, len);
+        if (!q)
+            break;
+        n++;
+        len -= q + 1 - p;
+        p = q + 1;
+    }
+    return n;
+}
+
 void LinuxSerialDevice::readLoopInner() {
-    uint8_t buf[128];
+    uint8_t buf[SERIAL_READ_CHUNK];
     while (true) {
         pthread_mutex_lock(&lock);
-        int left = buffersz - bufferedSize();
-        pthread_mutex_unlock(&lock);
-        if (left == 0) {
+        if (bufferedSize() == (int)buffersz - 1) {
+            pthread_mutex_unlock(&lock);
             raiseEvent(id, CODAL_SERIAL_EVT_RX_FULL);
-            sleep_core_us(20 * 1000);
-            continue;
+            pthread_mutex_lock(&lock);
+            // until the program reads
+            while (bufferedSize() == (int)buffersz - 1)
+                pthread_cond_wait(&spaceFreed, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            target_panic(PANIC_CODAL_HARDWARE_CONFIGURATION_ERROR);
         }
+
+        pthread_mutex_lock(&lock);
+        int left = buffersz - 1 - bufferedSize();
+        pthread_mutex_unlock(&lock);
+        if (left == 0)
+            continue;
+
+        // everything the driver has, up to what fits
         if (left > (int)sizeof(buf))
             left = sizeof(buf);
         int r = ::read(fd, buf, left);
-        if (r <= 0)
+        if (r < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (r < 0 || (r == 0 && (pfd.revents & (POLLHUP | POLLERR))))
             target_panic(PANIC_CODAL_HARDWARE_CONFIGURATION_ERROR);
+        if (r == 0)
+            continue;
 
         pthread_mutex_lock(&lock);
         int chunk = buffersz - writep;
@@ -112,14 +163,25 @@ void LinuxSerialDevice::readLoopInner() {
                 writep += r2;
             }
         }
-        pthread_mutex_unlock(&lock);
 
-        raiseEvent(id, CODAL_SERIAL_EVT_DATA_RECEIVED);
+        int newDelims = delim == -1 ? 0 : countByte(buf, r, delim);
+        delimCount += newDelims;
 
-        if (delim != -1)
-            for (int i = 0; i < r; ++i)
-                if (buf[i] == delim)
-                    raiseEvent(id, CODAL_SERIAL_EVT_DELIM_MATCH);
+        // one event of each kind for everything received until the program reads
+        int now = current_time_ms();
+        bool raiseData = dataEventTime < 0 || now - dataEventTime >= SERIAL_EVENT_REARM_MS;
+        if (raiseData)
+            dataEventTime = now;
+        bool raiseDelim =
+            newDelims && (delimEventTime < 0 || now - delimEventTime >= SERIAL_EVENT_REARM_MS);
+        if (raiseDelim)
+            delimEventTime = now;
+        pthread_mutex_unlock(&lock);
+
+        if (raiseData)
+            raiseEvent(id, CODAL_SERIAL_EVT_DATA_RECEIVED);
+        if (raiseDelim)
+            raiseEvent(id, CODAL_SERIAL_EVT_DELIM_MATCH);
     }
 }
 
@@ -150,8 +212,9 @@ void LinuxSerialDevice::setBaudRate(int rate) {
     tio.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
     tio.c_oflag &= ~OPOST;
 
-    tio.c_cc[VMIN] = 1;  // read blocks
-    tio.c_cc[VTIME] = 0; // no intra-character timeout
+    // poll() waits for data, and read() takes all there is without waiting for more
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
 
     if (tcsetattr(fd, TCSANOW, &tio) != 0) {
         target_panic(PANIC_CODAL_HARDWARE_CONFIGURATION_ERROR);
@@ -159,9 +222,12 @@ void LinuxSerialDevice::setBaudRate(int rate) {
     }
 }
 
-void LinuxSerialDevice::setRxBufferSize(unsigned size) {
+void LinuxSerialDevice::setRxBufferSize(int size) {
+    // the read thread waits while the ring is full, so it has to hold something
+    if (size < 1)
+        size = 1;
     pthread_mutex_lock(&lock);
-    auto tmp = malloc(size);
+    auto tmp = xmalloc_tagged(size + 1, MallocTag::Serial);
     if (buffer) {
         auto bsz = bufferedSize();
         if (bsz > (int)size)
@@ -169,18 +235,44 @@ void LinuxSerialDevice::setRxBufferSize(unsigned size) {
         readBuf(tmp, bsz);
         readp = 0;
         writep = bsz;
-        free(buffer);
+        xfree(buffer);
     }
     buffer = (uint8_t *)tmp;
-    buffersz = size;
+    buffersz = size + 1;
+    delimCount = delim == -1 ? 0 : countByte(buffer, writep, delim);
+    pthread_cond_broadcast(&spaceFreed);
     pthread_mutex_unlock(&lock);
 }
 
+void LinuxSerialDevice::onDelimiterReceived(Delimiters delimiter, Action handler) {
+    registerWithDal(id, CODAL_SERIAL_EVT_DELIM_MATCH, handler);
+    pthread_mutex_lock(&lock);
+    delim = (int)delimiter;
+    int len = bufferedSize();
+    int chunk = min(len, (int)(buffersz - readp));
+    delimCount = countByte(buffer + readp, chunk, delim) + countByte(buffer, len - chunk, delim);
+    pthread_mutex_unlock(&lock);
+}
+
+// the program has read; lineRead is for readUntil(), which gets another delimiter event when
+// there are more lines in the buffer
+void LinuxSerialDevice::afterRead(bool lineRead) {
+    pthread_mutex_lock(&lock);
+    dataEventTime = -1;
+    bool again = lineRead && delimCount > 0;
+    delimEventTime = again ? current_time_ms() : -1;
+    pthread_cond_broadcast(&spaceFreed);
+    pthread_mutex_unlock(&lock);
+    if (again)
+        raiseEvent(id, CODAL_SERIAL_EVT_DELIM_MATCH);
+}
+
 int LinuxSerialDevice::read() {
     pthread_mutex_lock(&lock);
     uint8_t c;
     int r = readBuf(&c, 1);
     pthread_mutex_unlock(&lock);
+    afterRead(false);
     if (r)
         return c;
     return -1;
@@ -196,6 +288,33 @@ Buffer LinuxSerialDevice::readBuffer() {
     if (sz != sz2)
         target_panic(999);
     pthread_mutex_unlock(&lock);
+    afterRead(false);
+    return r;
+}
+
+Buffer LinuxSerialDevice::readUntil(int delimiter) {
+    pthread_mutex_lock(&lock);
+    int len = bufferedSize();
+    int chunk = min(len, (int)(buffersz - readp));
+    int pos = -1;
+    auto q = (uint8_t *)memchr(buffer + readp, delimiter, chunk);
+    if (q)
+        pos = q - (buffer + readp);
+    else if ((q = (uint8_t *)memchr(buffer, delimiter, len - chunk)))
+        pos = chunk + (q - buffer);
+
+    Buffer r = NULL;
+    if (pos >= 0) {
+        r = mkBuffer(NULL, pos);
+        registerGCObj(r);
+        readBuf(r->data, pos);
+        readBuf(NULL, 1);
+        unregisterGCObj(r);
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (r)
+        afterRead(true);
     return r;
 }
 
@@ -220,21 +339,20 @@ int LinuxSerialDevice::readBuf(void *buf, int sz) {
     int amount = bufferedSize();
     if (amount < sz)
         sz = amount;
-    if (sz > 0) {
+    int done = 0;
+    while (done < sz) {
         int chunk = buffersz - readp;
-        if (chunk > sz)
-            chunk = sz;
-
-        memcpy(buf, buffer + readp, chunk);
+        if (chunk > sz - done)
+            chunk = sz - done;
+        // buf is NULL to drop the bytes
+        if (buf)
+            memcpy((uint8_t *)buf + done, buffer + readp, chunk);
+        if (delim != -1)
+            delimCount -= countByte(buffer + readp, chunk, delim);
         readp += chunk;
         if (readp == buffersz)
             readp = 0;
-        buf = (uint8_t *)buf + chunk;
-
-        if (sz - chunk > 0) {
-            memcpy(buf, buffer + readp, sz - chunk);
-            readp += chunk;
-        }
+        done += chunk;
     }
     return sz;
 }
@@ -12,6 +12,22 @@ enum class SerialEvent;
 enum class BaudRate;
 enum class Delimiters;
 
+// Size of the receive buffer until setRxBufferSize() is called
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 4096
+#endif
+
+// Bytes asked for from the device in one read() call
+#ifndef SERIAL_READ_CHUNK
+#define SERIAL_READ_CHUNK 1024
+#endif
+
+// A data received or delimiter event is not raised again until the program has read from the
+// device, or this long after the last one, so that fast data doesn't flood the event queue
+#ifndef SERIAL_EVENT_REARM_MS
+#define SERIAL_EVENT_REARM_MS 100
+#endif
+
 namespace serial {
 
 class LinuxSerialDevice {
@@ -19,8 +35,12 @@ class LinuxSerialDevice {
     uint16_t id;
     uint8_t *buffer;
     int delim;
+    // the ring holds up to buffersz - 1 bytes, so that full and empty differ
     unsigned readp, writep, buffersz;
+    unsigned delimCount; // delim bytes in the ring
+    int dataEventTime, delimEventTime; // when raised; -1 once the program has read
     pthread_mutex_t lock;
+    pthread_cond_t spaceFreed;
     int fd;
 
   public:
@@ -31,26 +51,31 @@ class LinuxSerialDevice {
         buffer = NULL;
         next = NULL;
         delim = -1;
+        delimCount = 0;
+        dataEventTime = delimEventTime = -1;
         fd = -1;
         pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&spaceFreed, NULL);
         init();
     }
 
     void setBaudRate(int rate);
-    void setRxBufferSize(unsigned size);
+    void setRxBufferSize(int size);
+
+    // the read thread waits for the program instead of dropping bytes
+    int rxOverruns() { return 0; }
 
     void setTxBufferSize(unsigned size) {}
 
     int read();
     Buffer readBuffer();
+    // the bytes before the first delimiter, which is dropped; NULL if there is none yet
+    Buffer readUntil(int delimiter);
     void writeBuffer(Buffer buffer);
 
     void onEvent(SerialEvent event, Action handler) { registerWithDal(id, (int)event, handler); }
 
-    void onDelimiterReceived(Delimiters delimiter, Action handler) {
-        registerWithDal(id, CODAL_SERIAL_EVT_DELIM_MATCH, handler);
-        delim = (int)delimiter;
-    }
+    void onDelimiterReceived(Delimiters delimiter, Action handler);
 
   private:
     int bufferedSize() {
@@ -61,6 +86,7 @@ class LinuxSerialDevice {
     }
 
     int readBuf(void *buf, int sz);
+    void afterRead(bool lineRead);
 
     static void *readLoop(void*);
     void readLoopInner();
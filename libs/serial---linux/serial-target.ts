@@ -1,8 +1,31 @@
 namespace serial {
+    // lines are sliced out of the receive buffer natively, instead of all of the received data
+    // going through the decoder
+    class LinuxSerial extends Serial {
+        readUntil(delimiter: Delimiters, timeOut?: number): string {
+            const start = control.millis();
+            do {
+                // data read before with readString() comes first
+                const s = this.decoder.decodeUntil(delimiter);
+                if (s !== undefined)
+                    return s;
+                const b = this.serialDevice.readUntil(delimiter);
+                if (b) {
+                    this.decoder.add(b);
+                    return this.decoder.decode();
+                }
+                pause(1);
+            }
+            while (timeOut === undefined || (control.millis() - start < timeOut));
+            // giving up
+            return "";
+        }
+    }
+
     let _device: Serial;
     export function device(): Serial {
         if (!_device) {
-            _device = new Serial(serial.internalCreateSerialDevice(3000));
+            _device = new LinuxSerial(serial.internalCreateSerialDevice(3000));
         }
         return _device;
     }
@@ -6,10 +6,18 @@ namespace SerialDeviceMethods {
  * Sets the size of the RX buffer in bytes
  */
 //%
-void setRxBufferSize(SerialDevice device, uint8_t size) {
+void setRxBufferSize(SerialDevice device, int size) {
     device->setRxBufferSize(size);
 }
 
+/**
+ * Bytes received since startup that were dropped because the RX buffer was full
+ */
+//%
+int rxOverruns(SerialDevice device) {
+    return device->rxOverruns();
+}
+
 /**
  * Sets the size of the TX buffer in bytes
  */
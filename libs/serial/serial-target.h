@@ -6,6 +6,20 @@ enum class SerialEvent;
 enum class BaudRate;
 enum class Delimiters;
 
+// CODAL keeps received bytes in a ring of at most this many; larger receive buffers are a second
+// ring in the proxy, which the bytes are moved to from the interrupt
+#define SERIAL_CODAL_RX_BUFFER_SIZE 255
+
+#ifndef SERIAL_MAX_RX_BUFFER_SIZE
+#define SERIAL_MAX_RX_BUFFER_SIZE 4096
+#endif
+
+// With a large receive buffer, bytes are moved out of the CODAL one every this many, so that it
+// never gets close to full at high baud rates; the rest is picked up when the program reads
+#ifndef SERIAL_RX_DRAIN_THRESHOLD
+#define SERIAL_RX_DRAIN_THRESHOLD 32
+#endif
+
 namespace serial {
 
 class CodalSerialDeviceProxy {
@@ -13,27 +27,123 @@ class CodalSerialDeviceProxy {
     DevicePin *tx;
     DevicePin *rx;
 
+    // the large receive buffer; NULL when the CODAL one is big enough. It holds up to
+    // rxRingSize - 1 bytes, written from the interrupt and read by the program
+    uint8_t *rxRing;
+    uint16_t rxRingSize;
+    volatile uint16_t rxHead, rxTail;
+
+    int ringBytes() {
+        int n = rxHead - rxTail;
+        return n < 0 ? n + rxRingSize : n;
+    }
+
+    // moves what CODAL has received to rxRing; with interrupts off, unless in one
+    void drain() {
+        uint8_t tmp[SERIAL_RX_DRAIN_THRESHOLD];
+        for (;;) {
+            int space = rxRingSize - 1 - ringBytes();
+            if (space > (int)sizeof(tmp))
+                space = sizeof(tmp);
+            if (space <= 0)
+                return; // what's left stays with CODAL, and is dropped once that is full too
+            int r = ser.read(tmp, space, SerialMode::ASYNC);
+            if (r <= 0)
+                return;
+            for (int i = 0; i < r; ++i) {
+                rxRing[rxHead] = tmp[i];
+                rxHead = rxHead + 1 == rxRingSize ? 0 : rxHead + 1;
+            }
+            if (r < space)
+                return;
+        }
+    }
+
+    void onHeadMatch(Event) {
+        if (!rxRing)
+            return;
+        drain();
+        ser.eventAfter(SERIAL_RX_DRAIN_THRESHOLD);
+    }
+
+    // CODAL drops the byte it can't keep
+    void onRxFull(Event) {
+        overruns++;
+        if (rxRing)
+            drain();
+    }
+
   public:
     CODAL_SERIAL ser;
     CodalSerialDeviceProxy *next;
+    // received bytes dropped because the receive buffer was full
+    uint32_t overruns;
 
     CodalSerialDeviceProxy(DevicePin *_tx, DevicePin *_rx, uint16_t id)
-        : tx(_tx), rx(_rx), ser(*tx, *rx), next(NULL) {
+        : tx(_tx), rx(_rx), rxRing(NULL), rxRingSize(0), rxHead(0), rxTail(0), ser(*tx, *rx),
+          next(NULL), overruns(0) {
         if (id <= 0)
             id = allocateNotifyEvent();
         ser.id = id;
         ser.setBaud(115200);
+        // immediate, as the bytes have to be moved before more arrive
+        EventModel::defaultEventBus->listen(ser.id, CODAL_SERIAL_EVT_HEAD_MATCH, this,
+                                            &CodalSerialDeviceProxy::onHeadMatch,
+                                            MESSAGE_BUS_LISTENER_IMMEDIATE);
+        EventModel::defaultEventBus->listen(ser.id, CODAL_SERIAL_EVT_RX_FULL, this,
+                                            &CodalSerialDeviceProxy::onRxFull,
+                                            MESSAGE_BUS_LISTENER_IMMEDIATE);
     }
 
     bool matchPins(DevicePin *_tx, DevicePin *_rx) { return this->tx == _tx && this->rx == _rx; }
 
-    void setRxBufferSize(uint8_t size) { ser.setRxBufferSize(size); }
+    void setRxBufferSize(int size) {
+        if (size > SERIAL_MAX_RX_BUFFER_SIZE)
+            size = SERIAL_MAX_RX_BUFFER_SIZE;
+        if (size < 0)
+            size = 0;
+
+        target_disable_irq();
+        auto old = rxRing;
+        rxRing = NULL;
+        target_enable_irq();
+        // what was in the old ring is dropped, as CODAL does when resizing its own
+        free(old);
+
+        if (size <= SERIAL_CODAL_RX_BUFFER_SIZE) {
+            ser.setRxBufferSize(size);
+            return;
+        }
+
+        ser.setRxBufferSize(SERIAL_CODAL_RX_BUFFER_SIZE);
+        auto ring = (uint8_t *)malloc(size + 1);
+        target_disable_irq();
+        rxRing = ring;
+        rxRingSize = size + 1;
+        rxHead = rxTail = 0;
+        target_enable_irq();
+        ser.eventAfter(SERIAL_RX_DRAIN_THRESHOLD);
+    }
+
+    int rxOverruns() { return overruns; }
 
     void setTxBufferSize(uint8_t size) { ser.setTxBufferSize(size); }
 
     void setBaudRate(int rate) { ser.setBaud(rate); }
 
     int read() {
+        if (rxRing) {
+            target_disable_irq();
+            drain();
+            int c = DEVICE_NO_DATA;
+            if (rxHead != rxTail) {
+                c = rxRing[rxTail];
+                rxTail = rxTail + 1 == rxRingSize ? 0 : rxTail + 1;
+            }
+            target_enable_irq();
+            return c;
+        }
+
         uint8_t buf[1];
         auto r = ser.read(buf, 1, codal::SerialMode::ASYNC);
         // r < 0 => error
@@ -47,6 +157,20 @@ class CodalSerialDeviceProxy {
     }
 
     Buffer readBuffer() {
+        if (rxRing) {
+            target_disable_irq();
+            drain();
+            int n = ringBytes();
+            target_enable_irq();
+            // only the interrupt writes to the ring, and only the program reads from it
+            auto buf = mkBuffer(NULL, n);
+            for (int i = 0; i < n; ++i) {
+                buf->data[i] = rxRing[rxTail];
+                rxTail = rxTail + 1 == rxRingSize ? 0 : rxTail + 1;
+            }
+            return buf;
+        }
+
         int n = ser.getRxBufferSize();
         // n maybe 0 but we still call read to force
         // to initialize rx
@@ -77,7 +201,8 @@ class CodalSerialDeviceProxy {
     }
 
     void onEvent(SerialEvent event, Action handler) {
-        ser.setRxBufferSize(ser.getRxBufferSize()); // turn on reading
+        if (!rxRing)
+            ser.setRxBufferSize(ser.getRxBufferSize()); // turn on reading
         registerWithDal(ser.id, (int)event, handler);
     }
 
@@ -157,6 +157,17 @@ namespace serial {
             ser.serialDevice.setRxBufferSize(size);
     }
 
+    /**
+    * Gets the number of received bytes that were dropped because the RX buffer was full
+    */
+    //% group="Configuration"
+    export function rxOverruns(): number {
+        const ser = device();
+        if (ser)
+            return ser.serialDevice.rxOverruns();
+        return 0;
+    }
+
     /**
     * Sets the size of the TX buffer in bytes
     */
@@ -22,7 +22,13 @@ declare interface SerialDevice {
      * Sets the size of the RX buffer in bytes
      */
     //% shim=SerialDeviceMethods::setRxBufferSize
-    setRxBufferSize(size: uint8): void;
+    setRxBufferSize(size: int32): void;
+
+    /**
+     * Bytes received since startup that were dropped because the RX buffer was full
+     */
+    //% shim=SerialDeviceMethods::rxOverruns
+    rxOverruns(): int32;
 
     /**
      * Sets the size of the TX buffer in bytes
@@ -0,0 +1,301 @@
+#include "pxt.h"
+#include "logstore.h"
+
+#if SETTINGS_LOG
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define LOG_MAGIC 0x474f4c53 // "SLOG"
+#define LOG_REMOVED 0xffffffffU
+
+#define FAIL(msg)                                                                                  \
+    do {                                                                                           \
+        DMESG("FAILURE: %s", msg);                                                                 \
+        abort();                                                                                   \
+    } while (0)
+
+namespace settings {
+
+struct LogHeader {
+    uint32_t magic;
+    uint32_t version;
+};
+
+// followed by the key, with its NUL, and the value
+struct LogRecord {
+    uint32_t check;    // hash_fnv1() of the rest of the record
+    uint32_t keyLen;   // including NUL
+    uint32_t valueLen; // LOG_REMOVED for removals
+};
+
+static uint32_t valueLen(const LogRecord &rec) {
+    return rec.valueLen == LOG_REMOVED ? 0 : rec.valueLen;
+}
+
+static uint32_t recordSize(const LogRecord &rec) {
+    return sizeof(LogRecord) + rec.keyLen + valueLen(rec);
+}
+
+static uint32_t keyHash(const char *key) {
+    return hash_fnv1(key, strlen(key));
+}
+
+LogStore::LogStore(const char *path) {
+    this->path = strdup(path);
+    fd = -1;
+    map = NULL;
+    mapSize = 0;
+    slots = NULL;
+    load();
+}
+
+LogStore::~LogStore() {
+    unload();
+    free(path);
+}
+
+void LogStore::load() {
+    fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        DMESG("errno=%d", errno);
+        FAIL("can't open settings");
+    }
+
+    struct stat st;
+    fstat(fd, &st);
+    end = st.st_size;
+
+    LogHeader hd;
+    if (end < sizeof(hd) || pread(fd, &hd, sizeof(hd), 0) != sizeof(hd) || hd.magic != LOG_MAGIC) {
+        if (end)
+            DMESG("settings: %s is invalid; starting over", path);
+        hd.magic = LOG_MAGIC;
+        hd.version = 1;
+        if (ftruncate(fd, 0) || pwrite(fd, &hd, sizeof(hd), 0) != sizeof(hd))
+            FAIL("can't write settings");
+        end = sizeof(hd);
+    }
+
+    remap();
+
+    numSlots = 64;
+    usedSlots = 0;
+    slots = new Slot[numSlots];
+    memset(slots, 0, numSlots * sizeof(Slot));
+    liveBytes = sizeof(hd);
+
+    uint32_t size = end;
+    uint32_t off = sizeof(hd);
+    while (off + sizeof(LogRecord) <= size) {
+        LogRecord rec;
+        memcpy(&rec, map + off, sizeof(rec));
+        auto key = (const char *)(map + off + sizeof(rec));
+        auto left = size - off - sizeof(rec);
+        if (rec.keyLen == 0 || rec.keyLen > left || valueLen(rec) > left - rec.keyLen ||
+            key[rec.keyLen - 1] != 0 ||
+            hash_fnv1(map + off + 4, recordSize(rec) - 4) != rec.check)
+            break;
+        addToIndex(keyHash(key), off);
+        off += recordSize(rec);
+    }
+
+    if (off != size) {
+        DMESG("settings: dropping %d bytes at the end of %s", size - off, path);
+        if (ftruncate(fd, off))
+            FAIL("can't truncate settings");
+    }
+    end = off;
+}
+
+void LogStore::unload() {
+    if (map)
+        munmap(map, mapSize);
+    map = NULL;
+    mapSize = 0;
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    delete[] slots;
+    slots = NULL;
+}
+
+void LogStore::remap() {
+    if (end <= mapSize)
+        return;
+    if (map)
+        munmap(map, mapSize);
+    // leave room to append to, without mapping again every time; pages past the end of the file
+    // are never touched
+    mapSize = (end + SETTINGS_LOG_MIN_COMPACT + 4095) & ~4095;
+    map = (uint8_t *)mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        DMESG("errno=%d", errno);
+        FAIL("can't mmap settings");
+    }
+}
+
+LogStore::Slot *LogStore::lookup(const char *key, uint32_t hash) {
+    uint32_t mask = numSlots - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        auto s = &slots[i];
+        if (!s->offset ||
+            (s->hash == hash && strcmp((const char *)(map + s->offset + sizeof(LogRecord)), key) == 0))
+            return s;
+    }
+}
+
+void LogStore::addToIndex(uint32_t hash, uint32_t offset) {
+    LogRecord rec;
+    memcpy(&rec, map + offset, sizeof(rec));
+    auto key = (const char *)(map + offset + sizeof(rec));
+
+    auto s = lookup(key, hash);
+    if (s->offset) {
+        LogRecord prev;
+        memcpy(&prev, map + s->offset, sizeof(prev));
+        if (prev.valueLen != LOG_REMOVED)
+            liveBytes -= recordSize(prev);
+    } else if ((usedSlots + 1) * 4 > numSlots * 3) {
+        auto old = slots;
+        auto oldNum = numSlots;
+        numSlots *= 2;
+        slots = new Slot[numSlots];
+        memset(slots, 0, numSlots * sizeof(Slot));
+        uint32_t mask = numSlots - 1;
+        for (uint32_t j = 0; j < oldNum; ++j) {
+            if (!old[j].offset)
+                continue;
+            auto i = old[j].hash & mask;
+            while (slots[i].offset)
+                i = (i + 1) & mask;
+            slots[i] = old[j];
+        }
+        delete[] old;
+        s = lookup(key, hash);
+    }
+
+    if (!s->offset)
+        usedSlots++;
+    s->hash = hash;
+    s->offset = offset;
+    if (rec.valueLen != LOG_REMOVED)
+        liveBytes += recordSize(rec);
+}
+
+int LogStore::append(const char *key, const void *data, uint32_t len) {
+    LogRecord rec;
+    rec.keyLen = strlen(key) + 1;
+    rec.valueLen = len;
+
+    auto size = recordSize(rec);
+    auto buf = new uint8_t[size];
+    memcpy(buf + sizeof(rec), key, rec.keyLen);
+    if (data)
+        memcpy(buf + sizeof(rec) + rec.keyLen, data, len);
+    memcpy(buf, &rec, sizeof(rec));
+    rec.check = hash_fnv1(buf + 4, size - 4);
+    memcpy(buf, &rec, sizeof(rec));
+
+    auto r = pwrite(fd, buf, size, end);
+    delete[] buf;
+    if (r != (int)size) {
+        DMESG("errno=%d", errno);
+        // don't leave half a record for the next one to follow
+        if (ftruncate(fd, end))
+            FAIL("can't truncate settings");
+        return -1;
+    }
+
+    auto off = end;
+    end += size;
+    remap();
+    addToIndex(keyHash(key), off);
+    return 0;
+}
+
+int LogStore::write(const char *key, const void *data, uint32_t len) {
+    if (append(key, data, len))
+        return -1;
+    if (end > SETTINGS_LOG_MIN_COMPACT && end > 2 * liveBytes)
+        compact();
+    return 0;
+}
+
+int LogStore::remove(const char *key) {
+    if (!read(key, NULL))
+        return -1;
+    return write(key, NULL, LOG_REMOVED);
+}
+
+const uint8_t *LogStore::read(const char *key, uint32_t *len) {
+    auto s = lookup(key, keyHash(key));
+    if (!s->offset)
+        return NULL;
+    LogRecord rec;
+    memcpy(&rec, map + s->offset, sizeof(rec));
+    if (rec.valueLen == LOG_REMOVED)
+        return NULL;
+    if (len)
+        *len = rec.valueLen;
+    return map + s->offset + sizeof(rec) + rec.keyLen;
+}
+
+const char *LogStore::keyAt(uint32_t i) {
+    auto off = slots[i].offset;
+    if (!off)
+        return NULL;
+    LogRecord rec;
+    memcpy(&rec, map + off, sizeof(rec));
+    if (rec.valueLen == LOG_REMOVED)
+        return NULL;
+    return (const char *)(map + off + sizeof(rec));
+}
+
+void LogStore::compact(bool (*keep)(const char *key)) {
+    char *tmp;
+    asprintf(&tmp, "%s.tmp", path);
+
+    auto nfd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    bool ok = nfd >= 0;
+
+    LogHeader hd;
+    hd.magic = LOG_MAGIC;
+    hd.version = 1;
+    ok = ok && ::write(nfd, &hd, sizeof(hd)) == sizeof(hd);
+
+    for (uint32_t i = 0; ok && i < numSlots; ++i) {
+        auto key = keyAt(i);
+        if (!key || (keep && !keep(key)))
+            continue;
+        LogRecord rec;
+        memcpy(&rec, map + slots[i].offset, sizeof(rec));
+        auto size = recordSize(rec);
+        ok = ::write(nfd, map + slots[i].offset, size) == (int)size;
+    }
+
+    // the new file has to be complete before it replaces the old one
+    ok = ok && fsync(nfd) == 0;
+    if (nfd >= 0)
+        close(nfd);
+
+    if (ok && rename(tmp, path) == 0) {
+        auto prevEnd = end;
+        unload();
+        load();
+        DMESG("settings: compacted %s from %d to %d bytes", path, prevEnd, end);
+    } else {
+        DMESG("settings: can't compact; errno=%d", errno);
+        unlink(tmp);
+    }
+
+    free(tmp);
+}
+
+} // namespace settings
+
+#endif
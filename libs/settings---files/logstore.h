@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+// Keep all settings in one append-only file, instead of a file per key; needs mmap()
+#ifndef SETTINGS_LOG
+#define SETTINGS_LOG 0
+#endif
+
+// The file is not rewritten while shorter than this
+#ifndef SETTINGS_LOG_MIN_COMPACT
+#define SETTINGS_LOG_MIN_COMPACT (64 * 1024)
+#endif
+
+namespace settings {
+
+// Each write() or remove() appends a record with the key and its new value, or nothing for
+// removals. Records are read through mmap() and found with a hash index in RAM. Once most of the
+// file is records that were overwritten, it's rewritten with the live ones only. A record cut
+// short by a crash fails its checksum and is dropped when the file is opened.
+class LogStore {
+    struct Slot {
+        uint32_t hash;   // of the key
+        uint32_t offset; // of the newest record for the key; 0 when empty
+    };
+
+    char *path;
+    int fd;
+    uint8_t *map;
+    uint32_t mapSize;
+    uint32_t end;       // of the last valid record
+    uint32_t liveBytes; // in the newest record of each key, and the file header
+    Slot *slots;
+    uint32_t numSlots; // power of 2
+    uint32_t usedSlots;
+
+    void load();
+    void unload();
+    void remap();
+    int append(const char *key, const void *data, uint32_t len);
+    Slot *lookup(const char *key, uint32_t hash);
+    void addToIndex(uint32_t hash, uint32_t offset);
+
+  public:
+    LogStore(const char *path);
+    ~LogStore();
+
+    // returns 0 for success, negative for error
+    int write(const char *key, const void *data, uint32_t len);
+    // returns -1 when the key doesn't exist
+    int remove(const char *key);
+    // value of the key, valid until the next write() or remove(); NULL when not found
+    const uint8_t *read(const char *key, uint32_t *len);
+    // the key in index slot i < numKeySlots(), or NULL if it's empty or removed
+    uint32_t numKeySlots() { return numSlots; }
+    const char *keyAt(uint32_t i);
+    // rewrite the file without overwritten and removed values, and keys keep() is false for
+    void compact(bool (*keep)(const char *key) = NULL);
+};
+
+} // namespace settings
@@ -1,6 +1,7 @@
 #define _GNU_SOURCE 1
 
 #include "pxt.h"
+#include "logstore.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -115,8 +116,27 @@ static FILE *openKey(String key, const char *mode) {
     return fopen(keyName(key), mode);
 }
 
+#if SETTINGS_LOG
+static LogStore *logStore() {
+    static LogStore *store;
+    if (!store) {
+        char *name;
+        // '.' is always encoded in key file names
+        asprintf(&name, "%s/settings.log", settingsDirectory());
+        store = new LogStore(name);
+        free(name);
+    }
+    return store;
+}
+#endif
+
 //%
 int _set(String key, Buffer data) {
+#if SETTINGS_LOG
+    if (logStore()->write(key->getUTF8Data(), data->data, data->length))
+        FAIL("can't write settings");
+    return 0;
+#else
     // DMESG("set[%s] - %p", key->getUTF8Data(), data);
     auto f = openKey(key, "wb");
     if (!f) {
@@ -126,22 +146,39 @@ int _set(String key, Buffer data) {
     fwrite(data->data, data->length, 1, f);
     fclose(f);
     return 0;
+#endif
 }
 
 //%
 int _remove(String key) {
+#if SETTINGS_LOG
+    return logStore()->remove(key->getUTF8Data());
+#else
     return remove(keyName(key));
+#endif
 }
 
 //%
 bool _exists(String key) {
+#if SETTINGS_LOG
+    return logStore()->read(key->getUTF8Data(), NULL) != NULL;
+#else
     auto f = openKey(key, "rb");
     fclose(f);
     return f != NULL;
+#endif
 }
 
 //%
 Buffer _get(String key) {
+#if SETTINGS_LOG
+    uint32_t len;
+    auto data = logStore()->read(key->getUTF8Data(), &len);
+    if (!data)
+        return NULL;
+    // mkBuffer() doesn't write settings, so data stays valid
+    return mkBuffer(data, len);
+#else
     auto f = openKey(key, "rb");
     if (f == NULL)
         return NULL;
@@ -154,10 +191,46 @@ Buffer _get(String key) {
     fclose(f);
     unregisterGCObj(ret);
     return ret;
+#endif
+}
+
+// values are copied out of files
+//%
+Buffer _getInPlace(String key) {
+    return _get(key);
+}
+
+//%
+int _generation() {
+    return 0;
+}
+
+static bool isSystem(const char *key) {
+    return key[0] == '#';
+}
+
+// settings are written to the file as they're set
+//%
+void _beginBatch() {}
+
+//%
+int _commitBatch() {
+    return 0;
+}
+
+//%
+Buffer _stats() {
+    // there's no flash to wear out here
+    uint32_t data[9] = {0};
+    return mkBuffer(data, sizeof(data));
 }
 
 //%
 void _userClean() {
+#if SETTINGS_LOG
+    logStore()->compact(isSystem);
+    return;
+#endif
     auto dp = opendir(settingsDirectory());
     if (!dp)
         return;
@@ -182,6 +255,23 @@ RefCollection *_list(String prefix) {
     auto prefLen = prefix->getUTF8Size();
     auto wantsInternal = prefData[0] == '#';
 
+#if SETTINGS_LOG
+    auto st = logStore();
+    for (uint32_t i = 0; i < st->numKeySlots(); ++i) {
+        auto name = st->keyAt(i);
+        if (!name || (!wantsInternal && name[0] == '#'))
+            continue;
+        if (memcmp(name, prefData, prefLen) != 0)
+            continue;
+        auto str = mkString(name, -1);
+        registerGCObj(str);
+        res->head.push((TValue)str);
+        unregisterGCObj(str);
+    }
+    unregisterGCObj(res);
+    return res;
+#endif
+
     auto dp = opendir(settingsDirectory());
 
     for (;;) {
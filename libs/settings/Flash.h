@@ -16,6 +16,12 @@ class Flash {
      */
     virtual int erasePage(uintptr_t address) = 0;
 
+    /**
+     * Erase page like erasePage(), letting other fibers run until it's done, where the flash
+     * controller allows that. Must be called from a fiber.
+     */
+    virtual int erasePageAsync(uintptr_t address) { return erasePage(address); }
+
     /**
      * Write given number of bytes within one page. Flash has to be erased first.
      */
@@ -32,6 +38,9 @@ class ZFlash : public Flash {
     virtual int pageSize(uintptr_t address);
     virtual int totalSize();
     virtual int erasePage(uintptr_t address);
+#if defined(SAMD51) || defined(NRF52_SERIES)
+    virtual int erasePageAsync(uintptr_t address);
+#endif
     virtual int writeBytes(uintptr_t dst, const void *src, uint32_t len);
 };
 
@@ -40,6 +40,33 @@ int ZFlash::erasePage(uintptr_t address) {
     return 0;
 }
 
+// The CPU stalls while flash erases, for up to 85ms a page, which starves audio and misses events.
+// Where the NVMC can erase a page in slices, other fibers run in between.
+#define ERASE_PAGE_MS 85
+#define ERASE_SLICE_MS 10
+
+int ZFlash::erasePageAsync(uintptr_t address) {
+#if defined(NVMC_CONFIG_WEN_PEen)
+    if (address & (pageSize(address) - 1))
+        target_panic(DEVICE_FLASH_ERROR);
+
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_PEen;
+    waitForLast();
+    NRF_NVMC->ERASEPAGEPARTIALCFG = ERASE_SLICE_MS;
+    for (int ms = 0; ms < ERASE_PAGE_MS; ms += ERASE_SLICE_MS) {
+        NRF_NVMC->ERASEPAGEPARTIAL = address;
+        waitForLast();
+        fiber_sleep(1);
+    }
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren;
+    waitForLast();
+
+    return 0;
+#else
+    return erasePage(address);
+#endif
+}
+
 int ZFlash::writeBytes(uintptr_t dst, const void *src, uint32_t len) {
     LOG("WR flash at %p len=%d", (void *)dst, len);
 
@@ -57,6 +57,13 @@ static uint16_t fnhash(const char *fn) {
     return h ^ (h >> 16);
 }
 
+// bytes written before a value of len bytes at offset, so it can be used as a Buffer in place
+static uint32_t valueHeaderSize(uint32_t offset, uint32_t len) {
+    if (len < RAFFS_INPLACE_MIN_SIZE)
+        return 0;
+    return ((4 - (offset & 3)) & 3) + 8;
+}
+
 FS::FS(Flash &flash, uintptr_t baseAddr, uint32_t bytes)
     : flash(flash), baseAddr(baseAddr), bytes(bytes) {
     locked = false;
@@ -69,8 +76,15 @@ FS::FS(Flash &flash, uintptr_t baseAddr, uint32_t bytes)
     cachedMeta = NULL;
     flashBufAddr = 0;
     blocked = NULL;
+    batching = false;
+    batch = NULL;
+    cachedStaged = NULL;
+    index = NULL;
+    indexSize = 0;
+    indexUsed = 0;
     gcHorizon = -10000000;
     minGCSpacing = 0;
+    memset(&stats, 0, sizeof(stats));
 
     if (bytes > 0x20000)
         oops();
@@ -85,7 +99,8 @@ FS::FS(Flash &flash, uintptr_t baseAddr, uint32_t bytes)
         raffs_unlocked_event = codal::allocateNotifyEvent();
 }
 
-void FS::erasePages(uintptr_t addr, uint32_t len) {
+// async erases let other fibers run; they wait for the lock to use the FS
+void FS::erasePages(uintptr_t addr, uint32_t len, bool async) {
     auto end = addr + len;
     auto page = flash.pageSize(addr);
     if (addr & (page - 1))
@@ -93,7 +108,11 @@ void FS::erasePages(uintptr_t addr, uint32_t len) {
     while (addr < end) {
         if (flash.pageSize(addr) != page)
             oops();
-        flash.erasePage(addr);
+        if (async)
+            flash.erasePageAsync(addr);
+        else
+            flash.erasePage(addr);
+        stats.erases++;
 #ifdef CHECK
         for (int i = 0; i < page; ++i)
             if (((uint8_t *)addr)[i] != 0xff)
@@ -104,7 +123,7 @@ void FS::erasePages(uintptr_t addr, uint32_t len) {
 }
 
 void FS::oopsAndClear() {
-    erasePages(baseAddr, bytes);
+    erasePages(baseAddr, bytes, false);
     oops();
 }
 
@@ -113,6 +132,8 @@ void FS::flushFlash() {
         int r = flash.writeBytes(flashBufAddr, flashBuf, sizeof(flashBuf));
         if (r)
             oopsAndClear();
+        stats.programs++;
+        stats.programmedBytes += sizeof(flashBuf);
 #ifdef CHECK
         for (unsigned i = 0; i < sizeof(flashBuf); ++i)
             if (flashBuf[i] != 0xff && flashBuf[i] != ((uint8_t *)flashBufAddr)[i])
@@ -152,6 +173,8 @@ void FS::format() {
     cachedMeta = NULL;
     readDirPtr = NULL;
     clearBlocked();
+    // remount, which also rebuilds the index
+    basePtr = NULL;
 
     LOG("formatting...");
 
@@ -258,6 +281,20 @@ bool FS::tryMount() {
     if (fp[0] != M1 || fp[1] != M1)
         oopsAndClear();
 
+    // a commitBatch() cut short by a reset; GC without its entries, so nothing more is written
+    // after them
+    MetaEntry *unfinished = NULL;
+    for (auto m = endPtr - 1; m >= metaPtr; m--)
+        if (m->isBatch() && m - metaPtr < m->_datasize)
+            unfinished = m;
+    if (unfinished) {
+        LOG("dropping unfinished batch at %x", OFF(unfinished));
+        metaPtr = unfinished + 1;
+        gc(0, NULL);
+    } else {
+        buildIndex();
+    }
+
     LOG("mounted, end=%x meta=%x free=%x", OFF(endPtr), OFF(metaPtr), OFF(freeDataPtr));
 
     return true;
@@ -272,7 +309,10 @@ void FS::mount() {
         oopsAndClear();
 }
 
-FS::~FS() {}
+FS::~FS() {
+    clearBatch();
+    delete[] index;
+}
 
 int FS::write(const char *keyName, const void *data, uint32_t bytes) {
     auto isDel = data == NULL && bytes == M1;
@@ -284,8 +324,16 @@ int FS::write(const char *keyName, const void *data, uint32_t bytes) {
     else
         LOGV("write: %s sz=%d", keyName, bytes);
 
+    if (batching)
+        return stage(keyName, data, bytes);
+
+    if (!isDel)
+        stats.requestedBytes += bytes;
+
     lock();
     uint32_t szneeded = bytes;
+    if (!isDel && bytes >= RAFFS_INPLACE_MIN_SIZE)
+        szneeded += RAFFS_INPLACE_HEADER_MAX;
     auto existing = findMetaEntry(keyName);
     auto prevBase = basePtr;
 
@@ -316,7 +364,7 @@ int FS::write(const char *keyName, const void *data, uint32_t bytes) {
         newMeta.fnhash = fnhash(keyName);
         newMeta.fnptr = writeData(keyName, strlen(keyName) + 1);
     }
-    newMeta.dataptr = isDel ? 0 : writeData(data, bytes);
+    newMeta.dataptr = isDel ? 0 : writeValue(data, bytes);
     newMeta._datasize = bytes;
     if (existing)
         newMeta._datasize |= RAFFS_FOLLOWING_MASK;
@@ -324,6 +372,7 @@ int FS::write(const char *keyName, const void *data, uint32_t bytes) {
 
     writeBytes(--metaPtr, &newMeta, sizeof(newMeta));
     flushFlash();
+    addToIndex(metaPtr);
 
     unlock();
     return 0;
@@ -333,12 +382,21 @@ int FS::read(const char *keyName, void *data, uint32_t bytes) {
     lock();
     int r = -1;
     MetaEntry *meta;
+    BatchEntry *staged;
     if (keyName) {
-        cachedMeta = meta = findMetaEntry(keyName);
+        staged = cachedStaged = findStaged(keyName);
+        cachedMeta = meta = staged ? NULL : findMetaEntry(keyName);
     } else {
+        staged = cachedStaged;
         meta = cachedMeta;
     }
-    if (meta != NULL && meta->dataptr) {
+    if (staged != NULL) {
+        if (staged->data) {
+            r = staged->bytes;
+            if (data)
+                memcpy(data, staged->data, bytes > (unsigned)r ? r : bytes);
+        }
+    } else if (meta != NULL && meta->dataptr) {
         r = meta->datasize();
         if (data) {
             if (bytes > (unsigned)r)
@@ -350,10 +408,162 @@ int FS::read(const char *keyName, void *data, uint32_t bytes) {
     return r;
 }
 
+const void *FS::readInPlace(const char *keyName) {
+    lock();
+    const void *r = NULL;
+    auto meta = batching && findStaged(keyName) ? NULL : findMetaEntry(keyName);
+    if (meta != NULL && meta->dataptr && (meta->dataptr & 3) == 0) {
+        auto hd = (uint32_t *)(basePtr + meta->dataptr) - 2;
+        if (hd[0] == (uint32_t)(uintptr_t)&pxt::buffer_vt && hd[1] == meta->datasize())
+            r = hd;
+    }
+    unlock();
+    return r;
+}
+
 int FS::remove(const char *keyName) {
     return write(keyName, NULL, M1);
 }
 
+BatchEntry *FS::findStaged(const char *keyName) {
+    for (auto e = batch; e; e = e->next)
+        if (strcmp(e->keyName, keyName) == 0)
+            return e;
+    return NULL;
+}
+
+int FS::stage(const char *keyName, const void *data, uint32_t bytes) {
+    lock();
+    cachedMeta = NULL;
+    cachedStaged = NULL;
+
+    auto e = findStaged(keyName);
+    if (!data && !findMetaEntry(keyName)) {
+        // nothing to remove in flash; just forget the staged value, if any
+        if (!e) {
+            unlock();
+            return -1;
+        }
+        auto pp = &batch;
+        while (*pp != e)
+            pp = &(*pp)->next;
+        *pp = e->next;
+        delete[] e->keyName;
+        delete[] e->data;
+        delete e;
+        unlock();
+        return 0;
+    }
+
+    if (!e) {
+        e = new BatchEntry;
+        auto len = strlen(keyName) + 1;
+        e->keyName = new char[len];
+        memcpy(e->keyName, keyName, len);
+        e->data = NULL;
+        e->next = batch;
+        batch = e;
+    }
+
+    delete[] e->data;
+    e->data = NULL;
+    e->bytes = bytes;
+    if (data) {
+        e->data = new uint8_t[bytes ? bytes : 1];
+        memcpy(e->data, data, bytes);
+    }
+
+    unlock();
+    return 0;
+}
+
+void FS::clearBatch() {
+    while (batch) {
+        auto e = batch;
+        batch = e->next;
+        delete[] e->keyName;
+        delete[] e->data;
+        delete e;
+    }
+    cachedStaged = NULL;
+}
+
+int FS::commitBatch() {
+    lock();
+    batching = false;
+    cachedMeta = NULL;
+    int r = writeBatch();
+    clearBatch();
+    unlock();
+    return r;
+}
+
+int FS::writeBatch() {
+    int num = 0;
+    int spaceNeeded = sizeof(MetaEntry);
+    for (auto e = batch; e; e = e->next) {
+        auto existing = findMetaEntry(e->keyName);
+        if (!existing && !e->data)
+            continue;
+        num++;
+        uint32_t sz = e->data ? e->bytes : 0;
+        if (sz >= RAFFS_INPLACE_MIN_SIZE)
+            sz += RAFFS_INPLACE_HEADER_MAX;
+        if (!existing)
+            sz += strlen(e->keyName) + 1;
+        spaceNeeded += sizeof(MetaEntry) + RAFFS_ROUND(sz);
+    }
+
+    if (!num)
+        return 0;
+
+    LOGV("commit: %d keys, %d bytes", num, spaceNeeded);
+
+    if (!tryGC(spaceNeeded))
+        return -1;
+
+    // names and values first, like write(); the GC might have moved the existing entries
+    auto metas = new MetaEntry[num];
+    auto m = metas;
+    for (auto e = batch; e; e = e->next) {
+        auto existing = findMetaEntry(e->keyName);
+        if (!existing && !e->data)
+            continue;
+        if (existing) {
+            m->fnhash = existing->fnhash;
+            m->fnptr = existing->fnptr;
+        } else {
+            m->fnhash = fnhash(e->keyName);
+            m->fnptr = writeData(e->keyName, strlen(e->keyName) + 1);
+        }
+        m->dataptr = e->data ? writeValue(e->data, e->bytes) : 0;
+        m->_datasize = e->bytes;
+        if (existing)
+            m->_datasize |= RAFFS_FOLLOWING_MASK;
+        if (e->data)
+            stats.requestedBytes += e->bytes;
+        m++;
+    }
+    finishWrite();
+
+    // then the marker, and the meta entries right after it; they share flash writes
+    MetaEntry marker;
+    marker.fnhash = 0;
+    marker.fnptr = 0;
+    marker._datasize = num;
+    marker.dataptr = 0;
+    writeBytes(--metaPtr, &marker, sizeof(marker));
+    for (int i = 0; i < num; ++i)
+        writeBytes(--metaPtr, &metas[i], sizeof(MetaEntry));
+    flushFlash();
+    delete[] metas;
+
+    for (int i = 0; i < num; ++i)
+        addToIndex(metaPtr + i);
+
+    return 0;
+}
+
 void FS::lock() {
     while (locked)
         fiber_wait_for_event(DEVICE_ID_NOTIFY, raffs_unlocked_event);
@@ -375,17 +585,56 @@ MetaEntry *FS::findMetaEntry(const char *filename) {
     uint16_t h = fnhash(filename);
     uint16_t buflen = strlen(filename) + 1;
 
-    for (auto p = metaPtr; p < endPtr; p++) {
-        // LOGV("check at %x %x %x", OFF(p),p->fnhash,h);
+    uint16_t mask = indexSize - 1;
+    for (uint16_t i = h & mask; index[i]; i = (i + 1) & mask) {
+        auto p = endPtr - index[i];
         if (p->fnhash == h && memcmp(fnptr(p), filename, buflen) == 0)
             return p;
     }
 
-    // LOGV("fail");
-
     return NULL;
 }
 
+// all entries of a key share its fnptr, so the newest one replaces the one indexed
+void FS::addToIndex(MetaEntry *m) {
+    if ((indexUsed + 1) * 4 > indexSize * 3) {
+        buildIndex();
+        return;
+    }
+
+    uint16_t mask = indexSize - 1;
+    uint16_t i = m->fnhash & mask;
+    while (index[i] && (endPtr - index[i])->fnptr != m->fnptr)
+        i = (i + 1) & mask;
+    if (!index[i])
+        indexUsed++;
+    index[i] = endPtr - m;
+}
+
+void FS::buildIndex() {
+    unsigned keys = 0;
+    for (auto p = metaPtr; p < endPtr; p++)
+        if (p->isFirst() && !p->isBatch())
+            keys++;
+
+    // keep it at most 3/4 full, with room to grow
+    unsigned size = 16;
+    while (size * 3 < (keys + 8) * 4)
+        size <<= 1;
+    if (size != indexSize) {
+        delete[] index;
+        index = new uint16_t[size];
+        indexSize = size;
+    }
+    memset(index, 0, size * sizeof(uint16_t));
+    indexUsed = 0;
+
+    // oldest first, so newer entries replace them
+    for (auto p = endPtr - 1; p >= metaPtr; p--)
+        if (!p->isBatch())
+            addToIndex(p);
+}
+
 void FS::forceGC(filename_filter filter) {
     lock();
     tryGC(0x7fff0000, filter);
@@ -419,6 +668,12 @@ bool FS::tryGC(int spaceNeeded, filename_filter filter) {
     }
 
     LOG("running flash FS GC; needed %d, left %d", spaceNeeded, spaceLeft);
+    return gc(spaceNeeded, filter);
+}
+
+bool FS::gc(int spaceNeeded, filename_filter filter) {
+    int now = (int)system_timer_current_time();
+    stats.gcRuns++;
 
     readDirPtr = NULL;
     cachedMeta = NULL;
@@ -438,6 +693,8 @@ bool FS::tryGC(int spaceNeeded, filename_filter filter) {
         auto offset = sizeof(FSHeader);
         for (auto p = metaPtr; p < endPtr; p++) {
             MetaEntry m = *p;
+            if (m.isBatch())
+                continue;
             const char *fn = fnptr(&m);
 
             if (filter && !filter(fn))
@@ -448,17 +705,18 @@ bool FS::tryGC(int spaceNeeded, filename_filter filter) {
 
             LOGV("GC %s sz=%d @%x", fn, m.datasize(), m.dataptr);
             auto fnlen = strlen(fn) + 1;
-            auto sz = fnlen + m.datasize();
+            auto hdsize = valueHeaderSize(offset + fnlen, m.datasize());
+            auto sz = fnlen + hdsize + m.datasize();
 
             if (iter == 0) {
                 auto fd = freeDataPtr;
                 writeData(fn, fnlen);
-                writeData(basePtr + m.dataptr, m.datasize());
+                writeValue(basePtr + m.dataptr, m.datasize());
                 if (freeDataPtr - fd != (int)sz)
                     oops();
             } else {
                 m.fnptr = offset;
-                m.dataptr = offset + fnlen;
+                m.dataptr = offset + fnlen + hdsize;
                 m._datasize &= ~RAFFS_FOLLOWING_MASK;
                 writeBytes(--metaDst, &m, sizeof(m));
             }
@@ -484,6 +742,13 @@ bool FS::tryGC(int spaceNeeded, filename_filter filter) {
     basePtr = newBaseP;
     endPtr = (MetaEntry *)(newBase + bytes / 2);
     metaPtr = metaDst;
+    buildIndex();
+
+    uint32_t gcMs = (int)system_timer_current_time() - now;
+    stats.gcTotalMs += gcMs;
+    if (gcMs > stats.gcMaxMs)
+        stats.gcMaxMs = gcMs;
+    dumpStats();
 
     if ((intptr_t)metaDst - (intptr_t)freeDataPtr <= spaceNeeded + 64) {
         if (filter != NULL && spaceNeeded != 0x7fff0000) {
@@ -508,7 +773,7 @@ DirEntry *FS::dirRead() {
 
     while (readDirPtr < endPtr) {
         auto m = *readDirPtr++;
-        if (checkBlocked(&m) || m.dataptr == 0)
+        if (m.isBatch() || checkBlocked(&m) || m.dataptr == 0)
             continue;
         dirEnt.size = m.datasize();
         dirEnt.flags = 0;
@@ -532,6 +797,16 @@ uint16_t FS::writeData(const void *data, uint32_t len) {
     return r;
 }
 
+uint16_t FS::writeValue(const void *data, uint32_t len) {
+    auto hdsize = valueHeaderSize(freeDataPtr - basePtr, len);
+    if (hdsize) {
+        // alignment, then the vtable and length of a BoxedBuffer
+        uint32_t hd[3] = {0, (uint32_t)(uintptr_t)&pxt::buffer_vt, len};
+        writeData((uint8_t *)(hd + 3) - hdsize, hdsize);
+    }
+    return writeData(data, len);
+}
+
 void FS::finishWrite() {
     auto nfp = RAFFS_ROUND(freeDataPtr);
     int tailSz = nfp - (uintptr_t)freeDataPtr;
@@ -545,6 +820,33 @@ void FS::finishWrite() {
     flushFlash();
 }
 
+uint32_t FS::lifetimeGCs() {
+    lock();
+    auto r = ((FSHeader *)basePtr)->numgc;
+    unlock();
+    return r;
+}
+
+int FS::gcHeadroomMs() {
+    if (!minGCSpacing)
+        return 0x7fffffff;
+    // what tryGC() would compute for a GC now
+    int now = (int)system_timer_current_time();
+    int horizon = gcHorizon + minGCSpacing;
+    if (now - minGCSpacing * 2 > horizon)
+        horizon = now - minGCSpacing * 2;
+    return now - horizon;
+}
+
+// may be called with the lock held
+void FS::dumpStats() {
+    LOG("RAFFS: %d erases, %d programs, %d/%d bytes written/requested, %d GCs (%d ms, max %d), "
+        "%d GCs ever, GC headroom %d ms",
+        stats.erases, stats.programs, stats.programmedBytes, stats.requestedBytes, stats.gcRuns,
+        stats.gcTotalMs, stats.gcMaxMs, basePtr ? ((FSHeader *)basePtr)->numgc : 0,
+        gcHeadroomMs());
+}
+
 int FS::readFlashBytes(uintptr_t addr, void *buffer, uint32_t len) {
     lock();
     memcpy(buffer, (void *)addr, len);
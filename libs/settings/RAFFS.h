@@ -28,10 +28,40 @@ struct MetaEntry {
 
     uint16_t datasize() { return _datasize & 0x7fff; }
     bool isFirst() { return (_datasize & RAFFS_FOLLOWING_MASK) == 0; }
+    // written before the entries of a commitBatch(), with their number in _datasize; fnptr can't
+    // be 0 otherwise, as the header is there
+    bool isBatch() { return fnptr == 0; }
+};
+
+// a write() or remove() between beginBatch() and commitBatch()
+struct BatchEntry {
+    BatchEntry *next;
+    char *keyName;
+    uint8_t *data;  // NULL when removing
+    uint32_t bytes; // 0xffffffff when removing
+};
+
+// Flash use since boot, to see how fast it wears out
+struct FSStats {
+    uint32_t erases;          // pages erased
+    uint32_t programs;        // flash writes, of RAFFS_FLASH_BUFFER_SIZE bytes each
+    uint32_t programmedBytes; // bytes they wrote, including names, metadata and GC copies
+    uint32_t requestedBytes;  // bytes of values written
+    uint32_t gcRuns;
+    uint32_t gcTotalMs;
+    uint32_t gcMaxMs;
 };
 
 #define RAFFS_ROUND(x) ((((uintptr_t)(x) + 7) >> 3) << 3)
 
+// Values at least this long are written after a Buffer header, 4-byte aligned, so that
+// readInPlace() can return them without copying
+#ifndef RAFFS_INPLACE_MIN_SIZE
+#define RAFFS_INPLACE_MIN_SIZE 64
+#endif
+// the most that header and its alignment take
+#define RAFFS_INPLACE_HEADER_MAX 11
+
 typedef bool (*filename_filter)(const char *);
 
 class FS {
@@ -45,21 +75,38 @@ class FS {
     uint8_t flashBuf[RAFFS_FLASH_BUFFER_SIZE];
     BlockedEntries *blocked;
     volatile bool locked;
+    bool batching;
+    BatchEntry *batch, *cachedStaged;
+
+    // open-addressed table of the newest meta entry of each key, by fnhash; slots hold
+    // endPtr - entry, or 0 when empty
+    uint16_t *index;
+    uint16_t indexSize; // power of 2
+    uint16_t indexUsed;
 
-    void erasePages(uintptr_t addr, uint32_t len);
+    void erasePages(uintptr_t addr, uint32_t len, bool async = true);
     void flushFlash();
     void writeBytes(void *dst, const void *src, uint32_t size);
     void mount();
     void lock();
     void unlock();
     MetaEntry *findMetaEntry(const char *filename);
+    void buildIndex();
+    void addToIndex(MetaEntry *m);
     bool tryGC(int spaceNeeded, filename_filter filter = NULL);
+    bool gc(int spaceNeeded, filename_filter filter);
+
+    BatchEntry *findStaged(const char *keyName);
+    int stage(const char *keyName, const void *data, uint32_t bytes);
+    int writeBatch();
+    void clearBatch();
 
     bool checkBlocked(MetaEntry *m);
     void clearBlocked();
     void oopsAndClear();
 
     uint16_t writeData(const void *data, uint32_t len);
+    uint16_t writeValue(const void *data, uint32_t len);
     void finishWrite();
     const char *fnptr(MetaEntry *m) { return (const char *)(basePtr + m->fnptr); }
 
@@ -78,6 +125,7 @@ class FS {
     uint16_t minGCSpacing;
     uintptr_t baseAddr;
     uint32_t bytes;
+    FSStats stats;
 
     FS(codal::Flash &flash, uintptr_t baseAddr, uint32_t bytes);
     ~FS();
@@ -87,9 +135,19 @@ class FS {
     // returns total number of bytes in key's value or -1 when file doesn't exists
     // if keyName==NULL it will re-use last keyName
     int read(const char *keyName, void *data, uint32_t bytes);
+    // the value as a read-only Buffer in flash, valid until the next GC (see lifetimeGCs());
+    // NULL when it wasn't written with a header for that, or only staged in a batch
+    const void *readInPlace(const char *keyName);
     // deletes given key if it exists
     int remove(const char *keyName);
 
+    // from now on write() and remove() only keep the change in RAM, where read() sees it, but
+    // dirRead() doesn't
+    void beginBatch() { batching = true; }
+    // writes the changes since beginBatch() to flash, with a single GC check; after a reset
+    // either all of them are there or none; returns 0 for success, negative when out of space
+    int commitBatch();
+
     void format();
     bool exists(const char *keyName) { return read(keyName, NULL, 0) >= 0; }
     uint32_t totalSize() { return bytes / 2; }
@@ -102,6 +160,12 @@ class FS {
     void dirRewind() { readDirPtr = NULL; }
     DirEntry *dirRead(); // data is only valid until next call to to any of File or FS function
 
+    // GCs since the FS was formatted the first time
+    uint32_t lifetimeGCs();
+    // how long before a GC would panic because of minGCSpacing; negative if it would now
+    int gcHeadroomMs();
+    void dumpStats();
+
 #ifdef RAFFS_TEST
     void debugDump();
     void dump();
@@ -89,6 +89,24 @@ int ZFlash::erasePage(uintptr_t address) {
     return 0;
 }
 
+#ifdef SAMD51
+// The flash has two banks, and code keeps running from the other one while a block erases, so
+// instead of spinning until it's done let other fibers run. The settings are near the end, in the
+// second bank; fibers running code from there, in a big program, stall until the erase is done.
+int ZFlash::erasePageAsync(uintptr_t address) {
+    LOG("Erase async %x", address);
+    NVMCTRL->CTRLA.bit.WMODE = NVMCTRL_CTRLA_WMODE_MAN_Val;
+    waitForLast();
+    unlock();
+    NVMCTRL->ADDR.reg = address;
+    CMD(NVMCTRL_CTRLA_CMD_ER, NVMCTRL_CTRLB_CMD_EB);
+    while (NVMCTRL->STATUS.bit.READY == 0)
+        fiber_sleep(1);
+    lock();
+    return 0;
+}
+#endif
+
 #if 0
 #define CHECK_ECC()                                                                                \
     if (NVMCTRL->INTFLAG.bit.ECCSE || NVMCTRL->INTFLAG.bit.ECCDE)                                  \
@@ -112,10 +112,38 @@ Buffer _get(String key) {
     return ret;
 }
 
+//%
+Buffer _getInPlace(String key) {
+    auto s = mountedStorage();
+    // in flash, where the GC doesn't look
+    auto r = (Buffer)s->fs.readInPlace(key->getUTF8Data());
+    if (r)
+        return r;
+    return _get(key);
+}
+
+//%
+int _generation() {
+    auto s = mountedStorage();
+    return s->fs.lifetimeGCs();
+}
+
 static bool isSystem(const char *fn) {
     return fn[0] == '#';
 }
 
+//%
+void _beginBatch() {
+    auto s = mountedStorage();
+    s->fs.beginBatch();
+}
+
+//%
+int _commitBatch() {
+    auto s = mountedStorage();
+    return s->fs.commitBatch();
+}
+
 //%
 void _userClean() {
     auto s = mountedStorage();
@@ -128,6 +156,16 @@ void _userClean() {
     }
 }
 
+//%
+Buffer _stats() {
+    auto s = mountedStorage();
+    uint32_t data[sizeof(FSStats) / 4 + 2];
+    memcpy(data, &s->fs.stats, sizeof(FSStats));
+    data[sizeof(FSStats) / 4] = s->fs.lifetimeGCs();
+    data[sizeof(FSStats) / 4 + 1] = s->fs.gcHeadroomMs();
+    return mkBuffer(data, sizeof(data));
+}
+
 //%
 RefCollection *_list(String prefix) {
     auto st = mountedStorage();
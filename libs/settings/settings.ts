@@ -19,12 +19,27 @@ namespace settings {
     //% shim=settings::_get
     declare function _get(key: string): Buffer;
 
+    //% shim=settings::_beginBatch
+    declare function _beginBatch(): void;
+
+    //% shim=settings::_commitBatch
+    declare function _commitBatch(): int32;
+
+    //% shim=settings::_getInPlace
+    declare function _getInPlace(key: string): Buffer;
+
+    //% shim=settings::_generation
+    declare function _generation(): int32;
+
     //% shim=settings::_userClean
     declare function _userClean(): void;
 
     //% shim=settings::_list
     declare function _list(prefix: string): string[];
 
+    //% shim=settings::_stats
+    declare function _stats(): Buffer;
+
     export function runNumber() {
         return readNumber(RUN_KEY) || 0
     }
@@ -91,6 +106,25 @@ namespace settings {
         writeBuffer(key, msgpack.packNumberArray(value))
     }
 
+    /**
+     * Keep further writes and removals in memory, until commitBatch() saves them all at once.
+     * Reads see them in the meantime, but list() doesn't.
+     */
+    export function beginBatch() {
+        _beginBatch()
+    }
+
+    /**
+     * Save the settings written since beginBatch(). If the device resets while saving,
+     * either all of them are kept or none.
+     */
+    export function commitBatch() {
+        if (_commitBatch()) {
+            _userClean()
+            control.panic(920)
+        }
+    }
+
     /**
      * Read named setting as a buffer. Returns undefined when setting not found.
      */
@@ -98,6 +132,21 @@ namespace settings {
         return _get(key)
     }
 
+    /**
+     * Read named setting as a buffer, without copying it to RAM where the storage allows that.
+     * The buffer must not be modified, and it's only valid while generation() stays the same.
+     */
+    export function readBufferInPlace(key: string) {
+        return _getInPlace(key)
+    }
+
+    /**
+     * Changes when settings are moved in storage, which happens on some writes and removals.
+     */
+    export function generation() {
+        return _generation()
+    }
+
     /**
      * Read named setting as a string.
      */
@@ -157,6 +206,15 @@ namespace settings {
         return _exists(key)
     }
 
+    /**
+     * Flash statistics since boot, as UInt32LE numbers: pages erased, flash writes, bytes written,
+     * bytes of values written, GCs, total and longest GC time in ms, GCs since the settings were
+     * first formatted, and ms before GCing would panic for happening too often.
+     */
+    export function flashStats() {
+        return _stats()
+    }
+
     function clone(v: any): any {
         if (v == null) return null
         return JSON.parse(JSON.stringify(v))
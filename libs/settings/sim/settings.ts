@@ -63,6 +63,25 @@ namespace pxsim.settings {
         return new RefBuffer(U.stringToUint8Array(atob(val)))
     }
 
+    // the simulator saves each write right away
+    export function _beginBatch(): void { }
+
+    export function _commitBatch() {
+        return 0
+    }
+
+    export function _getInPlace(key: string): RefBuffer {
+        return _get(key)
+    }
+
+    export function _generation() {
+        return 0
+    }
+
+    export function _stats(): RefBuffer {
+        return new RefBuffer(new Uint8Array(36))
+    }
+
     export function _userClean(): void {
         for (let k of userKeys())
             board().setStoredState(k, null)
@@ -0,0 +1,403 @@
+#include "BinLog.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+// values are rounded to int64_t, so they have to stay within the doubles that are whole numbers
+#define BINLOG_LIMIT 9007199254740992.0 // 2^53
+
+namespace codal
+{
+namespace snorfs
+{
+
+static const int64_t scales[BINLOG_MAX_DECIMALS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+static bool readHeader(File *f, BinLogHeader *hd)
+{
+    f->seek(0);
+    return f->read(hd, sizeof(*hd)) == sizeof(*hd) && hd->magic == BINLOG_MAGIC &&
+           hd->decimals <= BINLOG_MAX_DECIMALS;
+}
+
+void BinLogWriter::writeHeader(File *f, const char *columns, char separator, int decimals)
+{
+    BinLogHeader hd;
+    hd.magic = BINLOG_MAGIC;
+    hd.decimals = decimals < 0 ? 0 : decimals > BINLOG_MAX_DECIMALS ? BINLOG_MAX_DECIMALS : decimals;
+    hd.separator = separator;
+    hd.numColumns = 0;
+    hd.reserved = 0;
+
+    int namesLen = *columns ? strlen(columns) + 1 : 0;
+    auto data = new uint8_t[sizeof(hd) + namesLen];
+    auto names = data + sizeof(hd);
+    memcpy(names, columns, namesLen);
+    for (int i = 0; i < namesLen; ++i)
+    {
+        if (names[i] == '\n')
+            names[i] = 0;
+        if (names[i] == 0 && hd.numColumns < 0xff)
+            hd.numColumns++;
+    }
+    memcpy(data, &hd, sizeof(hd));
+
+    f->append(data, sizeof(hd) + namesLen);
+    delete[] data;
+}
+
+BinLogWriter::BinLogWriter(File *f)
+{
+    BinLogHeader hd;
+    decimals = readHeader(f, &hd) ? hd.decimals : 0xff;
+    numValues = 0;
+    rowsSinceSync = BINLOG_SYNC_ROWS;
+}
+
+void BinLogWriter::append(File *f, const double *values, int n)
+{
+    if (!isValid())
+        return;
+    if (n > BINLOG_MAX_VALUES)
+        n = BINLOG_MAX_VALUES;
+
+    // the values in the row before are only known to a reader when it has as many
+    bool sync = rowsSinceSync >= BINLOG_SYNC_ROWS || n != numValues;
+
+    uint8_t data[1 + BINLOG_MAX_VALUES * 10];
+    auto p = data;
+    *p++ = (sync ? BINLOG_ABSOLUTE : 0) | n;
+    for (int i = 0; i < n; ++i)
+    {
+        double x = values[i] * scales[decimals];
+        int64_t v = 0;
+        // NaN fails both
+        if (x > -BINLOG_LIMIT && x < BINLOG_LIMIT)
+            v = (int64_t)(x < 0 ? x - 0.5 : x + 0.5);
+        int64_t d = sync ? v : v - prev[i];
+        prev[i] = v;
+        uint64_t u = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+        while (u >= 0x80)
+        {
+            *p++ = (u & 0x7f) | 0x80;
+            u >>= 7;
+        }
+        *p++ = u;
+    }
+
+    f->append(data, p - data);
+    numValues = n;
+    rowsSinceSync = sync ? 1 : rowsSinceSync + 1;
+}
+
+BinLogCSV::BinLogCSV(FS &fs, const char *filename) : fs(fs)
+{
+    this->filename = strdup(filename);
+    file = NULL;
+    names = NULL;
+    line = NULL;
+    csvSize = 0;
+    numCheckpoints = 0;
+    checkpointStride = 1;
+    syncRows = 0;
+}
+
+BinLogCSV::~BinLogCSV()
+{
+    close();
+    free(filename);
+}
+
+void BinLogCSV::close()
+{
+    delete file;
+    file = NULL;
+    delete[] names;
+    names = NULL;
+    delete[] line;
+    line = NULL;
+}
+
+void BinLogCSV::seek(uint32_t pos)
+{
+    file->seek(pos);
+    bufStart = pos;
+    bufLen = 0;
+    bufPtr = 0;
+}
+
+int BinLogCSV::getByte()
+{
+    if (bufPtr == bufLen)
+    {
+        bufStart += bufLen;
+        bufLen = file->read(buf, sizeof(buf));
+        bufPtr = 0;
+        if (!bufLen)
+            return -1;
+    }
+    return buf[bufPtr++];
+}
+
+bool BinLogCSV::getVarint(uint64_t *v)
+{
+    uint64_t r = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = getByte();
+        if (c < 0)
+            return false;
+        r |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+        {
+            *v = r;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BinLogCSV::open()
+{
+    if (file)
+        return true;
+    file = fs.open(filename, false);
+    if (!file)
+        return false;
+
+    if (!readHeader(file, &hd))
+    {
+        close();
+        return false;
+    }
+
+    // names end at the numColumns-th NUL
+    seek(sizeof(hd));
+    int found = 0;
+    while (found < hd.numColumns)
+    {
+        int c = getByte();
+        if (c < 0)
+        {
+            close();
+            return false;
+        }
+        if (c == 0)
+            found++;
+    }
+    dataStart = tell();
+    namesLen = dataStart - sizeof(hd);
+    names = new char[namesLen + 1];
+    file->seek(sizeof(hd));
+    file->read(names, namesLen);
+
+    // "sep=X\n" and the names line
+    headerLen = 6 + (namesLen ? namesLen : 1);
+    int maxRow = BINLOG_MAX_VALUES * 28 + 1;
+    line = new char[headerLen > maxRow ? headerLen : maxRow];
+
+    seek(dataStart);
+    numValues = 0;
+    lineStart = 0;
+    lineLen = formatHeader();
+    return true;
+}
+
+uint16_t BinLogCSV::formatHeader()
+{
+    auto p = line;
+    memcpy(p, "sep=", 4);
+    p += 4;
+    *p++ = hd.separator;
+    *p++ = '\n';
+    for (int i = 0; i < namesLen; ++i)
+        *p++ = names[i] ? names[i] : i == namesLen - 1 ? '\n' : hd.separator;
+    if (!namesLen)
+        *p++ = '\n';
+    return p - line;
+}
+
+static char *formatNumber(char *p, int64_t v, int decimals)
+{
+    uint64_t u = v < 0 ? -(uint64_t)v : v;
+    uint64_t ip = u / scales[decimals];
+    uint64_t fp = u % scales[decimals];
+
+    if (v < 0)
+        *p++ = '-';
+
+    char tmp[20];
+    int n = 0;
+    do
+    {
+        tmp[n++] = '0' + ip % 10;
+        ip /= 10;
+    } while (ip);
+    while (n)
+        *p++ = tmp[--n];
+
+    if (fp)
+    {
+        *p++ = '.';
+        for (int i = decimals - 1; i >= 0; --i)
+        {
+            p[i] = '0' + fp % 10;
+            fp /= 10;
+        }
+        p += decimals;
+        while (p[-1] == '0')
+            p--;
+    }
+
+    return p;
+}
+
+uint16_t BinLogCSV::formatRow()
+{
+    auto p = line;
+    for (int i = 0; i < numValues; ++i)
+    {
+        if (i)
+            *p++ = hd.separator;
+        p = formatNumber(p, values[i], hd.decimals);
+    }
+    *p++ = '\n';
+    return p - line;
+}
+
+bool BinLogCSV::nextRow(bool *isSync)
+{
+    int tag = getByte();
+    if (tag < 0)
+        return false;
+    int n = tag & ~BINLOG_ABSOLUTE;
+    *isSync = (tag & BINLOG_ABSOLUTE) != 0;
+    // a delta row has the values of the one before; anything else is a row cut short by a reset
+    if (n > BINLOG_MAX_VALUES || (!*isSync && n != numValues))
+        return false;
+
+    for (int i = 0; i < n; ++i)
+    {
+        uint64_t u;
+        if (!getVarint(&u))
+            return false;
+        int64_t d = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+        values[i] = *isSync ? d : values[i] + d;
+    }
+    numValues = n;
+    return true;
+}
+
+void BinLogCSV::addCheckpoint(uint32_t rowStart, uint32_t csvOffset)
+{
+    uint32_t idx = syncRows++;
+    if (idx % checkpointStride)
+        return;
+    if (numCheckpoints == BINLOG_MAX_CHECKPOINTS)
+    {
+        for (int i = 0; i < BINLOG_MAX_CHECKPOINTS / 2; ++i)
+        {
+            checkpoints[i * 2] = checkpoints[i * 4];
+            checkpoints[i * 2 + 1] = checkpoints[i * 4 + 1];
+        }
+        numCheckpoints = BINLOG_MAX_CHECKPOINTS / 2;
+        checkpointStride *= 2;
+        if (idx % checkpointStride)
+            return;
+    }
+    checkpoints[numCheckpoints * 2] = rowStart;
+    checkpoints[numCheckpoints * 2 + 1] = csvOffset;
+    numCheckpoints++;
+}
+
+bool BinLogCSV::scan()
+{
+    if (!open())
+        return false;
+
+    numCheckpoints = 0;
+    checkpointStride = 1;
+    syncRows = 0;
+
+    uint32_t csv = headerLen;
+    for (;;)
+    {
+        uint32_t start = tell();
+        bool isSync;
+        if (!nextRow(&isSync))
+            break;
+        if (isSync)
+            addCheckpoint(start, csv);
+        csv += formatRow();
+    }
+    csvSize = csv;
+
+    seek(dataStart);
+    numValues = 0;
+    lineStart = 0;
+    lineLen = formatHeader();
+    return true;
+}
+
+void BinLogCSV::read(uint32_t offset, void *dst, uint32_t len)
+{
+    auto out = (uint8_t *)dst;
+
+    if (!open())
+    {
+        memset(out, 0, len);
+        return;
+    }
+
+    if (offset < lineStart || offset >= lineStart + lineLen)
+    {
+        // the last sync row at or before offset
+        int lo = 0, hi = numCheckpoints;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (checkpoints[mid * 2 + 1] <= offset)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo > 0 && (offset < lineStart || checkpoints[lo * 2 - 1] > lineStart))
+        {
+            seek(checkpoints[lo * 2 - 2]);
+            lineStart = checkpoints[lo * 2 - 1];
+            lineLen = 0;
+        }
+        else if (lo == 0)
+        {
+            seek(dataStart);
+            numValues = 0;
+            lineStart = 0;
+            lineLen = formatHeader();
+        }
+    }
+
+    uint32_t n = 0;
+    while (n < len)
+    {
+        if (offset >= lineStart + lineLen)
+        {
+            bool isSync;
+            lineStart += lineLen;
+            lineLen = 0;
+            if (!nextRow(&isSync))
+                break;
+            lineLen = formatRow();
+            continue;
+        }
+        uint32_t k = lineStart + lineLen - offset;
+        if (k > len - n)
+            k = len - n;
+        memcpy(out + n, line + offset - lineStart, k);
+        n += k;
+        offset += k;
+    }
+    memset(out + n, 0, len - n);
+}
+
+} // namespace snorfs
+} // namespace codal
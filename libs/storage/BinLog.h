@@ -0,0 +1,123 @@
+#ifndef CODAL_BINLOG_H
+#define CODAL_BINLOG_H
+
+#include "SNORFS.h"
+
+// A binary data log is a header with the column names, followed by rows of numbers, each kept as a
+// whole number of 10^-decimals units, written as the zigzag varint of its difference to the value
+// in the same column of the row before. Every BINLOG_SYNC_ROWS rows, and after a reset, a row is
+// written with the values themselves instead, so that reading can start there.
+//
+// header: BinLogHeader, then the column names, each followed by a NUL
+// row: tag byte (BINLOG_ABSOLUTE and the number of values), then the varints
+
+#define BINLOG_MAGIC 0x31474c44 // "DLG1"
+#define BINLOG_ABSOLUTE 0x80
+
+#ifndef BINLOG_SYNC_ROWS
+#define BINLOG_SYNC_ROWS 64
+#endif
+
+// values past these are dropped from rows
+#define BINLOG_MAX_VALUES 32
+#define BINLOG_MAX_DECIMALS 6
+
+// most rows a CSV view can start reading at, in place of the sync rows; past that, every other
+// one is dropped
+#ifndef BINLOG_MAX_CHECKPOINTS
+#define BINLOG_MAX_CHECKPOINTS 128
+#endif
+
+namespace codal
+{
+namespace snorfs
+{
+
+struct BinLogHeader
+{
+    uint32_t magic;
+    uint8_t decimals;
+    uint8_t separator; // between values, when shown as CSV
+    uint8_t numColumns;
+    uint8_t reserved;
+};
+
+class BinLogWriter
+{
+    uint8_t decimals;
+    uint8_t numValues; // in the row before
+    uint16_t rowsSinceSync;
+    int64_t prev[BINLOG_MAX_VALUES];
+
+public:
+    // columns are separated by '\n'; the file has to be empty
+    static void writeHeader(File *f, const char *columns, char separator, int decimals);
+
+    // reads the header of f; the first row written is a sync row
+    BinLogWriter(File *f);
+    // false if f doesn't start with a header
+    bool isValid() { return decimals != 0xff; }
+    void append(File *f, const double *values, int numValues);
+};
+
+// Shows a binary log as CSV text, like the one datalogger.FileStorage writes, with the names on
+// the first line.
+class BinLogCSV
+{
+    FS &fs;
+    char *filename;
+    File *file; // NULL when closed
+    BinLogHeader hd;
+    char *names;
+    uint16_t namesLen;
+    uint16_t headerLen; // of the CSV text
+    uint32_t dataStart;
+    uint32_t csvSize;
+
+    // pairs of file offset of a sync row and CSV offset of its line; one every checkpointStride
+    // sync rows
+    uint32_t checkpoints[BINLOG_MAX_CHECKPOINTS * 2];
+    uint16_t numCheckpoints;
+    uint16_t checkpointStride;
+    uint32_t syncRows;
+
+    // rows are read through this
+    uint8_t buf[64];
+    uint32_t bufStart;
+    uint8_t bufLen, bufPtr;
+
+    int numValues;
+    int64_t values[BINLOG_MAX_VALUES];
+
+    // line of text at CSV offset lineStart
+    char *line;
+    uint32_t lineStart;
+    uint16_t lineLen;
+
+    int getByte();
+    bool getVarint(uint64_t *v);
+    uint32_t tell() { return bufStart + bufPtr; }
+    void seek(uint32_t pos);
+    bool nextRow(bool *isSync);
+    uint16_t formatHeader();
+    uint16_t formatRow();
+    void addCheckpoint(uint32_t rowStart, uint32_t csvOffset);
+    bool open();
+
+public:
+    BinLogCSV(FS &fs, const char *filename);
+    ~BinLogCSV();
+
+    // reads all of the log, to find the size of the text; false if it's not a binary log
+    bool scan();
+    uint32_t size() { return csvSize; }
+    // len bytes of the text from offset, padded with zeros past the end
+    void read(uint32_t offset, void *dst, uint32_t len);
+    // free the file and the line buffer until the next read()
+    void close();
+};
+
+} // namespace snorfs
+} // namespace codal
+
+#endif
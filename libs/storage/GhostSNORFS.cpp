@@ -13,8 +13,13 @@ namespace codal {
 
 GhostSNORFS::GhostSNORFS(FS &fs) : fs(fs)
 {
-    currFile = NULL;
-    currEntry = NULL;
+    memset(openFiles, 0, sizeof(openFiles));
+    useCounter = 0;
+    ahead = NULL;
+    aheadEntry = NULL;
+    aheadStart = 0;
+    aheadBlocks = 0;
+    currLog = NULL;
 }
 
 void GhostSNORFS::readFlash(GFATEntry *ent, unsigned blockAddr, char *dst)
@@ -23,22 +28,115 @@ void GhostSNORFS::readFlash(GFATEntry *ent, unsigned blockAddr, char *dst)
     th->fs.readFlashBytes(blockAddr * 512, dst, 512);
 }
 
+GhostSNORFS::OpenFile *GhostSNORFS::openFile(GFATEntry *ent)
+{
+    OpenFile *lru = &openFiles[0];
+    for (int i = 0; i < GHOSTSNORFS_OPEN_FILES; ++i)
+    {
+        auto of = &openFiles[i];
+        if (of->ent == ent)
+        {
+            of->lastUse = ++useCounter;
+            return of;
+        }
+        if (of->lastUse < lru->lastUse)
+            lru = of;
+    }
+
+    if (lru->file)
+        delete lru->file;
+    lru->ent = ent;
+    // the program may have deleted it since the drive was listed
+    lru->file = fs.open(ent->filename, false);
+    lru->nextBlock = 0;
+    lru->lastUse = ++useCounter;
+    return lru;
+}
+
 void GhostSNORFS::readFile(GFATEntry *ent, unsigned blockAddr, char *dst)
 {
     auto th = (GhostSNORFS*)ent->userdata;
 
-    if (th->currEntry != ent)
+    if (th->aheadEntry == ent && blockAddr - th->aheadStart < th->aheadBlocks)
+    {
+        memcpy(dst, th->ahead + (blockAddr - th->aheadStart) * 512, 512);
+        return;
+    }
+
+    auto of = th->openFile(ent);
+    if (!of->file)
+    {
+        memset(dst, 0, 512);
+        return;
+    }
+
+    of->file->seek(blockAddr * 512);
+
+    if (blockAddr != of->nextBlock)
     {
-        th->currEntry = ent;
-        if (th->currFile)
-            delete th->currFile;
-        th->currFile = th->fs.open(ent->filename);
+        auto n = of->file->read(dst, 512);
+        memset(dst + n, 0, 512 - n);
+        of->nextBlock = blockAddr + 1;
+        return;
     }
 
-    th->currFile->seek(blockAddr * 512);
-    th->currFile->read(dst, 512);
+    // one read() looks up the pages of all the blocks, instead of once per block
+    if (!th->ahead)
+        th->ahead = new uint8_t[GHOSTSNORFS_READ_AHEAD * 512];
+    auto n = of->file->read(th->ahead, GHOSTSNORFS_READ_AHEAD * 512);
+    auto blocks = (n + 511) / 512;
+    memset(th->ahead + n, 0, blocks * 512 - n);
+    if (blocks == 0)
+        memset(th->ahead, 0, 512);
+    th->aheadEntry = ent;
+    th->aheadStart = blockAddr;
+    th->aheadBlocks = blocks;
+    of->nextBlock = blockAddr + blocks;
+    memcpy(dst, th->ahead, 512);
 }
 
+void GhostSNORFS::readLog(GFATEntry *ent, unsigned blockAddr, char *dst)
+{
+    auto view = (LogView *)ent->userdata;
+    auto th = view->owner;
+
+    // keep one log file and its line buffer at a time
+    if (th->currLog != view->csv)
+    {
+        if (th->currLog)
+            th->currLog->close();
+        th->currLog = view->csv;
+    }
+
+    view->csv->read(blockAddr * 512, dst, 512);
+}
+
+void GhostSNORFS::addLogView(const char *filename)
+{
+    // filename is in the FS buffer, which reading the log overwrites
+    char name[sizeof(DirEntry::name) + 4];
+    strcpy(name, filename);
+
+    auto csv = new BinLogCSV(fs, name);
+    if (!csv->scan())
+    {
+        delete csv;
+        return;
+    }
+    csv->close();
+
+    // log.dat -> log.csv
+    auto dot = strrchr(name, '.');
+    if (dot && strcmp(dot, ".csv") == 0)
+        strcat(name, ".csv");
+    else
+        strcpy(dot ? dot : name + strlen(name), ".csv");
+
+    auto view = new LogView;
+    view->owner = this;
+    view->csv = csv;
+    addFile(readLog, view, name, csv->size(), 20);
+}
 
 void GhostSNORFS::addFiles()
 {
@@ -55,6 +153,8 @@ void GhostSNORFS::addFiles()
     while (d)
     {
         addFile(readFile, this, d->name, d->size, 20);
+        if (d->size >= sizeof(BinLogHeader))
+            addLogView(d->name);
         d = fs.dirRead();
     }
 
@@ -3,6 +3,18 @@
 
 #include "GhostFAT.h"
 #include "SNORFS.h"
+#include "BinLog.h"
+
+// Number of files kept open for the USB drive, each where the host last read it, so that reading
+// a few files at once doesn't start again from the beginning of each
+#ifndef GHOSTSNORFS_OPEN_FILES
+#define GHOSTSNORFS_OPEN_FILES 4
+#endif
+
+// When the host reads a file in order, this many 512 byte blocks are read from it at once
+#ifndef GHOSTSNORFS_READ_AHEAD
+#define GHOSTSNORFS_READ_AHEAD 8
+#endif
 
 namespace codal
 {
@@ -10,12 +22,39 @@ namespace codal
 class GhostSNORFS : public GhostFAT
 {
 protected:
+    struct OpenFile
+    {
+        GFATEntry *ent;
+        snorfs::File *file; // NULL if it was deleted
+        uint32_t nextBlock; // reads of this one are in order
+        uint32_t lastUse;
+    };
+
     snorfs::FS &fs;
-    snorfs::File *currFile;
-    GFATEntry *currEntry;
+    OpenFile openFiles[GHOSTSNORFS_OPEN_FILES];
+    uint32_t useCounter;
+
+    // blocks of aheadEntry, from aheadStart
+    uint8_t *ahead;
+    GFATEntry *aheadEntry;
+    uint32_t aheadStart;
+    uint32_t aheadBlocks;
+
+    // a binary data log, shown as CSV next to it
+    struct LogView
+    {
+        GhostSNORFS *owner;
+        snorfs::BinLogCSV *csv;
+    };
+    // the one with its file open
+    snorfs::BinLogCSV *currLog;
+
+    OpenFile *openFile(GFATEntry *ent);
+    void addLogView(const char *filename);
 
     static void readFlash(GFATEntry *ent, unsigned blockAddr, char *dst);
     static void readFile(GFATEntry *ent, unsigned blockAddr, char *dst);
+    static void readLog(GFATEntry *ent, unsigned blockAddr, char *dst);
 
 public:
     GhostSNORFS(snorfs::FS &fs);
@@ -25,4 +64,3 @@ public:
 }
 
 #endif
-
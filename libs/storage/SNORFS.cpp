@@ -3,6 +3,7 @@
 #include "NotifyEvents.h"
 #include "MessageBus.h"
 #include "pxtbase.h"
+#include "Timer.h"
 #include <stddef.h>
 
 #define oops() target_panic(DEVICE_FLASH_ERROR)
@@ -55,6 +56,11 @@ FS::FS(SPIFlash &f) : flash(f)
     dirptr = 0;
     files = NULL;
     locked = false;
+    rowRemapCache = NULL;
+    metaIndex = NULL;
+    memset(sizeCache, 0, sizeof(sizeCache));
+    sizeCachePtr = 0;
+    memset(&stats, 0, sizeof(stats));
 
     if (!snorfs_unlocked_event)
         snorfs_unlocked_event = codal::allocateNotifyEvent();
@@ -80,15 +86,80 @@ uint32_t FS::random(uint32_t max)
     }
 }
 
+void FS::writeFlash(uint32_t addr, const void *data, uint32_t len)
+{
+    stats.programs++;
+    stats.programmedBytes += len;
+    flash.writeBytes(addr, data, len);
+}
+
+void FS::eraseRow(uint32_t addr)
+{
+    stats.erases++;
+    flash.eraseBigRow(addr);
+}
+
+void FS::dumpStats()
+{
+    LOG("SNORFS: %d erases, %d programs, %d/%d bytes written/appended, %d GCs (%d ms, max %d), "
+        "row erases %d-%d",
+        stats.erases, stats.programs, stats.programmedBytes, stats.requestedBytes, stats.gcRuns,
+        stats.gcTotalMs, stats.gcMaxMs, stats.minRowErases, stats.maxRowErases);
+}
+
 int FS::firstFree(uint16_t pageIdx)
 {
-    flash.readBytes(indexAddr(pageIdx), buf, SPIFLASH_PAGE_SIZE);
+    uint8_t *index = buf;
+    if (metaIndex && (pageIdx >> 8) < numMetaRows)
+        index = metaIndex + pageIdx;
+    else
+        flash.readBytes(indexAddr(pageIdx), buf, SPIFLASH_PAGE_SIZE);
     for (int k = 1; k < SPIFLASH_PAGE_SIZE - 1; ++k)
-        if (buf[k] == 0xff)
+        if (index[k] == 0xff)
             return pageIdx | k;
     return 0;
 }
 
+void FS::loadMetaIndex()
+{
+    if (!metaIndex)
+        metaIndex = new uint8_t[numMetaRows * SPIFLASH_PAGE_SIZE];
+    for (int i = 0; i < numMetaRows; ++i)
+        flash.readBytes(indexAddr(i << 8), metaIndex + (i << 8), SPIFLASH_PAGE_SIZE);
+}
+
+bool FS::cachedSize(uint16_t metaPage, uint32_t *size)
+{
+    for (int i = 0; i < SNORFS_SIZE_CACHE; ++i)
+        if (sizeCache[i].metaPage == metaPage)
+        {
+            *size = sizeCache[i].size;
+            return true;
+        }
+    return false;
+}
+
+void FS::setCachedSize(uint16_t metaPage, uint32_t size)
+{
+    for (int i = 0; i < SNORFS_SIZE_CACHE; ++i)
+        if (sizeCache[i].metaPage == metaPage)
+        {
+            sizeCache[i].size = size;
+            return;
+        }
+    auto e = &sizeCache[sizeCachePtr];
+    sizeCachePtr = (sizeCachePtr + 1) % SNORFS_SIZE_CACHE;
+    e->metaPage = metaPage;
+    e->size = size;
+}
+
+void FS::dropCachedSize(uint16_t metaPage)
+{
+    for (int i = 0; i < SNORFS_SIZE_CACHE; ++i)
+        if (sizeCache[i].metaPage == metaPage)
+            sizeCache[i].metaPage = 0;
+}
+
 void FS::busy(bool)
 {
     // blink LED or something
@@ -142,6 +213,8 @@ void FS::format()
 
     LOG("formatting SNORFS");
 
+    memset(sizeCache, 0, sizeof(sizeCache));
+
     uint32_t end = flash.numPages() * SPIFLASH_PAGE_SIZE;
     uint16_t rowIdx = 0;
     BlockHeader hd;
@@ -155,7 +228,7 @@ void FS::format()
         if (dirptr != SNORFS_TRY_MOUNT && !rowErased(addr, didErase))
         {
             didErase = true;
-            flash.eraseBigRow(addr);
+            eraseRow(addr);
             busy();
         }
 
@@ -169,13 +242,13 @@ void FS::format()
             hd.logicalBlockId = rowIdx;
         }
         LOGV("format: %d\n", rowIdx);
-        flash.writeBytes(addr, &hd, sizeof(hd));
+        writeFlash(addr, &hd, sizeof(hd));
         rowIdx++;
     }
     busy(false);
 }
 
-void FS::gcCore(bool force, bool isData)
+bool FS::gcCore(bool force, bool isData, bool background)
 {
     if (!force)
     {
@@ -243,14 +316,34 @@ void FS::gcCore(bool force, bool isData)
     //   * force is true (we desperately need space)
     //   * there's a row that's more than 50% deleted
     //   * clearing a row will increase free space by more than 20%
-    if (force || maxDelCnt > SPIFLASH_PAGE_SIZE / 2 || (maxDelCnt * 5 > freePages))
+    // in background, the last one is instead:
+    //   * free space is getting low and a row has a fair number of deleted pages; this runs much
+    //     more often than mount, and would otherwise erase rows to gain little
+    bool gain;
+    if (background)
+        gain = freePages * 100 <
+                   (fullPages + deletedPages + freePages) * SNORFS_GC_FREE_PERCENT &&
+               maxDelCnt >= SNORFS_GC_MIN_DELETED;
+    else
+        gain = maxDelCnt * 5 > freePages;
+    if (force || maxDelCnt > SPIFLASH_PAGE_SIZE / 2 || gain)
     {
+        auto start = system_timer_current_time();
         swapRow(rowRemapCache[maxDelIdx]);
         if (!readHeaders()) // this will trigger levelling on the new free block
             oops();         // but it should never fail
+        uint32_t ms = system_timer_current_time() - start;
+        stats.gcRuns++;
+        stats.gcTotalMs += ms;
+        if (ms > stats.gcMaxMs)
+            stats.gcMaxMs = ms;
+        dumpStats();
+        debugDump();
+        return true;
     }
 
     debugDump();
+    return false;
 }
 
 void FS::swapRow(int row)
@@ -280,25 +373,30 @@ void FS::swapRow(int row)
 #define setFlag(trg, flag, v)                                                                      \
     {                                                                                              \
         uint32_t flag = v;                                                                         \
-        flash.writeBytes(trg + offsetof(BlockHeader, flag), &flag, sizeof(flag));                  \
+        writeFlash(trg + offsetof(BlockHeader, flag), &flag, sizeof(flag));                  \
     }
 
     setFlag(trg, freeFlag, 0); // no longer free
 
-    flash.writeBytes(trg + idxOff, buf, SPIFLASH_PAGE_SIZE);
+    // free pages are not copied either, they are erased on both rows
+    for (int i = 1; i < SPIFLASH_PAGE_SIZE - 1; i++)
+        if (buf[i] == 0xff)
+            skipmask[i / 32] |= 1U << (i % 32);
+
+    writeFlash(trg + idxOff, buf, SPIFLASH_PAGE_SIZE);
     for (int i = 1; i < SPIFLASH_PAGE_SIZE - 1; ++i)
     {
         if (skipmask[i / 32] & (1U << (i % 32)))
             continue;
 
         flash.readBytes(src + SPIFLASH_PAGE_SIZE * i, buf, SPIFLASH_PAGE_SIZE);
-        flash.writeBytes(trg + SPIFLASH_PAGE_SIZE * i, buf, SPIFLASH_PAGE_SIZE);
+        writeFlash(trg + SPIFLASH_PAGE_SIZE * i, buf, SPIFLASH_PAGE_SIZE);
         busy();
     }
 
     flash.readBytes(src, buf, SPIFLASH_PAGE_SIZE);
     auto hd = (BlockHeader *)(void *)buf;
-    flash.writeBytes(trg + offsetof(BlockHeader, logicalBlockId), &hd->logicalBlockId, 2);
+    writeFlash(trg + offsetof(BlockHeader, logicalBlockId), &hd->logicalBlockId, 2);
     setFlag(trg, copiedFlag, SNORFS_COPIED_FLAG);
     setFlag(src, copiedFlag, 0);
 
@@ -306,13 +404,13 @@ void FS::swapRow(int row)
     hd->eraseCount++;
     hd->freeFlag = 0xffffffff;
     hd->copiedFlag = 0xffffffff;
-    flash.eraseBigRow(src);
+    eraseRow(src);
     busy();
     int last = 0;
     for (int i = 0; i < SPIFLASH_PAGE_SIZE; ++i)
         if (buf[i] != 0xff)
             last = i;
-    flash.writeBytes(src, buf, last + 1);
+    writeFlash(src, buf, last + 1);
     // everything done, mark as fully OK free row
     setFlag(src, freeFlag, SNORFS_FREE_FLAG);
 
@@ -322,6 +420,9 @@ void FS::swapRow(int row)
             rowRemapCache[i] = freeRow;
     }
     freeRow = row; // new free row
+    // deleted pages of the row are free now
+    if (metaIndex)
+        loadMetaIndex();
     busy(false);
 }
 
@@ -339,6 +440,9 @@ bool FS::readHeaders()
     uint32_t freeEraseCnt = 0;
     uint32_t totalEraseCount = 0;
 
+    stats.minRowErases = 0xffffffff;
+    stats.maxRowErases = 0;
+
     for (unsigned i = 0; i < (unsigned)numRows + 1; ++i)
     {
         auto addr = i * SPIFLASH_BIG_ROW_SIZE;
@@ -359,6 +463,10 @@ bool FS::readHeaders()
         numMetaRows = hd.numMetaRows;
 
         totalEraseCount += hd.eraseCount;
+        if (hd.eraseCount < stats.minRowErases)
+            stats.minRowErases = hd.eraseCount;
+        if (hd.eraseCount > stats.maxRowErases)
+            stats.maxRowErases = hd.eraseCount;
 
         if (hd.logicalBlockId == 0xffff || hd.copiedFlag != SNORFS_COPIED_FLAG)
             goto isFree;
@@ -404,9 +512,9 @@ bool FS::readHeaders()
         busy();
         initBlockHeader(hd, true);
         hd.eraseCount = freeRandom ? totalEraseCount / numRows : freeEraseCnt;
-        flash.eraseBigRow(freeRow * SPIFLASH_BIG_ROW_SIZE);
+        eraseRow(freeRow * SPIFLASH_BIG_ROW_SIZE);
         busy();
-        flash.writeBytes(freeRow * SPIFLASH_BIG_ROW_SIZE, &hd, sizeof(hd));
+        writeFlash(freeRow * SPIFLASH_BIG_ROW_SIZE, &hd, sizeof(hd));
         busy(false);
     }
     else if (minEraseCnt + SNORFS_LEVELING_THRESHOLD < freeEraseCnt)
@@ -465,6 +573,7 @@ void FS::mount()
         if (!readHeaders())
             oops();
     }
+    loadMetaIndex();
     gcCore(false, false);
 }
 
@@ -508,6 +617,7 @@ uint16_t FS::findFreePage(bool isData, uint16_t hint)
 FS::~FS()
 {
     delete rowRemapCache;
+    delete[] metaIndex;
 }
 
 void FS::markPage(uint16_t page, uint8_t flag)
@@ -527,9 +637,11 @@ void FS::markPage(uint16_t page, uint8_t flag)
 
     if (flag == 0 && (page >> 8) < numMetaRows)
     {
-        flash.writeBytes(pageAddr(page), &flag, 1);
+        writeFlash(pageAddr(page), &flag, 1);
     }
-    flash.writeBytes(indexAddr(page), &flag, 1);
+    writeFlash(indexAddr(page), &flag, 1);
+    if (metaIndex && (page >> 8) < numMetaRows)
+        metaIndex[page] &= flag;
 }
 
 uint8_t FS::dataPageSize()
@@ -613,11 +725,12 @@ void FS::unlock()
 #endif
 }
 
-void FS::maybeGC()
+bool FS::maybeGC()
 {
     lock();
-    gcCore(false, false);
+    auto r = gcCore(false, false, true);
     unlock();
+    return r;
 }
 
 uint16_t FS::findMetaEntry(const char *filename)
@@ -632,10 +745,10 @@ uint16_t FS::findMetaEntry(const char *filename)
 
     for (int i = 0; i < numMetaRows; ++i)
     {
-        flash.readBytes(indexAddr(i << 8), buf, SPIFLASH_PAGE_SIZE);
+        auto index = metaIndex + (i << 8);
         for (int j = 1; j < SPIFLASH_PAGE_SIZE - 1; ++j)
         {
-            if (buf[j] == h)
+            if (index[j] == h)
             {
                 uint16_t pageIdx = (i << 8) | j;
                 auto addr = pageAddr(pageIdx);
@@ -663,7 +776,7 @@ uint16_t FS::createMetaPage(const char *filename)
     buf[0] = 0x01;
     memcpy(buf + 1, filename, buflen - 1);
 
-    flash.writeBytes(pageAddr(page), buf, buflen);
+    writeFlash(pageAddr(page), buf, buflen);
     markPage(page, h);
 
     return page;
@@ -673,6 +786,8 @@ File::File(FS &f, uint16_t existing) : fs(f)
 {
     metaPage = existing;
     writePage = 0;
+    wbuf = NULL;
+    wbufLen = 0;
     rewind();
     next = fs.files;
     fs.files = this;
@@ -680,6 +795,14 @@ File::File(FS &f, uint16_t existing) : fs(f)
 
 File::~File()
 {
+    if (wbufLen)
+    {
+        auto n = wbufLen;
+        wbufLen = 0;
+        appendCore(wbuf, n);
+    }
+    delete[] wbuf;
+
     if (this == fs.files)
     {
         fs.files = next;
@@ -706,7 +829,16 @@ void File::seek(uint32_t pos)
     if (pos == readOffset)
         return;
     if (pos < readOffset)
+    {
+        // going back within the current page doesn't need its address looked up again
+        if (readPage && readOffset - pos <= readOffsetInPage)
+        {
+            readOffsetInPage -= readOffset - pos;
+            readOffset = pos;
+            return;
+        }
         rewind();
+    }
     read(NULL, pos - readOffset);
 }
 
@@ -730,6 +862,13 @@ int FS::metaStart(uint16_t *nextPtr, uint16_t *nextPtrPtr)
 uint32_t FS::fileSize(uint16_t metaPage)
 {
     uint32_t sz = 0;
+    if (cachedSize(metaPage, &sz))
+    {
+        // callers expect the start of the meta page in buf
+        flash.readBytes(pageAddr(metaPage), buf, 64);
+        return sz;
+    }
+
     uint16_t lastPage = 0;
     uint16_t currPage = metaPage;
     for (;;)
@@ -772,6 +911,8 @@ uint32_t FS::fileSize(uint16_t metaPage)
         sz += dataPageSize();
     }
 
+    setCachedSize(metaPage, sz);
+
     if (lastPage || currPage != metaPage)
     {
         flash.readBytes(pageAddr(metaPage), buf, 64);
@@ -785,43 +926,29 @@ uint16_t FS::read16(int off)
     return buf[off] | (buf[off + 1] << 8);
 }
 
-#define DIRCHUNK 32
 DirEntry *FS::dirRead()
 {
     lock();
-    for (;;)
+    while ((dirptr >> 8) < numMetaRows)
     {
-        if ((dirptr >> 8) >= numMetaRows)
-        {
-            unlock();
-            return NULL;
-        }
-        int off = dirptr & 0xff;
-        int len = min(DIRCHUNK, SPIFLASH_PAGE_SIZE - off);
-        flash.readBytes(indexAddr(dirptr), buf, len);
-        for (int i = 0; i < len; ++i)
+        uint16_t page = dirptr++;
+        if (0x02 < metaIndex[page] && metaIndex[page] < 0xff)
         {
-            if (i + off >= 0x100)
-                oops();
-            if (0x02 < buf[i] && buf[i] < 0xff)
+            DirEntry tmp;
+            tmp.flags = 0;
+            tmp.fileID = page;
+            tmp.size = fileSize(page);
+            if (buf[0] == 0x01)
             {
-                dirptr += i;
-                DirEntry tmp;
-                tmp.flags = 0;
-                tmp.fileID = dirptr;
-                tmp.size = fileSize(dirptr);
-                dirptr++;
-                if (buf[0] == 0x01)
-                {
-                    strcpy(tmp.name, (char *)buf + 1);
-                    memcpy(buf, &tmp, sizeof(tmp));
-                    unlock();
-                    return (DirEntry *)(void *)buf;
-                }
+                strcpy(tmp.name, (char *)buf + 1);
+                memcpy(buf, &tmp, sizeof(tmp));
+                unlock();
+                return (DirEntry *)(void *)buf;
             }
         }
-        dirptr += len;
     }
+    unlock();
+    return NULL;
 }
 
 bool File::seekNextPage(uint16_t *cache)
@@ -881,8 +1008,12 @@ bool File::seekNextPage(uint16_t *cache)
 
 uint32_t File::size()
 {
-    primary()->computeWritePage();
-    return metaSize;
+    auto prim = primary();
+    uint32_t sz;
+    if (!prim->writePage && fs.cachedSize(metaPage, &sz))
+        return sz + prim->wbufLen;
+    prim->computeWritePage();
+    return metaSize + prim->wbufLen;
 }
 
 File *File::primary()
@@ -900,7 +1031,10 @@ int File::read(void *data, uint32_t len)
         return 0;
 
     if (writePage != SNORFS_COMPUTING_WRITE_PAGE)
+    {
+        flush();
         fs.lock();
+    }
 
     if (len > 0x7fffffffU)
         len = 0x7fffffffU;
@@ -959,6 +1093,7 @@ void File::computeWritePage()
     for (auto p = fs.files; p; p = p->next)
         if (p->metaPage == metaPage)
             p->metaSize = readOffset;
+    fs.setCachedSize(metaPage, readOffset);
     seek(prevOff);
     writePage = newWritePage;
 }
@@ -975,6 +1110,49 @@ void File::append(const void *data, uint32_t len)
         return;
     }
 
+    fs.stats.requestedBytes += len;
+
+#if SNORFS_WRITE_BUFFER > 0
+    if (wbufLen + len > SNORFS_WRITE_BUFFER)
+        flush();
+    if (len < SNORFS_WRITE_BUFFER)
+    {
+        if (!wbuf)
+            wbuf = new uint8_t[SNORFS_WRITE_BUFFER];
+        memcpy(wbuf + wbufLen, data, len);
+        wbufLen += len;
+        return;
+    }
+#endif
+
+    appendCore(data, len);
+}
+
+void File::flush()
+{
+    auto prim = primary();
+    if (prim != this)
+    {
+        prim->flush();
+        return;
+    }
+
+    if (!wbufLen)
+        return;
+    // cleared first, as appendCore() reads the file to find where to write
+    auto n = wbufLen;
+    wbufLen = 0;
+    appendCore(wbuf, n);
+}
+
+void FS::flush()
+{
+    for (auto p = files; p; p = p->next)
+        p->flush();
+}
+
+void File::appendCore(const void *data, uint32_t len)
+{
     fs.lock();
 
     computeWritePage();
@@ -991,14 +1169,14 @@ void File::append(const void *data, uint32_t len)
 
         LOGV("write: left=%d page=0x%x nwr=%d off=%d\n", len, writePage, nwrite, writeOffsetInPage);
 
-        fs.flash.writeBytes(fs.pageAddr(writePage) + writeOffsetInPage, data, nwrite);
+        fs.writeFlash(fs.pageAddr(writePage) + writeOffsetInPage, data, nwrite);
 
         writeOffsetInPage += nwrite;
 
         // if the last byte was 0xff, we need an end marker
         if (((uint8_t *)data)[nwrite - 1] == 0xff)
         {
-            fs.flash.writeBytes(fs.pageAddr(writePage) + SPIFLASH_PAGE_SIZE -
+            fs.writeFlash(fs.pageAddr(writePage) + SPIFLASH_PAGE_SIZE -
                                     (writeNumExplicitSizes++ + 1),
                                 &writeOffsetInPage, 1);
         }
@@ -1015,6 +1193,7 @@ void File::append(const void *data, uint32_t len)
             }
     }
 
+    fs.setCachedSize(metaPage, metaSize);
     fs.unlock();
 }
 
@@ -1048,7 +1227,7 @@ void File::allocatePage()
             oops();
 #endif
         uint8_t v = writeOffsetInPage - 1;
-        fs.flash.writeBytes(fs.pageAddr(writeMetaPage) + last + 2, &v, 1);
+        fs.writeFlash(fs.pageAddr(writeMetaPage) + last + 2, &v, 1);
     }
 
     if (!next)
@@ -1056,8 +1235,8 @@ void File::allocatePage()
         uint16_t newMeta = fs.findFreePage(false);
         fs.markPage(newMeta, 0x02);
         uint8_t hd[] = {0x02, 0x00};
-        fs.flash.writeBytes(fs.pageAddr(newMeta), hd, 2);
-        fs.flash.writeBytes(fs.pageAddr(writeMetaPage) + nextPP, &newMeta, 2);
+        fs.writeFlash(fs.pageAddr(newMeta), hd, 2);
+        fs.writeFlash(fs.pageAddr(writeMetaPage) + nextPP, &newMeta, 2);
         writeMetaPage = newMeta;
         next = 4;
     }
@@ -1066,7 +1245,7 @@ void File::allocatePage()
     // delete locality
     writePage = fs.findFreePage(true, writePage);
     fs.markPage(writePage, 1);
-    fs.flash.writeBytes(fs.pageAddr(writeMetaPage) + next, &writePage, 2);
+    fs.writeFlash(fs.pageAddr(writeMetaPage) + next, &writePage, 2);
     writeOffsetInPage = 0;
     writeNumExplicitSizes = 0;
 }
@@ -1107,10 +1286,16 @@ void File::delCore(bool delMeta)
             p->metaSize = 0;
             p->writePage = 0xffff;
         }
+    // a deleted meta page can be reused by another file
+    if (delMeta)
+        fs.dropCachedSize(metaPage);
+    else
+        fs.setCachedSize(metaPage, 0);
 }
 
 void File::del()
 {
+    primary()->wbufLen = 0;
     fs.lock();
     primary()->delCore(true);
     fs.unlock();
@@ -1126,6 +1311,7 @@ void File::overwrite(const void *data, uint32_t len)
         return;
     }
 
+    wbufLen = 0;
     fs.lock();
 
     fs.flash.readBytes(metaPageAddr(), fs.buf, SPIFLASH_PAGE_SIZE);
@@ -1143,7 +1329,7 @@ void File::overwrite(const void *data, uint32_t len)
     {
         uint8_t clearMark[] = {0, 0, 0};
         delCore(false);
-        fs.flash.writeBytes(metaPageAddr() + freePtr, clearMark, 3);
+        fs.writeFlash(metaPageAddr() + freePtr, clearMark, 3);
     }
     else
     {
@@ -5,6 +5,27 @@
 
 #define DEVICE_FLASH_ERROR 950
 
+// Appends of fewer bytes than this are kept in RAM, and written together once that many have
+// accumulated, or when the file is read, closed or flushed. They are lost if power is lost, or the
+// device resets, before that; use 0 to write every append straight away.
+#ifndef SNORFS_WRITE_BUFFER
+#define SNORFS_WRITE_BUFFER 128
+#endif
+
+// maybeGC() also reclaims a row with at least SNORFS_GC_MIN_DELETED deleted pages once less than
+// SNORFS_GC_FREE_PERCENT of the space is free, so that appends rarely have to wait for one
+#ifndef SNORFS_GC_FREE_PERCENT
+#define SNORFS_GC_FREE_PERCENT 25
+#endif
+#ifndef SNORFS_GC_MIN_DELETED
+#define SNORFS_GC_MIN_DELETED 32
+#endif
+
+// Number of file sizes remembered, so that size() doesn't read all pages of recently used files
+#ifndef SNORFS_SIZE_CACHE
+#define SNORFS_SIZE_CACHE 16
+#endif
+
 namespace codal
 {
 namespace snorfs
@@ -12,6 +33,21 @@ namespace snorfs
 
 class File;
 
+// Flash use since mount, to see how fast it wears out
+struct FSStats
+{
+    uint32_t erases;          // rows erased
+    uint32_t programs;        // flash writes
+    uint32_t programmedBytes; // bytes they wrote, including metadata
+    uint32_t requestedBytes;  // bytes appended to files
+    uint32_t gcRuns;          // rows reclaimed
+    uint32_t gcTotalMs;
+    uint32_t gcMaxMs;
+    // erases of the least and most worn row over the life of the flash, from the row headers
+    uint32_t minRowErases;
+    uint32_t maxRowErases;
+};
+
 struct DirEntry
 {
     uint32_t size;
@@ -31,6 +67,17 @@ class FS
     File *files;
 
     uint8_t *rowRemapCache;
+    // copy of the index pages of meta rows, so finding a file doesn't read them from flash
+    uint8_t *metaIndex;
+
+    struct SizeEntry
+    {
+        uint16_t metaPage; // 0 when unused
+        uint32_t size;
+    };
+    SizeEntry sizeCache[SNORFS_SIZE_CACHE];
+    uint8_t sizeCachePtr;
+
     uint8_t numRows;
     uint8_t numMetaRows;
     uint8_t freeRow;
@@ -72,7 +119,7 @@ class FS
     uint16_t findMetaEntry(const char *filename);
     uint16_t createMetaPage(const char *filename);
     bool readHeaders();
-    void gcCore(bool force, bool isData);
+    bool gcCore(bool force, bool isData, bool background = false);
     void swapRow(int row);
     void markPage(uint16_t page, uint8_t flag);
     uint8_t dataPageSize();
@@ -83,8 +130,16 @@ class FS
     void unlock();
     bool pageErased(uint32_t addr);
     bool rowErased(uint32_t addr, bool checkFull);
+    void loadMetaIndex();
+    void writeFlash(uint32_t addr, const void *data, uint32_t len);
+    void eraseRow(uint32_t addr);
+    bool cachedSize(uint16_t metaPage, uint32_t *size);
+    void setCachedSize(uint16_t metaPage, uint32_t size);
+    void dropCachedSize(uint16_t metaPage);
 
 public:
+    FSStats stats;
+
     FS(SPIFlash &f);
     ~FS();
     // returns NULL if file doesn't exists and create==false
@@ -95,14 +150,24 @@ public:
     uint32_t totalSize() { return (fullPages + deletedPages + freePages) * SPIFLASH_PAGE_SIZE; }
     uint32_t freeSize() { return (deletedPages + freePages) * SPIFLASH_PAGE_SIZE; }
     void busy(bool isBusy = true);
-    void maybeGC();
+    // reclaim at most one row of deleted pages; returns true if it did, and may do more
+    bool maybeGC();
     // this allow raw r/o access; will lock the instance as needed
     int readFlashBytes(uint32_t addr, void *buffer, uint32_t len);
     bool tryMount();
 
-    void dirRewind() { dirptr = 0; }
+    // write out the buffered appends of all files
+    void flush();
+
+    void dirRewind()
+    {
+        flush();
+        dirptr = 0;
+    }
     DirEntry *dirRead(); // data is only valid until next call to to any of File or FS function
 
+    void dumpStats();
+
 #ifdef SNORFS_TEST
     void debugDump();
     void dump();
@@ -143,6 +208,10 @@ class File
     uint8_t writeOffsetInPage;
     uint8_t writeNumExplicitSizes;
 
+    // appends not written yet; only the primary File has them
+    uint8_t *wbuf;
+    uint16_t wbufLen;
+
     uint32_t metaPageAddr() { return fs.pageAddr(metaPage); }
 
     void rewind();
@@ -167,6 +236,8 @@ public:
     uint32_t fileID() { return metaPage; }
     bool isDeleted() { return writePage == 0xffff; }
     void overwrite(const void *data, uint32_t len);
+    // write out buffered appends
+    void flush();
     void del();
     void truncate() { overwrite(NULL, 0); }
     ~File();
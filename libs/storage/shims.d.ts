@@ -1,6 +1,21 @@
 // Auto-generated. Do not edit.
 declare namespace storage {
 
+    /**
+     * Write out data appended to files that is still buffered in RAM. Buffered data is written
+     * within a second anyway, but is lost if the device resets or loses power before that.
+     */
+    //% parts="storage" shim=storage::flush
+    function flush(): void;
+
+    /**
+     * Flash statistics since start, as UInt32LE numbers: rows erased, flash writes, bytes written,
+     * bytes appended to files, rows reclaimed, total and longest time reclaiming them in ms, and the
+     * erases of the least and most worn row over the life of the flash.
+     */
+    //% parts="storage" shim=storage::flashStats
+    function flashStats(): Buffer;
+
     /** 
      * Append a buffer to a new or existing file. 
      * @param filename name of the file, eg: "log.txt"
@@ -40,11 +55,36 @@ declare namespace storage {
     function size(filename: string): int32;
 
     /** 
-     * Read contents of file as a buffer. 
+     * Read contents of file as a buffer, or null if it is over 64k; use storage.openReader() then. 
      * @param filename name of the file, eg: "log.txt"
      */
     //% parts="storage" shim=storage::readAsBuffer
     function readAsBuffer(filename: string): Buffer;
+
+    /**
+     * Read up to length bytes of a file, starting at offset, as a buffer.
+     * @param filename name of the file, eg: "log.txt"
+     */
+    //% parts="storage" shim=storage::readRange
+    function readRange(filename: string, offset: int32, length: int32): Buffer;
+
+    /**
+     * Start a binary data log in a new file, unless the file exists. The USB drive shows it as CSV
+     * text next to it, with the extension changed to .csv.
+     * @param filename name of the file, eg: "log.dat"
+     * @param columns names of the columns, separated by newlines
+     * @param separator character between the values in the CSV text
+     * @param decimals number of decimals kept of each value, up to 6
+     */
+    //% parts="storage" shim=storage::binLogStart
+    function binLogStart(filename: string, columns: string, separator: int32, decimals: int32): void;
+
+    /**
+     * Append a row of numbers to a binary data log started with binLogStart().
+     * @param filename name of the file, eg: "log.dat"
+     */
+    //% parts="storage" shim=storage::binLogRow
+    function binLogRow(filename: string, values: number[]): void;
 }
 
 // Auto-generated. Do not edit. Really.
@@ -1,6 +1,10 @@
 namespace pxsim {
     export class StorageState {
         files: pxsim.Map<number[]> = {};
+        // binLogRow() writes differences to the values of the last row
+        binLogName: string = undefined;
+        binLogValues: number[] = [];
+        binLogRows = 0;
     }
 
     export interface StorageBoard extends CommonBoard {
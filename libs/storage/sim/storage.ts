@@ -4,6 +4,14 @@ namespace pxsim.storage {
         // do nothing
     }
 
+    export function flush() {
+        // nothing is buffered
+    }
+
+    export function flashStats(): RefBuffer {
+        return new RefBuffer(new Uint8Array(36));
+    }
+
     export function appendBuffer(filename: string, data: RefBuffer): void {
         const state = storageState();
         let buf = state.files[filename];
@@ -18,6 +26,7 @@ namespace pxsim.storage {
         for (let i = 0; i < data.data.length; ++i)
             buf.push(data.data[i]);
         state.files[filename] = buf;
+        if (state.binLogName == filename) state.binLogName = undefined;
     }
 
     export function exists(filename: string): boolean {
@@ -28,6 +37,7 @@ namespace pxsim.storage {
     export function remove(filename: string): void {
         const state = storageState();
         delete state.files[filename];
+        if (state.binLogName == filename) state.binLogName = undefined;
     }
 
     export function size(filename: string): number {
@@ -41,4 +51,62 @@ namespace pxsim.storage {
         const buf = state.files[filename];
         return buf ? new RefBuffer(Uint8Array.from(buf)) : undefined;
     }
+
+    export function readRange(filename: string, offset: number, length: number): RefBuffer {
+        const state = storageState();
+        const buf = state.files[filename];
+        if (!buf || offset < 0 || length < 0 || offset > buf.length) return undefined;
+        return new RefBuffer(Uint8Array.from(buf.slice(offset, offset + length)));
+    }
+
+    // same format as BinLog.cpp
+    const BINLOG_SYNC_ROWS = 64;
+    const BINLOG_MAX_VALUES = 32;
+
+    export function binLogStart(filename: string, columns: string, separator: number, decimals: number): void {
+        const state = storageState();
+        if (state.files[filename]) return;
+        decimals = Math.max(0, Math.min(6, decimals | 0));
+        const names = columns ? Array.from(U.stringToUint8Array(U.toUTF8(columns + "\n"))) : [];
+        const numColumns = Math.min(255, names.filter(c => c == 10).length);
+        const buf = [0x44, 0x4c, 0x47, 0x31, decimals, separator & 0xff, numColumns, 0];
+        for (const c of names)
+            buf.push(c == 10 ? 0 : c);
+        state.files[filename] = buf;
+        state.binLogName = undefined;
+    }
+
+    export function binLogRow(filename: string, values: RefCollection): void {
+        const state = storageState();
+        const buf = state.files[filename];
+        // not started with binLogStart()
+        if (!buf || buf.length < 8 || buf[0] != 0x44 || buf[1] != 0x4c || buf[2] != 0x47 || buf[3] != 0x31) return;
+        if (state.binLogName != filename) {
+            state.binLogName = filename;
+            state.binLogRows = BINLOG_SYNC_ROWS;
+            state.binLogValues = [];
+        }
+
+        const scale = Math.pow(10, buf[4]);
+        const row = (values.toArray() as number[]).slice(0, BINLOG_MAX_VALUES);
+        const prev = state.binLogValues;
+        const sync = state.binLogRows >= BINLOG_SYNC_ROWS || row.length != prev.length;
+        buf.push((sync ? 0x80 : 0) | row.length);
+        const next: number[] = [];
+        for (let i = 0; i < row.length; ++i) {
+            const x = row[i] * scale;
+            const v = x > -9007199254740992 && x < 9007199254740992 ? Math.round(Math.abs(x)) * (x < 0 ? -1 : 1) : 0;
+            const d = sync ? v : v - prev[i];
+            next.push(v);
+            // zigzag varint, without 32 bit operators
+            let u = d >= 0 ? 2 * d : -2 * d - 1;
+            while (u >= 0x80) {
+                buf.push(u % 0x80 | 0x80);
+                u = Math.floor(u / 0x80);
+            }
+            buf.push(u);
+        }
+        state.binLogValues = next;
+        state.binLogRows = sync ? 1 : state.binLogRows + 1;
+    }
 }
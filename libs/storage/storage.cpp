@@ -2,6 +2,7 @@
 #include "SPI.h"
 
 #include "GhostSNORFS.h"
+#include "BinLog.h"
 #include "StandardSPIFlash.h"
 
 namespace storage {
@@ -69,26 +70,146 @@ void init() {
     usb.start();
 }
 
+// Files kept open, so that appending to a few files in turn doesn't reopen them every time
+#ifndef STORAGE_OPEN_FILES
+#define STORAGE_OPEN_FILES 4
+#endif
+
+// most recently used first
+static String openNames[STORAGE_OPEN_FILES];
+static snorfs::File *openFiles[STORAGE_OPEN_FILES];
+
 snorfs::File *getFile(String filename) {
     auto st = mountedStorage();
     if (!st) 
         return NULL;
 
-    // maybe we want to keep say up to 5 files open?
-    static String currFilename;
-    static snorfs::File *currFile;
+    static bool inited;
+    if (!inited) {
+        registerGC((TValue *)openNames, STORAGE_OPEN_FILES);
+        inited = true;
+    }
 
-    if (!currFilename) {
-        registerGC((TValue*)&currFilename);
+    int i = 0;
+    while (i < STORAGE_OPEN_FILES - 1 && openNames[i] &&
+           String_::compare(openNames[i], filename) != 0)
+        i++;
+
+    snorfs::File *f;
+    if (openNames[i] && String_::compare(openNames[i], filename) == 0) {
+        f = openFiles[i];
     } else {
-        if (filename && String_::compare(currFilename, filename) == 0)
-            return currFile;
-        delete currFile;
+        // i is the first free or the least recently used entry
+        delete openFiles[i];
+        // TODO: fix UTF8 encoding
+        f = st->fs.open(filename->getUTF8Data());
+    }
+
+    memmove(openNames + 1, openNames, i * sizeof(String));
+    memmove(openFiles + 1, openFiles, i * sizeof(snorfs::File *));
+    openNames[0] = filename;
+    openFiles[0] = f;
+    return f;
+}
+
+static void closeFile(String filename) {
+    for (int i = 0; i < STORAGE_OPEN_FILES; ++i) {
+        if (openNames[i] && String_::compare(openNames[i], filename) == 0) {
+            delete openFiles[i];
+            memmove(openNames + i, openNames + i + 1, (STORAGE_OPEN_FILES - 1 - i) * sizeof(String));
+            memmove(openFiles + i, openFiles + i + 1,
+                    (STORAGE_OPEN_FILES - 1 - i) * sizeof(snorfs::File *));
+            openNames[STORAGE_OPEN_FILES - 1] = NULL;
+            openFiles[STORAGE_OPEN_FILES - 1] = NULL;
+            return;
+        }
+    }
+}
+
+// Small appends are buffered by SNORFS (see SNORFS_WRITE_BUFFER); they are written out at latest
+// this long after they are made
+#ifndef STORAGE_FLUSH_MS
+#define STORAGE_FLUSH_MS 1000
+#endif
+
+static bool flushScheduled;
+
+static void flushLater(void *) {
+    fiber_sleep(STORAGE_FLUSH_MS);
+    flushScheduled = false;
+    auto st = mountedStorage();
+    if (st)
+        st->fs.flush();
+}
+
+static void scheduleFlush() {
+    if (!flushScheduled) {
+        flushScheduled = true;
+        create_fiber(flushLater, NULL);
+    }
+}
+
+// Rows of deleted pages are reclaimed in the background, one every STORAGE_GC_INTERVAL_MS while
+// there is enough to gain, starting that long after a file changes. A row takes up to a few hundred
+// ms to copy and erase, which appends otherwise might have to wait for when space runs out.
+#ifndef STORAGE_GC_INTERVAL_MS
+#define STORAGE_GC_INTERVAL_MS 2000
+#endif
+
+static bool gcScheduled;
+
+static void gcLater(void *) {
+    for (;;) {
+        fiber_sleep(STORAGE_GC_INTERVAL_MS);
+        auto st = mountedStorage();
+        if (!st || !st->fs.maybeGC())
+            break;
+    }
+    gcScheduled = false;
+}
+
+static void scheduleGC() {
+    if (!gcScheduled) {
+        gcScheduled = true;
+        create_fiber(gcLater, NULL);
+    }
+}
+
+/**
+* Write out data appended to files that is still buffered in RAM. Buffered data is written
+* within a second anyway, but is lost if the device resets or loses power before that.
+*/
+//% parts="storage"
+void flush() {
+    auto st = mountedStorage();
+    if (st)
+        st->fs.flush();
+}
+
+/**
+* Flash statistics since start, as UInt32LE numbers: rows erased, flash writes, bytes written,
+* bytes appended to files, rows reclaimed, total and longest time reclaiming them in ms, and the
+* erases of the least and most worn row over the life of the flash.
+*/
+//% parts="storage"
+Buffer flashStats() {
+    auto st = mountedStorage();
+    if (!st)
+        return NULL;
+    return mkBuffer(&st->fs.stats, sizeof(st->fs.stats));
+}
+
+// binLogRow() keeps the values of the last row here, to write the next one as differences
+static char *binLogName;
+static snorfs::BinLogWriter *binLogWriter;
+
+static void dropBinLog(String filename) {
+    if (binLogName && strcmp(binLogName, filename->getUTF8Data()) == 0) {
+        free(binLogName);
+        binLogName = NULL;
+        delete binLogWriter;
+        binLogWriter = NULL;
     }
-    currFilename = filename;
-    // TODO: fix UTF8 encoding
-    currFile = filename == NULL ? NULL : st->fs.open(filename->getUTF8Data());
-    return currFile;
 }
 
 /** 
@@ -100,6 +221,8 @@ void appendBuffer(String filename, Buffer data) {
     auto f = getFile(filename);
     if (NULL == f) return;
     f->append(data->data, data->length);
+    scheduleFlush();
+    scheduleGC();
 }
 
 /** 
@@ -111,6 +234,8 @@ void overwriteWithBuffer(String filename, Buffer data) {
     auto f = getFile(filename);
     if (NULL == f) return;
     f->overwrite(data->data, data->length);
+    dropBinLog(filename);
+    scheduleGC();
 }
 
 /** 
@@ -135,7 +260,9 @@ void remove(String filename) {
         return;
     auto f = getFile(filename);
     f->del();
-    getFile(NULL);
+    closeFile(filename);
+    dropBinLog(filename);
+    scheduleGC();
 }
 
 /** 
@@ -152,7 +279,7 @@ int size(String filename) {
 }
 
 /** 
-* Read contents of file as a buffer. 
+* Read contents of file as a buffer, or null if it is over 64k; use storage.openReader() then. 
 * @param filename name of the file, eg: "log.txt"
 */
 //% parts="storage"
@@ -171,4 +298,71 @@ Buffer readAsBuffer(String filename) {
     return res;
 }
 
+/**
+* Read up to length bytes of a file, starting at offset, as a buffer.
+* @param filename name of the file, eg: "log.txt"
+*/
+//% parts="storage"
+Buffer readRange(String filename, int offset, int length) {
+    auto f = getFile(filename);
+    if (NULL == f)
+        return NULL;
+    int sz = f->size();
+    if (offset < 0 || length < 0 || offset > sz)
+        return NULL;
+    if (length > sz - offset)
+        length = sz - offset;
+    if (length > 0xffff)
+        length = 0xffff;
+    auto res = mkBuffer(NULL, length);
+    registerGCObj(res);
+    f->seek(offset);
+    f->read(res->data, res->length);
+    unregisterGCObj(res);
+    return res;
+}
+
+/**
+* Start a binary data log in a new file, unless the file exists. The USB drive shows it as CSV
+* text next to it, with the extension changed to .csv.
+* @param filename name of the file, eg: "log.dat"
+* @param columns names of the columns, separated by newlines
+* @param separator character between the values in the CSV text
+* @param decimals number of decimals kept of each value, up to 6
+*/
+//% parts="storage"
+void binLogStart(String filename, String columns, int separator, int decimals) {
+    if (exists(filename))
+        return;
+    auto f = getFile(filename);
+    if (NULL == f) return;
+    dropBinLog(filename);
+    snorfs::BinLogWriter::writeHeader(f, columns->getUTF8Data(), separator, decimals);
+    scheduleFlush();
+}
+
+/**
+* Append a row of numbers to a binary data log started with binLogStart().
+* @param filename name of the file, eg: "log.dat"
+*/
+//% parts="storage"
+void binLogRow(String filename, RefCollection *values) {
+    auto f = getFile(filename);
+    if (NULL == f) return;
+    if (!binLogName || strcmp(binLogName, filename->getUTF8Data()) != 0) {
+        free(binLogName);
+        delete binLogWriter;
+        binLogName = strdup(filename->getUTF8Data());
+        binLogWriter = new snorfs::BinLogWriter(f);
+    }
+
+    double row[BINLOG_MAX_VALUES];
+    int n = min((int)values->length(), BINLOG_MAX_VALUES);
+    for (int i = 0; i < n; ++i)
+        row[i] = toDouble(values->getAt(i));
+    binLogWriter->append(f, row, n);
+    scheduleFlush();
+    scheduleGC();
+}
+
 } // namespace storage
@@ -54,4 +54,46 @@ namespace storage {
             return null;
         return buf.toString();
     }
+
+    /**
+     * Reads a file a chunk at a time, so that big files don't have to fit in memory.
+     */
+    export class FileReader {
+        filename: string;
+        position: number;
+
+        constructor(filename: string) {
+            this.filename = filename;
+            this.position = 0;
+        }
+
+        /**
+         * Read up to length bytes from the current position, or return null at the end of the file.
+         * @param length maximum number of bytes, eg: 512
+         */
+        readChunk(length: number): Buffer {
+            const buf = readRange(this.filename, this.position, length);
+            if (!buf || !buf.length)
+                return null;
+            this.position += buf.length;
+            return buf;
+        }
+
+        /**
+         * Set the position the next chunk is read from.
+         * @param position offset in bytes from the start of the file
+         */
+        seek(position: number) {
+            this.position = Math.max(0, position);
+        }
+    }
+
+    /**
+     * Open a file to read it in chunks, eg. to send it over the network.
+     * @param filename name of the file, eg: "log.txt"
+     */
+    //% parts="storage"
+    export function openReader(filename: string): FileReader {
+        return new FileReader(filename);
+    }
 }
@@ -1,15 +1,81 @@
 #include "pxt.h"
 #include "touch.h"
 
+// all the pads are read every TOUCH_SCAN_MS
+#define TOUCH_SCAN_MS 10
+// the filter of the readings, and the much slower one of the baseline, as shifts
+#define TOUCH_FILTER_SHIFT 2
+#define TOUCH_BASELINE_SHIFT 7
+// a touch ends when the reading drops this part of the margin below the threshold
+#define TOUCH_HYSTERESIS_SHIFT 2
+
+static ScannedTouchButton *scannedButtons;
+
+static void scanTouchButtons(void *) {
+    while (true) {
+        for (auto b = scannedButtons; b; b = b->nextScanned)
+            b->scan();
+        fiber_sleep(TOUCH_SCAN_MS);
+    }
+}
+
+ScannedTouchButton::ScannedTouchButton(Pin &pin) : CapTouchButton(pin) {
+    filtered = baseline = 0;
+    margin = -1;
+    touched = false;
+    primed = false;
+    if (!scannedButtons)
+        create_fiber(scanTouchButtons);
+    nextScanned = scannedButtons;
+    scannedButtons = this;
+}
+
+void ScannedTouchButton::scan() {
+    int raw = getValue() << 4;
+    if (!primed) {
+        primed = true;
+        filtered = baseline = raw;
+    }
+    filtered += (raw - filtered) >> TOUCH_FILTER_SHIFT;
+
+    // the margin is taken from the threshold of the driver, the first time round
+    if (margin < 0)
+        margin = max(16, (threshold << 4) - baseline);
+
+    int thr = baseline + margin;
+    if (touched) {
+        touched = filtered >= thr - (margin >> TOUCH_HYSTERESIS_SHIFT);
+    } else {
+        touched = filtered >= thr;
+        // the pad drifts with temperature and humidity; follow it while it's not touched
+        if (!touched)
+            baseline += (filtered - baseline) >> TOUCH_BASELINE_SHIFT;
+    }
+}
+
+void ScannedTouchButton::calibrateScanned() {
+    calibrate();
+    int raw = getValue() << 4;
+    filtered = baseline = raw;
+    primed = true;
+    margin = max(16, (threshold << 4) - baseline);
+    touched = false;
+}
+
+void ScannedTouchButton::setScannedThreshold(int thr) {
+    setThreshold(thr);
+    margin = max(16, (thr << 4) - baseline);
+}
+
 namespace pxt {
 //%
 TouchButton getTouchButton(int id) {
     auto cpid = DEVICE_ID_FIRST_TOUCHBUTTON + id;
-    auto btn = (CapTouchButton*)lookupComponent(cpid);
+    auto btn = (ScannedTouchButton *)lookupComponent(cpid);
     if (btn == NULL) {
         // GCTODO
         // 'new' will add it to component list
-        btn = new CapTouchButton(*pxt::getPin(id));
+        btn = new ScannedTouchButton(*pxt::getPin(id));
         btn->id = cpid;
     }
     return btn;
@@ -34,7 +100,7 @@ namespace TouchButtonMethods {
 //% group="More" weight=16 blockGap=8
 //% help=input/touch/set-threshold
 void setThreshold(TouchButton button, int threshold) {
-    button->setThreshold(max(0, min(1 << 12, threshold << 2)));
+    button->setScannedThreshold(max(0, min(1 << 12, threshold << 2)));
 }
 
 /**
@@ -49,7 +115,7 @@ void setThreshold(TouchButton button, int threshold) {
 //% group="More" weight=16 blockGap=8
 //% help=input/touch/threshold
 int threshold(TouchButton button) {
-    return button->threshold >> 2;
+    return button->scannedThreshold() >> 2;
 }
 
 /**
@@ -64,7 +130,7 @@ int threshold(TouchButton button) {
 //% group="More" weight=49 blockGap=8
 //% help=input/touch/value
 int value(TouchButton button) {
-    return button->getValue() >> 2;
+    return button->filteredValue() >> 2;
 }
 
 /**
@@ -78,7 +144,7 @@ int value(TouchButton button) {
 //% group="More" weight=49 blockGap=8
 //% help=input/touch/calibrate
 void calibrate(TouchButton button) {
-    button->calibrate();
+    button->calibrateScanned();
 }
 
 }
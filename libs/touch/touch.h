@@ -1 +1,29 @@
-#define TouchButton CapTouchButton *
+#ifndef __PXT_TOUCH_H
+#define __PXT_TOUCH_H
+
+// A touch button read by the background scanner in touch.cpp, which filters the readings of
+// all the pads and follows their drift, and reports touches only when the filtered reading
+// crosses the threshold.
+class ScannedTouchButton : public CapTouchButton {
+  public:
+    ScannedTouchButton *nextScanned;
+    // readings, times 16 to keep the fraction of the filters
+    int filtered;
+    int baseline;
+    // how far the threshold is above the baseline; the threshold moves along with the baseline
+    int margin;
+    bool touched;
+    bool primed;
+
+    ScannedTouchButton(Pin &pin);
+    void scan();
+    void calibrateScanned();
+    void setScannedThreshold(int threshold);
+    int filteredValue() { return filtered >> 4; }
+    int scannedThreshold() { return margin < 0 ? threshold : (baseline + margin) >> 4; }
+    virtual int buttonActive() override { return touched; }
+};
+
+#define TouchButton ScannedTouchButton *
+
+#endif
@@ -302,11 +302,17 @@ function shouldSkip(ch) {
     return false
 }
 
-let lines = process.argv.slice(2).map(s => fs.readFileSync(s, "utf8")).join("\n").split(/\n\r?/)
+let args = process.argv.slice(2)
+// with --native, the human readable format is also compiled to the layout drawn by image.cpp
+let native = args.indexOf("--native") >= 0
+let proportional = args.indexOf("--proportional") >= 0
+let lines = args.filter(a => !/^--/.test(a)).map(s => fs.readFileSync(s, "utf8")).join("\n").split(/\n\r?/)
 let bmp = ""
 let charIdx = 0
 let compress = false
 let jres = false
+let kerning = []
+let inGlyphs = false
 
 for (let line of lines) {
     line = line.trim()
@@ -358,6 +364,12 @@ for (let line of lines) {
                 }
 
                 currCharLine++
+            } else if (m = /^kern\s+((\d+)|'(.)')\s+((\d+)|'(.)')\s+(-?\d+)$/.exec(line)) {
+                kerning.push({
+                    left: m[2] ? parseInt(m[2]) : m[3].charCodeAt(0),
+                    right: m[5] ? parseInt(m[5]) : m[6].charCodeAt(0),
+                    adjust: parseInt(m[7])
+                })
             } else {
                 m = /^\* ((\d+)|'(.)')/.exec(line)
                 if (m) {
@@ -372,7 +384,12 @@ for (let line of lines) {
                 }
             }
         } else if (mode == 2) {
-            if (/^[a-f0-9 ]{2,}$/.test(line)) {
+            // the --native glyphs are made again from the others
+            if (/^glyphs:/.test(line)) {
+                inGlyphs = true
+            } else if (inGlyphs) {
+                if (/^`/.test(line)) inGlyphs = false
+            } else if (/^[a-f0-9 ]{2,}$/.test(line)) {
                 dataBuf += line.replace(/ /g, "")
             } else {
                 console.error("Bad: " + line)
@@ -487,6 +504,56 @@ function fmt(bufs) {
     out += "\n`,\n"
 }
 
+// The glyphs of the packed format (code and 1bpp columns) in the layout of NativeFont in
+// libs/screen/image.cpp: a header, the sorted codes, the advances, the kerning pairs and the
+// glyphs as 4bpp images, so that they can be drawn a word at a time.
+function nativeFont(glyphs) {
+    const w = prop.charWidth, h = prop.charHeight
+    const byteHeight = (h + 7) >> 3
+    const columnBytes = ((h * 4 + 31) >> 5) << 2
+    glyphs = glyphs.filter((g, i) => !i || g.readUInt16LE(0) != glyphs[i - 1].readUInt16LE(0))
+    const n = glyphs.length
+    const pairs = kerning.slice(0)
+    pairs.sort((a, b) => a.left - b.left || a.right - b.right)
+
+    const advancesOff = 8 + 2 * n
+    const pairsOff = (advancesOff + n + 3) & ~3
+    const glyphsOff = pairsOff + 8 * pairs.length
+    const res = Buffer.alloc(glyphsOff + n * w * columnBytes)
+    res.writeUInt16LE(0xdf4e, 0)
+    res[2] = w
+    res[3] = h
+    res.writeUInt16LE(n, 4)
+    res.writeUInt16LE(pairs.length, 6)
+    glyphs.forEach((g, k) => {
+        res.writeUInt16LE(g.readUInt16LE(0), 8 + 2 * k)
+        let inked = 0
+        for (let i = 0; i < w; ++i) {
+            for (let j = 0; j < h; ++j) {
+                if (g[2 + i * byteHeight + (j >> 3)] & (1 << (j & 7))) {
+                    res[glyphsOff + (k * w + i) * columnBytes + (j >> 1)] |= j & 1 ? 0x10 : 0x01
+                    inked = i + 1
+                }
+            }
+        }
+        // with --proportional, the ink and a column of space, and half a glyph for blank ones
+        res[advancesOff + k] = !proportional ? w : inked ? Math.min(inked + 1, w) : (w + 1) >> 1
+    })
+    pairs.forEach((p, k) => {
+        res.writeUInt16LE(p.left, pairsOff + 8 * k)
+        res.writeUInt16LE(p.right, pairsOff + 8 * k + 2)
+        res.writeInt16LE(p.adjust, pairsOff + 8 * k + 4)
+    })
+    return res
+}
+
+function fmtNative(buf) {
+    out += "hex`\n"
+    for (let p = 0; p < buf.length; p += 48)
+        out += buf.slice(p, p + 48).toString("hex") + "\n"
+    out += "`,\n"
+}
+
 function showChar(buf, ptr, ch, hh) {
     if (!hh) hh = prop.charHeight
     out += `\n* '${String.fromCharCode(ch)}' ${ch} U+${("000" + ch.toString(16)).slice(-4)}\n`
@@ -526,7 +593,11 @@ if (mode == 2) {
         }
         out = JSON.stringify(outp, null, 4)
     } else {
-        fmt(unicodeBuf)    
+        fmt(unicodeBuf)
+        if (native) {
+            out += "glyphs: "
+            fmtNative(nativeFont(unicodeBuf))
+        }
     }
 }
 
@@ -0,0 +1,113 @@
+// Shared by snorfs/SNORFS-bench.cpp and raffs/raffs-bench.cpp: a simulated clock driven by the
+// flash operations, and the report for a workload.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+#include <algorithm>
+
+// Cost of flash operations, in microseconds
+struct FlashTiming {
+    double readUs;        // per read command; 0 for memory-mapped flash
+    double readByteUs;    // per byte read
+    double programUs;     // per program command
+    double programByteUs; // per byte programmed
+    double eraseUs;       // per erase unit (row or page)
+
+    // usage: <bench> [workload] [program-us] [program-byte-us] [erase-us]
+    void parseArgs(int argc, char **argv) {
+        if (argc > 2)
+            programUs = atof(argv[2]);
+        if (argc > 3)
+            programByteUs = atof(argv[3]);
+        if (argc > 4)
+            eraseUs = atof(argv[4]);
+        printf("timing: program %.1fus + %.2fus/byte, erase %.0fus, read %.1fus + %.2fus/byte\n",
+               programUs, programByteUs, eraseUs, readUs, readByteUs);
+    }
+};
+
+class Bench {
+    std::vector<uint32_t> latencies; // us, of every operation
+    std::vector<uint32_t> gcPauses;  // us, of operations that GCed
+    double opStart;
+    uint32_t gcAtStart;
+
+    static uint32_t percentile(std::vector<uint32_t> &v, int pct) {
+        if (v.empty())
+            return 0;
+        std::sort(v.begin(), v.end());
+        return v[std::min(v.size() - 1, v.size() * pct / 100)];
+    }
+
+  public:
+    FlashTiming timing;
+    double nowUs; // simulated; only flash operations take time
+    uint64_t userBytes, flashBytes;
+    uint32_t erases;
+    // background GC, outside of operations
+    double backgroundUs;
+    uint32_t backgroundGCs;
+
+    Bench(FlashTiming t) : timing(t) { reset(); }
+
+    void reset() {
+        latencies.clear();
+        gcPauses.clear();
+        nowUs = 0;
+        userBytes = flashBytes = 0;
+        erases = 0;
+        backgroundUs = 0;
+        backgroundGCs = 0;
+    }
+
+    void read(uint32_t len) { nowUs += timing.readUs + len * timing.readByteUs; }
+    void program(uint32_t len) {
+        nowUs += timing.programUs + len * timing.programByteUs;
+        flashBytes += len;
+    }
+    void erase() {
+        nowUs += timing.eraseUs;
+        erases++;
+    }
+
+    void begin(uint32_t gcRuns) {
+        opStart = nowUs;
+        gcAtStart = gcRuns;
+    }
+    // bytes is how much the user wrote
+    void end(uint32_t gcRuns, uint32_t bytes) {
+        uint32_t us = nowUs - opStart;
+        latencies.push_back(us);
+        if (gcRuns != gcAtStart)
+            gcPauses.push_back(us);
+        userBytes += bytes;
+    }
+
+    void background(double startUs, uint32_t gcs) {
+        backgroundUs += nowUs - startUs;
+        backgroundGCs += gcs;
+    }
+
+    void report(const char *name) {
+        double secs = nowUs / 1e6;
+        printf("%s: %d ops, %dk written in %.1fs simulated; %.1f ops/s, %.1fk/s\n", name,
+               (int)latencies.size(), (int)(userBytes / 1024), secs, latencies.size() / secs,
+               userBytes / 1024.0 / secs);
+        auto p50 = percentile(latencies, 50), p99 = percentile(latencies, 99);
+        printf("  latency: p50 %dus, p99 %dus, max %dus\n", p50, p99, percentile(latencies, 100));
+        printf("  write amplification: %.2f (%dk programmed), %d erases\n",
+               userBytes ? (double)flashBytes / userBytes : 0, (int)(flashBytes / 1024), erases);
+        auto n = gcPauses.size();
+        p50 = percentile(gcPauses, 50);
+        p99 = percentile(gcPauses, 99);
+        printf("  GC pauses: %d, p50 %dms, p99 %dms, max %dms\n", (int)n, p50 / 1000, p99 / 1000,
+               percentile(gcPauses, 100) / 1000);
+        if (backgroundGCs)
+            printf("  background: %d GCs in %dms\n", backgroundGCs, (int)(backgroundUs / 1000));
+    }
+};
@@ -0,0 +1,206 @@
+// Times the packet processing of libs/pulse on the host, per packet of the largest size, and
+// checks it against the bit-by-bit code it replaced.
+#include "pulsecodec.h"
+
+#include <stdlib.h>
+#include <chrono>
+
+#define MSG_SIZE 32 // PULSE_MAX_MSG_SIZE - 2
+#define NUM_PACKETS 20000
+
+using namespace network;
+
+namespace ref {
+
+static const uint8_t hamming[16] = {
+    0b0000000, 0b1110000, 0b1001100, 0b0111100, 0b0101010, 0b1011010, 0b1100110, 0b0010110,
+    0b1101001, 0b0011001, 0b0100101, 0b1010101, 0b1000011, 0b0110011, 0b0001111, 0b1111111,
+};
+
+static const uint8_t invHamming[64] = {
+    0x00, 0x0c, 0x0a, 0x7e, 0x09, 0x4e, 0x2e, 0xee, 0x09, 0x7d, 0x7b, 0x77, 0x99, 0x59, 0x39, 0x7e,
+    0x0a, 0x4d, 0xaa, 0x6a, 0x48, 0x44, 0x3a, 0x4e, 0x1d, 0xdd, 0x3a, 0x7d, 0x39, 0x4d, 0x33, 0x3f,
+    0x0c, 0xcc, 0x2b, 0x6c, 0x28, 0x5c, 0x22, 0x2e, 0x1b, 0x5c, 0xbb, 0x7b, 0x59, 0x55, 0x2b, 0x5f,
+    0x18, 0x6c, 0x6a, 0x66, 0x88, 0x48, 0x28, 0x6f, 0x11, 0x1d, 0x1b, 0x6f, 0x18, 0x5f, 0x3f, 0xff};
+
+static const uint8_t bitsToGap[4] = {1, 2, 4, 3};
+
+static int lookupInvHaming(int v) {
+    int k = invHamming[v >> 1];
+    if (v & 1)
+        return (k & 0xf);
+    else
+        return (k >> 4);
+}
+
+static void decodeHamming(uint32_t r, uint8_t *dst) {
+    int a0 = 0, a1 = 0, b0 = 0, b1 = 0;
+    int p = 0;
+    for (int i = 0; i < 7; ++i) {
+        a0 |= ((r >> p++) & 1) << i;
+        b0 |= ((r >> p++) & 1) << i;
+        a1 |= ((r >> p++) & 1) << i;
+        b1 |= ((r >> p++) & 1) << i;
+    }
+    dst[0] = (lookupInvHaming(a0) << 4) | lookupInvHaming(a1);
+    dst[1] = (lookupInvHaming(b0) << 4) | lookupInvHaming(b1);
+}
+
+static void pushTwo(BitVector &bv, uint8_t a, uint8_t b) {
+    int gap = bitsToGap[b * 2 + a];
+    bv.push(1);
+    while (gap--)
+        bv.push(0);
+}
+
+static void encodeHamming(BitVector &bv, uint8_t a, uint8_t b) {
+    int a0 = hamming[a >> 4];
+    int a1 = hamming[a & 0xf];
+    int b0 = hamming[b >> 4];
+    int b1 = hamming[b & 0xf];
+    for (int i = 0; i < 7; ++i) {
+        pushTwo(bv, (a0 >> i) & 1, (b0 >> i) & 1);
+        pushTwo(bv, (a1 >> i) & 1, (b1 >> i) & 1);
+    }
+}
+
+static uint16_t crc16ccit(const uint8_t *data, uint32_t len) {
+    uint16_t crc = 0xffff;
+    while (len--) {
+        crc ^= (*data++ << 8);
+        for (int i = 0; i < 8; ++i) {
+            if (crc & 0x8000)
+                crc = crc << 1 ^ 0x1021;
+            else
+                crc = crc << 1;
+        }
+    }
+    return crc;
+}
+
+} // namespace ref
+
+struct Codec {
+    void (*encode)(BitVector &bv, uint8_t a, uint8_t b);
+    void (*decode)(uint32_t r, uint8_t *dst);
+    uint16_t (*crc)(const uint8_t *data, uint32_t len);
+};
+
+// PulseBase::send(), without the pre- and postamble
+static void sendPacket(const Codec &c, BitVector &bv, const uint8_t *data, int len) {
+    bv.setLength(0);
+    for (int i = 0; i < len; i += 2)
+        c.encode(bv, data[i], data[i + 1]);
+    uint16_t crc = c.crc(data, len);
+    c.encode(bv, crc & 0xff, crc >> 8);
+}
+
+// the gaps between the pulses of bv, in pulses, as the receiver measures them
+static int toGaps(BitVector &bv, uint8_t *gaps) {
+    int n = 0, last = -1;
+    for (int i = 0; i < bv.size(); ++i)
+        if (bv.get(i)) {
+            if (last >= 0)
+                gaps[n++] = i - last - 1;
+            last = i;
+        }
+    gaps[n++] = 4; // the final mark ends the last one
+    return n;
+}
+
+// PulseBase::packetEnd(); -1 on a bad CRC
+static int receivePacket(const Codec &c, const uint8_t *gaps, int numGaps, uint8_t *buf) {
+    int numBits = 0, ptr = 0;
+    uint32_t r = 0;
+    for (int i = 0; i < numGaps; ++i) {
+        r |= (uint32_t)gapToBits[gaps[i]] << numBits;
+        numBits += 2;
+        if (numBits == 28) {
+            c.decode(r, buf + ptr);
+            numBits = 0;
+            r = 0;
+            ptr += 2;
+        }
+    }
+    ptr -= 2;
+    uint16_t crc = c.crc(buf, ptr);
+    return crc == ((buf[ptr + 1] << 8) | buf[ptr]) ? ptr : -1;
+}
+
+static double nowUs() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+static void bench(const char *name, const Codec &c, uint8_t (*packets)[MSG_SIZE]) {
+    BitVector bv;
+    uint8_t gaps[(MSG_SIZE + 2) * 14 + 1];
+    uint8_t buf[MSG_SIZE + 2];
+    int numGaps[NUM_PACKETS];
+    static uint8_t allGaps[NUM_PACKETS][sizeof(gaps)];
+
+    double t0 = nowUs();
+    for (int i = 0; i < NUM_PACKETS; ++i) {
+        sendPacket(c, bv, packets[i], MSG_SIZE);
+        numGaps[i] = toGaps(bv, allGaps[i]);
+    }
+    double t1 = nowUs();
+    for (int i = 0; i < NUM_PACKETS; ++i)
+        if (receivePacket(c, allGaps[i], numGaps[i], buf) != MSG_SIZE ||
+            memcmp(buf, packets[i], MSG_SIZE)) {
+            printf("%s: packet %d not received\n", name, i);
+            exit(1);
+        }
+    double t2 = nowUs();
+    // toGaps() is the same for both, and not part of sending
+    double tg0 = nowUs();
+    for (int i = 0; i < NUM_PACKETS; ++i)
+        toGaps(bv, gaps);
+    double tg = nowUs() - tg0;
+
+    printf("%s: send %.2fus, receive %.2fus per %d byte packet\n", name,
+           (t1 - t0 - tg) / NUM_PACKETS, (t2 - t1) / NUM_PACKETS, MSG_SIZE);
+}
+
+int main() {
+    static uint8_t packets[NUM_PACKETS][MSG_SIZE];
+    srand(42);
+    for (int i = 0; i < NUM_PACKETS; ++i)
+        for (int j = 0; j < MSG_SIZE; ++j)
+            packets[i][j] = rand();
+
+    Codec bits = {ref::encodeHamming, ref::decodeHamming, ref::crc16ccit};
+    Codec tables = {encodeHamming, decodeHamming, crc16ccit};
+
+    // the same pulses and bytes for all values
+    for (int a = 0; a < 256; ++a)
+        for (int b = 0; b < 256; ++b) {
+            BitVector x, y;
+            ref::encodeHamming(x, a, b);
+            encodeHamming(y, a, b);
+            if (x.size() != y.size() || x.getBits(0, 32) != y.getBits(0, 32) ||
+                x.getBits(32, 32) != y.getBits(32, 32)) {
+                printf("encode %02x %02x differs\n", a, b);
+                return 1;
+            }
+        }
+    for (uint32_t r = 0; r < (1 << 28); r += 4093) {
+        uint8_t x[2], y[2];
+        ref::decodeHamming(r, x);
+        decodeHamming(r, y);
+        if (x[0] != y[0] || x[1] != y[1]) {
+            printf("decode %07x differs\n", r);
+            return 1;
+        }
+    }
+    for (int i = 0; i < 1000; ++i)
+        if (ref::crc16ccit(packets[i], i % MSG_SIZE) != crc16ccit(packets[i], i % MSG_SIZE)) {
+            printf("crc differs\n");
+            return 1;
+        }
+    printf("same as the bit-by-bit codec\n");
+
+    bench("bit-by-bit", bits, packets);
+    bench("tables", tables, packets);
+    return 0;
+}
@@ -0,0 +1,30 @@
+/* dummy */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define DMESG(...) printf(__VA_ARGS__)
+
+// BitVector keeps 32 bits in each, which a pointer can't be cast from on the host
+struct TValue {
+    uint32_t v;
+    TValue(uint32_t v = 0) : v(v) {}
+    operator uint32_t() const { return v; }
+};
+
+class LLSegment {
+    std::vector<TValue> items;
+
+  public:
+    void set(unsigned idx, TValue v) {
+        if (idx >= items.size())
+            items.resize(idx + 1);
+        items[idx] = v;
+    }
+    void setLength(unsigned newLen) { items.resize(newLen); }
+    TValue get(unsigned i) { return i < items.size() ? items[i] : TValue(); }
+    void destroy() { items.clear(); }
+};
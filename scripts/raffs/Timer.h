@@ -0,0 +1,6 @@
+/* dummy */
+#pragma once
+
+static inline unsigned long system_timer_current_time() {
+    return 0;
+}
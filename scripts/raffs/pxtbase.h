@@ -0,0 +1,15 @@
+/* dummy */
+#pragma once
+
+static inline uint32_t hash_fnv1(const void *data, unsigned len) {
+    const uint8_t *d = (const uint8_t *)data;
+    uint32_t h = 0x811c9dc5;
+    while (len--)
+        h = (h * 0x1000193) ^ *d++;
+    return h;
+}
+
+namespace pxt {
+struct VTable {};
+static const VTable buffer_vt = {};
+} // namespace pxt
@@ -0,0 +1,148 @@
+#include "RAFFS.h"
+#include "../fs-bench.h"
+
+#define NS pxt::raffs
+
+#define oops() assert(false)
+
+// nRF52: 4k pages erased in 85ms, 41us per word written
+#define PAGE_SIZE 4096
+#define FS_SIZE (32 * 1024)
+
+Bench bench({0, 0, 0, 41.0 / 4, 85000});
+
+int codal::Flash::totalSize() {
+    return FS_SIZE;
+}
+
+class BenchFlash : public codal::Flash {
+  public:
+    uint8_t *data;
+
+    BenchFlash() {
+        data = (uint8_t *)aligned_alloc(PAGE_SIZE, FS_SIZE);
+        memset(data, 0xff, FS_SIZE);
+    }
+
+    int pageSize(uintptr_t) { return PAGE_SIZE; }
+    int erasePage(uintptr_t addr) {
+        memset((void *)addr, 0xff, PAGE_SIZE);
+        bench.erase();
+        return 0;
+    }
+    int writeBytes(uintptr_t dst, const void *src, uint32_t len) {
+        auto d = (uint32_t *)dst;
+        auto s = (const uint32_t *)src;
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < len / 4; ++i) {
+            // words left at 0xffffffff aren't written
+            if (s[i] != 0xffffffff)
+                n += 4;
+            d[i] &= s[i];
+        }
+        bench.program(n);
+        return 0;
+    }
+};
+
+BenchFlash flash;
+NS::FS *fs;
+uint8_t value[4096];
+
+static void randomValue(uint32_t len) {
+    for (uint32_t i = 0; i < len; ++i)
+        value[i] = rand();
+}
+
+static void write(const char *key, uint32_t len) {
+    randomValue(len);
+    bench.begin(fs->stats.gcRuns);
+    if (fs->write(key, value, len))
+        oops();
+    bench.end(fs->stats.gcRuns, len);
+}
+
+// a game's high scores and options: small values rewritten often
+static void settingsChurn(int ops) {
+    char key[16];
+    while (ops--) {
+        snprintf(key, sizeof(key), "opt%d", rand() % 20);
+        write(key, 4 + rand() % 60);
+    }
+}
+
+// saved levels: a few large values
+static void levels(int ops) {
+    char key[16];
+    while (ops--) {
+        snprintf(key, sizeof(key), "level%d", rand() % 5);
+        write(key, 200 + rand() % 1800);
+    }
+}
+
+// many small keys, created and removed
+static void manyKeys(int ops) {
+    char key[16];
+    while (ops--) {
+        snprintf(key, sizeof(key), "k%d", rand() % 300);
+        if (rand() % 10 < 4) {
+            bench.begin(fs->stats.gcRuns);
+            fs->remove(key);
+            bench.end(fs->stats.gcRuns, 0);
+        } else {
+            write(key, 8 + rand() % 24);
+        }
+    }
+}
+
+// saving a game state of 20 keys at once
+static void batches(int ops) {
+    char key[16];
+    while (ops--) {
+        fs->beginBatch();
+        uint32_t bytes = 0;
+        for (int i = 0; i < 20; ++i) {
+            snprintf(key, sizeof(key), "state%d", i);
+            auto len = 4 + rand() % 28;
+            randomValue(len);
+            fs->write(key, value, len);
+            bytes += len;
+        }
+        bench.begin(fs->stats.gcRuns);
+        if (fs->commitBatch())
+            oops();
+        bench.end(fs->stats.gcRuns, bytes);
+    }
+}
+
+struct Workload {
+    const char *name;
+    void (*run)(int ops);
+    int ops;
+};
+
+static const Workload workloads[] = {
+    {"settings", settingsChurn, 20000},
+    {"levels", levels, 2000},
+    {"many", manyKeys, 20000},
+    {"batch", batches, 1000},
+};
+
+int main(int argc, char **argv) {
+    bench.timing.parseArgs(argc, argv);
+
+    for (auto &w : workloads) {
+        if (argc > 1 && strcmp(argv[1], "all") && strcmp(argv[1], w.name))
+            continue;
+        srand(1);
+        memset(flash.data, 0xff, FS_SIZE);
+        delete fs;
+        fs = new NS::FS(flash, (uintptr_t)flash.data, FS_SIZE);
+        fs->exists("foobar"); // format
+        bench.reset();
+        w.run(w.ops);
+        bench.report(w.name);
+    }
+
+    return 0;
+}
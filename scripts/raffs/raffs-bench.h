@@ -0,0 +1,5 @@
+#include "raffs-test.h"
+
+// only the report is of interest
+#undef LOG
+#define LOG NOLOG
@@ -14,6 +14,7 @@ using namespace std;
 #define SZMULT 5
 
 NS::FS *fs;
+bool inBatch;
 
 class FileCache {
   public:
@@ -42,6 +43,16 @@ class FileCache {
         if (sz == 0)
             return;
 
+        // staged values are only in RAM
+        auto inPlace = (const uint32_t *)fs->readInPlace(name);
+        if (sz >= RAFFS_INPLACE_MIN_SIZE && !inBatch) {
+            assert(inPlace && inPlace[1] == (uint32_t)sz);
+            assert(memcmp(inPlace + 2, data.data(), sz) == 0);
+        } else {
+            assert(!inPlace);
+        }
+        fs->read(name, NULL, 0);
+
         uint8_t buf[sz];
         int sz2 = fs->read(NULL, buf, sz);
         assert(sz == sz2);
@@ -87,11 +98,10 @@ class MemFlash : public codal::Flash {
         uint8_t *ptr = (uint8_t *)buffer;
 
 #ifdef SAMD51
-        assert(len == 16);
-        if (((uint64_t *)buffer)[0] != 0xffffffffffffffff)
-            assert(((uint64_t *)(data + addr))[0] == 0xffffffffffffffff);
-        if (((uint64_t *)buffer)[1] != 0xffffffffffffffff)
-            assert(((uint64_t *)(data + addr))[1] == 0xffffffffffffffff);
+        assert(len % 8 == 0);
+        for (uint32_t i = 0; i < len / 8; ++i)
+            if (((uint64_t *)buffer)[i] != 0xffffffffffffffff)
+                assert(((uint64_t *)(data + addr))[i] == 0xffffffffffffffff);
 #endif
 
         for (uint32_t i = 0; i < len; ++i) {
@@ -110,15 +120,21 @@ class MemFlash : public codal::Flash {
             ptr++;
         }
         ticks += len * 3 + 50;
+        if (snapshotAfterWrites && --snapshotAfterWrites == 0)
+            takeSnapshot();
         return 0;
     }
 
+    void takeSnapshot() {
+        beforeErase = allocData();
+        memcpy(beforeErase, data, chipSize());
+    }
+
     void eraseCore(uint32_t addr, uint32_t sz) {
         numErases++;
         if (snapshotBeforeErase) {
             snapshotBeforeErase = false;
-            beforeErase = allocData();
-            memcpy(beforeErase, data, chipSize());
+            takeSnapshot();
         }
         ticks += sz * 10;
         erase(addr, sz);
@@ -130,6 +146,7 @@ class MemFlash : public codal::Flash {
         data = allocData();
         beforeErase = NULL;
         snapshotBeforeErase = false;
+        snapshotAfterWrites = 0;
 
         bytesWritten = 0;
         numWrites = 0;
@@ -138,6 +155,8 @@ class MemFlash : public codal::Flash {
     }
 
     bool snapshotBeforeErase;
+    // as if power was lost after this many more writes
+    int snapshotAfterWrites;
     uint8_t *beforeErase;
     int bytesWritten;
     int numWrites;
@@ -167,6 +186,10 @@ class MemFlash : public codal::Flash {
     int eraseChip() { return erase(0, chipSize()); }
 };
 
+int codal::Flash::totalSize() {
+    return 0;
+}
+
 MemFlash flash(128 * 1024 / SNORFS_PAGE_SIZE);
 uint8_t randomData[1024 * 1024 * 16];
 uint32_t fileSeqNo;
@@ -277,6 +300,66 @@ void multiTest(int nfiles, int blockSize, int reps) {
     }
 }
 
+void batchTest(int nfiles, int blockSize) {
+    LOGV("batch(%d,%d)", nfiles, blockSize);
+
+    auto fcs = new FileCache *[nfiles];
+    for (int i = 0; i < nfiles; ++i)
+        fcs[i] = lookupFile(getFileName(++fileSeqNo));
+
+    // staged values are read back, but only written on commit
+    fs->beginBatch();
+    inBatch = true;
+    for (int i = 0; i < nfiles; ++i) {
+        auto d = getRandomData();
+        auto len = rand() % blockSize;
+        fs->write(fcs[i]->name, d, len);
+        fcs[i]->write(d, len);
+        fcs[i]->validate();
+    }
+    inBatch = false;
+    auto numWrites = flash.numWrites;
+    assert(fs->commitBatch() == 0);
+    LOG("batch of %d: %d writes", nfiles, flash.numWrites - numWrites);
+    remount();
+    testAll();
+
+    // lose power somewhere in the middle of a commit; either all or none of it survives
+    for (int k = 1;; ++k) {
+        vector<vector<uint8_t>> prev, next;
+        fs->beginBatch();
+        for (int i = 0; i < nfiles; ++i) {
+            auto d = getRandomData();
+            auto len = rand() % blockSize;
+            // tells which of them survived
+            if (i == 0 && len == (int)fcs[0]->data.size())
+                len = (len + 1) % blockSize;
+            fs->write(fcs[i]->name, d, len);
+            prev.push_back(fcs[i]->data);
+            fcs[i]->write(d, len);
+            next.push_back(fcs[i]->data);
+        }
+        flash.snapshotAfterWrites = k;
+        assert(fs->commitBatch() == 0);
+        if (flash.snapshotAfterWrites) {
+            flash.snapshotAfterWrites = 0;
+            break;
+        }
+
+        flash.useSnapshot();
+        remount();
+        bool isNew = fs->read(fcs[0]->name, NULL, 0) == (int)next[0].size();
+        for (int i = 0; i < nfiles; ++i)
+            fcs[i]->data = isNew ? next[i] : prev[i];
+        testAll();
+    }
+    testAll();
+
+    for (int i = 0; i < nfiles; ++i) {
+        fs->remove(fcs[i]->name);
+        fcs[i]->del = true;
+    }
+}
 
 int main() {
     for (uint32_t i = 0; i < sizeof(randomData); ++i)
@@ -326,6 +409,11 @@ int main() {
 
     LOG("two");
 
+    batchTest(20, 100);
+    multiTest(10, 300, SZMULT);
+    batchTest(5, 1000);
+    testAll();
+
     multiTest(2, 1000, SZMULT);
     multiTest(10, 1000, SZMULT);
     for (int i = 0; i < 20; ++i)
@@ -0,0 +1,10 @@
+#pragma once
+
+#define DEVICE_ID_NOTIFY 1023
+
+namespace codal {
+static inline uint16_t allocateNotifyEvent() {
+    static uint16_t userNotifyId = 1;
+    return userNotifyId++;
+}
+}
@@ -0,0 +1,155 @@
+#include "SNORFS.h"
+#include "../fs-bench.h"
+
+#define oops() assert(false)
+
+typedef codal::snorfs::File File;
+
+#define FLASH_SIZE (2 * 1024 * 1024)
+
+// S25FL116K: 1.3k/ms reads, 0.7ms page program, 600ms 64k erase
+Bench bench({5, 0.77, 50, 2.5, 600000});
+
+class BenchFlash : public codal::SPIFlash {
+  public:
+    uint8_t *data;
+
+    BenchFlash() { data = new uint8_t[FLASH_SIZE]; }
+
+    int numPages() { return FLASH_SIZE / SPIFLASH_PAGE_SIZE; }
+    int readBytes(uint32_t addr, void *buffer, uint32_t len) {
+        memcpy(buffer, data + addr, len);
+        bench.read(len);
+        return 0;
+    }
+    int writeBytes(uint32_t addr, const void *buffer, uint32_t len) {
+        auto s = (const uint8_t *)buffer;
+        for (uint32_t i = 0; i < len; ++i)
+            data[addr + i] &= s[i];
+        bench.program(len);
+        return 0;
+    }
+    int eraseSmallRow(uint32_t) {
+        oops();
+        return 0;
+    }
+    int eraseBigRow(uint32_t addr) {
+        memset(data + addr, 0xff, SPIFLASH_BIG_ROW_SIZE);
+        bench.erase();
+        return 0;
+    }
+    int eraseChip() {
+        memset(data, 0xff, FLASH_SIZE);
+        return 0;
+    }
+};
+
+BenchFlash flash;
+codal::snorfs::FS *fs;
+uint8_t value[4096];
+
+static void randomValue(uint32_t len) {
+    for (uint32_t i = 0; i < len; ++i)
+        value[i] = rand();
+}
+
+// what storage.cpp does from its fibers every so often
+static void idle() {
+    auto start = bench.nowUs;
+    auto gcs = fs->stats.gcRuns;
+    fs->flush();
+    while (fs->maybeGC())
+        ;
+    bench.background(start, fs->stats.gcRuns - gcs);
+}
+
+// datalogger: lines appended to a file, which is started over once it's big
+static void datalogger(int ops) {
+    auto f = fs->open("log.csv");
+    for (int i = 0; i < ops; ++i) {
+        auto len = 30 + rand() % 20;
+        randomValue(len);
+        bench.begin(fs->stats.gcRuns);
+        f->append(value, len);
+        if (f->size() > 256 * 1024)
+            f->overwrite(NULL, 0);
+        bench.end(fs->stats.gcRuns, len);
+        if (i % 25 == 0)
+            idle();
+    }
+    delete f;
+}
+
+// small files overwritten, like settings or saved games
+static void settingsChurn(int ops) {
+    char name[16];
+    for (int i = 0; i < ops; ++i) {
+        snprintf(name, sizeof(name), "cfg%d.json", rand() % 10);
+        auto len = 20 + rand() % 180;
+        randomValue(len);
+        bench.begin(fs->stats.gcRuns);
+        auto f = fs->open(name);
+        f->overwrite(value, len);
+        delete f;
+        bench.end(fs->stats.gcRuns, len);
+        if (i % 10 == 0)
+            idle();
+    }
+}
+
+// many small files, appended to, read and removed
+static void manyFiles(int ops) {
+    char name[16];
+    for (int i = 0; i < ops; ++i) {
+        snprintf(name, sizeof(name), "f%d.dat", rand() % 200);
+        auto r = rand() % 10;
+        uint32_t len = 0;
+        bench.begin(fs->stats.gcRuns);
+        auto f = fs->open(name);
+        if (r < 5) {
+            len = 1 + rand() % 500;
+            randomValue(len);
+            f->append(value, len);
+        } else if (r < 7) {
+            while (f->read(value, sizeof(value)) > 0)
+                ;
+        } else {
+            f->del();
+        }
+        delete f;
+        bench.end(fs->stats.gcRuns, len);
+        if (i % 50 == 0)
+            idle();
+    }
+}
+
+struct Workload {
+    const char *name;
+    void (*run)(int ops);
+    int ops;
+};
+
+static const Workload workloads[] = {
+    {"datalogger", datalogger, 100000},
+    {"settings", settingsChurn, 5000},
+    {"many", manyFiles, 20000},
+};
+
+int main(int argc, char **argv) {
+    bench.timing.parseArgs(argc, argv);
+
+    for (auto &w : workloads) {
+        if (argc > 1 && strcmp(argv[1], "all") && strcmp(argv[1], w.name))
+            continue;
+        srand(1);
+        flash.eraseChip();
+        delete fs;
+        fs = new codal::snorfs::FS(flash);
+        fs->exists("foobar"); // format
+        bench.reset();
+        w.run(w.ops);
+        bench.report(w.name);
+    }
+
+    return 0;
+}
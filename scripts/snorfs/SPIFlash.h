@@ -0,0 +1,20 @@
+/* dummy, with the interface of codal's SPIFlash */
+#pragma once
+
+#define SPIFLASH_PAGE_SIZE 256
+#define SPIFLASH_SMALL_ROW_PAGES 16
+#define SPIFLASH_BIG_ROW_PAGES 256
+#define SPIFLASH_SMALL_ROW_SIZE (SPIFLASH_PAGE_SIZE * SPIFLASH_SMALL_ROW_PAGES)
+#define SPIFLASH_BIG_ROW_SIZE (SPIFLASH_PAGE_SIZE * SPIFLASH_BIG_ROW_PAGES)
+
+namespace codal {
+class SPIFlash {
+  public:
+    virtual int numPages() = 0;
+    virtual int readBytes(uint32_t addr, void *buffer, uint32_t len) = 0;
+    virtual int writeBytes(uint32_t addr, const void *buffer, uint32_t len) = 0;
+    virtual int eraseSmallRow(uint32_t addr) = 0;
+    virtual int eraseBigRow(uint32_t addr) = 0;
+    virtual int eraseChip() = 0;
+};
+} // namespace codal
@@ -0,0 +1,71 @@
+// Convert a binary trace (see TraceEvent in libs/base/pxtbase.h) to Chrome trace JSON,
+// for chrome://tracing or https://ui.perfetto.dev
+//
+//   node trace2json.js serial-log.txt > trace.json  (the "TRACE:" hex from control.dumpTrace())
+//   node trace2json.js trace.bin > trace.json       (records as they are, from pxt_get_logs(1))
+
+let fs = require("fs")
+
+// in the order of TraceEvent; an event ending in "End" closes the one before it
+const names = [
+    "None",
+    "FiberRun",
+    "EventDispatch",
+    "GC",
+    "GCEnd",
+    "ScreenUpdate",
+    "ScreenUpdateEnd",
+    "MixerFill",
+    "MixerFillEnd",
+]
+const USER = 0x100
+
+let data = fs.readFileSync(process.argv[2])
+const text = data.toString("binary")
+const idx = text.lastIndexOf("TRACE:\n")
+if (idx >= 0) {
+    let hex = ""
+    for (let l of text.slice(idx + 7).split(/\r?\n/)) {
+        if (!/^[0-9a-f]+$/.test(l))
+            break
+        hex += l
+    }
+    data = Buffer.from(hex, "hex")
+}
+
+let events = []
+let prevTime = -1
+let timeBase = 0
+let fiber = null
+for (let i = 0; i + 16 <= data.length; i += 16) {
+    let time = data.readUInt32LE(i)
+    const ev = data.readUInt32LE(i + 4)
+    const arg0 = data.readUInt32LE(i + 8)
+    const arg1 = data.readUInt32LE(i + 12)
+
+    // the microsecond timer wraps every 71 minutes
+    if (prevTime >= 0 && time < prevTime && prevTime - time > 0x80000000)
+        timeBase += 0x100000000
+    prevTime = time
+    const ts = timeBase + time
+
+    const name = ev >= USER ? "User" + (ev - USER) : names[ev] || "Event" + ev
+    const args = { arg0, arg1 }
+    if (name == "FiberRun") {
+        // a fiber runs until the next one does
+        if (fiber)
+            events.push({ name: fiber, ph: "E", ts, pid: 0, tid: 0 })
+        fiber = "fiber " + arg0.toString(16)
+        events.push({ name: fiber, ph: "B", ts, pid: 0, tid: 0 })
+    } else if (/End$/.test(name) && names.indexOf(name.slice(0, -3)) >= 0) {
+        events.push({ name: name.slice(0, -3), ph: "E", ts, pid: 0, tid: 1 })
+    } else if (names.indexOf(name + "End") >= 0) {
+        events.push({ name, ph: "B", ts, pid: 0, tid: 1, args })
+    } else {
+        events.push({ name, ph: "i", s: "t", ts, pid: 0, tid: 1, args })
+    }
+}
+if (fiber)
+    events.push({ name: fiber, ph: "E", ts: prevTime + timeBase, pid: 0, tid: 0 })
+
+console.log(JSON.stringify({ traceEvents: events, displayTimeUnit: "ms" }, null, 1))